@@ -173,6 +173,17 @@ raw_pressure_config_s getRawPressureConfigs(cfg::Configuration &syscfg) {
                              cfg.rbrCodaReadingPeriodMs);
     save_config = true;
   }
+  cfg.rawFormat = DEFAULT_RAW_PRESSURE_FORMAT;
+  if (!syscfg.getConfig(AppConfig::RBR_RAW_FORMAT, strlen(AppConfig::RBR_RAW_FORMAT),
+                        cfg.rawFormat)) {
+    bridgeLogPrint(BRIDGE_CFG, BM_COMMON_LOG_LEVEL_INFO, USE_HEADER,
+                   "Failed to get rbr raw pressure format from config, using default value and "
+                   "writing to config: %" PRIu32 "\n",
+                   cfg.rawFormat);
+    syscfg.setConfig(AppConfig::RBR_RAW_FORMAT, strlen(AppConfig::RBR_RAW_FORMAT),
+                     cfg.rawFormat);
+    save_config = true;
+  }
   if (save_config) {
     syscfg.saveConfig(false);
   }
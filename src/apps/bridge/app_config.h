@@ -4,6 +4,23 @@
 
 #define DEFAULT_TRANSMIT_AGGREGATIONS 1
 #define DEFAULT_SAMPLES_PER_REPORT 2
+#define DEFAULT_SENSOR_REPORT_FORMAT SENSOR_REPORT_FORMAT_CBOR
+
+typedef enum {
+  SENSOR_REPORT_FORMAT_CBOR = 0,
+  // Quantized and bit-packed, see packed_sensor_report_encoder.h
+  SENSOR_REPORT_FORMAT_PACKED = 1,
+} sensor_report_format_e;
+
+#ifdef RAW_PRESSURE_ENABLE
+#define DEFAULT_RAW_PRESSURE_FORMAT RAW_PRESSURE_FORMAT_CBOR
+
+typedef enum {
+  RAW_PRESSURE_FORMAT_CBOR = 0,
+  // Quantized and Rice coded residuals, see rbr_pressure_residual_encoder.h
+  RAW_PRESSURE_FORMAT_RESIDUAL = 1,
+} raw_pressure_format_e;
+#endif // RAW_PRESSURE_ENABLE
 
 namespace AppConfig {
 
@@ -16,6 +33,7 @@ constexpr const char *BRIDGE_POWER_CONTROLLER_ENABLED = "bridgePowerControllerEn
 constexpr const char *ALIGNMENT_INTERVAL_5MIN = "alignmentInterval5Min";
 constexpr const char *TRANSMIT_AGGREGATIONS = "transmitAggregations";
 constexpr const char *SAMPLES_PER_REPORT = "samplesPerReport";
+constexpr const char *SENSOR_REPORT_FORMAT = "sensorReportFormat";
 constexpr const char *CURRENT_READING_PERIOD_MS = "currentReadingPeriodMs";
 constexpr const char *SOFT_READING_PERIOD_MS = "softReadingPeriodMs";
 constexpr const char *RBR_CODA_READING_PERIOD_MS = "rbrCodaReadingPeriodMs";
@@ -26,6 +44,7 @@ constexpr const char *HARDWARE_VERSION = "hwVersion";
 constexpr const char *RBR_RAW_DIFFERENTIAL_SIGNAL_PERIOD_S = "rbrRawSampleS";
 constexpr const char *RBR_MAX_RAW_REPORTS = "rbrMaxRawReports";
 constexpr const char *RBR_RAW_DEPTH_THRESHOLD_UBAR = "rbrDepthThresholdUbar";
+constexpr const char *RBR_RAW_FORMAT = "rbrRawFormat";
 #endif // RAW_PRESSURE_ENABLE
 
 } // namespace AppConfig
@@ -40,7 +59,7 @@ power_config_s getPowerConfigs(cfg::Configuration &syscfg);
 
 #ifdef RAW_PRESSURE_ENABLE
 struct raw_pressure_config_s {
-  uint32_t rawSampleS, maxRawReports, rbrCodaReadingPeriodMs;
+  uint32_t rawSampleS, maxRawReports, rbrCodaReadingPeriodMs, rawFormat;
   float rawDepthThresholdUbar;
 };
 
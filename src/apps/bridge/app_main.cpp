@@ -440,7 +440,8 @@ static void defaultTask(void *parameters) {
   raw_pressure_config_s raw_pressure_cfg = getRawPressureConfigs(debug_configuration_system);
   rbrPressureProcessorInit(raw_pressure_cfg.rawSampleS, raw_pressure_cfg.maxRawReports,
                            raw_pressure_cfg.rawDepthThresholdUbar, &debug_configuration_user,
-                           raw_pressure_cfg.rbrCodaReadingPeriodMs);
+                           raw_pressure_cfg.rbrCodaReadingPeriodMs,
+                           raw_pressure_cfg.rawFormat);
 #endif // RAW_PRESSURE_ENABLE
 
   // // Re-enable low power mode
@@ -28,10 +28,13 @@ extern "C" {
 #define APP_PUB_SUB_BM_BRIDGE_PRINTF_TOPIC "bridge/printf"
 #define APP_PUB_SUB_BM_BRIDGE_PRINTF_TYPE 1
 #define APP_PUB_SUB_BM_BRIDGE_PRINTF_VERSION 2
+// bm_common_log_t carrying a bm_dlog_record_t instead of text
+#define APP_PUB_SUB_BM_BRIDGE_PRINTF_DLOG_TYPE 2
 
 #define APP_PUB_SUB_BM_BRIDGE_CFG_PRINTF_TOPIC "bridge/cfg_printf"
 #define APP_PUB_SUB_BM_BRIDGE_CFG_PRINTF_TYPE 1
 #define APP_PUB_SUB_BM_BRIDGE_CFG_PRINTF_VERSION 2
+#define APP_PUB_SUB_BM_BRIDGE_CFG_PRINTF_DLOG_TYPE 2
 
 #define APP_PUB_SUB_BM_BRIDGE_SENSOR_IND_TOPIC "bridge/sensor_ind_log"
 #define APP_PUB_SUB_BM_BRIDGE_SENSOR_IND_TYPE 1
@@ -49,11 +52,15 @@ typedef struct app_pub_sub_bm_bridge_sensor_report_data {
 
 #define APP_PUB_SUB_BM_BRIDGE_SENSOR_REPORT_TOPIC "bridge/sensor_report"
 #define APP_PUB_SUB_BM_BRIDGE_SENSOR_REPORT_TYPE 1
+// cbor_buffer holds a packed report instead, see packed_sensor_report_encoder.h
+#define APP_PUB_SUB_BM_BRIDGE_SENSOR_REPORT_PACKED_TYPE 2
 #define APP_PUB_SUB_BM_BRIDGE_SENSOR_REPORT_VERSION 1
 
 #ifdef RAW_PRESSURE_ENABLE
 #define APP_PUB_SUB_BM_BRIDGE_RBR_HDR_PRESSURE_TOPIC "bridge/rbr_hdr_pressure_data"
 #define APP_PUB_SUB_BM_BRIDGE_RBR_HDR_PRESSURE_TYPE 1
+// Rice coded integer residuals instead, see rbr_pressure_residual_encoder.h
+#define APP_PUB_SUB_BM_BRIDGE_RBR_HDR_PRESSURE_RESIDUAL_TYPE 2
 #define APP_PUB_SUB_BM_BRIDGE_RBR_HDR_PRESSURE_VERSION 1
 #endif // RAW_PRESSURE_ENABLE
 
@@ -1,6 +1,7 @@
 #include "bridgeLog.h"
 #include "FreeRTOS.h"
 #include "app_pub_sub.h"
+#include "bm_dlog.h"
 #include "bm_serial.h"
 #include "device_info.h"
 #include "stm32_rtc.h"
@@ -15,8 +16,69 @@ void bridgeLogPrint(bridgeLogType_e type, bm_common_log_level_e level, bool prin
   va_end(va_args);
 }
 
+static void bridgeLogPublish(bridgeLogType_e type, const bm_common_log_t *log_msg, size_t msg_len,
+                             bool deferred) {
+  switch (type) {
+  case BRIDGE_SYS:
+    bm_serial_pub(getNodeId(), APP_PUB_SUB_BM_BRIDGE_PRINTF_TOPIC,
+                  sizeof(APP_PUB_SUB_BM_BRIDGE_PRINTF_TOPIC) - 1,
+                  reinterpret_cast<const uint8_t *>(log_msg), msg_len,
+                  deferred ? APP_PUB_SUB_BM_BRIDGE_PRINTF_DLOG_TYPE
+                           : APP_PUB_SUB_BM_BRIDGE_PRINTF_TYPE,
+                  APP_PUB_SUB_BM_BRIDGE_PRINTF_VERSION);
+    break;
+  case BRIDGE_CFG:
+    bm_serial_pub(getNodeId(), APP_PUB_SUB_BM_BRIDGE_CFG_PRINTF_TOPIC,
+                  sizeof(APP_PUB_SUB_BM_BRIDGE_CFG_PRINTF_TOPIC) - 1,
+                  reinterpret_cast<const uint8_t *>(log_msg), msg_len,
+                  deferred ? APP_PUB_SUB_BM_BRIDGE_CFG_PRINTF_DLOG_TYPE
+                           : APP_PUB_SUB_BM_BRIDGE_CFG_PRINTF_TYPE,
+                  APP_PUB_SUB_BM_BRIDGE_CFG_PRINTF_VERSION);
+    break;
+  default:
+    printf("ERROR: Unknown log type in bridgeLogPrintf\n");
+    break;
+  }
+}
+
+static void bridgeLogTimestamp(bm_common_log_t *log_msg) {
+  RTCTimeAndDate_t datetime;
+  if (rtcGet(&datetime) == pdPASS) {
+    log_msg->timestamp_utc_s = rtcGetMicroSeconds(&datetime) * 1e-6;
+  }
+}
+
+/*!
+  Publish a log line as a deferred record, the host formats it from the ELF.
+  The console still gets the text, straight from vprintf.
+  \return true if the record was sent, false if the line has to be sent as text
+*/
+static bool dlogBridgeLogPrint(bridgeLogType_e type, bm_common_log_level_e level, bool print_header,
+                               const char *format, va_list va_args) {
+  uint8_t log_buf[sizeof(bm_common_log_t) + BM_DLOG_MAX_LEN] __attribute__((aligned(8)));
+  bm_common_log_t *log_msg = reinterpret_cast<bm_common_log_t *>(log_buf);
+  size_t record_len = bm_dlog_encode(reinterpret_cast<uint8_t *>(log_msg->message),
+                                     BM_DLOG_MAX_LEN, format, va_args);
+  if (!record_len) {
+    return false;
+  }
+
+  memset(log_msg, 0, sizeof(bm_common_log_t));
+  log_msg->level = level;
+  log_msg->message_length = record_len;
+  log_msg->print_header = print_header;
+  bridgeLogTimestamp(log_msg);
+  vprintf(format, va_args);
+  bridgeLogPublish(type, log_msg, sizeof(bm_common_log_t) + record_len, true);
+  return true;
+}
+
 void vBridgeLogPrint(bridgeLogType_e type, bm_common_log_level_e level, bool print_header,
                      const char *format, va_list va_args) {
+  if (bm_dlog_enabled() && dlogBridgeLogPrint(type, level, print_header, format, va_args)) {
+    return;
+  }
+
   bm_common_log_t *log_msg = NULL;
   size_t msg_len = 0;
   do {
@@ -42,29 +104,9 @@ void vBridgeLogPrint(bridgeLogType_e type, bm_common_log_level_e level, bool pri
       log_msg->print_header = print_header;
       vsnprintf(log_msg->message, print_size, format, va_args);
     }
-    RTCTimeAndDate_t datetime;
-    if (rtcGet(&datetime) == pdPASS) {
-      log_msg->timestamp_utc_s = rtcGetMicroSeconds(&datetime) * 1e-6;
-    }
+    bridgeLogTimestamp(log_msg);
     printf("%s", log_msg->message);
-    switch (type) {
-    case BRIDGE_SYS:
-      bm_serial_pub(getNodeId(), APP_PUB_SUB_BM_BRIDGE_PRINTF_TOPIC,
-                    sizeof(APP_PUB_SUB_BM_BRIDGE_PRINTF_TOPIC) - 1,
-                    reinterpret_cast<const uint8_t *>(log_msg), msg_len,
-                    APP_PUB_SUB_BM_BRIDGE_PRINTF_TYPE, APP_PUB_SUB_BM_BRIDGE_PRINTF_VERSION);
-      break;
-    case BRIDGE_CFG:
-      bm_serial_pub(getNodeId(), APP_PUB_SUB_BM_BRIDGE_CFG_PRINTF_TOPIC,
-                    sizeof(APP_PUB_SUB_BM_BRIDGE_CFG_PRINTF_TOPIC) - 1,
-                    reinterpret_cast<const uint8_t *>(log_msg), msg_len,
-                    APP_PUB_SUB_BM_BRIDGE_CFG_PRINTF_TYPE,
-                    APP_PUB_SUB_BM_BRIDGE_CFG_PRINTF_VERSION);
-      break;
-    default:
-      printf("ERROR: Unknown log type in bridgeLogPrintf\n");
-      break;
-    }
+    bridgeLogPublish(type, log_msg, msg_len, false);
   } while (0);
   if (log_msg) {
     vPortFree(log_msg);
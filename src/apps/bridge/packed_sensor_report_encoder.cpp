@@ -0,0 +1,183 @@
+#include "packed_sensor_report_encoder.h"
+#include <math.h>
+#include <string.h>
+
+static void putBits(packed_sensor_report_encoder_context_t &context, uint32_t value,
+                    uint8_t num_bits) {
+  if (context.bit_pos + num_bits > context.buffer_len * 8) {
+    context.overflow = true;
+    return;
+  }
+  while (num_bits > 0) {
+    size_t byte = context.bit_pos / 8;
+    uint8_t free_bits = 8 - (context.bit_pos % 8);
+    uint8_t chunk = (num_bits < free_bits) ? num_bits : free_bits;
+    uint8_t bits = (value >> (num_bits - chunk)) & ((1u << chunk) - 1);
+    if (free_bits == 8) {
+      context.buffer[byte] = 0;
+    }
+    context.buffer[byte] |= bits << (free_bits - chunk);
+    context.bit_pos += chunk;
+    num_bits -= chunk;
+  }
+}
+
+static uint32_t zigZag(uint32_t code, uint32_t prev_code) {
+  int64_t delta = static_cast<int64_t>(code) - static_cast<int64_t>(prev_code);
+  return static_cast<uint32_t>((static_cast<uint64_t>(delta) << 1) ^ (delta >> 63));
+}
+
+static uint8_t bitWidth(uint32_t value) {
+  uint8_t width = 0;
+  while (value) {
+    width++;
+    value >>= 1;
+  }
+  return width;
+}
+
+/*!
+ * @brief Quantize one field of a sample to its code.
+ * @param[in] field The field.
+ * @param[in] sample The aggregation struct the field is in.
+ * @return The code, one of the top three codes for NaN, +inf and -inf.
+ */
+uint32_t packed_sensor_report_quantize(const sensor_report_packed_field_t &field,
+                                       const void *sample) {
+  const uint8_t *member = static_cast<const uint8_t *>(sample) + field.offset;
+  double value = 0;
+  if (field.type == PACKED_FIELD_DOUBLE) {
+    memcpy(&value, member, sizeof(value));
+  } else if (field.size == sizeof(uint8_t)) {
+    value = *member;
+  } else if (field.size == sizeof(uint16_t)) {
+    uint16_t u16;
+    memcpy(&u16, member, sizeof(u16));
+    value = u16;
+  } else {
+    uint32_t u32;
+    memcpy(&u32, member, sizeof(u32));
+    value = u32;
+  }
+
+  uint32_t nan_code = (1u << field.bits) - 1;
+  if (isnan(value)) {
+    return nan_code;
+  }
+  double scaled = (value - field.min) / field.resolution;
+  if (scaled < -0.5) {
+    return nan_code - 2;
+  }
+  if (scaled >= field.max_code + 0.5) {
+    return nan_code - 1;
+  }
+  uint32_t code = static_cast<uint32_t>(scaled + 0.5);
+  return (code > field.max_code) ? field.max_code : code;
+}
+
+/*!
+ * @brief Open a packed sensor report. Must be called before any other encoding functions.
+ * @param[in] buffer The buffer to encode into.
+ * @param[in] buffer_len The length of the buffer.
+ * @param[in] num_sensors The number of sensors in the report.
+ * @param[in] num_samples The number of samples every sensor has.
+ * @param[in] context The context to use for the entire encoding.
+ * @return true if the header fit.
+ */
+bool packed_sensor_report_encoder_open_report(uint8_t *buffer, size_t buffer_len,
+                                              uint8_t num_sensors, uint32_t num_samples,
+                                              packed_sensor_report_encoder_context_t &context) {
+  if (num_samples > UINT16_MAX) {
+    return false;
+  }
+  context.buffer = buffer;
+  context.buffer_len = buffer_len;
+  context.bit_pos = 0;
+  context.overflow = false;
+  context.num_sensors = num_sensors;
+  context.sensors_added = 0;
+  context.num_samples = static_cast<uint16_t>(num_samples);
+  putBits(context, PACKED_SENSOR_REPORT_VERSION, 8);
+  putBits(context, num_sensors, 8);
+  putBits(context, num_samples, 16);
+  return !context.overflow;
+}
+
+/*!
+ * @brief Add all of the samples of one sensor to the report.
+ * @param[in] context The encoding context.
+ * @param[in] sensor_type The abstractSensorType_e of the sensor.
+ * @param[in] fields The fields to send from each sample.
+ * @param[in] num_fields The number of fields.
+ * @param[in] samples The sensor's aggregation structs, as many as the report has samples.
+ * @param[in] sample_size The size of one aggregation struct.
+ * @return true if the sensor fit in the report.
+ */
+bool packed_sensor_report_encoder_add_sensor(packed_sensor_report_encoder_context_t &context,
+                                             uint8_t sensor_type,
+                                             const sensor_report_packed_field_t *fields,
+                                             size_t num_fields, const void *samples,
+                                             size_t sample_size) {
+  if (context.sensors_added >= context.num_sensors ||
+      sensor_type >= (1u << PACKED_SENSOR_REPORT_TYPE_BITS)) {
+    return false;
+  }
+  const uint8_t *sample_bytes = static_cast<const uint8_t *>(samples);
+  putBits(context, sensor_type, PACKED_SENSOR_REPORT_TYPE_BITS);
+  for (size_t i = 0; i < num_fields; i++) {
+    const sensor_report_packed_field_t &field = fields[i];
+    uint32_t prev_code = packed_sensor_report_quantize(field, sample_bytes);
+    putBits(context, prev_code, field.bits);
+    if (context.num_samples < 2) {
+      continue;
+    }
+
+    // Slowly changing fields only need a few bits for the deltas
+    uint8_t width = 0;
+    for (uint16_t j = 1; j < context.num_samples; j++) {
+      uint32_t code = packed_sensor_report_quantize(field, &sample_bytes[j * sample_size]);
+      uint8_t delta_width = bitWidth(zigZag(code, prev_code));
+      width = (delta_width > width) ? delta_width : width;
+      prev_code = code;
+    }
+    bool absolute = width >= field.bits;
+    putBits(context, absolute ? PACKED_SENSOR_REPORT_ABSOLUTE : width,
+            PACKED_SENSOR_REPORT_WIDTH_BITS);
+
+    prev_code = packed_sensor_report_quantize(field, sample_bytes);
+    for (uint16_t j = 1; j < context.num_samples; j++) {
+      uint32_t code = packed_sensor_report_quantize(field, &sample_bytes[j * sample_size]);
+      if (absolute) {
+        putBits(context, code, field.bits);
+      } else {
+        putBits(context, zigZag(code, prev_code), width);
+      }
+      prev_code = code;
+    }
+  }
+  context.sensors_added++;
+  return !context.overflow;
+}
+
+/*!
+ * @brief Close a packed sensor report, pads it to a whole byte.
+ * @param[in] context The encoding context.
+ * @return true if every sensor was added and everything fit.
+ */
+bool packed_sensor_report_encoder_close_report(
+    packed_sensor_report_encoder_context_t &context) {
+  if (context.bit_pos % 8) {
+    putBits(context, 0, 8 - (context.bit_pos % 8));
+  }
+  return !context.overflow && context.sensors_added == context.num_sensors;
+}
+
+/*!
+ * @brief Get the size of the encoded report.
+ * @param[in] context The encoding context.
+ * @return The size of the encoded report.
+ */
+size_t packed_sensor_report_encoder_get_report_size_bytes(
+    packed_sensor_report_encoder_context_t &context) {
+  return (context.bit_pos + 7) / 8;
+}
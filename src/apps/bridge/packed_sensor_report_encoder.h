@@ -0,0 +1,109 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+  Bit-packed alternative to the CBOR sensor report, to fit more samples into an
+  Iridium message. Every field is quantized to an unsigned code using the range
+  and resolution from its sensor_report_packed_field_t.
+
+  Report layout, all fields MSB first with no padding until the end:
+    8 bits   PACKED_SENSOR_REPORT_VERSION
+    8 bits   number of sensors
+    16 bits  samples per sensor (n)
+    per sensor:
+      4 bits   abstractSensorType_e
+      per field, all n samples of it together:
+        bits     code of the first sample
+        if n > 1:
+          5 bits   delta width w, PACKED_SENSOR_REPORT_ABSOLUTE if not delta coded
+          (n-1) *  zig-zag delta from the previous code in w bits,
+                   or the code itself in bits if absolute
+  then zero padding to a whole byte.
+
+  The top three codes of every field mean NaN, +inf and -inf. Values outside
+  the field's range are sent as +/-inf, tools/scripts/misc/sensor_report_decoder.py
+  decodes the report on the host.
+*/
+
+#define PACKED_SENSOR_REPORT_VERSION 1
+#define PACKED_SENSOR_REPORT_ABSOLUTE 0x1F
+#define PACKED_SENSOR_REPORT_WIDTH_BITS 5
+#define PACKED_SENSOR_REPORT_TYPE_BITS 4
+#define PACKED_SENSOR_REPORT_SPECIAL_CODES 3
+#define PACKED_SENSOR_REPORT_MAX_FIELD_BITS 30
+
+typedef enum {
+  PACKED_FIELD_DOUBLE,
+  PACKED_FIELD_UINT,
+} packed_sensor_report_field_type_e;
+
+typedef struct {
+  packed_sensor_report_field_type_e type;
+  // Where the field is in the aggregation struct, and its size for PACKED_FIELD_UINT
+  uint16_t offset;
+  uint8_t size;
+  // Bits per code, from the range and resolution
+  uint8_t bits;
+  double min;
+  double resolution;
+  // Code of max, codes above it up to the special ones are unused
+  uint32_t max_code;
+} sensor_report_packed_field_t;
+
+typedef struct {
+  uint8_t *buffer;
+  size_t buffer_len;
+  size_t bit_pos;
+  bool overflow;
+  uint8_t num_sensors;
+  uint8_t sensors_added;
+  uint16_t num_samples;
+} packed_sensor_report_encoder_context_t;
+
+/*!
+ * @brief Describe a double field that is quantized to resolution over [min, max].
+ */
+constexpr sensor_report_packed_field_t packed_sensor_report_double(size_t offset, double min,
+                                                                   double max,
+                                                                   double resolution) {
+  uint32_t max_code = static_cast<uint32_t>((max - min) / resolution + 0.5);
+  uint8_t bits = 1;
+  uint64_t num_codes = static_cast<uint64_t>(max_code) + 1 + PACKED_SENSOR_REPORT_SPECIAL_CODES;
+  while (bits < 32 && (1ULL << bits) < num_codes) {
+    bits++;
+  }
+  return {PACKED_FIELD_DOUBLE, static_cast<uint16_t>(offset), sizeof(double), bits, min,
+          resolution, max_code};
+}
+
+/*!
+ * @brief Describe an unsigned integer or enum field of size bytes.
+ * Values above max are sent as +inf.
+ */
+constexpr sensor_report_packed_field_t packed_sensor_report_uint(size_t offset, size_t size,
+                                                                 uint32_t max) {
+  sensor_report_packed_field_t field = packed_sensor_report_double(offset, 0, max, 1);
+  field.type = PACKED_FIELD_UINT;
+  field.size = static_cast<uint8_t>(size);
+  return field;
+}
+
+bool packed_sensor_report_encoder_open_report(uint8_t *buffer, size_t buffer_len,
+                                              uint8_t num_sensors, uint32_t num_samples,
+                                              packed_sensor_report_encoder_context_t &context);
+
+bool packed_sensor_report_encoder_add_sensor(packed_sensor_report_encoder_context_t &context,
+                                             uint8_t sensor_type,
+                                             const sensor_report_packed_field_t *fields,
+                                             size_t num_fields, const void *samples,
+                                             size_t sample_size);
+
+bool packed_sensor_report_encoder_close_report(
+    packed_sensor_report_encoder_context_t &context);
+
+size_t packed_sensor_report_encoder_get_report_size_bytes(
+    packed_sensor_report_encoder_context_t &context);
+
+uint32_t packed_sensor_report_quantize(const sensor_report_packed_field_t &field,
+                                       const void *sample);
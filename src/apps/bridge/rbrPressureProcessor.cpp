@@ -1,5 +1,6 @@
 #include "rbrPressureProcessor.h"
 #include "FreeRTOS.h"
+#include "app_config.h"
 #include "app_pub_sub.h"
 #include "bm_network.h"
 #include "bm_rbr_pressure_difference_signal_msg.h"
@@ -9,6 +10,7 @@
 #include "differenceSignal.h"
 #include "event_groups.h"
 #include "queue.h"
+#include "rbr_pressure_residual_encoder.h"
 #include "task.h"
 #include "task_priorities.h"
 #include "timers.h"
@@ -31,6 +33,7 @@ typedef struct PressureProcessorContext {
   cfg::Configuration *usrCfg;
   uint32_t nRawReportsSent;
   uint32_t rbrCodaReadingPeriodMs;
+  uint32_t rawFormat;
 } PressureProcessorContext_t;
 
 static constexpr EventBits_t kQRcv = 1 << 0;
@@ -40,21 +43,31 @@ static constexpr char kRbrPressureProcessorTag[] = "[RbrPressureProcessor]";
 static constexpr size_t cbor_buffer_size = 1024;
 static constexpr char kRbrPressureHdrTopic[] = "/sofar/bm_rbr_data";
 static constexpr uint32_t kSampleChunkSize = 30;
+// Same Iridium budget as the sensor report, 340 bytes less the message header
+static constexpr size_t kResidualMessageLen = 315;
+// The resolution the RBR Coda reports pressure at
+static constexpr double kPressureResolutionDbar = 0.0001;
 // 1 decibar is 1/10th of a bar => there are 100,000 millionths of a bar (ubar) in one decibar.
 static constexpr double decibar_to_ubar = 100000.0;
 static constexpr char kRBRnRawReportsSent[] = "RBRnRawReportsSent";
 
 static void runTask(void *param);
 static void diffSigSendTimerCallback(TimerHandle_t xTimer);
+static bool sendDifferenceSignal(DifferenceSignal &diffSignal, double *d_n,
+                                 size_t total_samples, const BmRbrDataMsg::Data &rbr_data,
+                                 uint8_t *cbor_buffer);
+static bool sendResidualSignal(const double *r_n, size_t total_samples,
+                               const BmRbrDataMsg::Data &rbr_data, uint8_t *buffer);
 
 static PressureProcessorContext_t _ctx;
 
 void rbrPressureProcessorInit(uint32_t rawSampleS, uint32_t maxRawReports,
                               double rawDepthThresholdUbar, cfg::Configuration *usrCfg,
-                              uint32_t rbrCodaReadingPeriodMs) {
+                              uint32_t rbrCodaReadingPeriodMs, uint32_t rawFormat) {
   configASSERT(usrCfg);
   _ctx.usrCfg = usrCfg;
   _ctx.rbrCodaReadingPeriodMs = rbrCodaReadingPeriodMs;
+  _ctx.rawFormat = rawFormat;
   if (!_ctx.usrCfg->getConfig(kRBRnRawReportsSent, strlen(kRBRnRawReportsSent),
                               _ctx.nRawReportsSent)) {
     _ctx.nRawReportsSent = 0;
@@ -116,57 +129,16 @@ static void runTask(void *param) {
           break;
         }
         size_t total_samples = diffSignalCapacity;
-        if (diffSignal.encodeDifferenceSignalToBuffer(d_n, total_samples)) {
-          bridgeLogPrint(BRIDGE_SYS, BM_COMMON_LOG_LEVEL_INFO, USE_HEADER,
-                         "%s Encoded difference signal to buffer\n", kRbrPressureProcessorTag);
-          double r0, d0;
-          diffSignal.getReferenceSignal(r0);
-          // Compute 2nd order difference signal
-          DifferenceSignal::differenceSignalFromBuffer(d_n, total_samples, d0);
-          uint32_t samples_to_send = total_samples;
-          static BmRbrPressureDifferenceSignalMsg::Data d;
-          uint32_t offset = 0;
-          uint32_t sequence_num = 0;
-          while (samples_to_send) {
-            uint32_t samples_to_send_now =
-                samples_to_send > kSampleChunkSize ? kSampleChunkSize : samples_to_send;
-            d.header.version = BmRbrPressureDifferenceSignalMsg::VERSION;
-            d.header.reading_time_utc_ms = rbr_data.header.reading_time_utc_ms;
-            d.header.reading_uptime_millis = rbr_data.header.reading_uptime_millis;
-            d.header.sensor_reading_time_ms = rbr_data.header.sensor_reading_time_ms;
-            d.total_samples = total_samples;
-            d.sequence_num = sequence_num;
-            d.num_samples = samples_to_send_now;
-            d.residual_0 = r0;
-            d.residual_1 = d0;
-            d.difference_signal = d_n + offset;
-            size_t encoded_len = 0;
-            if (BmRbrPressureDifferenceSignalMsg::encode(d, cbor_buffer, cbor_buffer_size,
-                                                         &encoded_len) == CborNoError) {
-              if (bm_serial_pub(
-                      getNodeId(), APP_PUB_SUB_BM_BRIDGE_RBR_HDR_PRESSURE_TOPIC,
-                      strlen(APP_PUB_SUB_BM_BRIDGE_RBR_HDR_PRESSURE_TOPIC), cbor_buffer,
-                      encoded_len, APP_PUB_SUB_BM_BRIDGE_RBR_HDR_PRESSURE_TYPE,
-                      APP_PUB_SUB_BM_BRIDGE_RBR_HDR_PRESSURE_VERSION) == BM_SERIAL_OK) {
-                bridgeLogPrint(BRIDGE_SYS, BM_COMMON_LOG_LEVEL_INFO, USE_HEADER,
-                               "%s Sent difference signal to Spotter\n",
-                               kRbrPressureProcessorTag);
-                offset += samples_to_send_now;
-                samples_to_send -= samples_to_send_now;
-                sequence_num++;
-              } else {
-                bridgeLogPrint(BRIDGE_SYS, BM_COMMON_LOG_LEVEL_WARNING, USE_HEADER,
-                               "%s Failed to publish difference signal to Spotter\n",
-                               kRbrPressureProcessorTag);
-                break;
-              }
-            } else {
-              bridgeLogPrint(BRIDGE_SYS, BM_COMMON_LOG_LEVEL_WARNING, USE_HEADER,
-                             "%s Failed to encode difference signal\n",
-                             kRbrPressureProcessorTag);
-            }
-            vTaskDelay(100);
-          }
+        // Only a report that made it out at least in part counts against maxRawReports
+        bool sent = false;
+        if (_ctx.rawFormat == RAW_PRESSURE_FORMAT_RESIDUAL) {
+          sent = diffSignal.copySignalToBuffer(d_n, total_samples) &&
+                 sendResidualSignal(d_n, total_samples, rbr_data, cbor_buffer);
+        } else {
+          sent = diffSignal.encodeDifferenceSignalToBuffer(d_n, total_samples) &&
+                 sendDifferenceSignal(diffSignal, d_n, total_samples, rbr_data, cbor_buffer);
+        }
+        if (sent) {
           _ctx.nRawReportsSent++;
           _ctx.usrCfg->setConfig(kRBRnRawReportsSent, strlen(kRBRnRawReportsSent),
                                  _ctx.nRawReportsSent);
@@ -199,6 +171,129 @@ static void runTask(void *param) {
   }
 }
 
+/*!
+ * @brief Sends the 2nd order difference signal as CBOR doubles, kSampleChunkSize at a time.
+ * @param[in] diffSignal The signal, for its reference sample.
+ * @param[in] d_n The 1st order difference signal, replaced by the 2nd order one.
+ * @param[in] total_samples The number of samples in d_n.
+ * @param[in] rbr_data The last RBR sample, for the reading times.
+ * @param[in] cbor_buffer The buffer to encode each message into.
+ * @return true if at least one message was published.
+ */
+static bool sendDifferenceSignal(DifferenceSignal &diffSignal, double *d_n,
+                                 size_t total_samples, const BmRbrDataMsg::Data &rbr_data,
+                                 uint8_t *cbor_buffer) {
+  bridgeLogPrint(BRIDGE_SYS, BM_COMMON_LOG_LEVEL_INFO, USE_HEADER,
+                 "%s Encoded difference signal to buffer\n", kRbrPressureProcessorTag);
+  double r0, d0;
+  diffSignal.getReferenceSignal(r0);
+  // Compute 2nd order difference signal
+  DifferenceSignal::differenceSignalFromBuffer(d_n, total_samples, d0);
+  uint32_t samples_to_send = total_samples;
+  static BmRbrPressureDifferenceSignalMsg::Data d;
+  uint32_t offset = 0;
+  uint32_t sequence_num = 0;
+  bool sent = false;
+  while (samples_to_send) {
+    uint32_t samples_to_send_now =
+        samples_to_send > kSampleChunkSize ? kSampleChunkSize : samples_to_send;
+    d.header.version = BmRbrPressureDifferenceSignalMsg::VERSION;
+    d.header.reading_time_utc_ms = rbr_data.header.reading_time_utc_ms;
+    d.header.reading_uptime_millis = rbr_data.header.reading_uptime_millis;
+    d.header.sensor_reading_time_ms = rbr_data.header.sensor_reading_time_ms;
+    d.total_samples = total_samples;
+    d.sequence_num = sequence_num;
+    d.num_samples = samples_to_send_now;
+    d.residual_0 = r0;
+    d.residual_1 = d0;
+    d.difference_signal = d_n + offset;
+    size_t encoded_len = 0;
+    if (BmRbrPressureDifferenceSignalMsg::encode(d, cbor_buffer, cbor_buffer_size,
+                                                 &encoded_len) == CborNoError) {
+      if (bm_serial_pub(getNodeId(), APP_PUB_SUB_BM_BRIDGE_RBR_HDR_PRESSURE_TOPIC,
+                        strlen(APP_PUB_SUB_BM_BRIDGE_RBR_HDR_PRESSURE_TOPIC), cbor_buffer,
+                        encoded_len, APP_PUB_SUB_BM_BRIDGE_RBR_HDR_PRESSURE_TYPE,
+                        APP_PUB_SUB_BM_BRIDGE_RBR_HDR_PRESSURE_VERSION) == BM_SERIAL_OK) {
+        bridgeLogPrint(BRIDGE_SYS, BM_COMMON_LOG_LEVEL_INFO, USE_HEADER,
+                       "%s Sent difference signal to Spotter\n", kRbrPressureProcessorTag);
+        offset += samples_to_send_now;
+        samples_to_send -= samples_to_send_now;
+        sequence_num++;
+        sent = true;
+      } else {
+        bridgeLogPrint(BRIDGE_SYS, BM_COMMON_LOG_LEVEL_WARNING, USE_HEADER,
+                       "%s Failed to publish difference signal to Spotter\n",
+                       kRbrPressureProcessorTag);
+        break;
+      }
+    } else {
+      bridgeLogPrint(BRIDGE_SYS, BM_COMMON_LOG_LEVEL_WARNING, USE_HEADER,
+                     "%s Failed to encode difference signal\n", kRbrPressureProcessorTag);
+    }
+    vTaskDelay(100);
+  }
+  return sent;
+}
+
+/*!
+ * @brief Sends the signal quantized and Rice coded, as many samples per message as fit.
+ *        Samples that can't be coded are left out, the next message starts after them.
+ * @param[in] r_n The signal.
+ * @param[in] total_samples The number of samples in r_n.
+ * @param[in] rbr_data The last RBR sample, for the reading times.
+ * @param[in] buffer The buffer to encode each message into, at least kResidualMessageLen.
+ * @return true if at least one message was published.
+ */
+static bool sendResidualSignal(const double *r_n, size_t total_samples,
+                               const BmRbrDataMsg::Data &rbr_data, uint8_t *buffer) {
+  rbr_pressure_residual_header_t header = {};
+  header.reading_time_utc_ms = rbr_data.header.reading_time_utc_ms;
+  header.reading_uptime_millis = rbr_data.header.reading_uptime_millis;
+  header.sensor_reading_time_ms = rbr_data.header.sensor_reading_time_ms;
+  header.total_samples = total_samples;
+  bool sent = false;
+  while (header.first_sample < total_samples) {
+    size_t skipped = rbr_pressure_residual_skip(r_n + header.first_sample,
+                                                total_samples - header.first_sample,
+                                                kPressureResolutionDbar);
+    if (skipped) {
+      bridgeLogPrint(BRIDGE_SYS, BM_COMMON_LOG_LEVEL_WARNING, USE_HEADER,
+                     "%s Skipping %" PRIu32 " invalid samples at %" PRIu32 "\n",
+                     kRbrPressureProcessorTag, static_cast<uint32_t>(skipped),
+                     header.first_sample);
+      header.first_sample += skipped;
+      continue;
+    }
+    size_t encoded_len = 0;
+    if (!rbr_pressure_residual_encode(r_n + header.first_sample,
+                                      total_samples - header.first_sample,
+                                      kPressureResolutionDbar, header, buffer,
+                                      kResidualMessageLen, encoded_len)) {
+      bridgeLogPrint(BRIDGE_SYS, BM_COMMON_LOG_LEVEL_WARNING, USE_HEADER,
+                     "%s Failed to encode residual signal\n", kRbrPressureProcessorTag);
+      break;
+    }
+    if (bm_serial_pub(getNodeId(), APP_PUB_SUB_BM_BRIDGE_RBR_HDR_PRESSURE_TOPIC,
+                      strlen(APP_PUB_SUB_BM_BRIDGE_RBR_HDR_PRESSURE_TOPIC), buffer, encoded_len,
+                      APP_PUB_SUB_BM_BRIDGE_RBR_HDR_PRESSURE_RESIDUAL_TYPE,
+                      APP_PUB_SUB_BM_BRIDGE_RBR_HDR_PRESSURE_VERSION) == BM_SERIAL_OK) {
+      bridgeLogPrint(BRIDGE_SYS, BM_COMMON_LOG_LEVEL_INFO, USE_HEADER,
+                     "%s Sent %" PRIu16 " residual coded samples to Spotter\n",
+                     kRbrPressureProcessorTag, header.num_samples);
+      header.first_sample += header.num_samples;
+      header.sequence_num++;
+      sent = true;
+    } else {
+      bridgeLogPrint(BRIDGE_SYS, BM_COMMON_LOG_LEVEL_WARNING, USE_HEADER,
+                     "%s Failed to publish residual signal to Spotter\n",
+                     kRbrPressureProcessorTag);
+      break;
+    }
+    vTaskDelay(100);
+  }
+  return sent;
+}
+
 static void diffSigSendTimerCallback(TimerHandle_t xTimer) {
   (void)xTimer;
   xEventGroupSetBits(_ctx.eg, kTimEx);
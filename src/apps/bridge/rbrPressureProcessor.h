@@ -15,7 +15,8 @@ constexpr double DEFAULT_RAW_DEPTH_THRESHOLD_UBAR = 1500000.0;
 
 void rbrPressureProcessorInit(uint32_t rawSampleS,
                               uint32_t maxRawReports, double rawDepthThresholdUbar,
-                              cfg::Configuration *usrCfg, uint32_t rbrCodaReadingPeriodMs);
+                              cfg::Configuration *usrCfg, uint32_t rbrCodaReadingPeriodMs,
+                              uint32_t rawFormat);
 
 bool rbrPressureProcessorAddSample(BmRbrDataMsg::Data &rbr_data, uint32_t timeout_ms);
 
@@ -0,0 +1,177 @@
+#include "rbr_pressure_residual_encoder.h"
+#include <math.h>
+#include <string.h>
+
+static void putBits(uint8_t *buffer, size_t &bit_pos, uint64_t value, uint8_t num_bits) {
+  while (num_bits > 0) {
+    size_t byte = bit_pos / 8;
+    uint8_t free_bits = 8 - (bit_pos % 8);
+    uint8_t chunk = (num_bits < free_bits) ? num_bits : free_bits;
+    uint8_t bits = (value >> (num_bits - chunk)) & ((1u << chunk) - 1);
+    if (free_bits == 8) {
+      buffer[byte] = 0;
+    }
+    buffer[byte] |= bits << (free_bits - chunk);
+    bit_pos += chunk;
+    num_bits -= chunk;
+  }
+}
+
+static bool quantize(double value, double resolution_dbar, int32_t &code) {
+  double scaled = round(value / resolution_dbar);
+  if (!isfinite(scaled) || scaled > INT32_MAX || scaled < INT32_MIN) {
+    return false;
+  }
+  code = static_cast<int32_t>(scaled);
+  return true;
+}
+
+static uint64_t zigZag(int64_t residual) {
+  return (static_cast<uint64_t>(residual) << 1) ^ static_cast<uint64_t>(residual >> 63);
+}
+
+static uint8_t bitWidth(uint64_t value) {
+  uint8_t width = 0;
+  while (value) {
+    width++;
+    value >>= 1;
+  }
+  return width;
+}
+
+static size_t riceBits(uint64_t z, uint8_t k) {
+  uint64_t quotient = z >> k;
+  if (quotient < RBR_PRESSURE_RESIDUAL_ESCAPE) {
+    return quotient + 1 + k;
+  }
+  return RBR_PRESSURE_RESIDUAL_ESCAPE + RBR_PRESSURE_RESIDUAL_WIDTH_BITS + bitWidth(z);
+}
+
+static void putRice(uint8_t *buffer, size_t &bit_pos, uint64_t z, uint8_t k) {
+  uint64_t quotient = z >> k;
+  if (quotient < RBR_PRESSURE_RESIDUAL_ESCAPE) {
+    // quotient ones then the zero that ends them
+    putBits(buffer, bit_pos, ((1ULL << quotient) - 1) << 1, quotient + 1);
+    putBits(buffer, bit_pos, z & ((1ULL << k) - 1), k);
+  } else {
+    uint8_t width = bitWidth(z);
+    putBits(buffer, bit_pos, (1ULL << RBR_PRESSURE_RESIDUAL_ESCAPE) - 1,
+            RBR_PRESSURE_RESIDUAL_ESCAPE);
+    putBits(buffer, bit_pos, width, RBR_PRESSURE_RESIDUAL_WIDTH_BITS);
+    putBits(buffer, bit_pos, z, width);
+  }
+}
+
+/*!
+ * @brief Quantize and residual code as many samples of a signal as fit in one message.
+ * @param[in] signal The pressure samples in decibar, starting at header.first_sample.
+ * @param[in] num_samples The number of samples left to send.
+ * @param[in] resolution_dbar The resolution to quantize to.
+ * @param[in,out] header In: sequence_num, the reading times, total_samples and first_sample.
+ *                Out: the rest of the header, num_samples is the number of samples encoded.
+ * @param[out] buffer The buffer to encode the message into.
+ * @param[in] buffer_len The size of the buffer.
+ * @param[out] encoded_len The number of bytes encoded.
+ * @return true if at least one sample was encoded, false if the first sample is not finite or
+ *         out of range of the codes, or the buffer can't fit the header. The message ends ahead
+ *         of any later sample like that, rbr_pressure_residual_skip() steps over it.
+ */
+bool rbr_pressure_residual_encode(const double *signal, size_t num_samples,
+                                  double resolution_dbar,
+                                  rbr_pressure_residual_header_t &header,
+                                  uint8_t *buffer, size_t buffer_len, size_t &encoded_len) {
+  bool rval = false;
+  encoded_len = 0;
+  do {
+    if (signal == NULL || buffer == NULL || num_samples == 0 || !(resolution_dbar > 0) ||
+        buffer_len <= sizeof(header)) {
+      break;
+    }
+    if (num_samples > UINT16_MAX) {
+      num_samples = UINT16_MAX;
+    }
+
+    int32_t reference_code = 0;
+    int32_t second_code = 0;
+    if (!quantize(signal[0], resolution_dbar, reference_code)) {
+      break;
+    }
+    // The message ends ahead of the first sample that can't be coded
+    if (num_samples == 1 || !quantize(signal[1], resolution_dbar, second_code) ||
+        static_cast<int64_t>(second_code) - reference_code > INT32_MAX ||
+        static_cast<int64_t>(second_code) - reference_code < INT32_MIN) {
+      num_samples = 1;
+      second_code = reference_code;
+    }
+    int64_t first_difference = static_cast<int64_t>(second_code) - reference_code;
+
+    // Pick the k that codes all of the samples left in the fewest bits
+    size_t k_bits[RBR_PRESSURE_RESIDUAL_MAX_K + 1] = {};
+    int64_t prev_code = second_code;
+    int64_t prev_prev_code = reference_code;
+    for (size_t i = 2; i < num_samples; i++) {
+      int32_t code;
+      if (!quantize(signal[i], resolution_dbar, code)) {
+        num_samples = i;
+        break;
+      }
+      uint64_t z = zigZag(code - 2 * prev_code + prev_prev_code);
+      for (uint8_t k = 0; k <= RBR_PRESSURE_RESIDUAL_MAX_K; k++) {
+        k_bits[k] += riceBits(z, k);
+      }
+      prev_prev_code = prev_code;
+      prev_code = code;
+    }
+    uint8_t rice_k = 0;
+    for (uint8_t k = 1; k <= RBR_PRESSURE_RESIDUAL_MAX_K; k++) {
+      if (k_bits[k] < k_bits[rice_k]) {
+        rice_k = k;
+      }
+    }
+
+    size_t bit_pos = sizeof(header) * 8;
+    size_t encoded_samples = (num_samples > 1) ? 2 : 1;
+    prev_code = second_code;
+    prev_prev_code = reference_code;
+    for (; encoded_samples < num_samples; encoded_samples++) {
+      int32_t code;
+      quantize(signal[encoded_samples], resolution_dbar, code);
+      uint64_t z = zigZag(code - 2 * prev_code + prev_prev_code);
+      if (bit_pos + riceBits(z, rice_k) > buffer_len * 8) {
+        break;
+      }
+      putRice(buffer, bit_pos, z, rice_k);
+      prev_prev_code = prev_code;
+      prev_code = code;
+    }
+
+    header.version = RBR_PRESSURE_RESIDUAL_VERSION;
+    header.rice_k = rice_k;
+    header.num_samples = static_cast<uint16_t>(encoded_samples);
+    header.resolution_dbar = resolution_dbar;
+    header.reference_code = reference_code;
+    header.first_difference = static_cast<int32_t>(first_difference);
+    memcpy(buffer, &header, sizeof(header));
+    encoded_len = (bit_pos + 7) / 8;
+    rval = true;
+  } while (0);
+
+  return rval;
+}
+
+/*!
+ * @brief Count the samples at the start of a signal that can't be residual coded.
+ * @param[in] signal The pressure samples in decibar.
+ * @param[in] num_samples The number of samples left to send.
+ * @param[in] resolution_dbar The resolution to quantize to.
+ * @return The number of leading samples that are not finite or out of range of the codes.
+ */
+size_t rbr_pressure_residual_skip(const double *signal, size_t num_samples,
+                                  double resolution_dbar) {
+  size_t skipped = 0;
+  int32_t code;
+  while (skipped < num_samples && !quantize(signal[skipped], resolution_dbar, code)) {
+    skipped++;
+  }
+  return skipped;
+}
@@ -0,0 +1,58 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+  Integer residual coding of the raw RBR pressure signal, the alternative to
+  sending every 2nd order difference as a CBOR double. Pressure is quantized to
+  the sensor's resolution, so the 2nd order differences of the codes are small
+  integers. Those are zig-zag mapped to unsigned and Rice coded with a k chosen
+  per message to minimize its size.
+
+  Message layout, rbr_pressure_residual_header_t (little endian) followed by a
+  bit stream MSB first:
+    (num_samples - 2) * residual e[i] = c[i] - 2 * c[i - 1] + c[i - 2], where
+                        c[0] is reference_code and c[1] - c[0] first_difference,
+                        each zig-zag mapped to z and coded as
+      if (z >> k) < RBR_PRESSURE_RESIDUAL_ESCAPE:
+        (z >> k) one bits, a zero bit, then the low k bits of z
+      else:
+        RBR_PRESSURE_RESIDUAL_ESCAPE one bits, 6 bits bit width w of z, w bits of z
+  then zero padding to a whole byte.
+
+  Every message carries its own reference code and first difference so it
+  decodes on its own, tools/scripts/misc/rbr_pressure_decoder.py decodes it on
+  the host. The decoded pressure is code * resolution_dbar.
+
+  Samples that aren't finite or don't fit a code end the message they would be
+  in, the next message starts after them. They are the samples of the window
+  that no message's first_sample and num_samples cover.
+*/
+
+#define RBR_PRESSURE_RESIDUAL_VERSION 1
+#define RBR_PRESSURE_RESIDUAL_ESCAPE 16
+#define RBR_PRESSURE_RESIDUAL_WIDTH_BITS 6
+#define RBR_PRESSURE_RESIDUAL_MAX_K 24
+
+typedef struct {
+  uint8_t version;
+  uint8_t rice_k;
+  uint16_t sequence_num;
+  uint64_t reading_time_utc_ms;
+  uint64_t reading_uptime_millis;
+  uint64_t sensor_reading_time_ms;
+  // Samples in the whole window, and where this message's first sample is in it
+  uint32_t total_samples;
+  uint32_t first_sample;
+  uint16_t num_samples;
+  double resolution_dbar;
+  int32_t reference_code;
+  int32_t first_difference;
+} __attribute__((packed)) rbr_pressure_residual_header_t;
+
+bool rbr_pressure_residual_encode(const double *signal, size_t num_samples,
+                                  double resolution_dbar,
+                                  rbr_pressure_residual_header_t &header,
+                                  uint8_t *buffer, size_t buffer_len, size_t &encoded_len);
+size_t rbr_pressure_residual_skip(const double *signal, size_t num_samples,
+                                  double resolution_dbar);
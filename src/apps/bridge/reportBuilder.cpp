@@ -9,8 +9,10 @@
 #include "device_info.h"
 #include "queue.h"
 #include "rbrCodaSensor.h"
+#include "reportBuilderElementTable.h"
 #include "semphr.h"
 #include "sensorController.h"
+#include "sensor_report_schema.h"
 #include "softSensor.h"
 #include "seapointTurbiditySensor.h"
 #include "task.h"
@@ -42,68 +44,12 @@
 */
 #define MAX_SENSOR_REPORT_CBOR_LEN 1688
 
-typedef struct report_builder_element_s {
-  uint64_t node_id;
-  uint8_t sensor_type;
-  void *sensor_data;
-  uint32_t sample_counter;
-  report_builder_element_s *next;
-  report_builder_element_s *prev;
-} report_builder_element_t;
-
-static aanderaa_aggregations_t NAN_AGG = {.abs_speed_mean_cm_s = NAN,
-                                          .abs_speed_std_cm_s = NAN,
-                                          .direction_circ_mean_rad = NAN,
-                                          .direction_circ_std_rad = NAN,
-                                          .temp_mean_deg_c = NAN,
-                                          .abs_tilt_mean_rad = NAN,
-                                          .std_tilt_mean_rad = NAN,
-                                          .reading_count = 0};
-
-static soft_aggregations_t SOFT_NAN_AGG = {.temp_mean_deg_c = NAN, .reading_count = 0};
-
-static rbr_coda_aggregations_t RBR_CODA_NAN_AGG = {.temp_mean_deg_c = NAN,
-                                                   .pressure_mean_deci_bar = NAN,
-                                                   .pressure_stdev_deci_bar = NAN,
-                                                   .reading_count = 0,
-                                                   .sensor_type =
-                                                       BmRbrDataMsg::SensorType::UNKNOWN};
-
-static seapoint_turbidity_aggregations_t seapoint_turbidity_NAN_AGG = {
-    .turbidity_s_mean_ftu = NAN, .turbidity_r_mean_ftu = NAN, .reading_count = 0};
-
-class ReportBuilderLinkedList {
-private:
-  report_builder_element_t *newElement(uint64_t node_id, uint8_t sensor_type, void *sensor_data,
-                                       uint32_t sensor_data_size, uint32_t samples_per_report,
-                                       uint32_t sample_counter);
-  void freeElement(report_builder_element_s **element_pointer);
-  void append(report_builder_element_t *curr, uint64_t node_id, uint8_t sensor_type,
-              void *sensor_data, uint32_t sensor_data_size, uint32_t samples_per_report,
-              uint32_t sample_counter);
-  void addSampleToElement(report_builder_element_t *element, uint8_t sensor_type,
-                          void *sensor_data, uint32_t sample_counter);
-
-  report_builder_element_t *head;
-  size_t size;
-
-public:
-  ReportBuilderLinkedList();
-  ~ReportBuilderLinkedList();
-
-  void removeElement(report_builder_element_t *element);
-  void findElementAndAddSampleToElement(uint64_t node_id, uint8_t sensor_type,
-                                        void *sensor_data, uint32_t sensor_data_size,
-                                        uint32_t samples_per_report, uint32_t sample_counter);
-  report_builder_element_t *findElement(uint64_t node_id);
-  void clear();
-};
-
 typedef struct ReportBuilderContext_s {
   uint32_t _sample_counter;
   uint32_t _samplesPerReport;
   uint32_t _transmitAggregations;
-  ReportBuilderLinkedList _reportBuilderLinkedList;
+  uint32_t _reportFormat;
+  ReportBuilderElementTable _reportBuilderElementTable;
   uint64_t _report_period_node_list[TOPOLOGY_SAMPLER_MAX_NODE_LIST_SIZE];
   abstractSensorType_e _report_period_sensor_type_list[TOPOLOGY_SAMPLER_MAX_NODE_LIST_SIZE];
   uint8_t *report_period_max_network_config_cbor;
@@ -118,277 +64,25 @@ static QueueHandle_t _report_builder_queue = NULL;
 
 static void report_builder_task(void *parameters);
 
-ReportBuilderLinkedList::ReportBuilderLinkedList() {
-  head = NULL;
-  size = 0;
-}
-
-ReportBuilderLinkedList::~ReportBuilderLinkedList() { clear(); }
-
 /**
- * @brief Creates a new element for the report builder linked list.
- *
- * This function allocates memory for a new report builder element and initializes its properties. It also allocates memory for the sensor data based on the number of samples per report and the size of the sensor data.
+ * @brief Adds a sample to its node's element in the report builder element table.
  *
  * @param node_id The ID of the node for the report.
  * @param sensor_type The type of the sensor for the report.
- * @param sensor_data Pointer to the sensor data for the report.
- * @param sensor_data_size The size of the sensor data.
- * @param samples_per_report The number of samples per report.
+ * @param sensor_data Pointer to the sensor data for the report, NULL to add a NAN sample.
  * @param sample_counter The current sample counter.
- * @return A pointer to the newly created report builder element.
- *
  */
-report_builder_element_t *
-ReportBuilderLinkedList::newElement(uint64_t node_id, uint8_t sensor_type, void *sensor_data,
-                                    uint32_t sensor_data_size, uint32_t samples_per_report,
+static void addSampleToElementTable(uint64_t node_id, uint8_t sensor_type, void *sensor_data,
                                     uint32_t sample_counter) {
-  report_builder_element_t *element =
-      static_cast<report_builder_element_t *>(pvPortMalloc(sizeof(report_builder_element_t)));
-  configASSERT(element != NULL);
-  element->node_id = node_id;
-  element->sensor_type = sensor_type;
-  element->sample_counter = 0;
-  element->sensor_data =
-      static_cast<void *>(pvPortMalloc(samples_per_report * sensor_data_size));
-  configASSERT(element->sensor_data != NULL);
-  memset(element->sensor_data, 0, samples_per_report * sensor_data_size);
-
-  addSampleToElement(element, sensor_type, sensor_data, sample_counter);
-
-  element->next = NULL;
-  element->prev = NULL;
-  return element;
-}
-
-void ReportBuilderLinkedList::freeElement(report_builder_element_t **element_pointer) {
-  if (element_pointer != NULL && *element_pointer != NULL) {
-    vPortFree((*element_pointer)->sensor_data); // Free the data first
-    vPortFree(*element_pointer);
-    *element_pointer = NULL;
-  }
-}
-
-void ReportBuilderLinkedList::removeElement(report_builder_element_t *element) {
-  if (element != NULL) {
-    if (element->prev != NULL) {
-      element->prev->next = element->next;
-    } else {
-      head = element->next;
-    }
-    if (element->next != NULL) {
-      element->next->prev = element->prev;
-    }
-    freeElement(&element);
-    size--;
-  }
-}
-
-/**
- * @brief Adds sensor data to a specific element in the report builder linked list.
- *
- * This function takes a pointer to an element in the linked list and adds the sensor data to that element. The sensor data is added at the position specified by the sample counter.
- *
- * @param element Pointer to the element in the linked list.
- * @param sensor_type The type of the sensor for the report.
- * @param sensor_data Pointer to the sensor data for the report.
- * @param sample_counter The current sample counter, indicating the position at which to add the sensor data.
- */
-void ReportBuilderLinkedList::addSampleToElement(report_builder_element_t *element,
-                                                 uint8_t sensor_type, void *sensor_data,
-                                                 uint32_t sample_counter) {
-  switch (sensor_type) {
-  case SENSOR_TYPE_AANDERAA: {
-    if (element->sample_counter < sample_counter) {
-      // Back fill the sensor_data with NANs if we are not on the right sample counter
-      // We use the element->sample_counter to track within each element how many samples
-      // the element has received.
-      for (; element->sample_counter < sample_counter; element->sample_counter++) {
-        memcpy(&(static_cast<aanderaa_aggregations_t *>(
-                   element->sensor_data))[element->sample_counter],
-               &NAN_AGG, sizeof(aanderaa_aggregations_t));
-      }
-    }
-
-    // Copy the sensor data into the elements array in the correct location within the buffer
-    // If it is NULL then just fill it with NAN again
-    if (sensor_data != NULL) {
-      memcpy(&(static_cast<aanderaa_aggregations_t *>(
-                 element->sensor_data))[element->sample_counter],
-             sensor_data, sizeof(aanderaa_aggregations_t));
-    } else {
-      memcpy(&(static_cast<aanderaa_aggregations_t *>(
-                 element->sensor_data))[element->sample_counter],
-             &NAN_AGG, sizeof(aanderaa_aggregations_t));
-    }
-    element->sample_counter++;
-    break;
-  }
-  case SENSOR_TYPE_SOFT: {
-    if (element->sample_counter < sample_counter) {
-      // Back fill the sensor_data with NANs if we are not on the right sample counter
-      // We use the element->sample_counter to track within each element how many samples
-      // the element has received.
-      for (; element->sample_counter < sample_counter; element->sample_counter++) {
-        memcpy(&(static_cast<soft_aggregations_t *>(
-                   element->sensor_data))[element->sample_counter],
-               &SOFT_NAN_AGG, sizeof(soft_aggregations_t));
-      }
-    }
-    if (sensor_data != NULL) {
-      memcpy(
-          &(static_cast<soft_aggregations_t *>(element->sensor_data))[element->sample_counter],
-          sensor_data, sizeof(soft_aggregations_t));
-    } else {
-      memcpy(
-          &(static_cast<soft_aggregations_t *>(element->sensor_data))[element->sample_counter],
-          &SOFT_NAN_AGG, sizeof(soft_aggregations_t));
-    }
-    element->sample_counter++;
-    break;
-  }
-  case SENSOR_TYPE_RBR_CODA: {
-    if (element->sample_counter < sample_counter) {
-      // Back fill the sensor_data with NANs if we are not on the right sample counter
-      // We use the element->sample_counter to track within each element how many samples
-      // the element has received.
-      for (; element->sample_counter < sample_counter; element->sample_counter++) {
-        memcpy(&(static_cast<rbr_coda_aggregations_t *>(
-                   element->sensor_data))[element->sample_counter],
-               &RBR_CODA_NAN_AGG, sizeof(rbr_coda_aggregations_t));
-      }
-    }
-    if (sensor_data != NULL) {
-      memcpy(&(static_cast<rbr_coda_aggregations_t *>(
-                 element->sensor_data))[element->sample_counter],
-             sensor_data, sizeof(rbr_coda_aggregations_t));
-    } else {
-      memcpy(&(static_cast<rbr_coda_aggregations_t *>(
-                 element->sensor_data))[element->sample_counter],
-             &RBR_CODA_NAN_AGG, sizeof(rbr_coda_aggregations_t));
-    }
-    element->sample_counter++;
-    break;
-  }
-  case SENSOR_TYPE_SEAPOINT_TURBIDITY: {
-    if (element->sample_counter < sample_counter) {
-      // Back fill the sensor_data with NANs if we are not on the right sample counter
-      // We use the element->sample_counter to track within each element how many samples
-      // the element has received.
-      for (; element->sample_counter < sample_counter; element->sample_counter++) {
-        memcpy(&(static_cast<seapoint_turbidity_aggregations_t *>(
-                   element->sensor_data))[element->sample_counter],
-               &seapoint_turbidity_NAN_AGG, sizeof(seapoint_turbidity_aggregations_t));
-      }
-    }
-    if (sensor_data != NULL) {
-      memcpy(&(static_cast<seapoint_turbidity_aggregations_t *>(
-                 element->sensor_data))[element->sample_counter],
-             sensor_data, sizeof(seapoint_turbidity_aggregations_t));
-    } else {
-      memcpy(&(static_cast<seapoint_turbidity_aggregations_t *>(
-                 element->sensor_data))[element->sample_counter],
-             &seapoint_turbidity_NAN_AGG, sizeof(seapoint_turbidity_aggregations_t));
-    }
-    element->sample_counter++;
-    break;
-  }
-  default: {
+  if (sensor_report_schema_sample_size(sensor_type) == 0) {
     bridgeLogPrint(BRIDGE_SYS, BM_COMMON_LOG_LEVEL_WARNING, USE_HEADER,
-                   "Unknown sensor type in addSampleToElement\n");
+                   "Unknown sensor type in addSampleToElementTable\n");
     configASSERT(0);
-    break;
-  }
-  }
-}
-
-/**
- * @brief Adds a sample to a specific element in the report builder linked list.
- *
- * This function finds the element associated with the given node_id in the linked list. If the element is found, it adds the sensor data to the element. If the element is not found, it creates a new element and appends it to the linked list.
- *
- * @param node_id The ID of the node for the report.
- * @param sensor_type The type of the sensor for the report.
- * @param sensor_data Pointer to the sensor data for the report.
- * @param sensor_data_size The size of the sensor data.
- * @param samples_per_report The number of samples per report.
- * @param sample_counter The current sample counter.
- * @return A boolean value indicating whether the operation was successful. Returns true if the sample was added successfully, false otherwise.
- */
-void ReportBuilderLinkedList::findElementAndAddSampleToElement(
-    uint64_t node_id, uint8_t sensor_type, void *sensor_data, uint32_t sensor_data_size,
-    uint32_t samples_per_report, uint32_t sample_counter) {
-  report_builder_element_t *element = findElement(node_id);
-  if (element != NULL) {
-    addSampleToElement(element, sensor_type, sensor_data, sample_counter);
-  } else {
-    if (head == NULL && size == 0) {
-      append(NULL, node_id, sensor_type, sensor_data, sensor_data_size, samples_per_report,
-             sample_counter);
-    } else {
-      report_builder_element_t *element = head;
-      while (element->next != NULL) {
-        element = element->next;
-      }
-      append(element, node_id, sensor_type, sensor_data, sensor_data_size, samples_per_report,
-             sample_counter);
-    }
-  }
-}
-
-void ReportBuilderLinkedList::append(report_builder_element_t *curr, uint64_t node_id,
-                                     uint8_t sensor_type, void *sensor_data,
-                                     uint32_t sensor_data_size, uint32_t samples_per_report,
-                                     uint32_t sample_counter) {
-  report_builder_element_s *element = newElement(
-      node_id, sensor_type, sensor_data, sensor_data_size, samples_per_report, sample_counter);
-  if (curr != NULL) {
-    element->next = curr->next;
-    element->prev = curr;
-    if (curr->next != NULL) {
-      curr->next->prev = element;
-    }
-    curr->next = element;
-    size++;
-  } else {
-    head = element;
-  }
-}
-
-report_builder_element_t *ReportBuilderLinkedList::findElement(uint64_t node_id) {
-  report_builder_element_t *element = head;
-  while (element != NULL) {
-    if (element->node_id == node_id) {
-      break;
-    }
-    element = element->next;
-  }
-  return element;
-}
-
-void ReportBuilderLinkedList::clear() {
-  report_builder_element_t *element = head;
-  while (element != NULL) {
-    report_builder_element_t *next = element->next;
-    freeElement(&element);
-    element = next;
+  } else if (!_ctx._reportBuilderElementTable.addSample(node_id, sensor_type, sensor_data,
+                                                        sample_counter)) {
+    bridgeLogPrint(BRIDGE_SYS, BM_COMMON_LOG_LEVEL_ERROR, USE_HEADER,
+                   "Failed to add sample for %016" PRIx64 " to the element table\n", node_id);
   }
-  head = NULL;
-  size = 0;
-}
-
-CborError encode_double_sample_member(CborEncoder &sample_array, void *sample_member) {
-  double local_sample_member = *(double *)sample_member;
-  CborError err = CborNoError;
-  err = cbor_encode_double(&sample_array, local_sample_member);
-  return err;
-}
-
-CborError encode_uint_sample_member(CborEncoder &sample_array, void *sample_member) {
-  uint32_t local_sample_member = *(uint32_t *)sample_member;
-  CborError err = CborNoError;
-  err = cbor_encode_uint(&sample_array, local_sample_member);
-  return err;
 }
 
 /**
@@ -442,221 +136,50 @@ void reportBuilderAddToQueue(uint64_t node_id, uint8_t sensor_type, void *sensor
  */
 static bool addSamplesToReport(sensor_report_encoder_context_t &context, uint8_t sensor_type,
                                void *sensor_data, uint32_t sample_index) {
-  bool rval = false;
-  switch (sensor_type) {
-  case SENSOR_TYPE_AANDERAA: {
-    aanderaa_aggregations_t aanderaa_sample =
-        (static_cast<aanderaa_aggregations_t *>(sensor_data))[sample_index];
-    if (sensor_report_encoder_open_sample(context, AANDERAA_NUM_SAMPLE_MEMBERS,
-                                          "aanderaa_current_v0") != CborNoError) {
-      bridgeLogPrint(BRIDGE_SYS, BM_COMMON_LOG_LEVEL_ERROR, USE_HEADER,
-                     "Failed to open sample in addSamplesToReport\n");
-      break;
-    }
-    if (sensor_report_encoder_add_sample_member(context, encode_double_sample_member,
-                                                &aanderaa_sample.abs_speed_mean_cm_s) !=
-        CborNoError) {
-      bridgeLogPrint(BRIDGE_SYS, BM_COMMON_LOG_LEVEL_ERROR, USE_HEADER,
-                     "Failed to add sample member in addSamplesToReport\n");
-      break;
-    }
-    if (sensor_report_encoder_add_sample_member(context, encode_double_sample_member,
-                                                &aanderaa_sample.abs_speed_std_cm_s) !=
-        CborNoError) {
-      bridgeLogPrint(BRIDGE_SYS, BM_COMMON_LOG_LEVEL_ERROR, USE_HEADER,
-                     "Failed to add sample member in addSamplesToReport\n");
-      break;
-    }
-    if (sensor_report_encoder_add_sample_member(context, encode_double_sample_member,
-                                                &aanderaa_sample.direction_circ_mean_rad) !=
-        CborNoError) {
-      bridgeLogPrint(BRIDGE_SYS, BM_COMMON_LOG_LEVEL_ERROR, USE_HEADER,
-                     "Failed to add sample member in addSamplesToReport\n");
-      break;
-    }
-    if (sensor_report_encoder_add_sample_member(context, encode_double_sample_member,
-                                                &aanderaa_sample.direction_circ_std_rad) !=
-        CborNoError) {
-      bridgeLogPrint(BRIDGE_SYS, BM_COMMON_LOG_LEVEL_ERROR, USE_HEADER,
-                     "Failed to add sample member in addSamplesToReport\n");
-      break;
-    }
-    if (sensor_report_encoder_add_sample_member(context, encode_double_sample_member,
-                                                &aanderaa_sample.temp_mean_deg_c) !=
-        CborNoError) {
-      bridgeLogPrint(BRIDGE_SYS, BM_COMMON_LOG_LEVEL_ERROR, USE_HEADER,
-                     "Failed to add sample member in addSamplesToReport\n");
-      break;
-    }
-    if (sensor_report_encoder_add_sample_member(context, encode_double_sample_member,
-                                                &aanderaa_sample.abs_tilt_mean_rad) !=
-        CborNoError) {
-      bridgeLogPrint(BRIDGE_SYS, BM_COMMON_LOG_LEVEL_ERROR, USE_HEADER,
-                     "Failed to add sample member in addSamplesToReport\n");
-      break;
-    }
-    if (sensor_report_encoder_add_sample_member(context, encode_double_sample_member,
-                                                &aanderaa_sample.std_tilt_mean_rad) !=
-        CborNoError) {
-      bridgeLogPrint(BRIDGE_SYS, BM_COMMON_LOG_LEVEL_ERROR, USE_HEADER,
-                     "Failed to add sample member in addSamplesToReport\n");
-      break;
-    }
-    if (sensor_report_encoder_add_sample_member(context, encode_uint_sample_member,
-                                                &aanderaa_sample.reading_count) !=
-        CborNoError) {
-      bridgeLogPrint(BRIDGE_SYS, BM_COMMON_LOG_LEVEL_ERROR, USE_HEADER,
-                     "Failed to add sample member in addSamplesToReport\n");
-      break;
-    }
-    if (sensor_report_encoder_close_sample(context) != CborNoError) {
-      bridgeLogPrint(BRIDGE_SYS, BM_COMMON_LOG_LEVEL_ERROR, USE_HEADER,
-                     "Failed to close sample in addSamplesToReport\n");
-      break;
-    }
-    rval = true;
-    break;
-  }
-  case SENSOR_TYPE_SOFT: {
-    soft_aggregations_t soft_sample =
-        (static_cast<soft_aggregations_t *>(sensor_data))[sample_index];
-    if (sensor_report_encoder_open_sample(context, SOFT_NUM_SAMPLE_MEMBERS,
-                                          "bm_soft_temp_v0") != CborNoError) {
-      bridgeLogPrint(BRIDGE_SYS, BM_COMMON_LOG_LEVEL_ERROR, USE_HEADER,
-                     "Failed to open sample in addSamplesToReport\n");
-      break;
-    }
-    if (sensor_report_encoder_add_sample_member(context, encode_double_sample_member,
-                                                &soft_sample.temp_mean_deg_c) != CborNoError) {
-      bridgeLogPrint(BRIDGE_SYS, BM_COMMON_LOG_LEVEL_ERROR, USE_HEADER,
-                     "Failed to add sample member in addSamplesToReport\n");
-      break;
-    }
-    if (sensor_report_encoder_close_sample(context) != CborNoError) {
-      bridgeLogPrint(BRIDGE_SYS, BM_COMMON_LOG_LEVEL_ERROR, USE_HEADER,
-                     "Failed to close sample in addSamplesToReport\n");
-      break;
-    }
-    rval = true;
-    break;
+  CborError err = CborNoError;
+  if (!sensor_report_schema_visit(sensor_type, [&](auto schema) {
+        typedef typename decltype(schema)::sample_t sample_t;
+        err = sensor_report_encode_sample(context,
+                                          static_cast<sample_t *>(sensor_data)[sample_index]);
+      })) {
+    bridgeLogPrint(BRIDGE_SYS, BM_COMMON_LOG_LEVEL_ERROR, USE_HEADER,
+                   "Received invalid sensor type in addSamplesToReport\n");
+    return false;
   }
-  case SENSOR_TYPE_RBR_CODA: {
-    rbr_coda_aggregations_t rbr_coda_sample =
-        (static_cast<rbr_coda_aggregations_t *>(sensor_data))[sample_index];
-    bool rbr_coda_sample_valid = false;
-    switch (rbr_coda_sample.sensor_type) {
-    case BmRbrDataMsg::SensorType::TEMPERATURE: {
-      if (sensor_report_encoder_open_sample(context, RBR_CODA_NUM_SAMPLE_MEMBERS,
-                                            "bm_rbr_t_v0") != CborNoError) {
-        bridgeLogPrint(BRIDGE_SYS, BM_COMMON_LOG_LEVEL_ERROR, USE_HEADER,
-                       "Failed to open rbr_coda sample in addSamplesToReport\n");
-      }
-      rbr_coda_sample_valid = true;
-      break;
-    }
-    case BmRbrDataMsg::SensorType::PRESSURE: {
-      if (sensor_report_encoder_open_sample(context, RBR_CODA_NUM_SAMPLE_MEMBERS,
-                                            "bm_rbr_d_v0") != CborNoError) {
-        bridgeLogPrint(BRIDGE_SYS, BM_COMMON_LOG_LEVEL_ERROR, USE_HEADER,
-                       "Failed to open rbr_coda sample in addSamplesToReport\n");
-      }
-      rbr_coda_sample_valid = true;
-      break;
-    }
-    case BmRbrDataMsg::SensorType::PRESSURE_AND_TEMPERATURE: {
-      if (sensor_report_encoder_open_sample(context, RBR_CODA_NUM_SAMPLE_MEMBERS,
-                                            "bm_rbr_td_v0") != CborNoError) {
-        bridgeLogPrint(BRIDGE_SYS, BM_COMMON_LOG_LEVEL_ERROR, USE_HEADER,
-                       "Failed to open rbr_coda sample in addSamplesToReport\n");
-      }
-      rbr_coda_sample_valid = true;
-      break;
-    }
-    case BmRbrDataMsg::SensorType::UNKNOWN: {
-      if (sensor_report_encoder_open_sample(context, RBR_CODA_NUM_SAMPLE_MEMBERS,
-                                            "bm_rbr_unknown") != CborNoError) {
-        bridgeLogPrint(BRIDGE_SYS, BM_COMMON_LOG_LEVEL_ERROR, USE_HEADER,
-                       "Failed to open rbr_coda sample in addSamplesToReport\n");
-      }
-      rbr_coda_sample_valid = true;
-      break;
-    }
-    default: {
-      bridgeLogPrint(BRIDGE_SYS, BM_COMMON_LOG_LEVEL_ERROR, USE_HEADER,
-                     "Received invalid rbr type in addSamplesToReport\n");
-      break;
-    }
-    }
-    if (!rbr_coda_sample_valid) {
-      break;
-    }
-    if (sensor_report_encoder_add_sample_member(context, encode_double_sample_member,
-                                                &rbr_coda_sample.temp_mean_deg_c) !=
-        CborNoError) {
-      bridgeLogPrint(BRIDGE_SYS, BM_COMMON_LOG_LEVEL_ERROR, USE_HEADER,
-                     "Failed to add rbr_coda sample member in addSamplesToReport\n");
-      break;
-    }
-    if (sensor_report_encoder_add_sample_member(context, encode_double_sample_member,
-                                                &rbr_coda_sample.pressure_mean_deci_bar) !=
-        CborNoError) {
-      bridgeLogPrint(BRIDGE_SYS, BM_COMMON_LOG_LEVEL_ERROR, USE_HEADER,
-                     "Failed to add rbr_coda sample member in addSamplesToReport\n");
-      break;
-    }
-    if (sensor_report_encoder_add_sample_member(context, encode_double_sample_member,
-                                                &rbr_coda_sample.pressure_stdev_deci_bar) !=
-        CborNoError) {
-      bridgeLogPrint(BRIDGE_SYS, BM_COMMON_LOG_LEVEL_ERROR, USE_HEADER,
-                     "Failed to add rbr_coda sample member in addSamplesToReport\n");
-      break;
-    }
-    if (sensor_report_encoder_close_sample(context) != CborNoError) {
-      bridgeLogPrint(BRIDGE_SYS, BM_COMMON_LOG_LEVEL_ERROR, USE_HEADER,
-                     "Failed to close rbr_coda sample in addSamplesToReport\n");
-      break;
-    }
-    rval = true;
-    break;
+  if (err != CborNoError) {
+    bridgeLogPrint(BRIDGE_SYS, BM_COMMON_LOG_LEVEL_ERROR, USE_HEADER,
+                   "Failed to encode sample in addSamplesToReport, err %d\n", err);
+    return false;
   }
-  case SENSOR_TYPE_SEAPOINT_TURBIDITY: {
-    seapoint_turbidity_aggregations_t seapoint_turbidity_sample =
-        (static_cast<seapoint_turbidity_aggregations_t *>(sensor_data))[sample_index];
-    if (sensor_report_encoder_open_sample(context, SEAPOINT_TURBIDITY_NUM_SAMPLE_MEMBERS,
-                                          "bm_seapoint_turbidity_v0") != CborNoError) {
-      bridgeLogPrint(BRIDGE_SYS, BM_COMMON_LOG_LEVEL_ERROR, USE_HEADER,
-                     "Failed to open seapoint_turbidity sample in addSamplesToReport\n");
-      break;
-    }
-    if (sensor_report_encoder_add_sample_member(context, encode_double_sample_member,
-                                               &seapoint_turbidity_sample.turbidity_s_mean_ftu) !=
-        CborNoError) {
-      bridgeLogPrint(BRIDGE_SYS, BM_COMMON_LOG_LEVEL_ERROR, USE_HEADER,
-                     "Failed to add seapoint_turbidity sample member in addSamplesToReport\n");
-      break;
-    }
-    if (sensor_report_encoder_add_sample_member(context, encode_double_sample_member,
-                                               &seapoint_turbidity_sample.turbidity_r_mean_ftu) !=
-        CborNoError) {
-      bridgeLogPrint(BRIDGE_SYS, BM_COMMON_LOG_LEVEL_ERROR, USE_HEADER,
-                     "Failed to add seapoint_turbidity sample member in addSamplesToReport\n");
-      break;
-    }
-    if (sensor_report_encoder_close_sample(context) != CborNoError) {
-      bridgeLogPrint(BRIDGE_SYS, BM_COMMON_LOG_LEVEL_ERROR, USE_HEADER,
-                     "Failed to close sample in addSamplesToReport\n");
-      break;
-    }
-    rval = true;
-    break;
+  return true;
+}
+
+/**
+ * @brief Adds all of a sensor's samples to the sensor report.
+ *
+ * @param context The context for the sensor report encoder, used for SENSOR_REPORT_FORMAT_CBOR.
+ * @param packed_context The context for the packed encoder, used for SENSOR_REPORT_FORMAT_PACKED.
+ * @param element The sensor's element, with _ctx._samplesPerReport samples.
+ * @return true if the sensor was added.
+ */
+static bool addSensorToReport(sensor_report_encoder_context_t &context,
+                              packed_sensor_report_encoder_context_t &packed_context,
+                              report_builder_element_t *element) {
+  if (_ctx._reportFormat == SENSOR_REPORT_FORMAT_PACKED) {
+    return sensor_report_pack_sensor(packed_context, element->sensor_type,
+                                     element->sensor_data);
   }
-  default: {
+  if (sensor_report_encoder_open_sensor(context, _ctx._samplesPerReport) != CborNoError) {
     bridgeLogPrint(BRIDGE_SYS, BM_COMMON_LOG_LEVEL_ERROR, USE_HEADER,
-                   "Received invalid sensor type in addSamplesToReport\n");
-    break;
+                   "Failed to open sensor in addSensorToReport\n");
+    return false;
   }
+  for (uint32_t j = 0; j < _ctx._samplesPerReport; j++) {
+    if (!addSamplesToReport(context, element->sensor_type, element->sensor_data, j)) {
+      return false;
+    }
   }
-  return rval;
+  return sensor_report_encoder_close_sensor(context) == CborNoError;
 }
 
 // Task init
@@ -686,9 +209,21 @@ void reportBuilderInit(cfg::Configuration *sys_cfg) {
                        strlen(AppConfig::TRANSMIT_AGGREGATIONS), _ctx._transmitAggregations);
     save_config = true;
   }
+  _ctx._reportFormat = DEFAULT_SENSOR_REPORT_FORMAT;
+  if (!sys_cfg->getConfig(AppConfig::SENSOR_REPORT_FORMAT,
+                          strlen(AppConfig::SENSOR_REPORT_FORMAT), _ctx._reportFormat)) {
+    bridgeLogPrint(BRIDGE_SYS, BM_COMMON_LOG_LEVEL_INFO, USE_HEADER,
+                   "Failed to get sensor report format from config, using default %" PRIu32
+                   " and saving to config\n",
+                   _ctx._reportFormat);
+    sys_cfg->setConfig(AppConfig::SENSOR_REPORT_FORMAT,
+                       strlen(AppConfig::SENSOR_REPORT_FORMAT), _ctx._reportFormat);
+    save_config = true;
+  }
   if (save_config) {
     sys_cfg->saveConfig(false);
   }
+  _ctx._reportBuilderElementTable.configure(_ctx._samplesPerReport);
   _ctx._sample_counter = 0;
   _ctx._config_mutex = xSemaphoreCreateMutex();
   configASSERT(_ctx._config_mutex);
@@ -733,10 +268,18 @@ static void report_builder_task(void *parameters) {
               uint8_t *cbor_buffer = NULL;
               do {
                 sensor_report_encoder_context_t context;
+                packed_sensor_report_encoder_context_t packed_context;
+                bool packed = (_ctx._reportFormat == SENSOR_REPORT_FORMAT_PACKED);
                 cbor_buffer = static_cast<uint8_t *>(pvPortMalloc(MAX_SENSOR_REPORT_CBOR_LEN));
                 configASSERT(cbor_buffer != NULL);
-                if (sensor_report_encoder_open_report(cbor_buffer, MAX_SENSOR_REPORT_CBOR_LEN,
-                                                      num_sensors, context) != CborNoError) {
+                bool opened =
+                    packed ? packed_sensor_report_encoder_open_report(
+                                 cbor_buffer, MAX_SENSOR_REPORT_CBOR_LEN, num_sensors,
+                                 _ctx._samplesPerReport, packed_context)
+                           : sensor_report_encoder_open_report(cbor_buffer,
+                                                               MAX_SENSOR_REPORT_CBOR_LEN,
+                                                               num_sensors, context) == CborNoError;
+                if (!opened) {
                   bridgeLogPrint(BRIDGE_SYS, BM_COMMON_LOG_LEVEL_ERROR, USE_HEADER,
                                  "Failed to open report in report_builder_task\n");
                   break;
@@ -744,52 +287,23 @@ static void report_builder_task(void *parameters) {
                 bool abort_cbor_encoding = false;
                 // Start at index 1 to skip the bridge
                 for (size_t i = 1; i < _ctx._report_period_num_nodes; i++) {
-                  report_builder_element_t *element = _ctx._reportBuilderLinkedList.findElement(
-                      _ctx._report_period_node_list[i]);
+                  report_builder_element_t *element =
+                      _ctx._reportBuilderElementTable.findElement(
+                          _ctx._report_period_node_list[i]);
                   if (element == NULL) {
                     if (_ctx._report_period_sensor_type_list[i] > SENSOR_TYPE_UNKNOWN) {
                       bridgeLogPrint(BRIDGE_SYS, BM_COMMON_LOG_LEVEL_INFO, USE_HEADER,
                                      "No data for node %016" PRIx64
                                      " in report period, adding it to the list\n",
                                      _ctx._report_period_node_list[i]);
-                      switch (_ctx._report_period_sensor_type_list[i]) {
-                      case SENSOR_TYPE_AANDERAA: {
-                        _ctx._reportBuilderLinkedList.findElementAndAddSampleToElement(
-                            _ctx._report_period_node_list[i],
-                            _ctx._report_period_sensor_type_list[i], NULL,
-                            sizeof(aanderaa_aggregations_t), _ctx._samplesPerReport,
-                            (_ctx._sample_counter - 1));
-                        break;
-                      }
-                      case SENSOR_TYPE_SOFT: {
-                        _ctx._reportBuilderLinkedList.findElementAndAddSampleToElement(
-                            _ctx._report_period_node_list[i],
-                            _ctx._report_period_sensor_type_list[i], NULL,
-                            sizeof(soft_aggregations_t), _ctx._samplesPerReport,
-                            (_ctx._sample_counter - 1));
-                        break;
-                      }
-                      case SENSOR_TYPE_RBR_CODA: {
-                        _ctx._reportBuilderLinkedList.findElementAndAddSampleToElement(
-                            _ctx._report_period_node_list[i],
-                            _ctx._report_period_sensor_type_list[i], NULL,
-                            sizeof(rbr_coda_aggregations_t), _ctx._samplesPerReport,
-                            (_ctx._sample_counter - 1));
-                        break;
-                      }
-                      case SENSOR_TYPE_SEAPOINT_TURBIDITY: {
-                        _ctx._reportBuilderLinkedList.findElementAndAddSampleToElement(
-                            _ctx._report_period_node_list[i],
-                            _ctx._report_period_sensor_type_list[i], NULL,
-                            sizeof(seapoint_turbidity_aggregations_t), _ctx._samplesPerReport,
-                            (_ctx._sample_counter - 1));
-                        break;
-                      }
-                      default: {
+                      if (sensor_report_schema_sample_size(
+                              _ctx._report_period_sensor_type_list[i]) > 0) {
+                        addSampleToElementTable(_ctx._report_period_node_list[i],
+                                                _ctx._report_period_sensor_type_list[i], NULL,
+                                                (_ctx._sample_counter - 1));
+                      } else {
                         bridgeLogPrint(BRIDGE_SYS, BM_COMMON_LOG_LEVEL_ERROR, USE_HEADER,
                                        "Invalid sensor type in report_builder_task\n");
-                        break;
-                      }
                       }
                     } else {
                       bridgeLogPrint(BRIDGE_SYS, BM_COMMON_LOG_LEVEL_ERROR, USE_HEADER,
@@ -798,7 +312,7 @@ static void report_builder_task(void *parameters) {
                       // So instead, lets continue the for loop to the next node!
                       continue;
                     }
-                    element = _ctx._reportBuilderLinkedList.findElement(
+                    element = _ctx._reportBuilderElementTable.findElement(
                         _ctx._report_period_node_list[i]);
                   } else {
                     bridgeLogPrint(BRIDGE_SYS, BM_COMMON_LOG_LEVEL_INFO, USE_HEADER,
@@ -806,27 +320,9 @@ static void report_builder_task(void *parameters) {
                                    " adding it to the the report\n",
                                    _ctx._report_period_node_list[i]);
                   }
-                  if (sensor_report_encoder_open_sensor(context, _ctx._samplesPerReport) !=
-                      CborNoError) {
-                    bridgeLogPrint(BRIDGE_SYS, BM_COMMON_LOG_LEVEL_ERROR, USE_HEADER,
-                                   "Failed to open sensor in report_builder_task\n");
-                    abort_cbor_encoding = true;
-                    break;
-                  }
-                  for (uint32_t j = 0; j < _ctx._samplesPerReport; j++) {
-                    if (!addSamplesToReport(context, element->sensor_type, element->sensor_data,
-                                            j)) {
-                      bridgeLogPrint(
-                          BRIDGE_SYS, BM_COMMON_LOG_LEVEL_ERROR, USE_HEADER,
-                          "Failed to add samples to report in report_builder_task\n");
-                      abort_cbor_encoding = true;
-                      break;
-                    }
-                  }
-                  if (sensor_report_encoder_close_sensor(context) != CborNoError ||
-                      abort_cbor_encoding) {
+                  if (element == NULL || !addSensorToReport(context, packed_context, element)) {
                     bridgeLogPrint(BRIDGE_SYS, BM_COMMON_LOG_LEVEL_ERROR, USE_HEADER,
-                                   "Failed to close sensor in report_builder_task\n");
+                                   "Failed to add sensor to report in report_builder_task\n");
                     abort_cbor_encoding = true;
                     break;
                   }
@@ -834,12 +330,17 @@ static void report_builder_task(void *parameters) {
                 if (abort_cbor_encoding) {
                   break;
                 }
-                if (sensor_report_encoder_close_report(context) != CborNoError) {
+                bool closed = packed
+                                  ? packed_sensor_report_encoder_close_report(packed_context)
+                                  : sensor_report_encoder_close_report(context) == CborNoError;
+                if (!closed) {
                   bridgeLogPrint(BRIDGE_SYS, BM_COMMON_LOG_LEVEL_ERROR, USE_HEADER,
                                  "Failed to close report in report_builder_task\n");
                   break;
                 }
-                size_t cbor_buffer_len = sensor_report_encoder_get_report_size_bytes(context);
+                size_t cbor_buffer_len =
+                    packed ? packed_sensor_report_encoder_get_report_size_bytes(packed_context)
+                           : sensor_report_encoder_get_report_size_bytes(context);
                 message_buff =
                     static_cast<app_pub_sub_bm_bridge_sensor_report_data_t *>(pvPortMalloc(
                         sizeof(app_pub_sub_bm_bridge_sensor_report_data_t) + cbor_buffer_len));
@@ -852,7 +353,8 @@ static void report_builder_task(void *parameters) {
                               sizeof(APP_PUB_SUB_BM_BRIDGE_SENSOR_REPORT_TOPIC),
                               reinterpret_cast<uint8_t *>(message_buff),
                               sizeof(uint32_t) + sizeof(size_t) + cbor_buffer_len,
-                              APP_PUB_SUB_BM_BRIDGE_SENSOR_REPORT_TYPE,
+                              packed ? APP_PUB_SUB_BM_BRIDGE_SENSOR_REPORT_PACKED_TYPE
+                                     : APP_PUB_SUB_BM_BRIDGE_SENSOR_REPORT_TYPE,
                               APP_PUB_SUB_BM_BRIDGE_SENSOR_REPORT_VERSION);
               } while (0);
               if (message_buff != NULL) {
@@ -869,7 +371,7 @@ static void report_builder_task(void *parameters) {
           // Always clear the list and reset the sample counter when _ctx._sample_counter >= _ctx._samplesPerReport
           bridgeLogPrint(BRIDGE_SYS, BM_COMMON_LOG_LEVEL_INFO, USE_HEADER,
                          "Clearing the list\n");
-          _ctx._reportBuilderLinkedList.clear();
+          _ctx._reportBuilderElementTable.clear();
           bridgeLogPrint(BRIDGE_SYS, BM_COMMON_LOG_LEVEL_INFO, USE_HEADER,
                          "Clearing the sample counter\n");
           _ctx._sample_counter = 0;
@@ -887,9 +389,8 @@ static void report_builder_task(void *parameters) {
         if (_ctx._samplesPerReport > 0) {
           bridgeLogPrint(BRIDGE_SYS, BM_COMMON_LOG_LEVEL_INFO, USE_HEADER,
                          "Adding sample for %016" PRIx64 " to list\n", item.node_id);
-          _ctx._reportBuilderLinkedList.findElementAndAddSampleToElement(
-              item.node_id, item.sensor_type, item.sensor_data, item.sensor_data_size,
-              _ctx._samplesPerReport, _ctx._sample_counter);
+          addSampleToElementTable(item.node_id, item.sensor_type, item.sensor_data,
+                                  _ctx._sample_counter);
         } else {
           bridgeLogPrint(BRIDGE_SYS, BM_COMMON_LOG_LEVEL_INFO, USE_HEADER,
                          "samplesPerReport is 0, not adding sample to list\n");
@@ -0,0 +1,144 @@
+#include "reportBuilderElementTable.h"
+#include "FreeRTOS.h"
+#include "sensor_report_schema.h"
+#include <string.h>
+
+ReportBuilderElementTable::ReportBuilderElementTable() {
+  memset(_elements, 0, sizeof(_elements));
+  _samples_per_report = 0;
+  clear();
+}
+
+ReportBuilderElementTable::~ReportBuilderElementTable() { freeSampleBuffers(); }
+
+/**
+ * @brief Sets the number of samples per report the sample buffers are sized for.
+ *
+ * Changing it empties the table and frees the sample buffers, they are allocated again at
+ * the new size as sensors send samples.
+ *
+ * @param samples_per_report The number of samples per report.
+ */
+void ReportBuilderElementTable::configure(uint32_t samples_per_report) {
+  if (samples_per_report != _samples_per_report) {
+    clear();
+    freeSampleBuffers();
+    _samples_per_report = samples_per_report;
+  }
+}
+
+/**
+ * @brief Adds a sample to a node's element, creating the element if the node has none yet.
+ *
+ * Samples the node missed since its last one are back filled with NANs, so the sample ends up
+ * at sample_counter.
+ *
+ * @param node_id The ID of the node for the report.
+ * @param sensor_type The type of the sensor for the report.
+ * @param sensor_data Pointer to the sample, NULL to add a NAN sample.
+ * @param sample_counter The current sample counter.
+ * @return true if the sample was added, false if the sensor type is unknown or differs from the
+ *         element's, the sample doesn't fit in the report or the table is full.
+ */
+bool ReportBuilderElementTable::addSample(uint64_t node_id, uint8_t sensor_type,
+                                          const void *sensor_data, uint32_t sample_counter) {
+  size_t sample_size = sensor_report_schema_sample_size(sensor_type);
+  if (sample_size == 0 || sample_counter >= _samples_per_report) {
+    return false;
+  }
+  report_builder_element_t *element = findElement(node_id);
+  if (element == NULL) {
+    element = newElement(node_id, sensor_type, sample_size);
+    if (element == NULL) {
+      return false;
+    }
+  } else if (element->sensor_type != sensor_type ||
+             element->sample_counter >= _samples_per_report) {
+    return false;
+  }
+
+  return sensor_report_schema_visit(sensor_type, [&](auto schema) {
+    typedef typename decltype(schema)::sample_t sample_t;
+    sample_t *samples = static_cast<sample_t *>(element->sensor_data);
+    for (; element->sample_counter < sample_counter; element->sample_counter++) {
+      memcpy(&samples[element->sample_counter], &schema.nan_sample, sizeof(sample_t));
+    }
+    memcpy(&samples[element->sample_counter],
+           (sensor_data != NULL) ? sensor_data : &schema.nan_sample, sizeof(sample_t));
+    element->sample_counter++;
+  });
+}
+
+/**
+ * @brief Finds a node's element.
+ *
+ * @param node_id The ID of the node.
+ * @return The element, NULL if the node has no samples in this report period.
+ */
+report_builder_element_t *ReportBuilderElementTable::findElement(uint64_t node_id) {
+  uint8_t slot = indexSlot(node_id);
+  for (size_t i = 0; i < REPORT_BUILDER_ELEMENT_INDEX_SIZE; i++) {
+    int8_t element_index = _index[slot];
+    if (element_index == REPORT_BUILDER_ELEMENT_INDEX_EMPTY) {
+      break;
+    }
+    if (_elements[element_index].node_id == node_id) {
+      return &_elements[element_index];
+    }
+    slot = (slot + 1) & (REPORT_BUILDER_ELEMENT_INDEX_SIZE - 1);
+  }
+  return NULL;
+}
+
+/**
+ * @brief Empties the table for the next report period, keeping the sample buffers.
+ */
+void ReportBuilderElementTable::clear() {
+  memset(_index, REPORT_BUILDER_ELEMENT_INDEX_EMPTY, sizeof(_index));
+  _size = 0;
+}
+
+// Fibonacci hashing, node ids are random enough but not in their low bits alone
+uint8_t ReportBuilderElementTable::indexSlot(uint64_t node_id) const {
+  return static_cast<uint8_t>((node_id * 0x9E3779B97F4A7C15ULL) >>
+                              (64 - REPORT_BUILDER_ELEMENT_INDEX_BITS));
+}
+
+report_builder_element_t *ReportBuilderElementTable::newElement(uint64_t node_id,
+                                                                uint8_t sensor_type,
+                                                                size_t sample_size) {
+  if (_size >= TOPOLOGY_SAMPLER_MAX_NODE_LIST_SIZE) {
+    return NULL;
+  }
+  report_builder_element_t *element = &_elements[_size];
+  size_t sensor_data_size = _samples_per_report * sample_size;
+  // Only grows when a bigger sensor type lands in the slot than the ones before it
+  if (element->sensor_data_capacity < sensor_data_size) {
+    vPortFree(element->sensor_data);
+    element->sensor_data = pvPortMalloc(sensor_data_size);
+    configASSERT(element->sensor_data != NULL);
+    element->sensor_data_capacity = sensor_data_size;
+  }
+  memset(element->sensor_data, 0, sensor_data_size);
+  element->node_id = node_id;
+  element->sensor_type = sensor_type;
+  element->sample_counter = 0;
+
+  uint8_t slot = indexSlot(node_id);
+  while (_index[slot] != REPORT_BUILDER_ELEMENT_INDEX_EMPTY) {
+    slot = (slot + 1) & (REPORT_BUILDER_ELEMENT_INDEX_SIZE - 1);
+  }
+  _index[slot] = static_cast<int8_t>(_size);
+  _size++;
+  return element;
+}
+
+void ReportBuilderElementTable::freeSampleBuffers() {
+  for (size_t i = 0; i < TOPOLOGY_SAMPLER_MAX_NODE_LIST_SIZE; i++) {
+    if (_elements[i].sensor_data != NULL) {
+      vPortFree(_elements[i].sensor_data);
+      _elements[i].sensor_data = NULL;
+    }
+    _elements[i].sensor_data_capacity = 0;
+  }
+}
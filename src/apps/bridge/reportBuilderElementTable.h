@@ -0,0 +1,53 @@
+#pragma once
+
+#include "topology_sampler.h"
+#include <stddef.h>
+#include <stdint.h>
+
+// Open addressing index, twice the number of elements so probes stay short
+#define REPORT_BUILDER_ELEMENT_INDEX_BITS (5)
+#define REPORT_BUILDER_ELEMENT_INDEX_SIZE (1u << REPORT_BUILDER_ELEMENT_INDEX_BITS)
+#define REPORT_BUILDER_ELEMENT_INDEX_EMPTY (-1)
+
+static_assert(REPORT_BUILDER_ELEMENT_INDEX_SIZE >= 2 * TOPOLOGY_SAMPLER_MAX_NODE_LIST_SIZE,
+              "report builder element index too small");
+
+typedef struct {
+  uint64_t node_id;
+  uint8_t sensor_type;
+  // samples_per_report samples of sensor_type, kept across report periods
+  void *sensor_data;
+  size_t sensor_data_capacity;
+  uint32_t sample_counter;
+} report_builder_element_t;
+
+/*
+  The samples of every sensor for the current report period. Elements live in
+  a fixed arena with one slot per node of the topology, found by node id
+  through a hash index. Each slot's sample buffer is allocated the first time
+  it is needed and reused every report period after, until the number of
+  samples per report changes.
+*/
+class ReportBuilderElementTable {
+public:
+  ReportBuilderElementTable();
+  ~ReportBuilderElementTable();
+
+  void configure(uint32_t samples_per_report);
+  bool addSample(uint64_t node_id, uint8_t sensor_type, const void *sensor_data,
+                 uint32_t sample_counter);
+  report_builder_element_t *findElement(uint64_t node_id);
+  void clear();
+  size_t size() const { return _size; }
+
+private:
+  uint8_t indexSlot(uint64_t node_id) const;
+  report_builder_element_t *newElement(uint64_t node_id, uint8_t sensor_type,
+                                       size_t sample_size);
+  void freeSampleBuffers();
+
+  report_builder_element_t _elements[TOPOLOGY_SAMPLER_MAX_NODE_LIST_SIZE];
+  int8_t _index[REPORT_BUILDER_ELEMENT_INDEX_SIZE];
+  size_t _size;
+  uint32_t _samples_per_report;
+};
@@ -45,7 +45,7 @@ static bool node_info_reply_cb(bool ack, uint32_t msg_id, size_t service_strlen,
 static void abstractSensorAddSensorSub(AbstractSensor *sensor);
 /*!
  * @brief Initialize the sensor controller.
- * This controller is responsible for identifying & detecting sensor nodes and subscribing to them.
+ * This controller is responsible for identifying & detecting sensor nodes and subscribing to their data.
  * It will also aggregate the data from the Aanderaa nodes and transmit it over the spotter_tx service.
  */
 void sensorControllerInit(BridgePowerController *power_controller,
@@ -132,6 +132,12 @@ static void runController(void *param) {
   }
   _ctx._subbed_sensors = NULL;
   _ctx._num_subbed_sensors = 0;
+  // Wildcard subscriptions cover every node of a sensor type, data from nodes
+  // that haven't been found yet is dropped by the callbacks
+  if (!Aanderaa_t::subscribe() || !Soft_t::subscribe() || !RbrCoda_t::subscribe() ||
+      !SeapointTurbidity_t::subscribe()) {
+    printf("Failed to subscribe to sensor nodes\n");
+  }
   _ctx._initialized = true;
   while (true) {
     // wait for a notification from one of the timers, clear all the bits on exit
@@ -194,11 +200,7 @@ void abstractSensorAddSensorSub(AbstractSensor *sensor) {
     }
     curr->next = sensor;
   }
-  if (!sensor->subscribe()) {
-    printf("Failed to subscribe to sensor node %016" PRIx64 "\n", sensor->node_id);
-  } else {
-    printf("New sensor node found %016" PRIx64 "\n", sensor->node_id);
-  }
+  printf("New sensor node found %016" PRIx64 "\n", sensor->node_id);
 }
 
 AbstractSensor *sensorControllerFindSensorById(uint64_t node_id) {
@@ -235,11 +237,7 @@ static bool node_info_reply_cb(bool ack, uint32_t msg_id, size_t service_strlen,
           _ctx._sys_cfg->getConfig(AppConfig::SAMPLE_DURATION_MS,
                                    strlen(AppConfig::SAMPLE_DURATION_MS),
                                    current_agg_period_ms);
-          uint32_t AVERAGER_MAX_SAMPLES =
-              (current_agg_period_ms / _ctx.current_reading_period_ms) +
-              Aanderaa_t::N_SAMPLES_PAD;
-          Aanderaa_t *aanderaa_sub =
-              createAanderaaSub(reply.node_id, current_agg_period_ms, AVERAGER_MAX_SAMPLES);
+          Aanderaa_t *aanderaa_sub = createAanderaaSub(reply.node_id, current_agg_period_ms);
           if (aanderaa_sub) {
             abstractSensorAddSensorSub(aanderaa_sub);
           }
@@ -251,10 +249,7 @@ static bool node_info_reply_cb(bool ack, uint32_t msg_id, size_t service_strlen,
               (BridgePowerController::DEFAULT_SAMPLE_DURATION_S * 1000);
           _ctx._sys_cfg->getConfig(AppConfig::SAMPLE_DURATION_MS,
                                    strlen(AppConfig::SAMPLE_DURATION_MS), soft_agg_period_ms);
-          uint32_t AVERAGER_MAX_SAMPLES =
-              (soft_agg_period_ms / _ctx.soft_reading_period_ms) + Soft_t::N_SAMPLES_PAD;
-          Soft_t *soft_sub =
-              createSoftSub(reply.node_id, soft_agg_period_ms, AVERAGER_MAX_SAMPLES);
+          Soft_t *soft_sub = createSoftSub(reply.node_id, soft_agg_period_ms);
           if (soft_sub) {
             abstractSensorAddSensorSub(soft_sub);
           }
@@ -267,10 +262,8 @@ static bool node_info_reply_cb(bool ack, uint32_t msg_id, size_t service_strlen,
           _ctx._sys_cfg->getConfig(AppConfig::SAMPLE_DURATION_MS,
                                    strlen(AppConfig::SAMPLE_DURATION_MS),
                                    rbr_coda_agg_period_ms);
-          uint32_t AVERAGER_MAX_SAMPLES =
-              (rbr_coda_agg_period_ms / _ctx.rbr_coda_reading_period_ms) + RbrCoda_t::N_SAMPLES_PAD;
-          RbrCoda_t *rbr_coda_sub =
-              createRbrCodaSub(reply.node_id, rbr_coda_agg_period_ms, AVERAGER_MAX_SAMPLES, _ctx.rbr_coda_reading_period_ms);
+          RbrCoda_t *rbr_coda_sub = createRbrCodaSub(reply.node_id, rbr_coda_agg_period_ms,
+                                                     _ctx.rbr_coda_reading_period_ms);
           if (rbr_coda_sub) {
             abstractSensorAddSensorSub(rbr_coda_sub);
           }
@@ -283,11 +276,8 @@ static bool node_info_reply_cb(bool ack, uint32_t msg_id, size_t service_strlen,
           _ctx._sys_cfg->getConfig(AppConfig::SAMPLE_DURATION_MS,
                                    strlen(AppConfig::SAMPLE_DURATION_MS),
                                    seapoint_turbidity_agg_period_ms);
-          uint32_t AVERAGER_MAX_SAMPLES =
-              (seapoint_turbidity_agg_period_ms / _ctx.seapoint_turbidity_reading_period_ms) +
-              SeapointTurbidity_t::N_SAMPLES_PAD;
           SeapointTurbidity_t *seapoint_turbidity_sub =
-              createSeapointTurbiditySub(reply.node_id, seapoint_turbidity_agg_period_ms, AVERAGER_MAX_SAMPLES);
+              createSeapointTurbiditySub(reply.node_id, seapoint_turbidity_agg_period_ms);
           if (seapoint_turbidity_sub) {
             abstractSensorAddSensorSub(seapoint_turbidity_sub);
           }
@@ -21,7 +21,7 @@ bool AanderaaSensor::subscribe() {
   char *sub = static_cast<char *>(pvPortMalloc(BM_TOPIC_MAX_LEN));
   configASSERT(sub);
   int topic_strlen =
-      snprintf(sub, BM_TOPIC_MAX_LEN, "sensor/%016" PRIx64 "%s", node_id, subtag);
+      snprintf(sub, BM_TOPIC_MAX_LEN, "sensor/%c%s", BM_SUB_SINGLE_LEVEL_WILDCARD, subtag);
   if (topic_strlen > 0) {
     rval = bm_sub_wl(sub, topic_strlen, aanderaSubCallback);
   }
@@ -212,8 +212,7 @@ void AanderaaSensor::aggregate(void) {
   vPortFree(log_buf);
 }
 
-Aanderaa_t *createAanderaaSub(uint64_t node_id, uint32_t current_agg_period_ms,
-                              uint32_t averager_max_samples) {
+Aanderaa_t *createAanderaaSub(uint64_t node_id, uint32_t current_agg_period_ms) {
   Aanderaa_t *new_sub = static_cast<Aanderaa_t *>(pvPortMalloc(sizeof(Aanderaa_t)));
   new_sub = new (new_sub) Aanderaa_t();
   configASSERT(new_sub);
@@ -225,11 +224,11 @@ Aanderaa_t *createAanderaaSub(uint64_t node_id, uint32_t current_agg_period_ms,
   new_sub->type = SENSOR_TYPE_AANDERAA;
   new_sub->next = NULL;
   new_sub->current_agg_period_ms = current_agg_period_ms;
-  new_sub->abs_speed_cm_s.initBuffer(averager_max_samples);
-  new_sub->direction_rad.initBuffer(averager_max_samples);
-  new_sub->temp_deg_c.initBuffer(averager_max_samples);
-  new_sub->abs_tilt_rad.initBuffer(averager_max_samples);
-  new_sub->std_tilt_rad.initBuffer(averager_max_samples);
+  new_sub->abs_speed_cm_s.initStreaming();
+  new_sub->direction_rad.initStreaming();
+  new_sub->temp_deg_c.initStreaming();
+  new_sub->abs_tilt_rad.initStreaming();
+  new_sub->std_tilt_rad.initStreaming();
   new_sub->reading_count = 0;
   return new_sub;
 }
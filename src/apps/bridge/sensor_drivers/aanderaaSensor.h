@@ -35,8 +35,6 @@ typedef struct AanderaaSensor : public AbstractSensor {
   int8_t node_position;
   uint32_t last_timestamp;
 
-  static constexpr uint32_t N_SAMPLES_PAD =
-      10; // Extra sample padding to account for timing slop.
   static constexpr uint8_t MIN_READINGS_FOR_AGGREGATION = 3;
   static constexpr double DIRECTION_SAMPLE_MEMBER_MIN = 0.0;
   static constexpr double DIRECTION_SAMPLE_MEMBER_MAX = M_TWOPI;
@@ -48,7 +46,7 @@ typedef struct AanderaaSensor : public AbstractSensor {
   static constexpr double TEMP_SAMPLE_MEMBER_MAX = 40.0;
 
 public:
-  bool subscribe() override;
+  static bool subscribe();
   void aggregate(void);
 
 private:
@@ -60,4 +58,4 @@ private:
   static constexpr char subtag[] = "/sofar/aanderaa";
 } Aanderaa_t;
 
-Aanderaa_t* createAanderaaSub(uint64_t node_id, uint32_t current_agg_period_ms, uint32_t averager_max_samples);
+Aanderaa_t* createAanderaaSub(uint64_t node_id, uint32_t current_agg_period_ms);
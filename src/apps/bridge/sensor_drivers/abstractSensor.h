@@ -16,6 +16,4 @@ struct AbstractSensor {
     AbstractSensor *next;
     SemaphoreHandle_t _mutex;
     abstractSensorType_e type;
-public:
-    virtual bool subscribe() = 0;
 };
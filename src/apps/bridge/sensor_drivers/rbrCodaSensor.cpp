@@ -22,7 +22,7 @@ bool RbrCodaSensor::subscribe() {
   char *sub = static_cast<char *>(pvPortMalloc(BM_TOPIC_MAX_LEN));
   configASSERT(sub);
   int topic_strlen =
-      snprintf(sub, BM_TOPIC_MAX_LEN, "sensor/%016" PRIx64 "%s", node_id, subtag);
+      snprintf(sub, BM_TOPIC_MAX_LEN, "sensor/%c%s", BM_SUB_SINGLE_LEVEL_WILDCARD, subtag);
   if (topic_strlen > 0) {
     rval = bm_sub_wl(sub, topic_strlen, rbrCodaSubCallback);
   }
@@ -199,7 +199,7 @@ void RbrCodaSensor::aggregate(void) {
 }
 
 RbrCoda_t *createRbrCodaSub(uint64_t node_id, uint32_t rbr_coda_agg_period_ms,
-                            uint32_t averager_max_samples, uint32_t configured_reading_period_ms) {
+                            uint32_t configured_reading_period_ms) {
   RbrCoda_t *new_sub = static_cast<RbrCoda_t *>(pvPortMalloc(sizeof(RbrCoda_t)));
   new_sub = new (new_sub) RbrCoda_t();
   configASSERT(new_sub);
@@ -211,8 +211,8 @@ RbrCoda_t *createRbrCodaSub(uint64_t node_id, uint32_t rbr_coda_agg_period_ms,
   new_sub->type = SENSOR_TYPE_RBR_CODA;
   new_sub->next = NULL;
   new_sub->rbr_coda_agg_period_ms = rbr_coda_agg_period_ms;
-  new_sub->temp_deg_c.initBuffer(averager_max_samples);
-  new_sub->pressure_deci_bar.initBuffer(averager_max_samples);
+  new_sub->temp_deg_c.initStreaming();
+  new_sub->pressure_deci_bar.initStreaming();
   new_sub->reading_count = 0;
   new_sub->configured_reading_period_ms = configured_reading_period_ms;
   return new_sub;
@@ -28,9 +28,6 @@ typedef struct RbrCodaSensor : public AbstractSensor {
   uint32_t last_timestamp;
   uint32_t configured_reading_period_ms;
 
-  // Extra sample padding to account for timing slop. Calculated as the sample frequency + 2 minutes bridge on period + some extra slop.
-  // 2 minutes is the minimum bridge on period and the soft by default is sampling at 2Hz. So 2*120 + 30 = 270.
-  static constexpr uint32_t N_SAMPLES_PAD = 270;
   static constexpr uint8_t MIN_READINGS_FOR_AGGREGATION = 3;
   static constexpr double TEMP_SAMPLE_MEMBER_MIN = -20;
   static constexpr double TEMP_SAMPLE_MEMBER_MAX = 84.8572;
@@ -41,7 +38,7 @@ typedef struct RbrCodaSensor : public AbstractSensor {
   static constexpr uint32_t DEFAULT_RBR_CODA_READING_PERIOD_MS = 500; // 2Hz
 
 public:
-  bool subscribe() override;
+  static bool subscribe();
   void aggregate(void);
 
 private:
@@ -55,4 +52,4 @@ private:
 } RbrCoda_t;
 
 RbrCoda_t *createRbrCodaSub(uint64_t node_id, uint32_t rbr_coda_agg_period_ms,
-                            uint32_t averager_max_samples, uint32_t configured_reading_period_ms);
\ No newline at end of file
+                            uint32_t configured_reading_period_ms);
\ No newline at end of file
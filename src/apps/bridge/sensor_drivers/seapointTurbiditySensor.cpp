@@ -21,7 +21,7 @@ bool SeapointTurbiditySensor::subscribe() {
   char *sub = static_cast<char *>(pvPortMalloc(BM_TOPIC_MAX_LEN));
   configASSERT(sub);
   int topic_strlen =
-      snprintf(sub, BM_TOPIC_MAX_LEN, "sensor/%016" PRIx64 "%s", node_id, subtag);
+      snprintf(sub, BM_TOPIC_MAX_LEN, "sensor/%c%s", BM_SUB_SINGLE_LEVEL_WILDCARD, subtag);
   if (topic_strlen > 0) {
     rval = bm_sub_wl(sub, topic_strlen, seapointTurbiditySubCallback);
   }
@@ -154,8 +154,7 @@ void SeapointTurbiditySensor::aggregate(void) {
   vPortFree(log_buf);
 }
 
-SeapointTurbidity_t *createSeapointTurbiditySub(uint64_t node_id, uint32_t agg_period_ms,
-                                                uint32_t averager_max_samples) {
+SeapointTurbidity_t *createSeapointTurbiditySub(uint64_t node_id, uint32_t agg_period_ms) {
   SeapointTurbidity_t *new_sub =
       static_cast<SeapointTurbidity_t *>(pvPortMalloc(sizeof(SeapointTurbidity_t)));
   new_sub = new (new_sub) SeapointTurbidity_t();
@@ -168,8 +167,8 @@ SeapointTurbidity_t *createSeapointTurbiditySub(uint64_t node_id, uint32_t agg_p
   new_sub->type = SENSOR_TYPE_SEAPOINT_TURBIDITY;
   new_sub->next = NULL;
   new_sub->agg_period_ms = agg_period_ms;
-  new_sub->turbidity_s_ftu.initBuffer(averager_max_samples);
-  new_sub->turbidity_r_ftu.initBuffer(averager_max_samples);
+  new_sub->turbidity_s_ftu.initStreaming();
+  new_sub->turbidity_r_ftu.initStreaming();
   new_sub->reading_count = 0;
   return new_sub;
 }
\ No newline at end of file
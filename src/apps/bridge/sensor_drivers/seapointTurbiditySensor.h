@@ -23,13 +23,10 @@ typedef struct SeapointTurbiditySensor : public AbstractSensor {
   int8_t node_position;
   uint32_t last_timestamp;
 
-  // Extra sample padding to account for timing slop. Calculated as the sample frequency + 2 minutes bridge on period + some extra slop.
-  // 2 minutes is the minimum bridge on period and the turbidity sensor by default is sampling at 1Hz. So 1*120 + 30 = 150.
-  static constexpr uint32_t N_SAMPLES_PAD = 150;
   static constexpr uint8_t MIN_READINGS_FOR_AGGREGATION = 3;
 
 public:
-  bool subscribe() override;
+  static bool subscribe();
   void aggregate(void);
 
 private:
@@ -41,5 +38,4 @@ private:
   static constexpr char subtag[] = "/sofar/seapoint_turbidity_data";
 } SeapointTurbidity_t;
 
-SeapointTurbidity_t *createSeapointTurbiditySub(uint64_t node_id, uint32_t agg_period_ms,
-                                                uint32_t averager_max_samples);
+SeapointTurbidity_t *createSeapointTurbiditySub(uint64_t node_id, uint32_t agg_period_ms);
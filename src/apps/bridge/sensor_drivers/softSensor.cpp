@@ -21,7 +21,7 @@ bool SoftSensor::subscribe() {
   char *sub = static_cast<char *>(pvPortMalloc(BM_TOPIC_MAX_LEN));
   configASSERT(sub);
   int topic_strlen =
-      snprintf(sub, BM_TOPIC_MAX_LEN, "sensor/%016" PRIx64 "%s", node_id, subtag);
+      snprintf(sub, BM_TOPIC_MAX_LEN, "sensor/%c%s", BM_SUB_SINGLE_LEVEL_WILDCARD, subtag);
   if (topic_strlen > 0) {
     rval = bm_sub_wl(sub, topic_strlen, softSubCallback);
   }
@@ -144,8 +144,7 @@ void SoftSensor::aggregate(void) {
   vPortFree(log_buf);
 }
 
-Soft_t *createSoftSub(uint64_t node_id, uint32_t current_agg_period_ms,
-                      uint32_t averager_max_samples) {
+Soft_t *createSoftSub(uint64_t node_id, uint32_t current_agg_period_ms) {
   Soft_t *new_sub = static_cast<Soft_t *>(pvPortMalloc(sizeof(Soft_t)));
   new_sub = new (new_sub) Soft_t();
   configASSERT(new_sub);
@@ -157,7 +156,7 @@ Soft_t *createSoftSub(uint64_t node_id, uint32_t current_agg_period_ms,
   new_sub->type = SENSOR_TYPE_SOFT;
   new_sub->next = NULL;
   new_sub->current_agg_period_ms = current_agg_period_ms;
-  new_sub->temp_deg_c.initBuffer(averager_max_samples);
+  new_sub->temp_deg_c.initStreaming();
   new_sub->reading_count = 0;
   return new_sub;
 }
\ No newline at end of file
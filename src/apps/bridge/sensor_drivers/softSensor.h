@@ -21,15 +21,12 @@ typedef struct SoftSensor : public AbstractSensor {
   int8_t node_position;
   uint32_t last_timestamp;
 
-  // Extra sample padding to account for timing slop. Calculated as the sample frequency + 2 minutes bridge on period + some extra slop.
-  // 2 minutes is the minimum bridge on period and the soft by default is sampling at 2Hz. So 2*120 + 30 = 270.
-  static constexpr uint32_t N_SAMPLES_PAD = 270;
   static constexpr uint8_t MIN_READINGS_FOR_AGGREGATION = 3;
   static constexpr double TEMP_SAMPLE_MEMBER_MIN = -20;
   static constexpr double TEMP_SAMPLE_MEMBER_MAX = 61.88;
 
 public:
-  bool subscribe() override;
+  static bool subscribe();
   void aggregate(void);
 
 private:
@@ -41,4 +38,4 @@ private:
   static constexpr char subtag[] = "/sofar/bm_soft_temp";
 } Soft_t;
 
-Soft_t* createSoftSub(uint64_t node_id, uint32_t current_agg_period_ms, uint32_t averager_max_samples);
+Soft_t* createSoftSub(uint64_t node_id, uint32_t current_agg_period_ms);
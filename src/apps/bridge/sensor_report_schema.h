@@ -0,0 +1,275 @@
+#pragma once
+#include "aanderaaSensor.h"
+#include "cbor_sensor_report_encoder.h"
+#include "packed_sensor_report_encoder.h"
+#include "rbrCodaSensor.h"
+#include "seapointTurbiditySensor.h"
+#include "softSensor.h"
+#include <math.h>
+#include <stddef.h>
+
+/*
+  Describes how each sensor's aggregation struct is laid out in the sensor report.
+
+  A sample is encoded as [sample_type, member, member, ...]. The members are listed
+  as member pointers, so SampleMembers<>::encode() unrolls at compile time into
+  straight cbor_encode_* calls on the struct, with nothing looked up per member.
+
+  packed_fields describes the same sample for the bit-packed report, with the
+  range and resolution each member is quantized to. sensor_report_decoder.py in
+  tools/scripts/misc has a copy of these tables, keep them in sync.
+
+  Adding a sensor type means adding a SensorReportSchema specialization and a case
+  to sensor_report_schema_visit().
+*/
+
+static inline CborError sensor_report_encode_member(CborEncoder &sample_array, double value) {
+  return cbor_encode_double(&sample_array, value);
+}
+
+static inline CborError sensor_report_encode_member(CborEncoder &sample_array, uint32_t value) {
+  return cbor_encode_uint(&sample_array, value);
+}
+
+template <typename T, auto... Members> struct SampleMembers {
+  static constexpr size_t count = sizeof...(Members);
+
+  static CborError encode(CborEncoder &sample_array, const T &sample) {
+    CborError err = CborNoError;
+    // Stops at the first member that fails
+    (void)(((err = sensor_report_encode_member(sample_array, sample.*Members)) ==
+            CborNoError) &&
+           ...);
+    return err;
+  }
+};
+
+template <size_t N>
+constexpr bool
+sensor_report_packed_fields_fit(const sensor_report_packed_field_t (&fields)[N]) {
+  for (size_t i = 0; i < N; i++) {
+    if (fields[i].bits > PACKED_SENSOR_REPORT_MAX_FIELD_BITS) {
+      return false;
+    }
+  }
+  return true;
+}
+
+template <typename T> struct SensorReportSchema;
+
+template <> struct SensorReportSchema<aanderaa_aggregations_t> {
+  typedef aanderaa_aggregations_t sample_t;
+  typedef SampleMembers<sample_t, &sample_t::abs_speed_mean_cm_s, &sample_t::abs_speed_std_cm_s,
+                        &sample_t::direction_circ_mean_rad, &sample_t::direction_circ_std_rad,
+                        &sample_t::temp_mean_deg_c, &sample_t::abs_tilt_mean_rad,
+                        &sample_t::std_tilt_mean_rad, &sample_t::reading_count>
+      members;
+  static constexpr sample_t nan_sample = {.abs_speed_mean_cm_s = NAN,
+                                          .abs_speed_std_cm_s = NAN,
+                                          .direction_circ_mean_rad = NAN,
+                                          .direction_circ_std_rad = NAN,
+                                          .temp_mean_deg_c = NAN,
+                                          .abs_tilt_mean_rad = NAN,
+                                          .std_tilt_mean_rad = NAN,
+                                          .reading_count = 0};
+  static constexpr sensor_report_packed_field_t packed_fields[] = {
+      packed_sensor_report_double(offsetof(sample_t, abs_speed_mean_cm_s),
+                                  AanderaaSensor::ABS_SPEED_SAMPLE_MEMBER_MIN,
+                                  AanderaaSensor::ABS_SPEED_SAMPLE_MEMBER_MAX, 0.01),
+      packed_sensor_report_double(offsetof(sample_t, abs_speed_std_cm_s),
+                                  AanderaaSensor::ABS_SPEED_SAMPLE_MEMBER_MIN,
+                                  AanderaaSensor::ABS_SPEED_SAMPLE_MEMBER_MAX, 0.01),
+      packed_sensor_report_double(offsetof(sample_t, direction_circ_mean_rad),
+                                  AanderaaSensor::DIRECTION_SAMPLE_MEMBER_MIN,
+                                  AanderaaSensor::DIRECTION_SAMPLE_MEMBER_MAX, 0.001),
+      packed_sensor_report_double(offsetof(sample_t, direction_circ_std_rad),
+                                  AanderaaSensor::DIRECTION_SAMPLE_MEMBER_MIN,
+                                  AanderaaSensor::DIRECTION_SAMPLE_MEMBER_MAX, 0.001),
+      packed_sensor_report_double(offsetof(sample_t, temp_mean_deg_c),
+                                  AanderaaSensor::TEMP_SAMPLE_MEMBER_MIN,
+                                  AanderaaSensor::TEMP_SAMPLE_MEMBER_MAX, 0.001),
+      packed_sensor_report_double(offsetof(sample_t, abs_tilt_mean_rad),
+                                  AanderaaSensor::TILT_SAMPLE_MEMBER_MIN,
+                                  AanderaaSensor::TILT_SAMPLE_MEMBER_MAX, 0.001),
+      packed_sensor_report_double(offsetof(sample_t, std_tilt_mean_rad),
+                                  AanderaaSensor::TILT_SAMPLE_MEMBER_MIN,
+                                  AanderaaSensor::TILT_SAMPLE_MEMBER_MAX, 0.001),
+      packed_sensor_report_uint(offsetof(sample_t, reading_count),
+                                sizeof(sample_t::reading_count), UINT16_MAX),
+  };
+  static_assert(sensor_report_packed_fields_fit(packed_fields), "packed field too wide");
+  static const char *sampleType(const sample_t &) { return "aanderaa_current_v0"; }
+};
+static_assert(SensorReportSchema<aanderaa_aggregations_t>::members::count ==
+                  AANDERAA_NUM_SAMPLE_MEMBERS,
+              "aanderaa schema out of sync");
+
+template <> struct SensorReportSchema<soft_aggregations_t> {
+  typedef soft_aggregations_t sample_t;
+  // reading_count isn't reported
+  typedef SampleMembers<sample_t, &sample_t::temp_mean_deg_c> members;
+  static constexpr sample_t nan_sample = {.temp_mean_deg_c = NAN, .reading_count = 0};
+  static constexpr sensor_report_packed_field_t packed_fields[] = {
+      packed_sensor_report_double(offsetof(sample_t, temp_mean_deg_c),
+                                  SoftSensor::TEMP_SAMPLE_MEMBER_MIN,
+                                  SoftSensor::TEMP_SAMPLE_MEMBER_MAX, 0.001),
+  };
+  static_assert(sensor_report_packed_fields_fit(packed_fields), "packed field too wide");
+  static const char *sampleType(const sample_t &) { return "bm_soft_temp_v0"; }
+};
+static_assert(SensorReportSchema<soft_aggregations_t>::members::count ==
+                  SOFT_NUM_SAMPLE_MEMBERS,
+              "soft schema out of sync");
+
+template <> struct SensorReportSchema<rbr_coda_aggregations_t> {
+  typedef rbr_coda_aggregations_t sample_t;
+  typedef SampleMembers<sample_t, &sample_t::temp_mean_deg_c, &sample_t::pressure_mean_deci_bar,
+                        &sample_t::pressure_stdev_deci_bar>
+      members;
+  static constexpr sample_t nan_sample = {.temp_mean_deg_c = NAN,
+                                          .pressure_mean_deci_bar = NAN,
+                                          .pressure_stdev_deci_bar = NAN,
+                                          .reading_count = 0,
+                                          .sensor_type = BmRbrDataMsg::SensorType::UNKNOWN};
+  // sensor_type picks the sample type when decoding
+  static constexpr sensor_report_packed_field_t packed_fields[] = {
+      packed_sensor_report_uint(offsetof(sample_t, sensor_type), sizeof(sample_t::sensor_type),
+                                BmRbrDataMsg::SensorType::PRESSURE_AND_TEMPERATURE),
+      packed_sensor_report_double(offsetof(sample_t, temp_mean_deg_c),
+                                  RbrCodaSensor::TEMP_SAMPLE_MEMBER_MIN,
+                                  RbrCodaSensor::TEMP_SAMPLE_MEMBER_MAX, 0.0001),
+      packed_sensor_report_double(offsetof(sample_t, pressure_mean_deci_bar),
+                                  RbrCodaSensor::PRESSURE_SAMPLE_MEMBER_MIN,
+                                  RbrCodaSensor::PRESSURE_SAMPLE_MEMBER_MAX, 0.0001),
+      packed_sensor_report_double(offsetof(sample_t, pressure_stdev_deci_bar),
+                                  RbrCodaSensor::PRESSURE_STDEV_SAMPLE_MEMBER_MIN,
+                                  RbrCodaSensor::PRESSURE_STDEV_SAMPLE_MEMBER_MAX, 0.0001),
+  };
+  static_assert(sensor_report_packed_fields_fit(packed_fields), "packed field too wide");
+  // The sample type depends on what the Coda measures, NULL if it's not a known type
+  static const char *sampleType(const sample_t &sample) {
+    switch (sample.sensor_type) {
+    case BmRbrDataMsg::SensorType::TEMPERATURE:
+      return "bm_rbr_t_v0";
+    case BmRbrDataMsg::SensorType::PRESSURE:
+      return "bm_rbr_d_v0";
+    case BmRbrDataMsg::SensorType::PRESSURE_AND_TEMPERATURE:
+      return "bm_rbr_td_v0";
+    case BmRbrDataMsg::SensorType::UNKNOWN:
+      return "bm_rbr_unknown";
+    default:
+      return NULL;
+    }
+  }
+};
+static_assert(SensorReportSchema<rbr_coda_aggregations_t>::members::count ==
+                  RBR_CODA_NUM_SAMPLE_MEMBERS,
+              "rbr coda schema out of sync");
+
+template <> struct SensorReportSchema<seapoint_turbidity_aggregations_t> {
+  typedef seapoint_turbidity_aggregations_t sample_t;
+  typedef SampleMembers<sample_t, &sample_t::turbidity_s_mean_ftu,
+                        &sample_t::turbidity_r_mean_ftu>
+      members;
+  static constexpr sample_t nan_sample = {
+      .turbidity_s_mean_ftu = NAN, .turbidity_r_mean_ftu = NAN, .reading_count = 0};
+  // Full scale of the most sensitive gain setting is 4000 FTU
+  static constexpr sensor_report_packed_field_t packed_fields[] = {
+      packed_sensor_report_double(offsetof(sample_t, turbidity_s_mean_ftu), 0, 4000, 0.001),
+      packed_sensor_report_double(offsetof(sample_t, turbidity_r_mean_ftu), 0, 4000, 0.001),
+  };
+  static_assert(sensor_report_packed_fields_fit(packed_fields), "packed field too wide");
+  static const char *sampleType(const sample_t &) { return "bm_seapoint_turbidity_v0"; }
+};
+static_assert(SensorReportSchema<seapoint_turbidity_aggregations_t>::members::count ==
+                  SEAPOINT_TURBIDITY_NUM_SAMPLE_MEMBERS,
+              "seapoint turbidity schema out of sync");
+
+/*!
+ * @brief Call visitor with the schema of a sensor type.
+ * @param[in] sensor_type The abstractSensorType_e of the sensor.
+ * @param[in] visitor Generic callable, gets a SensorReportSchema<> instance.
+ * @return false if the sensor type has no schema, visitor isn't called.
+ */
+template <typename Visitor>
+static inline bool sensor_report_schema_visit(uint8_t sensor_type, Visitor &&visitor) {
+  switch (sensor_type) {
+  case SENSOR_TYPE_AANDERAA:
+    visitor(SensorReportSchema<aanderaa_aggregations_t>());
+    return true;
+  case SENSOR_TYPE_SOFT:
+    visitor(SensorReportSchema<soft_aggregations_t>());
+    return true;
+  case SENSOR_TYPE_RBR_CODA:
+    visitor(SensorReportSchema<rbr_coda_aggregations_t>());
+    return true;
+  case SENSOR_TYPE_SEAPOINT_TURBIDITY:
+    visitor(SensorReportSchema<seapoint_turbidity_aggregations_t>());
+    return true;
+  default:
+    return false;
+  }
+}
+
+/*!
+ * @brief Get the size of one aggregation sample of a sensor type.
+ * @param[in] sensor_type The abstractSensorType_e of the sensor.
+ * @return Size of the sample in bytes, 0 if the sensor type has no schema.
+ */
+static inline size_t sensor_report_schema_sample_size(uint8_t sensor_type) {
+  size_t size = 0;
+  sensor_report_schema_visit(sensor_type, [&size](auto schema) {
+    size = sizeof(typename decltype(schema)::sample_t);
+  });
+  return size;
+}
+
+/*!
+ * @brief Encode one aggregation sample into the open sensor array.
+ * @param[in] context The encoding context, with a sensor open.
+ * @param[in] sample The sample to encode.
+ * @return Cbor error code, CborErrorImproperValue if the sample has no valid sample type.
+ */
+template <typename T>
+CborError sensor_report_encode_sample(sensor_report_encoder_context_t &context,
+                                      const T &sample) {
+  typedef SensorReportSchema<T> Schema;
+  CborError err = CborNoError;
+  do {
+    const char *sample_type = Schema::sampleType(sample);
+    if (sample_type == NULL) {
+      err = CborErrorImproperValue;
+      break;
+    }
+    err = sensor_report_encoder_open_sample(context, Schema::members::count, sample_type);
+    if (err != CborNoError) {
+      break;
+    }
+    err = Schema::members::encode(context.sample_array, sample);
+    if (err != CborNoError) {
+      break;
+    }
+    err = sensor_report_encoder_close_sample(context);
+  } while (0);
+  return err;
+}
+
+/*!
+ * @brief Add all of the samples of one sensor to a packed report.
+ * @param[in] context The packed encoding context.
+ * @param[in] sensor_type The abstractSensorType_e of the sensor.
+ * @param[in] samples The sensor's aggregation structs, as many as the report has samples.
+ * @return false if the sensor type has no schema or the sensor doesn't fit.
+ */
+static inline bool sensor_report_pack_sensor(packed_sensor_report_encoder_context_t &context,
+                                             uint8_t sensor_type, const void *samples) {
+  bool rval = false;
+  sensor_report_schema_visit(sensor_type, [&](auto schema) {
+    typedef decltype(schema) Schema;
+    rval = packed_sensor_report_encoder_add_sensor(
+        context, sensor_type, Schema::packed_fields,
+        sizeof(Schema::packed_fields) / sizeof(Schema::packed_fields[0]), samples,
+        sizeof(typename Schema::sample_t));
+  });
+  return rval;
+}
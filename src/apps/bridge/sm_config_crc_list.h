@@ -7,7 +7,7 @@ public:
   static constexpr char KEY[] = "smConfigurationCrc";
   static constexpr size_t KEY_LEN = sizeof(KEY) - 1;
 
-  // MAX_CONFIG_BUFFER_SIZE_BYTES in configuration.h
+  // Encoded size of a full list, stored as a single bytes value
   static constexpr size_t MAX_BUFFER_SIZE = 50;
 
   // The maximum number of CRCs that can be stored within MAX_BUFFER_SIZE
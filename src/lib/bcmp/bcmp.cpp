@@ -19,6 +19,7 @@
 #include "bcmp_neighbors.h"
 #include "bcmp_ping.h"
 #include "bcmp_config.h"
+#include "bcmp_frag.h"
 #include "bcmp_time.h"
 #include "bcmp_topology.h"
 #include "bcmp_resource_discovery.h"
@@ -34,27 +35,26 @@
 // 1500 MTU minus ipv6 header
 #define MAX_PAYLOAD_LEN (1500 - sizeof(struct ip6_hdr))
 
-static constexpr uint32_t MESSAGE_TIMER_EXPIRY_PERIOD_MS = 12;
+// How soon to retry expiring requests if the request table couldn't be checked
+#define MESSAGE_TABLE_RETRY_MS 10
 
-typedef struct bcmp_request_element {
-  uint32_t seq_num;
-  uint16_t type;
-  uint32_t send_timestamp_ms;
-  uint32_t timeout_ms;
-  bcmp_reply_message_cb callback;
-  bcmp_request_element *next;
-} bcmp_request_element_t;
+static_assert(BCMP_FRAG_PAYLOAD_LEN == MAX_PAYLOAD_LEN - sizeof(bcmp_header_t), "fragments must fill a frame");
 
 typedef struct {
   struct netif* netif;
   struct raw_pcb *pcb;
   QueueHandle_t rx_queue;
   TimerHandle_t heartbeat_timer;
-  // Linked list of sent BCMP messages
-  bcmp_request_element *messages_list;
-  SemaphoreHandle_t messages_list_mutex;
+  // Sent BCMP requests waiting for a reply
+  bcmp_request_table_t messages;
+  SemaphoreHandle_t messages_mutex;
+  // One-shot, armed for the earliest request deadline
   TimerHandle_t messages_expiration_timer;
   uint32_t message_count;
+  // Only used by the BCMP task
+  bcmp_frag_pool_t frag_pool;
+  // Tells apart fragmented messages that don't have a sequence number of their own
+  uint32_t frag_count;
 } bcmpContext_t;
 
 typedef enum {
@@ -76,12 +76,11 @@ typedef struct {
 
 static bcmpContext_t _ctx;
 
-static bool _message_list_add_message(bcmp_request_element *message);
-static bool _message_list_remove_message(bcmp_request_element *message);
-static bcmp_request_element *_message_list_create_element(uint16_t seq_num, uint16_t type, uint32_t timeout_ms, bcmp_reply_message_cb callback);
-static void _message_list_timer_callback(TimerHandle_t tmr);
-static bcmp_request_element *_message_list_find_message(uint16_t seq_num);
-static void _message_list_timer_expiry_cb(void *arg);
+static bool _message_table_add(uint16_t &seq_num, uint16_t type, uint32_t timeout_ms, bcmp_reply_message_cb callback);
+static bool _message_table_remove(uint16_t seq_num, bcmp_reply_message_cb &callback);
+static void _message_table_reschedule(void);
+static void _message_table_timer_callback(TimerHandle_t tmr);
+static void _message_table_timer_expiry_cb(void *arg);
 static bool _message_is_sequenced_reply(uint16_t type);
 static bool _message_is_sequenced_request(uint16_t type);
 
@@ -104,72 +103,132 @@ void bcmp_link_change(uint8_t port, bool state) {
 
 /*!
   Process a DFU message. Allocates memory that the consumer is in charge of freeing.
-  \param pbuf[in] pbuf buffer
+  \param header[in] BCMP message
+  \param len[in] payload length
   \return none
 */
-static void dfu_copy_and_process_message(struct pbuf *pbuf) {
-  configASSERT(pbuf);
-  bcmp_header_t *header = static_cast<bcmp_header_t *>(pbuf->payload);
-  uint8_t* buf = static_cast<uint8_t *>(pvPortMalloc((pbuf->len) - sizeof(bcmp_header_t)));
+static void dfu_copy_and_process_message(const bcmp_header_t *header, uint16_t len) {
+  configASSERT(header);
+  uint8_t* buf = static_cast<uint8_t *>(pvPortMalloc(len));
   configASSERT(buf);
-  memcpy(buf, header->payload, (pbuf->len) - sizeof(bcmp_header_t));
-  bm_dfu_process_message(buf, (pbuf->len) - sizeof(bcmp_header_t));
+  memcpy(buf, header->payload, len);
+  bm_dfu_process_message(buf, len);
 }
 
 /*!
-  BCMP packet processing function
+  Get the link-local multicast address that reaches every port but the ingress port
 
-  \param *pbuf pbuf with packet
-  \param *src packet source
-  \param *dst packet destination
-  \return 0 if processed ok, nonzero otherwise
+  \param ingress_port port the message came in on
+  \param[out] *port_specific_dst destination address
+  \return none
 */
-int32_t bcmp_process_packet(struct pbuf *pbuf, ip_addr_t *src, ip_addr_t *dst) {
-  int32_t rval = 0;
-  // uint8_t egress_port;
-  uint8_t ingress_port;
+static void _ll_forward_dst(uint8_t ingress_port, ip_addr_t *port_specific_dst) {
+  ip6_addr_set(port_specific_dst, &multicast_ll_addr);
 
-  configASSERT(pbuf);
-  configASSERT(src);
-
-  // Ingress and Egress ports are mapped to the 5th and 6th byte of the IPv6 src address.
-  // This is in conflict with the v1.0.0, June 2023 version of the Bristlemouth spec.
-  // TODO: align with spec
-  // egress_port = ((src->addr[1]) & 0xFF);
-  ingress_port = ((src->addr[1] >> 8) & 0xFF);
+  // TODO: Make more generic. This is specifically for a 2-port device.
+  uint8_t egress_port = ingress_port == 1 ? 2 : 1;
+  port_specific_dst->addr[3] = 0x1000000 | (egress_port << 8);
+}
 
-  CLEAR_PORTS(src->addr);
+/*!
+  Send a BCMP message, as back-to-back fragments if it doesn't fit in one frame
 
+  \param *dst destination ip
+  \param *chksum_dst destination the checksum is computed on (L2 may rewrite dst)
+  \param *header message header, frag_total/frag_id/checksum are filled in per frame
+  \param *payload message payload
+  \param len payload length
+  \return ERR_OK on success, something else otherwise
+*/
+static err_t _tx_message(const ip_addr_t *dst, const ip_addr_t *chksum_dst, const bcmp_header_t *header, const uint8_t *payload, uint16_t len) {
+  err_t rval = ERR_OK;
+  uint8_t frag_total = bcmp_frag_count(len);
+  uint8_t frag_id = 0;
+  uint32_t offset = 0;
+  const ip_addr_t *src_ip = netif_ip_addr6(_ctx.netif, 0);
 
   do {
-    bcmp_header_t *header = static_cast<bcmp_header_t *>(pbuf->payload);
+    uint16_t frame_payload_len = frag_total ? bcmp_frag_len(len, frag_id) : len;
 
-    uint16_t checksum = ip6_chksum_pseudo(pbuf,
-                                          IP_PROTO_BCMP,
-                                          pbuf->len,
-                                          src, dst);
+    struct pbuf *pbuf = pbuf_alloc(PBUF_IP, frame_payload_len + sizeof(bcmp_header_t), PBUF_RAM);
+    configASSERT(pbuf);
 
-    // Valid checksum will come out to zero, since the actual checksum
-    // is included and cancels out
-    if(checksum) {
-      printf("BCMP - Invalid checksum\n");
+    bcmp_header_t *frame_header = static_cast<bcmp_header_t *>(pbuf->payload);
+    memcpy(frame_header, header, sizeof(bcmp_header_t));
+    frame_header->checksum = 0;
+    frame_header->frag_total = frag_total;
+    frame_header->frag_id = frag_id;
 
-      rval = -1;
-      break;
+    memcpy(frame_header->payload, &payload[offset], frame_payload_len);
+
+    frame_header->checksum = ip6_chksum_pseudo( pbuf,
+                                                IP_PROTO_BCMP,
+                                                pbuf->len,
+                                                src_ip, chksum_dst);
+
+    rval = raw_sendto_if_src( _ctx.pcb,
+                              pbuf,
+                              dst,
+                              _ctx.netif,
+                              src_ip); // Using link-local address
+
+    // We're done with this pbuf
+    // raw_sendto_if_src eventually calls bm_l2_tx, which does a pbuf_ref
+    // on this buffer.
+    pbuf_free(pbuf);
+
+    if(rval != ERR_OK) {
+      printf("Error sending BMCP packet %d\n", rval);
     }
 
+    offset += frame_payload_len;
+    frag_id++;
+  } while((rval == ERR_OK) && (offset < len));
+
+  return rval;
+}
+
+/*!
+  Forward a message to all ports other than the ingress port. Messages that were
+  reassembled from fragments are fragmented again.
+
+  \param *header message to forward
+  \param len payload length
+  \param *pbuf received frame, NULL if the message was reassembled
+  \param ingress_port port the message came in on
+  \return none
+*/
+static void _forward_message(bcmp_header_t *header, uint16_t len, struct pbuf *pbuf, uint8_t ingress_port) {
+  if (pbuf) {
+    bcmp_ll_forward(pbuf, ingress_port);
+  } else {
+    ip_addr_t port_specific_dst;
+    _ll_forward_dst(ingress_port, &port_specific_dst);
+    _tx_message(&port_specific_dst, &multicast_ll_addr, header, header->payload, len);
+  }
+}
+
+/*!
+  BCMP message processing function
+
+  \param *header message
+  \param len payload length
+  \param *pbuf received frame, NULL if the message was reassembled from fragments
+  \param *src message source
+  \param *dst message destination
+  \param ingress_port port the message came in on
+  \return 0 if processed ok, nonzero otherwise
+*/
+static int32_t _process_message(bcmp_header_t *header, uint16_t len, struct pbuf *pbuf, ip_addr_t *src, ip_addr_t *dst, uint8_t ingress_port) {
+  int32_t rval = 0;
+
+  do {
     bcmp_reply_message_cb cb = NULL;
 
     // Check if this message is a reply to a message we sent
     if (_message_is_sequenced_reply(header->type) && !_message_is_sequenced_request(header->type)) {
-      bcmp_request_element *sent_message = _message_list_find_message(header->seq_num);
-      if (sent_message) {
+      if (_message_table_remove(header->seq_num, cb)) {
         printf("BCMP - Received reply to our request message with seq_num %d\n", header->seq_num);
-        if (xSemaphoreTake(_ctx.messages_list_mutex, pdMS_TO_TICKS(DEFAULT_MESSAGE_TIMEOUT_MS)) == pdPASS) {
-          cb = sent_message->callback;
-          _message_list_remove_message(sent_message);
-          xSemaphoreGive(_ctx.messages_list_mutex);
-        }
       }
     }
 
@@ -217,7 +276,7 @@ int32_t bcmp_process_packet(struct pbuf *pbuf, ip_addr_t *src, ip_addr_t *dst) {
             static_cast<bcmp_message_type_t>(header->type), header->payload);
         if (should_forward) {
           // Forward the message to all ports other than the ingress port.
-          bcmp_ll_forward(pbuf, ingress_port);
+          _forward_message(header, len, pbuf, ingress_port);
         }
         break;
       }
@@ -234,10 +293,10 @@ int32_t bcmp_process_packet(struct pbuf *pbuf, ip_addr_t *src, ip_addr_t *dst) {
           cb(header->payload);
         } else {
           bool should_forward = bcmp_process_config_message(
-              static_cast<bcmp_message_type_t>(header->type), header->payload, header->seq_num);
+              static_cast<bcmp_message_type_t>(header->type), header->payload, len, header->seq_num);
           if (should_forward) {
             // Forward the message to all ports other than the ingress port.
-            bcmp_ll_forward(pbuf, ingress_port);
+            _forward_message(header, len, pbuf, ingress_port);
           }
         }
         break;
@@ -253,8 +312,10 @@ int32_t bcmp_process_packet(struct pbuf *pbuf, ip_addr_t *src, ip_addr_t *dst) {
       case BCMP_DFU_REBOOT_REQ:
       case BCMP_DFU_REBOOT:
       case BCMP_DFU_BOOT_COMPLETE:
+      case BCMP_DFU_WINDOW_REQ:
+      case BCMP_DFU_WINDOW_PAYLOAD:
       {
-        dfu_copy_and_process_message(pbuf);
+        dfu_copy_and_process_message(header, len);
         break;
       }
 
@@ -280,6 +341,66 @@ int32_t bcmp_process_packet(struct pbuf *pbuf, ip_addr_t *src, ip_addr_t *dst) {
   return rval;
 }
 
+/*!
+  BCMP packet processing function
+
+  \param *pbuf pbuf with packet
+  \param *src packet source
+  \param *dst packet destination
+  \return 0 if processed ok, nonzero otherwise
+*/
+int32_t bcmp_process_packet(struct pbuf *pbuf, ip_addr_t *src, ip_addr_t *dst) {
+  int32_t rval = 0;
+  // uint8_t egress_port;
+  uint8_t ingress_port;
+
+  configASSERT(pbuf);
+  configASSERT(src);
+
+  // Ingress and Egress ports are mapped to the 5th and 6th byte of the IPv6 src address.
+  // This is in conflict with the v1.0.0, June 2023 version of the Bristlemouth spec.
+  // TODO: align with spec
+  // egress_port = ((src->addr[1]) & 0xFF);
+  ingress_port = ((src->addr[1] >> 8) & 0xFF);
+
+  CLEAR_PORTS(src->addr);
+
+
+  do {
+    bcmp_header_t *header = static_cast<bcmp_header_t *>(pbuf->payload);
+
+    uint16_t checksum = ip6_chksum_pseudo(pbuf,
+                                          IP_PROTO_BCMP,
+                                          pbuf->len,
+                                          src, dst);
+
+    // Valid checksum will come out to zero, since the actual checksum
+    // is included and cancels out
+    if(checksum) {
+      printf("BCMP - Invalid checksum\n");
+
+      rval = -1;
+      break;
+    }
+
+    uint16_t len = pbuf->len - sizeof(bcmp_header_t);
+    if(!header->frag_total) {
+      rval = _process_message(header, len, pbuf, src, dst, ingress_port);
+      break;
+    }
+
+    // Each fragment was checksummed on its own, hand the message on once all of them are here
+    bcmp_header_t *msg = bcmp_frag_add(&_ctx.frag_pool, ip_to_nodeid(src), header, len,
+                                       pdTICKS_TO_MS(xTaskGetTickCount()), &len);
+    if(msg) {
+      rval = _process_message(msg, len, NULL, src, dst, ingress_port);
+      bcmp_frag_release(&_ctx.frag_pool, msg);
+    }
+  } while(0);
+
+  return rval;
+}
+
 
 /*!
   FreeRTOS timer handler for sending out heartbeats. No work is done in the timer
@@ -385,6 +506,9 @@ static void bcmp_thread(void *parameters) {
         // Check neighbor status to see if any dropped
         bcmp_check_neighbors();
 
+        // Free messages whose remaining fragments never showed up
+        bcmp_frag_evict(&_ctx.frag_pool, pdTICKS_TO_MS(xTaskGetTickCount()));
+
         // Send out heartbeats
         bcmp_send_heartbeat(BCMP_HEARTBEAT_S);
         break;
@@ -418,61 +542,42 @@ err_t bcmp_tx(const ip_addr_t *dst, bcmp_message_type_t type, uint8_t *buff, uin
   err_t rval;
 
   do {
-    if((uint32_t)len + sizeof(bcmp_header_t) > MAX_PAYLOAD_LEN) {
-      // Payload too big, don't try to transmit.
+    if(len > BCMP_FRAG_MAX_MESSAGE_LEN) {
+      // Payload too big, even when fragmented, don't try to transmit.
       rval = ERR_VAL;
       break;
     }
 
-    struct pbuf *pbuf = pbuf_alloc(PBUF_IP, len + sizeof(bcmp_header_t), PBUF_RAM);
-    configASSERT(pbuf);
-
-    bcmp_header_t *header = static_cast<bcmp_header_t *>(pbuf->payload);
-    header->type = (uint16_t)type;
-    header->checksum = 0;
-    header->flags = 0; // Unused for now
-    header->rsvd = 0; // Unused for now
+    bcmp_header_t header;
+    header.type = (uint16_t)type;
+    header.checksum = 0;
+    header.flags = 0; // Unused for now
+    header.rsvd = 0; // Unused for now
     if (_message_is_sequenced_reply(type)) {
       // if we are replying to a message, use the sequence number from the received message
-      header->seq_num = seq_num;
+      header.seq_num = seq_num;
     } else if (_message_is_sequenced_request(type)) {
       // If we are sending a new request, use our own sequence number
-      header->seq_num = _ctx.message_count;
-      _ctx.message_count++;
-      bcmp_request_element *sent_message = _message_list_create_element(header->seq_num, header->type, request_timeout_ms, reply_cb);
-      _message_list_add_message(sent_message);
-      printf("BCMP - Sending message with seq_num %d\n", header->seq_num);
+      uint16_t request_seq_num;
+      if (!_message_table_add(request_seq_num, header.type, request_timeout_ms, reply_cb)) {
+        printf("BCMP - Too many outstanding requests\n");
+        rval = ERR_MEM;
+        break;
+      }
+      header.seq_num = request_seq_num;
+      printf("BCMP - Sending message with seq_num %d\n", header.seq_num);
+    } else if (bcmp_frag_count(len)) {
+      // The receiver keys reassembly on the sequence number
+      header.seq_num = _ctx.frag_count++;
     } else {
       // If the message doesn't use sequence numbers, set it to 0
-      header->seq_num = 0;
+      header.seq_num = 0;
     }
-    header->frag_total = 0; // Unused for now
-    header->frag_id = 0; // Unused for now
-    header->next_header = 0; // Unused for now
-
-    memcpy(header->payload, buff, len);
-
-    const ip_addr_t *src_ip = netif_ip_addr6(_ctx.netif, 0);
-
-    header->checksum = ip6_chksum_pseudo( pbuf,
-                                          IP_PROTO_BCMP,
-                                          len + sizeof(bcmp_header_t),
-                                          src_ip, dst);
-
-    rval = raw_sendto_if_src( _ctx.pcb,
-                              pbuf,
-                              dst,
-                              _ctx.netif,
-                              src_ip); // Using link-local address
-
-    // We're done with this pbuf
-    // raw_sendto_if_src eventually calls bm_l2_tx, which does a pbuf_ref
-    // on this buffer.
-    pbuf_free(pbuf);
+    header.frag_total = 0; // Filled in per frame
+    header.frag_id = 0; // Filled in per frame
+    header.next_header = 0; // Unused for now
 
-    if(rval != ERR_OK) {
-      printf("Error sending BMCP packet %d\n", rval);
-    }
+    rval = _tx_message(dst, dst, &header, buff, len);
   } while(0);
 
   return rval;
@@ -488,11 +593,7 @@ err_t bcmp_tx(const ip_addr_t *dst, bcmp_message_type_t type, uint8_t *buff, uin
 */
 err_t bcmp_ll_forward(struct pbuf *pbuf, uint8_t ingress_port) {
   ip_addr_t port_specific_dst;
-  ip6_addr_set(&port_specific_dst, &multicast_ll_addr);
-
-  // TODO: Make more generic. This is specifically for a 2-port device.
-  uint8_t egress_port = ingress_port == 1 ? 2 : 1;
-  port_specific_dst.addr[3] = 0x1000000 | (egress_port << 8);
+  _ll_forward_dst(ingress_port, &port_specific_dst);
 
   const ip_addr_t *src = netif_ip_addr6(_ctx.netif, 0);
 
@@ -538,11 +639,13 @@ void bcmp_init(struct netif* netif, NvmPartition * dfu_partition, Configuration*
   /* Create threads and Queues */
   _ctx.rx_queue = xQueueCreate(BCMP_EVT_QUEUE_LEN, sizeof(bcmp_queue_item_t));
   configASSERT(_ctx.rx_queue);
-  _ctx.messages_list_mutex = xSemaphoreCreateMutex();
-  configASSERT(_ctx.messages_list_mutex);
-  _ctx.messages_expiration_timer = xTimerCreate("bcmp_message_expiration", pdMS_TO_TICKS(MESSAGE_TIMER_EXPIRY_PERIOD_MS),
-                                 pdTRUE, NULL, _message_list_timer_callback);
-  configASSERT(xTimerStart(_ctx.messages_expiration_timer, 10) == pdPASS);
+  bcmp_request_table_init(&_ctx.messages);
+  _ctx.messages_mutex = xSemaphoreCreateMutex();
+  configASSERT(_ctx.messages_mutex);
+  // Period is set to the next request deadline when the timer is armed
+  _ctx.messages_expiration_timer = xTimerCreate("bcmp_message_expiration", 1,
+                                 pdFALSE, NULL, _message_table_timer_callback);
+  configASSERT(_ctx.messages_expiration_timer);
 
   bm_dfu_init(bcmp_dfu_tx, dfu_partition, sys_cfg);
   bcmp_config_init(user_cfg, sys_cfg);
@@ -558,103 +661,103 @@ void bcmp_init(struct netif* netif, NvmPartition * dfu_partition, Configuration*
 }
 
 
-static bool _message_list_add_message(bcmp_request_element *message) {
+/*!
+  Pick a sequence number for a new request and track it until its reply arrives
+
+  \param[out] seq_num sequence number to send the request with
+  \param type message type
+  \param timeout_ms how long to wait for the reply
+  \param callback called with the reply payload, or NULL on timeout
+  \return false if every request table slot is taken
+*/
+static bool _message_table_add(uint16_t &seq_num, uint16_t type, uint32_t timeout_ms, bcmp_reply_message_cb callback) {
   bool rval = false;
-  configASSERT(message);
-  if (xSemaphoreTake(_ctx.messages_list_mutex, pdMS_TO_TICKS(DEFAULT_MESSAGE_TIMEOUT_MS)) == pdPASS) {
-    if (_ctx.messages_list == NULL) {
-      _ctx.messages_list = message;
-    } else {
-      bcmp_request_element *current = _ctx.messages_list;
-      while (current->next != NULL) {
-        current = current->next;
+  if (xSemaphoreTake(_ctx.messages_mutex, pdMS_TO_TICKS(DEFAULT_MESSAGE_TIMEOUT_MS)) == pdPASS) {
+    // Skip sequence numbers whose slot still holds an older request
+    for (uint32_t attempt = 0; attempt < BCMP_REQUEST_TABLE_LEN; attempt++) {
+      uint16_t candidate = static_cast<uint16_t>(_ctx.message_count++);
+      if (bcmp_request_table_slot_free(&_ctx.messages, candidate)) {
+        seq_num = candidate;
+        rval = bcmp_request_table_add(&_ctx.messages, seq_num, type, pdTICKS_TO_MS(xTaskGetTickCount()), timeout_ms, callback);
+        break;
       }
-      current->next = message;
     }
-    rval = true;
-    xSemaphoreGive(_ctx.messages_list_mutex);
+    if (rval) {
+      _message_table_reschedule();
+    }
+    xSemaphoreGive(_ctx.messages_mutex);
   }
   return rval;
 }
 
-// NOTE: This function is not thread safe and can only be called within a section
-// protected by the messages_list_mutex semaphore.
-static bool _message_list_remove_message(bcmp_request_element *message) {
+/*!
+  Stop tracking a request once its reply arrives
+
+  \param seq_num sequence number of the reply
+  \param[out] callback reply callback of the request
+  \return false if no request with seq_num is outstanding
+*/
+static bool _message_table_remove(uint16_t seq_num, bcmp_reply_message_cb &callback) {
   bool rval = false;
-  configASSERT(message);
-  bcmp_request_element *element_to_delete = NULL;
-  if (_ctx.messages_list == message) {
-    element_to_delete = _ctx.messages_list;
-    _ctx.messages_list = _ctx.messages_list->next;
-  } else {
-    bcmp_request_element *current = _ctx.messages_list;
-    while (current && current->next != message) {
-      current = current->next;
-    }
-    if (current) {
-      element_to_delete = current->next;
-      current->next = current->next->next;
+  if (xSemaphoreTake(_ctx.messages_mutex, pdMS_TO_TICKS(DEFAULT_MESSAGE_TIMEOUT_MS)) == pdPASS) {
+    bcmp_request_t request;
+    if (bcmp_request_table_remove(&_ctx.messages, seq_num, &request)) {
+      callback = request.callback;
+      _message_table_reschedule();
+      rval = true;
     }
-  }
-  if (element_to_delete) {
-    vPortFree(element_to_delete);
-    rval = true;
+    xSemaphoreGive(_ctx.messages_mutex);
   }
   return rval;
 }
 
-static bcmp_request_element *_message_list_create_element(uint16_t seq_num, uint16_t type, uint32_t timeout_ms, bcmp_reply_message_cb callback) {
-  bcmp_request_element *element = static_cast<bcmp_request_element *>(pvPortMalloc(sizeof(bcmp_request_element)));
-  configASSERT(element);
-  element->seq_num = seq_num;
-  element->type = type;
-  element->send_timestamp_ms = pdTICKS_TO_MS(xTaskGetTickCount());
-  element->timeout_ms = timeout_ms;
-  element->callback = callback;
-  element->next = NULL;
-  return element;
+// NOTE: This function is not thread safe and can only be called within a section
+// protected by the messages_mutex semaphore.
+static void _message_table_reschedule(void) {
+  uint32_t deadline_ms;
+  if (bcmp_request_table_next_deadline(&_ctx.messages, &deadline_ms)) {
+    int32_t remaining_ms = static_cast<int32_t>(deadline_ms - pdTICKS_TO_MS(xTaskGetTickCount()));
+    // Requests expire once their deadline has passed, so wake up one tick after it
+    TickType_t ticks = (remaining_ms > 0) ? pdMS_TO_TICKS(remaining_ms) + 1 : 1;
+    xTimerChangePeriod(_ctx.messages_expiration_timer, ticks, 10);
+  } else {
+    xTimerStop(_ctx.messages_expiration_timer, 10);
+  }
 }
 
-static void _message_list_timer_expiry_cb(void *arg) {
+static void _message_table_timer_expiry_cb(void *arg) {
   (void) arg;
-  if (xSemaphoreTake(_ctx.messages_list_mutex, pdMS_TO_TICKS(DEFAULT_MESSAGE_TIMEOUT_MS)) == pdPASS) {
-    bcmp_request_element *current = _ctx.messages_list;
-    while (current) {
-      if (pdTICKS_TO_MS(xTaskGetTickCount()) - current->send_timestamp_ms > current->timeout_ms) {
-        printf("BCMP message with seq_num %d timed out\n", current->seq_num);
-        if (current->callback) {
-          current->callback(NULL);
-        }
-        _message_list_remove_message(current);
-        current = _ctx.messages_list;
-        continue;
-      }
-      current = current->next;
+  bool rescheduled = false;
+  while (xSemaphoreTake(_ctx.messages_mutex, pdMS_TO_TICKS(DEFAULT_MESSAGE_TIMEOUT_MS)) == pdPASS) {
+    bcmp_request_t request;
+    bool expired = bcmp_request_table_pop_expired(&_ctx.messages, pdTICKS_TO_MS(xTaskGetTickCount()), &request);
+    if (!expired) {
+      _message_table_reschedule();
+      rescheduled = true;
+    }
+    xSemaphoreGive(_ctx.messages_mutex);
+
+    if (!expired) {
+      break;
+    }
+    // Callbacks run without the mutex so they can send new requests
+    printf("BCMP message with seq_num %d timed out\n", request.seq_num);
+    if (request.callback) {
+      request.callback(NULL);
     }
-    xSemaphoreGive(_ctx.messages_list_mutex);
   }
-}
 
-static void _message_list_timer_callback(TimerHandle_t tmr){
-  (void) tmr;
-  timer_callback_handler_send_cb(_message_list_timer_expiry_cb, tmr, 0);
+  if (!rescheduled) {
+    // The timer is one-shot, so without this the remaining requests would never expire
+    xTimerChangePeriod(_ctx.messages_expiration_timer, pdMS_TO_TICKS(MESSAGE_TABLE_RETRY_MS), 10);
+  }
 }
 
-static bcmp_request_element *_message_list_find_message(uint16_t seq_num) {
-  bcmp_request_element *rval = NULL;
-  if (xSemaphoreTake(_ctx.messages_list_mutex, pdMS_TO_TICKS(DEFAULT_MESSAGE_TIMEOUT_MS)) == pdPASS) {
-    bcmp_request_element *current = _ctx.messages_list;
-    while (current) {
-      if (current->seq_num == seq_num) {
-        printf("BCMP message with seq_num %d found\n", current->seq_num);
-        rval = current;
-        break;
-      }
-      current = current->next;
-    }
-    xSemaphoreGive(_ctx.messages_list_mutex);
+static void _message_table_timer_callback(TimerHandle_t tmr){
+  if (!timer_callback_handler_send_cb(_message_table_timer_expiry_cb, tmr, 0)) {
+    // Timer task, so the retry can't wait for room in the timer queue
+    xTimerChangePeriod(tmr, pdMS_TO_TICKS(MESSAGE_TABLE_RETRY_MS), 0);
   }
-  return rval;
 }
 
 static bool _message_is_sequenced_reply(uint16_t type) {
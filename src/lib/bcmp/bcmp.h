@@ -6,7 +6,9 @@
 #include "lwip/netif.h"
 #include "lwip/ip_addr.h"
 
+#include "bcmp_frag.h"
 #include "bcmp_messages.h"
+#include "bcmp_request_table.h"
 #include "bm_util.h"
 
 #include "nvmPartition.h"
@@ -18,21 +20,8 @@ using namespace cfg;
 #define CLEAR_PORTS(x) (x[1] &= (~(0xFFFFU)))
 
 #define IP_PROTO_BCMP (0xBC)
-#define BCMP_MAX_PAYLOAD_SIZE_BYTES (1500) // FIXME: Remove when we can split payloads.
-
-/**
- * @brief A function pointer type for handling reply messages in the BCMP protocol.
- *
- * This typedef defines a type for function pointers that can be used as callbacks
- * to handle sequenced reply messages in the BCMP protocol. These functions should
- * take a pointer to a payload of type uint8_t as a parameter and return a boolean
- * value.
- *
- * The return value should be:
- * - true if the reply message was handled successfully,
- * - false if there was an error handling the reply message.
- */
-typedef bool (*bcmp_reply_message_cb)(uint8_t *payload);
+// Largest payload bcmp_tx() can send, anything over one frame goes out in fragments
+#define BCMP_MAX_PAYLOAD_SIZE_BYTES (BCMP_FRAG_MAX_MESSAGE_LEN)
 
 static constexpr uint32_t DEFAULT_MESSAGE_TIMEOUT_MS = 24;
 
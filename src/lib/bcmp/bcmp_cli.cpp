@@ -18,6 +18,8 @@
 #include "bcmp_time.h"
 #include "bcmp_topology.h"
 #include "bcmp_resource_discovery.h"
+#include "bm_l2.h"
+#include "middleware.h"
 
 #include "debug.h"
 
@@ -40,17 +42,73 @@ static const CLI_Command_Definition_t cmd_bcmp = {
     " * bm time set <node_id> <utc_us>\n"
     " * bm time get <node_id>\n"
     " * bm topo\n"
+    " * bm topo bfs\n"
     " * bm resources\n"
     " * bm resources <node_id>\n"
+    " * bm l2\n"
+    " * bm l2 reset\n"
     " * bm sub <topic>\n"
     " * bm unsub <topic>\n"
-    " * bm pub <topic> <data> <type> <version>\n",
+    " * bm pub <topic> <data> <type> <version>\n"
+    " * bm batch <window_ms>\n"
+    " * bm batch bench <count> <data_len>\n",
     // Command function
     cmd_bcmp_fn,
     // Number of parameters
     -1
 };
 
+// Longest CBOR item head
+#define CFG_CBOR_HEAD_MAX_BYTES (9)
+
+// Ethernet header, FCS, preamble and inter-frame gap, plus the IPv6 and UDP headers
+#define BENCH_FRAME_OVERHEAD_BYTES (14 + 4 + 8 + 12 + 40 + 8)
+static constexpr char bench_topic[] = "bench/batch";
+
+/*!
+  Publish count messages through bm_pub() as fast as possible and report the throughput.
+  Uses whatever batching window is set, so run it with batching on and off to compare.
+
+  \param[in] count - number of messages to publish
+  \param[in] data_len - data length of each message
+  \return none
+*/
+static void pub_batch_bench(uint32_t count, uint16_t data_len) {
+  uint8_t *data = static_cast<uint8_t *>(pvPortMalloc(data_len));
+  configASSERT(data);
+  memset(data, 0xA5, data_len);
+
+  bm_middleware_tx_stats_t start_stats;
+  bm_middleware_get_tx_stats(&start_stats);
+  uint32_t failed = 0;
+  TickType_t start_ticks = xTaskGetTickCount();
+  for(uint32_t i = 0; i < count; i++) {
+    if(!bm_pub(bench_topic, data, data_len, 0)) {
+      failed++;
+    }
+  }
+  bm_pub_batching_flush();
+  uint32_t duration_ms = pdTICKS_TO_MS(xTaskGetTickCount() - start_ticks);
+  bm_middleware_tx_stats_t end_stats;
+  bm_middleware_get_tx_stats(&end_stats);
+  vPortFree(data);
+
+  uint32_t frames = end_stats.frames - start_stats.frames;
+  uint32_t bytes = end_stats.bytes - start_stats.bytes;
+  uint32_t sent = count - failed;
+  printf("Published %" PRIu32 " messages in %" PRIu32 " ms, %" PRIu32 " failed\n", sent,
+         duration_ms, failed);
+  if(duration_ms) {
+    printf("%" PRIu32 " msgs/s\n", static_cast<uint32_t>((uint64_t)sent * 1000 / duration_ms));
+  }
+  if(sent) {
+    // Anything else publishing at the same time is counted too
+    uint64_t wire_bytes = (uint64_t)bytes + (uint64_t)frames * BENCH_FRAME_OVERHEAD_BYTES;
+    printf("%" PRIu32 " frames, %" PRIu32 " bytes on the wire per message\n", frames,
+           static_cast<uint32_t>(wire_bytes / sent));
+  }
+}
+
 static void print_subscriptions(uint64_t node_id, const char* topic, uint16_t topic_len, const uint8_t* data, uint16_t data_len, uint8_t type, uint8_t version) {
   (void)node_id;
 
@@ -246,10 +304,11 @@ static BaseType_t cmd_bcmp_fn(char *writeBuffer,
           break;
         }
         err_t err;
-        size_t buffer_size = cfg::MAX_STR_LEN_BYTES;
+        // The value plus the longest CBOR head, which also fits any scalar
+        size_t buffer_size = strlen(value_str) + CFG_CBOR_HEAD_MAX_BYTES;
         uint8_t* cbor_buf = static_cast<uint8_t *>(pvPortMalloc(buffer_size));
         configASSERT(cbor_buf);
-        memset(cbor_buf, 0, cfg::MAX_STR_LEN_BYTES);
+        memset(cbor_buf, 0, buffer_size);
         CborEncoder encoder;
         cbor_encoder_init(&encoder, cbor_buf, buffer_size, 0);
         switch(type){
@@ -258,7 +317,8 @@ static BaseType_t cmd_bcmp_fn(char *writeBuffer,
             if(cbor_encode_uint(&encoder, val)!= CborNoError) {
               break;
             }
-            if(!bcmp_config_set(node_id,partition,key_str_str_len,key_str,buffer_size,cbor_buf,err)){
+            if(!bcmp_config_set(node_id,partition,key_str_str_len,key_str,
+                              cbor_encoder_get_buffer_size(&encoder, cbor_buf),cbor_buf,err)){
               printf("Failed to send message config set\n");
             } else {
               printf("Succesfully sent config set msg\n");
@@ -270,7 +330,8 @@ static BaseType_t cmd_bcmp_fn(char *writeBuffer,
             if(cbor_encode_int(&encoder, val)!= CborNoError) {
               break;
             }
-            if(!bcmp_config_set(node_id,partition,key_str_str_len,key_str,buffer_size,cbor_buf,err)){
+            if(!bcmp_config_set(node_id,partition,key_str_str_len,key_str,
+                              cbor_encoder_get_buffer_size(&encoder, cbor_buf),cbor_buf,err)){
               printf("Failed to send message config get\n");
             } else {
               printf("Succesfully sent config get msg\n");
@@ -286,7 +347,8 @@ static BaseType_t cmd_bcmp_fn(char *writeBuffer,
             if(cbor_encode_float(&encoder, val)!= CborNoError) {
               break;
             }
-            if(!bcmp_config_set(node_id,partition,key_str_str_len,key_str,buffer_size,cbor_buf,err)){
+            if(!bcmp_config_set(node_id,partition,key_str_str_len,key_str,
+                              cbor_encoder_get_buffer_size(&encoder, cbor_buf),cbor_buf,err)){
               printf("Failed to send message config get\n");
             } else {
               printf("Succesfully sent config get msg\n");
@@ -297,7 +359,8 @@ static BaseType_t cmd_bcmp_fn(char *writeBuffer,
             if(cbor_encode_text_stringz(&encoder, value_str)!= CborNoError) {
               break;
             }
-            if(!bcmp_config_set(node_id,partition,key_str_str_len,key_str,buffer_size,cbor_buf,err)){
+            if(!bcmp_config_set(node_id,partition,key_str_str_len,key_str,
+                              cbor_encoder_get_buffer_size(&encoder, cbor_buf),cbor_buf,err)){
               printf("Failed to send message config get\n");
             } else {
               printf("Succesfully sent config get msg\n");
@@ -308,7 +371,8 @@ static BaseType_t cmd_bcmp_fn(char *writeBuffer,
             if(cbor_encode_byte_string(&encoder, reinterpret_cast<const uint8_t*>(value_str), strlen(value_str))!= CborNoError) {
               break;
             }
-            if(!bcmp_config_set(node_id,partition,key_str_str_len,key_str,buffer_size,cbor_buf,err)){
+            if(!bcmp_config_set(node_id,partition,key_str_str_len,key_str,
+                              cbor_encoder_get_buffer_size(&encoder, cbor_buf),cbor_buf,err)){
               printf("Failed to send message config get\n");
             } else {
               printf("Succesfully sent config get msg\n");
@@ -477,7 +541,17 @@ static BaseType_t cmd_bcmp_fn(char *writeBuffer,
       }
     }
     else if (strncmp("topo", command, command_str_len) == 0) {
-      bcmp_topology_start(networkTopologyPrint); // use generic print as callback
+      const char *mode_str;
+      BaseType_t mode_str_len = 0;
+      mode_str = FreeRTOS_CLIGetParameter(
+          commandString,
+          2,
+          &mode_str_len);
+      bcmp_topo_mode_e mode = BCMP_TOPO_MODE_DEPTH_FIRST;
+      if (mode_str && strncmp("bfs", mode_str, mode_str_len) == 0) {
+        mode = BCMP_TOPO_MODE_BREADTH_FIRST;
+      }
+      bcmp_topology_start(networkTopologyPrint, mode); // use generic print as callback
     }
     else if (strncmp("resources", command, command_str_len) == 0) {
       const char *node_id_str;
@@ -497,6 +571,29 @@ static BaseType_t cmd_bcmp_fn(char *writeBuffer,
         printf("Sent discovery request to %016" PRIx64 "\n", node_id);
       }
     }
+    else if (strncmp("l2", command, command_str_len) == 0) {
+      const char *reset_str;
+      BaseType_t reset_str_len = 0;
+      reset_str = FreeRTOS_CLIGetParameter(
+          commandString,
+          2,
+          &reset_str_len);
+      if (reset_str && strncmp("reset", reset_str, reset_str_len) == 0) {
+        bm_l2_reset_fwd_stats();
+        break;
+      }
+
+      bm_l2_fwd_stats_t stats;
+      bm_l2_get_fwd_stats(&stats);
+      printf("Forwarded: %" PRIu32 "\n", stats.forwarded);
+      printf("Filtered: %" PRIu32 "\n", stats.filtered);
+      if (stats.forwarded) {
+        printf("Residence (us) min: %" PRIu32 " avg: %" PRIu32 " max: %" PRIu32 "\n",
+               stats.min_residence_us,
+               static_cast<uint32_t>(stats.total_residence_us / stats.forwarded),
+               stats.max_residence_us);
+      }
+    }
     else if (strncmp("sub", command, command_str_len) == 0) {
       const char *topicStr = FreeRTOS_CLIGetParameter(
           commandString,
@@ -591,6 +688,48 @@ static BaseType_t cmd_bcmp_fn(char *writeBuffer,
       vPortFree(topic);
       vPortFree(data);
     }
+    else if (strncmp("batch", command, command_str_len) == 0) {
+      const char *arg_str;
+      BaseType_t arg_str_len = 0;
+      arg_str = FreeRTOS_CLIGetParameter(
+          commandString,
+          2,
+          &arg_str_len);
+      if(arg_str_len == 0) {
+        printf("ERR window required\n");
+        break;
+      }
+
+      if(strncmp("bench", arg_str, arg_str_len) == 0) {
+        const char *count_str = FreeRTOS_CLIGetParameter(
+            commandString,
+            3,
+            &arg_str_len);
+        if(arg_str_len == 0) {
+          printf("ERR count required\n");
+          break;
+        }
+        const char *len_str = FreeRTOS_CLIGetParameter(
+            commandString,
+            4,
+            &arg_str_len);
+        if(arg_str_len == 0) {
+          printf("ERR data_len required\n");
+          break;
+        }
+        uint32_t count = strtoul(count_str, NULL, 0);
+        uint32_t data_len = strtoul(len_str, NULL, 0);
+        if(data_len == 0 || data_len > UINT16_MAX) {
+          printf("ERR Invalid data_len\n");
+          break;
+        }
+        pub_batch_bench(count, data_len);
+      } else {
+        uint32_t window_ms = strtoul(arg_str, NULL, 0);
+        bm_pub_batching_set_window(window_ms);
+        printf("Publish batching window: %" PRIu32 " ms\n", window_ms);
+      }
+    }
     else {
       printf("ERR Invalid arguments\n");
     }
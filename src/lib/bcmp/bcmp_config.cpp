@@ -197,7 +197,10 @@ static void bcmp_config_process_config_get_msg(bm_common_config_get_t *msg, uint
         } else {
             break;
         }
-        size_t buffer_len = cfg::MAX_CONFIG_BUFFER_SIZE_BYTES;
+        size_t buffer_len;
+        if(!cfg->getCborValueSize(msg->key, msg->key_length, buffer_len)){
+            break;
+        }
         uint8_t * buffer = (uint8_t *) pvPortMalloc(buffer_len);
         configASSERT(buffer);
         if(cfg->getConfigCbor(msg->key,msg->key_length, buffer, buffer_len)){
@@ -208,7 +211,7 @@ static void bcmp_config_process_config_get_msg(bm_common_config_get_t *msg, uint
     } while(0);
 }
 
-static void bcmp_config_process_config_set_msg(bm_common_config_set_t *msg, uint16_t seq_num){
+static void bcmp_config_process_config_set_msg(bm_common_config_set_t *msg, uint16_t payload_len, uint16_t seq_num){
     configASSERT(msg);
     do {
         Configuration *cfg;
@@ -219,7 +222,8 @@ static void bcmp_config_process_config_set_msg(bm_common_config_set_t *msg, uint
         } else {
             break;
         }
-        if (msg->data_length > cfg::MAX_CONFIG_BUFFER_SIZE_BYTES || msg->data_length == 0) {
+        if (msg->data_length == 0 ||
+            sizeof(bm_common_config_set_t) + msg->key_length + msg->data_length > payload_len) {
             break;
         }
         if(cfg->setConfigCbor(reinterpret_cast<const char *>(msg->keyAndData), msg->key_length, &msg->keyAndData[msg->key_length], msg->data_length)){
@@ -229,10 +233,13 @@ static void bcmp_config_process_config_set_msg(bm_common_config_set_t *msg, uint
     } while(0);
 }
 
-static void bcmp_process_value_message(bm_common_config_value_t * msg) {
+static void bcmp_process_value_message(bm_common_config_value_t * msg, uint16_t payload_len) {
     CborValue it;
     CborParser parser;
     do {
+        if(sizeof(bm_common_config_value_t) + msg->data_length > payload_len){
+            break;
+        }
         if(cbor_parser_init(msg->data, msg->data_length, 0, &parser, &it) != CborNoError){
             break;
         }
@@ -271,16 +278,18 @@ static void bcmp_process_value_message(bm_common_config_value_t * msg) {
                 break;
             }
             case cfg::ConfigDataTypes_e::STR : {
-                size_t buffer_len = cfg::MAX_CONFIG_BUFFER_SIZE_BYTES;
+                size_t buffer_len;
+                if(cbor_value_get_string_length(&it, &buffer_len) != CborNoError){
+                    break;
+                }
+                // Room for the null terminator
+                buffer_len++;
                 char * buffer = (char *) pvPortMalloc(buffer_len);
                 configASSERT(buffer);
                 do {
                     if(cbor_value_copy_text_string(&it,buffer, &buffer_len, NULL) != CborNoError){
                         break;
                     }
-                    if(buffer_len >= cfg::MAX_CONFIG_BUFFER_SIZE_BYTES){
-                        break;
-                    }
                     buffer[buffer_len] = '\0';
                     printf("Node Id: %016" PRIx64 " Value:%s\n", msg->header.source_node_id,
                            buffer);
@@ -289,8 +298,12 @@ static void bcmp_process_value_message(bm_common_config_value_t * msg) {
                 break;
             }
             case cfg::ConfigDataTypes_e::BYTES: {
-                size_t buffer_len = cfg::MAX_CONFIG_BUFFER_SIZE_BYTES;
-                uint8_t * buffer = (uint8_t *) pvPortMalloc(buffer_len);
+                size_t buffer_len;
+                if(cbor_value_get_string_length(&it, &buffer_len) != CborNoError){
+                    break;
+                }
+                // Zero length byte strings still get a buffer to copy into
+                uint8_t * buffer = (uint8_t *) pvPortMalloc(buffer_len ? buffer_len : 1);
                 configASSERT(buffer);
                 do {
                     if(cbor_value_copy_byte_string(&it,buffer, &buffer_len, NULL) != CborNoError){
@@ -310,17 +323,13 @@ static void bcmp_process_value_message(bm_common_config_value_t * msg) {
             }
             case cfg::ConfigDataTypes_e::ARRAY: {
                 printf("Node Id: %016" PRIx64 " Value: Array\n", msg->header.source_node_id);
-                size_t buffer_len = cfg::MAX_CONFIG_BUFFER_SIZE_BYTES;
-                uint8_t *buffer = static_cast<uint8_t *>(pvPortMalloc(buffer_len));
-                configASSERT(buffer);
-                for (size_t i = 0; i < buffer_len; i++) {
-                    printf(" %02x", buffer[i]);
+                for (size_t i = 0; i < msg->data_length; i++) {
+                    printf(" %02x", msg->data[i]);
                     if (i % 16 == 15) {
                         printf("\n");
                     }
                 }
                 printf("\n");
-                vPortFree(buffer);
                 break;
             }
         }
@@ -393,9 +402,10 @@ static void bcmp_process_del_response_message(bm_common_config_delete_key_respon
 }
 
 /*!
+    \param payload_len length of the config message in payload
     \return true if the caller should forward the message, false if the message was handled
 */
-bool bcmp_process_config_message(bcmp_message_type_t bcmp_msg_type, uint8_t *payload, uint16_t seq_num) {
+bool bcmp_process_config_message(bcmp_message_type_t bcmp_msg_type, uint8_t *payload, uint16_t payload_len, uint16_t seq_num) {
     bool should_forward = false;
     do {
         bm_common_config_header_t * msg_header = reinterpret_cast<bm_common_config_header_t *>(payload);
@@ -409,7 +419,7 @@ bool bcmp_process_config_message(bcmp_message_type_t bcmp_msg_type, uint8_t *pay
                 break;
             }
             case BCMP_CONFIG_SET: {
-                bcmp_config_process_config_set_msg(reinterpret_cast<bm_common_config_set_t *>(payload), seq_num);
+                bcmp_config_process_config_set_msg(reinterpret_cast<bm_common_config_set_t *>(payload), payload_len, seq_num);
                 break;
             }
             case BCMP_CONFIG_COMMIT: {
@@ -442,7 +452,7 @@ bool bcmp_process_config_message(bcmp_message_type_t bcmp_msg_type, uint8_t *pay
             case BCMP_CONFIG_VALUE: {
                 (void) seq_num;
                 bm_common_config_value_t *msg = reinterpret_cast<bm_common_config_value_t *>(payload);
-                bcmp_process_value_message(msg);
+                bcmp_process_value_message(msg, payload_len);
                 break;
             }
             case BCMP_CONFIG_DELETE_REQUEST: {
@@ -0,0 +1,228 @@
+#include <string.h>
+#include "FreeRTOS.h"
+#include "bcmp_frag.h"
+
+static void free_slot(bcmp_frag_pool_t *pool, bcmp_frag_reassembly_t *slot) {
+  vPortFree(slot->msg);
+  configASSERT(pool->bytes_in_use >= slot->alloc_len);
+  pool->bytes_in_use -= slot->alloc_len;
+  memset(slot, 0, sizeof(bcmp_frag_reassembly_t));
+}
+
+static bcmp_frag_reassembly_t *find_slot(bcmp_frag_pool_t *pool, uint64_t src_node_id, const bcmp_header_t *frag) {
+  for(uint8_t idx = 0; idx < BCMP_FRAG_POOL_LEN; idx++) {
+    bcmp_frag_reassembly_t *slot = &pool->slots[idx];
+    if(slot->msg && !slot->complete &&
+       (slot->src_node_id == src_node_id) &&
+       (slot->type == frag->type) &&
+       (slot->seq_num == frag->seq_num)) {
+      return slot;
+    }
+  }
+  return NULL;
+}
+
+/*!
+  Free the least recently updated incomplete message, if it has been idle long enough
+  that its missing fragments are most likely lost
+  \param[in,out] *pool - reassembly pool
+  \param[in] now_ms - current time
+  \return true if a slot was freed
+*/
+static bool reclaim_slot(bcmp_frag_pool_t *pool, uint32_t now_ms) {
+  bcmp_frag_reassembly_t *oldest = NULL;
+  for(uint8_t idx = 0; idx < BCMP_FRAG_POOL_LEN; idx++) {
+    bcmp_frag_reassembly_t *slot = &pool->slots[idx];
+    if(!slot->msg || slot->complete || (now_ms - slot->last_rx_ms <= BCMP_FRAG_RECLAIM_MS)) {
+      continue;
+    }
+    if(!oldest || (now_ms - slot->last_rx_ms > now_ms - oldest->last_rx_ms)) {
+      oldest = slot;
+    }
+  }
+  if(!oldest) {
+    return false;
+  }
+  free_slot(pool, oldest);
+  pool->evicted++;
+  return true;
+}
+
+/*!
+  Start a new reassembly for the first fragment of a message we see
+  \param[in,out] *pool - reassembly pool
+  \param[in] src_node_id - sender of the message
+  \param[in] *frag - header of the fragment
+  \param[in] now_ms - current time
+  \return slot, NULL if the pool or the memory budget is exhausted
+*/
+static bcmp_frag_reassembly_t *new_slot(bcmp_frag_pool_t *pool, uint64_t src_node_id, const bcmp_header_t *frag, uint32_t now_ms) {
+  // Allocate for the largest message with this many fragments, the last one may be shorter
+  uint32_t alloc_len = sizeof(bcmp_header_t) + frag->frag_total * BCMP_FRAG_PAYLOAD_LEN;
+
+  bcmp_frag_reassembly_t *slot = NULL;
+  while(true) {
+    slot = NULL;
+    for(uint8_t idx = 0; idx < BCMP_FRAG_POOL_LEN; idx++) {
+      if(!pool->slots[idx].msg) {
+        slot = &pool->slots[idx];
+        break;
+      }
+    }
+    if(slot && (pool->bytes_in_use + alloc_len <= BCMP_FRAG_MAX_BYTES)) {
+      break;
+    }
+    if(!reclaim_slot(pool, now_ms)) {
+      return NULL;
+    }
+  }
+
+  slot->msg = static_cast<bcmp_header_t *>(pvPortMalloc(alloc_len));
+  if(!slot->msg) {
+    return NULL;
+  }
+  slot->alloc_len = alloc_len;
+  slot->src_node_id = src_node_id;
+  slot->type = frag->type;
+  slot->seq_num = frag->seq_num;
+  slot->frag_total = frag->frag_total;
+
+  memcpy(slot->msg, frag, sizeof(bcmp_header_t));
+  slot->msg->checksum = 0;
+  slot->msg->frag_total = 0;
+  slot->msg->frag_id = 0;
+
+  pool->bytes_in_use += alloc_len;
+  if(pool->bytes_in_use > pool->bytes_high_water) {
+    pool->bytes_high_water = pool->bytes_in_use;
+  }
+  return slot;
+}
+
+/*!
+  Clear a reassembly pool
+  \param[out] *pool - reassembly pool
+  \return None
+*/
+void bcmp_frag_init(bcmp_frag_pool_t *pool) {
+  configASSERT(pool);
+  memset(pool, 0, sizeof(bcmp_frag_pool_t));
+}
+
+/*!
+  Get the number of fragments a message payload is sent in
+  \param[in] len - payload length
+  \return number of fragments, 0 if the message fits in a single frame
+*/
+uint8_t bcmp_frag_count(uint32_t len) {
+  if(len <= BCMP_FRAG_PAYLOAD_LEN) {
+    return 0;
+  }
+  return static_cast<uint8_t>((len + BCMP_FRAG_PAYLOAD_LEN - 1) / BCMP_FRAG_PAYLOAD_LEN);
+}
+
+/*!
+  Get the payload length of one fragment of a message
+  \param[in] len - payload length of the whole message
+  \param[in] frag_id - fragment
+  \return payload bytes in the fragment, it starts at frag_id * BCMP_FRAG_PAYLOAD_LEN
+*/
+uint16_t bcmp_frag_len(uint32_t len, uint8_t frag_id) {
+  uint32_t offset = static_cast<uint32_t>(frag_id) * BCMP_FRAG_PAYLOAD_LEN;
+  configASSERT(offset < len);
+  uint32_t remaining = len - offset;
+  return static_cast<uint16_t>((remaining < BCMP_FRAG_PAYLOAD_LEN) ? remaining : BCMP_FRAG_PAYLOAD_LEN);
+}
+
+/*!
+  Add a received fragment. Fragments may arrive in any order and more than once.
+  \param[in,out] *pool - reassembly pool
+  \param[in] src_node_id - sender of the fragment
+  \param[in] *frag - received fragment, header and payload
+  \param[in] frag_len - payload length of the fragment
+  \param[in] now_ms - current time
+  \param[out] *msg_len - payload length of the reassembled message
+  \return the reassembled message once this fragment completes it, NULL otherwise.
+          Hand it back with bcmp_frag_release() when done with it.
+*/
+bcmp_header_t *bcmp_frag_add(bcmp_frag_pool_t *pool, uint64_t src_node_id, const bcmp_header_t *frag, uint16_t frag_len, uint32_t now_ms, uint16_t *msg_len) {
+  configASSERT(pool);
+  configASSERT(frag);
+  configASSERT(msg_len);
+
+  bool last = (frag->frag_id == frag->frag_total - 1);
+  if((frag->frag_total < 2) || (frag->frag_total > BCMP_FRAG_MAX_FRAGMENTS) ||
+     (frag->frag_id >= frag->frag_total) || !frag_len ||
+     (last ? (frag_len > BCMP_FRAG_PAYLOAD_LEN) : (frag_len != BCMP_FRAG_PAYLOAD_LEN))) {
+    pool->dropped++;
+    return NULL;
+  }
+
+  bcmp_frag_evict(pool, now_ms);
+
+  bcmp_frag_reassembly_t *slot = find_slot(pool, src_node_id, frag);
+  if(slot && slot->frag_total != frag->frag_total) {
+    pool->dropped++;
+    return NULL;
+  }
+  if(!slot) {
+    slot = new_slot(pool, src_node_id, frag, now_ms);
+    if(!slot) {
+      pool->dropped++;
+      return NULL;
+    }
+  }
+
+  uint8_t frag_bit = 1u << frag->frag_id;
+  if(slot->received & frag_bit) {
+    // Duplicate
+    return NULL;
+  }
+  memcpy(&slot->msg->payload[frag->frag_id * BCMP_FRAG_PAYLOAD_LEN], frag->payload, frag_len);
+  slot->received |= frag_bit;
+  slot->last_rx_ms = now_ms;
+  if(last) {
+    slot->len = static_cast<uint16_t>((frag->frag_total - 1) * BCMP_FRAG_PAYLOAD_LEN + frag_len);
+  }
+
+  if(slot->received != static_cast<uint8_t>((1u << slot->frag_total) - 1)) {
+    return NULL;
+  }
+  slot->complete = true;
+  *msg_len = slot->len;
+  return slot->msg;
+}
+
+/*!
+  Free a message returned by bcmp_frag_add()
+  \param[in,out] *pool - reassembly pool
+  \param[in] *msg - reassembled message
+  \return None
+*/
+void bcmp_frag_release(bcmp_frag_pool_t *pool, bcmp_header_t *msg) {
+  configASSERT(pool);
+  for(uint8_t idx = 0; idx < BCMP_FRAG_POOL_LEN; idx++) {
+    if(pool->slots[idx].msg == msg && pool->slots[idx].complete) {
+      free_slot(pool, &pool->slots[idx]);
+      return;
+    }
+  }
+  configASSERT(false);
+}
+
+/*!
+  Drop incomplete messages that haven't received a fragment in BCMP_FRAG_TIMEOUT_MS
+  \param[in,out] *pool - reassembly pool
+  \param[in] now_ms - current time
+  \return None
+*/
+void bcmp_frag_evict(bcmp_frag_pool_t *pool, uint32_t now_ms) {
+  configASSERT(pool);
+  for(uint8_t idx = 0; idx < BCMP_FRAG_POOL_LEN; idx++) {
+    bcmp_frag_reassembly_t *slot = &pool->slots[idx];
+    if(slot->msg && !slot->complete && (now_ms - slot->last_rx_ms > BCMP_FRAG_TIMEOUT_MS)) {
+      free_slot(pool, slot);
+      pool->evicted++;
+    }
+  }
+}
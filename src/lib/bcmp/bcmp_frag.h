@@ -0,0 +1,53 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "bcmp_messages.h"
+
+// Payload carried by every fragment but the last one: 1500 MTU minus ipv6 and BCMP headers
+#define BCMP_FRAG_PAYLOAD_LEN (1500 - 40 - sizeof(bcmp_header_t))
+#define BCMP_FRAG_MAX_FRAGMENTS (8)
+#define BCMP_FRAG_MAX_MESSAGE_LEN (BCMP_FRAG_MAX_FRAGMENTS * BCMP_FRAG_PAYLOAD_LEN)
+
+// Messages being reassembled at the same time
+#define BCMP_FRAG_POOL_LEN (6)
+// Reassembly memory budget across the pool, two messages of the largest size fit
+#define BCMP_FRAG_MAX_BYTES (32 * 1024)
+// Fragments are sent back-to-back, so a message that stalls this long has lost one
+#define BCMP_FRAG_TIMEOUT_MS (100)
+// When out of room, an incomplete message idle this long gives way to a new one
+#define BCMP_FRAG_RECLAIM_MS (10)
+
+typedef struct {
+  uint64_t src_node_id;
+  uint16_t type;
+  uint32_t seq_num;
+  uint8_t frag_total;
+  // Bit per received fragment
+  uint8_t received;
+  uint16_t len;
+  // Handed out by bcmp_frag_add(), waiting for bcmp_frag_release()
+  bool complete;
+  uint32_t last_rx_ms;
+  // Reassembled header and payload, NULL while the slot is free
+  bcmp_header_t *msg;
+  uint32_t alloc_len;
+} bcmp_frag_reassembly_t;
+
+typedef struct {
+  bcmp_frag_reassembly_t slots[BCMP_FRAG_POOL_LEN];
+  uint32_t bytes_in_use;
+  uint32_t bytes_high_water;
+  uint32_t evicted;
+  uint32_t dropped;
+} bcmp_frag_pool_t;
+
+static_assert(BCMP_FRAG_MAX_FRAGMENTS <= 8, "received fragments are tracked in a uint8_t");
+
+void bcmp_frag_init(bcmp_frag_pool_t *pool);
+uint8_t bcmp_frag_count(uint32_t len);
+uint16_t bcmp_frag_len(uint32_t len, uint8_t frag_id);
+bcmp_header_t *bcmp_frag_add(bcmp_frag_pool_t *pool, uint64_t src_node_id, const bcmp_header_t *frag, uint16_t frag_len, uint32_t now_ms, uint16_t *msg_len);
+void bcmp_frag_release(bcmp_frag_pool_t *pool, bcmp_header_t *msg);
+void bcmp_frag_evict(bcmp_frag_pool_t *pool, uint32_t now_ms);
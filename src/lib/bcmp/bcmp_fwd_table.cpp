@@ -0,0 +1,314 @@
+#include <stddef.h>
+#include <string.h>
+#include "FreeRTOS.h"
+#include "bcmp_fwd_table.h"
+
+#define SLOT_MASK (BCMP_FWD_TABLE_LEN - 1)
+
+static_assert((BCMP_FWD_TABLE_LEN & SLOT_MASK) == 0, "BCMP_FWD_TABLE_LEN must be a power of 2");
+
+// Fixed ipv6 header, BCMP doesn't use extension headers
+#define IP6_HDR_LEN (40)
+#define IP6_NEXT_HEADER_OFFSET (6)
+#define IP6_SRC_OFFSET (8)
+#define IP6_DST_OFFSET (24)
+// Same as IP_PROTO_BCMP in bcmp.h, which drags in lwip
+#define IP6_NEXT_HEADER_BCMP (0xBC)
+
+// Node ids are already FNV hashes, so the low bits spread well enough
+static uint32_t home_slot(uint64_t node_id) {
+  return static_cast<uint32_t>(node_id) & SLOT_MASK;
+}
+
+static bool entry_stale(const bcmp_fwd_entry_t *entry, uint32_t now_ms) {
+  return (now_ms - entry->last_seen_ms) > BCMP_FWD_ENTRY_TIMEOUT_MS;
+}
+
+/*!
+  Find the slot holding a node
+  \param[in] *table - forwarding table
+  \param[in] node_id - node to look for
+  \return slot index, -1 if not found
+*/
+static int32_t find_slot(const bcmp_fwd_table_t *table, uint64_t node_id) {
+  uint32_t idx = home_slot(node_id);
+
+  // There is always at least one empty slot, so the probe sequence ends
+  while(table->entries[idx].node_id) {
+    if(table->entries[idx].node_id == node_id) {
+      return static_cast<int32_t>(idx);
+    }
+    idx = (idx + 1) & SLOT_MASK;
+  }
+  return -1;
+}
+
+/*!
+  Empty a slot, shifting back later entries of the probe sequence so lookups
+  don't need tombstones
+  \param[in,out] *table - forwarding table
+  \param[in] idx - slot to empty
+  \return none
+*/
+static void delete_slot(bcmp_fwd_table_t *table, uint32_t idx) {
+  uint32_t hole = idx;
+  uint32_t next = idx;
+
+  memset(&table->entries[hole], 0, sizeof(bcmp_fwd_entry_t));
+  while(true) {
+    next = (next + 1) & SLOT_MASK;
+    if(!table->entries[next].node_id) {
+      break;
+    }
+
+    // Entries whose home slot is cyclically in (hole, next] have to stay put
+    uint32_t home = home_slot(table->entries[next].node_id);
+    bool stays = (hole <= next) ? ((hole < home) && (home <= next)) : ((hole < home) || (home <= next));
+    if(!stays) {
+      table->entries[hole] = table->entries[next];
+      memset(&table->entries[next], 0, sizeof(bcmp_fwd_entry_t));
+      hole = next;
+    }
+  }
+  table->count--;
+}
+
+/*!
+  Drop every node we haven't heard from in BCMP_FWD_ENTRY_TIMEOUT_MS
+  \param[in,out] *table - forwarding table
+  \param[in] now_ms - current time
+  \return none
+*/
+static void purge_stale(bcmp_fwd_table_t *table, uint32_t now_ms) {
+  uint32_t idx = 0;
+  while(idx < BCMP_FWD_TABLE_LEN) {
+    bcmp_fwd_entry_t *entry = &table->entries[idx];
+    if(entry->node_id && entry_stale(entry, now_ms)) {
+      // Backward shift may move an unchecked entry into this slot, check it again
+      delete_slot(table, idx);
+    } else {
+      idx++;
+    }
+  }
+}
+
+static uint64_t read_node_id(const uint8_t *buf) {
+  uint64_t node_id;
+  memcpy(&node_id, buf, sizeof(node_id));
+  return node_id;
+}
+
+/*!
+  Empty the forwarding table
+  \param[out] *table - forwarding table
+  \return none
+*/
+void bcmp_fwd_table_init(bcmp_fwd_table_t *table) {
+  configASSERT(table);
+  memset(table, 0, sizeof(bcmp_fwd_table_t));
+}
+
+/*!
+  Record the port a node was heard on
+  \param[in,out] *table - forwarding table
+  \param[in] node_id - node that sent a frame
+  \param[in] port - port the frame came in on
+  \param[in] now_ms - current time
+  \return none
+*/
+void bcmp_fwd_table_learn(bcmp_fwd_table_t *table, uint64_t node_id, uint8_t port, uint32_t now_ms) {
+  configASSERT(table);
+  if(!node_id || !port) {
+    return;
+  }
+
+  int32_t found = find_slot(table, node_id);
+  if(found >= 0) {
+    table->entries[found].port = port;
+    table->entries[found].last_seen_ms = now_ms;
+    return;
+  }
+
+  if(table->count >= BCMP_FWD_MAX_NODES) {
+    purge_stale(table, now_ms);
+    if(table->count >= BCMP_FWD_MAX_NODES) {
+      // Unlearned nodes are still reached by flooding
+      return;
+    }
+  }
+
+  uint32_t idx = home_slot(node_id);
+  while(table->entries[idx].node_id) {
+    idx = (idx + 1) & SLOT_MASK;
+  }
+  table->entries[idx].node_id = node_id;
+  table->entries[idx].port = port;
+  table->entries[idx].last_seen_ms = now_ms;
+  table->count++;
+}
+
+/*!
+  Get the port a node is reached through
+  \param[in] *table - forwarding table
+  \param[in] node_id - node to look up
+  \param[in] now_ms - current time
+  \return port, 0 if the node is unknown or hasn't been heard from in a while
+*/
+uint8_t bcmp_fwd_table_lookup(const bcmp_fwd_table_t *table, uint64_t node_id, uint32_t now_ms) {
+  configASSERT(table);
+  int32_t found = find_slot(table, node_id);
+  if(found < 0 || entry_stale(&table->entries[found], now_ms)) {
+    return 0;
+  }
+  return table->entries[found].port;
+}
+
+/*!
+  Forget every node learned on a port, called when its link goes down
+  \param[in,out] *table - forwarding table
+  \param[in] port - port that went down
+  \return none
+*/
+void bcmp_fwd_table_flush_port(bcmp_fwd_table_t *table, uint8_t port) {
+  configASSERT(table);
+  uint32_t idx = 0;
+  while(idx < BCMP_FWD_TABLE_LEN) {
+    bcmp_fwd_entry_t *entry = &table->entries[idx];
+    if(entry->node_id && entry->port == port) {
+      delete_slot(table, idx);
+    } else {
+      idx++;
+    }
+  }
+}
+
+/*!
+  Get the number of learned nodes
+  \param[in] *table - forwarding table
+  \return number of nodes
+*/
+uint16_t bcmp_fwd_table_count(const bcmp_fwd_table_t *table) {
+  configASSERT(table);
+  return table->count;
+}
+
+/*!
+  Get the node a BCMP message is addressed to. Config and time messages start
+  with the target node id, DFU messages carry it in their address block.
+  \param[in] *header - BCMP message
+  \param[in] len - payload length
+  \param[out] *target_node_id - addressed node, 0 for every node
+  \return true if the message is addressed to a single node or to all of them,
+          false if it isn't a targeted message
+*/
+bool bcmp_fwd_target(const bcmp_header_t *header, uint16_t len, uint64_t *target_node_id) {
+  configASSERT(header);
+  configASSERT(target_node_id);
+
+  size_t offset = 0;
+  switch(header->type) {
+    case BCMP_SYSTEM_TIME_REQUEST:
+    case BCMP_SYSTEM_TIME_RESPONSE:
+    case BCMP_SYSTEM_TIME_SET: {
+      offset = offsetof(bcmp_system_time_header_t, target_node_id);
+      break;
+    }
+
+    case BCMP_CONFIG_GET:
+    case BCMP_CONFIG_SET:
+    case BCMP_CONFIG_VALUE:
+    case BCMP_CONFIG_COMMIT:
+    case BCMP_CONFIG_STATUS_REQUEST:
+    case BCMP_CONFIG_STATUS_RESPONSE:
+    case BCMP_CONFIG_DELETE_REQUEST:
+    case BCMP_CONFIG_DELETE_RESPONSE: {
+      // bm_common_config_header_t, laid out like bcmp_system_time_header_t
+      offset = 0;
+      break;
+    }
+
+    case BCMP_DFU_START:
+    case BCMP_DFU_PAYLOAD_REQ:
+    case BCMP_DFU_PAYLOAD:
+    case BCMP_DFU_END:
+    case BCMP_DFU_ACK:
+    case BCMP_DFU_ABORT:
+    case BCMP_DFU_HEARTBEAT:
+    case BCMP_DFU_REBOOT_REQ:
+    case BCMP_DFU_REBOOT:
+    case BCMP_DFU_BOOT_COMPLETE:
+    case BCMP_DFU_WINDOW_REQ:
+    case BCMP_DFU_WINDOW_PAYLOAD: {
+      offset = offsetof(bm_dfu_frame_t, payload) + offsetof(bm_dfu_event_address_t, dst_node_id);
+      break;
+    }
+
+    default: {
+      return false;
+    }
+  }
+
+  if(len < offset + sizeof(uint64_t)) {
+    return false;
+  }
+  *target_node_id = read_node_id(&header->payload[offset]);
+  return true;
+}
+
+/*!
+  Learn where a received frame came from and decide whether this node needs it.
+  Messages addressed to another node we know the port of are sent out of that
+  port alone instead of being flooded hop-by-hop through every BCMP task.
+  \param[in,out] *table - forwarding table
+  \param[in] self_node_id - this node
+  \param[in] *ip6_packet - received ipv6 packet, as it was on the wire
+  \param[in] len - packet length
+  \param[in] ingress_port - port the packet came in on
+  \param[in] now_ms - current time
+  \param[out] *egress_port - port to send the packet out of for BCMP_FWD_FORWARD
+  \return what to do with the packet
+*/
+bcmp_fwd_action_e bcmp_fwd_process(bcmp_fwd_table_t *table, uint64_t self_node_id, const uint8_t *ip6_packet, uint16_t len, uint8_t ingress_port, uint32_t now_ms, uint8_t *egress_port) {
+  configASSERT(table);
+  configASSERT(ip6_packet);
+  configASSERT(egress_port);
+
+  if(len < IP6_HDR_LEN || (ip6_packet[0] >> 4) != 6) {
+    return BCMP_FWD_DELIVER;
+  }
+
+  // Link-local addresses end in the node id, big endian
+  uint64_t src_node_id = __builtin_bswap64(read_node_id(&ip6_packet[IP6_SRC_OFFSET + 8]));
+  if(src_node_id != self_node_id) {
+    bcmp_fwd_table_learn(table, src_node_id, ingress_port, now_ms);
+  }
+
+  // Only link-local multicast BCMP is relayed hop-by-hop
+  const uint8_t *dst = &ip6_packet[IP6_DST_OFFSET];
+  if(ip6_packet[IP6_NEXT_HEADER_OFFSET] != IP6_NEXT_HEADER_BCMP || dst[0] != 0xFF || dst[1] != 0x02 ||
+     len < IP6_HDR_LEN + sizeof(bcmp_header_t)) {
+    return BCMP_FWD_DELIVER;
+  }
+
+  const bcmp_header_t *header = reinterpret_cast<const bcmp_header_t *>(&ip6_packet[IP6_HDR_LEN]);
+  uint16_t bcmp_len = len - IP6_HDR_LEN - sizeof(bcmp_header_t);
+  uint64_t target_node_id = 0;
+  // Only the first fragment carries the target, leave fragmented messages to the BCMP task
+  if(header->frag_total || !bcmp_fwd_target(header, bcmp_len, &target_node_id) ||
+     !target_node_id || target_node_id == self_node_id) {
+    return BCMP_FWD_DELIVER;
+  }
+
+  if(header->type >= BCMP_DFU_START && header->type <= BCMP_DFU_LAST_MESSAGE) {
+    // DFU only talks to neighbors, the BCMP task would throw this away
+    return BCMP_FWD_DROP;
+  }
+
+  uint8_t port = bcmp_fwd_table_lookup(table, target_node_id, now_ms);
+  if(!port || port == ingress_port) {
+    // Unknown, or the table is out of date, let the BCMP task flood it
+    return BCMP_FWD_DELIVER;
+  }
+  *egress_port = port;
+  return BCMP_FWD_FORWARD;
+}
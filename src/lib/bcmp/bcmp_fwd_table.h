@@ -0,0 +1,47 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "bcmp_messages.h"
+
+// Learned nodes, must be a power of 2
+#define BCMP_FWD_TABLE_LEN (64)
+// Learned nodes are capped below the table size to keep probe sequences short
+#define BCMP_FWD_MAX_NODES ((BCMP_FWD_TABLE_LEN * 3) / 4)
+// Nodes we haven't heard from in this long are flooded to again
+#define BCMP_FWD_ENTRY_TIMEOUT_MS (60 * 1000)
+
+typedef struct {
+  // 0 marks an empty slot
+  uint64_t node_id;
+  uint32_t last_seen_ms;
+  // Port the node was last heard on, 1 based like BCMP ingress ports
+  uint8_t port;
+} bcmp_fwd_entry_t;
+
+/*
+  Learned node id -> port table. Nodes are hashed on their id with linear
+  probing and backward shift deletion.
+*/
+typedef struct {
+  bcmp_fwd_entry_t entries[BCMP_FWD_TABLE_LEN];
+  uint16_t count;
+} bcmp_fwd_table_t;
+
+typedef enum {
+  // Hand the frame up to lwip as usual
+  BCMP_FWD_DELIVER,
+  // Send the frame out of the egress port only, this node doesn't need it
+  BCMP_FWD_FORWARD,
+  // Not for this node and not relayed by anyone
+  BCMP_FWD_DROP,
+} bcmp_fwd_action_e;
+
+void bcmp_fwd_table_init(bcmp_fwd_table_t *table);
+void bcmp_fwd_table_learn(bcmp_fwd_table_t *table, uint64_t node_id, uint8_t port, uint32_t now_ms);
+uint8_t bcmp_fwd_table_lookup(const bcmp_fwd_table_t *table, uint64_t node_id, uint32_t now_ms);
+void bcmp_fwd_table_flush_port(bcmp_fwd_table_t *table, uint8_t port);
+uint16_t bcmp_fwd_table_count(const bcmp_fwd_table_t *table);
+bool bcmp_fwd_target(const bcmp_header_t *header, uint16_t len, uint64_t *target_node_id);
+bcmp_fwd_action_e bcmp_fwd_process(bcmp_fwd_table_t *table, uint64_t self_node_id, const uint8_t *ip6_packet, uint16_t len, uint8_t ingress_port, uint32_t now_ms, uint8_t *egress_port);
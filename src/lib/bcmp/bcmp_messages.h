@@ -318,11 +318,33 @@ typedef struct {
   bm_dfu_event_img_info_t info;
 } __attribute__((packed)) bcmp_dfu_start_t;
 
+// Extended update request. Hosts that predate these options send a plain bcmp_dfu_start_t,
+// which clients treat as a window of 1 (stop-and-wait) with no flags set.
+typedef struct {
+  bcmp_dfu_start_t start;
+
+  // Largest number of chunks the host is willing to stream ahead of the client.
+  uint8_t max_window_size;
+
+  // BM_DFU_START_FLAG_* options for this update session
+  uint8_t flags;
+} __attribute__((packed)) bcmp_dfu_start_ext_t;
+
 typedef struct {
   bm_dfu_frame_header_t header;
   bm_dfu_event_chunk_request_t chunk_req;
 } __attribute__((packed)) bcmp_dfu_payload_req_t;
 
+typedef struct {
+  bm_dfu_frame_header_t header;
+  bm_dfu_event_window_request_t window_req;
+} __attribute__((packed)) bcmp_dfu_window_req_t;
+
+typedef struct {
+  bm_dfu_frame_header_t header;
+  bm_dfu_event_window_chunk_t chunk;
+} __attribute__((packed)) bcmp_dfu_window_payload_t;
+
 typedef struct {
   bm_dfu_frame_header_t header;
   bm_dfu_event_image_chunk_t chunk;
@@ -412,5 +434,7 @@ typedef enum {
   BCMP_DFU_REBOOT_REQ = 0xD7,
   BCMP_DFU_REBOOT = 0xD8,
   BCMP_DFU_BOOT_COMPLETE = 0xD9,
-  BCMP_DFU_LAST_MESSAGE = BCMP_DFU_BOOT_COMPLETE,
+  BCMP_DFU_WINDOW_REQ = 0xDA,
+  BCMP_DFU_WINDOW_PAYLOAD = 0xDB,
+  BCMP_DFU_LAST_MESSAGE = BCMP_DFU_WINDOW_PAYLOAD,
 } bcmp_message_type_t;
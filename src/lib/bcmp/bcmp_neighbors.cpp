@@ -5,6 +5,7 @@
 #include "bcmp.h"
 #include "bcmp_info.h"
 #include "bcmp_neighbors.h"
+#include "bcmp_resource_discovery.h"
 #include "device_info.h"
 #include "util.h"
 
@@ -146,6 +147,8 @@ bm_neighbor_t *bcmp_update_neighbor(uint64_t node_id, uint8_t port) {
     neighbor = bcmp_add_neighbor(node_id, port);
     // Let's get this node's information
     bcmp_request_info(node_id, &multicast_ll_addr);
+    // Nodes that just joined through this link haven't seen our subscriptions yet
+    bcmp_resource_discovery::bcmp_resource_discovery_announce();
   }
 
   return neighbor;
@@ -0,0 +1,198 @@
+#include <string.h>
+#include "FreeRTOS.h"
+#include "bcmp_request_table.h"
+
+static_assert((BCMP_REQUEST_TABLE_LEN & (BCMP_REQUEST_TABLE_LEN - 1)) == 0, "BCMP_REQUEST_TABLE_LEN must be a power of 2");
+static_assert(BCMP_REQUEST_TABLE_LEN <= UINT8_MAX, "heap indices are 8 bits");
+
+#define SLOT(seq_num) ((seq_num) & (BCMP_REQUEST_TABLE_LEN - 1))
+
+// Deadlines are tick based milliseconds and wrap around, so compare them by difference
+static bool deadline_before(uint32_t a, uint32_t b) {
+  return static_cast<int32_t>(a - b) < 0;
+}
+
+static bool heap_less(const bcmp_request_table_t *table, uint8_t a, uint8_t b) {
+  return deadline_before(table->requests[table->heap[a]].deadline_ms,
+                         table->requests[table->heap[b]].deadline_ms);
+}
+
+static void heap_swap(bcmp_request_table_t *table, uint8_t a, uint8_t b) {
+  uint8_t slot = table->heap[a];
+  table->heap[a] = table->heap[b];
+  table->heap[b] = slot;
+  table->requests[table->heap[a]].heap_idx = a;
+  table->requests[table->heap[b]].heap_idx = b;
+}
+
+static void heap_sift_up(bcmp_request_table_t *table, uint8_t idx) {
+  while(idx > 0) {
+    uint8_t parent = (idx - 1) / 2;
+    if(!heap_less(table, idx, parent)) {
+      break;
+    }
+    heap_swap(table, idx, parent);
+    idx = parent;
+  }
+}
+
+static void heap_sift_down(bcmp_request_table_t *table, uint8_t idx) {
+  while(true) {
+    uint8_t smallest = idx;
+    uint8_t left = 2 * idx + 1;
+    uint8_t right = left + 1;
+    if(left < table->heap_len && heap_less(table, left, smallest)) {
+      smallest = left;
+    }
+    if(right < table->heap_len && heap_less(table, right, smallest)) {
+      smallest = right;
+    }
+    if(smallest == idx) {
+      break;
+    }
+    heap_swap(table, idx, smallest);
+    idx = smallest;
+  }
+}
+
+/*!
+  Take a request out of its slot and out of the deadline heap
+  \param[in,out] *table - request table
+  \param[in] slot - slot of the request
+  \param[out] *request - copy of the removed request, may be NULL
+  \return None
+*/
+static void remove_slot(bcmp_request_table_t *table, uint8_t slot, bcmp_request_t *request) {
+  bcmp_request_t *entry = &table->requests[slot];
+  uint8_t idx = entry->heap_idx;
+  configASSERT(entry->in_use);
+  configASSERT(table->heap_len > 0);
+
+  if(request) {
+    *request = *entry;
+  }
+  entry->in_use = false;
+
+  // Move the last heap element into the hole and restore the heap order around it
+  table->heap_len--;
+  if(idx != table->heap_len) {
+    uint8_t moved = table->heap[table->heap_len];
+    table->heap[idx] = moved;
+    table->requests[moved].heap_idx = idx;
+    heap_sift_up(table, idx);
+    heap_sift_down(table, table->requests[moved].heap_idx);
+  }
+}
+
+/*!
+  Clear a request table
+  \param[out] *table - request table
+  \return None
+*/
+void bcmp_request_table_init(bcmp_request_table_t *table) {
+  configASSERT(table);
+  memset(table, 0, sizeof(bcmp_request_table_t));
+}
+
+/*!
+  Check if a request with this sequence number can be added
+  \param[in] *table - request table
+  \param[in] seq_num - sequence number
+  \return true if the slot for seq_num is free
+*/
+bool bcmp_request_table_slot_free(const bcmp_request_table_t *table, uint16_t seq_num) {
+  configASSERT(table);
+  return !table->requests[SLOT(seq_num)].in_use;
+}
+
+/*!
+  Track a sent request until its reply arrives or it times out
+  \param[in,out] *table - request table
+  \param[in] seq_num - sequence number of the request
+  \param[in] type - BCMP message type of the request
+  \param[in] now_ms - current time
+  \param[in] timeout_ms - how long to wait for the reply
+  \param[in] callback - reply callback, may be NULL
+  \return false if the slot for seq_num is already taken
+*/
+bool bcmp_request_table_add(bcmp_request_table_t *table, uint16_t seq_num, uint16_t type, uint32_t now_ms, uint32_t timeout_ms, bcmp_reply_message_cb callback) {
+  if(!bcmp_request_table_slot_free(table, seq_num)) {
+    return false;
+  }
+
+  uint8_t slot = SLOT(seq_num);
+  bcmp_request_t *entry = &table->requests[slot];
+  entry->seq_num = seq_num;
+  entry->type = type;
+  entry->deadline_ms = now_ms + timeout_ms;
+  entry->callback = callback;
+  entry->in_use = true;
+
+  configASSERT(table->heap_len < BCMP_REQUEST_TABLE_LEN);
+  entry->heap_idx = table->heap_len;
+  table->heap[table->heap_len] = slot;
+  table->heap_len++;
+  heap_sift_up(table, entry->heap_idx);
+
+  return true;
+}
+
+/*!
+  Stop tracking a request, usually because its reply arrived
+  \param[in,out] *table - request table
+  \param[in] seq_num - sequence number of the reply
+  \param[out] *request - copy of the removed request, may be NULL
+  \return false if there is no outstanding request with this sequence number
+*/
+bool bcmp_request_table_remove(bcmp_request_table_t *table, uint16_t seq_num, bcmp_request_t *request) {
+  configASSERT(table);
+  uint8_t slot = SLOT(seq_num);
+  if(!table->requests[slot].in_use || table->requests[slot].seq_num != seq_num) {
+    return false;
+  }
+  remove_slot(table, slot, request);
+  return true;
+}
+
+/*!
+  Get the earliest deadline of all outstanding requests
+  \param[in] *table - request table
+  \param[out] *deadline_ms - earliest deadline
+  \return false if there are no outstanding requests
+*/
+bool bcmp_request_table_next_deadline(const bcmp_request_table_t *table, uint32_t *deadline_ms) {
+  configASSERT(table);
+  configASSERT(deadline_ms);
+  if(!table->heap_len) {
+    return false;
+  }
+  *deadline_ms = table->requests[table->heap[0]].deadline_ms;
+  return true;
+}
+
+/*!
+  Remove the earliest request if its deadline has passed. Call until it
+  returns false to drain every expired request.
+  \param[in,out] *table - request table
+  \param[in] now_ms - current time
+  \param[out] *request - copy of the expired request
+  \return true if a request expired
+*/
+bool bcmp_request_table_pop_expired(bcmp_request_table_t *table, uint32_t now_ms, bcmp_request_t *request) {
+  uint32_t deadline_ms;
+  if(!bcmp_request_table_next_deadline(table, &deadline_ms) || !deadline_before(deadline_ms, now_ms)) {
+    return false;
+  }
+  remove_slot(table, table->heap[0], request);
+  return true;
+}
+
+/*!
+  Get the number of outstanding requests
+  \param[in] *table - request table
+  \return number of requests
+*/
+uint8_t bcmp_request_table_count(const bcmp_request_table_t *table) {
+  configASSERT(table);
+  return table->heap_len;
+}
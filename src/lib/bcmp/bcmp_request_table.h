@@ -0,0 +1,51 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * @brief A function pointer type for handling reply messages in the BCMP protocol.
+ *
+ * This typedef defines a type for function pointers that can be used as callbacks
+ * to handle sequenced reply messages in the BCMP protocol. These functions should
+ * take a pointer to a payload of type uint8_t as a parameter and return a boolean
+ * value.
+ *
+ * The return value should be:
+ * - true if the reply message was handled successfully,
+ * - false if there was an error handling the reply message.
+ */
+typedef bool (*bcmp_reply_message_cb)(uint8_t *payload);
+
+// Maximum number of outstanding sequenced requests, must be a power of 2
+#define BCMP_REQUEST_TABLE_LEN (32)
+
+typedef struct {
+  uint16_t seq_num;
+  uint16_t type;
+  uint32_t deadline_ms;
+  bcmp_reply_message_cb callback;
+  bool in_use;
+  // Position of this request in the deadline heap
+  uint8_t heap_idx;
+} bcmp_request_t;
+
+/*
+  Requests live in the slot selected by the low bits of their sequence number,
+  so a reply finds its request without searching. The slots in use are also kept
+  in a binary min-heap ordered by deadline, so the next expiration is always at
+  the top of the heap.
+*/
+typedef struct {
+  bcmp_request_t requests[BCMP_REQUEST_TABLE_LEN];
+  uint8_t heap[BCMP_REQUEST_TABLE_LEN];
+  uint8_t heap_len;
+} bcmp_request_table_t;
+
+void bcmp_request_table_init(bcmp_request_table_t *table);
+bool bcmp_request_table_slot_free(const bcmp_request_table_t *table, uint16_t seq_num);
+bool bcmp_request_table_add(bcmp_request_table_t *table, uint16_t seq_num, uint16_t type, uint32_t now_ms, uint32_t timeout_ms, bcmp_reply_message_cb callback);
+bool bcmp_request_table_remove(bcmp_request_table_t *table, uint16_t seq_num, bcmp_request_t *request);
+bool bcmp_request_table_next_deadline(const bcmp_request_table_t *table, uint32_t *deadline_ms);
+bool bcmp_request_table_pop_expired(bcmp_request_table_t *table, uint32_t now_ms, bcmp_request_t *request);
+uint8_t bcmp_request_table_count(const bcmp_request_table_t *table);
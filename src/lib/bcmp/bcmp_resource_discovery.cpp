@@ -6,6 +6,9 @@
 #include "device_info.h"
 #include "bcmp.h"
 #include "bcmp_linked_list_generic.h"
+#include "bcmp_topology.h"
+#include "bm_sub_table.h"
+#include "task.h"
 
 using namespace bcmp_resource_discovery;
 
@@ -24,11 +27,50 @@ typedef struct bcmp_resource_list_t {
 static bcmp_resource_list_t _pub_list;
 static bcmp_resource_list_t _sub_list;
 
+// Other nodes whose subscriptions are kept, from their resource table replies
+#ifndef BCMP_RESOURCE_MAX_REMOTE_NODES
+#define BCMP_RESOURCE_MAX_REMOTE_NODES (32)
+#endif
+// How long a survey that every node replied to is trusted for. Nodes also announce their
+// table when they subscribe or find a new neighbor, so this only bounds how stale it gets.
+#ifndef BCMP_RESOURCE_REMOTE_SUBS_TTL_MS
+#define BCMP_RESOURCE_REMOTE_SUBS_TTL_MS (60 * 1000)
+#endif
+// Least time between surveys, so an unfinished one isn't restarted on every publish
+#ifndef BCMP_RESOURCE_SURVEY_INTERVAL_MS
+#define BCMP_RESOURCE_SURVEY_INTERVAL_MS (10 * 1000)
+#endif
+
+typedef struct {
+    // 0 if the entry is free
+    uint64_t node_id;
+    // Copy of the subscribed bcmp_resource_t list from the node's last reply, NULL if none yet
+    uint8_t *subs;
+    uint16_t num_subs;
+    // Part of the current survey and hasn't replied to it yet
+    bool awaited;
+} bcmp_remote_subs_t;
+
+typedef struct {
+    bcmp_remote_subs_t nodes[BCMP_RESOURCE_MAX_REMOTE_NODES];
+    // Nodes of the current survey that haven't replied yet
+    uint16_t num_awaited;
+    bool surveyed;
+    // Every node of the last survey replied, so nodes has everyone's subscriptions
+    bool complete;
+    TickType_t survey_ticks;
+    SemaphoreHandle_t lock;
+} bcmp_remote_subs_table_t;
+
+static bcmp_remote_subs_table_t _remote;
+
 static BCMP_Linked_List_Generic _resource_request_list;
 
 static bool _bcmp_resource_discovery_find_resource(const char * resource, const uint16_t resource_len, resource_type_e type);
 static bool _bcmp_resource_compute_list_size(resource_type_e type, size_t &msg_len);
 static bool _bcmp_resource_populate_msg_data(resource_type_e type, bcmp_resource_table_reply_t * repl, uint32_t &data_offset);
+static bcmp_resource_table_reply_t *_bcmp_resource_alloc_local_reply(size_t &msg_len);
+static void _bcmp_resource_record_remote_subs(bcmp_resource_table_reply_t *repl);
 
 static bool _bcmp_resource_compute_list_size(resource_type_e type, size_t &msg_len) {
     bool rval = false;
@@ -81,38 +123,19 @@ static bool _bcmp_resource_populate_msg_data(resource_type_e type, bcmp_resource
 */
 void bcmp_resource_discovery::bcmp_process_resource_discovery_request(bcmp_resource_table_request_t *req, const ip_addr_t *dst) {
     do {
-        if(req->target_node_id != getNodeId()){
+        // Zeroed target is a survey of all nodes
+        if(req->target_node_id != getNodeId() && req->target_node_id != 0){
             break;
         }
-        size_t msg_len = sizeof(bcmp_resource_table_reply_t);
-        if(!_bcmp_resource_compute_list_size(PUB, msg_len)) {
-            printf("Failed to get publishers list\n.");
+        size_t msg_len;
+        bcmp_resource_table_reply_t *repl = _bcmp_resource_alloc_local_reply(msg_len);
+        if(!repl) {
             break;
         }
-        if(!_bcmp_resource_compute_list_size(SUB, msg_len)) {
-            printf("Failed to get subscribers list\n.");
-            break;
+        if(bcmp_tx(dst, BCMP_RESOURCE_TABLE_REPLY, reinterpret_cast<uint8_t *>(repl), msg_len) != ERR_OK){
+            printf("Failed to send bcmp resource table reply\n");
         }
-        // Create and fill the reply
-        uint8_t * reply_buf = static_cast<uint8_t*>(pvPortMalloc(msg_len));
-        configASSERT(reply_buf);
-        do {
-            bcmp_resource_table_reply_t * repl = reinterpret_cast<bcmp_resource_table_reply_t *>(reply_buf);
-            repl->node_id = getNodeId();
-            uint32_t data_offset = 0;
-            if(!_bcmp_resource_populate_msg_data(PUB, repl, data_offset)) {
-                printf("Failed to get publishers list\n.");
-                break;
-            }
-            if(!_bcmp_resource_populate_msg_data(SUB, repl, data_offset)) {
-                printf("Failed to get publishers list\n.");
-                break;
-            }
-            if(bcmp_tx(dst, BCMP_RESOURCE_TABLE_REPLY, reply_buf, msg_len) != ERR_OK){
-                printf("Failed to send bcmp resource table reply\n");
-            }
-        } while(0);
-        vPortFree(reply_buf);
+        vPortFree(repl);
     } while(0);
 }
 
@@ -128,8 +151,13 @@ void bcmp_resource_discovery::bcmp_process_resource_discovery_reply(bcmp_resourc
         if(repl->node_id != src_node_id){
             break;
         }
+        _bcmp_resource_record_remote_subs(repl);
         bcmp_ll_element_t *element = _resource_request_list.find(src_node_id);
-        if ((element != NULL) && (element->fp != NULL)) {
+        if (element == NULL) {
+            // Survey reply or announcement, nobody asked to see it
+            break;
+        }
+        if (element->fp != NULL) {
             element->fp(repl);
         } else {
             printf("Node Id %016" PRIx64 " resource table:\n", src_node_id);
@@ -151,9 +179,7 @@ void bcmp_resource_discovery::bcmp_process_resource_discovery_reply(bcmp_resourc
                 num_subs--;
             }
         }
-        if (element != NULL) {
-            _resource_request_list.remove(element);
-        }
+        _resource_request_list.remove(element);
     } while(0);
 }
 
@@ -173,6 +199,8 @@ void bcmp_resource_discovery::bcmp_resource_discovery_init(void) {
     _sub_list.num_resources = 0;
     _sub_list.lock = xSemaphoreCreateMutex();
     configASSERT(_sub_list.lock);
+    _remote.lock = xSemaphoreCreateMutex();
+    configASSERT(_remote.lock);
 }
 
 /*!
@@ -220,6 +248,10 @@ bool bcmp_resource_discovery::bcmp_resource_discovery_add_resource(const char *
         } while(0);
         xSemaphoreGive(res_list->lock);
     }
+    if(rval && type == SUB) {
+        // Let nodes publishing to this topic know it has a subscriber here
+        bcmp_resource_discovery_announce();
+    }
     return rval;
 }
 
@@ -339,9 +371,20 @@ static bool _bcmp_resource_discovery_find_resource(const char * resource, const
   \return - pointer to the resource table reply, caller is responsible for freeing the memory.
 */
 bcmp_resource_table_reply_t* bcmp_resource_discovery::bcmp_resource_discovery_get_local_resources(void) {
+    size_t msg_len;
+    return _bcmp_resource_alloc_local_reply(msg_len);
+}
+
+/*!
+  Build a resource table reply with this node's resources.
+
+  \param out &msg_len - length of the reply
+  \return - pointer to the reply, NULL on failure. Caller is responsible for freeing the memory.
+*/
+static bcmp_resource_table_reply_t *_bcmp_resource_alloc_local_reply(size_t &msg_len) {
     bool success = false;
     bcmp_resource_table_reply_t *reply_rval = NULL;
-    size_t msg_len = sizeof(bcmp_resource_table_reply_t);
+    msg_len = sizeof(bcmp_resource_table_reply_t);
     do {
         if(!_bcmp_resource_compute_list_size(PUB, msg_len)) {
             printf("Failed to get publishers list\n.");
@@ -375,3 +418,199 @@ bcmp_resource_table_reply_t* bcmp_resource_discovery::bcmp_resource_discovery_ge
     }
     return reply_rval;
 }
+
+/*!
+  Send this node's resource table to every node, so they see its subscriptions without
+  asking for them.
+
+  \return - true on success, false otherwise
+*/
+bool bcmp_resource_discovery::bcmp_resource_discovery_announce(void) {
+    bool rval = false;
+    size_t msg_len;
+    bcmp_resource_table_reply_t *repl = _bcmp_resource_alloc_local_reply(msg_len);
+    if(repl) {
+        rval = (bcmp_tx(&multicast_global_addr, BCMP_RESOURCE_TABLE_REPLY, reinterpret_cast<uint8_t *>(repl), msg_len) == ERR_OK);
+        vPortFree(repl);
+    }
+    return rval;
+}
+
+/*!
+  Find a node's entry in the remote subscriptions, remote lock must be held
+
+  \param in node_id - node ID
+  \param in create - use a free entry if the node doesn't have one
+  \return - pointer to the entry, NULL if not found or out of entries
+*/
+static bcmp_remote_subs_t *_bcmp_resource_find_remote(uint64_t node_id, bool create) {
+    bcmp_remote_subs_t *free_entry = NULL;
+    for(uint16_t i = 0; i < BCMP_RESOURCE_MAX_REMOTE_NODES; i++) {
+        if(_remote.nodes[i].node_id == node_id) {
+            return &_remote.nodes[i];
+        }
+        if(!free_entry && !_remote.nodes[i].node_id) {
+            free_entry = &_remote.nodes[i];
+        }
+    }
+    if(create && free_entry) {
+        memset(free_entry, 0, sizeof(bcmp_remote_subs_t));
+        free_entry->node_id = node_id;
+        return free_entry;
+    }
+    return NULL;
+}
+
+/*!
+  Keep the subscriptions from another node's resource table reply.
+
+  \param in *repl - reply
+  \return - None
+*/
+static void _bcmp_resource_record_remote_subs(bcmp_resource_table_reply_t *repl) {
+    if(!_remote.lock || repl->node_id == getNodeId()) {
+        return;
+    }
+    // Subscriptions come after the publishers
+    size_t offset = 0;
+    for(uint16_t i = 0; i < repl->num_pubs; i++) {
+        offset += sizeof(bcmp_resource_t) + reinterpret_cast<bcmp_resource_t *>(&repl->resource_list[offset])->resource_len;
+    }
+    size_t subs_offset = offset;
+    for(uint16_t i = 0; i < repl->num_subs; i++) {
+        offset += sizeof(bcmp_resource_t) + reinterpret_cast<bcmp_resource_t *>(&repl->resource_list[offset])->resource_len;
+    }
+    size_t subs_len = offset - subs_offset;
+
+    if(xSemaphoreTake(_remote.lock, pdMS_TO_TICKS(DEFAULT_RESOURCE_ADD_TIMEOUT_MS)) == pdPASS) {
+        bcmp_remote_subs_t *entry = _bcmp_resource_find_remote(repl->node_id, true);
+        if(entry) {
+            vPortFree(entry->subs);
+            entry->subs = NULL;
+            entry->num_subs = repl->num_subs;
+            if(subs_len) {
+                entry->subs = static_cast<uint8_t *>(pvPortMalloc(subs_len));
+                configASSERT(entry->subs);
+                memcpy(entry->subs, &repl->resource_list[subs_offset], subs_len);
+            }
+            if(entry->awaited) {
+                entry->awaited = false;
+                _remote.num_awaited--;
+                if(!_remote.num_awaited) {
+                    _remote.complete = true;
+                }
+            }
+        }
+        xSemaphoreGive(_remote.lock);
+    }
+}
+
+/*!
+  Start waiting for every node in the network to reply to a survey, then send it.
+
+  \param in *networkTopology - network topology, NULL if the topology couldn't be fetched
+  \return - None
+*/
+static void _bcmp_resource_survey_topo_cb(networkTopology_t *networkTopology) {
+    if(!networkTopology) {
+        return;
+    }
+    bool send = false;
+    if(xSemaphoreTake(_remote.lock, pdMS_TO_TICKS(DEFAULT_RESOURCE_ADD_TIMEOUT_MS)) == pdPASS) {
+        do {
+            bool fits = true;
+            _remote.num_awaited = 0;
+            // Forget nodes that left, wait for the rest to reply again
+            for(uint16_t i = 0; i < BCMP_RESOURCE_MAX_REMOTE_NODES; i++) {
+                _remote.nodes[i].awaited = false;
+            }
+            neighborTableEntry_t *cursor = networkTopology->front;
+            for(uint16_t counter = 0; cursor && (counter < networkTopology->length); cursor = cursor->nextNode, counter++) {
+                uint64_t node_id = cursor->neighbor_table_reply->node_id;
+                if(node_id == getNodeId()) {
+                    continue;
+                }
+                bcmp_remote_subs_t *entry = _bcmp_resource_find_remote(node_id, true);
+                if(!entry) {
+                    fits = false;
+                    break;
+                }
+                entry->awaited = true;
+                _remote.num_awaited++;
+            }
+            for(uint16_t i = 0; i < BCMP_RESOURCE_MAX_REMOTE_NODES; i++) {
+                if(_remote.nodes[i].node_id && !_remote.nodes[i].awaited) {
+                    vPortFree(_remote.nodes[i].subs);
+                    memset(&_remote.nodes[i], 0, sizeof(bcmp_remote_subs_t));
+                }
+            }
+            if(!fits) {
+                // Can't keep track of every node, so never complete
+                _remote.num_awaited = 0;
+                break;
+            }
+            if(!_remote.num_awaited) {
+                // Nobody else on the network
+                _remote.complete = true;
+                break;
+            }
+            send = true;
+        } while(0);
+        xSemaphoreGive(_remote.lock);
+    }
+
+    if(send) {
+        bcmp_resource_table_request_t req = {
+            .target_node_id = 0,
+        };
+        if(bcmp_tx(&multicast_global_addr, BCMP_RESOURCE_TABLE_REQUEST, reinterpret_cast<uint8_t *>(&req), sizeof(req)) != ERR_OK) {
+            printf("Failed to send bcmp resource table survey\n");
+        }
+    }
+}
+
+/*!
+  Check whether another node might subscribe to a topic. Only a recent survey that every
+  node replied to can rule that out, a new survey is started when there isn't one.
+
+  \param in *topic - topic
+  \param in topic_len - length of the topic
+  \return - false if no other node subscribes to the topic, true if one does or might
+*/
+bool bcmp_resource_discovery::bcmp_resource_discovery_remote_sub_possible(const char *topic, uint16_t topic_len) {
+    bool rval = true;
+    bool survey = false;
+    if(!_remote.lock || xSemaphoreTake(_remote.lock, pdMS_TO_TICKS(DEFAULT_RESOURCE_ADD_TIMEOUT_MS)) != pdPASS) {
+        return rval;
+    }
+    do {
+        TickType_t since_survey = xTaskGetTickCount() - _remote.survey_ticks;
+        if(!_remote.complete || since_survey >= pdMS_TO_TICKS(BCMP_RESOURCE_REMOTE_SUBS_TTL_MS)) {
+            if(!_remote.surveyed || since_survey >= pdMS_TO_TICKS(BCMP_RESOURCE_SURVEY_INTERVAL_MS)) {
+                _remote.surveyed = true;
+                _remote.complete = false;
+                _remote.survey_ticks = xTaskGetTickCount();
+                survey = true;
+            }
+            break;
+        }
+        rval = false;
+        for(uint16_t i = 0; i < BCMP_RESOURCE_MAX_REMOTE_NODES && !rval; i++) {
+            size_t offset = 0;
+            for(uint16_t sub = 0; sub < _remote.nodes[i].num_subs; sub++) {
+                const bcmp_resource_t *resource = reinterpret_cast<const bcmp_resource_t *>(&_remote.nodes[i].subs[offset]);
+                if(bm_sub_topic_matches(resource->resource, resource->resource_len, topic, topic_len)) {
+                    rval = true;
+                    break;
+                }
+                offset += sizeof(bcmp_resource_t) + resource->resource_len;
+            }
+        }
+    } while(0);
+    xSemaphoreGive(_remote.lock);
+
+    if(survey) {
+        bcmp_topology_start(_bcmp_resource_survey_topo_cb);
+    }
+    return rval;
+}
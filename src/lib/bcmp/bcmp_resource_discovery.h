@@ -21,5 +21,7 @@ bool bcmp_resource_discovery_find_resource(const char * res, const uint16_t reso
 bool bcmp_resource_discovery_send_request(uint64_t target_node_id, void (*cb)(void*) = NULL);
 void bcmp_resource_discovery_print_resources(void);
 bcmp_resource_table_reply_t* bcmp_resource_discovery_get_local_resources(void);
+bool bcmp_resource_discovery_announce(void);
+bool bcmp_resource_discovery_remote_sub_possible(const char *topic, uint16_t topic_len);
 
 }
@@ -11,6 +11,7 @@
 #include "bcmp_messages.h"
 #include "bcmp_neighbors.h"
 #include "bcmp_topology.h"
+#include "bcmp_topology_bfs.h"
 #include "bm_util.h"
 #include "device_info.h"
 #include "util.h"
@@ -18,7 +19,7 @@
 #define BCMP_TOPO_EVT_QUEUE_LEN 32
 // Timer to stop waiting for a nodes neighbor table
 #define BCMP_TOPO_TIMEOUT_S 1
-#define BCMP_TABLE_MAX_LEN 1024
+#define BCMP_TABLE_MAX_LEN BCMP_MAX_PAYLOAD_SIZE_BYTES
 
 typedef enum {
   BCMP_TOPO_EVT_START,
@@ -33,6 +34,7 @@ typedef struct {
   bcmp_topo_queue_type_e type;
   neighborTableEntry_t* neighborEntry;
   bcmp_topo_cb_t callback;
+  bcmp_topo_mode_e mode;
 } bcmp_topo_queue_item_t;
 
 typedef struct {
@@ -41,6 +43,9 @@ typedef struct {
   networkTopology_t* networkTopology;
   bool in_progress;
   bcmp_topo_cb_t callback;
+  bcmp_topo_mode_e mode;
+  // Only allocated while a breadth-first search is running
+  bcmp_topo_bfs_t* bfs;
 } bcmpTopoContext_t;
 
 static bcmpTopoContext_t _ctx;
@@ -72,6 +77,13 @@ static uint64_t networkTopologyCheckNeighborNodeIds(networkTopology_t *networkTo
 static bool networkTopologyCheckAllPortsExplored(networkTopology_t *networkTopology);
 
 // assembles the neighbor info list
+static err_t _send_neighbor_table_request(uint64_t target_node_id, const ip_addr_t *addr) {
+  bcmp_neighbor_table_request_t neighbor_table_req = {
+    .target_node_id=target_node_id
+  };
+  return bcmp_tx(addr, BCMP_NEIGHBOR_TABLE_REQUEST, (uint8_t *)&neighbor_table_req, sizeof(neighbor_table_req));
+}
+
 static void _assemble_neighbor_info_list(bcmp_neighbor_info_t *_neighbor_info_list, bm_neighbor_t *neighbor, uint8_t num_neighbors) {
   uint16_t _neighbor_count = 0;
   while(neighbor != NULL && _neighbor_count < num_neighbors) {
@@ -85,39 +97,52 @@ static void _assemble_neighbor_info_list(bcmp_neighbor_info_t *_neighbor_info_li
 }
 
 
-static void process_start_topology_event(void) {
-  // here we will need to kick off the topo process by looking at our own neighbors and then sending out a request
-  _ctx.networkTopology = newNetworkTopology();
-
+// assembles our own neighbor table, the root of the topology
+static bcmp_neighbor_table_reply_t *_new_local_neighbor_table(void) {
   static uint8_t num_ports = bm_l2_get_num_ports();
 
   // Check our neighbors
   uint8_t num_neighbors = 0;
   bm_neighbor_t *neighbor = bcmp_get_neighbors(num_neighbors);
 
-  // here we will assemble the entry for the SM
-  uint8_t *neighbor_entry_buff = static_cast<uint8_t *>(pvPortMalloc(sizeof(neighborTableEntry_t)));
-  configASSERT(neighbor_entry_buff);
-
-  memset(neighbor_entry_buff, 0, sizeof(neighborTableEntry_t));
-
-  neighborTableEntry_t *neighbor_entry = reinterpret_cast<neighborTableEntry_t *>(neighbor_entry_buff);
-
   uint32_t neighbor_table_len = sizeof(bcmp_neighbor_table_reply_t) + sizeof(bcmp_port_info_t) * num_ports + sizeof(bcmp_neighbor_info_t) * num_neighbors;
-  neighbor_entry->neighbor_table_reply = static_cast<bcmp_neighbor_table_reply_t *>(pvPortMalloc(neighbor_table_len));
+  bcmp_neighbor_table_reply_t *neighbor_table_reply = static_cast<bcmp_neighbor_table_reply_t *>(pvPortMalloc(neighbor_table_len));
+  configASSERT(neighbor_table_reply);
 
-  neighbor_entry->neighbor_table_reply->node_id = getNodeId();
+  neighbor_table_reply->node_id = getNodeId();
 
   // set the other vars
-  neighbor_entry->neighbor_table_reply->port_len = num_ports;
-  neighbor_entry->neighbor_table_reply->neighbor_len = num_neighbors;
+  neighbor_table_reply->port_len = num_ports;
+  neighbor_table_reply->neighbor_len = num_neighbors;
 
   // assemble the port list here
   for(uint8_t port = 0; port < num_ports; port++) {
-    neighbor_entry->neighbor_table_reply->port_list[port].state = bm_l2_get_port_state(port);
+    neighbor_table_reply->port_list[port].state = bm_l2_get_port_state(port);
   }
 
-  _assemble_neighbor_info_list(reinterpret_cast<bcmp_neighbor_info_t *>(&neighbor_entry->neighbor_table_reply->port_list[num_ports]), neighbor, num_neighbors);
+  _assemble_neighbor_info_list(reinterpret_cast<bcmp_neighbor_info_t *>(&neighbor_table_reply->port_list[num_ports]), neighbor, num_neighbors);
+
+  return neighbor_table_reply;
+}
+
+// wraps a neighbor table in a zeroed topology entry
+static neighborTableEntry_t *_new_neighbor_entry(bcmp_neighbor_table_reply_t *neighbor_table_reply) {
+  uint8_t *neighbor_entry_buff = static_cast<uint8_t *>(pvPortMalloc(sizeof(neighborTableEntry_t)));
+  configASSERT(neighbor_entry_buff);
+
+  memset(neighbor_entry_buff, 0, sizeof(neighborTableEntry_t));
+
+  neighborTableEntry_t *neighbor_entry = reinterpret_cast<neighborTableEntry_t *>(neighbor_entry_buff);
+  neighbor_entry->neighbor_table_reply = neighbor_table_reply;
+  return neighbor_entry;
+}
+
+static void process_start_topology_event(void) {
+  // here we will need to kick off the topo process by looking at our own neighbors and then sending out a request
+  _ctx.networkTopology = newNetworkTopology();
+
+  // here we will assemble the entry for the SM
+  neighborTableEntry_t *neighbor_entry = _new_neighbor_entry(_new_local_neighbor_table());
 
   // this is the root
   neighbor_entry->is_root = true;
@@ -125,15 +150,67 @@ static void process_start_topology_event(void) {
   networkTopologyAppend(_ctx.networkTopology, neighbor_entry);
   networkTopologyMoveFront(_ctx.networkTopology);
 
-  bcmp_topo_queue_item_t check_item = {BCMP_TOPO_EVT_CHECK_NODE, NULL, NULL};
+  bcmp_topo_queue_item_t check_item = {BCMP_TOPO_EVT_CHECK_NODE, NULL, NULL, BCMP_TOPO_MODE_DEPTH_FIRST};
   configASSERT(xQueueSend(_ctx.evt_queue, &check_item, 0) == pdTRUE);
 }
 
+// once the search is done its end event is already queued, late events are ignored
+static bool _bfs_running(void) {
+  return _ctx.bfs && !bcmp_topo_bfs_done(_ctx.bfs);
+}
+
+static bool _bfs_request_cb(uint64_t node_id, void *arg) {
+  (void) arg;
+  return _send_neighbor_table_request(node_id, &multicast_global_addr) == ERR_OK;
+}
+
+/*!
+  Arm the topology timer for the next breadth-first deadline, or end the
+  search once nothing is outstanding
+*/
+static void _bfs_update(void) {
+  uint32_t deadline_ms;
+  if (bcmp_topo_bfs_done(_ctx.bfs)) {
+    xTimerStop(_ctx.topo_timer, 10);
+    bcmp_topo_queue_item_t end_item = {BCMP_TOPO_EVT_END, NULL, NULL, BCMP_TOPO_MODE_BREADTH_FIRST};
+    configASSERT(xQueueSend(_ctx.evt_queue, &end_item, 0) == pdTRUE);
+  } else if (bcmp_topo_bfs_next_deadline(_ctx.bfs, &deadline_ms)) {
+    int32_t remaining_ms = static_cast<int32_t>(deadline_ms - pdTICKS_TO_MS(xTaskGetTickCount()));
+    TickType_t ticks = (remaining_ms > 0) ? pdMS_TO_TICKS(remaining_ms) + 1 : 1;
+    configASSERT(xTimerChangePeriod(_ctx.topo_timer, ticks, 10));
+  }
+}
+
+static void process_start_bfs_event(void) {
+  _ctx.bfs = static_cast<bcmp_topo_bfs_t *>(pvPortMalloc(sizeof(bcmp_topo_bfs_t)));
+  configASSERT(_ctx.bfs);
+  bcmp_topo_bfs_init(_ctx.bfs, _bfs_request_cb, NULL);
+  bcmp_topo_bfs_start(_ctx.bfs, _new_local_neighbor_table(), pdTICKS_TO_MS(xTaskGetTickCount()));
+  _bfs_update();
+}
+
+// link the breadth-first results into the same list the depth-first search builds
+static void process_end_bfs_event(void) {
+  bcmp_neighbor_table_reply_t *chain[BCMP_TOPO_BFS_MAX_NODES];
+  uint8_t chain_len = bcmp_topo_bfs_take_chain(_ctx.bfs, chain, BCMP_TOPO_BFS_MAX_NODES);
+
+  _ctx.networkTopology = newNetworkTopology();
+  for (uint8_t idx = 0; idx < chain_len; idx++) {
+    neighborTableEntry_t *neighbor_entry = _new_neighbor_entry(chain[idx]);
+    neighbor_entry->is_root = (chain[idx]->node_id == getNodeId());
+    networkTopologyAppend(_ctx.networkTopology, neighbor_entry);
+  }
+  networkTopologyMoveFront(_ctx.networkTopology);
+
+  bcmp_topo_bfs_deinit(_ctx.bfs);
+  vPortFree(_ctx.bfs);
+  _ctx.bfs = NULL;
+}
 
 static void process_check_node_event(void) {
   if (networkTopologyCheckAllPortsExplored(_ctx.networkTopology)) {
     if (networkTopologyIsRoot(_ctx.networkTopology)) {
-      bcmp_topo_queue_item_t end_item = {BCMP_TOPO_EVT_END, NULL, NULL};
+      bcmp_topo_queue_item_t end_item = {BCMP_TOPO_EVT_END, NULL, NULL, BCMP_TOPO_MODE_DEPTH_FIRST};
       configASSERT(xQueueSend(_ctx.evt_queue, &end_item, 0) == pdTRUE);
     } else {
       if(_insert_before) {
@@ -141,7 +218,7 @@ static void process_check_node_event(void) {
       } else {
         networkTopologyMovePrev(_ctx.networkTopology);
       }
-      bcmp_topo_queue_item_t check_item = {BCMP_TOPO_EVT_CHECK_NODE, NULL, NULL};
+      bcmp_topo_queue_item_t check_item = {BCMP_TOPO_EVT_CHECK_NODE, NULL, NULL, BCMP_TOPO_MODE_DEPTH_FIRST};
       configASSERT(xQueueSend(_ctx.evt_queue, &check_item, 0) == pdTRUE);
     }
   } else {
@@ -158,7 +235,7 @@ static void process_check_node_event(void) {
       } else {
         networkTopologyMovePrev(_ctx.networkTopology);
       }
-      bcmp_topo_queue_item_t check_item = {BCMP_TOPO_EVT_CHECK_NODE, NULL, NULL};
+      bcmp_topo_queue_item_t check_item = {BCMP_TOPO_EVT_CHECK_NODE, NULL, NULL, BCMP_TOPO_MODE_DEPTH_FIRST};
       configASSERT(xQueueSend(_ctx.evt_queue, &check_item, 0) == pdTRUE);
     }
   }
@@ -172,12 +249,10 @@ static void process_check_node_event(void) {
   \ret ERR_OK if successful
 */
 err_t bcmp_request_neighbor_table(uint64_t target_node_id, const ip_addr_t *addr) {
-  bcmp_neighbor_table_request_t neighbor_table_req = {
-    .target_node_id=target_node_id
-  };
   _target_node_id = target_node_id;
-  configASSERT(xTimerStart(_ctx.topo_timer, 10));
-  return bcmp_tx(addr, BCMP_NEIGHBOR_TABLE_REQUEST, (uint8_t *)&neighbor_table_req, sizeof(neighbor_table_req));
+  // Breadth-first searches change the timer period, so always set it
+  configASSERT(xTimerChangePeriod(_ctx.topo_timer, pdMS_TO_TICKS(BCMP_TOPO_TIMEOUT_S * 1000), 10));
+  return _send_neighbor_table_request(target_node_id, addr);
 }
 
 /*!
@@ -258,9 +333,13 @@ err_t bcmp_process_neighbor_table_request(bcmp_neighbor_table_request_t *neighbo
 */
 err_t bcmp_process_neighbor_table_reply(bcmp_neighbor_table_reply_t *neighbor_table_reply) {
   configASSERT(neighbor_table_reply);
-  if (_target_node_id == neighbor_table_reply->node_id && _sent_request) {
+  // Breadth-first searches have many requests in flight and sort out the replies themselves
+  bool breadth_first = (_ctx.mode == BCMP_TOPO_MODE_BREADTH_FIRST);
+  if (_sent_request && (breadth_first || _target_node_id == neighbor_table_reply->node_id)) {
 
-    configASSERT(xTimerStop(_ctx.topo_timer, 10));
+    if (!breadth_first) {
+      configASSERT(xTimerStop(_ctx.topo_timer, 10));
+    }
     // here we will assemble the entry for the SM
     // malloc the buffer then memcpy it over
     uint8_t *neighbor_entry_buff = static_cast<uint8_t *>(pvPortMalloc(sizeof(neighborTableEntry_t)));
@@ -279,10 +358,19 @@ err_t bcmp_process_neighbor_table_reply(bcmp_neighbor_table_reply_t *neighbor_ta
     bcmp_topo_queue_item_t item = {
       .type = BCMP_TOPO_EVT_ADD_NODE,
       .neighborEntry = neighbor_entry,
-      .callback = NULL
+      .callback = NULL,
+      .mode = _ctx.mode
     };
 
-    configASSERT(xQueueSend(_ctx.evt_queue, &item, 0) == pdTRUE);
+    if (breadth_first) {
+      // Several replies can arrive at once, a dropped one is retried by the search
+      if (xQueueSend(_ctx.evt_queue, &item, 0) != pdTRUE) {
+        printf("BCMP topology - dropped neighbor table from %016" PRIx64 "\n", neighbor_table_reply->node_id);
+        freeNeighborTableEntry(&neighbor_entry);
+      }
+    } else {
+      configASSERT(xQueueSend(_ctx.evt_queue, &item, 0) == pdTRUE);
+    }
   }
 
   return ERR_OK;
@@ -299,7 +387,7 @@ err_t bcmp_process_neighbor_table_reply(bcmp_neighbor_table_reply_t *neighbor_ta
 static void topology_timer_handler(TimerHandle_t tmr){
   (void) tmr;
 
-  bcmp_topo_queue_item_t item = {BCMP_TOPO_EVT_TIMEOUT, NULL, NULL};
+  bcmp_topo_queue_item_t item = {BCMP_TOPO_EVT_TIMEOUT, NULL, NULL, _ctx.mode};
 
   configASSERT(xQueueSend(_ctx.evt_queue, &item, 0) == pdTRUE);
 }
@@ -331,7 +419,12 @@ static void bcmp_topology_thread(void *parameters) {
           _ctx.in_progress = true;
           _sent_request = true;
           _ctx.callback = item.callback;
-          process_start_topology_event();
+          _ctx.mode = item.mode;
+          if (_ctx.mode == BCMP_TOPO_MODE_BREADTH_FIRST) {
+            process_start_bfs_event();
+          } else {
+            process_start_topology_event();
+          }
         } else {
           item.callback(NULL);
         }
@@ -339,6 +432,17 @@ static void bcmp_topology_thread(void *parameters) {
       }
 
       case BCMP_TOPO_EVT_ADD_NODE: {
+        if (item.mode == BCMP_TOPO_MODE_BREADTH_FIRST) {
+          if (_bfs_running() && item.neighborEntry &&
+              bcmp_topo_bfs_add_reply(_ctx.bfs, item.neighborEntry->neighbor_table_reply, pdTICKS_TO_MS(xTaskGetTickCount()))) {
+            // The search owns the table now, only the entry is ours
+            vPortFree(item.neighborEntry);
+            _bfs_update();
+          } else {
+            freeNeighborTableEntry(&item.neighborEntry);
+          }
+          break;
+        }
         if (item.neighborEntry) {
           if(!networkTopologyNodeIdInTopology(_ctx.networkTopology, item.neighborEntry->neighbor_table_reply->node_id)){
             if (_insert_before) {
@@ -351,7 +455,7 @@ static void bcmp_topology_thread(void *parameters) {
             networkTopologyIncrementPortCount(_ctx.networkTopology); // we have come from one of the ports so it must have been checked
           }
         }
-        bcmp_topo_queue_item_t check_item = {BCMP_TOPO_EVT_CHECK_NODE, NULL, NULL};
+        bcmp_topo_queue_item_t check_item = {BCMP_TOPO_EVT_CHECK_NODE, NULL, NULL, BCMP_TOPO_MODE_DEPTH_FIRST};
         configASSERT(xQueueSend(_ctx.evt_queue, &check_item, 0) == pdTRUE);
         break;
       }
@@ -362,6 +466,9 @@ static void bcmp_topology_thread(void *parameters) {
       }
 
       case BCMP_TOPO_EVT_END: {
+        if (_ctx.bfs) {
+          process_end_bfs_event();
+        }
         if (_ctx.callback) {
           _ctx.callback(_ctx.networkTopology);
         }
@@ -374,12 +481,19 @@ static void bcmp_topology_thread(void *parameters) {
       }
 
       case BCMP_TOPO_EVT_TIMEOUT: {
+        if (item.mode == BCMP_TOPO_MODE_BREADTH_FIRST) {
+          if (_bfs_running()) {
+            bcmp_topo_bfs_check_timeouts(_ctx.bfs, pdTICKS_TO_MS(xTaskGetTickCount()));
+            _bfs_update();
+          }
+          break;
+        }
         if(_insert_before) {
           networkTopologyMoveNext(_ctx.networkTopology);
         } else {
           networkTopologyMovePrev(_ctx.networkTopology);
         }
-        bcmp_topo_queue_item_t check_item = {BCMP_TOPO_EVT_CHECK_NODE, NULL, NULL};
+        bcmp_topo_queue_item_t check_item = {BCMP_TOPO_EVT_CHECK_NODE, NULL, NULL, BCMP_TOPO_MODE_DEPTH_FIRST};
         configASSERT(xQueueSend(_ctx.evt_queue, &check_item, 0) == pdTRUE);
         break;
       }
@@ -391,7 +505,7 @@ static void bcmp_topology_thread(void *parameters) {
   }
 }
 
-void bcmp_topology_start(bcmp_topo_cb_t callback) {
+void bcmp_topology_start(bcmp_topo_cb_t callback, bcmp_topo_mode_e mode) {
 
   // create the task if it is not already created
   if (!bcmpTopologyTask) {
@@ -408,7 +522,7 @@ void bcmp_topology_start(bcmp_topo_cb_t callback) {
   }
 
   // send the first request out
-  bcmp_topo_queue_item_t item = {BCMP_TOPO_EVT_START, NULL, callback};
+  bcmp_topo_queue_item_t item = {BCMP_TOPO_EVT_START, NULL, callback, mode};
   configASSERT(xQueueSend(_ctx.evt_queue, &item, 0) == pdTRUE);
 }
 
@@ -33,6 +33,13 @@ typedef enum {
   TOPO_EMPTY,
 } networkTopology_status_t;
 
+typedef enum {
+  // Request one node's neighbor table at a time, following each port to the end of the string
+  BCMP_TOPO_MODE_DEPTH_FIRST = 0,
+  // Request every newly discovered node's neighbor table at once (see bcmp_topology_bfs.h)
+  BCMP_TOPO_MODE_BREADTH_FIRST,
+} bcmp_topo_mode_e;
+
 typedef void (*bcmp_topo_cb_t)(networkTopology_t* networkTopology);
 
 void networkTopologyPrint(networkTopology_t* networkTopology);
@@ -44,4 +51,4 @@ err_t bcmp_process_neighbor_table_request(bcmp_neighbor_table_request_t *neighbo
 err_t bcmp_process_neighbor_table_reply(bcmp_neighbor_table_reply_t *neighbor_table_reply);
 
 // Topology task defines
-void bcmp_topology_start(const bcmp_topo_cb_t callback);
+void bcmp_topology_start(const bcmp_topo_cb_t callback, bcmp_topo_mode_e mode = BCMP_TOPO_MODE_DEPTH_FIRST);
@@ -0,0 +1,326 @@
+#include <string.h>
+#include "FreeRTOS.h"
+#include "bcmp_topology_bfs.h"
+
+typedef struct {
+  uint8_t node_idx;
+  uint16_t next_neighbor;
+} bcmp_topo_bfs_walk_t;
+
+static bcmp_neighbor_info_t *neighbor_list(const bcmp_neighbor_table_reply_t *neighbor_table_reply) {
+  return reinterpret_cast<bcmp_neighbor_info_t *>(const_cast<bcmp_port_info_t *>(&neighbor_table_reply->port_list[neighbor_table_reply->port_len]));
+}
+
+static int16_t find_node(const bcmp_topo_bfs_t *bfs, uint64_t node_id) {
+  for(uint8_t idx = 0; idx < bfs->num_nodes; idx++) {
+    if(bfs->nodes[idx].node_id == node_id) {
+      return idx;
+    }
+  }
+  return -1;
+}
+
+static bool is_received(const bcmp_topo_bfs_t *bfs, int16_t idx) {
+  return (idx >= 0) && (bfs->nodes[idx].state == BCMP_TOPO_BFS_NODE_RECEIVED) && bfs->nodes[idx].neighbor_table_reply;
+}
+
+static uint32_t node_timeout_ms(const bcmp_topo_bfs_t *bfs, const bcmp_topo_bfs_node_t *node) {
+  uint32_t timeout_ms = BCMP_TOPO_BFS_MAX_TIMEOUT_MS;
+  if(bfs->have_rtt) {
+    uint64_t timeout_us = static_cast<uint64_t>(node->hops) * (bfs->srtt_per_hop_us + 4 * bfs->rttvar_per_hop_us);
+    timeout_ms = static_cast<uint32_t>((timeout_us + 999) / 1000);
+  }
+  // Back off on every retry
+  timeout_ms <<= (node->attempts - 1);
+  if(timeout_ms < BCMP_TOPO_BFS_MIN_TIMEOUT_MS) {
+    timeout_ms = BCMP_TOPO_BFS_MIN_TIMEOUT_MS;
+  } else if(timeout_ms > BCMP_TOPO_BFS_MAX_TIMEOUT_MS) {
+    timeout_ms = BCMP_TOPO_BFS_MAX_TIMEOUT_MS;
+  }
+  return timeout_ms;
+}
+
+static void request_node(bcmp_topo_bfs_t *bfs, bcmp_topo_bfs_node_t *node, uint32_t now_ms) {
+  node->attempts++;
+  node->sent_ms = now_ms;
+  node->deadline_ms = now_ms + node_timeout_ms(bfs, node);
+  // A failed send is handled like a lost reply
+  bfs->request_cb(node->node_id, bfs->request_arg);
+}
+
+/*!
+  Update the per hop round trip time estimate (RFC 6298 style smoothing)
+  \param[in,out] *bfs - search
+  \param[in] *node - node whose first request was just answered
+  \param[in] now_ms - current time
+  \return None
+*/
+static void update_rtt(bcmp_topo_bfs_t *bfs, const bcmp_topo_bfs_node_t *node, uint32_t now_ms) {
+  uint32_t sample_us = (now_ms - node->sent_ms) * 1000 / (node->hops ? node->hops : 1);
+  if(!bfs->have_rtt) {
+    bfs->srtt_per_hop_us = sample_us;
+    bfs->rttvar_per_hop_us = sample_us / 2;
+    bfs->have_rtt = true;
+  } else {
+    uint32_t err_us = (sample_us > bfs->srtt_per_hop_us) ? sample_us - bfs->srtt_per_hop_us : bfs->srtt_per_hop_us - sample_us;
+    bfs->rttvar_per_hop_us = (3 * bfs->rttvar_per_hop_us + err_us) / 4;
+    bfs->srtt_per_hop_us = (7 * bfs->srtt_per_hop_us + sample_us) / 8;
+  }
+}
+
+/*!
+  Request every neighbor of a node we haven't seen yet
+  \param[in,out] *bfs - search
+  \param[in] idx - node with a received neighbor table
+  \param[in] now_ms - current time
+  \return None
+*/
+static void expand_node(bcmp_topo_bfs_t *bfs, uint8_t idx, uint32_t now_ms) {
+  const bcmp_neighbor_table_reply_t *neighbor_table_reply = bfs->nodes[idx].neighbor_table_reply;
+  const bcmp_neighbor_info_t *neighbor_info = neighbor_list(neighbor_table_reply);
+
+  for(uint16_t neighbor = 0; neighbor < neighbor_table_reply->neighbor_len; neighbor++) {
+    uint8_t port = neighbor_info[neighbor].port;
+    // Ports are numbered from 1, and only neighbors on ports that are up can answer
+    if(!port || (port > neighbor_table_reply->port_len) || !neighbor_table_reply->port_list[port - 1].state) {
+      continue;
+    }
+    if((find_node(bfs, neighbor_info[neighbor].node_id) >= 0) || (bfs->num_nodes == BCMP_TOPO_BFS_MAX_NODES)) {
+      continue;
+    }
+
+    bcmp_topo_bfs_node_t *node = &bfs->nodes[bfs->num_nodes++];
+    memset(node, 0, sizeof(bcmp_topo_bfs_node_t));
+    node->node_id = neighbor_info[neighbor].node_id;
+    node->hops = bfs->nodes[idx].hops + 1;
+    node->state = BCMP_TOPO_BFS_NODE_REQUESTED;
+    bfs->num_outstanding++;
+    request_node(bfs, node, now_ms);
+  }
+}
+
+/*!
+  Preorder walk of the received nodes reachable from start, in neighbor table order
+  \param[in] *bfs - search
+  \param[in] start - first node of the walk
+  \param[in,out] *visited - nodes already placed in the chain
+  \param[out] *order - node indices in walk order
+  \return number of nodes added to order
+*/
+static uint8_t walk_branch(const bcmp_topo_bfs_t *bfs, uint8_t start, bool *visited, uint8_t *order) {
+  bcmp_topo_bfs_walk_t stack[BCMP_TOPO_BFS_MAX_NODES];
+  uint8_t depth = 0;
+  uint8_t len = 0;
+
+  visited[start] = true;
+  order[len++] = start;
+  stack[depth++] = {start, 0};
+
+  while(depth) {
+    bcmp_topo_bfs_walk_t *top = &stack[depth - 1];
+    const bcmp_neighbor_table_reply_t *neighbor_table_reply = bfs->nodes[top->node_idx].neighbor_table_reply;
+    if(top->next_neighbor >= neighbor_table_reply->neighbor_len) {
+      depth--;
+      continue;
+    }
+    int16_t idx = find_node(bfs, neighbor_list(neighbor_table_reply)[top->next_neighbor++].node_id);
+    if(is_received(bfs, idx) && !visited[idx]) {
+      visited[idx] = true;
+      order[len++] = static_cast<uint8_t>(idx);
+      stack[depth++] = {static_cast<uint8_t>(idx), 0};
+    }
+  }
+
+  return len;
+}
+
+/*!
+  Clear a search
+  \param[out] *bfs - search
+  \param[in] request_cb - sends neighbor table requests
+  \param[in] *request_arg - passed to request_cb
+  \return None
+*/
+void bcmp_topo_bfs_init(bcmp_topo_bfs_t *bfs, bcmp_topo_bfs_request_cb_t request_cb, void *request_arg) {
+  configASSERT(bfs);
+  configASSERT(request_cb);
+  memset(bfs, 0, sizeof(bcmp_topo_bfs_t));
+  bfs->request_cb = request_cb;
+  bfs->request_arg = request_arg;
+}
+
+/*!
+  Start a search from our own neighbor table, requesting all of our neighbors
+  \param[in,out] *bfs - search
+  \param[in] *root_table - our neighbor table, the search takes ownership of it
+  \param[in] now_ms - current time
+  \return None
+*/
+void bcmp_topo_bfs_start(bcmp_topo_bfs_t *bfs, bcmp_neighbor_table_reply_t *root_table, uint32_t now_ms) {
+  configASSERT(bfs);
+  configASSERT(root_table);
+  configASSERT(bfs->num_nodes == 0);
+
+  bcmp_topo_bfs_node_t *root = &bfs->nodes[bfs->num_nodes++];
+  root->node_id = root_table->node_id;
+  root->neighbor_table_reply = root_table;
+  root->state = BCMP_TOPO_BFS_NODE_RECEIVED;
+  expand_node(bfs, 0, now_ms);
+}
+
+/*!
+  Add a received neighbor table and request the new neighbors it lists
+  \param[in,out] *bfs - search
+  \param[in] *neighbor_table_reply - received table, the search takes ownership of it if it is used
+  \param[in] now_ms - current time
+  \return false if the table was not requested or is a duplicate, the caller still owns it
+*/
+bool bcmp_topo_bfs_add_reply(bcmp_topo_bfs_t *bfs, bcmp_neighbor_table_reply_t *neighbor_table_reply, uint32_t now_ms) {
+  configASSERT(bfs);
+  configASSERT(neighbor_table_reply);
+
+  int16_t idx = find_node(bfs, neighbor_table_reply->node_id);
+  if((idx < 0) || (bfs->nodes[idx].state == BCMP_TOPO_BFS_NODE_RECEIVED)) {
+    return false;
+  }
+
+  bcmp_topo_bfs_node_t *node = &bfs->nodes[idx];
+  if(node->state == BCMP_TOPO_BFS_NODE_REQUESTED) {
+    bfs->num_outstanding--;
+    // A retried request's reply can't be matched to one send time, so don't sample it
+    if(node->attempts == 1) {
+      update_rtt(bfs, node, now_ms);
+    }
+  }
+  // Late replies from nodes we gave up on are still used
+  node->neighbor_table_reply = neighbor_table_reply;
+  node->state = BCMP_TOPO_BFS_NODE_RECEIVED;
+  expand_node(bfs, static_cast<uint8_t>(idx), now_ms);
+
+  return true;
+}
+
+/*!
+  Retry or give up on requests whose deadline has passed
+  \param[in,out] *bfs - search
+  \param[in] now_ms - current time
+  \return None
+*/
+void bcmp_topo_bfs_check_timeouts(bcmp_topo_bfs_t *bfs, uint32_t now_ms) {
+  configASSERT(bfs);
+  for(uint8_t idx = 0; idx < bfs->num_nodes; idx++) {
+    bcmp_topo_bfs_node_t *node = &bfs->nodes[idx];
+    if((node->state != BCMP_TOPO_BFS_NODE_REQUESTED) || (static_cast<int32_t>(now_ms - node->deadline_ms) < 0)) {
+      continue;
+    }
+    if(node->attempts < BCMP_TOPO_BFS_MAX_ATTEMPTS) {
+      request_node(bfs, node, now_ms);
+    } else {
+      node->state = BCMP_TOPO_BFS_NODE_FAILED;
+      bfs->num_outstanding--;
+    }
+  }
+}
+
+/*!
+  Get the earliest deadline of all outstanding requests
+  \param[in] *bfs - search
+  \param[out] *deadline_ms - earliest deadline
+  \return false if there are no outstanding requests
+*/
+bool bcmp_topo_bfs_next_deadline(const bcmp_topo_bfs_t *bfs, uint32_t *deadline_ms) {
+  configASSERT(bfs);
+  configASSERT(deadline_ms);
+  bool found = false;
+  for(uint8_t idx = 0; idx < bfs->num_nodes; idx++) {
+    const bcmp_topo_bfs_node_t *node = &bfs->nodes[idx];
+    if((node->state == BCMP_TOPO_BFS_NODE_REQUESTED) &&
+       (!found || static_cast<int32_t>(node->deadline_ms - *deadline_ms) < 0)) {
+      *deadline_ms = node->deadline_ms;
+      found = true;
+    }
+  }
+  return found;
+}
+
+/*!
+  Check if the search is over
+  \param[in] *bfs - search
+  \return true once every request has been answered or given up on
+*/
+bool bcmp_topo_bfs_done(const bcmp_topo_bfs_t *bfs) {
+  configASSERT(bfs);
+  return bfs->num_nodes && !bfs->num_outstanding;
+}
+
+/*!
+  Order the received neighbor tables the same way the depth-first search links
+  them: the root's first branch follows the root, every other branch is placed
+  in front of it, nearest node first.
+  \param[in,out] *bfs - search
+  \param[out] **chain - neighbor tables in order, the caller takes ownership of them
+  \param[in] max_len - size of chain
+  \return number of tables in chain
+*/
+uint8_t bcmp_topo_bfs_take_chain(bcmp_topo_bfs_t *bfs, bcmp_neighbor_table_reply_t **chain, uint8_t max_len) {
+  configASSERT(bfs);
+  configASSERT(chain);
+  if(!bfs->num_nodes || !bfs->nodes[0].neighbor_table_reply) {
+    return 0;
+  }
+
+  bool visited[BCMP_TOPO_BFS_MAX_NODES] = {};
+  uint8_t before[BCMP_TOPO_BFS_MAX_NODES];
+  uint8_t after[BCMP_TOPO_BFS_MAX_NODES];
+  uint8_t before_len = 0;
+  uint8_t after_len = 0;
+  bool first_branch = true;
+
+  visited[0] = true;
+  const bcmp_neighbor_table_reply_t *root_table = bfs->nodes[0].neighbor_table_reply;
+  for(uint16_t neighbor = 0; neighbor < root_table->neighbor_len; neighbor++) {
+    int16_t idx = find_node(bfs, neighbor_list(root_table)[neighbor].node_id);
+    if(!is_received(bfs, idx) || visited[idx]) {
+      continue;
+    }
+    if(first_branch) {
+      after_len += walk_branch(bfs, static_cast<uint8_t>(idx), visited, &after[after_len]);
+      first_branch = false;
+    } else {
+      before_len += walk_branch(bfs, static_cast<uint8_t>(idx), visited, &before[before_len]);
+    }
+  }
+
+  uint8_t len = 0;
+  for(uint8_t pos = before_len; pos > 0 && len < max_len; pos--) {
+    chain[len++] = bfs->nodes[before[pos - 1]].neighbor_table_reply;
+    bfs->nodes[before[pos - 1]].neighbor_table_reply = NULL;
+  }
+  if(len < max_len) {
+    chain[len++] = bfs->nodes[0].neighbor_table_reply;
+    bfs->nodes[0].neighbor_table_reply = NULL;
+  }
+  for(uint8_t pos = 0; pos < after_len && len < max_len; pos++) {
+    chain[len++] = bfs->nodes[after[pos]].neighbor_table_reply;
+    bfs->nodes[after[pos]].neighbor_table_reply = NULL;
+  }
+
+  return len;
+}
+
+/*!
+  Free every neighbor table the search still owns
+  \param[in,out] *bfs - search
+  \return None
+*/
+void bcmp_topo_bfs_deinit(bcmp_topo_bfs_t *bfs) {
+  configASSERT(bfs);
+  for(uint8_t idx = 0; idx < bfs->num_nodes; idx++) {
+    if(bfs->nodes[idx].neighbor_table_reply) {
+      vPortFree(bfs->nodes[idx].neighbor_table_reply);
+      bfs->nodes[idx].neighbor_table_reply = NULL;
+    }
+  }
+  bfs->num_nodes = 0;
+  bfs->num_outstanding = 0;
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "bcmp_messages.h"
+
+#define BCMP_TOPO_BFS_MAX_NODES (64)
+// Requests per node, including the first one, before the node is skipped
+#define BCMP_TOPO_BFS_MAX_ATTEMPTS (2)
+#define BCMP_TOPO_BFS_MIN_TIMEOUT_MS (20)
+// Also used until the first reply gives us a round trip time estimate
+#define BCMP_TOPO_BFS_MAX_TIMEOUT_MS (1000)
+
+typedef enum {
+  BCMP_TOPO_BFS_NODE_REQUESTED,
+  BCMP_TOPO_BFS_NODE_RECEIVED,
+  BCMP_TOPO_BFS_NODE_FAILED,
+} bcmp_topo_bfs_node_state_e;
+
+typedef struct {
+  uint64_t node_id;
+  // Owned by the search until taken with bcmp_topo_bfs_take_chain()
+  bcmp_neighbor_table_reply_t *neighbor_table_reply;
+  uint32_t sent_ms;
+  uint32_t deadline_ms;
+  // Distance from the root, replies take longer the further away a node is
+  uint8_t hops;
+  uint8_t attempts;
+  bcmp_topo_bfs_node_state_e state;
+} bcmp_topo_bfs_node_t;
+
+// Sends a neighbor table request to node_id
+typedef bool (*bcmp_topo_bfs_request_cb_t)(uint64_t node_id, void *arg);
+
+/*
+  Breadth-first topology search. Every newly discovered node is requested as
+  soon as the reply that names it arrives, so all nodes on the frontier have a
+  request in flight at the same time. Per node timeouts come from a smoothed
+  per hop round trip time, scaled by the node's distance from the root.
+*/
+typedef struct {
+  bcmp_topo_bfs_node_t nodes[BCMP_TOPO_BFS_MAX_NODES];
+  uint8_t num_nodes;
+  uint8_t num_outstanding;
+  bool have_rtt;
+  uint32_t srtt_per_hop_us;
+  uint32_t rttvar_per_hop_us;
+  bcmp_topo_bfs_request_cb_t request_cb;
+  void *request_arg;
+} bcmp_topo_bfs_t;
+
+void bcmp_topo_bfs_init(bcmp_topo_bfs_t *bfs, bcmp_topo_bfs_request_cb_t request_cb, void *request_arg);
+void bcmp_topo_bfs_start(bcmp_topo_bfs_t *bfs, bcmp_neighbor_table_reply_t *root_table, uint32_t now_ms);
+bool bcmp_topo_bfs_add_reply(bcmp_topo_bfs_t *bfs, bcmp_neighbor_table_reply_t *neighbor_table_reply, uint32_t now_ms);
+void bcmp_topo_bfs_check_timeouts(bcmp_topo_bfs_t *bfs, uint32_t now_ms);
+bool bcmp_topo_bfs_next_deadline(const bcmp_topo_bfs_t *bfs, uint32_t *deadline_ms);
+bool bcmp_topo_bfs_done(const bcmp_topo_bfs_t *bfs);
+uint8_t bcmp_topo_bfs_take_chain(bcmp_topo_bfs_t *bfs, bcmp_neighbor_table_reply_t **chain, uint8_t max_len);
+void bcmp_topo_bfs_deinit(bcmp_topo_bfs_t *bfs);
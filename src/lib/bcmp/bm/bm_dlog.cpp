@@ -0,0 +1,224 @@
+#include <string.h>
+#include "FreeRTOS.h"
+#include "bm_dlog.h"
+
+typedef struct {
+  uint8_t *buf;
+  size_t len;
+  size_t pos;
+} dlog_writer_t;
+
+typedef enum {
+  LEN_NONE,
+  LEN_LONG_LONG,
+  LEN_LONG,
+  LEN_SIZE,
+  LEN_LONG_DOUBLE,
+} dlog_arg_len_e;
+
+static bool _enabled = BM_DLOG_ENABLE_DEFAULT;
+static uint32_t _build_id;
+
+static bool put(dlog_writer_t *writer, const void *data, size_t len) {
+  if (writer->len - writer->pos < len) {
+    return false;
+  }
+  memcpy(&writer->buf[writer->pos], data, len);
+  writer->pos += len;
+  return true;
+}
+
+// The target is 32 bit little endian, wider host types are cut down to match it
+static bool put_u32(dlog_writer_t *writer, uint32_t value) {
+  return put(writer, &value, sizeof(value));
+}
+
+static bool put_u64(dlog_writer_t *writer, uint64_t value) {
+  return put(writer, &value, sizeof(value));
+}
+
+/*!
+  Copy a string argument, truncating it to what is left of the record
+  \param[in,out] *writer - record being built
+  \param[in] *str - string argument
+  \return true if at least the length byte fit, false otherwise
+*/
+static bool put_str(dlog_writer_t *writer, const char *str) {
+  if (!str) {
+    // Same as newlib prints
+    str = "(null)";
+  }
+  if (writer->pos >= writer->len) {
+    return false;
+  }
+  size_t room = writer->len - writer->pos - 1;
+  if (room > BM_DLOG_MAX_STR_LEN) {
+    room = BM_DLOG_MAX_STR_LEN;
+  }
+  uint8_t str_len = static_cast<uint8_t>(strnlen(str, room));
+  writer->buf[writer->pos++] = str_len;
+  return put(writer, str, str_len);
+}
+
+/*!
+  Pull the argument of one conversion off the argument list
+  \param[in,out] *writer - record being built
+  \param[in] conversion - conversion specifier character
+  \param[in] arg_len - length modifier
+  \param[in,out] *va - argument list
+  \return true if the argument was added, false if it didn't fit or can't be deferred
+*/
+static bool put_arg(dlog_writer_t *writer, char conversion, dlog_arg_len_e arg_len, va_list *va) {
+  switch (conversion) {
+    case 'd':
+    case 'i':
+    case 'u':
+    case 'o':
+    case 'x':
+    case 'X': {
+      switch (arg_len) {
+        case LEN_LONG_LONG:
+          return put_u64(writer, va_arg(*va, unsigned long long));
+        case LEN_LONG:
+          return put_u32(writer, static_cast<uint32_t>(va_arg(*va, unsigned long)));
+        case LEN_SIZE:
+          return put_u32(writer, static_cast<uint32_t>(va_arg(*va, size_t)));
+        default:
+          return put_u32(writer, va_arg(*va, unsigned int));
+      }
+    }
+
+    case 'c': {
+      return put_u32(writer, va_arg(*va, unsigned int));
+    }
+
+    case 'p': {
+      return put_u32(writer, static_cast<uint32_t>(reinterpret_cast<uintptr_t>(va_arg(*va, void *))));
+    }
+
+    case 'a':
+    case 'A':
+    case 'e':
+    case 'E':
+    case 'f':
+    case 'F':
+    case 'g':
+    case 'G': {
+      double value = (arg_len == LEN_LONG_DOUBLE) ? static_cast<double>(va_arg(*va, long double))
+                                                  : va_arg(*va, double);
+      return put(writer, &value, sizeof(value));
+    }
+
+    case 's': {
+      return put_str(writer, va_arg(*va, const char *));
+    }
+
+    default: {
+      // %n and anything newlib doesn't know has to be formatted here
+      return false;
+    }
+  }
+}
+
+/*!
+  Encode a log line as a deferred record instead of formatting it
+  \param[out] *buf - record buffer
+  \param[in] len - buffer length
+  \param[in] *format - printf format string, must live in flash for the whole run
+  \param[in] va - format arguments, left untouched so the caller can still format them
+  \return encoded record length, 0 if the line can't be deferred and has to be formatted
+*/
+size_t bm_dlog_encode(uint8_t *buf, size_t len, const char *format, va_list va) {
+  configASSERT(buf);
+  configASSERT(format);
+
+  dlog_writer_t writer = {buf, len, 0};
+  if (!put_u32(&writer, _build_id) ||
+      !put_u32(&writer, static_cast<uint32_t>(reinterpret_cast<uintptr_t>(format)))) {
+    return 0;
+  }
+
+  va_list args;
+  va_copy(args, va);
+  bool ok = true;
+  const char *fmt = format;
+  while (ok && *fmt) {
+    if (*fmt++ != '%') {
+      continue;
+    }
+    if (*fmt == '%') {
+      fmt++;
+      continue;
+    }
+
+    // Flags
+    while (*fmt && strchr("-+ #0'", *fmt)) {
+      fmt++;
+    }
+
+    // Width and precision, either of which may come from the arguments
+    for (uint8_t field = 0; ok && field < 2; field++) {
+      if (field == 1) {
+        if (*fmt != '.') {
+          break;
+        }
+        fmt++;
+      }
+      if (*fmt == '*') {
+        ok = put_u32(&writer, static_cast<uint32_t>(va_arg(args, int)));
+        fmt++;
+      } else {
+        while (*fmt >= '0' && *fmt <= '9') {
+          fmt++;
+        }
+      }
+    }
+
+    dlog_arg_len_e arg_len = LEN_NONE;
+    while (*fmt && strchr("hlLqjzt", *fmt)) {
+      if (*fmt == 'l') {
+        arg_len = (arg_len == LEN_LONG) ? LEN_LONG_LONG : LEN_LONG;
+      } else if (*fmt == 'q' || *fmt == 'j') {
+        arg_len = LEN_LONG_LONG;
+      } else if (*fmt == 'L') {
+        arg_len = LEN_LONG_DOUBLE;
+      } else if (*fmt == 'z' || *fmt == 't') {
+        arg_len = LEN_SIZE;
+      }
+      fmt++;
+    }
+
+    if (ok) {
+      ok = *fmt && put_arg(&writer, *fmt++, arg_len, &args);
+    }
+  }
+  va_end(args);
+
+  return ok ? writer.pos : 0;
+}
+
+/*!
+  Set the build id records are tagged with, so the host can match them to their ELF
+  \param[in] build_id - first four bytes of the GNU build id, as stored in the ELF note
+  \return none
+*/
+void bm_dlog_set_build_id(uint32_t build_id) {
+  _build_id = build_id;
+}
+
+/*!
+  Switch logs between deferred records and formatted text
+  \param[in] enabled - true to send deferred records
+  \return none
+*/
+void bm_dlog_set_enabled(bool enabled) {
+  _enabled = enabled;
+}
+
+/*!
+  Check whether logs are sent as deferred records
+  \return true if they are, false if they are sent as text
+*/
+bool bm_dlog_enabled(void) {
+  return _enabled;
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Largest encoded record, long strings are truncated to fit
+#define BM_DLOG_MAX_LEN (256)
+// Strings carry a one byte length
+#define BM_DLOG_MAX_STR_LEN (UINT8_MAX)
+
+#ifndef BM_DLOG_ENABLE_DEFAULT
+#define BM_DLOG_ENABLE_DEFAULT (0)
+#endif
+
+/*
+  Deferred log record. Instead of the formatted text, the log carries the address
+  of its format string in flash and the raw arguments; the host looks the format
+  string up in the ELF and does the formatting (tools/scripts/misc/dlog_decoder.py).
+  The record starts with the first four bytes of the firmware's GNU build id, so the
+  host can pick the ELF, and with it the string table, each record was made with.
+
+  Arguments follow the format string in order, little endian, sized like on the
+  32 bit target:
+    - %c %d %i %u %o %x %X %p, with no, h, hh, l, z, t length: 4 bytes
+    - ll and j length: 8 bytes
+    - %a %e %f %g (and upper case): 8 byte double
+    - %s: 1 byte length followed by the characters, no terminator
+    - * width or precision: 4 bytes, ahead of the argument it applies to
+*/
+typedef struct {
+  uint32_t build_id;
+  uint32_t fmt_addr;
+  uint8_t args[0];
+} __attribute__((packed)) bm_dlog_record_t;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+size_t bm_dlog_encode(uint8_t *buf, size_t len, const char *format, va_list va);
+void bm_dlog_set_build_id(uint32_t build_id);
+void bm_dlog_set_enabled(bool enabled);
+bool bm_dlog_enabled(void);
+
+#ifdef __cplusplus
+}
+#endif
@@ -1,11 +1,15 @@
 #include "FreeRTOS.h"
+#include "task.h"
+#include "bcmp_fwd_table.h"
 #include "bm_config.h"
 #include "bm_l2.h"
+#include "device_info.h"
 #include "eth_adin2111.h"
 #include "lwip/ethip6.h"
 #include "lwip/prot/ethernet.h"
 #include "lwip/snmp.h"
 #include "task_priorities.h"
+#include "uptime.h"
 
 #define IFNAME0                     'b'
 #define IFNAME1                     'm'
@@ -45,6 +49,8 @@ typedef struct {
     uint8_t port_mask;
     struct pbuf* pbuf;
     bm_l2_queue_type_e type;
+    // When the driver handed us a received frame, for forwarding stats
+    uint64_t rx_us;
 } l2_queue_element_t;
 
 typedef struct {
@@ -56,6 +62,12 @@ typedef struct {
     uint8_t available_port_mask_idx;
     uint8_t enabled_port_mask;
     QueueHandle_t evt_queue;
+    // Only used by the L2 thread
+    bcmp_fwd_table_t fwd_table;
+    // Called from the driver's RX context
+    bm_l2_rx_filter_cb_t multicast_filter_cb;
+    // Updated from both the driver's RX context and the L2 thread
+    bm_l2_fwd_stats_t fwd_stats;
 } bm_l2_ctx_t;
 
 static bm_l2_ctx_t bm_l2_ctx;
@@ -78,26 +90,53 @@ static int32_t bm_l2_get_device_index(const void* device_handle) {
 }
 
 /*!
-  Process TX event. Receive message from L2 queue and send over all
-  network interfaces (if there are multiple). The specific port
-  to use is stored in the tx_event data structure
+  Record how long a forwarded frame spent in this node
 
-  \param *tx_evt - tx event with buffer, port, and other information
+  \param rx_us - when the frame was received
   \return none
 */
-static void bm_l2_process_tx_evt(l2_queue_element_t *tx_evt) {
-    configASSERT(tx_evt);
+static void bm_l2_record_residence(uint64_t rx_us) {
+    uint32_t residence_us = static_cast<uint32_t>(uptimeGetMicroSeconds() - rx_us);
+
+    taskENTER_CRITICAL();
+    bm_l2_fwd_stats_t *stats = &bm_l2_ctx.fwd_stats;
+    stats->forwarded++;
+    if (!stats->min_residence_us || residence_us < stats->min_residence_us) {
+        stats->min_residence_us = residence_us;
+    }
+    if (residence_us > stats->max_residence_us) {
+        stats->max_residence_us = residence_us;
+    }
+    stats->total_residence_us += residence_us;
+    taskEXIT_CRITICAL();
+}
 
+/*!
+  Send a frame over all network interfaces (if there are multiple).
+  Safe to call from the L2 thread and from the driver's RX context.
+
+  \param *pbuf - frame to send
+  \param port_mask - port(s) to transmit the frame over
+  \param shared - true if something else will still read the frame, so the driver
+                   sends a copy. Otherwise it sends straight out of the pbuf.
+  \return none
+*/
+static void bm_l2_send(struct pbuf *pbuf, uint8_t port_mask, bool shared) {
     uint8_t mask_idx = 0;
 
     for (uint32_t idx=0; idx < BM_NETDEV_TYPE_MAX; idx++) {
         switch (bm_l2_ctx.devices[idx].type) {
             case BM_NETDEV_TYPE_ADIN2111: {
-                err_t retv =
-                    adin2111_tx((adin2111_DeviceHandle_t)bm_l2_ctx.devices[idx].device_handle,
-                                static_cast<uint8_t *>(tx_evt->pbuf->payload), tx_evt->pbuf->len,
-                                (tx_evt->port_mask >> mask_idx) & ADIN2111_PORT_MASK,
-                                bm_l2_ctx.devices[idx].start_port_idx);
+                adin2111_DeviceHandle_t device_handle = (adin2111_DeviceHandle_t)bm_l2_ctx.devices[idx].device_handle;
+                uint8_t device_port_mask = (port_mask >> mask_idx) & ADIN2111_PORT_MASK;
+                err_t retv = ERR_OK;
+                if (shared) {
+                    retv = adin2111_tx(device_handle, static_cast<uint8_t *>(pbuf->payload), pbuf->len,
+                                       device_port_mask, bm_l2_ctx.devices[idx].start_port_idx);
+                } else {
+                    retv = adin2111_tx_pbuf(device_handle, pbuf, device_port_mask,
+                                            bm_l2_ctx.devices[idx].start_port_idx);
+                }
                 mask_idx += bm_l2_ctx.devices[idx].num_ports;
                 if (retv != ERR_OK) {
                     printf("Failed to submit TX buffer to ADIN\n");
@@ -115,25 +154,37 @@ static void bm_l2_process_tx_evt(l2_queue_element_t *tx_evt) {
             }
         }
     }
-    pbuf_free(tx_evt->pbuf);
 }
 
 /*!
-  Process RX event. Receive message from L2 queue and:
-  1. re-transmit over other port if the message is multicast
-  2. send up to lwip for processing via net_if->input()
+  Process TX event. Receive message from L2 queue and send over all
+  network interfaces (if there are multiple). The specific port
+  to use is stored in the tx_event data structure
 
-  \param *rx_evt - rx event with buffer, port, and other information
+  \param *tx_evt - tx event with buffer, port, and other information
   \return none
 */
-static void bm_l2_process_rx_evt(l2_queue_element_t *rx_evt) {
-    configASSERT(rx_evt);
+static void bm_l2_process_tx_evt(l2_queue_element_t *tx_evt) {
+    configASSERT(tx_evt);
+
+    bm_l2_send(tx_evt->pbuf, tx_evt->port_mask, false);
+    pbuf_free(tx_evt->pbuf);
+}
 
+/*!
+  Convert a device specific rx port mask into the overall port mask
+
+  \param *device_handle - eth driver handle
+  \param port_mask - device specific port mask
+  \return overall port mask
+*/
+static uint8_t bm_l2_rx_port_mask(const void *device_handle, uint8_t port_mask) {
     uint8_t rx_port_mask = 0;
-    uint8_t device_idx = bm_l2_get_device_index(rx_evt->device_handle);
+    int32_t device_idx = bm_l2_get_device_index(device_handle);
+    configASSERT(device_idx >= 0);
     switch (bm_l2_ctx.devices[device_idx].type) {
         case BM_NETDEV_TYPE_ADIN2111:
-            rx_port_mask = ((rx_evt->port_mask & ADIN2111_PORT_MASK) << bm_l2_ctx.devices[device_idx].start_port_idx);
+            rx_port_mask = ((port_mask & ADIN2111_PORT_MASK) << bm_l2_ctx.devices[device_idx].start_port_idx);
             break;
         case BM_NETDEV_TYPE_NONE:
         default:
@@ -142,18 +193,45 @@ static void bm_l2_process_rx_evt(l2_queue_element_t *rx_evt) {
             rx_port_mask = 0;
             break;
     }
+    return rx_port_mask;
+}
 
-    /* We need to code the RX Port into the IPV6 address passed to lwip */
-    ADD_INGRESS_PORT((static_cast<uint8_t *>(rx_evt->pbuf->payload)), rx_port_mask);
+/*!
+  Process RX event. Receive message from L2 queue and:
+  1. forward targeted BCMP messages for other nodes
+  2. send up to lwip for processing via net_if->input()
+  Global multicast was already re-transmitted over the other ports by bm_l2_rx().
 
-    if (IS_GLOBAL_MULTICAST(rx_evt->pbuf->payload)) {
-        uint8_t new_port_mask = bm_l2_ctx.available_ports_mask & ~(rx_port_mask);
-        bm_l2_tx(rx_evt->pbuf, new_port_mask);
+  \param *rx_evt - rx event with buffer, port, and other information
+  \return none
+*/
+static void bm_l2_process_rx_evt(l2_queue_element_t *rx_evt) {
+    configASSERT(rx_evt);
+
+    uint8_t rx_port_mask = bm_l2_rx_port_mask(rx_evt->device_handle, rx_evt->port_mask);
+
+    /* Learn where the sender is and route messages for other nodes before touching the frame */
+    struct eth_hdr *eth_frame = static_cast<struct eth_hdr *>(rx_evt->pbuf->payload);
+    if (rx_port_mask && rx_evt->pbuf->len > sizeof(struct eth_hdr) && eth_frame->type == PP_HTONS(ETHTYPE_IPV6)) {
+        uint8_t egress_port = 0;
+        bcmp_fwd_action_e action = bcmp_fwd_process(&bm_l2_ctx.fwd_table, getNodeId(),
+                                                     &static_cast<uint8_t *>(rx_evt->pbuf->payload)[sizeof(struct eth_hdr)],
+                                                     rx_evt->pbuf->len - sizeof(struct eth_hdr),
+                                                     __builtin_ctz(rx_port_mask) + 1,
+                                                     pdTICKS_TO_MS(xTaskGetTickCount()), &egress_port);
+        if (action != BCMP_FWD_DELIVER) {
+            if (action == BCMP_FWD_FORWARD) {
+                // Straight to the driver, this thread is the one that would dequeue a BM_L2_TX
+                bm_l2_send(rx_evt->pbuf, (1 << (egress_port - 1)) & bm_l2_ctx.enabled_port_mask, false);
+                bm_l2_record_residence(rx_evt->rx_us);
+            }
+            pbuf_free(rx_evt->pbuf);
+            return;
+        }
     }
 
-    /* TODO: This is the place where routing and filtering functions would happen, to prevent passing the
-       packet to net_if->input() if unnecessary, as well as forwarding routed multicast data to interested
-       neighbors and user devices. */
+    /* We need to code the RX Port into the IPV6 address passed to lwip */
+    ADD_INGRESS_PORT((static_cast<uint8_t *>(rx_evt->pbuf->payload)), rx_port_mask);
 
     // Submit packet to lwip. User RX Callback is responsible for freeing the packet
     // We're using tcpip_input in the netif, which is thread safe, so no
@@ -176,7 +254,7 @@ static void bm_l2_process_rx_evt(l2_queue_element_t *rx_evt) {
 static void _link_change_cb(void* device_handle, uint8_t port, bool state) {
     configASSERT(device_handle);
 
-    l2_queue_element_t link_change_evt = {device_handle, port, NULL, BM_L2_LINK_DOWN};
+    l2_queue_element_t link_change_evt = {device_handle, port, NULL, BM_L2_LINK_DOWN, 0};
     if(state) {
         link_change_evt.type = BM_L2_LINK_UP;
     }
@@ -208,6 +286,8 @@ static void _handle_link_change(const void *device_handle, uint8_t port, bool st
                 bm_l2_ctx.enabled_port_mask |= port_mask;
             } else {
                 bm_l2_ctx.enabled_port_mask &= ~port_mask;
+                // Nodes behind this port have to be found again
+                bcmp_fwd_table_flush_port(&bm_l2_ctx.fwd_table, port_idx + 1);
             }
 
             if(bm_l2_ctx.link_change_cb) {
@@ -303,7 +383,7 @@ err_t bm_l2_tx(struct pbuf *pbuf, uint8_t port_mask) {
 
     // device_handle not needed for tx
     // Don't send to ports that are offline
-    l2_queue_element_t tx_evt = {NULL, port_mask & bm_l2_ctx.enabled_port_mask, pbuf, BM_L2_TX};
+    l2_queue_element_t tx_evt = {NULL, port_mask & bm_l2_ctx.enabled_port_mask, pbuf, BM_L2_TX, 0};
 
     pbuf_ref(pbuf);
     if(xQueueSend(bm_l2_ctx.evt_queue, &tx_evt, 10) != pdTRUE) {
@@ -315,28 +395,44 @@ err_t bm_l2_tx(struct pbuf *pbuf, uint8_t port_mask) {
 }
 
 /*!
-  L2 RX Function - called by low level driver when new data is available
+  L2 RX Function - called by low level driver when new data is available.
+  Global multicast is re-transmitted over the other ports right here instead of
+  waiting for the L2 thread, and dropped if nothing on this node wants it.
 
   \param device_handle device handle
-  \param payload buffer with received data
-  \param payload_len buffer length
+  \param pbuf received frame, freed here or once lwip is done with it
   \param port_mask which port was this received over
   \return ERR_OK if successful, something else otherwise
 */
-err_t bm_l2_rx(void* device_handle, uint8_t* payload, uint16_t payload_len, uint8_t port_mask) {
+err_t bm_l2_rx(void* device_handle, struct pbuf *pbuf, uint8_t port_mask) {
     err_t retv = ERR_OK;
 
-    l2_queue_element_t tx_evt = {device_handle, port_mask, NULL, BM_L2_RX};
+    l2_queue_element_t tx_evt = {device_handle, port_mask, pbuf, BM_L2_RX, uptimeGetMicroSeconds()};
 
     do {
-        tx_evt.pbuf = pbuf_alloc(PBUF_RAW, payload_len, PBUF_RAM);
-        if (tx_evt.pbuf == NULL) {
-            printf("No mem for pbuf in RX pathway\n");
-            retv = ERR_MEM;
-            break;
+        uint8_t *payload = static_cast<uint8_t *>(pbuf->payload);
+        uint16_t payload_len = pbuf->len;
+        if (payload_len >= sizeof(struct eth_hdr) + sizeof(struct ip6_hdr) && IS_GLOBAL_MULTICAST(payload)) {
+            bm_l2_rx_filter_cb_t filter_cb = bm_l2_ctx.multicast_filter_cb;
+            bool wanted = !filter_cb || filter_cb(&payload[sizeof(struct eth_hdr)], payload_len - sizeof(struct eth_hdr));
+
+            uint8_t rx_port_mask = bm_l2_rx_port_mask(device_handle, port_mask);
+            uint8_t new_port_mask = bm_l2_ctx.available_ports_mask & bm_l2_ctx.enabled_port_mask & ~(rx_port_mask);
+            if (new_port_mask) {
+                ADD_INGRESS_PORT(payload, rx_port_mask);
+                // Frames nobody here wants go out without being copied
+                bm_l2_send(pbuf, new_port_mask, wanted);
+                bm_l2_record_residence(tx_evt.rx_us);
+            }
+
+            if (!wanted) {
+                taskENTER_CRITICAL();
+                bm_l2_ctx.fwd_stats.filtered++;
+                taskEXIT_CRITICAL();
+                pbuf_free(pbuf);
+                break;
+            }
         }
-        tx_evt.pbuf->len = payload_len;
-        memcpy(tx_evt.pbuf->payload, payload, payload_len);
 
         if(xQueueSend(bm_l2_ctx.evt_queue, (void *) &tx_evt, 0) != pdTRUE) {
             pbuf_free(tx_evt.pbuf);
@@ -404,6 +500,7 @@ err_t bm_l2_init(bm_l2_link_change_cb_t link_change_cb) {
     /* Reset context variables */
     bm_l2_ctx.available_ports_mask = 0;
     bm_l2_ctx.available_port_mask_idx = 0;
+    bcmp_fwd_table_init(&bm_l2_ctx.fwd_table);
 
     for (uint32_t idx=0; idx < BM_NETDEV_COUNT; idx++) {
         bm_l2_ctx.devices[idx].type = bm_netdev_config[idx].type;
@@ -500,7 +597,7 @@ bool bm_l2_get_port_state(uint8_t port) {
 void bm_l2_netif_set_power(void * dev, bool on) {
     configASSERT(dev);
 
-    l2_queue_element_t pwr_evt = {dev, 0, NULL, BM_L2_SET_NETIF_DOWN};
+    l2_queue_element_t pwr_evt = {dev, 0, NULL, BM_L2_SET_NETIF_DOWN, 0};
     if(on) {
         pwr_evt.type = BM_L2_SET_NETIF_UP;
     }
@@ -521,4 +618,39 @@ static void bm_l2_set_netif(bool up) {
         netif_set_link_down(bm_l2_ctx.net_if);
         netif_set_down(bm_l2_ctx.net_if);
     }
-}
\ No newline at end of file
+}
+/*!
+  Set the function that decides whether received global multicast is passed up
+  to lwip. It runs in the driver's RX context, after the frame was forwarded,
+  so it has to be quick and must not block.
+
+  \param filter_cb - returns false for packets nothing on this node wants, NULL to pass everything up
+  \return none
+*/
+void bm_l2_set_multicast_filter(bm_l2_rx_filter_cb_t filter_cb) {
+    bm_l2_ctx.multicast_filter_cb = filter_cb;
+}
+
+/*!
+  Get a copy of the forwarding stats
+
+  \param[out] *stats - forwarding stats
+  \return none
+*/
+void bm_l2_get_fwd_stats(bm_l2_fwd_stats_t *stats) {
+    configASSERT(stats);
+    taskENTER_CRITICAL();
+    *stats = bm_l2_ctx.fwd_stats;
+    taskEXIT_CRITICAL();
+}
+
+/*!
+  Clear the forwarding stats
+
+  \return none
+*/
+void bm_l2_reset_fwd_stats(void) {
+    taskENTER_CRITICAL();
+    memset(&bm_l2_ctx.fwd_stats, 0, sizeof(bm_l2_ctx.fwd_stats));
+    taskEXIT_CRITICAL();
+}
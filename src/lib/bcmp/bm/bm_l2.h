@@ -24,9 +24,21 @@ enum {
     IPV6_ADDR_DWORD_3
 };
 typedef void (*bm_l2_link_change_cb_t)(uint8_t port, bool state);
+typedef bool (*bm_l2_rx_filter_cb_t)(const uint8_t *ip6_packet, uint16_t len);
+
+typedef struct {
+    // Frames re-transmitted towards other nodes
+    uint32_t forwarded;
+    // Global multicast dropped before lwip because nothing here wanted it
+    uint32_t filtered;
+    // Time from the driver handing us a frame until the forwarded copy is queued to it
+    uint32_t min_residence_us;
+    uint32_t max_residence_us;
+    uint64_t total_residence_us;
+} bm_l2_fwd_stats_t;
 
 err_t bm_l2_tx(struct pbuf *p, uint8_t port_mask);
-err_t bm_l2_rx(void* device_handle, uint8_t* payload, uint16_t payload_len, uint8_t port_mask);
+err_t bm_l2_rx(void* device_handle, struct pbuf *pbuf, uint8_t port_mask);
 err_t bm_l2_link_output(struct netif *netif, struct pbuf *p);
 err_t bm_l2_netif_init(struct netif *netif);
 err_t bm_l2_init(bm_l2_link_change_cb_t link_change_cb);
@@ -35,6 +47,9 @@ void bm_l2_netif_set_power(void * dev, bool on);
 bool bm_l2_get_device_handle(uint8_t dev_idx, void **device_handle, bm_netdev_type_t *type, uint32_t *start_port_idx);
 uint8_t bm_l2_get_num_ports();
 bool bm_l2_get_port_state(uint8_t port);
+void bm_l2_set_multicast_filter(bm_l2_rx_filter_cb_t filter_cb);
+void bm_l2_get_fwd_stats(bm_l2_fwd_stats_t *stats);
+void bm_l2_reset_fwd_stats(void);
 
 #ifdef __cplusplus
 }
@@ -4,12 +4,43 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include "bm_printf.h"
+#include "bm_dlog.h"
 
 #define MAX_FILE_NAME_LEN 64
 #define MAX_STR_LEN(fname_len) (int32_t)(1500 - sizeof(struct ip6_hdr) - sizeof(bm_print_publication_t) - fname_len)
 static constexpr uint8_t fprintfType = 1;
 static constexpr uint8_t printfType = 1;
 static constexpr uint8_t fappendType = 1;
+// Same publication, with a deferred log record in place of the text
+static constexpr uint8_t dlogType = 2;
+
+/*!
+  Publish a console printf as a deferred log record, skipping the formatting and the heap.
+  File writes always go as text, whatever lands on the SD card has to be readable as is.
+  \param[in] target_node_id - node_id to send to (0 = all nodes)
+  \param[in] *format - printf format string
+  \param[in] va - format arguments
+  \param[out] *rval - result, when the record was sent
+  \return true if the record was sent, false if the line has to be sent as text
+*/
+static bool dlog_printf(uint64_t target_node_id, const char* format, va_list va, bm_printf_err_t *rval) {
+  uint8_t pub_buf[sizeof(bm_print_publication_t) + BM_DLOG_MAX_LEN] __attribute__((aligned(8)));
+  bm_print_publication_t* printf_pub = reinterpret_cast<bm_print_publication_t*>(pub_buf);
+
+  size_t record_len = bm_dlog_encode(printf_pub->fnameAndData, BM_DLOG_MAX_LEN, format, va);
+  if (!record_len) {
+    return false;
+  }
+
+  memset(printf_pub, 0, sizeof(bm_print_publication_t));
+  printf_pub->target_node_id = target_node_id;
+  printf_pub->data_len = record_len;
+
+  size_t printf_pub_len = sizeof(bm_print_publication_t) + record_len;
+  *rval = bm_pub("spotter/printf", printf_pub, printf_pub_len, dlogType) ? BM_PRINTF_OK
+                                                                           : BM_PRINTF_TX_ERR;
+  return true;
+}
 
 /*!
   Bristlemouth generic fprintf function, will publish the data to end in a file or
@@ -28,9 +59,7 @@ bm_printf_err_t bm_fprintf(uint64_t target_node_id, const char* file_name,
   va_start(va, format);
 
   do {
-    // check how long the string we are printing will be
-    int32_t data_len = vsnprintf(NULL, 0, format, va);
-    if (data_len == 0) {
+    if (*format == '\0') {
       rval = BM_PRINTF_STR_ZERO_LEN;
       break;
     }
@@ -44,6 +73,17 @@ bm_printf_err_t bm_fprintf(uint64_t target_node_id, const char* file_name,
       }
     }
 
+    if (!file_name && bm_dlog_enabled() && dlog_printf(target_node_id, format, va, &rval)) {
+      break;
+    }
+
+    // check how long the string we are printing will be
+    int32_t data_len = vsnprintf(NULL, 0, format, va);
+    if (data_len == 0) {
+      rval = BM_PRINTF_STR_ZERO_LEN;
+      break;
+    }
+
     if (data_len > MAX_STR_LEN(fname_len)) {
       rval = BM_PRINTF_STR_MAX_LEN;
       break;
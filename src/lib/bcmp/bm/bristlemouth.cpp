@@ -1,5 +1,8 @@
 #include "bristlemouth.h"
 
+#include <inttypes.h>
+#include <string.h>
+
 // Includes for FreeRTOS
 #include "FreeRTOS.h"
 #include "task.h"
@@ -19,6 +22,8 @@
 #include "bcmp_cli.h"
 
 #include "middleware.h"
+#include "bm_pubsub.h"
+#include "bm_dlog.h"
 #include "task_priorities.h"
 
 #ifdef STRESS_TEST_ENABLE
@@ -27,6 +32,11 @@
 
 static struct netif     netif;
 
+// System config key for the publish batching window, 0 or unset leaves batching off
+static constexpr char pub_batch_window_config_key[] = "pubBatchWindowMs";
+// System config key to turn deferred log records on (1) or off (0), unset keeps the build default
+static constexpr char dlog_enable_config_key[] = "dlogEnable";
+
 // Callback function in case of link changes.
 // Will notify relevant subsystems of link change event
 void bm_link_change_cb(uint8_t port, bool state) {
@@ -96,6 +106,32 @@ void bcl_init(NvmPartition * dfu_partition, cfg::Configuration* usr_cfg, cfg::Co
     bcmp_cli_init();
 
     bm_middleware_init(&netif, BM_MIDDLEWARE_PORT);
+    bm_l2_set_multicast_filter(bm_middleware_wants_packet);
+
+    // Every node receiving batches has to understand them, so this is opt-in per network
+    uint32_t pub_batch_window_ms = 0;
+    if (sys_cfg && sys_cfg->getConfig(pub_batch_window_config_key, strlen(pub_batch_window_config_key),
+                                      pub_batch_window_ms) && pub_batch_window_ms) {
+        bm_pub_batching_set_window(pub_batch_window_ms);
+        printf("Publish batching window: %" PRIu32 " ms\n", pub_batch_window_ms);
+    }
+
+    // Records carry the start of the build id so the host decodes them with the right ELF
+    const uint8_t *build_id = NULL;
+    uint32_t dlog_build_id = 0;
+    if (getBuildId(&build_id) >= sizeof(dlog_build_id)) {
+        memcpy(&dlog_build_id, build_id, sizeof(dlog_build_id));
+    }
+    bm_dlog_set_build_id(dlog_build_id);
+
+    uint32_t dlog_enable = 0;
+    if (sys_cfg &&
+        sys_cfg->getConfig(dlog_enable_config_key, strlen(dlog_enable_config_key), dlog_enable)) {
+        bm_dlog_set_enabled(dlog_enable != 0);
+    }
+    if (bm_dlog_enabled()) {
+        printf("Deferred log records on, decode with tools/scripts/misc/dlog_decoder.py\n");
+    }
 
 #ifdef STRESS_TEST_ENABLE
     stress_test_init(&netif, STRESS_TEST_PORT);
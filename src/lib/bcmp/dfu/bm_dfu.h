@@ -20,8 +20,28 @@ extern "C" {
 #define BM_DFU_MAX_CHUNK_SIZE (1024) // TODO: put this in an app config header
 #define BM_DFU_MAX_CHUNK_RETRIES 5
 
+// Largest number of chunks a host will stream ahead of a client in windowed mode.
+// Bounded by the width of bm_dfu_event_window_request_t::received_mask.
+#define BM_DFU_MAX_WINDOW_SIZE 16
+
+// Enough room for a full window of chunks plus the regular control traffic
+#define BM_DFU_EVENT_QUEUE_LEN (5 + BM_DFU_MAX_WINDOW_SIZE)
+
 #define BM_IMG_PAGE_LENGTH 2048
 
+// Destination node id used for chunks streamed to every client in a multicast session
+#define BM_DFU_MULTICAST_NODE_ID (0)
+
+// Largest number of clients a host can update in one multicast session
+#define BM_DFU_MCAST_MAX_CLIENTS 32
+
+// Largest image a multicast client can track, in chunks (one bit per chunk)
+#define BM_DFU_MCAST_MAX_CHUNKS 4096
+
+// Multicast clients write chunks straight to their offset in flash, so the chunk
+// size must keep every chunk aligned to the flash programming granularity.
+#define BM_DFU_MCAST_WRITE_ALIGN 16
+
 typedef enum {
   BM_DFU_ERR_NONE,
   BM_DFU_ERR_TOO_LARGE,
@@ -37,6 +57,8 @@ typedef enum {
   BM_DFU_ERR_CHUNK_SIZE,
   BM_DFU_ERR_UNKNOWN_NODE_ID,
   BM_DFU_ERR_CONFIRMATION_ABORT,
+  BM_DFU_ERR_DELTA_BASE,
+  BM_DFU_ERR_COMPRESSION,
   // All errors below this are "fatal"
   BM_DFU_ERR_FLASH_ACCESS,
 } bm_dfu_err_t;
@@ -71,6 +93,10 @@ enum BM_DFU_EVT_TYPE {
   DFU_EVENT_REBOOT_REQUEST,
   DFU_EVENT_REBOOT,
   DFU_EVENT_BOOT_COMPLETE,
+  DFU_EVENT_WINDOW_REQUEST,
+  DFU_EVENT_WINDOW_CHUNK,
+  DFU_EVENT_BEGIN_HOST_MULTICAST,
+  DFU_EVENT_MCAST_SEND,
 };
 
 typedef bool (*bcmp_dfu_tx_func_t)(bcmp_message_type_t type, uint8_t *buff, uint16_t len);
@@ -88,6 +114,12 @@ typedef struct __attribute__((__packed__)) dfu_host_start_event {
   uint32_t timeoutMs;
 } dfu_host_start_event_t;
 
+typedef struct dfu_host_mcast_start_event {
+  dfu_host_start_event_t start_event;
+  uint8_t num_nodes;
+  uint64_t node_ids[0];
+} dfu_host_mcast_start_event_t;
+
 #define DFU_REBOOT_MAGIC (0xBADC0FFE)
 
 typedef struct __attribute__((__packed__)) {
@@ -112,6 +144,8 @@ void bm_dfu_set_pending_state_change(uint8_t new_state);
 
 void bm_dfu_send_ack(uint64_t dst_node_id, uint8_t success, bm_dfu_err_t err_code);
 void bm_dfu_req_next_chunk(uint64_t dst_node_id, uint16_t chunk_num);
+void bm_dfu_req_chunk_window(uint64_t dst_node_id, uint16_t chunk_num, uint8_t window_size,
+                             uint16_t received_mask);
 void bm_dfu_update_end(uint64_t dst_node_id, uint8_t success, bm_dfu_err_t err_code);
 void bm_dfu_send_heartbeat(uint64_t dst_node_id);
 
@@ -120,6 +154,9 @@ void bm_dfu_init(bcmp_dfu_tx_func_t bcmp_dfu_tx, NvmPartition *dfu_partition,
 void bm_dfu_process_message(uint8_t *buf, size_t len);
 bool bm_dfu_initiate_update(bm_dfu_img_info_t info, uint64_t dest_node_id,
                             update_finish_cb_t update_finish_callback, uint32_t timeoutMs);
+bool bm_dfu_initiate_multicast_update(bm_dfu_img_info_t info, const uint64_t *dest_node_ids,
+                                      uint8_t num_nodes, update_finish_cb_t update_finish_callback,
+                                      uint32_t timeoutMs);
 
 bool bm_dfu_confirm_is_enabled(void);
 void bm_dfu_confirm_enable(bool en);
@@ -10,6 +10,8 @@
 
 #include "bm_dfu.h"
 #include "bm_dfu_client.h"
+#include "bm_dfu_delta.h"
+#include "bm_dfu_lz.h"
 #include "bootutil/bootutil_public.h"
 #include "flash_map_backend/flash_map_backend.h"
 #include "stm32_flash.h"
@@ -39,6 +41,30 @@ typedef struct dfu_client_ctx_t {
     uint64_t self_node_id;
     uint64_t host_node_id;
     bcmp_dfu_tx_func_t bcmp_dfu_tx;
+    /* Windowed transfer variables */
+    uint8_t max_window_size;
+    uint8_t window_size;
+    uint16_t requested_end;
+    uint16_t nack_chunk;
+    bool nack_sent;
+    uint8_t *window_bufs[BM_DFU_MAX_WINDOW_SIZE];
+    uint16_t window_lens[BM_DFU_MAX_WINDOW_SIZE];
+    /* Multicast transfer variables */
+    bool multicast;
+    bool mcast_stream_done;
+    uint16_t mcast_chunks_received;
+    uint16_t mcast_repair_base;
+    uint16_t mcast_repair_end;
+    uint16_t chunk_size;
+    uint8_t mcast_rx_bitmap[BM_DFU_MCAST_MAX_CHUNKS / 8];
+    /* Delta image variables */
+    bool delta;
+    const struct flash_area *base_fa;
+    bm_dfu_delta_ctx_t delta_ctx;
+    /* Compressed image variables */
+    bool compressed;
+    bm_dfu_err_t lz_write_err;
+    bm_dfu_lz_ctx_t lz_ctx;
 } dfu_client_ctx_t;
 
 static dfu_client_ctx_t client_ctx;
@@ -48,6 +74,9 @@ static void bm_dfu_client_send_reboot_request();
 static void bm_dfu_client_send_boot_complete(uint64_t host_node_id);
 static void bm_dfu_client_transition_to_error(bm_dfu_err_t err);
 static void bm_dfu_client_fail_update_and_reboot(void);
+static void bm_dfu_client_window_reset(void);
+static void bm_dfu_client_window_start(void);
+static void bm_dfu_client_mcast_reset(void);
 
 /**
  * @brief Send DFU Abort to Host
@@ -124,7 +153,7 @@ static void chunk_timer_handler(TimerHandle_t tmr) {
  * @param man_decode_buf    Buffer of decoded payload
  * @return int32_t 0 on success, non-0 on error
  */
-static int32_t bm_dfu_process_payload(uint16_t len, uint8_t * buf)
+static int32_t bm_dfu_process_payload(uint16_t len, const uint8_t * buf)
 {
     int32_t retval = 0;
 
@@ -196,10 +225,429 @@ static int32_t bm_dfu_process_end(void) {
         }
     }
 
+    flash_area_close(client_ctx.fa);
+    if (client_ctx.delta) {
+        flash_area_close(client_ctx.base_fa);
+    }
+    return retval;
+}
+
+/**
+ * @brief Read the running image for the delta applier
+ *
+ * @return int 0 on success, non-0 on error
+ */
+static int bm_dfu_client_delta_read_base(void *arg, uint32_t offset, uint8_t *buf, uint32_t len) {
+    (void) arg;
+    return flash_area_read(client_ctx.base_fa, offset, buf, len);
+}
+
+/**
+ * @brief Write reconstructed image bytes from the delta applier
+ *
+ * @note The CRC of a delta update covers the reconstructed image, not the patch.
+ *
+ * @return int 0 on success, non-0 on error
+ */
+static int bm_dfu_client_delta_write(void *arg, const uint8_t *buf, uint32_t len) {
+    (void) arg;
+    client_ctx.running_crc16 = crc16_ccitt(client_ctx.running_crc16, buf, len);
+    return bm_dfu_process_payload(static_cast<uint16_t>(len), buf);
+}
+
+/**
+ * @brief Checksum and write image bytes, or apply them as a patch for delta images
+ *
+ * @param len    Number of bytes
+ * @param buf    Image bytes
+ * @return bm_dfu_err_t BM_DFU_ERR_NONE on success
+ */
+static bm_dfu_err_t bm_dfu_client_write_image(uint32_t len, const uint8_t *buf) {
+    if (client_ctx.delta) {
+        bm_dfu_delta_err_t err = bm_dfu_delta_process(&client_ctx.delta_ctx, buf, len);
+        if (err == BM_DFU_DELTA_ERR_BASE) {
+            return BM_DFU_ERR_DELTA_BASE;
+        }
+        return (err == BM_DFU_DELTA_OK) ? BM_DFU_ERR_NONE : BM_DFU_ERR_BM_FRAME;
+    }
+    client_ctx.running_crc16 = crc16_ccitt(client_ctx.running_crc16, buf, len);
+    return bm_dfu_process_payload(static_cast<uint16_t>(len), buf) ? BM_DFU_ERR_BM_FRAME : BM_DFU_ERR_NONE;
+}
+
+/**
+ * @brief Write decompressed image bytes
+ *
+ * @note The CRC of a compressed update covers the decompressed image.
+ *
+ * @return int 0 on success, non-0 on error
+ */
+static int bm_dfu_client_lz_write(void *arg, const uint8_t *buf, uint32_t len) {
+    (void) arg;
+    client_ctx.lz_write_err = bm_dfu_client_write_image(len, buf);
+    return (client_ctx.lz_write_err == BM_DFU_ERR_NONE) ? 0 : -1;
+}
+
+/**
+ * @brief Start receiving the image from the beginning
+ *
+ * @return none
+ */
+static void bm_dfu_client_rx_reset(void) {
+    client_ctx.current_chunk = 0;
+    client_ctx.chunk_retry_num = 0;
+    client_ctx.img_page_byte_counter = 0;
+    client_ctx.img_flash_offset = 0;
+    client_ctx.running_crc16 = 0;
+    if (client_ctx.delta) {
+        bm_dfu_delta_init(&client_ctx.delta_ctx, bm_dfu_client_delta_read_base, bm_dfu_client_delta_write, NULL, getGitSHA());
+    }
+    if (client_ctx.compressed) {
+        bm_dfu_lz_init(&client_ctx.lz_ctx, bm_dfu_client_lz_write, NULL);
+    }
+}
+
+/**
+ * @brief Free any out-of-order chunks held for the current window
+ *
+ * @return none
+ */
+static void bm_dfu_client_window_reset(void) {
+    for (uint8_t i = 0; i < BM_DFU_MAX_WINDOW_SIZE; i++) {
+        if (client_ctx.window_bufs[i]) {
+            vPortFree(client_ctx.window_bufs[i]);
+            client_ctx.window_bufs[i] = NULL;
+        }
+        client_ctx.window_lens[i] = 0;
+    }
+    client_ctx.requested_end = 0;
+    client_ctx.nack_chunk = 0;
+    client_ctx.nack_sent = false;
+}
+
+/**
+ * @brief Build the mask of chunks already held in [seq_num, seq_num + count)
+ *
+ * @param seq_num   First chunk of the window
+ * @param count     Number of chunks in the window
+ * @return uint16_t bit n set if chunk (seq_num + n) is held
+ */
+static uint16_t bm_dfu_client_window_held_mask(uint16_t seq_num, uint8_t count) {
+    uint16_t mask = 0;
+    for (uint8_t i = 0; i < count; i++) {
+        if (client_ctx.window_bufs[(seq_num + i) % BM_DFU_MAX_WINDOW_SIZE]) {
+            mask |= (1U << i);
+        }
+    }
+    return mask;
+}
+
+/**
+ * @brief (Re)request every outstanding chunk the client doesn't hold yet
+ *
+ * @note Used both to start a window and as a selective NACK on timeout.
+ *
+ * @return none
+ */
+static void bm_dfu_client_window_request_outstanding(void) {
+    uint8_t count = static_cast<uint8_t>(client_ctx.requested_end - client_ctx.current_chunk);
+    bm_dfu_req_chunk_window(client_ctx.host_node_id, client_ctx.current_chunk, count,
+                            bm_dfu_client_window_held_mask(client_ctx.current_chunk, count));
+}
+
+/**
+ * @brief Request the first window of chunks from the Host
+ *
+ * @return none
+ */
+static void bm_dfu_client_window_start(void) {
+    bm_dfu_client_window_reset();
+    client_ctx.requested_end = client_ctx.current_chunk + client_ctx.window_size;
+    if (client_ctx.requested_end > client_ctx.num_chunks) {
+        client_ctx.requested_end = client_ctx.num_chunks;
+    }
+    bm_dfu_client_window_request_outstanding();
+}
+
+/**
+ * @brief Checksum and write one in-order chunk
+ *
+ * @note Chunks of a compressed image are decompressed first, chunks of a delta image
+ *       go through the patch applier.
+ *
+ * @param len    Length of the chunk
+ * @param buf    Chunk payload
+ * @return bm_dfu_err_t BM_DFU_ERR_NONE on success
+ */
+static bm_dfu_err_t bm_dfu_client_consume_chunk(uint16_t len, uint8_t *buf) {
+    if (client_ctx.compressed) {
+        client_ctx.lz_write_err = BM_DFU_ERR_NONE;
+        bm_dfu_lz_err_t err = bm_dfu_lz_process(&client_ctx.lz_ctx, buf, len);
+        if (err == BM_DFU_LZ_OK) {
+            return BM_DFU_ERR_NONE;
+        } else if (err == BM_DFU_LZ_ERR_WINDOW) {
+            return BM_DFU_ERR_COMPRESSION;
+        } else if (err == BM_DFU_LZ_ERR_WRITE && client_ctx.lz_write_err != BM_DFU_ERR_NONE) {
+            return client_ctx.lz_write_err;
+        }
+        return BM_DFU_ERR_BM_FRAME;
+    }
+    return bm_dfu_client_write_image(len, buf);
+}
+
+/**
+ * @brief Stop receiving after a chunk couldn't be consumed
+ *
+ * @return none
+ */
+static void bm_dfu_client_chunk_failed(bm_dfu_err_t err) {
+    if (err == BM_DFU_ERR_DELTA_BASE || err == BM_DFU_ERR_COMPRESSION) {
+        /* Let the host know right away, it can fall back to a full image */
+        bm_dfu_client_abort(err);
+    }
+    bm_dfu_client_transition_to_error(err);
+}
+
+/**
+ * @brief Handle a chunk received in windowed mode
+ *
+ * @note In-order chunks are written immediately, followed by any held chunks they unblock.
+ *       Out-of-order chunks are held until the gap is filled, and the first one after a gap
+ *       triggers a selective NACK for the chunks in between. Once half the window has been
+ *       consumed the next chunks are requested, so the host always has chunks in flight.
+ *
+ * @param *chunk    Received chunk
+ * @return none
+ */
+static void bm_dfu_client_process_window_chunk(bm_dfu_event_window_chunk_t *chunk) {
+    uint16_t seq_num = chunk->seq_num;
+
+    /* Drop stale duplicates and anything outside of the current window */
+    if (seq_num < client_ctx.current_chunk || seq_num >= client_ctx.requested_end ||
+        chunk->payload_length == 0 || chunk->payload_length > BM_DFU_MAX_CHUNK_SIZE) {
+        return;
+    }
+
+    configASSERT(xTimerStop(client_ctx.chunk_timer, 10));
+    client_ctx.chunk_retry_num = 0;
+
+    if (seq_num != client_ctx.current_chunk) {
+        uint8_t slot = seq_num % BM_DFU_MAX_WINDOW_SIZE;
+        if (!client_ctx.window_bufs[slot]) {
+            client_ctx.window_bufs[slot] = static_cast<uint8_t *>(pvPortMalloc(chunk->payload_length));
+            configASSERT(client_ctx.window_bufs[slot]);
+            memcpy(client_ctx.window_bufs[slot], chunk->payload_buf, chunk->payload_length);
+            client_ctx.window_lens[slot] = chunk->payload_length;
+        }
+
+        /* Chunks arrive in order on the bus, so a gap means the ones before this were lost.
+           Only NACK once per gap, the chunk timer covers lost retransmissions. */
+        if (!client_ctx.nack_sent || client_ctx.nack_chunk != client_ctx.current_chunk) {
+            uint8_t count = static_cast<uint8_t>(seq_num - client_ctx.current_chunk);
+            bm_dfu_req_chunk_window(client_ctx.host_node_id, client_ctx.current_chunk, count,
+                                    bm_dfu_client_window_held_mask(client_ctx.current_chunk, count));
+            client_ctx.nack_sent = true;
+            client_ctx.nack_chunk = client_ctx.current_chunk;
+        }
+        configASSERT(xTimerStart(client_ctx.chunk_timer, 10));
+        return;
+    }
+
+    bm_dfu_err_t err = bm_dfu_client_consume_chunk(chunk->payload_length, chunk->payload_buf);
+    if (err != BM_DFU_ERR_NONE) {
+        bm_dfu_client_chunk_failed(err);
+        return;
+    }
+    client_ctx.current_chunk++;
+
+    /* Flush any held chunks that are now in order */
+    uint8_t slot = client_ctx.current_chunk % BM_DFU_MAX_WINDOW_SIZE;
+    while (client_ctx.current_chunk < client_ctx.requested_end && client_ctx.window_bufs[slot]) {
+        err = bm_dfu_client_consume_chunk(client_ctx.window_lens[slot], client_ctx.window_bufs[slot]);
+        vPortFree(client_ctx.window_bufs[slot]);
+        client_ctx.window_bufs[slot] = NULL;
+        client_ctx.window_lens[slot] = 0;
+        if (err != BM_DFU_ERR_NONE) {
+            bm_dfu_client_chunk_failed(err);
+            return;
+        }
+        client_ctx.current_chunk++;
+        slot = client_ctx.current_chunk % BM_DFU_MAX_WINDOW_SIZE;
+    }
+
+    if (client_ctx.current_chunk >= client_ctx.num_chunks) {
+        bm_dfu_client_window_reset();
+        if (bm_dfu_process_end()) {
+            bm_dfu_client_transition_to_error(BM_DFU_ERR_BM_FRAME);
+        } else {
+            bm_dfu_set_pending_state_change(BM_DFU_STATE_CLIENT_VALIDATING);
+        }
+        return;
+    }
+
+    /* Slide the window once half of it has been consumed */
+    uint16_t window_end = client_ctx.current_chunk + client_ctx.window_size;
+    if (window_end > client_ctx.num_chunks) {
+        window_end = client_ctx.num_chunks;
+    }
+    if ((client_ctx.requested_end - client_ctx.current_chunk) <= (client_ctx.window_size / 2) &&
+        window_end > client_ctx.requested_end) {
+        uint8_t count = static_cast<uint8_t>(window_end - client_ctx.requested_end);
+        bm_dfu_req_chunk_window(client_ctx.host_node_id, client_ctx.requested_end, count, 0);
+        client_ctx.requested_end = window_end;
+    }
+
+    configASSERT(xTimerStart(client_ctx.chunk_timer, 10));
+}
+
+/**
+ * @brief Clear the multicast chunk bitmap
+ *
+ * @return none
+ */
+static void bm_dfu_client_mcast_reset(void) {
+    memset(client_ctx.mcast_rx_bitmap, 0, sizeof(client_ctx.mcast_rx_bitmap));
+    client_ctx.mcast_chunks_received = 0;
+    client_ctx.mcast_repair_base = 0;
+    client_ctx.mcast_repair_end = 0;
+    client_ctx.mcast_stream_done = false;
+}
+
+static bool bm_dfu_client_mcast_has_chunk(uint16_t seq_num) {
+    return client_ctx.mcast_rx_bitmap[seq_num / 8] & (1U << (seq_num % 8));
+}
+
+/**
+ * @brief Request the first gap in the received chunks from the Host
+ *
+ * @note Repairs are unicast, and a single window request covers the first missing chunk
+ *       plus any other missing chunks that follow it within one window.
+ *
+ * @return none
+ */
+static void bm_dfu_client_mcast_request_gap(void) {
+    uint16_t base = 0;
+    while (base < client_ctx.num_chunks && bm_dfu_client_mcast_has_chunk(base)) {
+        base++;
+    }
+    if (base >= client_ctx.num_chunks) {
+        return;
+    }
+
+    uint16_t end = base + BM_DFU_MAX_WINDOW_SIZE;
+    if (end > client_ctx.num_chunks) {
+        end = client_ctx.num_chunks;
+    }
+    uint16_t mask = 0;
+    for (uint16_t seq_num = base; seq_num < end; seq_num++) {
+        if (bm_dfu_client_mcast_has_chunk(seq_num)) {
+            mask |= (1U << (seq_num - base));
+        }
+    }
+    bm_dfu_req_chunk_window(client_ctx.host_node_id, base, static_cast<uint8_t>(end - base), mask);
+    client_ctx.mcast_repair_base = base;
+    client_ctx.mcast_repair_end = end;
+}
+
+/**
+ * @brief Checksum the image written to flash
+ *
+ * @note Multicast chunks are written out of order, so the running CRC is computed
+ *       by reading the image back once every chunk has been received.
+ *
+ * @return int32_t 0 on success, non-0 on error
+ */
+static int32_t bm_dfu_client_mcast_finish(void) {
+    int32_t retval = 0;
+    uint32_t offset = 0;
+
+    client_ctx.running_crc16 = 0;
+    while (offset < client_ctx.image_size) {
+        uint32_t len = client_ctx.image_size - offset;
+        if (len > BM_IMG_PAGE_LENGTH) {
+            len = BM_IMG_PAGE_LENGTH;
+        }
+        retval = flash_area_read(client_ctx.fa, offset, client_ctx.img_page_buf, len);
+        if (retval) {
+            printf("Unable to read DFU image from Flash\n");
+            break;
+        }
+        client_ctx.running_crc16 = crc16_ccitt(client_ctx.running_crc16, client_ctx.img_page_buf, len);
+        offset += len;
+    }
+    client_ctx.img_flash_offset = offset;
+
     flash_area_close(client_ctx.fa);
     return retval;
 }
 
+/**
+ * @brief Handle a chunk received in multicast mode
+ *
+ * @note Chunks are written straight to their offset in the secondary slot and tracked in a
+ *       bitmap. Once the host's stream has gone by (the last chunk was seen or the chunk timer
+ *       expired), missing chunks are requested from the host one window at a time.
+ *
+ * @param *chunk    Received chunk
+ * @return none
+ */
+static void bm_dfu_client_process_mcast_chunk(bm_dfu_event_window_chunk_t *chunk) {
+    uint16_t seq_num = chunk->seq_num;
+    if (seq_num >= client_ctx.num_chunks) {
+        return;
+    }
+
+    uint32_t img_offset = static_cast<uint32_t>(seq_num) * client_ctx.chunk_size;
+    uint32_t expected_len = client_ctx.image_size - img_offset;
+    if (expected_len > client_ctx.chunk_size) {
+        expected_len = client_ctx.chunk_size;
+    }
+    if (chunk->payload_length != expected_len) {
+        return;
+    }
+
+    configASSERT(xTimerStop(client_ctx.chunk_timer, 10));
+    client_ctx.chunk_retry_num = 0;
+
+    if (!bm_dfu_client_mcast_has_chunk(seq_num)) {
+        if (flash_area_write(client_ctx.fa, img_offset, chunk->payload_buf, chunk->payload_length)) {
+            printf("Unable to write DFU frame to Flash\n");
+            bm_dfu_client_transition_to_error(BM_DFU_ERR_BM_FRAME);
+            return;
+        }
+        client_ctx.mcast_rx_bitmap[seq_num / 8] |= (1U << (seq_num % 8));
+        client_ctx.mcast_chunks_received++;
+    }
+
+    if (client_ctx.mcast_chunks_received >= client_ctx.num_chunks) {
+        if (bm_dfu_client_mcast_finish()) {
+            bm_dfu_client_transition_to_error(BM_DFU_ERR_BM_FRAME);
+        } else {
+            bm_dfu_set_pending_state_change(BM_DFU_STATE_CLIENT_VALIDATING);
+        }
+        return;
+    }
+
+    if (seq_num == client_ctx.num_chunks - 1) {
+        client_ctx.mcast_stream_done = true;
+    }
+
+    /* Ask for the next gap once the last repair window has been filled */
+    if (client_ctx.mcast_stream_done) {
+        bool repair_done = true;
+        for (uint16_t i = client_ctx.mcast_repair_base; i < client_ctx.mcast_repair_end; i++) {
+            if (!bm_dfu_client_mcast_has_chunk(i)) {
+                repair_done = false;
+                break;
+            }
+        }
+        if (repair_done) {
+            bm_dfu_client_mcast_request_gap();
+        }
+    }
+
+    configASSERT(xTimerStart(client_ctx.chunk_timer, 10));
+}
+
 /**
  * @brief Process a DFU request from the Host
  *
@@ -229,13 +677,49 @@ void bm_dfu_client_process_update_request(void) {
     major_version = img_info_evt->img_info.major_ver;
     client_ctx.host_node_id = img_info_evt->addresses.src_node_id;
 
+    /* Hosts that support windowed transfers append their max window size and options to the request */
+    client_ctx.window_size = 1;
+    client_ctx.multicast = false;
+    client_ctx.delta = false;
+    client_ctx.compressed = false;
+    if (curr_evt.len >= sizeof(bcmp_dfu_start_ext_t)) {
+        bcmp_dfu_start_ext_t *start_ext = reinterpret_cast<bcmp_dfu_start_ext_t *>(frame);
+        uint8_t host_max_window = start_ext->max_window_size;
+        client_ctx.window_size = (host_max_window < client_ctx.max_window_size) ? host_max_window : client_ctx.max_window_size;
+        if (client_ctx.window_size == 0) {
+            client_ctx.window_size = 1;
+        }
+        client_ctx.multicast = (start_ext->flags & BM_DFU_START_FLAG_MULTICAST);
+        client_ctx.delta = (start_ext->flags & BM_DFU_START_FLAG_DELTA);
+        client_ctx.compressed = (start_ext->flags & BM_DFU_START_FLAG_COMPRESSED);
+    }
+
     if (img_info_evt->img_info.gitSHA != getGitSHA() || img_info_evt->img_info.filter_key == BM_DFU_IMG_INFO_FORCE_UPDATE) {
         if(chunk_size > BM_DFU_MAX_CHUNK_SIZE) {
             bm_dfu_client_abort(BM_DFU_ERR_ABORTED);
             bm_dfu_client_transition_to_error(BM_DFU_ERR_CHUNK_SIZE);
             return;
         }
+        if(client_ctx.multicast && (chunk_size == 0 || (chunk_size % BM_DFU_MCAST_WRITE_ALIGN) ||
+                                    ((image_size + chunk_size - 1) / chunk_size) > BM_DFU_MCAST_MAX_CHUNKS)) {
+            printf("Unsupported multicast chunk layout\n");
+            bm_dfu_send_ack(client_ctx.host_node_id, 0, BM_DFU_ERR_CHUNK_SIZE);
+            return;
+        }
+        if(client_ctx.multicast && (client_ctx.delta || client_ctx.compressed)) {
+            printf("Delta and compressed images can't be multicast\n");
+            bm_dfu_send_ack(client_ctx.host_node_id, 0, BM_DFU_ERR_ABORTED);
+            return;
+        }
         client_ctx.image_size = image_size;
+        client_ctx.chunk_size = chunk_size;
+
+        /* Delta images are applied against the image in the primary slot */
+        if (client_ctx.delta && flash_area_open(FLASH_AREA_IMAGE_PRIMARY(0), &client_ctx.base_fa) != 0) {
+            bm_dfu_send_ack(client_ctx.host_node_id, 0, BM_DFU_ERR_FLASH_ACCESS);
+            bm_dfu_client_transition_to_error(BM_DFU_ERR_FLASH_ACCESS);
+            return;
+        }
 
         /* We calculating the number of chunks that the client will be requesting based on the
            size of each chunk and the total size of the image. */
@@ -298,14 +782,16 @@ void s_client_activating_run(void) {}
  */
 void s_client_receiving_entry(void) {
     /* Start from Chunk #0 */
-    client_ctx.current_chunk = 0;
-    client_ctx.chunk_retry_num = 0;
-    client_ctx.img_page_byte_counter = 0;
-    client_ctx.img_flash_offset = 0;
-    client_ctx.running_crc16 = 0;
+    bm_dfu_client_rx_reset();
 
-    /* Request Next Chunk */
-    bm_dfu_req_next_chunk(client_ctx.host_node_id, client_ctx.current_chunk);
+    /* Request Next Chunk(s). Multicast chunks are pushed by the host without asking. */
+    if (client_ctx.multicast) {
+        bm_dfu_client_mcast_reset();
+    } else if (client_ctx.window_size > 1) {
+        bm_dfu_client_window_start();
+    } else {
+        bm_dfu_req_next_chunk(client_ctx.host_node_id, client_ctx.current_chunk);
+    }
 
     /* Kickoff Chunk timeout */
     configASSERT(xTimerStart(client_ctx.chunk_timer, 10));
@@ -332,12 +818,11 @@ void s_client_receiving_run(void) {
         /* Get Chunk Length and Chunk */
         client_ctx.chunk_length = image_chunk_evt->payload_length;
 
-        /* Calculate Running CRC */
-        client_ctx.running_crc16 = crc16_ccitt(client_ctx.running_crc16, image_chunk_evt->payload_buf, client_ctx.chunk_length);
-
         /* Process the frame */
-        if (bm_dfu_process_payload(client_ctx.chunk_length, image_chunk_evt->payload_buf)) {
-            bm_dfu_client_transition_to_error(BM_DFU_ERR_BM_FRAME);
+        bm_dfu_err_t err = bm_dfu_client_consume_chunk(client_ctx.chunk_length, image_chunk_evt->payload_buf);
+        if (err != BM_DFU_ERR_NONE) {
+            bm_dfu_client_chunk_failed(err);
+            return;
         }
 
         /* Request Next Chunk */
@@ -355,6 +840,16 @@ void s_client_receiving_run(void) {
                 bm_dfu_set_pending_state_change(BM_DFU_STATE_CLIENT_VALIDATING);
             }
         }
+    } else if (curr_evt.type == DFU_EVENT_WINDOW_CHUNK) {
+        configASSERT(curr_evt.buf);
+        bm_dfu_frame_t *frame = reinterpret_cast<bm_dfu_frame_t *>(curr_evt.buf);
+        bm_dfu_event_window_chunk_t* window_chunk_evt = (bm_dfu_event_window_chunk_t*) &(reinterpret_cast<uint8_t *>(frame))[1];
+
+        if (client_ctx.multicast) {
+            bm_dfu_client_process_mcast_chunk(window_chunk_evt);
+        } else if (client_ctx.window_size > 1) {
+            bm_dfu_client_process_window_chunk(window_chunk_evt);
+        }
     } else if (curr_evt.type == DFU_EVENT_CHUNK_TIMEOUT) {
         client_ctx.chunk_retry_num++;
         /* Try requesting chunk until max retries is reached */
@@ -362,20 +857,33 @@ void s_client_receiving_run(void) {
             bm_dfu_client_abort(BM_DFU_ERR_ABORTED);
             bm_dfu_client_transition_to_error(BM_DFU_ERR_TIMEOUT);
         } else {
-            bm_dfu_req_next_chunk(client_ctx.host_node_id, client_ctx.current_chunk);
+            if (client_ctx.multicast) {
+                /* The stream stalled or finished without us, repair from the first gap */
+                client_ctx.mcast_stream_done = true;
+                bm_dfu_client_mcast_request_gap();
+            } else if (client_ctx.window_size > 1) {
+                /* Selectively re-request everything outstanding that we don't hold */
+                bm_dfu_client_window_request_outstanding();
+                client_ctx.nack_sent = true;
+                client_ctx.nack_chunk = client_ctx.current_chunk;
+            } else {
+                bm_dfu_req_next_chunk(client_ctx.host_node_id, client_ctx.current_chunk);
+            }
             configASSERT(xTimerStart(client_ctx.chunk_timer, 10));
         }
     } else if (curr_evt.type == DFU_EVENT_RECEIVED_UPDATE_REQUEST) { // The host dropped our previous ack to the image, and we need to sync up.
         configASSERT(xTimerStop(client_ctx.chunk_timer, 10));
         bm_dfu_send_ack(client_ctx.host_node_id, 1, BM_DFU_ERR_NONE);
         // Start image from the beginning
-        client_ctx.current_chunk = 0;
-        client_ctx.chunk_retry_num = 0;
-        client_ctx.img_page_byte_counter = 0;
-        client_ctx.img_flash_offset = 0;
-        client_ctx.running_crc16 = 0;
+        bm_dfu_client_rx_reset();
         vTaskDelay(100); // Allow host to process ACK and Get ready to send chunk.
-        bm_dfu_req_next_chunk(client_ctx.host_node_id, client_ctx.current_chunk);
+        if (client_ctx.multicast) {
+            // Keep any chunks already written, they can't be programmed twice.
+        } else if (client_ctx.window_size > 1) {
+            bm_dfu_client_window_start();
+        } else {
+            bm_dfu_req_next_chunk(client_ctx.host_node_id, client_ctx.current_chunk);
+        }
         configASSERT(xTimerStart(client_ctx.chunk_timer, 10));
     }
     /* TODO: (IMPLEMENT THIS PERIODICALLY ON HOST SIDE)
@@ -394,9 +902,16 @@ void s_client_receiving_run(void) {
  */
 void s_client_validating_entry(void)
 {
-    /* Verify image length */
-    if (client_ctx.image_size != client_ctx.img_flash_offset) {
-        printf("Rx Len: %" PRIu32 ", Actual Len: %" PRIu32 "\n", client_ctx.image_size, client_ctx.img_flash_offset);
+    /* Verify image length. A delta image must have been fully applied and a compressed image fully decompressed. */
+    uint32_t image_size = client_ctx.image_size;
+    if (client_ctx.delta) {
+        image_size = client_ctx.delta_ctx.header.target_size;
+    } else if (client_ctx.compressed) {
+        image_size = client_ctx.lz_ctx.header.size;
+    }
+    if (image_size != client_ctx.img_flash_offset || (client_ctx.delta && !bm_dfu_delta_done(&client_ctx.delta_ctx)) ||
+        (client_ctx.compressed && !bm_dfu_lz_done(&client_ctx.lz_ctx))) {
+        printf("Rx Len: %" PRIu32 ", Actual Len: %" PRIu32 "\n", image_size, client_ctx.img_flash_offset);
         bm_dfu_update_end(client_ctx.host_node_id, 0, BM_DFU_ERR_MISMATCH_LEN);
         bm_dfu_client_transition_to_error(BM_DFU_ERR_MISMATCH_LEN);
 
@@ -556,10 +1071,32 @@ void bm_dfu_client_init(bcmp_dfu_tx_func_t bcmp_dfu_tx)
     client_ctx.chunk_timer = xTimerCreate("DFU Client Chunk Timer", (BM_DFU_CLIENT_CHUNK_TIMEOUT_MS / portTICK_RATE_MS),
                                       pdFALSE, (void *) &tmr_id, chunk_timer_handler);
     configASSERT(client_ctx.chunk_timer);
+
+    client_ctx.max_window_size = BM_DFU_CLIENT_DEFAULT_WINDOW_SIZE;
+    client_ctx.window_size = 1;
+}
+
+/**
+ * @brief Set the largest window the client will request from a host
+ *
+ * @note Each held out-of-order chunk costs up to BM_DFU_MAX_CHUNK_SIZE bytes of heap,
+ *       so this bounds the client's reorder memory. A window of 1 disables windowed transfers.
+ *
+ * @param window_size    Window size in chunks, clamped to [1, BM_DFU_MAX_WINDOW_SIZE]
+ * @return none
+ */
+void bm_dfu_client_set_max_window_size(uint8_t window_size) {
+    if (window_size < 1) {
+        window_size = 1;
+    } else if (window_size > BM_DFU_MAX_WINDOW_SIZE) {
+        window_size = BM_DFU_MAX_WINDOW_SIZE;
+    }
+    client_ctx.max_window_size = window_size;
 }
 
 static void bm_dfu_client_transition_to_error(bm_dfu_err_t err) {
     configASSERT(xTimerStop(client_ctx.chunk_timer, 10));
+    bm_dfu_client_window_reset();
     bm_dfu_set_error(err);
     bm_dfu_set_pending_state_change(BM_DFU_STATE_ERROR);
 }
@@ -8,6 +8,7 @@ extern "C"
 #endif
 
 #define BM_DFU_CLIENT_CHUNK_TIMEOUT_MS  2000UL
+#define BM_DFU_CLIENT_DEFAULT_WINDOW_SIZE 8
 
 void bm_dfu_client_process_update_request(void);
 
@@ -25,6 +26,7 @@ void s_client_update_done_run(void);
 
 void bm_dfu_client_init(bcmp_dfu_tx_func_t bcmp_dfu_tx);
 bool bm_dfu_client_host_node_valid(uint64_t host_node_id);
+void bm_dfu_client_set_max_window_size(uint8_t window_size);
 
 #ifdef __cplusplus
 }
@@ -163,6 +163,15 @@ static void s_idle_run(void) {
         dfu_ctx.update_finish_callback = start_event->finish_cb;
         dfu_ctx.client_node_id = start_event->start.info.addresses.dst_node_id;
         bm_dfu_host_set_params(dfu_ctx.update_finish_callback, start_event->timeoutMs);
+        bm_dfu_host_set_multicast_clients(NULL, 0);
+        bm_dfu_set_pending_state_change(BM_DFU_STATE_HOST_REQ_UPDATE);
+    } else if(dfu_ctx.current_event.type == DFU_EVENT_BEGIN_HOST_MULTICAST) {
+        /* Host, updating several clients at once */
+        dfu_host_mcast_start_event_t *mcast_event = reinterpret_cast<dfu_host_mcast_start_event_t*>(dfu_ctx.current_event.buf);
+        dfu_ctx.update_finish_callback = mcast_event->start_event.finish_cb;
+        dfu_ctx.client_node_id = BM_DFU_MULTICAST_NODE_ID;
+        bm_dfu_host_set_params(dfu_ctx.update_finish_callback, mcast_event->start_event.timeoutMs);
+        bm_dfu_host_set_multicast_clients(mcast_event->node_ids, mcast_event->num_nodes);
         bm_dfu_set_pending_state_change(BM_DFU_STATE_HOST_REQ_UPDATE);
     }
 }
@@ -217,12 +226,19 @@ static void s_error_entry(void) {
         case BM_DFU_ERR_CONFIRMATION_ABORT:
             printf("BM Aborted Error During Reboot Confirmation\n");
             break;
+        case BM_DFU_ERR_DELTA_BASE:
+            printf("Delta image doesn't match the client's running image\n");
+            break;
+        case BM_DFU_ERR_COMPRESSION:
+            printf("Compressed image isn't supported by the client\n");
+            break;
         case BM_DFU_ERR_NONE:
         default:
             break;
     }
 
-    if(dfu_ctx.update_finish_callback) {
+    /* Multicast sessions report the result of each client from the host */
+    if(dfu_ctx.update_finish_callback && dfu_ctx.client_node_id != BM_DFU_MULTICAST_NODE_ID) {
         dfu_ctx.update_finish_callback(false, dfu_ctx.error, dfu_ctx.client_node_id);
     }
 
@@ -240,8 +256,11 @@ void bm_dfu_process_message(uint8_t *buf, size_t len) {
     bm_dfu_event_t evt;
     bm_dfu_frame_t *frame = reinterpret_cast<bm_dfu_frame_t *>(buf);
 
-    /* If this node is not the intended destination, then discard and continue to wait on queue */
-    if (dfu_ctx.self_node_id != (reinterpret_cast<bm_dfu_event_address_t *>(frame->payload))->dst_node_id) {
+    /* If this node is not the intended destination, then discard and continue to wait on queue.
+       Chunks multicast by a host are only of interest while receiving an image. */
+    uint64_t dst_node_id = (reinterpret_cast<bm_dfu_event_address_t *>(frame->payload))->dst_node_id;
+    if (dfu_ctx.self_node_id != dst_node_id &&
+        !(dst_node_id == BM_DFU_MULTICAST_NODE_ID && getCurrentStateEnum(dfu_ctx.sm_ctx) == BM_DFU_STATE_CLIENT_RECEIVING)) {
         vPortFree(buf);
         return;
     }
@@ -359,6 +378,20 @@ void bm_dfu_process_message(uint8_t *buf, size_t len) {
                 printf("Message could not be added to Queue\n");
             }
             break;
+        case BCMP_DFU_WINDOW_REQ:
+            evt.type = DFU_EVENT_WINDOW_REQUEST;
+            if(xQueueSend(dfu_event_queue, &evt, 0) != pdTRUE) {
+                vPortFree(buf);
+                printf("Message could not be added to Queue\n");
+            }
+            break;
+        case BCMP_DFU_WINDOW_PAYLOAD:
+            evt.type = DFU_EVENT_WINDOW_CHUNK;
+            if(xQueueSend(dfu_event_queue, &evt, 0) != pdTRUE) {
+                vPortFree(buf);
+                printf("Message could not be added to Queue\n");
+            }
+            break;
         default:
             configASSERT(false);
         }
@@ -458,6 +491,34 @@ void bm_dfu_req_next_chunk(uint64_t dst_node_id, uint16_t chunk_num)
     }
 }
 
+/**
+ * @brief Send Chunk Window Request
+ *
+ * @note Asks the host to stream a window of chunks. Also used as a selective NACK by
+ *       re-requesting a window with the chunks we already hold masked out.
+ *
+ * @param chunk_num     First image chunk number requested
+ * @param window_size   Number of chunks requested, starting at chunk_num
+ * @param received_mask Bit n set if chunk (chunk_num + n) does not need to be sent
+ * @return none
+ */
+void bm_dfu_req_chunk_window(uint64_t dst_node_id, uint16_t chunk_num, uint8_t window_size, uint16_t received_mask)
+{
+    bcmp_dfu_window_req_t window_req_msg;
+
+    /* Stuff Window Request Event */
+    window_req_msg.window_req.seq_num = chunk_num;
+    window_req_msg.window_req.window_size = window_size;
+    window_req_msg.window_req.received_mask = received_mask;
+    window_req_msg.window_req.addresses.src_node_id = dfu_ctx.self_node_id;
+    window_req_msg.window_req.addresses.dst_node_id = dst_node_id;
+    window_req_msg.header.frame_type = BCMP_DFU_WINDOW_REQ;
+
+    if(!dfu_ctx.bcmp_dfu_tx(static_cast<bcmp_message_type_t>(window_req_msg.header.frame_type), reinterpret_cast<uint8_t*>(&window_req_msg), sizeof(window_req_msg))){
+        printf("Failed to send message %d\n", window_req_msg.header.frame_type);
+    }
+}
+
 /**
  * @brief Send DFU END
  *
@@ -542,7 +603,7 @@ void bm_dfu_init(bcmp_dfu_tx_func_t bcmp_dfu_tx, NvmPartition * dfu_partition, c
     /* Set initial state of DFU State Machine*/
     libSmInit(dfu_ctx.sm_ctx, dfu_states[BM_DFU_STATE_INIT], bm_dfu_check_transitions);
 
-    dfu_event_queue = xQueueCreate( 5, sizeof(bm_dfu_event_t));
+    dfu_event_queue = xQueueCreate( BM_DFU_EVENT_QUEUE_LEN, sizeof(bm_dfu_event_t));
     configASSERT(dfu_event_queue);
 
     bm_dfu_client_init(bcmp_dfu_tx);
@@ -607,6 +668,76 @@ bool bm_dfu_initiate_update(bm_dfu_img_info_t info, uint64_t dest_node_id, updat
     return ret;
 }
 
+/**
+ * @brief Update several clients with a single stream of chunks
+ *
+ * @note Every chunk is sent once to BM_DFU_MULTICAST_NODE_ID, clients then request
+ *       whatever they missed from the host directly. update_finish_callback is called
+ *       once for each client as it finishes.
+ *
+ * @param info                      Image to send
+ * @param dest_node_ids             Clients to update
+ * @param num_nodes                 Number of clients, at most BM_DFU_MCAST_MAX_CLIENTS
+ * @param update_finish_callback    Called with the result for each client
+ * @param timeoutMs                 Timeout for the whole session
+ * @return true if the update was started, false otherwise
+ */
+bool bm_dfu_initiate_multicast_update(bm_dfu_img_info_t info, const uint64_t *dest_node_ids, uint8_t num_nodes, update_finish_cb_t update_finish_callback, uint32_t timeoutMs) {
+    bool ret = false;
+    do {
+        if(!dest_node_ids || num_nodes == 0 || num_nodes > BM_DFU_MCAST_MAX_CLIENTS) {
+            printf("Invalid client list for multicast DFU\n");
+            break;
+        }
+        if(info.chunk_size > BM_DFU_MAX_CHUNK_SIZE || info.chunk_size == 0 || (info.chunk_size % BM_DFU_MCAST_WRITE_ALIGN)) {
+            printf("Invalid chunk size for multicast DFU\n");
+            break;
+        }
+        if(((info.image_size + info.chunk_size - 1) / info.chunk_size) > BM_DFU_MCAST_MAX_CHUNKS) {
+            printf("Image has too many chunks for multicast DFU\n");
+            break;
+        }
+        if(getCurrentStateEnum(dfu_ctx.sm_ctx) != BM_DFU_STATE_IDLE) {
+            printf("Not ready to start update.\n");
+            if(update_finish_callback) {
+                for(uint8_t i = 0; i < num_nodes; i++) {
+                    update_finish_callback(false, BM_DFU_ERR_IN_PROGRESS, dest_node_ids[i]);
+                }
+            }
+            break;
+        }
+        bm_dfu_event_t evt;
+        size_t size = sizeof(dfu_host_mcast_start_event_t) + num_nodes * sizeof(uint64_t);
+        evt.type = DFU_EVENT_BEGIN_HOST_MULTICAST;
+        uint8_t *buf = static_cast<uint8_t*>(pvPortMalloc(size));
+        configASSERT(buf);
+
+        dfu_host_mcast_start_event_t *mcast_event = reinterpret_cast<dfu_host_mcast_start_event_t*>(buf);
+        mcast_event->start_event.start.header.frame_type = BCMP_DFU_START;
+        mcast_event->start_event.start.info.addresses.dst_node_id = BM_DFU_MULTICAST_NODE_ID;
+        mcast_event->start_event.start.info.addresses.src_node_id = dfu_ctx.self_node_id;
+        memcpy(&mcast_event->start_event.start.info.img_info, &info, sizeof(bm_dfu_img_info_t));
+        mcast_event->start_event.finish_cb = update_finish_callback;
+        mcast_event->start_event.timeoutMs = timeoutMs;
+        mcast_event->num_nodes = num_nodes;
+        memcpy(mcast_event->node_ids, dest_node_ids, num_nodes * sizeof(uint64_t));
+        evt.buf = buf;
+        evt.len = size;
+        if(xQueueSend(dfu_event_queue, &evt, 0) != pdTRUE) {
+            vPortFree(buf);
+            if(update_finish_callback) {
+                for(uint8_t i = 0; i < num_nodes; i++) {
+                    update_finish_callback(false, BM_DFU_ERR_IN_PROGRESS, dest_node_ids[i]);
+                }
+            }
+            printf("Message could not be added to Queue\n");
+            break;
+        }
+        ret = true;
+    } while(0);
+    return ret;
+}
+
 bm_dfu_err_t bm_dfu_get_error(void) {
     return dfu_ctx.error;
 }
@@ -0,0 +1,247 @@
+#define __STDC_FORMAT_MACROS
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "FreeRTOS.h"
+#include "bm_dfu_delta.h"
+#include "crc.h"
+
+enum {
+    DELTA_STATE_HEADER,
+    DELTA_STATE_OP,
+    DELTA_STATE_INSERT,
+    DELTA_STATE_DONE,
+    DELTA_STATE_ERROR,
+};
+
+/**
+ * @brief Accumulate a fixed size record that may be split across chunks
+ *
+ * @param ctx           Delta context
+ * @param record_len    Size of the record being accumulated
+ * @param buf           Incoming bytes, advanced past the consumed bytes
+ * @param len           Number of incoming bytes, decremented by the consumed bytes
+ * @return true once the full record is available in ctx->partial
+ */
+static bool bm_dfu_delta_fill_partial(bm_dfu_delta_ctx_t *ctx, uint8_t record_len,
+                                      const uint8_t *&buf, uint32_t &len) {
+    uint8_t needed = record_len - ctx->partial_len;
+    uint8_t take = (len < needed) ? static_cast<uint8_t>(len) : needed;
+    memcpy(reinterpret_cast<uint8_t *>(&ctx->partial) + ctx->partial_len, buf, take);
+    ctx->partial_len += take;
+    buf += take;
+    len -= take;
+    if (ctx->partial_len < record_len) {
+        return false;
+    }
+    ctx->partial_len = 0;
+    return true;
+}
+
+/**
+ * @brief Check that the image in the primary slot is the one the patch was made against
+ *
+ * @return BM_DFU_DELTA_OK if the base image matches
+ */
+static bm_dfu_delta_err_t bm_dfu_delta_check_base(bm_dfu_delta_ctx_t *ctx) {
+    if (ctx->header.base_git_sha != ctx->base_git_sha) {
+        printf("Delta base SHA %08" PRIX32 " does not match running image %08" PRIX32 "\n",
+               ctx->header.base_git_sha, ctx->base_git_sha);
+        return BM_DFU_DELTA_ERR_BASE;
+    }
+
+    uint16_t crc = 0;
+    uint32_t offset = 0;
+    while (offset < ctx->header.base_size) {
+        uint32_t len = ctx->header.base_size - offset;
+        if (len > BM_DFU_DELTA_COPY_BUF_LEN) {
+            len = BM_DFU_DELTA_COPY_BUF_LEN;
+        }
+        if (ctx->read_base(ctx->arg, offset, ctx->copy_buf, len)) {
+            return BM_DFU_DELTA_ERR_READ;
+        }
+        crc = crc16_ccitt(crc, ctx->copy_buf, len);
+        offset += len;
+    }
+    if (crc != ctx->header.base_crc16) {
+        printf("Delta base CRC %04X does not match primary slot %04X\n", ctx->header.base_crc16, crc);
+        return BM_DFU_DELTA_ERR_BASE;
+    }
+    return BM_DFU_DELTA_OK;
+}
+
+/**
+ * @brief Copy a range of the base image to the output
+ *
+ * @note Goes through a small fixed buffer so large copies don't need extra RAM.
+ *
+ * @return BM_DFU_DELTA_OK on success
+ */
+static bm_dfu_delta_err_t bm_dfu_delta_copy(bm_dfu_delta_ctx_t *ctx, uint32_t src_offset, uint32_t len) {
+    while (len) {
+        uint32_t block = (len > BM_DFU_DELTA_COPY_BUF_LEN) ? BM_DFU_DELTA_COPY_BUF_LEN : len;
+        if (ctx->read_base(ctx->arg, src_offset, ctx->copy_buf, block)) {
+            return BM_DFU_DELTA_ERR_READ;
+        }
+        if (ctx->write_out(ctx->arg, ctx->copy_buf, block)) {
+            return BM_DFU_DELTA_ERR_WRITE;
+        }
+        src_offset += block;
+        len -= block;
+        ctx->out_len += block;
+    }
+    return BM_DFU_DELTA_OK;
+}
+
+/**
+ * @brief Validate and run one operation
+ *
+ * @return BM_DFU_DELTA_OK on success
+ */
+static bm_dfu_delta_err_t bm_dfu_delta_run_op(bm_dfu_delta_ctx_t *ctx, const bm_dfu_delta_op_t *op) {
+    uint32_t out_remaining = ctx->header.target_size - ctx->out_len;
+    if (op->len == 0 || op->len > out_remaining) {
+        return BM_DFU_DELTA_ERR_FORMAT;
+    }
+
+    if (op->opcode == BM_DFU_DELTA_OP_COPY) {
+        if (op->src_offset > ctx->header.base_size || op->len > ctx->header.base_size - op->src_offset) {
+            return BM_DFU_DELTA_ERR_FORMAT;
+        }
+        bm_dfu_delta_err_t err = bm_dfu_delta_copy(ctx, op->src_offset, op->len);
+        if (err != BM_DFU_DELTA_OK) {
+            return err;
+        }
+        ctx->state = (ctx->out_len == ctx->header.target_size) ? DELTA_STATE_DONE : DELTA_STATE_OP;
+    } else if (op->opcode == BM_DFU_DELTA_OP_INSERT) {
+        ctx->insert_remaining = op->len;
+        ctx->state = DELTA_STATE_INSERT;
+    } else {
+        return BM_DFU_DELTA_ERR_FORMAT;
+    }
+    return BM_DFU_DELTA_OK;
+}
+
+/**
+ * @brief Prepare a context to apply a delta image
+ *
+ * @param ctx           Context to initialize
+ * @param read_base     Reads the base (currently running) image
+ * @param write_out     Appends to the reconstructed image
+ * @param arg           Passed to read_base and write_out
+ * @param base_git_sha  Git SHA of the running image, the patch must have been made against it
+ * @return none
+ */
+void bm_dfu_delta_init(bm_dfu_delta_ctx_t *ctx, bm_dfu_delta_read_t read_base,
+                       bm_dfu_delta_write_t write_out, void *arg, uint32_t base_git_sha) {
+    configASSERT(ctx);
+    configASSERT(read_base);
+    configASSERT(write_out);
+    memset(ctx, 0, sizeof(*ctx));
+    ctx->read_base = read_base;
+    ctx->write_out = write_out;
+    ctx->arg = arg;
+    ctx->base_git_sha = base_git_sha;
+    ctx->state = DELTA_STATE_HEADER;
+}
+
+/**
+ * @brief Apply the next piece of a delta image
+ *
+ * @note The patch can be fed in pieces of any size, in order. Output is produced as soon
+ *       as possible, so RAM use doesn't depend on the size of the image or the operations.
+ *
+ * @param ctx   Delta context
+ * @param buf   Next bytes of the patch
+ * @param len   Number of bytes in buf
+ * @return BM_DFU_DELTA_OK on success, otherwise the error that stopped the patch.
+ *         Once an error is returned every later call fails.
+ */
+bm_dfu_delta_err_t bm_dfu_delta_process(bm_dfu_delta_ctx_t *ctx, const uint8_t *buf, uint32_t len) {
+    configASSERT(ctx);
+    configASSERT(buf || len == 0);
+    bm_dfu_delta_err_t err = BM_DFU_DELTA_OK;
+
+    while (len && err == BM_DFU_DELTA_OK) {
+        switch (ctx->state) {
+            case DELTA_STATE_HEADER: {
+                if (!bm_dfu_delta_fill_partial(ctx, sizeof(bm_dfu_delta_header_t), buf, len)) {
+                    break;
+                }
+                memcpy(&ctx->header, &ctx->partial.header_buf, sizeof(bm_dfu_delta_header_t));
+                if (ctx->header.magic != BM_DFU_DELTA_MAGIC || ctx->header.version != BM_DFU_DELTA_VERSION ||
+                    ctx->header.target_size == 0) {
+                    err = BM_DFU_DELTA_ERR_FORMAT;
+                    break;
+                }
+                err = bm_dfu_delta_check_base(ctx);
+                ctx->state = DELTA_STATE_OP;
+                break;
+            }
+            case DELTA_STATE_OP: {
+                if (!bm_dfu_delta_fill_partial(ctx, sizeof(bm_dfu_delta_op_t), buf, len)) {
+                    break;
+                }
+                bm_dfu_delta_op_t op;
+                memcpy(&op, &ctx->partial.op_buf, sizeof(op));
+                err = bm_dfu_delta_run_op(ctx, &op);
+                break;
+            }
+            case DELTA_STATE_INSERT: {
+                uint32_t take = (len < ctx->insert_remaining) ? len : ctx->insert_remaining;
+                if (ctx->write_out(ctx->arg, buf, take)) {
+                    err = BM_DFU_DELTA_ERR_WRITE;
+                    break;
+                }
+                buf += take;
+                len -= take;
+                ctx->out_len += take;
+                ctx->insert_remaining -= take;
+                if (ctx->insert_remaining == 0) {
+                    ctx->state = (ctx->out_len == ctx->header.target_size) ? DELTA_STATE_DONE : DELTA_STATE_OP;
+                }
+                break;
+            }
+            case DELTA_STATE_DONE:
+                // Trailing bytes after the image is complete
+                err = BM_DFU_DELTA_ERR_FORMAT;
+                break;
+            case DELTA_STATE_ERROR:
+            default:
+                err = BM_DFU_DELTA_ERR_FORMAT;
+                break;
+        }
+    }
+
+    if (err != BM_DFU_DELTA_OK) {
+        ctx->state = DELTA_STATE_ERROR;
+    }
+    return err;
+}
+
+/**
+ * @brief Check if the whole target image has been produced
+ *
+ * @return true if the patch has been fully applied
+ */
+bool bm_dfu_delta_done(const bm_dfu_delta_ctx_t *ctx) {
+    configASSERT(ctx);
+    return ctx->state == DELTA_STATE_DONE;
+}
+
+/**
+ * @brief Check if an image is a delta image
+ *
+ * @param buf   Start of the image
+ * @param len   Number of bytes available in buf
+ * @return true if the image starts with a delta header
+ */
+bool bm_dfu_delta_is_delta_image(const uint8_t *buf, uint32_t len) {
+    uint32_t magic;
+    if (!buf || len < sizeof(magic)) {
+        return false;
+    }
+    memcpy(&magic, buf, sizeof(magic));
+    return magic == BM_DFU_DELTA_MAGIC;
+}
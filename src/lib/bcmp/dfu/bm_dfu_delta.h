@@ -0,0 +1,90 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Delta images start with this magic instead of an MCUboot image header ("BMDP")
+#define BM_DFU_DELTA_MAGIC (0x50444D42)
+#define BM_DFU_DELTA_VERSION 1
+
+// Bytes of base image read from flash at a time while copying from it
+#define BM_DFU_DELTA_COPY_BUF_LEN 256
+
+/*
+ * Delta image format (little endian)
+ *
+ * bm_dfu_delta_header_t, followed by operations until target_size bytes have been produced.
+ * Each operation is a bm_dfu_delta_op_t:
+ *   COPY   - copy len bytes from the base image starting at src_offset
+ *   INSERT - the next len bytes of the patch are copied to the output as is (src_offset unused)
+ *
+ * The base image is the image currently in the primary slot, identified by its
+ * git SHA, size, and CRC16.
+ */
+typedef struct {
+  uint32_t magic;
+  uint8_t version;
+  uint32_t base_size;
+  uint16_t base_crc16;
+  uint32_t base_git_sha;
+  uint32_t target_size;
+  uint16_t target_crc16;
+  uint8_t target_major;
+  uint8_t target_minor;
+  uint32_t target_git_sha;
+} __attribute__((packed)) bm_dfu_delta_header_t;
+
+typedef enum {
+  BM_DFU_DELTA_OP_COPY = 0,
+  BM_DFU_DELTA_OP_INSERT = 1,
+} bm_dfu_delta_opcode_t;
+
+typedef struct {
+  uint8_t opcode;
+  uint32_t len;
+  uint32_t src_offset;
+} __attribute__((packed)) bm_dfu_delta_op_t;
+
+typedef enum {
+  BM_DFU_DELTA_OK,
+  BM_DFU_DELTA_ERR_FORMAT,
+  BM_DFU_DELTA_ERR_BASE,
+  BM_DFU_DELTA_ERR_READ,
+  BM_DFU_DELTA_ERR_WRITE,
+} bm_dfu_delta_err_t;
+
+// Read len bytes of the base image at offset. Returns 0 on success.
+typedef int (*bm_dfu_delta_read_t)(void *arg, uint32_t offset, uint8_t *buf, uint32_t len);
+// Append len bytes to the reconstructed image. Returns 0 on success.
+typedef int (*bm_dfu_delta_write_t)(void *arg, const uint8_t *buf, uint32_t len);
+
+typedef struct {
+  bm_dfu_delta_read_t read_base;
+  bm_dfu_delta_write_t write_out;
+  void *arg;
+  uint32_t base_git_sha;
+  uint8_t state;
+  uint8_t partial_len;
+  union {
+    bm_dfu_delta_header_t header_buf;
+    bm_dfu_delta_op_t op_buf;
+  } partial;
+  bm_dfu_delta_header_t header;
+  uint32_t insert_remaining;
+  uint32_t out_len;
+  uint8_t copy_buf[BM_DFU_DELTA_COPY_BUF_LEN];
+} bm_dfu_delta_ctx_t;
+
+void bm_dfu_delta_init(bm_dfu_delta_ctx_t *ctx, bm_dfu_delta_read_t read_base,
+                       bm_dfu_delta_write_t write_out, void *arg, uint32_t base_git_sha);
+bm_dfu_delta_err_t bm_dfu_delta_process(bm_dfu_delta_ctx_t *ctx, const uint8_t *buf, uint32_t len);
+bool bm_dfu_delta_done(const bm_dfu_delta_ctx_t *ctx);
+bool bm_dfu_delta_is_delta_image(const uint8_t *buf, uint32_t len);
+
+#ifdef __cplusplus
+}
+#endif
@@ -1,12 +1,25 @@
 #include <stdio.h>
 #include <string.h>
 #include "bm_dfu.h"
+#include "bm_dfu_delta.h"
+#include "bm_dfu_lz.h"
 #include "bm_dfu_host.h"
 #include "device_info.h"
 #include "external_flash_partitions.h"
 #include "FreeRTOS.h"
 #include "timer_callback_handler.h"
 
+typedef enum {
+    MCAST_CLIENT_PENDING_ACK,
+    MCAST_CLIENT_ACTIVE,
+    MCAST_CLIENT_DONE,
+} bm_dfu_mcast_client_state_t;
+
+typedef struct {
+    uint64_t node_id;
+    uint8_t state;
+} bm_dfu_mcast_client_t;
+
 typedef struct dfu_host_ctx_t {
     QueueHandle_t dfu_event_queue;
     TimerHandle_t ack_timer;
@@ -21,6 +34,15 @@ typedef struct dfu_host_ctx_t {
     update_finish_cb_t update_complete_callback;
     TimerHandle_t update_timer;
     uint32_t host_timeout_ms;
+    /* Multicast session variables */
+    bool multicast;
+    uint8_t num_mcast_clients;
+    bm_dfu_mcast_client_t mcast_clients[BM_DFU_MCAST_MAX_CLIENTS];
+    uint16_t mcast_next_chunk;
+    /* Image in the DFU partition is a delta image */
+    bool delta;
+    /* Image in the DFU partition is compressed */
+    bool compressed;
 } dfu_host_ctx_t;
 
 static constexpr uint32_t FLASH_READ_TIMEOUT_MS = 5 * 1000;
@@ -31,10 +53,11 @@ static void ack_timer_handler(TimerHandle_t tmr);
 static void heartbeat_timer_handler(TimerHandle_t tmr);
 static void update_timer_handler(TimerHandle_t tmr);
 
-static void bm_dfu_host_req_update();
-static void bm_dfu_host_send_reboot();
+static void bm_dfu_host_req_update(uint64_t client_node_id);
+static void bm_dfu_host_send_reboot(uint64_t client_node_id);
 static void bm_dfu_host_transition_to_error(bm_dfu_err_t err);
 static void bm_dfu_host_start_update_timer(uint32_t timeoutMs);
+static void bm_dfu_host_mcast_fail_pending(bm_dfu_err_t err);
 
 /**
  * @brief ACK Timer Handler function
@@ -100,22 +123,35 @@ static void update_timer_handler(TimerHandle_t tmr) {
  *
  * @note Stuff Update Request bm_frame with image info and put into BM Serial TX Queue
  *
+ * @param client_node_id    Client to update
  * @return none
  */
-static void bm_dfu_host_req_update() {
-    bcmp_dfu_start_t update_start_req_evt;
+static void bm_dfu_host_req_update(uint64_t client_node_id) {
+    bcmp_dfu_start_ext_t update_start_req_evt;
 
     printf("Sending Update to Client\n");
 
     /* Populate the appropriate event */
-    update_start_req_evt.info.img_info = host_ctx.img_info;
-    update_start_req_evt.info.addresses.src_node_id = host_ctx.self_node_id;
-    update_start_req_evt.info.addresses.dst_node_id = host_ctx.client_node_id;
-    update_start_req_evt.header.frame_type = BCMP_DFU_START;
-    if(host_ctx.bcmp_dfu_tx(static_cast<bcmp_message_type_t>(update_start_req_evt.header.frame_type), reinterpret_cast<uint8_t *>(&update_start_req_evt), sizeof(update_start_req_evt))){
-        printf("Message %d sent \n",update_start_req_evt.header.frame_type);
+    update_start_req_evt.start.info.img_info = host_ctx.img_info;
+    update_start_req_evt.start.info.addresses.src_node_id = host_ctx.self_node_id;
+    update_start_req_evt.start.info.addresses.dst_node_id = client_node_id;
+    update_start_req_evt.start.header.frame_type = BCMP_DFU_START;
+    /* Clients that don't know about windowed transfers ignore the trailing options */
+    update_start_req_evt.max_window_size = BM_DFU_MAX_WINDOW_SIZE;
+    update_start_req_evt.flags = 0;
+    if (host_ctx.multicast) {
+        update_start_req_evt.flags |= BM_DFU_START_FLAG_MULTICAST;
+    }
+    if (host_ctx.delta) {
+        update_start_req_evt.flags |= BM_DFU_START_FLAG_DELTA;
+    }
+    if (host_ctx.compressed) {
+        update_start_req_evt.flags |= BM_DFU_START_FLAG_COMPRESSED;
+    }
+    if(host_ctx.bcmp_dfu_tx(static_cast<bcmp_message_type_t>(update_start_req_evt.start.header.frame_type), reinterpret_cast<uint8_t *>(&update_start_req_evt), sizeof(update_start_req_evt))){
+        printf("Message %d sent \n",update_start_req_evt.start.header.frame_type);
     } else {
-        printf("Failed to send message %d\n",update_start_req_evt.header.frame_type);
+        printf("Failed to send message %d\n",update_start_req_evt.start.header.frame_type);
     }
 }
 
@@ -157,15 +193,77 @@ static void bm_dfu_host_send_chunk(bm_dfu_event_chunk_request_t* req) {
     vPortFree(buf);
 }
 
+/**
+ * @brief Send a window of Chunks to Client
+ *
+ * @note Streams every chunk in the requested window that the client doesn't already hold,
+ *       back to back, without waiting for individual chunk requests.
+ *
+ * @param *req            Window request from the client
+ * @param dst_node_id     Client to send the window to, or BM_DFU_MULTICAST_NODE_ID
+ * @return true if every chunk was sent, false otherwise
+ */
+static bool bm_dfu_host_send_window(bm_dfu_event_window_request_t* req, uint64_t dst_node_id) {
+    bool rval = true;
+    uint32_t chunk_size = host_ctx.img_info.chunk_size;
+    configASSERT(chunk_size);
+    uint32_t num_chunks = (host_ctx.img_info.image_size + chunk_size - 1) / chunk_size;
+    uint8_t window_size = (req->window_size > BM_DFU_MAX_WINDOW_SIZE) ? BM_DFU_MAX_WINDOW_SIZE : req->window_size;
+
+    printf("Processing chunk window %" PRIu16 "+%" PRIu8 " mask %04" PRIX16 "\n", req->seq_num, window_size, req->received_mask);
+
+    /* A single buffer is reused for every chunk in the window */
+    uint32_t buf_len = sizeof(bcmp_dfu_window_payload_t) + chunk_size;
+    uint8_t* buf = static_cast<uint8_t*>(pvPortMalloc(buf_len));
+    configASSERT(buf);
+    bcmp_dfu_window_payload_t *payload_header = reinterpret_cast<bcmp_dfu_window_payload_t *>(buf);
+    payload_header->header.frame_type = BCMP_DFU_WINDOW_PAYLOAD;
+    payload_header->chunk.addresses.src_node_id = host_ctx.self_node_id;
+    payload_header->chunk.addresses.dst_node_id = dst_node_id;
+
+    for (uint8_t i = 0; i < window_size; i++) {
+        uint32_t seq_num = static_cast<uint32_t>(req->seq_num) + i;
+        if (seq_num >= num_chunks) {
+            break;
+        }
+        if (req->received_mask & (1U << i)) {
+            continue;
+        }
+        uint32_t img_offset = seq_num * chunk_size;
+        uint32_t payload_len = host_ctx.img_info.image_size - img_offset;
+        if (payload_len > chunk_size) {
+            payload_len = chunk_size;
+        }
+        payload_header->chunk.seq_num = static_cast<uint16_t>(seq_num);
+        payload_header->chunk.payload_length = static_cast<uint16_t>(payload_len);
+        if(!host_ctx.dfu_partition->read(DFU_IMG_START_OFFSET_BYTES + img_offset, payload_header->chunk.payload_buf, payload_len, FLASH_READ_TIMEOUT_MS)){
+            printf("Failed to read chunk from flash.\n");
+            bm_dfu_host_transition_to_error(BM_DFU_ERR_FLASH_ACCESS);
+            rval = false;
+            break;
+        }
+        if(!host_ctx.bcmp_dfu_tx(static_cast<bcmp_message_type_t>(payload_header->header.frame_type), buf, sizeof(bcmp_dfu_window_payload_t) + payload_len)){
+            printf("Failed to send message %d\n",payload_header->header.frame_type);
+            bm_dfu_host_transition_to_error(BM_DFU_ERR_IMG_CHUNK_ACCESS);
+            rval = false;
+            break;
+        }
+    }
+
+    vPortFree(buf);
+    return rval;
+}
+
 /**
  * @brief Send an update reboot to Client
  *
+ * @param client_node_id    Client to reboot
  * @return none
  */
-static void bm_dfu_host_send_reboot() {
+static void bm_dfu_host_send_reboot(uint64_t client_node_id) {
     bcmp_dfu_reboot_t reboot_msg;
     reboot_msg.addr.src_node_id = host_ctx.self_node_id;
-    reboot_msg.addr.dst_node_id = host_ctx.client_node_id;
+    reboot_msg.addr.dst_node_id = client_node_id;
     reboot_msg.header.frame_type = BCMP_DFU_REBOOT;
     if(host_ctx.bcmp_dfu_tx(static_cast<bcmp_message_type_t>(reboot_msg.header.frame_type), reinterpret_cast<uint8_t*>(&reboot_msg), sizeof(bcmp_dfu_reboot_t))){
         printf("Message %d sent \n",reboot_msg.header.frame_type);
@@ -174,6 +272,146 @@ static void bm_dfu_host_send_reboot() {
     }
 }
 
+/**
+ * @brief Find a client in the multicast session
+ *
+ * @param node_id    Node id of the client
+ * @return Pointer to the client entry, NULL if the node isn't part of the session
+ */
+static bm_dfu_mcast_client_t* bm_dfu_host_mcast_find(uint64_t node_id) {
+    for (uint8_t i = 0; i < host_ctx.num_mcast_clients; i++) {
+        if (host_ctx.mcast_clients[i].node_id == node_id) {
+            return &host_ctx.mcast_clients[i];
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @brief Count the multicast clients in a given state
+ *
+ * @param state    bm_dfu_mcast_client_state_t to count
+ * @return number of clients in that state
+ */
+static uint8_t bm_dfu_host_mcast_count(uint8_t state) {
+    uint8_t count = 0;
+    for (uint8_t i = 0; i < host_ctx.num_mcast_clients; i++) {
+        if (host_ctx.mcast_clients[i].state == state) {
+            count++;
+        }
+    }
+    return count;
+}
+
+/**
+ * @brief Record the result for one multicast client
+ *
+ * @note The update complete callback is called at most once per client.
+ *
+ * @return none
+ */
+static void bm_dfu_host_mcast_finish_client(bm_dfu_mcast_client_t *client, bool success, bm_dfu_err_t err) {
+    configASSERT(client);
+    if (client->state == MCAST_CLIENT_DONE) {
+        return;
+    }
+    client->state = MCAST_CLIENT_DONE;
+    printf("Client %016" PRIx64 " update %s\n", client->node_id, success ? "succeeded" : "failed");
+    if (host_ctx.update_complete_callback) {
+        host_ctx.update_complete_callback(success, err, client->node_id);
+    }
+}
+
+/**
+ * @brief Fail every multicast client that hasn't finished yet
+ *
+ * @return none
+ */
+static void bm_dfu_host_mcast_fail_pending(bm_dfu_err_t err) {
+    for (uint8_t i = 0; i < host_ctx.num_mcast_clients; i++) {
+        bm_dfu_host_mcast_finish_client(&host_ctx.mcast_clients[i], false, err);
+    }
+}
+
+/**
+ * @brief Close the multicast session once every client has a result
+ *
+ * @return none
+ */
+static void bm_dfu_host_mcast_end_session(void) {
+    configASSERT(xTimerStop(host_ctx.update_timer, 100));
+    configASSERT(xTimerStop(host_ctx.heartbeat_timer, 10));
+    configASSERT(xTimerStop(host_ctx.ack_timer, 10));
+    bm_dfu_set_pending_state_change(BM_DFU_STATE_IDLE);
+}
+
+/**
+ * @brief Start streaming once every client has accepted or declined the update
+ *
+ * @return none
+ */
+static void bm_dfu_host_mcast_check_acks(void) {
+    if (bm_dfu_host_mcast_count(MCAST_CLIENT_PENDING_ACK)) {
+        return;
+    }
+    configASSERT(xTimerStop(host_ctx.ack_timer, 10));
+    if (bm_dfu_host_mcast_count(MCAST_CLIENT_ACTIVE)) {
+        bm_dfu_set_pending_state_change(BM_DFU_STATE_HOST_UPDATE);
+    } else {
+        printf("No clients accepted the update\n");
+        bm_dfu_host_mcast_end_session();
+    }
+}
+
+/**
+ * @brief Queue the next multicast burst
+ *
+ * @return none
+ */
+static void bm_dfu_host_mcast_post_send(void) {
+    bm_dfu_event_t evt = {DFU_EVENT_MCAST_SEND, NULL, 0};
+
+    if(xQueueSend(host_ctx.dfu_event_queue, &evt, 0) != pdTRUE) {
+        configASSERT(false);
+    }
+}
+
+/**
+ * @brief Multicast the next burst of chunks to every client
+ *
+ * @note Each chunk is sent once. Bursts are paced so the clients and any nodes in between
+ *       can drain their queues, and the rest of the image is sent from a new event so repair
+ *       requests from clients get interleaved with the stream.
+ *
+ * @return none
+ */
+static void bm_dfu_host_mcast_send_burst(void) {
+    uint32_t chunk_size = host_ctx.img_info.chunk_size;
+    configASSERT(chunk_size);
+    uint32_t num_chunks = (host_ctx.img_info.image_size + chunk_size - 1) / chunk_size;
+    if (host_ctx.mcast_next_chunk >= num_chunks) {
+        return;
+    }
+
+    bm_dfu_event_window_request_t burst;
+    burst.addresses.src_node_id = host_ctx.self_node_id;
+    burst.addresses.dst_node_id = BM_DFU_MULTICAST_NODE_ID;
+    burst.seq_num = host_ctx.mcast_next_chunk;
+    burst.window_size = BM_DFU_MAX_WINDOW_SIZE;
+    burst.received_mask = 0;
+    if (!bm_dfu_host_send_window(&burst, BM_DFU_MULTICAST_NODE_ID)) {
+        return;
+    }
+
+    host_ctx.mcast_next_chunk += BM_DFU_MAX_WINDOW_SIZE;
+    if (host_ctx.mcast_next_chunk < num_chunks) {
+        vTaskDelay(pdMS_TO_TICKS(BM_DFU_MCAST_BURST_INTERVAL_MS));
+        bm_dfu_host_mcast_post_send();
+    } else {
+        printf("Multicast stream complete, serving repairs\n");
+    }
+}
+
 /**
  * @brief Entry Function for the Request Update State
  *
@@ -195,16 +433,95 @@ void s_host_req_update_entry(void) {
     host_ctx.bytes_remaining = host_ctx.img_info.image_size;
     host_ctx.client_node_id = img_info_evt->addresses.dst_node_id;
 
-    printf("DFU Client Node Id: %016" PRIx64 "\n", host_ctx.client_node_id);
+    /* Delta and compressed images are sent like full images, but the client has to know to
+       apply or decompress them. A compressed image may hold a delta image. */
+    uint8_t magic_buf[sizeof(bm_dfu_lz_header_t)] = {};
+    uint8_t lz_flags = 0;
+    bool read_ok = host_ctx.dfu_partition->read(DFU_IMG_START_OFFSET_BYTES, magic_buf, sizeof(magic_buf), FLASH_READ_TIMEOUT_MS);
+    host_ctx.compressed = read_ok && bm_dfu_lz_is_compressed_image(magic_buf, sizeof(magic_buf), &lz_flags);
+    host_ctx.delta = read_ok && (host_ctx.compressed ? (lz_flags & BM_DFU_LZ_FLAG_DELTA) :
+                                                       bm_dfu_delta_is_delta_image(magic_buf, sizeof(magic_buf)));
+    if ((host_ctx.delta || host_ctx.compressed) && host_ctx.multicast) {
+        /* Multicast clients write chunks out of order, these have to be processed in order */
+        printf("Delta and compressed images can't be multicast\n");
+        bm_dfu_host_transition_to_error(BM_DFU_ERR_ABORTED);
+        return;
+    }
 
     host_ctx.ack_retry_num = 0;
-    /* Request Client Firmware Update */
-    bm_dfu_host_req_update();
+    if (host_ctx.multicast) {
+        printf("DFU multicast to %" PRIu8 " clients\n", host_ctx.num_mcast_clients);
+        /* Request Firmware Update from every client */
+        for (uint8_t i = 0; i < host_ctx.num_mcast_clients; i++) {
+            host_ctx.mcast_clients[i].state = MCAST_CLIENT_PENDING_ACK;
+            bm_dfu_host_req_update(host_ctx.mcast_clients[i].node_id);
+        }
+        /* Keep clients that already accepted from timing out while the others answer */
+        configASSERT(xTimerStart(host_ctx.heartbeat_timer, 10));
+    } else {
+        printf("DFU Client Node Id: %016" PRIx64 "\n", host_ctx.client_node_id);
+        /* Request Client Firmware Update */
+        bm_dfu_host_req_update(host_ctx.client_node_id);
+    }
 
     /* Kickoff ACK timeout */
     configASSERT(xTimerStart(host_ctx.ack_timer, 10));
 }
 
+/**
+ * @brief Run Function for the Request Update State in a multicast session
+ *
+ * @note Waits for every client to accept or decline the update, re-requesting only the clients
+ *       that haven't answered. Clients that never answer are dropped from the session.
+ *
+ * @return none
+ */
+static void bm_dfu_host_mcast_req_update_run(bm_dfu_event_t curr_evt) {
+    if (curr_evt.type == DFU_EVENT_ACK_RECEIVED) {
+        configASSERT(curr_evt.buf);
+        bm_dfu_frame_t *frame = reinterpret_cast<bm_dfu_frame_t *>(curr_evt.buf);
+        bm_dfu_event_result_t* result_evt = reinterpret_cast<bm_dfu_event_result_t*>(&(reinterpret_cast<uint8_t *>(frame))[1]);
+        bm_dfu_mcast_client_t *client = bm_dfu_host_mcast_find(result_evt->addresses.src_node_id);
+        if (client && client->state == MCAST_CLIENT_PENDING_ACK) {
+            if (result_evt->success) {
+                client->state = MCAST_CLIENT_ACTIVE;
+            } else {
+                bm_dfu_host_mcast_finish_client(client, false, static_cast<bm_dfu_err_t>(result_evt->err_code));
+            }
+        }
+        bm_dfu_host_mcast_check_acks();
+    } else if (curr_evt.type == DFU_EVENT_ACK_TIMEOUT) {
+        host_ctx.ack_retry_num++;
+
+        if (host_ctx.ack_retry_num >= BM_DFU_MAX_ACK_RETRIES) {
+            for (uint8_t i = 0; i < host_ctx.num_mcast_clients; i++) {
+                if (host_ctx.mcast_clients[i].state == MCAST_CLIENT_PENDING_ACK) {
+                    bm_dfu_host_mcast_finish_client(&host_ctx.mcast_clients[i], false, BM_DFU_ERR_TIMEOUT);
+                }
+            }
+            bm_dfu_host_mcast_check_acks();
+        } else {
+            for (uint8_t i = 0; i < host_ctx.num_mcast_clients; i++) {
+                if (host_ctx.mcast_clients[i].state == MCAST_CLIENT_PENDING_ACK) {
+                    bm_dfu_host_req_update(host_ctx.mcast_clients[i].node_id);
+                }
+            }
+            configASSERT(xTimerStart(host_ctx.ack_timer, 10));
+        }
+    } else if (curr_evt.type == DFU_EVENT_ABORT) {
+        if (curr_evt.buf) {
+            bcmp_dfu_abort_t* abort_evt = reinterpret_cast<bcmp_dfu_abort_t *>(curr_evt.buf);
+            bm_dfu_mcast_client_t *client = bm_dfu_host_mcast_find(abort_evt->err.addresses.src_node_id);
+            if (client) {
+                bm_dfu_host_mcast_finish_client(client, false, static_cast<bm_dfu_err_t>(abort_evt->err.err_code));
+            }
+            bm_dfu_host_mcast_check_acks();
+        } else {
+            bm_dfu_host_transition_to_error(BM_DFU_ERR_ABORTED);
+        }
+    }
+}
+
 /**
  * @brief Run Function for the Request Update State
  *
@@ -216,7 +533,9 @@ void s_host_req_update_run(void)
 {
     bm_dfu_event_t curr_evt = bm_dfu_get_current_event();
 
-    if (curr_evt.type == DFU_EVENT_ACK_RECEIVED) {
+    if (host_ctx.multicast) {
+        bm_dfu_host_mcast_req_update_run(curr_evt);
+    } else if (curr_evt.type == DFU_EVENT_ACK_RECEIVED) {
         /* Stop ACK Timer */
         configASSERT(xTimerStop(host_ctx.ack_timer, 10));
         configASSERT(curr_evt.buf);
@@ -235,7 +554,7 @@ void s_host_req_update_run(void)
         if (host_ctx.ack_retry_num >= BM_DFU_MAX_ACK_RETRIES) {
             bm_dfu_host_transition_to_error(BM_DFU_ERR_TIMEOUT);
         } else {
-            bm_dfu_host_req_update();
+            bm_dfu_host_req_update(host_ctx.client_node_id);
             configASSERT(xTimerStart(host_ctx.ack_timer, 10));
         }
     } else if (curr_evt.type == DFU_EVENT_ABORT) {
@@ -259,6 +578,65 @@ void s_host_req_update_run(void)
  */
 void s_host_update_entry(void) {
     bm_dfu_host_start_update_timer(host_ctx.host_timeout_ms);
+    if (host_ctx.multicast) {
+        /* Chunks keep the clients alive from here on. Clients rely on their chunk timer
+           expiring to notice they missed the end of the stream. */
+        configASSERT(xTimerStop(host_ctx.heartbeat_timer, 10));
+        host_ctx.mcast_next_chunk = 0;
+        bm_dfu_host_mcast_post_send();
+    }
+}
+
+/**
+ * @brief Run Function for the Update State in a multicast session
+ *
+ * @note Streams the image once to every client, serves unicast repair requests, and walks each
+ *       client through the reboot handshake. Returns to idle once every client has a result.
+ *
+ * @return none
+ */
+static void bm_dfu_host_mcast_update_run(bm_dfu_event_t curr_evt) {
+    if (curr_evt.type == DFU_EVENT_MCAST_SEND) {
+        bm_dfu_host_mcast_send_burst();
+        return;
+    }
+
+    if (!curr_evt.buf) {
+        if (curr_evt.type == DFU_EVENT_ABORT) {
+            printf("Multicast update timed out.\n");
+            bm_dfu_host_transition_to_error(BM_DFU_ERR_TIMEOUT);
+        }
+        return;
+    }
+
+    bm_dfu_frame_t *frame = reinterpret_cast<bm_dfu_frame_t *>(curr_evt.buf);
+    bm_dfu_event_address_t *addresses = reinterpret_cast<bm_dfu_event_address_t *>(frame->payload);
+    bm_dfu_mcast_client_t *client = bm_dfu_host_mcast_find(addresses->src_node_id);
+    if (!client) {
+        return;
+    }
+
+    if (curr_evt.type == DFU_EVENT_WINDOW_REQUEST) {
+        if (client->state == MCAST_CLIENT_ACTIVE) {
+            bm_dfu_event_window_request_t* window_req_evt = reinterpret_cast<bm_dfu_event_window_request_t*>(&(reinterpret_cast<uint8_t *>(frame))[1]);
+            bm_dfu_host_send_window(window_req_evt, client->node_id);
+        }
+    } else if (curr_evt.type == DFU_EVENT_REBOOT_REQUEST) {
+        bm_dfu_host_send_reboot(client->node_id);
+    } else if (curr_evt.type == DFU_EVENT_BOOT_COMPLETE) {
+        bm_dfu_update_end(client->node_id, true, BM_DFU_ERR_NONE);
+    } else if (curr_evt.type == DFU_EVENT_UPDATE_END) {
+        bm_dfu_event_result_t* update_end_evt = reinterpret_cast<bm_dfu_event_result_t*>(&(reinterpret_cast<uint8_t *>(frame))[1]);
+        bm_dfu_host_mcast_finish_client(client, update_end_evt->success, static_cast<bm_dfu_err_t>(update_end_evt->err_code));
+    } else if (curr_evt.type == DFU_EVENT_ABORT) {
+        bcmp_dfu_abort_t* abort_evt = reinterpret_cast<bcmp_dfu_abort_t *>(curr_evt.buf);
+        bm_dfu_host_mcast_finish_client(client, false, static_cast<bm_dfu_err_t>(abort_evt->err.err_code));
+    }
+
+    if (bm_dfu_host_mcast_count(MCAST_CLIENT_DONE) == host_ctx.num_mcast_clients) {
+        printf("Multicast update finished\n");
+        bm_dfu_host_mcast_end_session();
+    }
 }
 
 /**
@@ -272,6 +650,11 @@ void s_host_update_run(void) {
     bm_dfu_frame_t *frame = NULL;
     bm_dfu_event_t curr_evt = bm_dfu_get_current_event();
 
+    if (host_ctx.multicast) {
+        bm_dfu_host_mcast_update_run(curr_evt);
+        return;
+    }
+
     /* Check if we even have a buf to inspect */
     if (curr_evt.buf) {
         frame = reinterpret_cast<bm_dfu_frame_t *>(curr_evt.buf);
@@ -288,10 +671,20 @@ void s_host_update_run(void) {
         /* resend the frame to the client as is */
         bm_dfu_host_send_chunk(chunk_req_evt);
 
+        configASSERT(xTimerStop(host_ctx.heartbeat_timer, 10));
+    } else if (curr_evt.type == DFU_EVENT_WINDOW_REQUEST) {
+        configASSERT(frame);
+        bm_dfu_event_window_request_t* window_req_evt = reinterpret_cast<bm_dfu_event_window_request_t*>(&(reinterpret_cast<uint8_t *>(frame))[1]);
+
+        /* Send Heartbeat to Client while streaming the window */
+        configASSERT(xTimerStart(host_ctx.heartbeat_timer, 10));
+
+        bm_dfu_host_send_window(window_req_evt, host_ctx.client_node_id);
+
         configASSERT(xTimerStop(host_ctx.heartbeat_timer, 10));
     } else if (curr_evt.type == DFU_EVENT_REBOOT_REQUEST) {
         configASSERT(frame);
-        bm_dfu_host_send_reboot();
+        bm_dfu_host_send_reboot(host_ctx.client_node_id);
     } else if (curr_evt.type == DFU_EVENT_BOOT_COMPLETE) {
         configASSERT(frame);
         bm_dfu_update_end(host_ctx.client_node_id, true, BM_DFU_ERR_NONE);
@@ -353,6 +746,26 @@ void bm_dfu_host_set_params(update_finish_cb_t update_complete_callback, uint32_
     host_ctx.host_timeout_ms = hostTimeoutMs;
 }
 
+/**
+ * @brief Set the clients for the next update
+ *
+ * @note A non-empty list makes the next update a multicast session to those clients.
+ *
+ * @param client_node_ids    Clients to update, NULL for a regular single client update
+ * @param num_clients        Number of clients, at most BM_DFU_MCAST_MAX_CLIENTS
+ * @return none
+ */
+void bm_dfu_host_set_multicast_clients(const uint64_t *client_node_ids, uint8_t num_clients) {
+    configASSERT(num_clients <= BM_DFU_MCAST_MAX_CLIENTS);
+    configASSERT(client_node_ids || num_clients == 0);
+    host_ctx.multicast = (num_clients > 0);
+    host_ctx.num_mcast_clients = num_clients;
+    for (uint8_t i = 0; i < num_clients; i++) {
+        host_ctx.mcast_clients[i].node_id = client_node_ids[i];
+        host_ctx.mcast_clients[i].state = MCAST_CLIENT_PENDING_ACK;
+    }
+}
+
 static void bm_dfu_host_start_update_timer(uint32_t timeoutMs) {
     configASSERT(xTimerStop(host_ctx.update_timer, 100));
     configASSERT(xTimerChangePeriod(host_ctx.update_timer, pdMS_TO_TICKS(timeoutMs), 100));
@@ -363,10 +776,16 @@ static void bm_dfu_host_transition_to_error(bm_dfu_err_t err) {
     configASSERT(xTimerStop(host_ctx.update_timer, 100));
     configASSERT(xTimerStop(host_ctx.heartbeat_timer, 10));
     configASSERT(xTimerStop(host_ctx.ack_timer, 10));
+    if (host_ctx.multicast) {
+        bm_dfu_host_mcast_fail_pending(err);
+    }
     bm_dfu_set_error(err);
     bm_dfu_set_pending_state_change(BM_DFU_STATE_ERROR);
 }
 
 bool bm_dfu_host_client_node_valid(uint64_t client_node_id) {
+    if (host_ctx.multicast) {
+        return bm_dfu_host_mcast_find(client_node_id) != NULL;
+    }
     return host_ctx.client_node_id == client_node_id;
 }
@@ -18,6 +18,7 @@ extern "C"
 #define BM_DFU_HOST_ACK_TIMEOUT_MS          10000UL
 #define BM_DFU_HOST_HEARTBEAT_TIMEOUT_MS    1000UL
 #define BM_DFU_UPDATE_DEFAULT_TIMEOUT_MS    (5 * 60 * 1000)
+#define BM_DFU_MCAST_BURST_INTERVAL_MS      50UL
 
 typedef int (*bm_dfu_chunk_req_cb)(uint16_t chunk_num, uint16_t *chunk_len, uint8_t *buf, uint16_t buf_len);
 
@@ -28,6 +29,7 @@ void s_host_update_run(void);
 
 void bm_dfu_host_init(bcmp_dfu_tx_func_t bcmp_dfu_tx, NvmPartition * dfu_partition);
 void bm_dfu_host_set_params(update_finish_cb_t update_complete_callback, uint32_t hostTimeoutMs);
+void bm_dfu_host_set_multicast_clients(const uint64_t *client_node_ids, uint8_t num_clients);
 bool bm_dfu_host_client_node_valid(uint64_t client_node_id);
 
 #ifdef __cplusplus
@@ -0,0 +1,221 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "FreeRTOS.h"
+#include "bm_dfu_lz.h"
+
+#define WINDOW_MASK (BM_DFU_LZ_WINDOW_LEN - 1)
+
+enum {
+    LZ_STATE_HEADER,
+    LZ_STATE_CONTROL,
+    LZ_STATE_ITEM,
+    LZ_STATE_REF_HI,
+    LZ_STATE_DONE,
+    LZ_STATE_ERROR,
+};
+
+/**
+ * @brief Hand decoded bytes that haven't been written yet to write_out
+ *
+ * @note Decoded bytes live in the window until they are flushed, so no other buffer is needed.
+ *
+ * @return BM_DFU_LZ_OK on success
+ */
+static bm_dfu_lz_err_t bm_dfu_lz_flush(bm_dfu_lz_ctx_t *ctx) {
+    while (ctx->flushed_len != ctx->out_len) {
+        uint32_t start = ctx->flushed_len & WINDOW_MASK;
+        uint32_t len = ctx->out_len - ctx->flushed_len;
+        if (len > BM_DFU_LZ_WINDOW_LEN - start) {
+            len = BM_DFU_LZ_WINDOW_LEN - start;
+        }
+        if (ctx->write_out(ctx->arg, &ctx->window[start], len)) {
+            return BM_DFU_LZ_ERR_WRITE;
+        }
+        ctx->flushed_len += len;
+    }
+    return BM_DFU_LZ_OK;
+}
+
+/**
+ * @brief Add one decoded byte to the window
+ *
+ * @return BM_DFU_LZ_OK on success
+ */
+static inline bm_dfu_lz_err_t bm_dfu_lz_put(bm_dfu_lz_ctx_t *ctx, uint8_t byte) {
+    ctx->window[ctx->out_len & WINDOW_MASK] = byte;
+    ctx->out_len++;
+    if (ctx->out_len - ctx->flushed_len == BM_DFU_LZ_FLUSH_LEN) {
+        return bm_dfu_lz_flush(ctx);
+    }
+    return BM_DFU_LZ_OK;
+}
+
+/**
+ * @brief Validate and copy a back reference
+ *
+ * @return BM_DFU_LZ_OK on success
+ */
+static bm_dfu_lz_err_t bm_dfu_lz_copy_ref(bm_dfu_lz_ctx_t *ctx, uint16_t ref) {
+    uint8_t window_bits = ctx->header.window_bits;
+    uint32_t distance = (ref & ((1u << window_bits) - 1)) + 1;
+    uint32_t len = (static_cast<uint32_t>(ref) >> window_bits) + BM_DFU_LZ_MIN_MATCH;
+    if (distance > ctx->out_len || len > ctx->header.size - ctx->out_len) {
+        return BM_DFU_LZ_ERR_FORMAT;
+    }
+
+    bm_dfu_lz_err_t err = BM_DFU_LZ_OK;
+    while (len-- && err == BM_DFU_LZ_OK) {
+        err = bm_dfu_lz_put(ctx, ctx->window[(ctx->out_len - distance) & WINDOW_MASK]);
+    }
+    return err;
+}
+
+/**
+ * @brief Prepare a context to decompress an image
+ *
+ * @param ctx           Context to initialize
+ * @param write_out     Appends to the decompressed image
+ * @param arg           Passed to write_out
+ * @return none
+ */
+void bm_dfu_lz_init(bm_dfu_lz_ctx_t *ctx, bm_dfu_lz_write_t write_out, void *arg) {
+    configASSERT(ctx);
+    configASSERT(write_out);
+    ctx->write_out = write_out;
+    ctx->arg = arg;
+    ctx->state = LZ_STATE_HEADER;
+    ctx->header_len = 0;
+    ctx->control = 0;
+    ctx->items_left = 0;
+    ctx->ref_lo = 0;
+    ctx->out_len = 0;
+    ctx->flushed_len = 0;
+}
+
+/**
+ * @brief Decompress the next piece of a compressed image
+ *
+ * @note The image can be fed in pieces of any size, in order. All bytes decoded
+ *       from buf have been passed to write_out when this returns.
+ *
+ * @param ctx   Decompression context
+ * @param buf   Next bytes of the compressed image
+ * @param len   Number of bytes in buf
+ * @return BM_DFU_LZ_OK on success, otherwise the error that stopped decompression.
+ *         Once an error is returned every later call fails.
+ */
+bm_dfu_lz_err_t bm_dfu_lz_process(bm_dfu_lz_ctx_t *ctx, const uint8_t *buf, uint32_t len) {
+    configASSERT(ctx);
+    configASSERT(buf || len == 0);
+    bm_dfu_lz_err_t err = BM_DFU_LZ_OK;
+
+    while (len && err == BM_DFU_LZ_OK) {
+        switch (ctx->state) {
+            case LZ_STATE_HEADER: {
+                uint8_t take = sizeof(bm_dfu_lz_header_t) - ctx->header_len;
+                if (len < take) {
+                    take = static_cast<uint8_t>(len);
+                }
+                memcpy(reinterpret_cast<uint8_t *>(&ctx->header) + ctx->header_len, buf, take);
+                ctx->header_len += take;
+                buf += take;
+                len -= take;
+                if (ctx->header_len < sizeof(bm_dfu_lz_header_t)) {
+                    break;
+                }
+                if (ctx->header.magic != BM_DFU_LZ_MAGIC || ctx->header.version != BM_DFU_LZ_VERSION ||
+                    ctx->header.size == 0) {
+                    err = BM_DFU_LZ_ERR_FORMAT;
+                } else if (ctx->header.window_bits < BM_DFU_LZ_MIN_WINDOW_BITS ||
+                           ctx->header.window_bits > BM_DFU_LZ_MAX_WINDOW_BITS) {
+                    printf("Unsupported compression window %u bits\n", ctx->header.window_bits);
+                    err = BM_DFU_LZ_ERR_WINDOW;
+                }
+                ctx->state = LZ_STATE_CONTROL;
+                break;
+            }
+            case LZ_STATE_CONTROL:
+                ctx->control = *buf++;
+                len--;
+                ctx->items_left = 8;
+                ctx->state = LZ_STATE_ITEM;
+                break;
+            case LZ_STATE_ITEM: {
+                uint8_t byte = *buf++;
+                len--;
+                bool literal = ctx->control & 1;
+                ctx->control >>= 1;
+                ctx->items_left--;
+                if (literal) {
+                    err = bm_dfu_lz_put(ctx, byte);
+                    ctx->state = ctx->items_left ? LZ_STATE_ITEM : LZ_STATE_CONTROL;
+                } else {
+                    ctx->ref_lo = byte;
+                    ctx->state = LZ_STATE_REF_HI;
+                }
+                break;
+            }
+            case LZ_STATE_REF_HI: {
+                uint16_t ref = static_cast<uint16_t>(ctx->ref_lo | (*buf++ << 8));
+                len--;
+                err = bm_dfu_lz_copy_ref(ctx, ref);
+                ctx->state = ctx->items_left ? LZ_STATE_ITEM : LZ_STATE_CONTROL;
+                break;
+            }
+            case LZ_STATE_DONE:
+                // Trailing bytes after the image is complete
+                err = BM_DFU_LZ_ERR_FORMAT;
+                break;
+            case LZ_STATE_ERROR:
+            default:
+                err = BM_DFU_LZ_ERR_FORMAT;
+                break;
+        }
+
+        if (err == BM_DFU_LZ_OK && ctx->state != LZ_STATE_HEADER && ctx->out_len == ctx->header.size) {
+            ctx->state = LZ_STATE_DONE;
+        }
+    }
+
+    if (err == BM_DFU_LZ_OK) {
+        err = bm_dfu_lz_flush(ctx);
+    }
+    if (err != BM_DFU_LZ_OK) {
+        ctx->state = LZ_STATE_ERROR;
+    }
+    return err;
+}
+
+/**
+ * @brief Check if the whole image has been decompressed
+ *
+ * @return true if size bytes have been decoded and written
+ */
+bool bm_dfu_lz_done(const bm_dfu_lz_ctx_t *ctx) {
+    configASSERT(ctx);
+    return ctx->state == LZ_STATE_DONE && ctx->flushed_len == ctx->header.size;
+}
+
+/**
+ * @brief Check if an image is a compressed image
+ *
+ * @param buf   Start of the image
+ * @param len   Number of bytes available in buf
+ * @param flags Set to the header flags if the image is compressed, can be NULL
+ * @return true if the image starts with a compressed image header
+ */
+bool bm_dfu_lz_is_compressed_image(const uint8_t *buf, uint32_t len, uint8_t *flags) {
+    bm_dfu_lz_header_t header;
+    if (!buf || len < sizeof(header)) {
+        return false;
+    }
+    memcpy(&header, buf, sizeof(header));
+    if (header.magic != BM_DFU_LZ_MAGIC) {
+        return false;
+    }
+    if (flags) {
+        *flags = header.flags;
+    }
+    return true;
+}
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Compressed images start with this magic instead of an MCUboot image header ("BMLZ")
+#define BM_DFU_LZ_MAGIC (0x5A4C4D42)
+#define BM_DFU_LZ_VERSION 1
+
+// Back reference distances are window_bits wide, the rest of the 16 bit reference is the length
+#define BM_DFU_LZ_MIN_WINDOW_BITS 8
+// Largest window a client can decode, sets the size of the decode buffer.
+// See tools/scripts/dfu/bm_dfu_compress.py bench for the ratio each window size gets.
+#ifndef BM_DFU_LZ_MAX_WINDOW_BITS
+#define BM_DFU_LZ_MAX_WINDOW_BITS 11
+#endif
+#define BM_DFU_LZ_WINDOW_LEN (1 << BM_DFU_LZ_MAX_WINDOW_BITS)
+#define BM_DFU_LZ_MIN_MATCH 3
+
+// Decoded bytes are handed to write_out at most this many at a time
+#define BM_DFU_LZ_FLUSH_LEN 256
+
+// Header flags
+#define BM_DFU_LZ_FLAG_DELTA (1 << 0) // The decompressed image is a delta image (bm_dfu_delta.h)
+
+/*
+ * Compressed image format (little endian)
+ *
+ * bm_dfu_lz_header_t, followed by groups of up to 8 items until size bytes have been decoded.
+ * Each group starts with a control byte, bit n (LSB first) describes item n:
+ *   1 - literal, one byte copied to the output
+ *   0 - back reference, a uint16_t with the distance - 1 in the low window_bits bits
+ *       and the length - BM_DFU_LZ_MIN_MATCH in the remaining bits
+ */
+typedef struct {
+  uint32_t magic;
+  uint8_t version;
+  uint8_t window_bits;
+  uint8_t flags;
+  uint32_t size;
+} __attribute__((packed)) bm_dfu_lz_header_t;
+
+typedef enum {
+  BM_DFU_LZ_OK,
+  BM_DFU_LZ_ERR_FORMAT,
+  BM_DFU_LZ_ERR_WINDOW,
+  BM_DFU_LZ_ERR_WRITE,
+} bm_dfu_lz_err_t;
+
+// Append len bytes to the decompressed image. Returns 0 on success.
+typedef int (*bm_dfu_lz_write_t)(void *arg, const uint8_t *buf, uint32_t len);
+
+typedef struct {
+  bm_dfu_lz_write_t write_out;
+  void *arg;
+  uint8_t state;
+  uint8_t header_len;
+  bm_dfu_lz_header_t header;
+  uint8_t control;
+  uint8_t items_left;
+  uint8_t ref_lo;
+  uint32_t out_len;
+  uint32_t flushed_len;
+  uint8_t window[BM_DFU_LZ_WINDOW_LEN];
+} bm_dfu_lz_ctx_t;
+
+void bm_dfu_lz_init(bm_dfu_lz_ctx_t *ctx, bm_dfu_lz_write_t write_out, void *arg);
+bm_dfu_lz_err_t bm_dfu_lz_process(bm_dfu_lz_ctx_t *ctx, const uint8_t *buf, uint32_t len);
+bool bm_dfu_lz_done(const bm_dfu_lz_ctx_t *ctx);
+bool bm_dfu_lz_is_compressed_image(const uint8_t *buf, uint32_t len, uint8_t *flags);
+
+#ifdef __cplusplus
+}
+#endif
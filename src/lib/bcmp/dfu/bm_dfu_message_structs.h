@@ -13,6 +13,11 @@ typedef struct __attribute__((__packed__)) bm_dfu_img_info_s {
 
 #define BM_DFU_IMG_INFO_FORCE_UPDATE (0x4CEDc0fe)
 
+// Update request flags (bcmp_dfu_start_ext_t::flags)
+#define BM_DFU_START_FLAG_MULTICAST (1 << 0) // Chunks are streamed once to every client in the session
+#define BM_DFU_START_FLAG_DELTA (1 << 1) // The image is a delta against the client's running image (bm_dfu_delta.h)
+#define BM_DFU_START_FLAG_COMPRESSED (1 << 2) // The image is compressed, clients decompress it as it arrives (bm_dfu_lz.h)
+
 typedef struct __attribute__((__packed__)) bm_dfu_frame_header_s {
     uint8_t frame_type;
 } bm_dfu_frame_header_t;
@@ -42,6 +47,20 @@ typedef struct __attribute__((__packed__)) bm_dfu_event_image_chunk_s {
     uint8_t payload_buf[0];
 } bm_dfu_event_image_chunk_t;
 
+typedef struct __attribute__((__packed__)) bm_dfu_event_window_request_s {
+    bm_dfu_event_address_t addresses;
+    uint16_t seq_num; // First chunk of the requested window
+    uint8_t window_size; // Number of chunks requested, starting at seq_num
+    uint16_t received_mask; // Bit n is set if the client already holds chunk (seq_num + n)
+} bm_dfu_event_window_request_t;
+
+typedef struct __attribute__((__packed__)) bm_dfu_event_window_chunk_s {
+    bm_dfu_event_address_t addresses;
+    uint16_t seq_num;
+    uint16_t payload_length;
+    uint8_t payload_buf[0];
+} bm_dfu_event_window_chunk_t;
+
 typedef struct __attribute__((__packed__)) bm_dfu_result_s {
     bm_dfu_event_address_t addresses;
     uint8_t success;
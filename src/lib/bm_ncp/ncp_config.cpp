@@ -27,14 +27,18 @@ bool ncp_cfg_get_cb(uint64_t node_id, bm_common_config_partition_e partition, si
     uint8_t *valueBuf = NULL;
     do {
         if (node_id == getNodeId() || node_id == 0) {
-            valueBuf = reinterpret_cast<uint8_t*>(pvPortMalloc(MAX_CONFIG_BUFFER_SIZE_BYTES));
-            configASSERT(valueBuf);
             Configuration* p = get_partition(partition);
             if(!p) {
                 printf("Invalid partition\n.");
                 break;
             }
-            size_t value_len = MAX_CONFIG_BUFFER_SIZE_BYTES;
+            size_t value_len;
+            if(!p->getCborValueSize(key, key_len, value_len)){
+                printf("Failed to get config.\n");
+                break;
+            }
+            valueBuf = reinterpret_cast<uint8_t*>(pvPortMalloc(value_len));
+            configASSERT(valueBuf);
             if(!p->getConfigCbor(key, key_len, valueBuf, value_len)){
                 printf("Failed to get config.\n");
                 break;
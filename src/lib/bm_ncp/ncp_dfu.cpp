@@ -177,11 +177,26 @@ bool ncp_dfu_start_cb(bm_serial_dfu_start_t *dfu_start) {
 
 bool ncp_dfu_chunk_cb(uint32_t offset, size_t length, uint8_t *data) {
   bool rval = false;
-  if (_ctx.dfu_cli_partition->write(DFU_IMG_START_OFFSET_BYTES + offset, data, length,
-                                    FLASH_WRITE_READ_TIMEOUT_MS)) {
+  bool written = false;
+  uint32_t flash_offset = DFU_IMG_START_OFFSET_BYTES + offset;
+  // Chunks come in order, so the image is appended and only page programmed
+  if (offset == 0) {
+    _ctx.dfu_cli_partition->appendStart(flash_offset, FLASH_WRITE_READ_TIMEOUT_MS);
+  }
+  if (_ctx.dfu_cli_partition->appending() &&
+      _ctx.dfu_cli_partition->appendOffset() == flash_offset) {
+    written = _ctx.dfu_cli_partition->append(data, length, FLASH_WRITE_READ_TIMEOUT_MS);
+  } else {
+    // Resent or out of order chunks
+    written = _ctx.dfu_cli_partition->write(flash_offset, data, length,
+                                            FLASH_WRITE_READ_TIMEOUT_MS);
+  }
+  if (written) {
     if (bm_serial_dfu_send_chunk(offset, 0, NULL) == BM_SERIAL_OK) {
       rval = true;
     }
+    // While the host sends the next chunk
+    _ctx.dfu_cli_partition->appendEraseAhead(FLASH_WRITE_READ_TIMEOUT_MS);
   } else {
     bm_serial_dfu_send_chunk(offset | DFU_CHUNK_NAK_BITFLAG, 0, NULL);
   }
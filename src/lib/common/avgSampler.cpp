@@ -6,6 +6,8 @@ AveragingSampler::AveragingSampler() {
   _fullBuffer = false;
   _maxSamples = 0;
   _samples = NULL;
+  _streaming = false;
+  resetAccumulators();
 }
 
 AveragingSampler::~AveragingSampler() {
@@ -21,6 +23,7 @@ AveragingSampler::~AveragingSampler() {
 */
 void AveragingSampler::initBuffer(uint32_t maxSamples) {
   configASSERT(maxSamples > 0);
+  _streaming = false;
   _maxSamples = maxSamples;
   if (_samples != NULL) {
     vPortFree(_samples);
@@ -30,6 +33,21 @@ void AveragingSampler::initBuffer(uint32_t maxSamples) {
   configASSERT(_samples != NULL);
 }
 
+/*!
+  Use the sampler without a sample buffer. Every statistic is accumulated as samples are
+  added, in O(1) memory, and covers all of the samples since the last clear() instead of the
+  last maxSamples. Use initBuffer() instead if the raw samples are needed.
+*/
+void AveragingSampler::initStreaming() {
+  if (_samples != NULL) {
+    vPortFree(_samples);
+  }
+  _samples = NULL;
+  _maxSamples = 0;
+  _streaming = true;
+  clear();
+}
+
 /*!
   Add sample to circular buffer
 
@@ -50,16 +68,20 @@ bool AveragingSampler::addSample(double sample) {
 */
 bool AveragingSampler::addSampleTimestamped(double sample, uint32_t timestamp) {
   bool rval = false;
-  configASSERT(_samples != NULL);
+  configASSERT(initialized());
   // Ignore timestamp if it is zero
   if (!timestamp || (timestamp != _lastSampleTime)) {
-    _samples[_sampleIdx] = sample;
     _lastSampleTime = timestamp;
-
-    // Wrap around
-    if (++_sampleIdx == _maxSamples) {
-      _fullBuffer = true;
-      _sampleIdx = 0;
+    if (_streaming) {
+      accumulate(sample);
+    } else {
+      _samples[_sampleIdx] = sample;
+
+      // Wrap around
+      if (++_sampleIdx == _maxSamples) {
+        _fullBuffer = true;
+        _sampleIdx = 0;
+      }
     }
     rval = true;
   }
@@ -73,7 +95,9 @@ bool AveragingSampler::addSampleTimestamped(double sample, uint32_t timestamp) {
   \return Number of samples in circular buffer
 */
 uint32_t AveragingSampler::getNumSamples() {
-  if (!_fullBuffer) {
+  if (_streaming) {
+    return _numSamples;
+  } else if (!_fullBuffer) {
     return _sampleIdx;
   } else {
     return _maxSamples;
@@ -83,7 +107,7 @@ uint32_t AveragingSampler::getNumSamples() {
 /*!
   Get maximum number of samples to store
 
-  \return _maxSamples
+  \return _maxSamples, 0 in streaming mode where there is no limit
 */
 uint32_t AveragingSampler::getMaxSamples() {
   return _maxSamples;
@@ -93,8 +117,11 @@ uint32_t AveragingSampler::getMaxSamples() {
   Clear all samples and reset sample index
 */
 void AveragingSampler::clear() {
-  configASSERT(_samples != NULL);
-  memset(_samples, 0, sizeof(double) * _maxSamples);
+  configASSERT(initialized());
+  if (_samples != NULL) {
+    memset(_samples, 0, sizeof(double) * _maxSamples);
+  }
+  resetAccumulators();
   _sampleIdx = 0;
   _lastSampleTime = 0;
   _fullBuffer = false;
@@ -106,13 +133,16 @@ void AveragingSampler::clear() {
   \return mean of all samples
 */
 double AveragingSampler::getMean(bool useKahan) {
-  configASSERT(_samples != NULL);
+  configASSERT(initialized());
   double total = 0.0;
   double mean = 0.0;
 
   uint32_t numSamples = getNumSamples();
 
-  if (useKahan) {
+  if (_streaming) {
+    // The streaming sum is always compensated
+    total = _sum;
+  } else if (useKahan) {
     double c = 0.0;
     for (uint32_t i = 0; i < numSamples; i++) {
       total = kahanSum(total, _samples[i], c);
@@ -160,6 +190,9 @@ double AveragingSampler::getMax() {
   if (!numSamples) {
     return NAN;
   }
+  if (_streaming) {
+    return _max;
+  }
   double max = _samples[0];
   for (uint32_t i = 0; i < numSamples; i++) {
     if (_samples[i] > max) {
@@ -179,6 +212,9 @@ double AveragingSampler::getMin() {
   if (!numSamples) {
     return NAN;
   }
+  if (_streaming) {
+    return _min;
+  }
   double min = _samples[0];
   for (uint32_t i = 0; i < numSamples; i++) {
     if (_samples[i] < min) {
@@ -217,6 +253,15 @@ double AveragingSampler::getVariance(double mean, bool useKahan) {
   double var = 0.0;
   uint32_t numSamples = getNumSamples();
 
+  if (_streaming) {
+    // Welford's M2 is the sum of squares around the running mean, move it to avg
+    if (numSamples) {
+      double offset = _welfordMean - avg;
+      return _welfordM2 / numSamples + offset * offset;
+    }
+    return NAN;
+  }
+
   for (uint16_t i = 0; i < numSamples; i++) {
     var = var + ((_samples[i] - avg) * (_samples[i] - avg));
   }
@@ -236,9 +281,13 @@ double AveragingSampler::getVariance(double mean, bool useKahan) {
   \return trigonometric sum of all the samples
  */
 double AveragingSampler::getTrigSum(TrigMeanType_e type) {
-  configASSERT(_samples != NULL);
+  configASSERT(initialized());
   double total = 0.0;
   uint32_t numSamples = getNumSamples();
+  if (_streaming) {
+    configASSERT(type == TRIG_MEAN_TYPE_SIN || type == TRIG_MEAN_TYPE_COS);
+    return (type == TRIG_MEAN_TYPE_SIN) ? _sinSum : _cosSum;
+  }
   for (uint32_t i = 0; i < numSamples; i++) {
     if(type == TRIG_MEAN_TYPE_SIN){
       total += sin(_samples[i]);
@@ -260,7 +309,7 @@ double AveragingSampler::getTrigSum(TrigMeanType_e type) {
   \return trigonometric mean of all the samples (NaN if no samples available
 */
 double AveragingSampler::getTrigMean(TrigMeanType_e type) {
-  configASSERT(_samples != NULL);
+  configASSERT(initialized());
   double mean = 0.0;
 
   uint32_t numSamples = getNumSamples();
@@ -282,7 +331,7 @@ double AveragingSampler::getTrigMean(TrigMeanType_e type) {
   \return circular mean of all the samples
 */
 double AveragingSampler::getCircularMean() {
-  configASSERT(_samples != NULL);
+  configASSERT(initialized());
   double sin_sum = getTrigSum(TRIG_MEAN_TYPE_SIN);
   double cos_sum = getTrigSum(TRIG_MEAN_TYPE_COS);
   double mean = atan2(sin_sum, cos_sum);
@@ -306,3 +355,43 @@ double AveragingSampler::getCircularStd() {
   }
   return sqrt(2 - 2 * sqrt(pow(a1, 2) + pow(b1,2)));
 }
+
+bool AveragingSampler::initialized() {
+  return _streaming || _samples != NULL;
+}
+
+void AveragingSampler::resetAccumulators() {
+  _numSamples = 0;
+  _sum = 0.0;
+  _sumC = 0.0;
+  _welfordMean = 0.0;
+  _welfordM2 = 0.0;
+  _min = NAN;
+  _max = NAN;
+  _sinSum = 0.0;
+  _sinC = 0.0;
+  _cosSum = 0.0;
+  _cosC = 0.0;
+}
+
+/*!
+  Add a sample to the streaming statistics. Welford's algorithm for the variance, Kahan
+  summation for the sums so long aggregation periods don't lose precision.
+
+  \param[in] sample - sample to add
+*/
+void AveragingSampler::accumulate(double sample) {
+  _numSamples++;
+  _sum = kahanSum(_sum, sample, _sumC);
+  double delta = sample - _welfordMean;
+  _welfordMean += delta / _numSamples;
+  _welfordM2 += delta * (sample - _welfordMean);
+  if (_numSamples == 1 || sample < _min) {
+    _min = sample;
+  }
+  if (_numSamples == 1 || sample > _max) {
+    _max = sample;
+  }
+  _sinSum = kahanSum(_sinSum, sin(sample), _sinC);
+  _cosSum = kahanSum(_cosSum, cos(sample), _cosC);
+}
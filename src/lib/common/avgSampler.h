@@ -28,14 +28,28 @@ public:
   double getCircularMean();
   double getCircularStd();
   void initBuffer(uint32_t maxSamples);
+  void initStreaming();
   void clear();
   uint32_t getNumSamples();
   uint32_t getMaxSamples();
 
 private:
+  bool initialized();
+  void resetAccumulators();
+  void accumulate(double sample);
+
   uint32_t _lastSampleTime;
   uint32_t _maxSamples;
   uint32_t _sampleIdx;
   bool _fullBuffer;
   double *_samples;
+
+  // Streaming mode, every statistic is kept up to date as samples come in
+  bool _streaming;
+  uint32_t _numSamples;
+  double _sum, _sumC;
+  double _welfordMean, _welfordM2;
+  double _min, _max;
+  double _sinSum, _sinC;
+  double _cosSum, _cosC;
 };
@@ -1,4 +1,5 @@
 #include "differenceSignal.h"
+#include <string.h>
 
 /*!
  * @brief Constructor for DifferenceSignal class
@@ -62,6 +63,34 @@ bool DifferenceSignal::encodeDifferenceSignalToBuffer(double *d_n, size_t &numSa
   return rval;
 }
 
+/*!
+ * @brief Copies the signal itself to a buffer
+ * @param r_n_out[out] The buffer to store the signal
+ * @param numSamples[in, out] In: The buffer sample size, Out: The number of samples copied into the buffer
+ * @return True if the signal was copied, false otherwise
+ * @note Caller must ensure that the buffer is large enough to store the requested samples
+ */
+bool DifferenceSignal::copySignalToBuffer(double *r_n_out, size_t &numSamples) {
+  configASSERT(r_n_out);
+  configASSERT(numSamples > 0);
+  bool rval = false;
+  xSemaphoreTake(_mutex, portMAX_DELAY);
+  do {
+    if (!r_i) {
+      break;
+    }
+    numSamples = (numSamples < r_i) ? numSamples : r_i;
+    memcpy(r_n_out, r, numSamples * sizeof(double));
+    rval = true;
+  } while (0);
+  xSemaphoreGive(_mutex);
+
+  if (!rval) {
+    numSamples = 0;
+  }
+  return rval;
+}
+
 /*!
  * @brief Clears the signal buffer
  */
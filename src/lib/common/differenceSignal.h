@@ -9,6 +9,7 @@ public:
   DifferenceSignal(uint32_t numTotalSamples);
   bool addSample(double sample);
   bool encodeDifferenceSignalToBuffer(double *d_n, size_t &numSamples);
+  bool copySignalToBuffer(double *r_n_out, size_t &numSamples);
   bool getReferenceSignal(double &r0);
   void clear();
   bool isFull();
@@ -3,7 +3,8 @@
 #include <stdio.h>
 
 NvmPartition::NvmPartition(AbstractStorageDriver& storage_driver, const ext_flash_partition_t &partition): 
-        _storage_driver(storage_driver), _partition(partition) {
+        _storage_driver(storage_driver), _partition(partition), _appending(false), _append_offset(0),
+        _erased_start(0), _erased_end(0) {
     configASSERT((_partition.fa_off + _partition.fa_size < storage_driver.getStorageSizeBytes()));
     configASSERT(_partition.fa_off % storage_driver.getAlignmentBytes() == 0);
 }
@@ -27,6 +28,11 @@ bool NvmPartition::erase(uint32_t offset, size_t len, uint32_t timeoutMs) {
     return _storage_driver.erase(_partition.fa_off + offset, len, timeoutMs);
 }
 
+bool NvmPartition::program(uint32_t offset, uint8_t *buffer, size_t len, uint32_t timeoutMs) {
+    configASSERT(offset + len < _partition.fa_size);
+    return _storage_driver.program(_partition.fa_off + offset, buffer, len, timeoutMs);
+}
+
 uint32_t NvmPartition::alignment(void) {
     return _storage_driver.getAlignmentBytes();
 }
@@ -35,3 +41,108 @@ bool NvmPartition::crc16(uint32_t offset, size_t len, uint16_t &crc, uint32_t ti
     configASSERT(offset + len + (len % _storage_driver.getAlignmentBytes()) < _partition.fa_size);
     return _storage_driver.crc16(_partition.fa_off + offset, len, crc, timeoutMs);
 }
+
+/*!
+ * Start writing sequentially from offset, like a DFU image or a log. Blocks
+ * are erased once ahead of the writer and then only page programmed, rather
+ * than erased and reprogrammed on every write.
+ * \param[in] offset - where the first append goes
+ * \param[in] timeoutMs - timeout for erasing the first block
+ * \return true if success, false if fail.
+*/
+bool NvmPartition::appendStart(uint32_t offset, uint32_t timeoutMs) {
+    configASSERT(offset < _partition.fa_size);
+    _appending = true;
+    _append_offset = offset;
+    _erased_start = 0;
+    _erased_end = 0;
+    bool rval = appendEraseAhead(timeoutMs);
+    if (!rval) {
+        _appending = false;
+    }
+    return rval;
+}
+
+/*!
+ * Write at the append offset and move it along. Anything ahead of the
+ * writer is overwritten, it doesn't need to be erased by the caller. A
+ * failed append ends the stream, since part of it may have been programmed.
+ * \param[in] buffer - data to write
+ * \param[in] len - length of data
+ * \param[in] timeoutMs - timeout for each flash operation
+ * \return true if success, false if fail.
+*/
+bool NvmPartition::append(uint8_t *buffer, size_t len, uint32_t timeoutMs) {
+    configASSERT(buffer);
+    bool rval = _appending;
+    uint32_t block_size = alignment();
+    size_t done = 0;
+    while (rval && done < len) {
+        uint32_t offset = _append_offset + done;
+        uint32_t block_end = offset - (offset % block_size) + block_size;
+        size_t chunk_len = (len - done < block_end - offset) ? len - done : block_end - offset;
+        if (offset >= _erased_start && offset < _erased_end) {
+            rval = program(offset, &buffer[done], chunk_len, timeoutMs);
+        } else if (offset % block_size == 0 && block_end < _partition.fa_size) {
+            // The writer got ahead of appendEraseAhead()
+            rval = erase(offset, block_size, timeoutMs) && program(offset, &buffer[done], chunk_len, timeoutMs);
+            if (rval) {
+                _erased_start = offset;
+                _erased_end = block_end;
+            }
+        } else {
+            // Shares a block with whatever came before the stream, or runs into the end of
+            // the partition, so the driver has to work out whether it needs an erase
+            rval = write(offset, &buffer[done], chunk_len, timeoutMs);
+        }
+        done += chunk_len;
+    }
+    if (rval) {
+        _append_offset += len;
+    } else {
+        _appending = false;
+    }
+    return rval;
+}
+
+/*!
+ * Erase the next block if the writer is about to run out of erased flash.
+ * Call this when the flash would otherwise be idle, like while waiting for
+ * the next chunk, so append() doesn't have to wait on an erase.
+ * \param[in] timeoutMs - timeout for the erase
+ * \return true if nothing needed erasing or the erase succeeded, false if fail.
+*/
+bool NvmPartition::appendEraseAhead(uint32_t timeoutMs) {
+    bool rval = true;
+    uint32_t block_size = alignment();
+    do {
+        if (!_appending || _erased_end >= _append_offset + block_size) {
+            break;
+        }
+        uint32_t next = _erased_end;
+        if (next <= _append_offset) {
+            // Nothing erased ahead yet, start at the first block the writer hasn't touched
+            next = _append_offset + ((block_size - (_append_offset % block_size)) % block_size);
+            _erased_start = next;
+            _erased_end = next;
+        }
+        if (next + block_size >= _partition.fa_size) {
+            break;
+        }
+        rval = erase(next, block_size, timeoutMs);
+        if (rval) {
+            _erased_end = next + block_size;
+        } else {
+            _appending = false;
+        }
+    } while (0);
+    return rval;
+}
+
+bool NvmPartition::appending(void) {
+    return _appending;
+}
+
+uint32_t NvmPartition::appendOffset(void) {
+    return _append_offset;
+}
@@ -8,10 +8,22 @@ class NvmPartition {
         bool read(uint32_t offset, uint8_t *buffer, size_t len, uint32_t timeoutMs);
         bool write(uint32_t offset, uint8_t *buffer, size_t len, uint32_t timeoutMs);
         bool erase(uint32_t offset, size_t len, uint32_t timeoutMs);
+        bool program(uint32_t offset, uint8_t *buffer, size_t len, uint32_t timeoutMs);
         bool crc16(uint32_t offset, size_t len, uint16_t &crc, uint32_t timeoutMs);
         uint32_t size(void);
         uint32_t alignment(void);
+        bool appendStart(uint32_t offset, uint32_t timeoutMs);
+        bool append(uint8_t *buffer, size_t len, uint32_t timeoutMs);
+        bool appendEraseAhead(uint32_t timeoutMs);
+        bool appending(void);
+        uint32_t appendOffset(void);
     private:
         AbstractStorageDriver& _storage_driver;
         const ext_flash_partition_t &_partition;
+        // Sequential writer state, see appendStart()
+        bool _appending;
+        uint32_t _append_offset;
+        // Blocks the writer erased, which it can program without checking
+        uint32_t _erased_start;
+        uint32_t _erased_end;
 };
\ No newline at end of file
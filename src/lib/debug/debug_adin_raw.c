@@ -34,14 +34,16 @@ void debugAdinRawInit(void) {
   FreeRTOS_CLIRegisterCommand( &cmdGpio );
 }
 
-int8_t debug_l2_rx(void* device_handle, uint8_t* payload, uint16_t payload_len, uint8_t port_mask) {
+int8_t debug_l2_rx(void* device_handle, struct pbuf *pbuf, uint8_t port_mask) {
   (void)device_handle;
 
+  const uint8_t *payload = (const uint8_t *)pbuf->payload;
   printf("ADIN RX <%d> ", port_mask);
-  for(uint32_t idx = 0; idx < payload_len; idx++){
+  for(uint32_t idx = 0; idx < pbuf->len; idx++){
     printf("%02X ", payload[idx]);
   }
   printf("\n");
+  pbuf_free(pbuf);
 
   return ERR_OK;
 }
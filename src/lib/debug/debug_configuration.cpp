@@ -199,17 +199,31 @@ static BaseType_t configurationCommand( char *writeBuffer,
                     printf("failed to get %s\n", keystr);
                 }
             } else if(strncmp("str",typestr, typeStrLen) == 0){
-                char strbuf[MAX_CONFIG_BUFFER_SIZE_BYTES];
-                size_t strlen = sizeof(strbuf);
+                size_t strlen = 0;
+                if(!config->getValueSize(keystr,keyStrLen, strlen)){
+                    printf("failed to get %s\n", keystr);
+                    break;
+                }
+                // Room for the null terminator
+                strlen++;
+                char *strbuf = static_cast<char *>(pvPortMalloc(strlen));
+                configASSERT(strbuf);
                 if(config->getConfig(keystr,keyStrLen, strbuf, strlen)){
                     strbuf[strlen] = '\0';
                     printf("get %s\n", strbuf);
                 } else{
                     printf("failed to get %s\n", keystr);
                 }
+                vPortFree(strbuf);
             } else if(strncmp("bytestr",typestr, typeStrLen) == 0){
-                uint8_t bytes[MAX_CONFIG_BUFFER_SIZE_BYTES];
-                size_t bytelen = sizeof(bytes);
+                size_t bytelen = 0;
+                if(!config->getValueSize(keystr,keyStrLen, bytelen)){
+                    printf("failed to get %s\n", keystr);
+                    break;
+                }
+                // Zero length byte strings still get a buffer to copy into
+                uint8_t *bytes = static_cast<uint8_t *>(pvPortMalloc(bytelen ? bytelen : 1));
+                configASSERT(bytes);
                 if(config->getConfig(keystr,keyStrLen, bytes, bytelen)){
                     printf("get bytes:");
                     for(size_t i = 0; i < bytelen; i++){
@@ -219,6 +233,7 @@ static BaseType_t configurationCommand( char *writeBuffer,
                 } else{
                     printf("failed to get %s\n", keystr);
                 }
+                vPortFree(bytes);
             } else {
                 printf("ERR Invalid paramters\n");
                 break;
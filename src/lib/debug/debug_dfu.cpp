@@ -4,6 +4,8 @@
 #include "external_flash_partitions.h"
 #include <stdio.h>
 #include "bm_dfu.h"
+#include "bm_dfu_delta.h"
+#include "bm_dfu_lz.h"
 
 static BaseType_t dfuCommand( char *writeBuffer,
                                   size_t writeBufferLen,
@@ -14,7 +16,8 @@ static const CLI_Command_Definition_t cmdDfu = {
   "dfu",
   // Help string
   "dfu:\n"
-  " * dfu start <node id> <filter_key> <TimeoutMs>\n",
+  " * dfu start <node id> <filter_key> <TimeoutMs>\n"
+  " * dfu mcast <filter_key> <TimeoutMs> <node id> [node id ...]\n",
   // Command function
   dfuCommand,
   // Number of parameters (variable)
@@ -33,10 +36,37 @@ void updateSuccessCallback(bool success, bm_dfu_err_t err, uint64_t node_id) {
     if(success){
         printf("update successful %016" PRIx64 "\n", node_id);
     } else {
-        printf("update failed, err: %d\n", err);
+        printf("update failed %016" PRIx64 ", err: %d\n", node_id, err);
     }
 }
 
+static bool readImageInfo(uint32_t filter_key, bm_dfu_img_info_t &image_info) {
+    if(!_dfu_cli_partition->read(DFU_HEADER_OFFSET_BYTES, reinterpret_cast<uint8_t*>(&image_info), sizeof(bm_dfu_img_info_t), 1000)){
+        printf("Failed to read DFU header.\n");
+        return false;
+    }
+    image_info.filter_key = filter_key;
+    // The header CRC of a delta or compressed image is the CRC of the image the client
+    // rebuilds from it, so it can only be checked on the client.
+    uint8_t magic_buf[sizeof(bm_dfu_lz_header_t)];
+    if(_dfu_cli_partition->read(DFU_IMG_START_OFFSET_BYTES, magic_buf, sizeof(magic_buf), 1000) &&
+       (bm_dfu_delta_is_delta_image(magic_buf, sizeof(magic_buf)) ||
+        bm_dfu_lz_is_compressed_image(magic_buf, sizeof(magic_buf), NULL))) {
+        printf("Delta or compressed image, skipping CRC check\n");
+        return true;
+    }
+    uint16_t crc;
+    if(!_dfu_cli_partition->crc16(DFU_IMG_START_OFFSET_BYTES, image_info.image_size, crc, 10000)){
+        printf("Failed to compute crc.\n");
+        return false;
+    }
+    if(crc != image_info.crc16){
+        printf("CRCs don't match %x, %x, invalid image!\n", crc, image_info.crc16);
+        return false;
+    }
+    return true;
+}
+
 static BaseType_t dfuCommand( char *writeBuffer,
                                   size_t writeBufferLen,
                                   const char *commandString) {
@@ -88,22 +118,52 @@ static BaseType_t dfuCommand( char *writeBuffer,
             uint32_t filter_key = strtoul(filterKeyStr, NULL, 0);
             uint32_t timeoutMS = strtoul(timeoutMsStr, NULL, 0);
             bm_dfu_img_info_t image_info;
-            if(!_dfu_cli_partition->read(DFU_HEADER_OFFSET_BYTES, reinterpret_cast<uint8_t*>(&image_info), sizeof(bm_dfu_img_info_t), 1000)){
-                printf("Failed to read DFU header.\n");
+            if(!readImageInfo(filter_key, image_info)) {
+                break;
+            }
+            printf("Image valid, attempting to update\n");
+            if(!bm_dfu_initiate_update(image_info, node_id, updateSuccessCallback, timeoutMS)){
+                printf("Failed to start update\n");
+            }
+
+        } else if (strncmp("mcast", parameter, parameterStringLength) == 0) {
+            const char *filterKeyStr = FreeRTOS_CLIGetParameter(
+                    commandString,
+                    2,
+                    &parameterStringLength);
+
+            if(filterKeyStr == NULL) {
+                printf("ERR Invalid paramters\n");
+                break;
+            }
+            const char *timeoutMsStr = FreeRTOS_CLIGetParameter(
+                    commandString,
+                    3,
+                    &parameterStringLength);
+
+            if(timeoutMsStr == NULL) {
+                printf("ERR Invalid paramters\n");
                 break;
             }
-            uint16_t crc;
-            if(!_dfu_cli_partition->crc16(DFU_IMG_START_OFFSET_BYTES, image_info.image_size, crc, 10000)){
-                printf("Failed to compute crc.\n");
+            uint64_t node_ids[BM_DFU_MCAST_MAX_CLIENTS];
+            uint8_t num_nodes = 0;
+            const char *nodeIdStr;
+            while(num_nodes < BM_DFU_MCAST_MAX_CLIENTS &&
+                  (nodeIdStr = FreeRTOS_CLIGetParameter(commandString, 4 + num_nodes, &parameterStringLength)) != NULL) {
+                node_ids[num_nodes++] = strtoull(nodeIdStr, NULL, 0);
+            }
+            if(num_nodes == 0) {
+                printf("ERR Invalid paramters\n");
                 break;
             }
-            if(crc != image_info.crc16){
-                printf("CRCs don't match %x, %x, invalid image!\n", crc, image_info.crc16);
+            uint32_t filter_key = strtoul(filterKeyStr, NULL, 0);
+            uint32_t timeoutMS = strtoul(timeoutMsStr, NULL, 0);
+            bm_dfu_img_info_t image_info;
+            if(!readImageInfo(filter_key, image_info)) {
                 break;
             }
-            image_info.filter_key = filter_key;
-            printf("Image valid, attempting to update\n");
-            if(!bm_dfu_initiate_update(image_info, node_id, updateSuccessCallback, timeoutMS)){
+            printf("Image valid, attempting to update %u nodes\n", num_nodes);
+            if(!bm_dfu_initiate_multicast_update(image_info, node_ids, num_nodes, updateSuccessCallback, timeoutMS)){
                 printf("Failed to start update\n");
             }
 
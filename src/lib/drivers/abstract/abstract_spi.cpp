@@ -37,3 +37,20 @@ SPIResponse_t AbstractSPI::writeReadBytes(uint8_t * rxBuff, size_t len, uint8_t
     }
     return rval;
 }
+
+SPIResponse_t AbstractSPI::writeThenReadBytes(uint8_t * txBytes, size_t txLen, uint8_t * rxBuff, size_t rxLen, uint32_t timeout) {
+    SPIResponse_t rval = SPI_OK;
+    if (txLen && rxLen && (rxBuff != nullptr) && txBytes != nullptr) {
+        rval = spiTxThenRx(_interface, _csPin, txLen, txBytes, rxLen, rxBuff, timeout);
+    }
+    return rval;
+}
+
+SPIResponse_t AbstractSPI::writeThenReadBytesStart(uint8_t * txBytes, size_t txLen, uint8_t * rxBuff, size_t rxLen, uint32_t timeout) {
+    configASSERT(txLen && rxLen && (rxBuff != nullptr) && txBytes != nullptr);
+    return spiTxThenRxStart(_interface, _csPin, txLen, txBytes, rxLen, rxBuff, timeout);
+}
+
+SPIResponse_t AbstractSPI::writeThenReadBytesWait(uint32_t timeout) {
+    return spiTxThenRxWait(_interface, _csPin, timeout);
+}
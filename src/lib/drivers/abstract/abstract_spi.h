@@ -13,6 +13,9 @@ public:
   virtual SPIResponse_t writeBytes(uint8_t * txBytes, size_t txLen, uint32_t timeout = SPI_DEFAULT_TIMEOUT_MS, bool nonblocking = false);
   virtual SPIResponse_t readBytes(uint8_t * rxBuff, size_t rxLen, uint32_t timeout = SPI_DEFAULT_TIMEOUT_MS, bool nonblocking = false);
   virtual SPIResponse_t writeReadBytes(uint8_t * rxBuff, size_t len, uint8_t * txBytes, uint32_t timeout = SPI_DEFAULT_TIMEOUT_MS, bool nonblocking = false);
+  virtual SPIResponse_t writeThenReadBytes(uint8_t * txBytes, size_t txLen, uint8_t * rxBuff, size_t rxLen, uint32_t timeout = SPI_DEFAULT_TIMEOUT_MS);
+  virtual SPIResponse_t writeThenReadBytesStart(uint8_t * txBytes, size_t txLen, uint8_t * rxBuff, size_t rxLen, uint32_t timeout = SPI_DEFAULT_TIMEOUT_MS);
+  virtual SPIResponse_t writeThenReadBytesWait(uint32_t timeout = SPI_DEFAULT_TIMEOUT_MS);
 
 protected:
   SPIInterface_t * _interface;
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+  Fixed pool of equally sized blocks carved out of caller provided memory.
+  Free blocks are kept in a list threaded through the blocks themselves, so
+  allocating and freeing take constant time and never touch the heap.
+*/
+typedef struct {
+  uint8_t *mem;
+  uint32_t block_size;
+  uint16_t num_blocks;
+  // Head of the free list, NULL when the pool is exhausted
+  void *free_list;
+  uint16_t num_free;
+  // Fewest free blocks there have been since init
+  uint16_t min_free;
+  // Allocations that found the pool empty
+  uint32_t exhausted;
+} eth_buf_pool_t;
+
+void eth_buf_pool_init(eth_buf_pool_t *pool, void *mem, uint32_t block_size, uint16_t num_blocks);
+void *eth_buf_pool_alloc(eth_buf_pool_t *pool);
+void eth_buf_pool_free(eth_buf_pool_t *pool, void *block);
+bool eth_buf_pool_owns(const eth_buf_pool_t *pool, const void *block);
+uint16_t eth_buf_pool_num_free(const eth_buf_pool_t *pool);
+
+#ifdef __cplusplus
+}
+#endif
@@ -1,4 +1,5 @@
 #include <errno.h>
+#include <stddef.h>
 #include <string.h>
 
 // Includes for FreeRTOS
@@ -6,7 +7,6 @@
 #include "task.h"
 #include "semphr.h"
 #include "queue.h"
-#include "aligned_malloc.h"
 
 #include "netif/ethernet.h"
 #include "lwip/pbuf.h"
@@ -23,6 +23,7 @@
 #include "bm_l2.h"
 #include "bsp.h"
 #include "eth_adin2111.h"
+#include "eth_buf_pool.h"
 #include "task_priorities.h"
 
 #include "pcap.h"
@@ -52,14 +53,24 @@ typedef struct {
     adi_eth_BufDesc_t bufDesc;
     adin2111_Port_e port; // TODO: can we just use ->port in bufDesc?
     adin2111_DeviceHandle_t dev;
+    // Frame being sent, bufDesc points into it. Freed once the ADIN is done with it.
+    struct pbuf *pbuf;
 } txMsgEvt_t;
 
+/*
+  Frame memory the ADIN receives into. Received frames go up to lwip as custom
+  pbufs around data, and frames that have to be copied for TX use them too.
+*/
 typedef struct {
-    // NOTE: bufDesc MUST be first, since it's what the callback returns and we need
-    // to know what address to free :D
+    // NOTE: bufDesc MUST be first, since it's what the RX callback returns
     adi_eth_BufDesc_t bufDesc;
     adin2111_DeviceHandle_t dev;
-} rxMsgEvt_t;
+    // Index in adin_rx_buf_mem while the frame is in the ADIN's RX queue
+    uint8_t rx_slot;
+    // Wraps data while the frame is out of the RX queue
+    struct pbuf_custom pc;
+    uint8_t data[MAX_FRAME_BUF_SIZE] __attribute__((aligned(DMA_ALIGN_SIZE)));
+} ethFrame_t;
 
 typedef struct {
     adin2111_DeviceHandle_t handle;
@@ -78,6 +89,12 @@ static adin_link_change_callback_t _link_change_callback;
 
 #define ETH_EVT_QUEUE_LEN 32
 
+// Frames that can be up in lwip or waiting to go out as copies before received frames are copied again
+#define ETH_FRAMES_IN_FLIGHT (12)
+#define ETH_FRAME_POOL_LEN (RX_QUEUE_NUM_ENTRIES + ETH_FRAMES_IN_FLIGHT)
+// TX requests are either in the event queue or in the ADIN's TX queue
+#define ETH_TX_POOL_LEN (ETH_EVT_QUEUE_LEN + TX_QUEUE_NUM_ENTRIES)
+
 typedef enum {
     // Buffer ready to send to ADIN
     EVT_ETH_TX,
@@ -110,9 +127,14 @@ typedef struct {
 // Queue used to handle all tx/rx/irq events
 static QueueHandle_t    _eth_evt_queue;
 static bool _adin_thread_paused = false;
-static rxMsgEvt_t* adin_rx_buf_mem[RX_QUEUE_NUM_ENTRIES];
+static ethFrame_t* adin_rx_buf_mem[RX_QUEUE_NUM_ENTRIES];
+static ethFrame_t _frame_mem[ETH_FRAME_POOL_LEN];
+static eth_buf_pool_t _frame_pool;
+static txMsgEvt_t _tx_msg_mem[ETH_TX_POOL_LEN];
+static eth_buf_pool_t _tx_msg_pool;
 static void free_tx_msg_req(txMsgEvt_t *txMsg);
-static rxMsgEvt_t *createRxMsgReq(adin2111_DeviceHandle_t hDevice, uint16_t buf_len);
+static ethFrame_t *createRxMsgReq(adin2111_DeviceHandle_t hDevice);
+static void rx_frame_deliver(ethFrame_t *rxFrame);
 static bool resume_pause_adin_task(bool start, TaskHandle_t task_to_notify, uint32_t timeout_ms);
 
 /*!
@@ -120,14 +142,14 @@ static bool resume_pause_adin_task(bool start, TaskHandle_t task_to_notify, uint
 
   \param pCBParam unused
   \param Event unused
-  \param *pArg pointer to rxMsgEvt_t
+  \param *pArg pointer to ethFrame_t
   \return none
 */
 static void adin2111_rx_cb(void *pCBParam, uint32_t Event, void *pArg) {
     (void) Event;
     (void)pCBParam;
 
-    // pArg points to rxMsgEvt_t
+    // pArg points to ethFrame_t
     ethEvt_t event = {.type=EVT_ETH_RX, .data=pArg};
     configASSERT(xQueueSend(_eth_evt_queue, &event, 10));
 }
@@ -299,9 +321,9 @@ static void adin2111_thread(void *parameters) {
                     // Sometimes we get a RX event when we're paused. In order to make
                     // sure we don't leak memory, lets resubmit the buffer just like
                     // we would do if the adin was not paused.
-                    rxMsgEvt_t *rxMsg = static_cast<rxMsgEvt_t *>(event.data);
+                    ethFrame_t *rxFrame = static_cast<ethFrame_t *>(event.data);
                     // Re-submit buffer into ADIN's RX queue
-                    adi_eth_Result_e result = adin2111_SubmitRxBuffer(rxMsg->dev, &rxMsg->bufDesc);
+                    adi_eth_Result_e result = adin2111_SubmitRxBuffer(rxFrame->dev, &rxFrame->bufDesc);
                     if (result != ADI_ETH_SUCCESS) {
                         printf("Unable to re-submit RX Buffer\n");
                         configASSERT(0);
@@ -345,24 +367,11 @@ static void adin2111_thread(void *parameters) {
             }
 
             case EVT_ETH_RX: {
-                rxMsgEvt_t *rxMsg = static_cast<rxMsgEvt_t *>(event.data);
+                ethFrame_t *rxFrame = static_cast<ethFrame_t *>(event.data);
 
-                pcapTxPacket(rxMsg->bufDesc.pBuf, rxMsg->bufDesc.trxSize);
-
-                uint8_t rx_port_mask = (1 << rxMsg->bufDesc.port);
-                err_t retv =  _rx_callback(rxMsg->dev, rxMsg->bufDesc.pBuf, rxMsg->bufDesc.trxSize, rx_port_mask);
-                if (retv != ERR_OK) {
-                    printf("Unable to pass to the L2 layer\n");
-                    // Don't break since we still want to re-add it to the adin rx queue below
-                }
-
-                // Re-submit buffer into ADIN's RX queue
-                adi_eth_Result_e result = adin2111_SubmitRxBuffer(rxMsg->dev, &rxMsg->bufDesc);
-                if (result != ADI_ETH_SUCCESS) {
-                    printf("Unable to re-submit RX Buffer\n");
-                    configASSERT(0);
-                }
+                pcapTxPacket(rxFrame->bufDesc.pBuf, rxFrame->bufDesc.trxSize);
 
+                rx_frame_deliver(rxFrame);
                 break;
             }
 
@@ -470,10 +479,14 @@ adi_eth_Result_e adin2111_hw_init(adin2111_DeviceHandle_t hDevice, adin_rx_callb
             break;
         }
 
-        // Allocate RX buffers for ADIN (Only need to do this once)
+        eth_buf_pool_init(&_frame_pool, _frame_mem, sizeof(ethFrame_t), ETH_FRAME_POOL_LEN);
+        eth_buf_pool_init(&_tx_msg_pool, _tx_msg_mem, sizeof(txMsgEvt_t), ETH_TX_POOL_LEN);
+
+        // Take RX buffers for ADIN from the frame pool (Only need to do this once)
         for(uint32_t idx = 0; idx < RX_QUEUE_NUM_ENTRIES; idx++) {
-            adin_rx_buf_mem[idx] = createRxMsgReq(hDevice, MAX_FRAME_BUF_SIZE);
+            adin_rx_buf_mem[idx] = createRxMsgReq(hDevice);
             configASSERT(adin_rx_buf_mem[idx]);
+            adin_rx_buf_mem[idx]->rx_slot = idx;
 
             // Submit rx buffer to ADIN's RX queue
             // Once buffer is used, adin2111_rx_cb will be called
@@ -554,92 +567,192 @@ static void add_egress_port(uint8_t *buff, uint8_t port) {
 }
 
 /*!
-  Allocate rx message request and buffer for adin
+  Custom pbuf free function, returns the frame to the pool once lwip and the
+  ADIN are done with it
+
+  \param *pbuf custom pbuf of the frame
+  \return none
+*/
+static void frame_pbuf_free(struct pbuf *pbuf) {
+    ethFrame_t *frame = reinterpret_cast<ethFrame_t *>(reinterpret_cast<uint8_t *>(pbuf) - offsetof(ethFrame_t, pc));
+    eth_buf_pool_free(&_frame_pool, frame);
+}
+
+/*!
+  Wrap a frame in a pbuf
+
+  \param frame frame from the pool
+  \param len length of the data in the frame
+  \return pbuf, freeing it returns the frame to the pool
+*/
+static struct pbuf *frame_pbuf(ethFrame_t *frame, uint16_t len) {
+    frame->pc.custom_free_function = frame_pbuf_free;
+    struct pbuf *pbuf = pbuf_alloced_custom(PBUF_RAW, len, PBUF_REF, &frame->pc, frame->data, sizeof(frame->data));
+    configASSERT(pbuf);
+    return pbuf;
+}
+
+/*!
+  Get a single pbuf to copy a frame into, around a frame from the pool if there is one
+
+  \param len frame length
+  \return pbuf, NULL if out of memory
+*/
+static struct pbuf *frame_pbuf_alloc(uint16_t len) {
+    ethFrame_t *frame = NULL;
+    if (len <= MAX_FRAME_BUF_SIZE) {
+        frame = static_cast<ethFrame_t *>(eth_buf_pool_alloc(&_frame_pool));
+    }
+    if (frame) {
+        return frame_pbuf(frame, len);
+    }
+
+    // Out of frames, fall back to the lwip heap
+    return pbuf_alloc(PBUF_RAW, len, PBUF_RAM);
+}
+
+/*!
+  Take a frame from the pool and set it up as an adin rx buffer
 
-  NOTE: these RX messages will never be freed, but instead re-queued in the adin driver
+  NOTE: these frames stay in the adin's rx queue until a frame is received,
+  which is then swapped for a fresh one from the pool
 
   \param hDevice adin device handle
-  \param buf_len buffer size to be allocated
 
-  \return pointer to allocated message request
+  \return pointer to frame, NULL if the pool is empty
 */
-static rxMsgEvt_t *createRxMsgReq(adin2111_DeviceHandle_t hDevice, uint16_t buf_len) {
-    rxMsgEvt_t *rxMsg = static_cast<rxMsgEvt_t *>(pvPortMalloc(sizeof(rxMsgEvt_t)));
-    if(rxMsg) {
-        memset(rxMsg, 0x00, sizeof(rxMsgEvt_t));
-        rxMsg->dev = hDevice;
-        rxMsg->bufDesc.bufSize = buf_len;
-        rxMsg->bufDesc.cbFunc = adin2111_rx_cb;
-
-        // Allocate alligned buffer in case we use DMA
-        rxMsg->bufDesc.pBuf = static_cast<uint8_t *>(aligned_malloc(DMA_ALIGN_SIZE, buf_len));
-        if(rxMsg->bufDesc.pBuf) {
-            // Clear buffer
-            // TODO - use pbuf instead of malloc/copying
-            memset(rxMsg->bufDesc.pBuf, 0x00, buf_len);
+static ethFrame_t *createRxMsgReq(adin2111_DeviceHandle_t hDevice) {
+    ethFrame_t *rxFrame = static_cast<ethFrame_t *>(eth_buf_pool_alloc(&_frame_pool));
+    if(rxFrame) {
+        memset(&rxFrame->bufDesc, 0x00, sizeof(rxFrame->bufDesc));
+        rxFrame->dev = hDevice;
+        rxFrame->bufDesc.pBuf = rxFrame->data;
+        rxFrame->bufDesc.bufSize = sizeof(rxFrame->data);
+        rxFrame->bufDesc.cbFunc = adin2111_rx_cb;
+    }
+
+    return rxFrame;
+}
+
+/*!
+  Pass a received frame to the rx callback and keep the adin's rx queue full.
+  When the pool has a frame to spare it takes this one's place in the queue and
+  this one goes up as is. Otherwise the callback gets a copy and this one is
+  re-submitted.
+
+  \param rxFrame frame returned by the adin
+  \return none
+*/
+static void rx_frame_deliver(ethFrame_t *rxFrame) {
+    uint16_t len = rxFrame->bufDesc.trxSize;
+    uint8_t rx_port_mask = (1 << rxFrame->bufDesc.port);
+    ethFrame_t *submitFrame = createRxMsgReq(rxFrame->dev);
+    struct pbuf *pbuf = NULL;
+
+    if (submitFrame) {
+        submitFrame->rx_slot = rxFrame->rx_slot;
+        adin_rx_buf_mem[submitFrame->rx_slot] = submitFrame;
+        pbuf = frame_pbuf(rxFrame, len);
+    } else {
+        submitFrame = rxFrame;
+        pbuf = pbuf_alloc(PBUF_RAW, len, PBUF_RAM);
+        if (pbuf) {
+            memcpy(pbuf->payload, rxFrame->data, len);
         } else {
-            vPortFree(rxMsg);
-            rxMsg = NULL;
+            printf("No mem for pbuf in RX pathway\n");
         }
     }
 
-    return rxMsg;
+    // Re-submit buffer into ADIN's RX queue
+    adi_eth_Result_e result = adin2111_SubmitRxBuffer(submitFrame->dev, &submitFrame->bufDesc);
+    if (result != ADI_ETH_SUCCESS) {
+        printf("Unable to re-submit RX Buffer\n");
+        configASSERT(0);
+    }
+
+    // The callback owns the pbuf from here on
+    if (pbuf && _rx_callback(rxFrame->dev, pbuf, rx_port_mask) != ERR_OK) {
+        printf("Unable to pass to the L2 layer\n");
+    }
 }
 
 /*!
-  Allocate and initialize tx message request and copy data to data buffer
+  Allocate and initialize tx message request for a frame
 
-  NOTE: txMsgReq MUST be freed with free_tx_msg_req since it has an aligned buffer internally
+  NOTE: txMsgReq MUST be freed with free_tx_msg_req, which also frees the frame
 
   \param hDevice adin device handle
-  \param buf data buffer
-  \param buf_len buffer length
+  \param pbuf frame to send, the request takes over the caller's reference
   \param port ADIN port to transmit message on
-  \return pointer to txMsgEvt
+  \return pointer to txMsgEvt, NULL if out of requests
 */
-static txMsgEvt_t *createTxMsgReq(adin2111_DeviceHandle_t hDevice, uint8_t* buf, uint16_t buf_len, adin2111_Port_e port) {
-    configASSERT(buf);
+static txMsgEvt_t *createTxMsgReq(adin2111_DeviceHandle_t hDevice, struct pbuf *pbuf, adin2111_Port_e port) {
+    configASSERT(pbuf);
 
-    txMsgEvt_t *txMsg = static_cast<txMsgEvt_t *>(pvPortMalloc(sizeof(txMsgEvt_t)));
+    txMsgEvt_t *txMsg = static_cast<txMsgEvt_t *>(eth_buf_pool_alloc(&_tx_msg_pool));
     if(txMsg) {
         memset(txMsg, 0x00, sizeof(txMsgEvt_t));
         txMsg->dev = hDevice;
         txMsg->port = port;
-        txMsg->bufDesc.trxSize = buf_len;
+        txMsg->pbuf = pbuf;
+        txMsg->bufDesc.pBuf = static_cast<uint8_t *>(pbuf->payload);
+        txMsg->bufDesc.trxSize = pbuf->len;
         txMsg->bufDesc.cbFunc = adin2111_tx_cb;
-
-        // Allocate alligned buffer in case we use DMA
-        txMsg->bufDesc.pBuf = static_cast<uint8_t *>(aligned_malloc(DMA_ALIGN_SIZE, buf_len));
-        if(txMsg->bufDesc.pBuf) {
-            // Copy data to buffer
-            // TODO - use pbuf instead of malloc/copying
-            memcpy(txMsg->bufDesc.pBuf, buf, buf_len);
-        } else {
-            vPortFree(txMsg);
-            txMsg = NULL;
-        }
     }
 
     return txMsg;
 }
 
 /*!
-  Free tx message request and data buffer
+  Free tx message request and its frame
 
   \param txMsg pointer to txMsgEvet_t to be freed
   \return none
 */
 static void free_tx_msg_req(txMsgEvt_t *txMsg) {
     if(txMsg) {
-        if(txMsg->bufDesc.pBuf){
-            aligned_free(txMsg->bufDesc.pBuf);
+        if(txMsg->pbuf){
+            pbuf_free(txMsg->pbuf);
         }
-        vPortFree(txMsg);
+        eth_buf_pool_free(&_tx_msg_pool, txMsg);
     }
 }
 
 /*!
-  ADIN TX function
+  Queue a frame to go out of one port
+
+  \param hDevice adin device handle
+  \param pbuf frame to send, single pbuf. The caller's reference is handed over, even on failure.
+  \param port ADIN port to transmit message on
+  \param port_offset overall index of the device's first port
+  \return ERR_OK if successful, something else otherwise
+*/
+static err_t tx_submit(adin2111_DeviceHandle_t hDevice, struct pbuf *pbuf, uint32_t port, uint8_t port_offset) {
+    txMsgEvt_t *txMsg = createTxMsgReq(hDevice, pbuf, static_cast<adin2111_Port_e>(port));
+    if (!txMsg) {
+        pbuf_free(pbuf);
+        return ERR_MEM;
+    }
+
+    /* We are modifying the IPV6 SRC address to include the egress port */
+    uint8_t bm_egress_port = (0x01 << port) << port_offset;
+    add_egress_port(txMsg->bufDesc.pBuf, bm_egress_port);
+
+    pcapTxPacket(txMsg->bufDesc.pBuf, txMsg->bufDesc.trxSize);
+
+    // L2 forwards received frames from the service task, which is the only one emptying the queue
+    TickType_t timeout = (xTaskGetCurrentTaskHandle() == serviceTask) ? 0 : 100;
+    ethEvt_t event = {.type=EVT_ETH_TX, .data=txMsg};
+    if(xQueueSend(_eth_evt_queue, &event, timeout) == pdFALSE) {
+        free_tx_msg_req(txMsg);
+        return ERR_MEM;
+    }
+
+    return ERR_OK;
+}
+
+/*!
+  ADIN TX function. The frame is copied, so buf can be reused right away.
 
   \param hDevice adin device handle
   \param buf data buffer
@@ -665,31 +778,81 @@ err_t adin2111_tx(adin2111_DeviceHandle_t hDevice, uint8_t* buf, uint16_t buf_le
 
         for(uint32_t port=0; port < ADIN2111_PORT_NUM; port++) {
             if (port_mask & (0x01 << port)) {
-                txMsgEvt_t *txMsg = createTxMsgReq(hDevice, buf, buf_len, static_cast<adin2111_Port_e>(port));
-                if (txMsg) {
-                    /* We are modifying the IPV6 SRC address to include the egress port */
-                    uint8_t bm_egress_port = (0x01 << port) << port_offset;
-                    add_egress_port(txMsg->bufDesc.pBuf, bm_egress_port);
-
-                    pcapTxPacket(buf, buf_len);
-
-                    ethEvt_t event = {.type=EVT_ETH_TX, .data=txMsg};
-                    if(xQueueSend(_eth_evt_queue, &event, 100) == pdFALSE) {
-                        free_tx_msg_req(txMsg);
-                        retv = ERR_MEM;
-                        break;
-                    }
-
-                } else {
+                struct pbuf *pbuf = frame_pbuf_alloc(buf_len);
+                if (!pbuf) {
                     retv = ERR_MEM;
                     break;
                 }
+                memcpy(pbuf->payload, buf, buf_len);
+
+                retv = tx_submit(hDevice, pbuf, port, port_offset);
+                if (retv != ERR_OK) {
+                    break;
+                }
             }
         }
+    } while(0);
+
+    return retv;
+}
 
-        if(retv != ERR_OK) {
+/*!
+  ADIN TX function for frames nothing else will read. The ADIN sends straight
+  out of the pbuf, which is held until it's done, and the egress port is written
+  into the frame itself. Only the last port gets the original, the others get
+  copies since each one carries its own egress port.
+
+  NOTE: The OA SPI layer copies frames into SPI chunks, so pbufs don't need to
+  be DMA aligned.
+
+  \param hDevice adin device handle
+  \param pbuf frame to send
+  \param port_mask which ports will this be sent over
+  \param port_offset overall index of the device's first port
+  \return ERR_OK if successful, something else otherwise
+*/
+err_t adin2111_tx_pbuf(adin2111_DeviceHandle_t hDevice, struct pbuf *pbuf, uint8_t port_mask, uint8_t port_offset) {
+    err_t retv = ERR_OK;
+
+    do {
+        if (!hDevice) {
+            // no device provided!
+            retv = ERR_IF;
+            break;
+        }
+
+        if(!pbuf) {
+            retv = ERR_BUF;
             break;
         }
+
+        port_mask &= ADIN2111_PORT_MASK;
+        while (port_mask) {
+            uint32_t port = __builtin_ctz(port_mask);
+            port_mask &= ~(0x01 << port);
+
+            struct pbuf *frame = NULL;
+            if (port_mask || pbuf->next) {
+                // Copies are made before the original is modified for the last port,
+                // chains are flattened since the ADIN sends from one buffer
+                frame = frame_pbuf_alloc(pbuf->tot_len);
+                if (frame) {
+                    pbuf_copy_partial(pbuf, frame->payload, pbuf->tot_len, 0);
+                }
+            } else {
+                pbuf_ref(pbuf);
+                frame = pbuf;
+            }
+            if (!frame) {
+                retv = ERR_MEM;
+                break;
+            }
+
+            retv = tx_submit(hDevice, frame, port, port_offset);
+            if (retv != ERR_OK) {
+                break;
+            }
+        }
     } while(0);
 
     return retv;
@@ -0,0 +1,104 @@
+#include <string.h>
+#include "FreeRTOS.h"
+#include "task.h"
+#include "eth_buf_pool.h"
+
+/*!
+  Set up a pool over a block of memory. Everything is free to begin with.
+  \param[out] *pool - pool to set up
+  \param[in] *mem - memory for num_blocks blocks of block_size bytes
+  \param[in] block_size - size of each block, a multiple of the pointer size
+  \param[in] num_blocks - number of blocks
+  \return none
+*/
+void eth_buf_pool_init(eth_buf_pool_t *pool, void *mem, uint32_t block_size, uint16_t num_blocks) {
+  configASSERT(pool);
+  configASSERT(mem);
+  configASSERT(num_blocks);
+  // Free blocks hold the pointer to the next one
+  configASSERT(block_size >= sizeof(void *));
+  configASSERT((block_size % sizeof(void *)) == 0);
+  configASSERT((reinterpret_cast<uintptr_t>(mem) % sizeof(void *)) == 0);
+
+  memset(pool, 0, sizeof(eth_buf_pool_t));
+  pool->mem = static_cast<uint8_t *>(mem);
+  pool->block_size = block_size;
+  pool->num_blocks = num_blocks;
+
+  // Thread the list back to front so blocks are handed out in address order
+  for(uint16_t idx = num_blocks; idx > 0; idx--) {
+    void *block = &pool->mem[(idx - 1) * block_size];
+    *static_cast<void **>(block) = pool->free_list;
+    pool->free_list = block;
+  }
+  pool->num_free = num_blocks;
+  pool->min_free = num_blocks;
+}
+
+/*!
+  Take a block from the pool
+  \param[in,out] *pool - pool
+  \return block, NULL if every block is in use
+*/
+void *eth_buf_pool_alloc(eth_buf_pool_t *pool) {
+  configASSERT(pool);
+
+  taskENTER_CRITICAL();
+  void *block = pool->free_list;
+  if(block) {
+    pool->free_list = *static_cast<void **>(block);
+    pool->num_free--;
+    if(pool->num_free < pool->min_free) {
+      pool->min_free = pool->num_free;
+    }
+  } else {
+    pool->exhausted++;
+  }
+  taskEXIT_CRITICAL();
+
+  return block;
+}
+
+/*!
+  Return a block to the pool
+  \param[in,out] *pool - pool the block came from
+  \param[in] *block - block to return
+  \return none
+*/
+void eth_buf_pool_free(eth_buf_pool_t *pool, void *block) {
+  configASSERT(pool);
+  configASSERT(eth_buf_pool_owns(pool, block));
+
+  taskENTER_CRITICAL();
+  configASSERT(pool->num_free < pool->num_blocks);
+  *static_cast<void **>(block) = pool->free_list;
+  pool->free_list = block;
+  pool->num_free++;
+  taskEXIT_CRITICAL();
+}
+
+/*!
+  Check whether a block belongs to the pool, for callers that fall back to
+  the heap when the pool is empty
+  \param[in] *pool - pool
+  \param[in] *block - block to check
+  \return true if block is the start of one of the pool's blocks
+*/
+bool eth_buf_pool_owns(const eth_buf_pool_t *pool, const void *block) {
+  configASSERT(pool);
+  const uint8_t *addr = static_cast<const uint8_t *>(block);
+  if(!addr || addr < pool->mem || addr >= &pool->mem[pool->num_blocks * pool->block_size]) {
+    return false;
+  }
+  return ((addr - pool->mem) % pool->block_size) == 0;
+}
+
+/*!
+  Get the number of blocks that can be allocated right now
+  \param[in] *pool - pool
+  \return free blocks
+*/
+uint16_t eth_buf_pool_num_free(const eth_buf_pool_t *pool) {
+  configASSERT(pool);
+  return pool->num_free;
+}
@@ -243,6 +243,142 @@ SPIResponse_t spiTxRxNonblocking(SPIInterface_t *interface, IOPinHandle_t *csPin
   return rval;
 }
 
+/*!
+  Start a transaction that sends a command and then receives straight into
+  rxBuff with DMA, all with CS asserted. The interface stays locked until
+  spiTxThenRxWait() is called from the same task, which can do other work
+  in the meantime.
+
+  \param interface Handle to spi interface
+  \param txLen command length
+  \param txBuff command, sent without DMA
+  \param rxLen receive length
+  \param rxBuff receive buffer, its contents are clocked out while receiving
+  \param timeoutMs timeout before giving up on the interface or the command
+  \return SPI_OK if the receive was started, the interface is only locked then
+*/
+SPIResponse_t spiTxThenRxStart(SPIInterface_t *interface, IOPinHandle_t *csPin, size_t txLen, uint8_t *txBuff, size_t rxLen, uint8_t *rxBuff, uint32_t timeoutMs) {
+  configASSERT(interface != NULL);
+  configASSERT(interface->dma_id < MAX_NUM_SPI);
+  configASSERT(txBuff != NULL && rxBuff != NULL);
+  configASSERT(rxLen <= UINT16_MAX);
+  SPIResponse_t rval = SPI_ERR;
+
+  if(xSemaphoreTake(interface->mutex, pdMS_TO_TICKS(timeoutMs)) == pdTRUE) {
+
+    if(interface->lpm_mask) {
+      lpmPeripheralActive(interface->lpm_mask);
+    }
+
+    HAL_StatusTypeDef halRval = HAL_ERROR;
+    do {
+      _dma_context.spi_task_to_wake[interface->dma_id] = xTaskGetCurrentTaskHandle();
+
+      // Assert CS if needed
+      if(csPin != NULL) {
+        IOWrite(csPin, 0);
+      }
+
+      halRval = HAL_SPI_Transmit(interface->handle, txBuff, txLen, timeoutMs);
+      if(halRval != HAL_OK) {
+        break;
+      }
+
+      halRval = HAL_SPI_Receive_DMA(interface->handle, rxBuff, rxLen);
+    } while(0);
+
+    switch(halRval) {
+      case HAL_OK: {
+        rval = SPI_OK;
+        break;
+      }
+      case HAL_TIMEOUT: {
+        rval = SPI_TIMEOUT;
+        break;
+      }
+      default: {
+        rval = SPI_ERR;
+        break;
+      }
+    }
+
+    if(rval != SPI_OK) {
+      _dma_context.spi_task_to_wake[interface->dma_id] = NULL;
+
+      // De-assert CS if needed
+      if(csPin != NULL) {
+        IOWrite(csPin, 1);
+      }
+
+      if(interface->lpm_mask) {
+        lpmPeripheralInactive(interface->lpm_mask);
+      }
+
+      xSemaphoreGive(interface->mutex);
+    }
+  } else {
+    printf("%s Error [%s] - Unable to take mutex.\n", __func__, interface->name);
+    rval = SPI_MUTEX;
+  }
+
+  return rval;
+}
+
+/*!
+  Wait for a receive started with spiTxThenRxStart() and unlock the interface
+
+  \param interface Handle to spi interface
+  \param timeoutMs timeout before giving up
+  \return SPIResponse depending on how it goes
+*/
+SPIResponse_t spiTxThenRxWait(SPIInterface_t *interface, IOPinHandle_t *csPin, uint32_t timeoutMs) {
+  configASSERT(interface != NULL);
+  configASSERT(interface->dma_id < MAX_NUM_SPI);
+  SPIResponse_t rval = SPI_OK;
+
+  bool notified = ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(timeoutMs));
+
+  // De-assert CS if needed
+  if(csPin != NULL) {
+    IOWrite(csPin, 1);
+  }
+
+  if(!notified) { // Timeout occured.
+    HAL_SPI_Abort(interface->handle);
+    _dma_context.spi_task_to_wake[interface->dma_id] = NULL;
+    rval = SPI_TIMEOUT;
+  } else if (_dma_context.spi_dma_error_occurred[interface->dma_id]){
+    rval = SPI_ERR;
+  }
+
+  if(interface->lpm_mask) {
+    lpmPeripheralInactive(interface->lpm_mask);
+  }
+
+  xSemaphoreGive(interface->mutex);
+
+  return rval;
+}
+
+/*!
+  Send a command and then receive straight into rxBuff with DMA
+
+  \param interface Handle to spi interface
+  \param txLen command length
+  \param txBuff command
+  \param rxLen receive length
+  \param rxBuff receive buffer
+  \param timeoutMs timeout before giving up
+  \return SPIResponse depending on how it goes
+*/
+SPIResponse_t spiTxThenRx(SPIInterface_t *interface, IOPinHandle_t *csPin, size_t txLen, uint8_t *txBuff, size_t rxLen, uint8_t *rxBuff, uint32_t timeoutMs) {
+  SPIResponse_t rval = spiTxThenRxStart(interface, csPin, txLen, txBuff, rxLen, rxBuff, timeoutMs);
+  if(rval == SPI_OK) {
+    rval = spiTxThenRxWait(interface, csPin, timeoutMs);
+  }
+  return rval;
+}
+
 void HAL_SPI_TxRxCpltCallback(SPI_HandleTypeDef *hspi) {
   BaseType_t xHigherPriorityTaskWoken = pdFALSE;
   for(int i = 0; i < _dma_context.num_registered_spi; i++){
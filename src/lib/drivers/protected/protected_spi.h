@@ -30,6 +30,9 @@ typedef struct {
 bool spiInit(SPIInterface_t *interface);
 SPIResponse_t spiTxRx(SPIInterface_t *interface, IOPinHandle_t *csPin, size_t len, uint8_t *txBuff, uint8_t *rxBuff, uint32_t timeoutMs);
 SPIResponse_t spiTxRxNonblocking(SPIInterface_t *interface, IOPinHandle_t *csPin, size_t len, uint8_t *txBuff, uint8_t *rxBuff, uint32_t timeoutMs);
+SPIResponse_t spiTxThenRxStart(SPIInterface_t *interface, IOPinHandle_t *csPin, size_t txLen, uint8_t *txBuff, size_t rxLen, uint8_t *rxBuff, uint32_t timeoutMs);
+SPIResponse_t spiTxThenRxWait(SPIInterface_t *interface, IOPinHandle_t *csPin, uint32_t timeoutMs);
+SPIResponse_t spiTxThenRx(SPIInterface_t *interface, IOPinHandle_t *csPin, size_t txLen, uint8_t *txBuff, size_t rxLen, uint8_t *rxBuff, uint32_t timeoutMs);
 #define spiTx(interface, csPin, len, buff, timeout) spiTxRx(interface, csPin, len, buff, NULL, timeout);
 #define spiRx(interface, csPin, len, buff, timeout) spiTxRx(interface, csPin, len, NULL, buff, timeout);
 #define spiTxNonblocking(interface, csPin, len, buff, timeout) spiTxRxNonblocking(interface, csPin, len, buff, NULL, timeout);
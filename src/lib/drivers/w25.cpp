@@ -22,13 +22,14 @@ namespace spiflash {
 #define W25_WRITE_TIMEOUT_MS                (15)
 #define W25_PAGE_SIZE                       (256) // W25 can write 256 bytes at a time
 #define W25_PAGE_MASK                       (W25_PAGE_SIZE - 1)
-#define W25_NUM_PAGES_IN_SECTOR             (16)
 #define W25_SECTOR_SIZE                     (4096)
 #define W25_SECTOR_MASK                     (W25_SECTOR_SIZE - 1)
-#define W25_SECTOR_NUM_BITS                 (12)
 #define W25_CHIP_ERASE_TIMEOUT_MS           (100 * 1000)
 #define W25_SECTOR_ERASE_TIMEOUT_MS         (400)
 #define W25_MAX_ADDRESS                     (0x7FFFFF)
+#define W25_READ_TIMEOUT_MS                 (100)
+#define W25_MAX_READ_LEN                    (0x8000) // Has to fit a DMA transfer length
+#define W25_CHUNK_READ_LEN                  (1024) // Checksums read two of these at a time
 
 #define W25X40CL_DEVICE_ID                  0x12
 #define W25X40CL_MEMORY_TYPE                0x30
@@ -223,6 +224,11 @@ bool W25::eraseSector(uint32_t addr, uint32_t timeoutMs) {
     return rval;
 }
 
+static void crc32Chunk(void *arg, const uint8_t *buffer, size_t len) {
+    uint32_t *crc32 = static_cast<uint32_t *>(arg);
+    *crc32 = crc32_ieee_update(*crc32, buffer, len);
+}
+
 /*!
  * Compute the crc32 checksum for segment of flash
  * \param[in] addr - address of flash
@@ -233,233 +239,308 @@ bool W25::eraseSector(uint32_t addr, uint32_t timeoutMs) {
 bool W25::crc32Checksum(uint32_t addr, size_t len, uint32_t &crc32, uint32_t timeoutMs) {
     configASSERT((addr + len) < W25_MAX_ADDRESS);
     crc32 = 0;
-    bool retval = true;
+    bool retval = false;
     if(xSemaphoreTake(_mutex, pdMS_TO_TICKS(timeoutMs)) == pdTRUE) {
-        bool first_read = true;
-        uint32_t readlen = len;
-        uint32_t offset = 0;
-        uint32_t blocklen = (readlen < W25_SECTOR_SIZE) ? readlen : W25_SECTOR_SIZE;
-        uint8_t* read_buf = (uint8_t *)pvPortMalloc(blocklen);
-        configASSERT(read_buf);
-        while(readlen){
-            printf("Reading addr %lu, size %lu \n", (addr + offset), blocklen);
-            if(!_read(addr + offset, read_buf, blocklen)){
-                printf("Write failed\n");
-                retval = false;
-                break;
-            }
-            if(first_read){
-                crc32 = crc32_ieee(read_buf, blocklen);
-                first_read = false;
-            } else {
-                crc32 = crc32_ieee_update(crc32, read_buf, blocklen);
-            }
-            offset += blocklen;
-            readlen -= blocklen;
-            blocklen = (readlen < W25_SECTOR_SIZE) ? readlen : W25_SECTOR_SIZE;
+        retval = _readChunks(addr, len, crc32Chunk, &crc32);
+        if(!retval) {
+            printf("Read failed\n");
         }
-        vPortFree(read_buf);
         xSemaphoreGive(_mutex);
     } else {
-        retval = false;
         printf("Failed to acquire W25 mutex.\n");
     }
     return retval;
 }
 
+static void readCommand(uint8_t *cmd, uint32_t addr) {
+    cmd[0] = READ_DATA;
+    cmd[1] = (addr >> 16) & 0xFF;
+    cmd[2] = (addr >> 8) & 0xFF;
+    cmd[3] = addr & 0xFF;
+}
+
+/*
+    The data is clocked straight into the caller's buffer with DMA, after the
+    command is sent, so nothing is allocated or copied.
+*/
 bool W25::_read(uint32_t addr, uint8_t *buffer, size_t len) {
     configASSERT(buffer);
     configASSERT(((addr + len) < W25_MAX_ADDRESS));
+    bool rval = true;
+
+    /* Make sure there's no write in progress! */
+    if(!readyToWrite(W25_WRITE_TIMEOUT_MS)) {
+        printf("Timeout waiting for write to complete\n");
+        return false;
+    }
+
+    /* DMA transfers are limited to 16 bit lengths */
+    size_t totalBytesRead = 0;
+    while(rval && totalBytesRead < len) {
+        size_t readLen = len - totalBytesRead;
+        if(readLen > W25_MAX_READ_LEN) {
+            readLen = W25_MAX_READ_LEN;
+        }
+        uint8_t cmd[W25_RW_HEADER_LEN];
+        readCommand(cmd, addr + totalBytesRead);
+        rval = (writeThenReadBytes(cmd, sizeof(cmd), &buffer[totalBytesRead], readLen, W25_READ_TIMEOUT_MS) == SPI_OK);
+        totalBytesRead += readLen;
+    }
+
+    return rval;
+}
+
+/*!
+ * Read flash a chunk at a time, handing each chunk to cb while the next one is read.
+ * \param[in] addr - address of flash
+ * \param[in] len - length of flash to read
+ * \param[in] cb - called with each chunk in order
+ * \param[in] arg - passed to cb
+ * \return true if success, false if fail.
+*/
+bool W25::_readChunks(uint32_t addr, size_t len, W25ChunkCb cb, void *arg) {
+    configASSERT(cb);
     bool rval = false;
-    const size_t buffLen = len + W25_RW_HEADER_LEN;
+    if(!len) {
+        return true;
+    }
 
-    uint8_t *txBuff = (uint8_t *)pvPortMalloc(buffLen);
-    configASSERT(txBuff != NULL);
+    uint8_t *buffers = (uint8_t *)pvPortMalloc(W25_CHUNK_READ_LEN * 2);
+    configASSERT(buffers != NULL);
+    uint8_t *currBuff = buffers;
+    uint8_t *nextBuff = &buffers[W25_CHUNK_READ_LEN];
+    uint8_t cmd[W25_RW_HEADER_LEN];
 
-    uint8_t *rxBuff = (uint8_t *)pvPortMalloc(buffLen);
-    configASSERT(rxBuff != NULL);
+    do {
+        /* Make sure there's no write in progress! */
+        if(!readyToWrite(W25_WRITE_TIMEOUT_MS)) {
+            printf("Timeout waiting for write to complete\n");
+            break;
+        }
 
-    /* Clear tx buff */
-    memset(txBuff, 0, buffLen);
+        size_t offset = 0;
+        size_t chunkLen = (len < W25_CHUNK_READ_LEN) ? len : W25_CHUNK_READ_LEN;
+        readCommand(cmd, addr);
+        if(writeThenReadBytesStart(cmd, sizeof(cmd), currBuff, chunkLen, W25_READ_TIMEOUT_MS) != SPI_OK) {
+            break;
+        }
+        while(true) {
+            if(writeThenReadBytesWait(W25_READ_TIMEOUT_MS) != SPI_OK) {
+                break;
+            }
+            size_t nextOffset = offset + chunkLen;
+            size_t nextLen = len - nextOffset;
+            if(nextLen > W25_CHUNK_READ_LEN) {
+                nextLen = W25_CHUNK_READ_LEN;
+            }
+            if(nextLen) {
+                readCommand(cmd, addr + nextOffset);
+                if(writeThenReadBytesStart(cmd, sizeof(cmd), nextBuff, nextLen, W25_READ_TIMEOUT_MS) != SPI_OK) {
+                    break;
+                }
+            }
 
-    txBuff[0] = READ_DATA;
-    txBuff[1] = (addr >> 16) & 0xFF;
-    txBuff[2] = (addr >> 8) & 0xFF;
-    txBuff[3] = addr & 0xFF;
+            /* While the next chunk is on its way */
+            cb(arg, currBuff, chunkLen);
 
-    /* Make sure there's no write in progress! */
-    if(readyToWrite(W25_WRITE_TIMEOUT_MS)) {
-        if(writeReadBytes(rxBuff, buffLen, txBuff, 100, true) == SPI_OK){
-            memcpy(buffer, &rxBuff[W25_RW_HEADER_LEN], len);
-            rval = true;
+            if(!nextLen) {
+                rval = true;
+                break;
+            }
+            uint8_t *tmp = currBuff;
+            currBuff = nextBuff;
+            nextBuff = tmp;
+            offset = nextOffset;
+            chunkLen = nextLen;
         }
-    } else {
-        printf("Timeout waiting for write to complete\n");
-    }
+    } while(0);
 
-    vPortFree(txBuff);
-    vPortFree(rxBuff);
+    vPortFree(buffers);
 
     return rval;
 }
 
+/*!
+ * Check if a buffer read from flash is erased
+ * \param[in] buffer - flash contents
+ * \param[in] len - length of buffer
+ * \return true if every byte is 0xFF
+*/
+static bool isErased(const uint8_t *buffer, size_t len) {
+    for (size_t i = 0; i < len; i++) {
+        if (buffer[i] != 0xFF) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/*
+    Sectors the write only lands on erased bytes of are page programmed in place.
+    Anything else is read, erased and reprogrammed, skipping the pages that end
+    up erased anyway.
+*/
 bool W25::_write(uint32_t addr, uint8_t *buffer, size_t len) {
     configASSERT(buffer);
     configASSERT(((addr + len) < W25_MAX_ADDRESS));
     bool rval = true;
-    /* Allocate mem for a page request to Flash */
-    uint8_t *pageReqBuff = (uint8_t *)pvPortMalloc(W25_PAGE_SIZE + W25_RW_HEADER_LEN);
-    configASSERT(pageReqBuff != NULL);
 
     /* Allocate mem to read out sector at a time */
     uint8_t *sectorBuff = (uint8_t*)pvPortMalloc(W25_SECTOR_SIZE);
     configASSERT(sectorBuff != NULL);
 
-    /* Flash operation variables */
-    size_t totalBytesRemaining = len;
-
-    /* Sector variables */
-    size_t numSectorBytesToModify;
-    uint32_t startSectorAddr;
-    uint32_t currSectorAddr;
-    bool sectorWriteSuccess;
-    uint16_t numSectors = 0;
-    uint32_t totalBytesWritten = 0;
-    uint32_t currAddr = addr;
-
-    /* Page variables */
-    uint32_t wrAddr = 0;
-
-    /* Figure out how many sectors need to be modified */
-    if(len & W25_SECTOR_MASK) {
-        numSectors = (len >> W25_SECTOR_NUM_BITS) + 1;
-    } else {
-        numSectors = (len >> W25_SECTOR_NUM_BITS);
-    }
-
-    /* Check if end address in the middle of a sector and it's a different sector than the beginning (write straddles a sector). */
-    if((((addr) / W25_SECTOR_SIZE) != ((len + addr) / W25_SECTOR_SIZE )) && \
-        (len + addr) % W25_SECTOR_SIZE) {
-        numSectors++;
-    }
-
-    startSectorAddr = (addr & (~W25_SECTOR_MASK));
-    wrAddr = startSectorAddr;
-
-    for (int i=0; i < numSectors; i++) {
-        /* Reset sectorBuffer */
-        memset(sectorBuff,0xFF, W25_SECTOR_SIZE);
-
-        /* Set current Address (based on current sector and start offset) */
-        currSectorAddr = startSectorAddr + (W25_SECTOR_SIZE * i);
-        configASSERT(currSectorAddr == wrAddr);
+    size_t totalBytesWritten = 0;
+    while (totalBytesWritten < len) {
+        uint32_t currAddr = addr + totalBytesWritten;
+        uint32_t currSectorAddr = currAddr & (~W25_SECTOR_MASK);
+        uint32_t sectorOffset = currAddr - currSectorAddr;
 
         /* Determine num bytes to modify within sector */
-        /* If starting in the middle of a sector */
-        if(wrAddr < currAddr) {
-            if(totalBytesRemaining < (W25_SECTOR_SIZE - (currAddr - wrAddr))) {
-                numSectorBytesToModify = totalBytesRemaining;
-            } else {
-                numSectorBytesToModify = W25_SECTOR_SIZE - (currAddr - wrAddr);
-            }
-        /* If sector aligned */
-        } else {
-            if(totalBytesRemaining < W25_SECTOR_SIZE) {
-                numSectorBytesToModify = totalBytesRemaining;
-            }else {
-                numSectorBytesToModify = W25_SECTOR_SIZE;
-            }
+        size_t numSectorBytesToModify = W25_SECTOR_SIZE - sectorOffset;
+        if (len - totalBytesWritten < numSectorBytesToModify) {
+            numSectorBytesToModify = len - totalBytesWritten;
         }
 
-        if(!_read(currSectorAddr, sectorBuff, W25_SECTOR_SIZE)) {
+        /* Only the range being written has to be erased to skip the sector erase */
+        if(!_read(currAddr, &sectorBuff[sectorOffset], numSectorBytesToModify)) {
             printf("Unable to read sector.\n");
             rval = false;
             break;
         }
 
-        /* Modify Sector */
-        if(wrAddr < currAddr) {
-            memcpy(&sectorBuff[currAddr-wrAddr], &buffer[totalBytesWritten], numSectorBytesToModify);
+        if (isErased(&sectorBuff[sectorOffset], numSectorBytesToModify)) {
+            if (!_program(currAddr, &buffer[totalBytesWritten], numSectorBytesToModify)) {
+                printf("Unable to program sector at addr: %lu\n", currSectorAddr);
+                rval = false;
+                break;
+            }
         } else {
-            memcpy(sectorBuff, &buffer[totalBytesWritten], numSectorBytesToModify);
-        }
-        totalBytesWritten += numSectorBytesToModify;
-        totalBytesRemaining -= numSectorBytesToModify;
-        currAddr += numSectorBytesToModify;
-        /* Erase Sector in Flash before re-writing */
-        if (!_eraseSector(currSectorAddr)) {
-            printf("Unable to erase sector at addr: %lu\n", currSectorAddr);
-            rval = false;
-            break;
-        }
-
-        /* Set the wrAddr for Page Program to the current start of the Sector */
-        sectorWriteSuccess = true;
-
-        /* Iterate through pages in sector to re-write to flash */
-        for (int j=0; j < W25_NUM_PAGES_IN_SECTOR; j++) {
-            /* Reset pageReq Buffer */
-            memset(pageReqBuff, 0xFF, (W25_PAGE_SIZE + W25_RW_HEADER_LEN));
-
-            /* Make sure the previous write finished */
-            if(!readyToWrite(W25_WRITE_TIMEOUT_MS)) {
-                printf("Timeout waiting for write to complete\n");
-                sectorWriteSuccess = false;
+            if(!_read(currSectorAddr, sectorBuff, W25_SECTOR_SIZE)) {
+                printf("Unable to read sector.\n");
+                rval = false;
                 break;
             }
 
-            /* Enable writes */
-            uint8_t writeEnReq = WRITE_ENABLE;
-            if(writeBytes(&writeEnReq, sizeof(writeEnReq), 10,true) != SPI_OK) {
-                printf("Error sending WREN command\n");
-                sectorWriteSuccess = false;
+            /* Modify Sector */
+            memcpy(&sectorBuff[sectorOffset], &buffer[totalBytesWritten], numSectorBytesToModify);
+
+            /* Erase Sector in Flash before re-writing */
+            if (!_eraseSector(currSectorAddr)) {
+                printf("Unable to erase sector at addr: %lu\n", currSectorAddr);
+                rval = false;
                 break;
             }
 
-            /* Ensure WEL is set */
-            if(!checkWEL(W25_WRITE_TIMEOUT_MS, true)) {
-                printf("Timeout waiting for write to complete\n");
-                sectorWriteSuccess = false;
+            if (!_program(currSectorAddr, sectorBuff, W25_SECTOR_SIZE)) {
+                printf("Unable to write to page in sector at addr: %lu\n", currSectorAddr);
+                rval = false;
                 break;
             }
+        }
+        totalBytesWritten += numSectorBytesToModify;
+    }
 
-            pageReqBuff[0] = PAGE_PROGRAM;
-            pageReqBuff[1] = (wrAddr >> 16) & 0xFF;
-            pageReqBuff[2] = (wrAddr >> 8) & 0xFF;
-            pageReqBuff[3] = wrAddr & 0xFF;
+    vPortFree(sectorBuff);
 
-            memcpy(&pageReqBuff[W25_RW_HEADER_LEN], &sectorBuff[wrAddr - currSectorAddr], W25_PAGE_SIZE);
+    return rval;
 
-            if(writeBytes(pageReqBuff, W25_RW_HEADER_LEN + W25_PAGE_SIZE, 10, true) != SPI_OK) {
-                printf("Error writing bytes\n");
-                sectorWriteSuccess = false;
-                break;
-            }
+}
 
-            /* Ensure WEL is reset */
-            if(!checkWEL(W25_WRITE_TIMEOUT_MS, false)) {
-                printf("Timeout waiting for write to complete\n");
-                sectorWriteSuccess = false;
+/*!
+ * Program flash that is already erased, no sector erase is done.
+ * \param[in] addr - address of flash
+ * \param[in] buffer - pointer to buffer of data
+ * \param[in] len - length of data
+ * \return true if success, false if fail.
+*/
+bool W25::program(uint32_t addr, uint8_t *buffer, size_t len, uint32_t timeoutMs) {
+    bool rval = false;
+    if(xSemaphoreTake(_mutex, pdMS_TO_TICKS(timeoutMs)) == pdTRUE) {
+        rval = _program(addr, buffer, len);
+        xSemaphoreGive(_mutex);
+    } else {
+        printf("Failed to acquire W25 mutex.\n");
+    }
+    return rval;
+}
+
+bool W25::_program(uint32_t addr, const uint8_t *buffer, size_t len) {
+    configASSERT(buffer);
+    configASSERT(((addr + len) < W25_MAX_ADDRESS));
+    bool rval = true;
+
+    /* Allocate mem for a page request to Flash */
+    uint8_t *pageReqBuff = (uint8_t *)pvPortMalloc(W25_PAGE_SIZE + W25_RW_HEADER_LEN);
+    configASSERT(pageReqBuff != NULL);
+
+    size_t totalBytesWritten = 0;
+    while (totalBytesWritten < len) {
+        uint32_t wrAddr = addr + totalBytesWritten;
+
+        /* Page programs wrap around within the page, so stop at the end of it */
+        size_t numPageBytes = W25_PAGE_SIZE - (wrAddr & W25_PAGE_MASK);
+        if (len - totalBytesWritten < numPageBytes) {
+            numPageBytes = len - totalBytesWritten;
+        }
+
+        /* Programming 0xFF doesn't change anything */
+        if (!isErased(&buffer[totalBytesWritten], numPageBytes)) {
+            if (!_programPage(wrAddr, &buffer[totalBytesWritten], numPageBytes, pageReqBuff)) {
+                rval = false;
                 break;
             }
+        }
+        totalBytesWritten += numPageBytes;
+    }
+
+    vPortFree(pageReqBuff);
+
+    return rval;
+}
 
-            /* Update Flash Write address */
-            wrAddr += W25_PAGE_SIZE;
+bool W25::_programPage(uint32_t addr, const uint8_t *buffer, size_t len, uint8_t *pageReqBuff) {
+    configASSERT(len <= W25_PAGE_SIZE);
+    bool rval = false;
+    do {
+        /* Make sure the previous write finished */
+        if(!readyToWrite(W25_WRITE_TIMEOUT_MS)) {
+            printf("Timeout waiting for write to complete\n");
+            break;
         }
 
-        if (!sectorWriteSuccess)
-        {
-            printf("Unable to write to page in sector at addr: %lu\n", wrAddr);
-            rval = false;
+        /* Enable writes */
+        uint8_t writeEnReq = WRITE_ENABLE;
+        if(writeBytes(&writeEnReq, sizeof(writeEnReq), 10,true) != SPI_OK) {
+            printf("Error sending WREN command\n");
             break;
         }
-    };
 
-    vPortFree(pageReqBuff);
-    vPortFree(sectorBuff);
+        /* Ensure WEL is set */
+        if(!checkWEL(W25_WRITE_TIMEOUT_MS, true)) {
+            printf("Timeout waiting for write to complete\n");
+            break;
+        }
 
-    return rval;
+        pageReqBuff[0] = PAGE_PROGRAM;
+        pageReqBuff[1] = (addr >> 16) & 0xFF;
+        pageReqBuff[2] = (addr >> 8) & 0xFF;
+        pageReqBuff[3] = addr & 0xFF;
+        memcpy(&pageReqBuff[W25_RW_HEADER_LEN], buffer, len);
+
+        if(writeBytes(pageReqBuff, W25_RW_HEADER_LEN + len, 10, true) != SPI_OK) {
+            printf("Error writing bytes\n");
+            break;
+        }
 
+        /* Ensure WEL is reset */
+        if(!checkWEL(W25_WRITE_TIMEOUT_MS, false)) {
+            printf("Timeout waiting for write to complete\n");
+            break;
+        }
+        rval = true;
+    } while (0);
+
+    return rval;
 }
 
 bool W25::_eraseSector(uint32_t addr) {
@@ -551,32 +632,22 @@ bool W25::erase(uint32_t addr, size_t len, uint32_t timeoutMs) {
     return rval;
 }
 
+static void crc16Chunk(void *arg, const uint8_t *buffer, size_t len) {
+    uint16_t *crc = static_cast<uint16_t *>(arg);
+    *crc = crc16_ccitt(*crc, buffer, len);
+}
+
 bool W25::crc16(uint32_t addr, size_t len, uint16_t &crc, uint32_t timeoutMs) {
     configASSERT((addr + len) < W25_MAX_ADDRESS);
     crc = 0;
-    bool retval = true;
+    bool retval = false;
     if(xSemaphoreTake(_mutex, pdMS_TO_TICKS(timeoutMs)) == pdTRUE) {
-        uint32_t readlen = len;
-        uint32_t offset = 0;
-        uint32_t blocklen = (readlen < W25_SECTOR_SIZE) ? readlen : W25_SECTOR_SIZE;
-        uint8_t* read_buf = (uint8_t *)pvPortMalloc(blocklen);
-        configASSERT(read_buf);
-        while(readlen){
-            printf("Reading addr %lu, size %lu \n", (addr + offset), blocklen);
-            if(!_read(addr + offset, read_buf, blocklen)){
-                printf("Write failed\n");
-                retval = false;
-                break;
-            }
-            crc = crc16_ccitt(crc, read_buf, blocklen);
-            offset += blocklen;
-            readlen -= blocklen;
-            blocklen = (readlen < W25_SECTOR_SIZE) ? readlen : W25_SECTOR_SIZE;
+        retval = _readChunks(addr, len, crc16Chunk, &crc);
+        if(!retval) {
+            printf("Read failed\n");
         }
-        vPortFree(read_buf);
         xSemaphoreGive(_mutex);
     } else {
-        retval = false;
         printf("Failed to acquire W25 mutex.\n");
     }
     return retval;
@@ -7,6 +7,8 @@
 
 namespace spiflash {
 
+typedef void (*W25ChunkCb)(void *arg, const uint8_t *buffer, size_t len);
+
 class W25 : public AbstractSPI, public AbstractStorageDriver {
 public:
     W25(SPIInterface_t *interface, IOPinHandle_t *csPin);
@@ -14,6 +16,7 @@ public:
     bool read(uint32_t addr, uint8_t *buffer, size_t len, uint32_t timeoutMs=100);
     bool write(uint32_t addr, uint8_t *buffer, size_t len, uint32_t timeoutMs=100);
     bool erase(uint32_t addr, size_t len, uint32_t timeoutMs=100);
+    bool program(uint32_t addr, uint8_t *buffer, size_t len, uint32_t timeoutMs=100);
     bool crc16(uint32_t addr, size_t len, uint16_t &crc, uint32_t timeoutMs);
     bool eraseSector(uint32_t addr, uint32_t timeoutMs=100);
     bool crc32Checksum(uint32_t addr, size_t len, uint32_t &crc32, uint32_t timeoutMs=100);
@@ -24,7 +27,10 @@ private:
     bool readStatus(uint8_t &status);
     bool checkWEL(uint32_t timeoutMs, bool set, bool feedWDT=false);
     bool _read(uint32_t addr, uint8_t *buffer, size_t len);
+    bool _readChunks(uint32_t addr, size_t len, W25ChunkCb cb, void *arg);
     bool _write(uint32_t addr, uint8_t *buffer, size_t len);
+    bool _program(uint32_t addr, const uint8_t *buffer, size_t len);
+    bool _programPage(uint32_t addr, const uint8_t *buffer, size_t len, uint8_t *pageReqBuff);
     bool _eraseSector(uint32_t addr);
 private:
     SemaphoreHandle_t _mutex;
@@ -90,6 +90,10 @@ a lot of data that needs to be copied, this should be set high. */
    should be set high. */
 #define MEMP_NUM_PBUF           0
 
+/* LWIP_SUPPORT_CUSTOM_PBUF: pbufs backed by application buffers, used to share
+   published messages with local subscribers without copying them. */
+#define LWIP_SUPPORT_CUSTOM_PBUF 1
+
 /* MEMP_NUM_RAW_PCB: the number of UDP protocol control blocks. One
    per active RAW "connection". */
 #define MEMP_NUM_RAW_PCB        3
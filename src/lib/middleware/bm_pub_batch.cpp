@@ -0,0 +1,116 @@
+#include <string.h>
+#include "FreeRTOS.h"
+#include "bm_pub_batch.h"
+
+#define MAX_RECORDS (UINT8_MAX)
+
+/*!
+  Start an empty batch frame
+  \param[out] *batch - batch to start
+  \param[in] *buf - buffer for the frame
+  \param[in] buf_len - size of buf, the frame will not grow past it
+  \return None
+*/
+void bm_pub_batch_init(bm_pub_batch_t *batch, uint8_t *buf, uint16_t buf_len) {
+  configASSERT(batch);
+  configASSERT(buf);
+  configASSERT(buf_len >= sizeof(bm_pub_batch_header_t));
+
+  batch->buf = buf;
+  batch->buf_len = buf_len;
+  batch->len = sizeof(bm_pub_batch_header_t);
+
+  bm_pub_batch_header_t *header = reinterpret_cast<bm_pub_batch_header_t *>(buf);
+  header->type = BM_PUBSUB_MSG_TYPE_BATCH;
+  header->flags = 0;
+  header->num_records = 0;
+}
+
+/*!
+  Check if a message still fits in a batch
+  \param[in] *batch - batch
+  \param[in] msg_len - length of the pubsub message
+  \return true if bm_pub_batch_add() will succeed
+*/
+bool bm_pub_batch_fits(const bm_pub_batch_t *batch, uint16_t msg_len) {
+  configASSERT(batch);
+  return (bm_pub_batch_num_records(batch) < MAX_RECORDS) &&
+         (static_cast<uint32_t>(batch->len) + sizeof(bm_pub_batch_record_t) + msg_len <= batch->buf_len);
+}
+
+/*!
+  Add a record to a batch
+  \param[in,out] *batch - batch
+  \param[in] msg_len - length of the pubsub message
+  \return where to write the pubsub message, NULL if it doesn't fit
+*/
+uint8_t *bm_pub_batch_add(bm_pub_batch_t *batch, uint16_t msg_len) {
+  if(!bm_pub_batch_fits(batch, msg_len)) {
+    return NULL;
+  }
+
+  bm_pub_batch_record_t *record = reinterpret_cast<bm_pub_batch_record_t *>(&batch->buf[batch->len]);
+  record->len = msg_len;
+  batch->len += sizeof(bm_pub_batch_record_t) + msg_len;
+  reinterpret_cast<bm_pub_batch_header_t *>(batch->buf)->num_records++;
+
+  return record->msg;
+}
+
+/*!
+  Get the number of records in a batch
+  \param[in] *batch - batch
+  \return number of records
+*/
+uint8_t bm_pub_batch_num_records(const bm_pub_batch_t *batch) {
+  return reinterpret_cast<const bm_pub_batch_header_t *>(batch->buf)->num_records;
+}
+
+/*!
+  Check if a received pubsub frame is a batch
+  \param[in] *frame - received frame
+  \param[in] frame_len - length of frame
+  \return true if the frame is a batch
+*/
+bool bm_pub_batch_is_batch(const uint8_t *frame, uint16_t frame_len) {
+  return frame && (frame_len >= sizeof(bm_pub_batch_header_t)) && (frame[0] == BM_PUBSUB_MSG_TYPE_BATCH);
+}
+
+/*!
+  Unpack a received batch. The whole frame is checked before any record is handed out,
+  so a corrupt frame doesn't deliver part of its records.
+  \param[in] *frame - received frame
+  \param[in] frame_len - length of frame
+  \param[in] cb - called with every record's pubsub message
+  \param[in] *arg - passed to cb
+  \return false if the frame is not a valid batch
+*/
+bool bm_pub_batch_unpack(const uint8_t *frame, uint16_t frame_len, bm_pub_batch_record_cb_t cb, void *arg) {
+  if(!bm_pub_batch_is_batch(frame, frame_len) || !cb) {
+    return false;
+  }
+
+  const bm_pub_batch_header_t *header = reinterpret_cast<const bm_pub_batch_header_t *>(frame);
+  for(uint8_t pass = 0; pass < 2; pass++) {
+    uint16_t offset = sizeof(bm_pub_batch_header_t);
+    for(uint8_t i = 0; i < header->num_records; i++) {
+      if(offset + sizeof(bm_pub_batch_record_t) > frame_len) {
+        return false;
+      }
+      const bm_pub_batch_record_t *record = reinterpret_cast<const bm_pub_batch_record_t *>(&frame[offset]);
+      uint16_t msg_len = record->len;
+      offset += sizeof(bm_pub_batch_record_t);
+      if(!msg_len || (offset + msg_len > frame_len)) {
+        return false;
+      }
+      if(pass) {
+        cb(record->msg, msg_len, arg);
+      }
+      offset += msg_len;
+    }
+    if(offset != frame_len) {
+      return false;
+    }
+  }
+  return true;
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Pubsub message type of a frame carrying several pubsub messages (single messages use 0)
+#define BM_PUBSUB_MSG_TYPE_BATCH (1)
+
+typedef struct {
+  uint8_t type;
+  uint8_t flags;
+  uint8_t num_records;
+} __attribute__((packed)) bm_pub_batch_header_t;
+
+// Every record is a complete pubsub message, as it would have been sent on its own
+typedef struct {
+  uint16_t len;
+  uint8_t msg[0];
+} __attribute__((packed)) bm_pub_batch_record_t;
+
+typedef struct {
+  uint8_t *buf;
+  uint16_t buf_len;
+  uint16_t len;
+} bm_pub_batch_t;
+
+typedef void (*bm_pub_batch_record_cb_t)(const uint8_t *msg, uint16_t msg_len, void *arg);
+
+void bm_pub_batch_init(bm_pub_batch_t *batch, uint8_t *buf, uint16_t buf_len);
+uint8_t *bm_pub_batch_add(bm_pub_batch_t *batch, uint16_t msg_len);
+bool bm_pub_batch_fits(const bm_pub_batch_t *batch, uint16_t msg_len);
+uint8_t bm_pub_batch_num_records(const bm_pub_batch_t *batch);
+bool bm_pub_batch_is_batch(const uint8_t *frame, uint16_t frame_len);
+bool bm_pub_batch_unpack(const uint8_t *frame, uint16_t frame_len, bm_pub_batch_record_cb_t cb, void *arg);
+
+#ifdef __cplusplus
+}
+#endif
@@ -1,11 +1,18 @@
+#include <stdio.h>
 #include <string.h>
 #include "FreeRTOS.h"
+#include "task.h"
+#include "semphr.h"
+#include "timers.h"
 #include "lwip/ip_addr.h"
 #include "lwip/inet.h"
 #include "bm_pubsub.h"
+#include "bm_pub_batch.h"
+#include "bm_sub_table.h"
 #include "middleware.h"
 #include "bm_util.h"
 #include "bcmp_resource_discovery.h"
+#include "timer_callback_handler.h"
 
 typedef struct {
   uint8_t type;
@@ -15,34 +22,50 @@ typedef struct {
   const char topic[0];
 } __attribute__((packed)) bm_pubsub_header_t;
 
-// Used for callback linked-list
-typedef struct bm_cb_node_s {
-  struct bm_cb_node_s *next;
-  bm_cb_t callback_fn;
-} bm_cb_node_t;
+typedef struct {
+  uint64_t node_id;
+  const bm_pubsub_header_t *header;
+  uint16_t data_len;
+} bm_pubsub_dispatch_t;
+
+// Buffers for local deliveries, so they don't need a pbuf from the lwIP heap
+#ifndef BM_PUB_LOCAL_POOL_LEN
+#define BM_PUB_LOCAL_POOL_LEN (8)
+#endif
+// Largest message that fits in a local delivery buffer, larger ones use the lwIP heap
+#ifndef BM_PUB_LOCAL_BUF_LEN
+#define BM_PUB_LOCAL_BUF_LEN (256)
+#endif
 
 typedef struct {
-    char *topic;
-    uint16_t topic_len;
-    bm_cb_node_t *callbacks;
-} bm_sub_t;
+  // Must be first, lwIP hands it back to local_buf_free()
+  struct pbuf_custom pc;
+  // Published pbuf whose message this delivery points into, NULL if the message is in data
+  struct pbuf *shared;
+  bool in_use;
+  uint8_t data[BM_PUB_LOCAL_BUF_LEN];
+} bm_pub_local_buf_t;
+
+static bm_pub_local_buf_t _local_bufs[BM_PUB_LOCAL_POOL_LEN];
 
-typedef struct bm_sub_node_s {
-  bm_sub_t sub;
-  struct bm_sub_node_s* next;
-} bm_sub_node_t;
+// How long to wait before handing the batch flush to the timer callback handler again
+#define BM_PUB_BATCH_RETRY_MS (10)
 
 typedef struct {
-  bm_sub_node_t subscription_list;
-} pubsubContext_t;
+  SemaphoreHandle_t lock;
+  TimerHandle_t timer;
+  // 0 when batching is off
+  uint32_t window_ms;
+  // Frame being filled, NULL if there is nothing waiting to be sent
+  struct pbuf *pbuf;
+  bm_pub_batch_t batch;
+} bm_pub_batching_t;
 
-static bm_sub_node_t* delete_sub(const char* topic, uint16_t topic_len);
-static bm_sub_node_t* get_sub(const char* topic, uint16_t topic_len);
-static bm_sub_node_t* get_last_sub(void);
-static pubsubContext_t _ctx;
+static bm_pub_batching_t _batching;
 
 /*!
   Subscribe to a specific string topic with callback
+  Topics can use MQTT style wildcard levels, "sensor/+/sofar/aanderaa" or "sensor/#"
 
   \param[in] *topic topic string to subscribe to
   \param[in] callback callback function to call when data is received on this topic
@@ -85,67 +108,8 @@ bool bm_sub_wl(const char *topic, uint16_t topic_len, const bm_cb_t callback) {
       break;
     }
 
-    bm_sub_node_t* ptr = get_sub(topic, topic_len);
-
-    // Subscription already exists, add a new callback
-    if (ptr) {
-
-      bm_cb_node_t *last_cb_node = ptr->sub.callbacks;
-
-      // Go to last node (but stop if one already matches the requested callback)
-      while((ptr->sub.callbacks->callback_fn != callback) && last_cb_node->next) {
-        last_cb_node = last_cb_node->next;
-      }
-
-      if(ptr->sub.callbacks->callback_fn == callback) {
-        // Callback already subscribed to this topic!
-        break;
-      }
-
-      // Add new callback item to linked-list
-      bm_cb_node_t *cb_node = static_cast<bm_cb_node_t *>(pvPortMalloc(sizeof(bm_cb_node_t)));
-      configASSERT(cb_node);
-
-      cb_node->next = NULL;
-      cb_node->callback_fn = callback;
-      last_cb_node->next = cb_node;
-
-      retv = true;
-    } else {
-      // Creating new subscription from scratch
-
-      ptr = get_last_sub();
-
-      // If there's no subscriptions, point to the start of the list
-      if(!ptr) {
-        ptr = &_ctx.subscription_list;
-      }
-
-      ptr->next = static_cast<bm_sub_node_t *>(pvPortMalloc(sizeof(bm_sub_node_t)));
-      if(!ptr->next){
-        break;
-      }
-
-      memset(ptr->next, 0x00, sizeof(bm_sub_node_t));
-      ptr->next->sub.topic = static_cast<char *>(pvPortMalloc(topic_len + 1));
-      if(!ptr->next->sub.topic){
-        vPortFree(ptr->next);
-        break;
-      }
-      memcpy(ptr->next->sub.topic, topic, topic_len);
-      ptr->next->sub.topic[topic_len] = 0;
-      ptr->next->sub.topic_len = topic_len;
-
-      // Add first callback item to linked-list
-      bm_cb_node_t *cb_node = static_cast<bm_cb_node_t *>(pvPortMalloc(sizeof(bm_cb_node_t)));
-      configASSERT(cb_node);
-
-      cb_node->next = NULL;
-      cb_node->callback_fn = callback;
-      ptr->next->sub.callbacks = cb_node;
-
-      retv = true;
-    }
+    // Adds a callback to an existing subscription or creates a new one
+    retv = bm_sub_table_add(topic, topic_len, callback);
 
   } while(0);
 
@@ -198,53 +162,291 @@ bool bm_unsub_wl(const char *topic, uint16_t topic_len, const bm_cb_t callback)
       break;
     }
 
-    bm_sub_node_t* ptr = get_sub(topic, topic_len);
-    /* Subscription already exists, update */
-    if (ptr) {
+    retv = bm_sub_table_remove(topic, topic_len, callback);
 
-      bm_cb_node_t *cb_node = ptr->sub.callbacks;
-      bm_cb_node_t *prev_node = NULL;
+  } while (0);
 
-      // Check nodes for matching callback
-      while((cb_node->callback_fn != callback) && cb_node->next) {
-        prev_node = cb_node;
-        cb_node = cb_node->next;
-      }
+  if (retv) {
+    printf("Unubscribed from Topic: %s\n", topic);
+  } else {
+    printf("Unable to Unsubscribe to topic\n");
+  }
 
-      // Didn't find a matching callback to unsubscribe :'(
-      if(cb_node->callback_fn != callback) {
-        break;
-      }
+  return retv;
+}
 
-      // Link to the next node in list
-      if(prev_node) {
-        prev_node->next = cb_node->next;
-      } else {
-        ptr->sub.callbacks = cb_node->next;
-      }
+/*!
+  Fill in a pubsub message
+  \param[out] *buf - buffer for the message, sizeof(bm_pubsub_header_t) + topic_len + len bytes
+  \param[in] *topic topic string
+  \param[in] topic_len length of topic string
+  \param[in] *data pointer to data to publish
+  \param[in] len length of data to publish
+  \param[in] type of data to publish
+  \param[in] version of data to publish
+  \return None
+*/
+static void fill_msg(void *buf, const char *topic, uint16_t topic_len, const void *data, uint16_t len,
+                     uint8_t type, uint8_t version) {
+  bm_pubsub_header_t *header = reinterpret_cast<bm_pubsub_header_t *>(buf);
+  // TODO actually set the type here
+  header->type = 0;
+  header->flags = 0;
+  header->topic_len = topic_len;
+  header->ext_header.type = type;
+  header->ext_header.version = version;
+
+  memcpy((void *)header->topic, topic, topic_len);
+  memcpy((void *)&header->topic[header->topic_len], data, len);
+}
+
+/*!
+  Return a local delivery buffer to the pool once the middleware task is done with it
+  \param[in] *pbuf - custom pbuf of the buffer
+  \return None
+*/
+static void local_buf_free(struct pbuf *pbuf) {
+  bm_pub_local_buf_t *buf = reinterpret_cast<bm_pub_local_buf_t *>(pbuf);
+  if(buf->shared) {
+    pbuf_free(buf->shared);
+    buf->shared = NULL;
+  }
+  taskENTER_CRITICAL();
+  buf->in_use = false;
+  taskEXIT_CRITICAL();
+}
 
-      // Free deleted node
-      vPortFree(cb_node);
+/*!
+  Get a pbuf for a local delivery from the pool
+  \param[in] *shared - published pbuf the message is in, NULL to use the buffer's own data
+  \param[in] *msg - message in shared, unused if shared is NULL
+  \param[in] message_size - message length
+  \return pbuf, NULL if the pool is exhausted or the message doesn't fit
+*/
+static struct pbuf *local_buf_alloc(struct pbuf *shared, uint8_t *msg, uint16_t message_size) {
+  if(!shared && (message_size > BM_PUB_LOCAL_BUF_LEN)) {
+    return NULL;
+  }
 
-      // If there are no more callbacks, delete the sub entirely
-      if(ptr->sub.callbacks == NULL) {
-        delete_sub(topic, topic_len);
-      }
+  bm_pub_local_buf_t *buf = NULL;
+  taskENTER_CRITICAL();
+  for(uint16_t i = 0; i < BM_PUB_LOCAL_POOL_LEN; i++) {
+    if(!_local_bufs[i].in_use) {
+      buf = &_local_bufs[i];
+      buf->in_use = true;
+      break;
+    }
+  }
+  taskEXIT_CRITICAL();
+  if(!buf) {
+    return NULL;
+  }
+
+  buf->pc.custom_free_function = local_buf_free;
+  if(shared) {
+    // Keep the published message around until the middleware task is done with it
+    pbuf_ref(shared);
+    buf->shared = shared;
+  } else {
+    msg = buf->data;
+  }
+  struct pbuf *pbuf = pbuf_alloced_custom(PBUF_RAW, message_size, PBUF_REF, &buf->pc, msg, message_size);
+  configASSERT(pbuf);
+  return pbuf;
+}
+
+/*!
+  Deliver a message to local subscribers only. No network pbuf is built, small messages go
+  straight into a pooled buffer for the middleware task.
+
+  \param[in] *topic topic string to publish to
+  \param[in] topic_len length of topic string
+  \param[in] *data pointer to data to publish
+  \param[in] length of data to publish
+  \param[in] type of data to publish
+  \param[in] version of data to publish
+  \return True if data has been queued for local subscribers (or there are none)
+*/
+static bool pub_local(const char *topic, uint16_t topic_len, const void *data, uint16_t len,
+                      uint8_t type, uint8_t version) {
+  bool retv = true;
 
-      retv = true;
+  do {
+    if (!bm_sub_table_match(topic, topic_len, NULL, NULL)) {
+      // Nobody to deliver to
+      break;
     }
 
+    uint16_t message_size = sizeof(bm_pubsub_header_t) + topic_len + len;
+    struct pbuf *pbuf_local = local_buf_alloc(NULL, NULL, message_size);
+    if(!pbuf_local) {
+      pbuf_local = pbuf_alloc(PBUF_TRANSPORT, message_size, PBUF_RAM);
+    }
+    if(!pbuf_local) {
+      retv = false;
+      break;
+    }
+
+    fill_msg(pbuf_local->payload, topic, topic_len, data, len, type, version);
+    if (bm_middleware_local_pub(pbuf_local)) {
+      retv = false;
+    }
+    pbuf_free(pbuf_local);
   } while (0);
 
-  if (retv) {
-    printf("Unubscribed from Topic: %s\n", topic);
-  } else {
-    printf("Unable to Unsubscribe to topic\n");
+  if (!retv) {
+    printf("Unable to publish to topic locally\n");
   }
 
   return retv;
 }
 
+/*!
+  Send the batch frame being filled, batching lock must be held
+  \return true if there was nothing to send or the frame was sent
+*/
+static bool batch_send_locked(void) {
+  bool retv = true;
+  if(_batching.pbuf) {
+    xTimerStop(_batching.timer, 0);
+    pbuf_realloc(_batching.pbuf, _batching.batch.len);
+    if(middleware_net_tx(_batching.pbuf)) {
+      printf("Unable to send batch of %u messages\n", bm_pub_batch_num_records(&_batching.batch));
+      retv = false;
+    }
+    pbuf_free(_batching.pbuf);
+    _batching.pbuf = NULL;
+  }
+  return retv;
+}
+
+/*!
+  Send the batch frame, run from the timer callback handler task
+  \param[in] *arg - unused
+  \return None
+*/
+static void batch_flush_cb(void *arg) {
+  (void)arg;
+  bm_pub_batching_flush();
+}
+
+/*!
+  Send the batch frame when the batching window is over. Sending takes the batching lock
+  and goes through the IP stack, which can't be done from the timer task.
+  \param[in] timer - batching timer
+  \return None
+*/
+static void batch_timer_cb(TimerHandle_t timer) {
+  if(!timer_callback_handler_send_cb(batch_flush_cb, NULL, 0)) {
+    // Try again shortly rather than leave the frame unsent
+    xTimerChangePeriod(timer, pdMS_TO_TICKS(BM_PUB_BATCH_RETRY_MS), 0);
+  }
+}
+
+/*!
+  Add a message to the batch frame being filled, starting a new frame if needed
+  \param[in] *topic topic string
+  \param[in] topic_len length of topic string
+  \param[in] *data pointer to data to publish
+  \param[in] len length of data to publish
+  \param[in] type of data to publish
+  \param[in] version of data to publish
+  \param[out] &batched - false if batching is off or the message is too large for a batch
+  \return false if a batch couldn't be sent or allocated
+*/
+static bool batch_add(const char *topic, uint16_t topic_len, const void *data, uint16_t len,
+                      uint8_t type, uint8_t version, bool &batched) {
+  bool retv = true;
+  batched = false;
+
+  if(!_batching.lock) {
+    return retv;
+  }
+
+  uint16_t message_size = sizeof(bm_pubsub_header_t) + topic_len + len;
+  bool send_now = false;
+  xSemaphoreTake(_batching.lock, portMAX_DELAY);
+  do {
+    if(!_batching.window_ms) {
+      break;
+    }
+
+    if(sizeof(bm_pub_batch_header_t) + sizeof(bm_pub_batch_record_t) + message_size >
+       BM_MIDDLEWARE_MAX_PAYLOAD_LEN) {
+      // Goes out on its own
+      break;
+    }
+
+    if(_batching.pbuf && !bm_pub_batch_fits(&_batching.batch, message_size)) {
+      retv = batch_send_locked();
+    }
+
+    if(!_batching.pbuf) {
+      _batching.pbuf = pbuf_alloc(PBUF_TRANSPORT, BM_MIDDLEWARE_MAX_PAYLOAD_LEN, PBUF_RAM);
+      if(!_batching.pbuf) {
+        retv = false;
+        break;
+      }
+      bm_pub_batch_init(&_batching.batch, static_cast<uint8_t *>(_batching.pbuf->payload),
+                        BM_MIDDLEWARE_MAX_PAYLOAD_LEN);
+      TickType_t window_ticks = pdMS_TO_TICKS(_batching.window_ms);
+      if(xTimerChangePeriod(_batching.timer, window_ticks ? window_ticks : 1, 0) != pdPASS) {
+        // Nothing would send this frame when the window ends, so don't hold the message
+        send_now = true;
+      }
+    }
+
+    fill_msg(bm_pub_batch_add(&_batching.batch, message_size), topic, topic_len, data, len, type, version);
+    batched = true;
+
+    if(send_now && !batch_send_locked()) {
+      retv = false;
+    }
+  } while(0);
+  xSemaphoreGive(_batching.lock);
+
+  return retv;
+}
+
+/*!
+  Batch published messages, so many small messages go out in one frame. Messages are held
+  for up to window_ms or until the frame is full. Receivers unpack batches in bm_handle_msg(),
+  nodes running firmware from before batching will drop them.
+
+  \param[in] window_ms how long to hold a message for, 0 to stop batching
+  \return None
+*/
+void bm_pub_batching_set_window(uint32_t window_ms) {
+  if(!_batching.lock) {
+    _batching.lock = xSemaphoreCreateMutex();
+    configASSERT(_batching.lock);
+    _batching.timer = xTimerCreate("pubBatch", pdMS_TO_TICKS(1), pdFALSE, NULL, batch_timer_cb);
+    configASSERT(_batching.timer);
+  }
+
+  xSemaphoreTake(_batching.lock, portMAX_DELAY);
+  if(!window_ms) {
+    batch_send_locked();
+  }
+  _batching.window_ms = window_ms;
+  xSemaphoreGive(_batching.lock);
+}
+
+/*!
+  Send any batched messages now
+
+  \return true if there was nothing to send or the batch was sent
+*/
+bool bm_pub_batching_flush(void) {
+  bool retv = true;
+  if(_batching.lock) {
+    xSemaphoreTake(_batching.lock, portMAX_DELAY);
+    retv = batch_send_locked();
+    xSemaphoreGive(_batching.lock);
+  }
+  return retv;
+}
+
 /*!
   Publish data to specific string topic
 
@@ -283,6 +485,23 @@ bool bm_pub_wl(const char *topic, uint16_t topic_len, const void *data, uint16_t
 
   do {
 
+    // Only subscribed here, skip the network message entirely
+    if (bm_sub_table_match(topic, topic_len, NULL, NULL) &&
+        !bcmp_resource_discovery::bcmp_resource_discovery_remote_sub_possible(topic, topic_len)) {
+      retv = pub_local(topic, topic_len, data, len, type, version);
+      break;
+    }
+
+    bool batched = false;
+    retv = batch_add(topic, topic_len, data, len, type, version, batched);
+    if (batched) {
+      // Local subscribers don't wait for the batch
+      if (!pub_local(topic, topic_len, data, len, type, version)) {
+        retv = false;
+      }
+      break;
+    }
+
     uint16_t message_size = sizeof(bm_pubsub_header_t) + topic_len + len;
     struct pbuf *pbuf = pbuf_alloc(PBUF_TRANSPORT, message_size, PBUF_RAM);
     if(!pbuf) {
@@ -290,49 +509,37 @@ bool bm_pub_wl(const char *topic, uint16_t topic_len, const void *data, uint16_t
       break;
     }
 
-    bm_pubsub_header_t *header = reinterpret_cast<bm_pubsub_header_t *>(pbuf->payload);
-    // TODO actually set the type here
-    header->type = 0;
-    header->flags = 0;
-    header->topic_len = topic_len;
-    header->ext_header.type = type;
-    header->ext_header.version = version;
+    // The IP stack adds headers in front of the message, but leaves the message itself alone
+    uint8_t *msg = static_cast<uint8_t *>(pbuf->payload);
+    fill_msg(msg, topic, topic_len, data, len, type, version);
 
-    memcpy((void *)header->topic, topic, topic_len);
-    memcpy((void *)&header->topic[header->topic_len], data, len);
+    if (middleware_net_tx(pbuf)) {
+      retv = false;
+    }
 
     // If we have a local subscription, submit it to the local queue as well
-    if (get_sub(topic, topic_len)) {
-      // Submit to local queue as well.
-      // Caller must create a seperate pbuf than the IP stack send b/c
-      // sending a pbuf to the IP stack must have a 1 reference count.
+    if (bm_sub_table_match(topic, topic_len, NULL, NULL)) {
+      // Sending a pbuf to the IP stack must have a 1 reference count, so the local
+      // delivery can only share the sent message once it has been sent.
       // See: LWIP_IP_CHECK_PBUF_REF_COUNT_FOR_TX
-      do {
-        struct pbuf *pbuf_local = pbuf_alloc(PBUF_TRANSPORT, message_size, PBUF_RAM);
-        if(!pbuf_local) {
-          retv = false;
-          break;
+      struct pbuf *pbuf_local = local_buf_alloc(pbuf, msg, message_size);
+      if(!pbuf_local) {
+        // Out of local buffers, fall back to copying the message
+        pbuf_local = pbuf_alloc(PBUF_TRANSPORT, message_size, PBUF_RAM);
+        if(pbuf_local) {
+          memcpy(pbuf_local->payload, msg, message_size);
         }
-        bm_pubsub_header_t *local_header = reinterpret_cast<bm_pubsub_header_t *>(pbuf_local->payload);
-        // TODO actually set the type here
-        local_header->type = 0;
-        local_header->flags = 0;
-        local_header->topic_len = topic_len;
-        local_header->ext_header.type = type;
-        local_header->ext_header.version = version;
-
-        memcpy((void *)local_header->topic, topic, topic_len);
-        memcpy((void *)&local_header->topic[local_header->topic_len], data, len);
+      }
+      if(pbuf_local) {
         // The reason why we push back to the middleware queue instead of running the callbacks here
         // is so they don't run in the current task context, which will depend on the caller.
         bm_middleware_local_pub(pbuf_local);
         pbuf_free(pbuf_local);
-      } while(0);
+      } else {
+        retv = false;
+      }
     }
 
-    if (middleware_net_tx(pbuf)) {
-      retv = false;
-    }
     pbuf_free(pbuf);
   } while (0);
 
@@ -348,47 +555,117 @@ bool bm_pub_wl(const char *topic, uint16_t topic_len, const void *data, uint16_t
 }
 
 /*!
-  Handle incoming data that we are subscribed to.
+  Run the callbacks of a subscription matching an incoming message
+  \param[in] *sub - matching subscription
+  \param[in] *arg - bm_pubsub_dispatch_t for the message
+  \return true to keep looking for matching subscriptions
+*/
+static bool dispatch_sub(const bm_sub_t *sub, void *arg) {
+  const bm_pubsub_dispatch_t *msg = static_cast<const bm_pubsub_dispatch_t *>(arg);
+  bm_cb_node_t *cb_node = sub->callbacks;
+
+  while(cb_node) {
+    cb_node->callback_fn( msg->node_id,
+                          msg->header->topic,
+                          msg->header->topic_len,
+                          (const uint8_t *)&msg->header->topic[msg->header->topic_len],
+                          msg->data_len,
+                          msg->header->ext_header.type,
+                          msg->header->ext_header.version);
+    cb_node = cb_node->next;
+  }
+  return true;
+}
+
+/*!
+  Handle one incoming pubsub message
+  \param[in] *msg - pubsub message
+  \param[in] msg_len - length of msg
+  \param[in] *arg - pointer to the sender's node id
+  \return None
+*/
+static void handle_record(const uint8_t *msg, uint16_t msg_len, void *arg) {
+  const bm_pubsub_header_t *header = reinterpret_cast<const bm_pubsub_header_t *>(msg);
+  if((msg_len < sizeof(bm_pubsub_header_t)) || (msg_len < sizeof(bm_pubsub_header_t) + header->topic_len)) {
+    printf("Dropping malformed pubsub message\n");
+    return;
+  }
+  uint16_t data_len = msg_len - sizeof(bm_pubsub_header_t) - header->topic_len;
+
+  // TODO check header type and flags and do something about it
+
+  bm_pubsub_dispatch_t dispatch = {*static_cast<uint64_t *>(arg), header, data_len};
+  bm_sub_table_match(header->topic, header->topic_len, dispatch_sub, &dispatch);
+}
+
+/*!
+  Handle incoming data that we are subscribed to. Batches are unpacked into their messages.
+  Callbacks run once for every subscription matching the topic, so a callback subscribed
+  both to a topic and to a wildcard covering it runs twice.
   \param[in] node_id - node id for sender
   \param[in] *pbuf - pbuf with incoming data
   \return None
 */
 void bm_handle_msg(uint64_t node_id, struct pbuf *pbuf) {
-  bm_pubsub_header_t *header = reinterpret_cast<bm_pubsub_header_t *>(pbuf->payload);
-  uint16_t data_len = pbuf->len - sizeof(bm_pubsub_header_t) - header->topic_len;
+  const uint8_t *frame = static_cast<const uint8_t *>(pbuf->payload);
 
-  // TODO check header type and flags and do something about it
+  if (bm_pub_batch_is_batch(frame, pbuf->len)) {
+    if (!bm_pub_batch_unpack(frame, pbuf->len, handle_record, &node_id)) {
+      printf("Dropping malformed pubsub batch\n");
+    }
+  } else {
+    handle_record(frame, pbuf->len, &node_id);
+  }
+}
 
-  bm_sub_node_t* ptr = get_sub(header->topic, header->topic_len);
+/*!
+  Check one record of an incoming frame against the subscriptions
+  \param[in] *msg - pubsub message
+  \param[in] msg_len - length of msg
+  \param[in,out] *arg - bool set when the message may have subscribers
+  \return None
+*/
+static void record_wanted(const uint8_t *msg, uint16_t msg_len, void *arg) {
+  const bm_pubsub_header_t *header = reinterpret_cast<const bm_pubsub_header_t *>(msg);
+  // Let bm_handle_msg() complain about malformed messages
+  if((msg_len < sizeof(bm_pubsub_header_t)) || (msg_len < sizeof(bm_pubsub_header_t) + header->topic_len) ||
+     bm_sub_table_may_match(header->topic, header->topic_len)) {
+    *static_cast<bool *>(arg) = true;
+  }
+}
 
-  if (ptr && ptr->sub.callbacks) {
-    bm_cb_node_t *cb_node = ptr->sub.callbacks;
+/*!
+  Quick check on whether anything here is subscribed to an incoming frame, without
+  taking the subscription table lock. Runs in the network driver's context.
+  \param[in] *frame - pubsub frame, single message or batch
+  \param[in] len - length of frame
+  \return false if no subscription can match, true if one might
+*/
+bool bm_wants_msg(const uint8_t *frame, uint16_t len) {
+  bool wanted = false;
 
-    while(cb_node) {
-      cb_node->callback_fn( node_id,
-                            header->topic,
-                            header->topic_len,
-                            (const uint8_t *)&header->topic[header->topic_len],
-                            data_len,
-                            header->ext_header.type,
-                            header->ext_header.version);
-      cb_node = cb_node->next;
+  if (bm_pub_batch_is_batch(frame, len)) {
+    if (!bm_pub_batch_unpack(frame, len, record_wanted, &wanted)) {
+      wanted = true;
     }
+  } else {
+    record_wanted(frame, len, &wanted);
   }
+
+  return wanted;
 }
 
 /*!
-  Print subscription linked list
-  \param[in] *parameters - unused
-  \return *bm_sub_node_t, last element in linked list
+  Print subscriptions
+  \return None
 */
 void bm_print_subs(void) {
-  bm_sub_node_t* node = _ctx.subscription_list.next;
-
-  while(node != NULL) {
-    // TODO, print number of callbacks subscribed
-    printf("Node: %.*s\n", node->sub.topic_len, node->sub.topic);
-    node = node->next;
+  for(uint16_t i = 0; i < BM_SUB_TABLE_ENTRIES; i++) {
+    const bm_sub_t* sub = bm_sub_table_entry(i);
+    if(sub) {
+      // TODO, print number of callbacks subscribed
+      printf("Node: %.*s\n", sub->topic_len, sub->topic);
+    }
   }
 }
 
@@ -399,7 +676,6 @@ void bm_print_subs(void) {
   \return *char, string of subs
 */
 char* bm_get_subs(void) {
-  bm_sub_node_t* node = _ctx.subscription_list.next;
   char* subs_string = static_cast<char *>(pvPortMalloc(MAX_SUB_STR_LEN));
   memset(subs_string, 0, MAX_SUB_STR_LEN);
   configASSERT(subs_string);
@@ -407,91 +683,21 @@ char* bm_get_subs(void) {
   char spacing[] = " | ";
   bool first = true;
 
-  while(node != NULL) {
+  for(uint16_t i = 0; i < BM_SUB_TABLE_ENTRIES; i++) {
+    const bm_sub_t* sub = bm_sub_table_entry(i);
+    if(!sub) {
+      continue;
+    }
     if (first) {
       first = false;
     } else {
       strcat(ptr, spacing);
       ptr += sizeof(spacing) - 1;
     }
-    strncat(ptr, node->sub.topic, node->sub.topic_len);
-    ptr += node->sub.topic_len;
-
-    node = node->next;
+    strncat(ptr, sub->topic, sub->topic_len);
+    ptr += sub->topic_len;
   }
   *ptr = 0x00; // Add Null terminator
 
   return subs_string;
 }
-
-/*!
-  Deletes a subscription in linked list based on topic
-  \param[in] *topic - topic string
-  \param[in] *topic_len - byte length of topic
-  \return pointer to bm_sub_node_t, NULL if not found
-*/
-static bm_sub_node_t* delete_sub(const char* topic, uint16_t topic_len) {
-  bm_sub_node_t* node = _ctx.subscription_list.next;
-  bm_sub_node_t* prev = &_ctx.subscription_list;
-
-  while(node != NULL) {
-    if ((node->sub.topic_len == topic_len) &&
-      (memcmp(node->sub.topic, topic, topic_len) == 0)) {
-
-      // Delete node from list
-      prev->next = node->next;
-
-      // Free any callbacks that might have been linked
-      bm_cb_node_t *cb_node = node->sub.callbacks;
-      while(cb_node) {
-        bm_cb_node_t *to_del = cb_node;
-        cb_node = cb_node->next;
-
-        // Free callback node
-        vPortFree(to_del);
-      }
-
-      vPortFree(node->sub.topic);
-      vPortFree(node);
-      break;
-    }
-    prev = node;
-    node = node->next;
-  }
-  return node;
-}
-
-/*!
-  Finds a subscription in linked list based on topic
-  \param[in] *topic - topic string
-  \param[in] *topic_len - byte length of topic
-  \return pointer to bm_sub_node_t, NULL if not found
-*/
-static bm_sub_node_t* get_sub(const char* topic, uint16_t topic_len) {
-  bm_sub_node_t* node = _ctx.subscription_list.next;
-
-  while(node != NULL) {
-    if ((node->sub.topic_len == topic_len) &&
-      (memcmp(node->sub.topic, topic, topic_len) == 0)) {
-      break;
-    }
-    node = node->next;
-  }
-  return node;
-}
-
-/*!
-  Get the last subscription in the linked list of subscription topics
-  \param[in] *parameters - unused
-  \return *bm_sub_node_t, last element in linked list
-*/
-static bm_sub_node_t* get_last_sub(void) {
-  bm_sub_node_t* node = _ctx.subscription_list.next;
-  bm_sub_node_t* last = node;
-
-  while(node != NULL) {
-    last = node;
-    node = node->next;
-  }
-  return last;
-}
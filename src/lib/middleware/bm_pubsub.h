@@ -6,6 +6,7 @@
 #include "lwip/pbuf.h"
 #include "lwip/udp.h"
 #include "bm_common_pub_sub.h"
+#include "bm_sub_table.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -13,8 +14,6 @@ extern "C" {
 
 #define BM_TOPIC_MAX_LEN (255)
 
-typedef void (*bm_cb_t)(uint64_t node_id, const char* topic, uint16_t topic_len, const uint8_t* data, uint16_t data_len, uint8_t type, uint8_t version);
-
 void bm_init(struct netif* netif, struct udp_pcb* pcb, uint16_t port);
 bool bm_pub(const char *topic, const void *data, uint16_t len, uint8_t type, uint8_t version=BM_COMMON_PUB_SUB_VERSION);
 bool bm_pub_wl(const char *topic, uint16_t topic_len, const void *data, uint16_t len, uint8_t type, uint8_t version=BM_COMMON_PUB_SUB_VERSION);
@@ -23,6 +22,9 @@ bool bm_sub_wl(const char *topic, uint16_t topic_len, const bm_cb_t callback);
 bool bm_unsub(const char *topic, const bm_cb_t callback);
 bool bm_unsub_wl(const char *topic, uint16_t topic_len, const bm_cb_t callback);
 void bm_handle_msg(uint64_t node_id, struct pbuf *pbuf);
+bool bm_wants_msg(const uint8_t *frame, uint16_t len);
+void bm_pub_batching_set_window(uint32_t window_ms);
+bool bm_pub_batching_flush(void);
 void bm_print_subs(void);
 char* bm_get_subs(void);
 
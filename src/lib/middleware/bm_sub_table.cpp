@@ -0,0 +1,706 @@
+#include <string.h>
+#include "FreeRTOS.h"
+#include "bm_sub_table.h"
+extern "C" {
+#include "fnv.h"
+}
+
+#define SLOT_MASK (BM_SUB_TABLE_LEN - 1)
+
+static_assert((BM_SUB_TABLE_LEN & SLOT_MASK) == 0, "BM_SUB_TABLE_LEN must be a power of 2");
+static_assert((BM_SUB_FILTER_BITS % 32) == 0, "BM_SUB_FILTER_BITS must be a multiple of 32");
+
+#define FILTER_WORDS (BM_SUB_FILTER_BITS / 32)
+
+// One level of a wildcard subscription topic, levels shared by several subscriptions form a trie
+typedef struct bm_sub_level_s {
+  struct bm_sub_level_s *parent;
+  struct bm_sub_level_s *children;
+  struct bm_sub_level_s *next;
+  char *level;
+  uint16_t level_len;
+  // Subscription for the topic ending at this level, no callbacks if there isn't one
+  bm_sub_t sub;
+} bm_sub_level_t;
+
+typedef struct {
+  // Open addressing with linear probing, a NULL topic marks an empty slot
+  bm_sub_t slots[BM_SUB_TABLE_LEN];
+  // Callback nodes, a NULL callback_fn marks a free node
+  bm_cb_node_t cb_pool[BM_SUB_MAX_CALLBACKS];
+  uint16_t num_topics;
+  // Wildcard subscription levels, a NULL level marks a free level
+  bm_sub_level_t level_pool[BM_SUB_MAX_WILDCARD_LEVELS];
+  bm_sub_level_t *wildcard_levels;
+  uint16_t num_wildcards;
+  // Hashes of exact topics and of the first level of wildcard topics. Rebuilt after
+  // every change and read without locking by bm_sub_table_may_match().
+  volatile uint32_t topic_filter[FILTER_WORDS];
+  volatile uint32_t level_filter[FILTER_WORDS];
+  // A wildcard subscription starts with a wildcard level, anything may match
+  volatile bool match_all;
+} subTableContext_t;
+
+static subTableContext_t _ctx;
+
+/*!
+  Hash a topic string
+  \param[in] *topic - topic string
+  \param[in] topic_len - byte length of topic
+  \return 32 bit FNV-1a hash of the topic
+*/
+static uint32_t topic_hash(const char *topic, uint16_t topic_len) {
+  return fnv_32a_buf(const_cast<char *>(topic), topic_len, FNV1_32A_INIT);
+}
+
+/*!
+  Find the slot holding a topic
+  \param[in] hash - hash of the topic
+  \param[in] *topic - topic string
+  \param[in] topic_len - byte length of topic
+  \return slot index, -1 if not found
+*/
+static int32_t find_slot(uint32_t hash, const char *topic, uint16_t topic_len) {
+  uint32_t idx = hash & SLOT_MASK;
+
+  // There is always at least one empty slot, so the probe sequence ends
+  while(_ctx.slots[idx].topic) {
+    const bm_sub_t *sub = &_ctx.slots[idx];
+    if((sub->hash == hash) && (sub->topic_len == topic_len) &&
+       (memcmp(sub->topic, topic, topic_len) == 0)) {
+      return static_cast<int32_t>(idx);
+    }
+    idx = (idx + 1) & SLOT_MASK;
+  }
+  return -1;
+}
+
+/*!
+  Get a free callback node from the pool
+  \return pointer to node, NULL if the pool is exhausted
+*/
+static bm_cb_node_t *alloc_cb_node(const bm_cb_t callback) {
+  for(uint16_t i = 0; i < BM_SUB_MAX_CALLBACKS; i++) {
+    if(_ctx.cb_pool[i].callback_fn == NULL) {
+      _ctx.cb_pool[i].callback_fn = callback;
+      _ctx.cb_pool[i].next = NULL;
+      return &_ctx.cb_pool[i];
+    }
+  }
+  return NULL;
+}
+
+/*!
+  Return a callback node to the pool
+  \param[in] *node - node to free
+  \return none
+*/
+static void free_cb_node(bm_cb_node_t *node) {
+  node->callback_fn = NULL;
+  node->next = NULL;
+}
+
+/*!
+  Add a callback to the end of an existing subscription's callbacks
+  \param[in] *sub - subscription
+  \param[in] callback - callback function to add
+  \return true if the callback is subscribed (including if it already was)
+*/
+static bool add_callback(bm_sub_t *sub, const bm_cb_t callback) {
+  bm_cb_node_t *last_cb_node = sub->callbacks;
+  while(true) {
+    if(last_cb_node->callback_fn == callback) {
+      // Callback already subscribed to this topic!
+      return true;
+    }
+    if(!last_cb_node->next) {
+      break;
+    }
+    last_cb_node = last_cb_node->next;
+  }
+
+  bm_cb_node_t *cb_node = alloc_cb_node(callback);
+  if(!cb_node) {
+    return false;
+  }
+  last_cb_node->next = cb_node;
+  return true;
+}
+
+/*!
+  Remove a callback from a subscription
+  \param[in] *sub - subscription
+  \param[in] callback - callback function to remove
+  \return true if the callback was subscribed
+*/
+static bool remove_callback(bm_sub_t *sub, const bm_cb_t callback) {
+  bm_cb_node_t *cb_node = sub->callbacks;
+  bm_cb_node_t *prev_node = NULL;
+
+  // Check nodes for matching callback
+  while(cb_node && (cb_node->callback_fn != callback)) {
+    prev_node = cb_node;
+    cb_node = cb_node->next;
+  }
+
+  // Didn't find a matching callback to unsubscribe :'(
+  if(!cb_node) {
+    return false;
+  }
+
+  // Link to the next node in list
+  if(prev_node) {
+    prev_node->next = cb_node->next;
+  } else {
+    sub->callbacks = cb_node->next;
+  }
+  free_cb_node(cb_node);
+  return true;
+}
+
+/*!
+  Copy a topic string
+  \param[in] *topic - topic string
+  \param[in] topic_len - byte length of topic
+  \return null terminated copy, NULL if out of memory
+*/
+static char *copy_topic(const char *topic, uint16_t topic_len) {
+  char *topic_copy = static_cast<char *>(pvPortMalloc(topic_len + 1));
+  if(topic_copy) {
+    memcpy(topic_copy, topic, topic_len);
+    topic_copy[topic_len] = 0;
+  }
+  return topic_copy;
+}
+
+/*!
+  Empty a slot, shifting back later entries of the probe sequence so lookups
+  don't need tombstones
+  \param[in] idx - slot to empty
+  \return none
+*/
+static void delete_slot(uint32_t idx) {
+  uint32_t hole = idx;
+  uint32_t next = idx;
+
+  memset(&_ctx.slots[hole], 0, sizeof(bm_sub_t));
+  while(true) {
+    next = (next + 1) & SLOT_MASK;
+    if(!_ctx.slots[next].topic) {
+      break;
+    }
+
+    // Entries whose home slot is cyclically in (hole, next] have to stay put
+    uint32_t home = _ctx.slots[next].hash & SLOT_MASK;
+    bool stays = (hole <= next) ? ((hole < home) && (home <= next)) : ((hole < home) || (home <= next));
+    if(!stays) {
+      _ctx.slots[hole] = _ctx.slots[next];
+      memset(&_ctx.slots[next], 0, sizeof(bm_sub_t));
+      hole = next;
+    }
+  }
+  _ctx.num_topics--;
+}
+
+/*!
+  Check a topic for wildcards
+  \param[in] *topic - topic string
+  \param[in] topic_len - byte length of topic
+  \return 1 if the topic has valid wildcards, 0 if it has none, -1 if they are misused
+*/
+static int8_t check_wildcards(const char *topic, uint16_t topic_len) {
+  int8_t rval = 0;
+  uint16_t level_start = 0;
+  for(uint16_t i = 0; i < topic_len; i++) {
+    if((topic[i] != BM_SUB_SINGLE_LEVEL_WILDCARD) && (topic[i] != BM_SUB_MULTI_LEVEL_WILDCARD)) {
+      if(topic[i] == BM_SUB_LEVEL_SEPARATOR) {
+        level_start = i + 1;
+      }
+      continue;
+    }
+
+    // Wildcards have to be a whole level
+    bool whole_level = (i == level_start) &&
+                       ((i + 1 == topic_len) || (topic[i + 1] == BM_SUB_LEVEL_SEPARATOR));
+    // and '#' can only be the last one
+    if(!whole_level || ((topic[i] == BM_SUB_MULTI_LEVEL_WILDCARD) && (i + 1 != topic_len))) {
+      return -1;
+    }
+    rval = 1;
+  }
+  return rval;
+}
+
+/*!
+  Split the first level off a topic
+  \param[in] *topic - topic string
+  \param[in] topic_len - byte length of topic
+  \param[out] *level_len - byte length of the first level
+  \return pointer to the rest of the topic after the separator, NULL if this is the last level
+*/
+static const char *split_level(const char *topic, uint16_t topic_len, uint16_t *level_len) {
+  const char *separator = static_cast<const char *>(memchr(topic, BM_SUB_LEVEL_SEPARATOR, topic_len));
+  if(!separator) {
+    *level_len = topic_len;
+    return NULL;
+  }
+  *level_len = static_cast<uint16_t>(separator - topic);
+  return separator + 1;
+}
+
+/*!
+  Find a level in a list of sibling levels
+  \param[in] *levels - first sibling
+  \param[in] *level - level string
+  \param[in] level_len - byte length of level
+  \return pointer to level, NULL if not found
+*/
+static bm_sub_level_t *find_level(bm_sub_level_t *levels, const char *level, uint16_t level_len) {
+  while(levels) {
+    if((levels->level_len == level_len) && (memcmp(levels->level, level, level_len) == 0)) {
+      break;
+    }
+    levels = levels->next;
+  }
+  return levels;
+}
+
+/*!
+  Free a wildcard level and any parents that are no longer used by a subscription
+  \param[in] *level - last level of a topic
+  \return none
+*/
+static void prune_levels(bm_sub_level_t *level) {
+  while(level && !level->children && !level->sub.callbacks) {
+    bm_sub_level_t **link = level->parent ? &level->parent->children : &_ctx.wildcard_levels;
+    while(*link != level) {
+      link = &(*link)->next;
+    }
+    *link = level->next;
+
+    bm_sub_level_t *parent = level->parent;
+    vPortFree(level->level);
+    memset(level, 0, sizeof(bm_sub_level_t));
+    level = parent;
+  }
+}
+
+/*!
+  Find the last level of a wildcard topic
+  \param[in] *topic - topic string
+  \param[in] topic_len - byte length of topic
+  \param[in] create - add any missing levels
+  \return pointer to the last level, NULL if not found or out of levels
+*/
+static bm_sub_level_t *get_wildcard(const char *topic, uint16_t topic_len, bool create) {
+  bm_sub_level_t *parent = NULL;
+  bm_sub_level_t *level = NULL;
+  const char *rest = topic;
+
+  while(rest) {
+    uint16_t level_len;
+    uint16_t rest_len = topic_len - static_cast<uint16_t>(rest - topic);
+    const char *next = split_level(rest, rest_len, &level_len);
+
+    level = find_level(parent ? parent->children : _ctx.wildcard_levels, rest, level_len);
+    if(!level && create) {
+      for(uint16_t i = 0; i < BM_SUB_MAX_WILDCARD_LEVELS; i++) {
+        if(!_ctx.level_pool[i].level) {
+          level = &_ctx.level_pool[i];
+          break;
+        }
+      }
+      if(level) {
+        level->level = copy_topic(rest, level_len);
+        if(!level->level) {
+          level = NULL;
+        }
+      }
+      if(level) {
+        level->parent = parent;
+        level->level_len = level_len;
+        bm_sub_level_t **siblings = parent ? &parent->children : &_ctx.wildcard_levels;
+        level->next = *siblings;
+        *siblings = level;
+      }
+    }
+    if(!level) {
+      // Don't leave behind levels added for this topic
+      prune_levels(parent);
+      return NULL;
+    }
+
+    parent = level;
+    rest = next;
+  }
+  return level;
+}
+
+/*!
+  Find the wildcard subscriptions matching the rest of a topic
+  \param[in] *levels - candidate levels for the first level of the rest of the topic
+  \param[in] *rest - rest of the topic string, NULL if all levels have been matched
+  \param[in] rest_len - byte length of rest
+  \param[in] visit - called for every match, can be NULL
+  \param[in] *arg - passed to visit
+  \param[in,out] *stop - set when visit asks to stop
+  \return number of matching subscriptions
+*/
+static uint16_t match_levels(const bm_sub_level_t *levels, const char *rest, uint16_t rest_len,
+                             bm_sub_visit_t visit, void *arg, bool *stop) {
+  uint16_t matches = 0;
+  uint16_t level_len = 0;
+  const char *next = NULL;
+  if(rest) {
+    next = split_level(rest, rest_len, &level_len);
+  }
+
+  for(; levels && !*stop; levels = levels->next) {
+    bool multi = (levels->level_len == 1) && (levels->level[0] == BM_SUB_MULTI_LEVEL_WILDCARD);
+    bool single = (levels->level_len == 1) && (levels->level[0] == BM_SUB_SINGLE_LEVEL_WILDCARD);
+
+    if(multi || (rest && (single || ((levels->level_len == level_len) &&
+                                     (memcmp(levels->level, rest, level_len) == 0))))) {
+      // '#' matches whatever is left, anything else matches if this was the last level
+      if(levels->sub.callbacks && (multi || !next)) {
+        matches++;
+        if(visit && !visit(&levels->sub, arg)) {
+          *stop = true;
+        }
+      }
+      // A '#' below the last level also matches, "sensor/#" matches "sensor"
+      if(!multi && levels->children) {
+        uint16_t next_len = next ? rest_len - level_len - 1 : 0;
+        matches += match_levels(levels->children, next, next_len, visit, arg, stop);
+      }
+    }
+  }
+  return matches;
+}
+
+/*!
+  Find the subscription for a topic
+  \param[in] *topic - topic string
+  \param[in] topic_len - byte length of topic
+  \return pointer to bm_sub_t, NULL if not found
+*/
+const bm_sub_t *bm_sub_table_get(const char *topic, uint16_t topic_len) {
+  if(!topic || !_ctx.num_topics) {
+    return NULL;
+  }
+
+  int32_t idx = find_slot(topic_hash(topic, topic_len), topic, topic_len);
+  return (idx < 0) ? NULL : &_ctx.slots[idx];
+}
+
+/*!
+  Find all subscriptions matching a topic, the exact topic first then any wildcard subscriptions
+  \param[in] *topic - topic string
+  \param[in] topic_len - byte length of topic
+  \param[in] visit - called for every matching subscription, can be NULL to just count them
+  \param[in] *arg - passed to visit
+  \return number of matching subscriptions visited
+*/
+uint16_t bm_sub_table_match(const char *topic, uint16_t topic_len, bm_sub_visit_t visit, void *arg) {
+  uint16_t matches = 0;
+  bool stop = false;
+
+  const bm_sub_t *sub = bm_sub_table_get(topic, topic_len);
+  if(sub) {
+    matches++;
+    if(visit && !visit(sub, arg)) {
+      stop = true;
+    }
+  }
+
+  if(topic && _ctx.wildcard_levels && !stop) {
+    matches += match_levels(_ctx.wildcard_levels, topic, topic_len, visit, arg, &stop);
+  }
+  return matches;
+}
+
+/*!
+  Check a topic against one subscription topic, with the same wildcard rules as
+  bm_sub_table_match(). Used for subscriptions that aren't in this table.
+  \param[in] *sub_topic - subscription topic, can have wildcards
+  \param[in] sub_topic_len - byte length of sub_topic
+  \param[in] *topic - topic string
+  \param[in] topic_len - byte length of topic
+  \return true if the subscription matches the topic
+*/
+bool bm_sub_topic_matches(const char *sub_topic, uint16_t sub_topic_len, const char *topic, uint16_t topic_len) {
+  if(!sub_topic || !topic) {
+    return false;
+  }
+
+  const char *sub_rest = sub_topic;
+  const char *rest = topic;
+  while(sub_rest) {
+    uint16_t sub_level_len;
+    const char *sub_next = split_level(sub_rest, sub_topic_len - static_cast<uint16_t>(sub_rest - sub_topic),
+                                       &sub_level_len);
+    if((sub_level_len == 1) && (sub_rest[0] == BM_SUB_MULTI_LEVEL_WILDCARD)) {
+      // Matches whatever is left, including nothing
+      return true;
+    }
+    if(!rest) {
+      return false;
+    }
+
+    uint16_t level_len;
+    const char *next = split_level(rest, topic_len - static_cast<uint16_t>(rest - topic), &level_len);
+    bool single = (sub_level_len == 1) && (sub_rest[0] == BM_SUB_SINGLE_LEVEL_WILDCARD);
+    if(!single && ((sub_level_len != level_len) || (memcmp(sub_rest, rest, level_len) != 0))) {
+      return false;
+    }
+    sub_rest = sub_next;
+    rest = next;
+  }
+  return !rest;
+}
+
+// Bloom filter with two bits per topic, one from each half of the hash
+static uint32_t filter_bit(uint32_t hash, uint8_t half) {
+  return (half ? (hash >> 16) : hash) % BM_SUB_FILTER_BITS;
+}
+
+static void filter_set(uint32_t *filter, uint32_t hash) {
+  for(uint8_t half = 0; half < 2; half++) {
+    uint32_t bit = filter_bit(hash, half);
+    filter[bit / 32] |= 1u << (bit % 32);
+  }
+}
+
+static bool filter_test(const volatile uint32_t *filter, uint32_t hash) {
+  for(uint8_t half = 0; half < 2; half++) {
+    uint32_t bit = filter_bit(hash, half);
+    if(!(filter[bit / 32] & (1u << (bit % 32)))) {
+      return false;
+    }
+  }
+  return true;
+}
+
+/*!
+  Recompute the filters after the subscriptions changed. Every word is written
+  once with its final value, so a topic subscribed before and after the change
+  matches throughout, even for a reader running at the same time.
+  \return none
+*/
+static void rebuild_filter(void) {
+  uint32_t topic_filter[FILTER_WORDS] = {0};
+  uint32_t level_filter[FILTER_WORDS] = {0};
+  bool match_all = false;
+
+  for(uint32_t idx = 0; idx < BM_SUB_TABLE_LEN; idx++) {
+    if(_ctx.slots[idx].topic) {
+      filter_set(topic_filter, _ctx.slots[idx].hash);
+    }
+  }
+  for(const bm_sub_level_t *level = _ctx.wildcard_levels; level; level = level->next) {
+    if((level->level_len == 1) && ((level->level[0] == BM_SUB_SINGLE_LEVEL_WILDCARD) ||
+                                   (level->level[0] == BM_SUB_MULTI_LEVEL_WILDCARD))) {
+      match_all = true;
+    }
+    filter_set(level_filter, topic_hash(level->level, level->level_len));
+  }
+
+  // Widen before narrowing
+  if(match_all) {
+    _ctx.match_all = true;
+  }
+  for(uint32_t word = 0; word < FILTER_WORDS; word++) {
+    _ctx.topic_filter[word] = topic_filter[word];
+    _ctx.level_filter[word] = level_filter[word];
+  }
+  _ctx.match_all = match_all;
+}
+
+/*!
+  Cheap check for whether a topic could have subscribers, for dropping unwanted
+  messages early. Safe to call from any task while subscriptions change.
+  \param[in] *topic - topic string
+  \param[in] topic_len - byte length of topic
+  \return false if no subscription matches the topic, true if one may
+*/
+bool bm_sub_table_may_match(const char *topic, uint16_t topic_len) {
+  if(!topic) {
+    return false;
+  }
+  if(_ctx.match_all || filter_test(_ctx.topic_filter, topic_hash(topic, topic_len))) {
+    return true;
+  }
+
+  uint16_t level_len;
+  split_level(topic, topic_len, &level_len);
+  return filter_test(_ctx.level_filter, topic_hash(topic, level_len));
+}
+
+static bool table_add(const char *topic, uint16_t topic_len, const bm_cb_t callback) {
+  if(!topic || !topic_len || !callback) {
+    return false;
+  }
+
+  int8_t wildcards = check_wildcards(topic, topic_len);
+  if(wildcards < 0) {
+    return false;
+  }
+  if(wildcards) {
+    bm_sub_level_t *level = get_wildcard(topic, topic_len, true);
+    if(!level) {
+      return false;
+    }
+    if(level->sub.callbacks) {
+      return add_callback(&level->sub, callback);
+    }
+
+    bm_cb_node_t *cb_node = alloc_cb_node(callback);
+    char *topic_copy = cb_node ? copy_topic(topic, topic_len) : NULL;
+    if(!topic_copy) {
+      if(cb_node) {
+        free_cb_node(cb_node);
+      }
+      prune_levels(level);
+      return false;
+    }
+    level->sub.topic = topic_copy;
+    level->sub.topic_len = topic_len;
+    level->sub.callbacks = cb_node;
+    _ctx.num_wildcards++;
+    return true;
+  }
+
+  uint32_t hash = topic_hash(topic, topic_len);
+  int32_t idx = find_slot(hash, topic, topic_len);
+
+  if(idx >= 0) {
+    // Subscription already exists, add a new callback at the end of the list
+    return add_callback(&_ctx.slots[idx], callback);
+  }
+
+  // Creating new subscription from scratch
+  if(_ctx.num_topics >= BM_SUB_MAX_TOPICS) {
+    return false;
+  }
+
+  bm_cb_node_t *cb_node = alloc_cb_node(callback);
+  if(!cb_node) {
+    return false;
+  }
+
+  char *topic_copy = copy_topic(topic, topic_len);
+  if(!topic_copy) {
+    free_cb_node(cb_node);
+    return false;
+  }
+
+  uint32_t slot = hash & SLOT_MASK;
+  while(_ctx.slots[slot].topic) {
+    slot = (slot + 1) & SLOT_MASK;
+  }
+  _ctx.slots[slot].hash = hash;
+  _ctx.slots[slot].topic = topic_copy;
+  _ctx.slots[slot].topic_len = topic_len;
+  _ctx.slots[slot].callbacks = cb_node;
+  _ctx.num_topics++;
+
+  return true;
+}
+
+static bool table_remove(const char *topic, uint16_t topic_len, const bm_cb_t callback) {
+  if(!topic) {
+    return false;
+  }
+
+  if(check_wildcards(topic, topic_len) > 0) {
+    bm_sub_level_t *level = get_wildcard(topic, topic_len, false);
+    if(!level || !level->sub.callbacks || !remove_callback(&level->sub, callback)) {
+      return false;
+    }
+    if(level->sub.callbacks == NULL) {
+      vPortFree(level->sub.topic);
+      memset(&level->sub, 0, sizeof(bm_sub_t));
+      _ctx.num_wildcards--;
+      prune_levels(level);
+    }
+    return true;
+  }
+
+  if(!_ctx.num_topics) {
+    return false;
+  }
+
+  int32_t idx = find_slot(topic_hash(topic, topic_len), topic, topic_len);
+  if(idx < 0) {
+    return false;
+  }
+
+  bm_sub_t *sub = &_ctx.slots[idx];
+  if(!remove_callback(sub, callback)) {
+    return false;
+  }
+
+  // If there are no more callbacks, delete the sub entirely
+  if(sub->callbacks == NULL) {
+    vPortFree(sub->topic);
+    delete_slot(static_cast<uint32_t>(idx));
+  }
+
+  return true;
+}
+
+/*!
+  Add a callback to a topic, creating the subscription if needed. Topics can use
+  BM_SUB_SINGLE_LEVEL_WILDCARD and BM_SUB_MULTI_LEVEL_WILDCARD levels
+  \param[in] *topic - topic string
+  \param[in] topic_len - byte length of topic
+  \param[in] callback - callback function to add
+  \return true if the callback is subscribed to the topic (including if it already was)
+*/
+bool bm_sub_table_add(const char *topic, uint16_t topic_len, const bm_cb_t callback) {
+  bool rval = table_add(topic, topic_len, callback);
+  if(rval) {
+    rebuild_filter();
+  }
+  return rval;
+}
+
+/*!
+  Remove a callback from a topic, deleting the subscription when it has no callbacks left
+  \param[in] *topic - topic string
+  \param[in] topic_len - byte length of topic
+  \param[in] callback - callback function to remove
+  \return true if the callback was subscribed to the topic
+*/
+bool bm_sub_table_remove(const char *topic, uint16_t topic_len, const bm_cb_t callback) {
+  bool rval = table_remove(topic, topic_len, callback);
+  if(rval) {
+    rebuild_filter();
+  }
+  return rval;
+}
+
+/*!
+  Get the subscription at a table index, used to list all subscriptions
+  \param[in] index - 0 to BM_SUB_TABLE_ENTRIES - 1
+  \return pointer to bm_sub_t, NULL if there is no subscription at this index
+*/
+const bm_sub_t *bm_sub_table_entry(uint16_t index) {
+  if(index < BM_SUB_TABLE_LEN) {
+    return _ctx.slots[index].topic ? &_ctx.slots[index] : NULL;
+  }
+
+  index -= BM_SUB_TABLE_LEN;
+  if((index >= BM_SUB_MAX_WILDCARD_LEVELS) || !_ctx.level_pool[index].sub.callbacks) {
+    return NULL;
+  }
+  return &_ctx.level_pool[index].sub;
+}
+
+/*!
+  Get the number of subscribed topics, including wildcard topics
+  \return number of topics
+*/
+uint16_t bm_sub_table_count(void) {
+  return _ctx.num_topics + _ctx.num_wildcards;
+}
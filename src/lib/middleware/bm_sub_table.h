@@ -0,0 +1,64 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Topic slots in the subscription hash table, must be a power of 2
+#ifndef BM_SUB_TABLE_LEN
+#define BM_SUB_TABLE_LEN (64)
+#endif
+// Subscribed topics are capped below the table size to keep probe sequences short
+#define BM_SUB_MAX_TOPICS ((BM_SUB_TABLE_LEN * 3) / 4)
+// Callbacks shared by all topics
+#ifndef BM_SUB_MAX_CALLBACKS
+#define BM_SUB_MAX_CALLBACKS (64)
+#endif
+// Topic levels shared by all wildcard subscriptions ("sensor/+/sofar/aanderaa" uses 4)
+#ifndef BM_SUB_MAX_WILDCARD_LEVELS
+#define BM_SUB_MAX_WILDCARD_LEVELS (32)
+#endif
+// Bits in the filters behind bm_sub_table_may_match(), must be a multiple of 32
+#define BM_SUB_FILTER_BITS (256)
+// Indices for bm_sub_table_entry(), exact topics first then wildcard subscriptions
+#define BM_SUB_TABLE_ENTRIES (BM_SUB_TABLE_LEN + BM_SUB_MAX_WILDCARD_LEVELS)
+
+#define BM_SUB_LEVEL_SEPARATOR '/'
+// Matches exactly one topic level, "sensor/+/sofar/aanderaa"
+#define BM_SUB_SINGLE_LEVEL_WILDCARD '+'
+// Matches the parent level and everything below it, must be the last level, "sensor/#"
+#define BM_SUB_MULTI_LEVEL_WILDCARD '#'
+
+typedef void (*bm_cb_t)(uint64_t node_id, const char* topic, uint16_t topic_len, const uint8_t* data, uint16_t data_len, uint8_t type, uint8_t version);
+
+// Used for callback linked-list
+typedef struct bm_cb_node_s {
+  struct bm_cb_node_s *next;
+  bm_cb_t callback_fn;
+} bm_cb_node_t;
+
+typedef struct {
+  uint32_t hash;
+  char *topic;
+  uint16_t topic_len;
+  bm_cb_node_t *callbacks;
+} bm_sub_t;
+
+// Called for every subscription matching a topic, return false to stop matching
+typedef bool (*bm_sub_visit_t)(const bm_sub_t *sub, void *arg);
+
+const bm_sub_t *bm_sub_table_get(const char *topic, uint16_t topic_len);
+uint16_t bm_sub_table_match(const char *topic, uint16_t topic_len, bm_sub_visit_t visit, void *arg);
+bool bm_sub_table_add(const char *topic, uint16_t topic_len, const bm_cb_t callback);
+bool bm_sub_table_remove(const char *topic, uint16_t topic_len, const bm_cb_t callback);
+bool bm_sub_table_may_match(const char *topic, uint16_t topic_len);
+bool bm_sub_topic_matches(const char *sub_topic, uint16_t sub_topic_len, const char *topic, uint16_t topic_len);
+const bm_sub_t *bm_sub_table_entry(uint16_t index);
+uint16_t bm_sub_table_count(void);
+
+#ifdef __cplusplus
+}
+#endif
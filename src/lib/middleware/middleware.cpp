@@ -15,13 +15,14 @@
 
 #define NET_QUEUE_LEN 64
 
-#define MAX_PAYLOAD_LEN (1500 - sizeof(struct ip6_hdr) - sizeof(struct udp_hdr))
+#define MAX_PAYLOAD_LEN BM_MIDDLEWARE_MAX_PAYLOAD_LEN
 
 typedef struct {
     struct netif* netif;
     struct udp_pcb* pcb;
     uint16_t port;
     xQueueHandle netQueue;
+    bm_middleware_tx_stats_t tx_stats;
 } middlewareContext_t;
 
 typedef struct {
@@ -79,9 +80,29 @@ int32_t middleware_net_tx(struct pbuf *pbuf) {
     rval = safe_udp_sendto_if(_ctx.pcb, pbuf, &multicast_global_addr, _ctx.port, _ctx.netif);
   }
 
+  if(rval == ERR_OK) {
+    taskENTER_CRITICAL();
+    _ctx.tx_stats.frames++;
+    _ctx.tx_stats.bytes += pbuf->tot_len;
+    taskEXIT_CRITICAL();
+  }
+
   return rval;
 }
 
+/*!
+  Get a copy of the transmit stats
+
+  \param[out] *stats - transmit stats
+  \return none
+*/
+void bm_middleware_get_tx_stats(bm_middleware_tx_stats_t *stats) {
+  configASSERT(stats);
+  taskENTER_CRITICAL();
+  *stats = _ctx.tx_stats;
+  taskEXIT_CRITICAL();
+}
+
 /*!
   Middleware UDP rx callback
   \param[in] *arg - unused
@@ -190,3 +211,27 @@ static void middleware_net_task( void *parameters ) {
     }
   }
 }
+
+/*!
+  Multicast filter for the L2 layer. Drops pubsub packets nothing here is
+  subscribed to before they reach lwip, everything else goes through.
+  \param[in] *ip6_packet - received ipv6 packet
+  \param[in] len - packet length
+  \return false if the packet can be dropped
+*/
+bool bm_middleware_wants_packet(const uint8_t *ip6_packet, uint16_t len) {
+  configASSERT(ip6_packet);
+
+  if((len < IP6_HLEN + UDP_HLEN) || (ip6_packet[offsetof(struct ip6_hdr, _nexth)] != IP6_NEXTH_UDP)) {
+    return true;
+  }
+
+  const struct udp_hdr *udp = reinterpret_cast<const struct udp_hdr *>(&ip6_packet[IP6_HLEN]);
+  uint16_t udp_len = lwip_ntohs(udp->len);
+  // Short frames are padded, so trust the UDP length. Bad ones are lwip's problem.
+  if((lwip_ntohs(udp->dest) != _ctx.port) || (udp_len < UDP_HLEN) || (udp_len > len - IP6_HLEN)) {
+    return true;
+  }
+
+  return bm_wants_msg(&ip6_packet[IP6_HLEN + UDP_HLEN], udp_len - UDP_HLEN);
+}
@@ -4,14 +4,28 @@
 #include <stdint.h>
 #include "lwip/netif.h"
 #include "lwip/pbuf.h"
+#include "lwip/prot/ip6.h"
+#include "lwip/prot/udp.h"
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+// Largest pubsub frame middleware_net_tx() will send
+#define BM_MIDDLEWARE_MAX_PAYLOAD_LEN (1500 - IP6_HLEN - UDP_HLEN)
+
+typedef struct {
+  // Frames middleware_net_tx() handed to lwIP
+  uint32_t frames;
+  // UDP payload bytes in those frames
+  uint32_t bytes;
+} bm_middleware_tx_stats_t;
+
 int32_t bm_middleware_local_pub(struct pbuf *pbuf);
 void bm_middleware_init(struct netif* netif, uint16_t port);
 int32_t middleware_net_tx(struct pbuf *pbuf);
+bool bm_middleware_wants_packet(const uint8_t *ip6_packet, uint16_t len);
+void bm_middleware_get_tx_stats(bm_middleware_tx_stats_t *stats);
 
 #ifdef __cplusplus
 }
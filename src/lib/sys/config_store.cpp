@@ -0,0 +1,522 @@
+#include "config_store.h"
+#include "FreeRTOS.h"
+#include "crc.h"
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+
+namespace cfg {
+
+static constexpr uint8_t NUM_BLOCKS = 2;
+static constexpr uint16_t ERASED_LEN = 0xFFFF;
+// Keeps the flash driver's own buffers small while loading a block
+static constexpr uint32_t READ_CHUNK_BYTES = 1024;
+static constexpr uint16_t MIN_INDEX_LEN = 16;
+
+static uint32_t keyHash(const char *key, uint8_t key_len) {
+    return crc32_ieee(reinterpret_cast<const uint8_t *>(key), key_len);
+}
+
+static uint32_t valueCrc32(uint8_t type, const uint8_t *value, uint16_t value_len) {
+    return crc32_ieee_update(crc32_ieee(&type, sizeof(type)), value, value_len);
+}
+
+static uint32_t recordLen(uint8_t key_len, uint16_t value_len) {
+    return sizeof(ConfigStoreRecordHeader_t) + key_len + value_len;
+}
+
+static uint32_t recordCrc32(const ConfigStoreRecordHeader_t &header, const uint8_t *payload) {
+    uint32_t crc = crc32_ieee(reinterpret_cast<const uint8_t *>(&header), offsetof(ConfigStoreRecordHeader_t, crc32));
+    return crc32_ieee_update(crc, payload, header.len - sizeof(ConfigStoreRecordHeader_t));
+}
+
+static uint32_t blockHeaderCrc32(const ConfigStoreBlockHeader_t &header) {
+    return crc32_ieee(reinterpret_cast<const uint8_t *>(&header), offsetof(ConfigStoreBlockHeader_t, crc32));
+}
+
+/*!
+* Lay out a record in a buffer
+* \param buffer[out] - where the record goes
+* \param flags[in] - ConfigStoreRecordFlags_e
+* \param key[in] - key, not null terminated
+* \param key_len[in] - key length
+* \param type[in] - value type, stored as is
+* \param value[in] - value, NULL for a delete
+* \param value_len[in] - value length
+* \returns - record length
+*/
+static uint32_t serializeRecord(uint8_t *buffer, uint8_t flags, const char *key, uint8_t key_len, uint8_t type,
+                                const uint8_t *value, uint16_t value_len) {
+    ConfigStoreRecordHeader_t header;
+    header.len = recordLen(key_len, value_len);
+    header.flags = flags;
+    header.keyLen = key_len;
+    header.type = type;
+    memcpy(&buffer[sizeof(header)], key, key_len);
+    if (value_len) {
+        memcpy(&buffer[sizeof(header) + key_len], value, value_len);
+    }
+    header.crc32 = recordCrc32(header, &buffer[sizeof(header)]);
+    memcpy(buffer, &header, sizeof(header));
+    return header.len;
+}
+
+ConfigStore::ConfigStore(NvmPartition &flash_partition)
+    : _flash_partition(flash_partition), _index(NULL), _index_len(0), _num_keys(0),
+      _block_size(flash_partition.alignment()), _active_block(-1), _seq(0), _tail(0), _tail_dirty(false),
+      _block_cache(NULL) {
+    // NvmPartition wants every access to end before the partition does
+    configASSERT(_block_size * NUM_BLOCKS < _flash_partition.size());
+    configASSERT(_block_size < ERASED_LEN);
+    memset(&_stats, 0, sizeof(_stats));
+}
+
+ConfigStore::~ConfigStore() {
+    vPortFree(_index);
+}
+
+/*!
+* Make room in the index, doubling it so a growing config doesn't reallocate on every key
+* \param num_keys[in] - number of keys the index needs to hold
+* \returns - true if success, false if out of memory
+*/
+bool ConfigStore::reserveIndex(uint16_t num_keys) {
+    if (num_keys <= _index_len) {
+        return true;
+    }
+    uint32_t index_len = (_index_len < MIN_INDEX_LEN) ? MIN_INDEX_LEN : _index_len * 2;
+    if (index_len < num_keys) {
+        index_len = num_keys;
+    }
+    if (index_len > UINT16_MAX) {
+        index_len = UINT16_MAX;
+    }
+    ConfigStoreIndexEntry_t *index =
+        static_cast<ConfigStoreIndexEntry_t *>(pvPortMalloc(index_len * sizeof(ConfigStoreIndexEntry_t)));
+    if (!index) {
+        return false;
+    }
+    if (_index) {
+        memcpy(index, _index, _num_keys * sizeof(ConfigStoreIndexEntry_t));
+        vPortFree(_index);
+    }
+    _index = index;
+    _index_len = index_len;
+    return true;
+}
+
+uint32_t ConfigStore::blockOffset(uint8_t block) {
+    return block * _block_size;
+}
+
+bool ConfigStore::readBlockHeader(uint8_t block, ConfigStoreBlockHeader_t &header) {
+    memset(&header, 0, sizeof(header));
+    if (!_flash_partition.read(blockOffset(block), reinterpret_cast<uint8_t *>(&header), sizeof(header), CONFIG_STORE_TIMEOUT_MS)) {
+        return false;
+    }
+    return header.magic == CONFIG_STORE_MAGIC && header.crc32 == blockHeaderCrc32(header) &&
+           header.compactedLen <= _block_size - sizeof(header);
+}
+
+/*!
+* Read a whole block, a chunk at a time
+* \param block[in] - block number
+* \param buffer[out] - _block_size bytes
+* \returns - true if success, false otherwise.
+*/
+bool ConfigStore::readBlock(uint8_t block, uint8_t *buffer) {
+    for (uint32_t offset = 0; offset < _block_size; offset += READ_CHUNK_BYTES) {
+        uint32_t len = (_block_size - offset < READ_CHUNK_BYTES) ? _block_size - offset : READ_CHUNK_BYTES;
+        if (!_flash_partition.read(blockOffset(block) + offset, &buffer[offset], len, CONFIG_STORE_TIMEOUT_MS)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool ConfigStore::keyMatches(const ConfigStoreIndexEntry_t &entry, const char *key) {
+    uint32_t key_offset = entry.offset + sizeof(ConfigStoreRecordHeader_t);
+    if (_block_cache) {
+        return memcmp(&_block_cache[key_offset], key, entry.keyLen) == 0;
+    }
+    uint8_t stored_key[CONFIG_STORE_MAX_KEY_LEN];
+    if (!_flash_partition.read(blockOffset(_active_block) + key_offset, stored_key, entry.keyLen, CONFIG_STORE_TIMEOUT_MS)) {
+        // Hash and length already match, a collision is far less likely than this being the key
+        return true;
+    }
+    return memcmp(stored_key, key, entry.keyLen) == 0;
+}
+
+int32_t ConfigStore::findKey(const char *key, uint8_t key_len, uint32_t key_hash) {
+    for (uint16_t i = 0; i < _num_keys; i++) {
+        if (_index[i].keyHash == key_hash && _index[i].keyLen == key_len && keyMatches(_index[i], key)) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+/*!
+* Point the index at a record that is now on flash
+* \param offset[in] - record offset in the active block
+* \param header[in] - record header
+* \param key[in] - record key
+* \param value_crc32[in] - crc of the record's type and value
+* \returns - true if success, false if the index can't grow or the record is bad
+*/
+bool ConfigStore::applyRecord(uint16_t offset, const ConfigStoreRecordHeader_t &header, const char *key, uint32_t value_crc32) {
+    uint32_t key_hash = keyHash(key, header.keyLen);
+    int32_t idx = findKey(key, header.keyLen, key_hash);
+    if (header.flags == CONFIG_STORE_RECORD_DELETE) {
+        if (idx >= 0) {
+            memmove(&_index[idx], &_index[idx + 1], (_num_keys - idx - 1) * sizeof(ConfigStoreIndexEntry_t));
+            _num_keys--;
+        }
+        return true;
+    }
+    if (header.flags != CONFIG_STORE_RECORD_SET) {
+        return false;
+    }
+    if (idx < 0) {
+        if (!reserveIndex(_num_keys + 1)) {
+            return false;
+        }
+        idx = _num_keys++;
+        _index[idx].keyHash = key_hash;
+        _index[idx].keyLen = header.keyLen;
+        _index[idx].seen = false;
+    }
+    _index[idx].offset = offset;
+    _index[idx].valueCrc32 = value_crc32;
+    return true;
+}
+
+/*!
+* Load the newest valid block and replay its log
+* \param cb[in] - called with every live key, in the order they were first stored
+* \param arg[in] - passed to cb
+* \returns - true if a block was loaded, false if there is none (or it can't be read)
+*/
+bool ConfigStore::load(ConfigStoreLoadCb cb, void *arg) {
+    configASSERT(cb);
+    bool rval = false;
+    _num_keys = 0;
+    _active_block = -1;
+    _tail_dirty = false;
+
+    ConfigStoreBlockHeader_t headers[NUM_BLOCKS];
+    bool valid[NUM_BLOCKS];
+    for (uint8_t block = 0; block < NUM_BLOCKS; block++) {
+        valid[block] = readBlockHeader(block, headers[block]);
+    }
+    // Newest first, the other one is the fallback if its compaction was torn
+    uint8_t order[NUM_BLOCKS] = {0, 1};
+    if (valid[0] && valid[1] && static_cast<int32_t>(headers[1].seq - headers[0].seq) > 0) {
+        order[0] = 1;
+        order[1] = 0;
+    }
+
+    uint8_t *block_buffer = static_cast<uint8_t *>(pvPortMalloc(_block_size));
+    configASSERT(block_buffer);
+    do {
+        bool read_ok = true;
+        for (uint8_t i = 0; i < NUM_BLOCKS && read_ok && _active_block < 0; i++) {
+            uint8_t block = order[i];
+            if (!valid[block]) {
+                continue;
+            }
+            read_ok = readBlock(block, block_buffer);
+            const ConfigStoreBlockHeader_t &header = headers[block];
+            if (read_ok && crc32_ieee(&block_buffer[sizeof(header)], header.compactedLen) == header.compactedCrc32) {
+                _active_block = block;
+                _seq = header.seq;
+            }
+        }
+        if (_active_block < 0) {
+            break;
+        }
+
+        _block_cache = block_buffer;
+        uint32_t offset = sizeof(ConfigStoreBlockHeader_t);
+        while (offset + sizeof(ConfigStoreRecordHeader_t) <= _block_size) {
+            ConfigStoreRecordHeader_t header;
+            memcpy(&header, &block_buffer[offset], sizeof(header));
+            if (header.len == ERASED_LEN) {
+                break;
+            }
+            const uint8_t *payload = &block_buffer[offset + sizeof(header)];
+            if (header.len < recordLen(header.keyLen, 0) || offset + header.len > _block_size ||
+                header.keyLen > CONFIG_STORE_MAX_KEY_LEN || recordCrc32(header, payload) != header.crc32) {
+                // Torn append, the block is good up to here
+                _tail_dirty = true;
+                break;
+            }
+            uint16_t value_len = header.len - recordLen(header.keyLen, 0);
+            if (!applyRecord(offset, header, reinterpret_cast<const char *>(payload),
+                             valueCrc32(header.type, &payload[header.keyLen], value_len))) {
+                printf("Config record at %" PRIu32 " doesn't fit the index\n", offset);
+                _tail_dirty = true;
+                break;
+            }
+            offset += header.len;
+        }
+        _tail = offset;
+
+        uint16_t kept = 0;
+        for (uint16_t i = 0; i < _num_keys; i++) {
+            ConfigStoreRecordHeader_t header;
+            memcpy(&header, &block_buffer[_index[i].offset], sizeof(header));
+            ConfigStoreRecord_t record;
+            record.key = reinterpret_cast<const char *>(&block_buffer[_index[i].offset + sizeof(header)]);
+            record.keyLen = header.keyLen;
+            record.type = header.type;
+            record.value = reinterpret_cast<const uint8_t *>(&record.key[header.keyLen]);
+            record.valueLen = header.len - recordLen(header.keyLen, 0);
+            if (!cb(arg, record)) {
+                // Not in RAM, so it mustn't look deleted to the next save. Its record stays on
+                // flash until a compaction.
+                printf("Unable to load config key %.*s\n", record.keyLen, record.key);
+                continue;
+            }
+            _index[kept++] = _index[i];
+        }
+        _num_keys = kept;
+        rval = true;
+    } while (0);
+    _block_cache = NULL;
+    vPortFree(block_buffer);
+    return rval;
+}
+
+/*!
+* Append the keys that changed since the last save, and delete records for the
+* keys that are gone. Compacts instead if the active block can't fit them.
+* \param cb[in] - enumerates every key that should be stored
+* \param arg[in] - passed to cb
+* \returns - true if success, false otherwise.
+*/
+bool ConfigStore::save(ConfigStoreKeyCb cb, void *arg) {
+    configASSERT(cb);
+    _stats.saves++;
+    if (_active_block < 0 || _tail_dirty) {
+        return compact(cb, arg);
+    }
+
+    for (uint16_t i = 0; i < _num_keys; i++) {
+        _index[i].seen = false;
+    }
+
+    uint32_t append_len = 0;
+    uint16_t new_keys = 0;
+    ConfigStoreRecord_t record;
+    for (uint16_t idx = 0; cb(arg, idx, record); idx++) {
+        configASSERT(record.keyLen <= CONFIG_STORE_MAX_KEY_LEN);
+        int32_t found = findKey(record.key, record.keyLen, keyHash(record.key, record.keyLen));
+        if (found >= 0) {
+            _index[found].seen = true;
+            if (_index[found].valueCrc32 == valueCrc32(record.type, record.value, record.valueLen)) {
+                continue;
+            }
+        } else {
+            new_keys++;
+        }
+        append_len += recordLen(record.keyLen, record.valueLen);
+    }
+
+    uint16_t deleted_keys = 0;
+    for (uint16_t i = 0; i < _num_keys; i++) {
+        if (!_index[i].seen) {
+            deleted_keys++;
+            append_len += recordLen(_index[i].keyLen, 0);
+        }
+    }
+
+    if (append_len == 0) {
+        _stats.unchangedSaves++;
+        return true;
+    }
+    if (!reserveIndex(_num_keys + new_keys)) {
+        return false;
+    }
+    if (append_len > freeBytes()) {
+        return compact(cb, arg);
+    }
+
+    bool rval = true;
+    uint8_t *buffer = static_cast<uint8_t *>(pvPortMalloc(append_len));
+    configASSERT(buffer);
+    uint32_t pos = 0;
+    // Deletes go first, then the keys that changed
+    for (uint16_t i = 0; i < _num_keys && rval; i++) {
+        if (_index[i].seen) {
+            continue;
+        }
+        char key[CONFIG_STORE_MAX_KEY_LEN];
+        uint32_t key_offset = blockOffset(_active_block) + _index[i].offset + sizeof(ConfigStoreRecordHeader_t);
+        rval = _flash_partition.read(key_offset, reinterpret_cast<uint8_t *>(key), _index[i].keyLen, CONFIG_STORE_TIMEOUT_MS);
+        if (rval) {
+            pos += serializeRecord(&buffer[pos], CONFIG_STORE_RECORD_DELETE, key, _index[i].keyLen, 0, NULL, 0);
+        }
+    }
+    for (uint16_t idx = 0; rval && cb(arg, idx, record); idx++) {
+        int32_t found = findKey(record.key, record.keyLen, keyHash(record.key, record.keyLen));
+        if (found >= 0 && _index[found].valueCrc32 == valueCrc32(record.type, record.value, record.valueLen)) {
+            continue;
+        }
+        // Keys can't change under a save
+        configASSERT(pos + recordLen(record.keyLen, record.valueLen) <= append_len);
+        pos += serializeRecord(&buffer[pos], CONFIG_STORE_RECORD_SET, record.key, record.keyLen, record.type,
+                               record.value, record.valueLen);
+    }
+
+    if (rval) {
+        rval = _flash_partition.program(blockOffset(_active_block) + _tail, buffer, pos, CONFIG_STORE_TIMEOUT_MS);
+    }
+    if (rval) {
+        for (uint32_t offset = 0; offset < pos;) {
+            ConfigStoreRecordHeader_t header;
+            memcpy(&header, &buffer[offset], sizeof(header));
+            const uint8_t *payload = &buffer[offset + sizeof(header)];
+            uint16_t value_len = header.len - recordLen(header.keyLen, 0);
+            if (!applyRecord(_tail + offset, header, reinterpret_cast<const char *>(payload),
+                             valueCrc32(header.type, &payload[header.keyLen], value_len))) {
+                // Can't happen, the index was checked for room above
+                _tail_dirty = true;
+            }
+            _stats.appendedRecords++;
+            offset += header.len;
+        }
+        _tail += pos;
+    } else {
+        // Part of the append may have made it to flash
+        _tail_dirty = true;
+    }
+    vPortFree(buffer);
+    return rval;
+}
+
+/*!
+* Write every key into the other block, which takes over once it reads back intact.
+* With no valid block yet, block 1 is used, so whatever block 0 holds (like a layout
+* from older firmware) is left alone until the new block is verified.
+* \param cb[in] - enumerates every key that should be stored
+* \param arg[in] - passed to cb
+* \returns - true if success, false otherwise.
+*/
+bool ConfigStore::compact(ConfigStoreKeyCb cb, void *arg) {
+    configASSERT(cb);
+    bool rval = false;
+    uint8_t target = (_active_block == 1) ? 0 : 1;
+    uint8_t *buffer = static_cast<uint8_t *>(pvPortMalloc(_block_size));
+    configASSERT(buffer);
+    memset(buffer, 0xFF, _block_size);
+    _num_keys = 0;
+    // Until this succeeds the index doesn't match the flash, the next save has to compact again
+    _tail_dirty = true;
+    do {
+        uint32_t pos = sizeof(ConfigStoreBlockHeader_t);
+        bool fits = true;
+        bool indexed = true;
+        ConfigStoreRecord_t record;
+        for (uint16_t idx = 0; cb(arg, idx, record); idx++) {
+            configASSERT(record.keyLen <= CONFIG_STORE_MAX_KEY_LEN);
+            uint32_t len = recordLen(record.keyLen, record.valueLen);
+            if (pos + len > _block_size) {
+                fits = false;
+                break;
+            }
+            if (!reserveIndex(_num_keys + 1)) {
+                indexed = false;
+                break;
+            }
+            serializeRecord(&buffer[pos], CONFIG_STORE_RECORD_SET, record.key, record.keyLen, record.type,
+                            record.value, record.valueLen);
+            ConfigStoreIndexEntry_t &entry = _index[_num_keys++];
+            entry.keyHash = keyHash(record.key, record.keyLen);
+            entry.valueCrc32 = valueCrc32(record.type, record.value, record.valueLen);
+            entry.offset = pos;
+            entry.keyLen = record.keyLen;
+            entry.seen = false;
+            pos += len;
+        }
+        if (!fits) {
+            printf("Config doesn't fit in a %" PRIu32 " byte block\n", _block_size);
+            break;
+        }
+        if (!indexed) {
+            printf("Out of memory for the config index\n");
+            break;
+        }
+
+        ConfigStoreBlockHeader_t header;
+        header.magic = CONFIG_STORE_MAGIC;
+        header.seq = _seq + 1;
+        header.compactedLen = pos - sizeof(header);
+        header.compactedCrc32 = crc32_ieee(&buffer[sizeof(header)], header.compactedLen);
+        header.crc32 = blockHeaderCrc32(header);
+        memcpy(buffer, &header, sizeof(header));
+
+        if (!_flash_partition.erase(blockOffset(target), _block_size, CONFIG_STORE_TIMEOUT_MS)) {
+            break;
+        }
+        if (!_flash_partition.program(blockOffset(target), buffer, pos, CONFIG_STORE_TIMEOUT_MS)) {
+            break;
+        }
+        if (!readBlock(target, buffer) || !readBlockHeader(target, header) ||
+            crc32_ieee(&buffer[sizeof(header)], header.compactedLen) != header.compactedCrc32) {
+            printf("Compacted config block %u doesn't read back\n", target);
+            break;
+        }
+        _active_block = target;
+        _seq = header.seq;
+        _tail = pos;
+        _tail_dirty = false;
+        _stats.compactions++;
+        rval = true;
+    } while (0);
+    vPortFree(buffer);
+    return rval;
+}
+
+/*!
+* Get the room left for appends in the active block
+* \returns - bytes
+*/
+uint32_t ConfigStore::freeBytes(void) {
+    if (_active_block < 0) {
+        return 0;
+    }
+    return _block_size - _tail;
+}
+
+/*!
+* Get how much of the partition the blocks take up, the store never touches the rest
+* \returns - bytes
+*/
+uint32_t ConfigStore::footprint(void) {
+    return blockOffset(NUM_BLOCKS);
+}
+
+/*!
+* Get the most a compacted block can hold, records included
+* \returns - bytes
+*/
+uint32_t ConfigStore::capacity(void) {
+    return _block_size - sizeof(ConfigStoreBlockHeader_t);
+}
+
+/*!
+* Get the space a key takes up in a block
+* \param key_len[in] - key length
+* \param value_len[in] - value length
+* \returns - bytes
+*/
+uint32_t ConfigStore::recordSize(uint8_t key_len, uint16_t value_len) {
+    return recordLen(key_len, value_len);
+}
+
+const ConfigStoreStats_t &ConfigStore::getStats(void) {
+    return _stats;
+}
+
+} // namespace cfg
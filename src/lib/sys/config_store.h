@@ -0,0 +1,120 @@
+#pragma once
+#include "nvmPartition.h"
+#include <stddef.h>
+#include <stdint.h>
+
+namespace cfg {
+
+static constexpr uint8_t CONFIG_STORE_MAX_KEY_LEN = 32;
+static constexpr uint32_t CONFIG_STORE_MAGIC = 0x474C4643; // "CFLG"
+static constexpr uint32_t CONFIG_STORE_TIMEOUT_MS = 5000;
+
+typedef enum ConfigStoreRecordFlags {
+    CONFIG_STORE_RECORD_SET = 0x01,
+    CONFIG_STORE_RECORD_DELETE = 0x02,
+} ConfigStoreRecordFlags_e;
+
+/*
+    Written at the start of a block when it is compacted. The records written
+    along with it are covered by compactedCrc32, so a torn compaction leaves
+    the previous block in charge. The first compaction goes to block 1, so
+    block 0 keeps whatever it held until then.
+*/
+typedef struct ConfigStoreBlockHeader {
+    uint32_t magic;
+    uint32_t seq;
+    uint16_t compactedLen;
+    uint32_t compactedCrc32;
+    uint32_t crc32;
+} __attribute__((packed, aligned(1))) ConfigStoreBlockHeader_t;
+
+/*
+    Followed by keyLen bytes of key, then the value, which takes up the rest of
+    the record. Delete records have no value.
+*/
+typedef struct ConfigStoreRecordHeader {
+    // Whole record, 0xFFFF where the log ends
+    uint16_t len;
+    uint8_t flags;
+    uint8_t keyLen;
+    uint8_t type;
+    // Over the fields above, the key and the value
+    uint32_t crc32;
+} __attribute__((packed, aligned(1))) ConfigStoreRecordHeader_t;
+
+// Where the latest record of a key is, kept in RAM so appends don't need to scan the log
+typedef struct ConfigStoreIndexEntry {
+    uint32_t keyHash;
+    // Over the type and value, so unchanged keys aren't written again
+    uint32_t valueCrc32;
+    uint16_t offset;
+    uint8_t keyLen;
+    uint8_t seen;
+} __attribute__((packed, aligned(1))) ConfigStoreIndexEntry_t;
+
+typedef struct ConfigStoreRecord {
+    const char *key;
+    uint8_t keyLen;
+    uint8_t type;
+    const uint8_t *value;
+    uint16_t valueLen;
+} ConfigStoreRecord_t;
+
+typedef struct ConfigStoreStats {
+    uint32_t saves;
+    uint32_t unchangedSaves;
+    uint32_t appendedRecords;
+    uint32_t compactions;
+} ConfigStoreStats_t;
+
+// Called for every live key when loading
+typedef bool (*ConfigStoreLoadCb)(void *arg, const ConfigStoreRecord_t &record);
+// Fills in the idx-th key to save, returns false once there are no more keys
+typedef bool (*ConfigStoreKeyCb)(void *arg, uint16_t idx, ConfigStoreRecord_t &record);
+
+/*
+    Log-structured key/value store. The partition is split into two blocks of
+    one erase sector each. Changed keys are appended to the active block, and
+    when it fills up the live keys are compacted into the other one.
+*/
+class ConfigStore {
+public:
+    ConfigStore(NvmPartition &flash_partition);
+    ~ConfigStore();
+    bool load(ConfigStoreLoadCb cb, void *arg);
+    bool save(ConfigStoreKeyCb cb, void *arg);
+    bool compact(ConfigStoreKeyCb cb, void *arg);
+    uint32_t freeBytes(void);
+    uint32_t capacity(void);
+    uint32_t footprint(void);
+    const ConfigStoreStats_t &getStats(void);
+    static uint32_t recordSize(uint8_t key_len, uint16_t value_len);
+
+private:
+    bool readBlockHeader(uint8_t block, ConfigStoreBlockHeader_t &header);
+    bool readBlock(uint8_t block, uint8_t *buffer);
+    bool reserveIndex(uint16_t num_keys);
+    int32_t findKey(const char *key, uint8_t key_len, uint32_t key_hash);
+    bool keyMatches(const ConfigStoreIndexEntry_t &entry, const char *key);
+    bool applyRecord(uint16_t offset, const ConfigStoreRecordHeader_t &header, const char *key, uint32_t value_crc32);
+    uint32_t blockOffset(uint8_t block);
+
+private:
+    NvmPartition &_flash_partition;
+    // On the heap, grows with the number of keys
+    ConfigStoreIndexEntry_t *_index;
+    uint16_t _index_len;
+    uint16_t _num_keys;
+    uint32_t _block_size;
+    // -1 until a valid block is loaded or compacted
+    int8_t _active_block;
+    uint32_t _seq;
+    uint16_t _tail;
+    // Something other than erased flash is past the last good record, appending has to wait for a compaction
+    bool _tail_dirty;
+    // Active block contents while loading, so key lookups don't go back to flash
+    const uint8_t *_block_cache;
+    ConfigStoreStats_t _stats;
+};
+
+} // namespace cfg
@@ -2,6 +2,7 @@
 #include "FreeRTOS.h"
 #include <stdio.h>
 #include "crc.h"
+#include "fnv.h"
 #include "reset_reason.h"
 #ifndef CBOR_CUSTOM_ALLOC_INCLUDE
 #error "CBOR_CUSTOM_ALLOC_INCLUDE must be defined!"
@@ -11,39 +12,215 @@
 #endif // CBOR_PARSER_MAX_RECURSIONS
 namespace cfg {
 
-Configuration::Configuration(NvmPartition& flash_partition, uint8_t *ram_partition, size_t ram_partition_size):_flash_partition(flash_partition), _ram_partition_size(ram_partition_size), _needs_commit(false) {
+// Layout written by firmware from before variable length values, only read to migrate it
+static constexpr uint8_t LEGACY_MAX_NUM_KV = 50;
+static constexpr uint8_t LEGACY_VALUE_SIZE_BYTES = 50;
+// Largest a CBOR head can be, and so the largest encoded scalar
+static constexpr size_t CBOR_HEAD_MAX_LEN = 9;
+
+typedef struct LegacyConfigPartitionHeader {
+    uint32_t crc32;
+    uint32_t version;
+    uint8_t numKeys;
+} __attribute__((packed, aligned(1))) LegacyConfigPartitionHeader_t;
+
+typedef struct LegacyConfigKey {
+    char keyBuffer[MAX_KEY_LEN_BYTES];
+    size_t keyLen;
+    ConfigDataTypes_e valueType;
+} __attribute__((packed, aligned(1))) LegacyConfigKey_t;
+
+typedef struct LegacyConfigPartition {
+    LegacyConfigPartitionHeader_t header;
+    LegacyConfigKey_t keys[LEGACY_MAX_NUM_KV];
+    uint8_t values[LEGACY_MAX_NUM_KV][LEGACY_VALUE_SIZE_BYTES];
+} __attribute__((packed, aligned(1))) LegacyConfigPartition_t;
+
+static uint32_t legacyCrc32(const LegacyConfigPartition_t *legacy) {
+    return crc32_ieee(reinterpret_cast<const uint8_t *>(&legacy->header.version), (sizeof(LegacyConfigPartition_t)-sizeof(legacy->header.crc32)));
+}
+
+/*!
+* Get the length of the first CBOR item in a buffer
+* \param buffer[in] - CBOR buffer
+* \param buffer_len[in] - buffer length
+* \param len[out] - encoded length of the first item
+* \returns - true if success, false if the buffer doesn't start with a valid item.
+*/
+static bool encodedLength(const uint8_t *buffer, size_t buffer_len, size_t &len) {
+    CborParser parser;
+    CborValue it;
+    if(cbor_parser_init(buffer, buffer_len, 0, &parser, &it) != CborNoError || !cbor_value_is_valid(&it)) {
+        return false;
+    }
+    if(cbor_value_advance(&it) != CborNoError) {
+        return false;
+    }
+    len = cbor_value_get_next_byte(&it) - buffer;
+    return true;
+}
+
+Configuration::Configuration(NvmPartition& flash_partition, uint8_t *ram_partition, size_t ram_partition_size):_flash_partition(flash_partition), _ram_partition_size(ram_partition_size), _needs_commit(false), _legacy_pending(false), _store(flash_partition) {
     configASSERT(ram_partition);
     configASSERT(_ram_partition_size >= sizeof(ConfigPartition_t));
+    // Value offsets are 16 bit
+    configASSERT(_ram_partition_size <= UINT16_MAX);
     _ram_partition = reinterpret_cast<ConfigPartition_t*>(ram_partition);
-    if(!loadAndVerifyNvmConfig()) {
+    _ram_partition->numKeys = 0;
+    _ram_partition->valuesOffset = _ram_partition_size;
+    _ram_partition->version = CONFIG_VERSION;
+    memset(_ram_partition->keySlots, 0, sizeof(_ram_partition->keySlots));
+    if(_store.load(loadRecord, this)) {
+        printf("Succesfully loaded configs from flash.");
+    } else if(loadAndVerifyNvmConfig()) {
+        // Written by firmware from before the config store, the next save converts it.
+        _legacy_pending = true;
+        printf("Succesfully loaded configs from flash.");
+    } else {
         printf("Unable to load configs from flash.");
-        _ram_partition->header.numKeys = 0;
-        _ram_partition->header.version = CONFIG_VERSION;
         // TODO: Once we have default configs, load these into flash.
-    } else {
-        printf("Succesfully loaded configs from flash.");
     }
 }
 
+/*!
+* Adds a key loaded by the config store to the RAM partition.
+* \param arg[in] - Configuration
+* \param record[in] - key and value
+* \returns - true if the key was added, false otherwise.
+*/
+bool Configuration::loadRecord(void *arg, const ConfigStoreRecord_t &record) {
+    Configuration *self = static_cast<Configuration *>(arg);
+    if(record.type > ARRAY) {
+        return false;
+    }
+    return self->addKey(record.key, record.keyLen, static_cast<ConfigDataTypes_e>(record.type), record.value, record.valueLen);
+}
+
+/*!
+* Hands the idx-th key to the config store.
+* \param arg[in] - Configuration
+* \param idx[in] - key index
+* \param record[out] - key and value
+* \returns - true if there is such a key, false otherwise.
+*/
+bool Configuration::storedKey(void *arg, uint16_t idx, ConfigStoreRecord_t &record) {
+    Configuration *self = static_cast<Configuration *>(arg);
+    ConfigPartition_t *partition = self->_ram_partition;
+    if(idx >= partition->numKeys) {
+        return false;
+    }
+    const ConfigKey_t &key = partition->keys[idx];
+    record.key = key.keyBuffer;
+    record.keyLen = key.keyLen;
+    record.type = key.valueType;
+    record.value = self->valuePtr(idx);
+    record.valueLen = key.valueLen;
+    return true;
+}
+
+/*!
+* Read and verify the legacy layout. If it doesn't check out, the part past the first block
+* is taken from the backup made before migrating, in case the migration was torn.
+* \param buffer[out] - sizeof(LegacyConfigPartition_t) bytes for the layout
+* \returns - true if success, false otherwise.
+*/
+bool Configuration::readLegacyLayout(uint8_t *buffer) {
+    LegacyConfigPartition_t *legacy = reinterpret_cast<LegacyConfigPartition_t *>(buffer);
+    if (!_flash_partition.read(CONFIG_START_OFFSET_IN_BYTES, buffer, sizeof(LegacyConfigPartition_t), CONFIG_LOAD_TIMEOUT_MS)) {
+        return false;
+    }
+    if (legacy->header.crc32 != legacyCrc32(legacy)) {
+        uint32_t tail_offset = _flash_partition.alignment();
+        uint32_t backup_offset = _store.footprint();
+        if (sizeof(LegacyConfigPartition_t) <= tail_offset ||
+            backup_offset + sizeof(LegacyConfigPartition_t) - tail_offset >= _flash_partition.size()) {
+            return false;
+        }
+        if (!_flash_partition.read(backup_offset, &buffer[tail_offset], sizeof(LegacyConfigPartition_t) - tail_offset, CONFIG_LOAD_TIMEOUT_MS) ||
+            legacy->header.crc32 != legacyCrc32(legacy)) {
+            return false;
+        }
+        printf("Legacy config restored from its backup\n");
+    }
+    return legacy->header.numKeys <= LEGACY_MAX_NUM_KV;
+}
+
+/*!
+* Load the fixed size layout older firmware wrote, each value is trimmed to its encoded length.
+* \returns - true if success, false otherwise.
+*/
 bool Configuration::loadAndVerifyNvmConfig(void) {
     bool rval = false;
+    LegacyConfigPartition_t *legacy = static_cast<LegacyConfigPartition_t *>(pvPortMalloc(sizeof(LegacyConfigPartition_t)));
+    if(!legacy) {
+        return false;
+    }
     do {
-        if (!_flash_partition.read(CONFIG_START_OFFSET_IN_BYTES, reinterpret_cast<uint8_t *>(_ram_partition), sizeof(ConfigPartition_t), CONFIG_LOAD_TIMEOUT_MS)){
+        if (!readLegacyLayout(reinterpret_cast<uint8_t *>(legacy))) {
             break;
         }
-        uint32_t partition_crc32 = crc32_ieee(reinterpret_cast<const uint8_t *>(&_ram_partition->header.version), (sizeof(ConfigPartition_t)-sizeof(_ram_partition->header.crc32)));
-        if (_ram_partition->header.crc32 != partition_crc32) {
-            break;
+        _ram_partition->version = legacy->header.version;
+        for(uint8_t i = 0; i < legacy->header.numKeys; i++) {
+            const LegacyConfigKey_t &key = legacy->keys[i];
+            size_t value_len;
+            if(!encodedLength(legacy->values[i], LEGACY_VALUE_SIZE_BYTES, value_len) ||
+               !addKey(key.keyBuffer, key.keyLen, key.valueType, legacy->values[i], value_len)) {
+                printf("Unable to migrate config key %.*s\n", static_cast<int>(MAX_KEY_LEN_BYTES), key.keyBuffer);
+            }
         }
         rval = true;
     } while(0);
+    vPortFree(legacy);
+    return rval;
+}
+
+/*!
+* The config store's first block overlaps the end of the legacy layout. Copy that part to
+* where the store doesn't write, so the layout can still be read if the migration is torn.
+* \returns - true if the backup is on flash (or isn't needed), false otherwise.
+*/
+bool Configuration::backUpLegacyLayout(void) {
+    uint32_t tail_offset = _flash_partition.alignment();
+    if (sizeof(LegacyConfigPartition_t) <= tail_offset) {
+        return true;
+    }
+    uint32_t backup_offset = _store.footprint();
+    uint32_t tail_len = sizeof(LegacyConfigPartition_t) - tail_offset;
+    if (backup_offset + 2 * tail_len >= _flash_partition.size()) {
+        printf("No room to back up the legacy config\n");
+        return false;
+    }
+    bool rval = false;
+    LegacyConfigPartition_t *legacy = static_cast<LegacyConfigPartition_t *>(pvPortMalloc(sizeof(LegacyConfigPartition_t)));
+    uint8_t *backup = static_cast<uint8_t *>(pvPortMalloc(tail_len));
+    do {
+        if (!legacy || !backup) {
+            break;
+        }
+        if (!readLegacyLayout(reinterpret_cast<uint8_t *>(legacy))) {
+            break;
+        }
+        uint8_t *tail = &reinterpret_cast<uint8_t *>(legacy)[tail_offset];
+        if (!_flash_partition.read(backup_offset, backup, tail_len, CONFIG_LOAD_TIMEOUT_MS)) {
+            break;
+        }
+        if (memcmp(backup, tail, tail_len) == 0) {
+            // Left over from a migration that didn't finish
+            rval = true;
+            break;
+        }
+        rval = _flash_partition.erase(backup_offset, tail_len, CONFIG_LOAD_TIMEOUT_MS) &&
+               _flash_partition.program(backup_offset, tail, tail_len, CONFIG_LOAD_TIMEOUT_MS);
+    } while(0);
+    vPortFree(backup);
+    vPortFree(legacy);
     return rval;
 }
 
 /*!
  * @brief Get the the entire cbor encoded Configuration CRC.
- * @note This differs from the ConfigPartition_t header.crc32, 
- * which is strictly used for partition validation.
+ * @note This differs from the config store's crc32s,
+ * which are strictly used for flash validation.
  * @return The CRC32 of the entire cbor encoded Configuration.
  */
 uint32_t Configuration::getCborEncodedConfigurationCrc32(void) {
@@ -68,7 +245,7 @@ bool Configuration::prepareCborParser(const char * key, size_t key_len, CborValu
         if(!findKeyIndex(key, key_len, keyIdx)){
             break;
         }
-        if(cbor_parser_init(_ram_partition->values[keyIdx].valueBuffer, sizeof(_ram_partition->values[keyIdx].valueBuffer), 0, &parser, &it) != CborNoError){
+        if(cbor_parser_init(valuePtr(keyIdx), _ram_partition->keys[keyIdx].valueLen, 0, &parser, &it) != CborNoError){
             break;
         }
         retval = true;
@@ -89,7 +266,17 @@ bool Configuration::getConfig(const char * key, size_t key_len, uint32_t &value)
 
     CborValue it;
     CborParser parser;
+    uint8_t keyIdx;
     do {
+        if(!findKeyIndex(key, key_len, keyIdx)){
+            break;
+        }
+        ConfigValueCache_t &cache = _ram_partition->keys[keyIdx].cache;
+        if(cache.type == CACHE_UINT32){
+            value = cache.value.u32;
+            rval = true;
+            break;
+        }
         if(!prepareCborParser(key, key_len, it, parser)){
             break;
         }
@@ -101,6 +288,8 @@ bool Configuration::getConfig(const char * key, size_t key_len, uint32_t &value)
             break;
         }
         value = static_cast<uint32_t>(temp);
+        cache.type = CACHE_UINT32;
+        cache.value.u32 = value;
         rval = true;
     } while(0);
     return rval;
@@ -118,7 +307,17 @@ bool Configuration::getConfig(const char * key, size_t key_len, int32_t &value)
 
     CborValue it;
     CborParser parser;
+    uint8_t keyIdx;
     do {
+        if(!findKeyIndex(key, key_len, keyIdx)){
+            break;
+        }
+        ConfigValueCache_t &cache = _ram_partition->keys[keyIdx].cache;
+        if(cache.type == CACHE_INT32){
+            value = cache.value.i32;
+            rval = true;
+            break;
+        }
         if(!prepareCborParser(key, key_len, it, parser)){
             break;
         }
@@ -130,6 +329,8 @@ bool Configuration::getConfig(const char * key, size_t key_len, int32_t &value)
             break;
         }
         value = static_cast<int32_t>(temp);
+        cache.type = CACHE_INT32;
+        cache.value.i32 = value;
         rval = true;
     } while(0);
     return rval;
@@ -147,7 +348,17 @@ bool Configuration::getConfig(const char * key, size_t key_len, float &value){
 
     CborValue it;
     CborParser parser;
+    uint8_t keyIdx;
     do {
+        if(!findKeyIndex(key, key_len, keyIdx)){
+            break;
+        }
+        ConfigValueCache_t &cache = _ram_partition->keys[keyIdx].cache;
+        if(cache.type == CACHE_FLOAT){
+            value = cache.value.f;
+            rval = true;
+            break;
+        }
         if(!prepareCborParser(key, key_len, it, parser)){
             break;
         }
@@ -159,6 +370,8 @@ bool Configuration::getConfig(const char * key, size_t key_len, float &value){
             break;
         }
         value = temp;
+        cache.type = CACHE_FLOAT;
+        cache.value.f = value;
         rval = true;
     } while(0);
     return rval;
@@ -247,11 +460,11 @@ bool Configuration::getConfigCbor(const char * key, size_t key_len, uint8_t *val
         if(!findKeyIndex(key, key_len, keyIdx)){
             break;
         }
-        size_t buffer_size = sizeof(_ram_partition->values[keyIdx].valueBuffer);
+        size_t buffer_size = _ram_partition->keys[keyIdx].valueLen;
         if(value_len < buffer_size || value_len == 0){
             break;
         }
-        memcpy(value, _ram_partition->values[keyIdx].valueBuffer, buffer_size);
+        memcpy(value, valuePtr(keyIdx), buffer_size);
         value_len = buffer_size;
         rval = true;
     } while(0);
@@ -265,145 +478,119 @@ bool Configuration::getConfigCbor(const char * key, size_t key_len, uint8_t *val
  */
 uint8_t *Configuration::asCborMap(size_t &buffer_size) {
   buffer_size = 0;
-  size_t allocated_size = 512;
+  // Values are stored CBOR encoded, so the map is the keys with their values copied in after them.
+  // Room for every CBOR head at its largest, so nothing has to be retried.
+  size_t allocated_size = CBOR_HEAD_MAX_LEN;
+  for (size_t i = 0; i < _ram_partition->numKeys; i++) {
+    allocated_size += CBOR_HEAD_MAX_LEN + _ram_partition->keys[i].keyLen + _ram_partition->keys[i].valueLen;
+  }
   uint8_t *buffer = static_cast<uint8_t *>(pvPortMalloc(allocated_size));
   if (!buffer) {
     return NULL;
   }
 
-  uint32_t tmpU;
-  int32_t tmpI;
-  float tmpF;
-
-  char tmpS[MAX_STR_LEN_BYTES];
-  size_t tmpSSize = MAX_STR_LEN_BYTES;
-
-  uint8_t tmpB[MAX_STR_LEN_BYTES];
-  size_t tmpBSize = MAX_STR_LEN_BYTES;
-
   CborEncoder encoder;
   CborEncoder map;
   CborError err;
-  bool shouldRetry;
-
+  size_t pos = 0;
   do {
-    shouldRetry = false;
     cbor_encoder_init(&encoder, buffer, allocated_size, 0);
-    err = cbor_encoder_create_map(&encoder, &map, _ram_partition->header.numKeys);
-    if (err != CborNoError && err != CborErrorOutOfMemory) {
+    err = cbor_encoder_create_map(&encoder, &map, _ram_partition->numKeys);
+    if (err != CborNoError) {
       break;
     }
+    pos = cbor_encoder_get_buffer_size(&map, buffer);
 
-    for (size_t i = 0; i < _ram_partition->header.numKeys; i++) {
-      ConfigKey_t key = _ram_partition->keys[i];
-      err = cbor_encode_text_string(&map, key.keyBuffer, key.keyLen);
-      if (err != CborNoError && err != CborErrorOutOfMemory) {
+    for (size_t i = 0; i < _ram_partition->numKeys; i++) {
+      const ConfigKey_t &key = _ram_partition->keys[i];
+      cbor_encoder_init(&encoder, &buffer[pos], allocated_size - pos, 0);
+      err = cbor_encode_text_string(&encoder, key.keyBuffer, key.keyLen);
+      if (err != CborNoError) {
         break;
       }
-
-      bool internalSuccess = true;
-      switch (key.valueType) {
-      case UINT32:
-        internalSuccess = getConfig(key.keyBuffer, key.keyLen, tmpU);
-        if (internalSuccess) {
-          err = cbor_encode_uint(&map, tmpU);
-        }
-        break;
-      case INT32:
-        internalSuccess = getConfig(key.keyBuffer, key.keyLen, tmpI);
-        if (internalSuccess) {
-          err = cbor_encode_int(&map, tmpI);
-        }
-        break;
-      case FLOAT:
-        internalSuccess = getConfig(key.keyBuffer, key.keyLen, tmpF);
-        if (internalSuccess) {
-          err = cbor_encode_float(&map, tmpF);
-        }
-        break;
-      case STR:
-        tmpSSize = MAX_STR_LEN_BYTES;
-        memset(tmpS, 0, MAX_STR_LEN_BYTES);
-        internalSuccess = getConfig(key.keyBuffer, key.keyLen, tmpS, tmpSSize);
-        if (internalSuccess) {
-          err = cbor_encode_text_string(&map, tmpS, tmpSSize);
-        }
-        break;
-      case BYTES:
-        tmpBSize = MAX_STR_LEN_BYTES;
-        memset(tmpB, 0, MAX_STR_LEN_BYTES);
-        internalSuccess = getConfig(key.keyBuffer, key.keyLen, tmpB, tmpBSize);
-        if (internalSuccess) {
-          err = cbor_encode_byte_string(&map, tmpB, tmpBSize);
-        }
-        break;
-      case ARRAY:
-        tmpBSize = MAX_STR_LEN_BYTES;
-        memset(tmpB, 0, MAX_STR_LEN_BYTES);
-        internalSuccess = getConfigCbor(key.keyBuffer, key.keyLen, tmpB, tmpBSize);
-        if (internalSuccess) {
-            memcpy(map.data.ptr, tmpB, tmpBSize);
-            map.data.ptr += tmpBSize;
-        }
-        break;
-      }
-
-      if (!internalSuccess || (err != CborNoError && err != CborErrorOutOfMemory)) {
-        break; // out of for loop
-      }
+      pos += cbor_encoder_get_buffer_size(&encoder, &buffer[pos]);
+      memcpy(&buffer[pos], valuePtr(i), key.valueLen);
+      pos += key.valueLen;
     }
+  } while (0);
 
-    if (err == CborNoError || err == CborErrorOutOfMemory) {
-      err = cbor_encoder_close_container(&encoder, &map);
-    }
-
-    if (err == CborErrorOutOfMemory) {
-      size_t needed = cbor_encoder_get_extra_bytes_needed(&encoder);
-      printf("Encoding failed, buffer too small. Will retry. "
-             "Need %zu more bytes than the %zu originally given, or %zu total.\n",
-             needed, allocated_size, allocated_size + needed);
-      vPortFree(buffer);
-      allocated_size += needed;
-      buffer = static_cast<uint8_t *>(pvPortMalloc(allocated_size));
-      if (!buffer) {
-        break;
-      }
-      shouldRetry = true;
-    } else if (err == CborNoError) {
-      buffer_size = cbor_encoder_get_buffer_size(&encoder, buffer);
-    } else {
-      printf("Failed to encode config as cbor map, err=%" PRIu32 "\n", err);
-      vPortFree(buffer);
-      buffer = NULL;
-    }
-  } while (shouldRetry);
+  if (err == CborNoError) {
+    buffer_size = pos;
+  } else {
+    printf("Failed to encode config as cbor map, err=%" PRIu32 "\n", err);
+    vPortFree(buffer);
+    buffer = NULL;
+  }
 
   return buffer;
 }
 
-bool Configuration::prepareCborEncoder(const char * key, size_t key_len, CborEncoder &encoder, uint8_t &keyIdx, bool &keyExists) {
+/*!
+* Find or make room for a value, and point an encoder at scratch space for it.
+* The current value is left alone until storeValue(), so a failed set doesn't lose it.
+* \param key[in] - key
+* \param key_len[in] - key length
+* \param max_len[in] - largest the encoded value can be
+* \param encoder[out] - encoder for the scratch space
+* \param keyIdx[out] - index of the key, if it exists
+* \param keyExists[out] - whether the key exists
+* \param scratch[out] - where the value is encoded
+* \returns - true if the value fits, false otherwise.
+*/
+bool Configuration::prepareCborEncoder(const char * key, size_t key_len, size_t max_len, CborEncoder &encoder, uint8_t &keyIdx, bool &keyExists, uint8_t *&scratch) {
     configASSERT(key);
     bool rval = false;
     do {
-        if(key_len > MAX_KEY_LEN_BYTES) {
-            break;
-        }
-        if(_ram_partition->header.numKeys >= MAX_NUM_KV) {
+        if(key_len > MAX_KEY_LEN_BYTES || max_len > UINT16_MAX) {
             break;
         }
         keyExists = findKeyIndex(key, key_len, keyIdx);
-        if(!keyExists) {
-            keyIdx = _ram_partition->header.numKeys;
+        if(!keyExists && _ram_partition->numKeys >= MAX_NUM_KV) {
+            break;
         }
-        if(snprintf(_ram_partition->keys[keyIdx].keyBuffer,sizeof(_ram_partition->keys[keyIdx].keyBuffer),"%s",key) < 0){
+        if(freeBytes() < max_len + (keyExists ? 0 : sizeof(ConfigKey_t))) {
             break;
         }
-        cbor_encoder_init(&encoder, _ram_partition->values[keyIdx].valueBuffer, sizeof(_ram_partition->values[keyIdx].valueBuffer), 0);
+        scratch = reinterpret_cast<uint8_t *>(_ram_partition) + _ram_partition->valuesOffset - max_len;
+        cbor_encoder_init(&encoder, scratch, max_len, 0);
         rval = true;
     } while(0);
     return rval;
 }
 
+/*!
+* Replace a key's value, or add the key, with a value from prepareCborEncoder()'s scratch space.
+* \param key[in] - key
+* \param key_len[in] - key length
+* \param keyIdx[in] - index of the key, if it exists
+* \param keyExists[in] - whether the key exists
+* \param type[in] - value type
+* \param value[in] - CBOR encoded value
+* \param value_len[in] - value length
+* \returns - true if success, false if it wouldn't fit in the config store.
+*/
+bool Configuration::storeValue(const char * key, size_t key_len, uint8_t keyIdx, bool keyExists, ConfigDataTypes_e type, const uint8_t *value, size_t value_len) {
+    bool rval = false;
+    do {
+        // Has to fit in a compacted config store block along with everything else
+        size_t stored = storedBytes() + ConfigStore::recordSize(key_len, value_len);
+        if(keyExists) {
+            stored -= ConfigStore::recordSize(key_len, _ram_partition->keys[keyIdx].valueLen);
+        }
+        if(stored > _store.capacity()) {
+            break;
+        }
+        if(keyExists) {
+            releaseValue(keyIdx);
+            placeValue(keyIdx, type, value, value_len);
+        } else if(!addKey(key, key_len, type, value, value_len)) {
+            break;
+        }
+        _needs_commit = true;
+        rval = true;
+    } while(0);
+    return rval;
+}
 
 /*!
 * sets uint32 config
@@ -417,19 +604,17 @@ bool Configuration::setConfig(const char * key, size_t key_len, uint32_t value)
     CborEncoder encoder;
     uint8_t keyIdx;
     bool keyExists;
+    uint8_t *scratch;
     do{
-        if(!prepareCborEncoder(key, key_len, encoder, keyIdx, keyExists)){
+        if(!prepareCborEncoder(key, key_len, CBOR_HEAD_MAX_LEN, encoder, keyIdx, keyExists, scratch)){
             break;
         }
         if(cbor_encode_uint(&encoder, value)!= CborNoError) {
             break;
         }
-        _ram_partition->keys[keyIdx].valueType = UINT32;
-        _ram_partition->keys[keyIdx].keyLen = key_len;
-        if(!keyExists){
-            _ram_partition->header.numKeys++;
+        if(!storeValue(key, key_len, keyIdx, keyExists, UINT32, scratch, cbor_encoder_get_buffer_size(&encoder, scratch))){
+            break;
         }
-        _needs_commit = true;
         rval = true;
     } while(0);
     return rval;
@@ -447,19 +632,17 @@ bool Configuration::setConfig(const char * key, size_t key_len, int32_t value) {
     CborEncoder encoder;
     uint8_t keyIdx;
     bool keyExists;
+    uint8_t *scratch;
     do{
-        if(!prepareCborEncoder(key, key_len, encoder, keyIdx, keyExists)){
+        if(!prepareCborEncoder(key, key_len, CBOR_HEAD_MAX_LEN, encoder, keyIdx, keyExists, scratch)){
             break;
         }
         if(cbor_encode_int(&encoder, value)!= CborNoError) {
             break;
         }
-        _ram_partition->keys[keyIdx].valueType = INT32;
-        _ram_partition->keys[keyIdx].keyLen = key_len;
-        if(!keyExists){
-            _ram_partition->header.numKeys++;
+        if(!storeValue(key, key_len, keyIdx, keyExists, INT32, scratch, cbor_encoder_get_buffer_size(&encoder, scratch))){
+            break;
         }
-        _needs_commit = true;
         rval = true;
     } while(0);
     return rval;
@@ -477,19 +660,17 @@ bool Configuration::setConfig(const char * key, size_t key_len, float value) {
     CborEncoder encoder;
     uint8_t keyIdx;
     bool keyExists;
+    uint8_t *scratch;
     do {
-        if(!prepareCborEncoder(key, key_len, encoder, keyIdx, keyExists)){
+        if(!prepareCborEncoder(key, key_len, CBOR_HEAD_MAX_LEN, encoder, keyIdx, keyExists, scratch)){
             break;
         }
         if(cbor_encode_float(&encoder, value)!= CborNoError) {
             break;
         }
-        _ram_partition->keys[keyIdx].valueType = FLOAT;
-        _ram_partition->keys[keyIdx].keyLen = key_len;
-        if(!keyExists){
-            _ram_partition->header.numKeys++;
+        if(!storeValue(key, key_len, keyIdx, keyExists, FLOAT, scratch, cbor_encoder_get_buffer_size(&encoder, scratch))){
+            break;
         }
-        _needs_commit = true;
         rval = true;
     } while(0);
     return rval;
@@ -507,19 +688,17 @@ bool Configuration::setConfig(const char * key, size_t key_len, const char *valu
     CborEncoder encoder;
     uint8_t keyIdx;
     bool keyExists;
+    uint8_t *scratch;
     do {
-        if(!prepareCborEncoder(key, key_len, encoder, keyIdx, keyExists)){
+        if(!prepareCborEncoder(key, key_len, value_len + CBOR_HEAD_MAX_LEN, encoder, keyIdx, keyExists, scratch)){
             break;
         }
         if(cbor_encode_text_string(&encoder, value, value_len)!= CborNoError) {
             break;
         }
-        _ram_partition->keys[keyIdx].valueType = STR;
-        _ram_partition->keys[keyIdx].keyLen = key_len;
-        if(!keyExists){
-            _ram_partition->header.numKeys++;
+        if(!storeValue(key, key_len, keyIdx, keyExists, STR, scratch, cbor_encoder_get_buffer_size(&encoder, scratch))){
+            break;
         }
-        _needs_commit = true;
         rval = true;
     } while(0);
     return rval;
@@ -538,19 +717,17 @@ bool Configuration::setConfig(const char * key, size_t key_len, const uint8_t *v
     CborEncoder encoder;
     uint8_t keyIdx;
     bool keyExists;
+    uint8_t *scratch;
     do {
-        if(!prepareCborEncoder(key, key_len, encoder, keyIdx, keyExists)){
+        if(!prepareCborEncoder(key, key_len, value_len + CBOR_HEAD_MAX_LEN, encoder, keyIdx, keyExists, scratch)){
             break;
         }
         if(cbor_encode_byte_string(&encoder, value, value_len)!= CborNoError) {
             break;
         }
-        _ram_partition->keys[keyIdx].valueType = BYTES;
-        _ram_partition->keys[keyIdx].keyLen = key_len;
-        if(!keyExists){
-            _ram_partition->header.numKeys++;
+        if(!storeValue(key, key_len, keyIdx, keyExists, BYTES, scratch, cbor_encoder_get_buffer_size(&encoder, scratch))){
+            break;
         }
-        _needs_commit = true;
         rval = true;
     } while(0);
     return rval;
@@ -569,13 +746,13 @@ bool Configuration::setConfigCbor(const char * key, size_t key_len, uint8_t *val
     configASSERT(value);
     CborValue it;
     CborParser parser;
+    CborEncoder encoder;
     uint8_t keyIdx;
+    bool keyExists;
+    uint8_t *scratch;
     bool rval = false;
     do {
-        if(key_len > MAX_KEY_LEN_BYTES) {
-            break;
-        }
-        if(value_len > MAX_CONFIG_BUFFER_SIZE_BYTES || value_len == 0) {
+        if(value_len == 0) {
             break;
         }
         if(cbor_parser_init(value, value_len, 0, &parser, &it) != CborNoError){
@@ -584,26 +761,22 @@ bool Configuration::setConfigCbor(const char * key, size_t key_len, uint8_t *val
         if(!cbor_value_is_valid(&it)){
             break;
         }
-        if(!findKeyIndex(key, key_len, keyIdx)){
-            if(_ram_partition->header.numKeys >= MAX_NUM_KV) {
-                break;
-            }
-            keyIdx = _ram_partition->header.numKeys;
-            if(snprintf(_ram_partition->keys[keyIdx].keyBuffer,sizeof(_ram_partition->keys[keyIdx].keyBuffer),"%s",key) < 0){
-                break;
-            }
-        }
         ConfigDataTypes_e type;
         if(!cborTypeToConfigType(&it,type)) {
             break;
         }
-        _ram_partition->keys[keyIdx].valueType = type;
-        _ram_partition->keys[keyIdx].keyLen = key_len;
-        memcpy(_ram_partition->values[keyIdx].valueBuffer, value, value_len);
-        if(keyIdx == _ram_partition->header.numKeys){
-            _ram_partition->header.numKeys++;
+        // Only the value itself is kept, not whatever the buffer had after it
+        size_t encoded_len;
+        if(!encodedLength(value, value_len, encoded_len)) {
+            break;
+        }
+        if(!prepareCborEncoder(key, key_len, encoded_len, encoder, keyIdx, keyExists, scratch)){
+            break;
+        }
+        memcpy(scratch, value, encoded_len);
+        if(!storeValue(key, key_len, keyIdx, keyExists, type, scratch, encoded_len)){
+            break;
         }
-        _needs_commit = true;
         rval = true;
     } while(0);
     return rval;
@@ -651,7 +824,7 @@ bool Configuration::cborTypeToConfigType(const CborValue *value, ConfigDataTypes
 * \returns - map of keys
 */
 const ConfigKey_t* Configuration::getStoredKeys(uint8_t &num_stored_keys){
-    num_stored_keys = _ram_partition->header.numKeys;
+    num_stored_keys = _ram_partition->numKeys;
     return _ram_partition->keys;
 }
 
@@ -668,21 +841,40 @@ bool Configuration::removeKey(const char * key, size_t key_len) {
         if(!findKeyIndex(key, key_len,keyIdx)){
             break;
         }
-        if(_ram_partition->header.numKeys - 1 > keyIdx) { // if there are keys after, we need to move them up.
-            memmove(&_ram_partition->keys[keyIdx],&_ram_partition->keys[keyIdx+1], (_ram_partition->header.numKeys - 1 - keyIdx) * sizeof(ConfigKey_t)); // shift keys
-            memmove(&_ram_partition->values[keyIdx],&_ram_partition->values[keyIdx+1], (_ram_partition->header.numKeys - 1 - keyIdx) * sizeof(ConfigValue_t)); // shift values
+        releaseValue(keyIdx);
+        if(_ram_partition->numKeys - 1 > keyIdx) { // if there are keys after, we need to move them up.
+            memmove(&_ram_partition->keys[keyIdx],&_ram_partition->keys[keyIdx+1], (_ram_partition->numKeys - 1 - keyIdx) * sizeof(ConfigKey_t)); // shift keys
         }
-        _ram_partition->header.numKeys--;
+        _ram_partition->numKeys--;
+        rebuildKeyIndex();
         _needs_commit = true;
         rval = true;
     } while(0);
     return rval;
 }
 
+uint32_t Configuration::keyHash(const char * key, size_t len) {
+    return fnv_32a_buf(const_cast<char *>(key), len, FNV1_32A_INIT);
+}
+
+/*!
+* Find a key with a probe of the hashed key index.
+* \param key[in] - key, doesn't need to be null terminated
+* \param len[in] - key length
+* \param idx[out] - index of the key in the RAM partition
+* \returns - true if the key exists, false otherwise.
+*/
 bool Configuration::findKeyIndex(const char * key, size_t len, uint8_t &idx) {
     bool rval = false;
-    for(int i = 0; i < _ram_partition->header.numKeys; i++){
-        if(strncmp(key, _ram_partition->keys[i].keyBuffer,len) == 0){
+    if(len > MAX_KEY_LEN_BYTES) {
+        return false;
+    }
+    uint32_t hash = keyHash(key, len);
+    // There are always empty slots, so the probe ends
+    for(uint16_t slot = hash & (CONFIG_KEY_SLOTS - 1); _ram_partition->keySlots[slot]; slot = (slot + 1) & (CONFIG_KEY_SLOTS - 1)){
+        uint8_t i = _ram_partition->keySlots[slot] - 1;
+        if(_ram_partition->keys[i].keyHash == hash && _ram_partition->keys[i].keyLen == len &&
+           memcmp(key, _ram_partition->keys[i].keyBuffer, len) == 0){
             idx = i;
             rval = true;
             break;
@@ -691,6 +883,122 @@ bool Configuration::findKeyIndex(const char * key, size_t len, uint8_t &idx) {
     return rval;
 }
 
+/*!
+* Add a key and its value to the RAM partition.
+* \param key[in] - key
+* \param key_len[in] - key length
+* \param type[in] - value type
+* \param value[in] - CBOR encoded value
+* \param value_len[in] - value length
+* \returns - true if there was room, false otherwise.
+*/
+bool Configuration::addKey(const char * key, size_t key_len, ConfigDataTypes_e type, const uint8_t *value, size_t value_len) {
+    bool rval = false;
+    do {
+        if(_ram_partition->numKeys >= MAX_NUM_KV || key_len > MAX_KEY_LEN_BYTES) {
+            break;
+        }
+        if(freeBytes() < sizeof(ConfigKey_t) + value_len) {
+            break;
+        }
+        uint8_t idx = _ram_partition->numKeys;
+        ConfigKey_t &entry = _ram_partition->keys[idx];
+        memset(&entry, 0, sizeof(entry));
+        memcpy(entry.keyBuffer, key, key_len);
+        entry.keyLen = key_len;
+        placeValue(idx, type, value, value_len);
+        indexKey(idx);
+        _ram_partition->numKeys++;
+        rval = true;
+    } while(0);
+    return rval;
+}
+
+/*!
+* Put a value at the bottom of the values, the caller makes sure there is room.
+* \param idx[in] - index of the key
+* \param type[in] - value type
+* \param value[in] - CBOR encoded value, can be in the free space
+* \param value_len[in] - value length
+*/
+void Configuration::placeValue(uint8_t idx, ConfigDataTypes_e type, const uint8_t *value, size_t value_len) {
+    ConfigKey_t &entry = _ram_partition->keys[idx];
+    uint16_t offset = _ram_partition->valuesOffset - value_len;
+    memmove(reinterpret_cast<uint8_t *>(_ram_partition) + offset, value, value_len);
+    _ram_partition->valuesOffset = offset;
+    entry.valueOffset = offset;
+    entry.valueLen = value_len;
+    entry.valueType = type;
+    entry.cache.type = CACHE_NONE;
+}
+
+/*!
+* Give a key's value space back by sliding the values below it up.
+* \param idx[in] - index of the key
+*/
+void Configuration::releaseValue(uint8_t idx) {
+    ConfigKey_t &entry = _ram_partition->keys[idx];
+    uint8_t *base = reinterpret_cast<uint8_t *>(_ram_partition);
+    uint16_t offset = entry.valueOffset;
+    uint16_t len = entry.valueLen;
+    memmove(base + _ram_partition->valuesOffset + len, base + _ram_partition->valuesOffset, offset - _ram_partition->valuesOffset);
+    for(uint8_t i = 0; i < _ram_partition->numKeys; i++){
+        if(_ram_partition->keys[i].valueOffset < offset){
+            _ram_partition->keys[i].valueOffset += len;
+        }
+    }
+    _ram_partition->valuesOffset += len;
+    entry.valueOffset = _ram_partition->valuesOffset;
+    entry.valueLen = 0;
+    entry.cache.type = CACHE_NONE;
+}
+
+uint8_t *Configuration::valuePtr(uint8_t idx) {
+    return reinterpret_cast<uint8_t *>(_ram_partition) + _ram_partition->keys[idx].valueOffset;
+}
+
+// Between the end of the keys and the start of the values
+size_t Configuration::freeBytes(void) {
+    return _ram_partition->valuesOffset - (offsetof(ConfigPartition_t, keys) + _ram_partition->numKeys * sizeof(ConfigKey_t));
+}
+
+// What a compacted config store block would hold
+size_t Configuration::storedBytes(void) {
+    size_t bytes = 0;
+    for(uint8_t i = 0; i < _ram_partition->numKeys; i++){
+        bytes += ConfigStore::recordSize(_ram_partition->keys[i].keyLen, _ram_partition->keys[i].valueLen);
+    }
+    return bytes;
+}
+
+/*!
+* Put a key into the key index and drop its decoded value.
+* \param idx[in] - index of the key
+*/
+void Configuration::indexKey(uint8_t idx) {
+    ConfigKey_t &entry = _ram_partition->keys[idx];
+    // A bad length makes the key unreachable rather than overrunning the key buffer
+    size_t len = (entry.keyLen > MAX_KEY_LEN_BYTES) ? MAX_KEY_LEN_BYTES : entry.keyLen;
+    entry.keyHash = keyHash(entry.keyBuffer, len);
+    entry.cache.type = CACHE_NONE;
+    uint16_t slot = entry.keyHash & (CONFIG_KEY_SLOTS - 1);
+    while(_ram_partition->keySlots[slot]){
+        slot = (slot + 1) & (CONFIG_KEY_SLOTS - 1);
+    }
+    _ram_partition->keySlots[slot] = idx + 1;
+}
+
+/*!
+* Rebuild the key index and drop the decoded values, for when keys were moved.
+*/
+void Configuration::rebuildKeyIndex(void) {
+    configASSERT(_ram_partition->numKeys <= MAX_NUM_KV);
+    memset(_ram_partition->keySlots, 0, sizeof(_ram_partition->keySlots));
+    for(uint8_t i = 0; i < _ram_partition->numKeys; i++){
+        indexKey(i);
+    }
+}
+
 const char* Configuration::dataTypeEnumToStr(ConfigDataTypes_e type) {
     switch(type){
         case UINT32:
@@ -712,10 +1020,14 @@ const char* Configuration::dataTypeEnumToStr(ConfigDataTypes_e type) {
 bool Configuration::saveConfig(bool restart) {
     bool rval = false;
     do {
-        _ram_partition->header.crc32 = crc32_ieee(reinterpret_cast<const uint8_t *>(&_ram_partition->header.version), (sizeof(ConfigPartition_t)-sizeof(_ram_partition->header.crc32)));
-        if(!_flash_partition.write(CONFIG_START_OFFSET_IN_BYTES, reinterpret_cast<uint8_t *>(_ram_partition), sizeof(ConfigPartition_t), CONFIG_LOAD_TIMEOUT_MS)){
+        if(_legacy_pending && !backUpLegacyLayout()) {
+            printf("Unable to back up the legacy config, not migrating it\n");
             break;
         }
+        if(!_store.save(storedKey, this)){
+            break;
+        }
+        _legacy_pending = false;
         if (restart) {
             resetSystem(RESET_REASON_CONFIG);
         }
@@ -724,6 +1036,27 @@ bool Configuration::saveConfig(bool restart) {
     return rval;
 }
 
+/*!
+* Get the length of the cbor encoded value for a given key, the buffer size getConfigCbor needs.
+* \param key[in] - key
+* \param key_len[in] - key length
+* \param size[out] - encoded value length
+* \returns - true if success, false otherwise.
+*/
+bool Configuration::getCborValueSize(const char * key, size_t key_len, size_t &size) {
+    configASSERT(key);
+    bool rval = false;
+    uint8_t keyIdx;
+    do {
+        if(!findKeyIndex(key, key_len, keyIdx)){
+            break;
+        }
+        size = _ram_partition->keys[keyIdx].valueLen;
+        rval = true;
+    } while(0);
+    return rval;
+}
+
  bool Configuration::getValueSize(const char * key, size_t key_len, size_t &size) {
     configASSERT(key);
     bool rval = false;
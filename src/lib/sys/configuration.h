@@ -1,15 +1,18 @@
 #pragma once
 #include "abstract_configuration.h"
+#include "config_store.h"
 #include "nvmPartition.h"
 #include "cbor.h"
 
 namespace cfg {
 
-static constexpr uint8_t MAX_NUM_KV                         = 50;
+// Bounded by the key index, and before that by the RAM partition and config store block
+static constexpr uint8_t MAX_NUM_KV                         = 128;
 static constexpr uint8_t MAX_KEY_LEN_BYTES                  = 32;
-static constexpr uint8_t MAX_STR_LEN_BYTES                  = 50;
-static constexpr uint8_t MAX_CONFIG_BUFFER_SIZE_BYTES       = 50;
 static constexpr uint32_t CONFIG_VERSION        = 0; // FIXME: Put this in the default config file.
+// Power of two, twice MAX_NUM_KV or more so probe sequences stay short
+static constexpr uint16_t CONFIG_KEY_SLOTS                  = 256;
+static_assert(MAX_KEY_LEN_BYTES <= CONFIG_STORE_MAX_KEY_LEN, "Config keys don't fit the config store");
 
 typedef enum ConfigDataTypes{
     UINT32,
@@ -20,27 +23,47 @@ typedef enum ConfigDataTypes{
     ARRAY,
 } ConfigDataTypes_e;
 
-typedef struct ConfigPartitionHeader {
-    uint32_t crc32;
-    uint32_t version;
-    uint8_t numKeys;
-} __attribute__((packed, aligned(1))) ConfigPartitionHeader_t;
+typedef enum ConfigCacheType {
+    CACHE_NONE,
+    CACHE_UINT32,
+    CACHE_INT32,
+    CACHE_FLOAT,
+} ConfigCacheType_e;
+
+// Decoded scalar, so repeated reads skip the CBOR parser
+typedef struct ConfigValueCache {
+    uint8_t type;
+    union {
+        uint32_t u32;
+        int32_t i32;
+        float f;
+    } value;
+} __attribute__((packed, aligned(1))) ConfigValueCache_t;
 
 typedef struct ConfigKey {
     char keyBuffer[MAX_KEY_LEN_BYTES];
     size_t keyLen;
     ConfigDataTypes_e valueType;
+    // CBOR encoded value, from the start of the RAM partition
+    uint16_t valueOffset;
+    uint16_t valueLen;
+    uint32_t keyHash;
+    ConfigValueCache_t cache;
 } __attribute__((packed, aligned(1))) ConfigKey_t;
 
-typedef struct ConfigValue {
-    uint8_t valueBuffer[MAX_CONFIG_BUFFER_SIZE_BYTES];
-}__attribute__((packed, aligned(1))) ConfigValue_t;
-
+/*
+    Keys grow up from the start of the RAM partition, and their values are
+    packed down from the end of it, so neither has a fixed size.
+*/
 typedef struct ConfigPartition {
-    ConfigPartitionHeader_t header;
-    ConfigKey_t keys[MAX_NUM_KV];
-    ConfigValue_t values[MAX_NUM_KV];
-}__attribute__((packed, aligned(1))) ConfigPartition_t;
+    uint32_t version;
+    uint8_t numKeys;
+    // Where the values start, they run to the end of the RAM partition
+    uint16_t valuesOffset;
+    // Key index + 1, 0 if the slot is empty
+    uint8_t keySlots[CONFIG_KEY_SLOTS];
+    ConfigKey_t keys[0];
+} __attribute__((packed, aligned(1))) ConfigPartition_t;
 
 class Configuration : public AbstractConfiguration {
 public:
@@ -63,14 +86,29 @@ public:
     static const char* dataTypeEnumToStr(ConfigDataTypes_e type);
     bool saveConfig(bool restart=true);
     bool getValueSize(const char * key, size_t key_len, size_t &size);
+    bool getCborValueSize(const char * key, size_t key_len, size_t &size);
     bool needsCommit(void);
     static bool cborTypeToConfigType(const CborValue *value, ConfigDataTypes_e &configType);
     uint32_t getCborEncodedConfigurationCrc32(void);
 private:
     bool findKeyIndex(const char * key, size_t len, uint8_t &idx);
+    void indexKey(uint8_t idx);
+    void rebuildKeyIndex(void);
+    static uint32_t keyHash(const char * key, size_t len);
     bool prepareCborParser(const char * key, size_t key_len, CborValue &it, CborParser &parser);
-    bool prepareCborEncoder(const char * key, size_t key_len, CborEncoder &encoder, uint8_t &keyIdx, bool &keyExists);
+    bool prepareCborEncoder(const char * key, size_t key_len, size_t max_len, CborEncoder &encoder, uint8_t &keyIdx, bool &keyExists, uint8_t *&scratch);
+    bool storeValue(const char * key, size_t key_len, uint8_t keyIdx, bool keyExists, ConfigDataTypes_e type, const uint8_t *value, size_t value_len);
+    bool addKey(const char * key, size_t key_len, ConfigDataTypes_e type, const uint8_t *value, size_t value_len);
+    void placeValue(uint8_t idx, ConfigDataTypes_e type, const uint8_t *value, size_t value_len);
+    void releaseValue(uint8_t idx);
+    uint8_t *valuePtr(uint8_t idx);
+    size_t freeBytes(void);
+    size_t storedBytes(void);
+    bool readLegacyLayout(uint8_t *buffer);
     bool loadAndVerifyNvmConfig(void);
+    bool backUpLegacyLayout(void);
+    static bool loadRecord(void *arg, const ConfigStoreRecord_t &record);
+    static bool storedKey(void *arg, uint16_t idx, ConfigStoreRecord_t &record);
 
     static constexpr uint32_t CONFIG_START_OFFSET_IN_BYTES = 0;
     static constexpr uint32_t CONFIG_LOAD_TIMEOUT_MS = 5000;
@@ -80,5 +118,8 @@ private:
     size_t _ram_partition_size;
     ConfigPartition_t* _ram_partition;
     bool _needs_commit;
+    // Loaded from the legacy layout, which has to be backed up before the first save
+    bool _legacy_pending;
+    ConfigStore _store;
 };
 } // namespace cfg
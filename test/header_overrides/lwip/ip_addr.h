@@ -0,0 +1,11 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+
+// IPv6 only, like the bristlemouth lwIP configuration
+typedef struct ip6_addr {
+  uint32_t addr[4];
+  uint8_t zone;
+} ip6_addr_t;
+
+typedef ip6_addr_t ip_addr_t;
@@ -0,0 +1,51 @@
+#pragma once
+#include <stdint.h>
+#include "fff.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Just enough of lwIP's pbuf for the middleware, see lwip/src/include/lwip/pbuf.h
+typedef enum {
+  PBUF_TRANSPORT = 74,
+  PBUF_IP = 54,
+  PBUF_LINK = 14,
+  PBUF_RAW_TX = 0,
+  PBUF_RAW = 0
+} pbuf_layer;
+
+typedef enum {
+  PBUF_RAM = 0x0280,
+  PBUF_ROM = 0x0001,
+  PBUF_REF = 0x0041,
+  PBUF_POOL = 0x0182
+} pbuf_type;
+
+struct pbuf {
+  struct pbuf *next;
+  void *payload;
+  uint16_t tot_len;
+  uint16_t len;
+  uint8_t type_internal;
+  uint8_t flags;
+  uint8_t ref;
+  uint8_t if_idx;
+};
+
+typedef void (*pbuf_free_custom_fn)(struct pbuf *p);
+
+struct pbuf_custom {
+  struct pbuf pbuf;
+  pbuf_free_custom_fn custom_free_function;
+};
+
+DECLARE_FAKE_VALUE_FUNC(struct pbuf *, pbuf_alloc, pbuf_layer, uint16_t, pbuf_type);
+DECLARE_FAKE_VALUE_FUNC(struct pbuf *, pbuf_alloced_custom, pbuf_layer, uint16_t, pbuf_type, struct pbuf_custom *, void *, uint16_t);
+DECLARE_FAKE_VOID_FUNC(pbuf_realloc, struct pbuf *, uint16_t);
+DECLARE_FAKE_VOID_FUNC(pbuf_ref, struct pbuf *);
+DECLARE_FAKE_VALUE_FUNC(uint8_t, pbuf_free, struct pbuf *);
+
+#ifdef __cplusplus
+}
+#endif
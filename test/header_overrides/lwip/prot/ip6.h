@@ -0,0 +1,3 @@
+#pragma once
+
+#define IP6_HLEN 40
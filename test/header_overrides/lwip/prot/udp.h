@@ -0,0 +1,3 @@
+#pragma once
+
+#define UDP_HLEN 8
@@ -0,0 +1,12 @@
+#pragma once
+#include "bcmp_resource_discovery.h"
+
+// fff fakes get C linkage, so the namespaced functions are stubbed by hand
+typedef struct {
+  uint32_t add_resource_call_count;
+  uint32_t remote_sub_possible_call_count;
+  // Returned by bcmp_resource_discovery_remote_sub_possible()
+  bool remote_sub_possible;
+} mock_bcmp_resource_discovery_t;
+
+extern mock_bcmp_resource_discovery_t mock_bcmp_resource_discovery;
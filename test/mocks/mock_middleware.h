@@ -0,0 +1,6 @@
+#pragma once
+#include "fff.h"
+#include "middleware.h"
+
+DECLARE_FAKE_VALUE_FUNC(int32_t, bm_middleware_local_pub, struct pbuf *);
+DECLARE_FAKE_VALUE_FUNC(int32_t, middleware_net_tx, struct pbuf *);
@@ -0,0 +1,441 @@
+#include "gtest/gtest.h"
+
+#include <math.h>
+#include <random>
+#include <string.h>
+#include <vector>
+
+#include "packed_sensor_report_encoder.h"
+#include "sensor_report_schema.h"
+
+// What's left of an Iridium message after its header, see MAX_SENSOR_REPORT_CBOR_LEN
+static constexpr size_t IRIDIUM_REPORT_BYTES = 315;
+
+class BitReader {
+public:
+  BitReader(const uint8_t *buf, size_t len) : _buf(buf), _len(len), _pos(0) {}
+
+  uint32_t get(uint8_t num_bits) {
+    uint32_t value = 0;
+    for (uint8_t i = 0; i < num_bits; i++) {
+      EXPECT_LT(_pos / 8, _len);
+      value = (value << 1) | ((_buf[_pos / 8] >> (7 - (_pos % 8))) & 1);
+      _pos++;
+    }
+    return value;
+  }
+
+  size_t pos() { return _pos; }
+
+private:
+  const uint8_t *_buf;
+  size_t _len;
+  size_t _pos;
+};
+
+static double decodeCode(const sensor_report_packed_field_t &field, uint32_t code) {
+  uint32_t nan_code = (1u << field.bits) - 1;
+  if (code == nan_code) {
+    return NAN;
+  } else if (code == nan_code - 1) {
+    return INFINITY;
+  } else if (code == nan_code - 2) {
+    return -INFINITY;
+  }
+  EXPECT_LE(code, field.max_code);
+  return field.min + code * field.resolution;
+}
+
+// Decodes one sensor, values[field][sample]
+static std::vector<std::vector<double>> decodeSensor(BitReader &reader,
+                                                     const sensor_report_packed_field_t *fields,
+                                                     size_t num_fields, uint16_t num_samples) {
+  std::vector<std::vector<double>> values(num_fields);
+  for (size_t i = 0; i < num_fields; i++) {
+    const sensor_report_packed_field_t &field = fields[i];
+    uint32_t code = reader.get(field.bits);
+    values[i].push_back(decodeCode(field, code));
+    if (num_samples < 2) {
+      continue;
+    }
+    uint8_t width = reader.get(PACKED_SENSOR_REPORT_WIDTH_BITS);
+    for (uint16_t j = 1; j < num_samples; j++) {
+      if (width == PACKED_SENSOR_REPORT_ABSOLUTE) {
+        code = reader.get(field.bits);
+      } else {
+        uint32_t zz = reader.get(width);
+        int64_t delta = static_cast<int64_t>(zz >> 1) ^ -static_cast<int64_t>(zz & 1);
+        code = static_cast<uint32_t>(code + delta);
+      }
+      values[i].push_back(decodeCode(field, code));
+    }
+  }
+  return values;
+}
+
+// Samples like the ones our deployments send, each sensor drifting a little between them
+static std::vector<aanderaa_aggregations_t> aanderaaSamples(std::mt19937 &rng, size_t n) {
+  std::normal_distribution<double> step(0, 1);
+  std::vector<aanderaa_aggregations_t> samples;
+  aanderaa_aggregations_t sample = {.abs_speed_mean_cm_s = 18.0,
+                                    .abs_speed_std_cm_s = 1.5,
+                                    .direction_circ_mean_rad = 2.0,
+                                    .direction_circ_std_rad = 0.2,
+                                    .temp_mean_deg_c = 15.2,
+                                    .abs_tilt_mean_rad = 0.05,
+                                    .std_tilt_mean_rad = 0.01,
+                                    .reading_count = 60};
+  for (size_t i = 0; i < n; i++) {
+    sample.abs_speed_mean_cm_s = fabs(sample.abs_speed_mean_cm_s + 2 * step(rng));
+    sample.abs_speed_std_cm_s = fabs(sample.abs_speed_std_cm_s + 0.2 * step(rng));
+    sample.direction_circ_mean_rad =
+        fmod(sample.direction_circ_mean_rad + 0.1 * step(rng) + 2 * M_PI, 2 * M_PI);
+    sample.direction_circ_std_rad = fabs(sample.direction_circ_std_rad + 0.02 * step(rng));
+    sample.temp_mean_deg_c += 0.05 * step(rng);
+    sample.abs_tilt_mean_rad = fabs(sample.abs_tilt_mean_rad + 0.005 * step(rng));
+    sample.std_tilt_mean_rad = fabs(sample.std_tilt_mean_rad + 0.001 * step(rng));
+    sample.reading_count = 58 + rng() % 3;
+    samples.push_back(sample);
+  }
+  return samples;
+}
+
+static std::vector<rbr_coda_aggregations_t> rbrCodaSamples(std::mt19937 &rng, size_t n) {
+  std::normal_distribution<double> step(0, 1);
+  std::vector<rbr_coda_aggregations_t> samples;
+  rbr_coda_aggregations_t sample = {.temp_mean_deg_c = 12.0,
+                                    .pressure_mean_deci_bar = 100.0,
+                                    .pressure_stdev_deci_bar = 0.3,
+                                    .reading_count = 240,
+                                    .sensor_type =
+                                        BmRbrDataMsg::SensorType::PRESSURE_AND_TEMPERATURE};
+  for (size_t i = 0; i < n; i++) {
+    sample.temp_mean_deg_c += 0.01 * step(rng);
+    sample.pressure_mean_deci_bar += 0.05 * step(rng);
+    sample.pressure_stdev_deci_bar = fabs(sample.pressure_stdev_deci_bar + 0.02 * step(rng));
+    samples.push_back(sample);
+  }
+  return samples;
+}
+
+static std::vector<seapoint_turbidity_aggregations_t> seapointSamples(std::mt19937 &rng,
+                                                                      size_t n) {
+  std::normal_distribution<double> step(0, 1);
+  std::vector<seapoint_turbidity_aggregations_t> samples;
+  seapoint_turbidity_aggregations_t sample = {
+      .turbidity_s_mean_ftu = 3.0, .turbidity_r_mean_ftu = 3.2, .reading_count = 120};
+  for (size_t i = 0; i < n; i++) {
+    sample.turbidity_s_mean_ftu = fabs(sample.turbidity_s_mean_ftu + 0.1 * step(rng));
+    sample.turbidity_r_mean_ftu = fabs(sample.turbidity_r_mean_ftu + 0.1 * step(rng));
+    samples.push_back(sample);
+  }
+  return samples;
+}
+
+template <typename T> static size_t numPackedFields() {
+  return sizeof(SensorReportSchema<T>::packed_fields) / sizeof(sensor_report_packed_field_t);
+}
+
+// The fixture for testing class Foo.
+class PackedSensorReportEncoderTest : public ::testing::Test {
+protected:
+  // You can remove any or all of the following functions if its body
+  // is empty.
+
+  PackedSensorReportEncoderTest() {
+    // You can do set-up work for each test here.
+  }
+
+  ~PackedSensorReportEncoderTest() override {
+    // You can do clean-up work that doesn't throw exceptions here.
+  }
+
+  // If the constructor and destructor are not enough for setting up
+  // and cleaning up each test, you can define the following methods:
+
+  void SetUp() override {
+    // Code here will be called immediately after the constructor (right
+    // before each test).
+    memset(buf, 0xAA, sizeof(buf));
+  }
+
+  void TearDown() override {
+    // Code here will be called immediately after each test (right
+    // before the destructor).
+  }
+
+  // Packs a one sensor report and decodes it again
+  template <typename T>
+  std::vector<std::vector<double>> roundTrip(uint8_t sensor_type, const T *samples,
+                                             uint16_t num_samples) {
+    packed_sensor_report_encoder_context_t context;
+    EXPECT_TRUE(
+        packed_sensor_report_encoder_open_report(buf, sizeof(buf), 1, num_samples, context));
+    EXPECT_TRUE(sensor_report_pack_sensor(context, sensor_type, samples));
+    EXPECT_TRUE(packed_sensor_report_encoder_close_report(context));
+    size_t len = packed_sensor_report_encoder_get_report_size_bytes(context);
+
+    BitReader reader(buf, len);
+    EXPECT_EQ(reader.get(8), PACKED_SENSOR_REPORT_VERSION);
+    EXPECT_EQ(reader.get(8), 1u);
+    EXPECT_EQ(reader.get(16), num_samples);
+    EXPECT_EQ(reader.get(PACKED_SENSOR_REPORT_TYPE_BITS), sensor_type);
+    std::vector<std::vector<double>> values = decodeSensor(
+        reader, SensorReportSchema<T>::packed_fields, numPackedFields<T>(), num_samples);
+    EXPECT_EQ((reader.pos() + 7) / 8, len);
+    return values;
+  }
+
+  // Objects declared here can be used by all tests in the test suite for Foo.
+  uint8_t buf[1024];
+};
+
+TEST_F(PackedSensorReportEncoderTest, FieldBits) {
+  constexpr sensor_report_packed_field_t temp = packed_sensor_report_double(0, -5, 40, 0.001);
+  EXPECT_EQ(temp.max_code, 45000u);
+  EXPECT_EQ(temp.bits, 16);
+  // 0..3 plus the three special codes
+  constexpr sensor_report_packed_field_t type = packed_sensor_report_uint(0, 1, 3);
+  EXPECT_EQ(type.bits, 3);
+  constexpr sensor_report_packed_field_t count = packed_sensor_report_uint(0, 4, UINT16_MAX);
+  EXPECT_EQ(count.bits, 17);
+}
+
+TEST_F(PackedSensorReportEncoderTest, Quantize) {
+  const sensor_report_packed_field_t field = packed_sensor_report_double(0, -5, 40, 0.001);
+  uint32_t nan_code = (1u << field.bits) - 1;
+  double value = 12.3456;
+  EXPECT_EQ(packed_sensor_report_quantize(field, &value), 17346u);
+  value = -5;
+  EXPECT_EQ(packed_sensor_report_quantize(field, &value), 0u);
+  value = 40;
+  EXPECT_EQ(packed_sensor_report_quantize(field, &value), field.max_code);
+  value = NAN;
+  EXPECT_EQ(packed_sensor_report_quantize(field, &value), nan_code);
+  value = 40.1;
+  EXPECT_EQ(packed_sensor_report_quantize(field, &value), nan_code - 1);
+  value = HUGE_VAL;
+  EXPECT_EQ(packed_sensor_report_quantize(field, &value), nan_code - 1);
+  value = -HUGE_VAL;
+  EXPECT_EQ(packed_sensor_report_quantize(field, &value), nan_code - 2);
+}
+
+TEST_F(PackedSensorReportEncoderTest, AanderaaRoundTrip) {
+  aanderaa_aggregations_t samples[] = {
+      {.abs_speed_mean_cm_s = 12.5,
+       .abs_speed_std_cm_s = 0.25,
+       .direction_circ_mean_rad = 3.1,
+       .direction_circ_std_rad = 0.01,
+       .temp_mean_deg_c = 18.75,
+       .abs_tilt_mean_rad = 0.1,
+       .std_tilt_mean_rad = 0.002,
+       .reading_count = 59},
+      SensorReportSchema<aanderaa_aggregations_t>::nan_sample,
+      {.abs_speed_mean_cm_s = 13.01,
+       .abs_speed_std_cm_s = 0.3,
+       .direction_circ_mean_rad = 3.2,
+       .direction_circ_std_rad = 0.02,
+       .temp_mean_deg_c = 18.7,
+       .abs_tilt_mean_rad = 0.1,
+       .std_tilt_mean_rad = 0.002,
+       .reading_count = 100000},
+  };
+  std::vector<std::vector<double>> values = roundTrip(SENSOR_TYPE_AANDERAA, samples, 3);
+  const sensor_report_packed_field_t *fields =
+      SensorReportSchema<aanderaa_aggregations_t>::packed_fields;
+  for (int j : {0, 2}) {
+    const double expected[] = {
+        samples[j].abs_speed_mean_cm_s,     samples[j].abs_speed_std_cm_s,
+        samples[j].direction_circ_mean_rad, samples[j].direction_circ_std_rad,
+        samples[j].temp_mean_deg_c,         samples[j].abs_tilt_mean_rad,
+        samples[j].std_tilt_mean_rad};
+    for (size_t i = 0; i < 7; i++) {
+      EXPECT_NEAR(values[i][j], expected[i], fields[i].resolution / 2);
+    }
+  }
+  for (size_t i = 0; i < 7; i++) {
+    EXPECT_TRUE(isnan(values[i][1]));
+  }
+  EXPECT_EQ(values[7][0], 59);
+  EXPECT_EQ(values[7][1], 0);
+  // Too many readings to say how many
+  EXPECT_EQ(values[7][2], INFINITY);
+}
+
+TEST_F(PackedSensorReportEncoderTest, RbrCodaRoundTrip) {
+  rbr_coda_aggregations_t samples[] = {
+      {.temp_mean_deg_c = 4.5123,
+       .pressure_mean_deci_bar = NAN,
+       .pressure_stdev_deci_bar = NAN,
+       .reading_count = 10,
+       .sensor_type = BmRbrDataMsg::SensorType::TEMPERATURE},
+      {.temp_mean_deg_c = HUGE_VAL,
+       .pressure_mean_deci_bar = 101.3,
+       .pressure_stdev_deci_bar = HUGE_VAL,
+       .reading_count = 11,
+       .sensor_type = BmRbrDataMsg::SensorType::PRESSURE_AND_TEMPERATURE},
+  };
+  std::vector<std::vector<double>> values = roundTrip(SENSOR_TYPE_RBR_CODA, samples, 2);
+  EXPECT_EQ(values[0][0], BmRbrDataMsg::SensorType::TEMPERATURE);
+  EXPECT_EQ(values[0][1], BmRbrDataMsg::SensorType::PRESSURE_AND_TEMPERATURE);
+  EXPECT_NEAR(values[1][0], 4.5123, 0.00005);
+  EXPECT_EQ(values[1][1], INFINITY);
+  EXPECT_TRUE(isnan(values[2][0]));
+  EXPECT_NEAR(values[2][1], 101.3, 0.00005);
+  EXPECT_TRUE(isnan(values[3][0]));
+  EXPECT_EQ(values[3][1], INFINITY);
+}
+
+TEST_F(PackedSensorReportEncoderTest, OneSample) {
+  soft_aggregations_t sample = {.temp_mean_deg_c = 21.125, .reading_count = 240};
+  std::vector<std::vector<double>> values = roundTrip(SENSOR_TYPE_SOFT, &sample, 1);
+  EXPECT_NEAR(values[0][0], 21.125, 0.0005);
+  // Header, type and one 17 bit temperature
+  packed_sensor_report_encoder_context_t context;
+  ASSERT_TRUE(packed_sensor_report_encoder_open_report(buf, sizeof(buf), 1, 1, context));
+  ASSERT_TRUE(sensor_report_pack_sensor(context, SENSOR_TYPE_SOFT, &sample));
+  ASSERT_TRUE(packed_sensor_report_encoder_close_report(context));
+  EXPECT_EQ(packed_sensor_report_encoder_get_report_size_bytes(context), 7u);
+}
+
+TEST_F(PackedSensorReportEncoderTest, ConstantFieldsAreFree) {
+  std::vector<seapoint_turbidity_aggregations_t> samples(
+      100, {.turbidity_s_mean_ftu = 1.5, .turbidity_r_mean_ftu = 2.25, .reading_count = 120});
+  std::vector<std::vector<double>> values =
+      roundTrip(SENSOR_TYPE_SEAPOINT_TURBIDITY, samples.data(), samples.size());
+  for (size_t j = 0; j < samples.size(); j++) {
+    EXPECT_NEAR(values[0][j], 1.5, 0.0005);
+    EXPECT_NEAR(values[1][j], 2.25, 0.0005);
+  }
+  // Only the first code and a zero width for each field
+  packed_sensor_report_encoder_context_t context;
+  ASSERT_TRUE(packed_sensor_report_encoder_open_report(buf, sizeof(buf), 1, 100, context));
+  ASSERT_TRUE(
+      sensor_report_pack_sensor(context, SENSOR_TYPE_SEAPOINT_TURBIDITY, samples.data()));
+  const sensor_report_packed_field_t *fields =
+      SensorReportSchema<seapoint_turbidity_aggregations_t>::packed_fields;
+  EXPECT_EQ(context.bit_pos, 32u + PACKED_SENSOR_REPORT_TYPE_BITS + fields[0].bits +
+                                 fields[1].bits + 2 * PACKED_SENSOR_REPORT_WIDTH_BITS);
+}
+
+TEST_F(PackedSensorReportEncoderTest, LargeJumpsAreAbsolute) {
+  soft_aggregations_t samples[] = {
+      {.temp_mean_deg_c = -20, .reading_count = 1},
+      {.temp_mean_deg_c = 61.88, .reading_count = 1},
+      {.temp_mean_deg_c = -20, .reading_count = 1},
+  };
+  std::vector<std::vector<double>> values = roundTrip(SENSOR_TYPE_SOFT, samples, 3);
+  EXPECT_NEAR(values[0][0], -20, 0.0005);
+  EXPECT_NEAR(values[0][1], 61.88, 0.0005);
+  EXPECT_NEAR(values[0][2], -20, 0.0005);
+  BitReader reader(buf, sizeof(buf));
+  reader.get(32 + PACKED_SENSOR_REPORT_TYPE_BITS +
+             SensorReportSchema<soft_aggregations_t>::packed_fields[0].bits);
+  EXPECT_EQ(reader.get(PACKED_SENSOR_REPORT_WIDTH_BITS), PACKED_SENSOR_REPORT_ABSOLUTE);
+}
+
+TEST_F(PackedSensorReportEncoderTest, Errors) {
+  soft_aggregations_t sample = SensorReportSchema<soft_aggregations_t>::nan_sample;
+  packed_sensor_report_encoder_context_t context;
+  EXPECT_FALSE(packed_sensor_report_encoder_open_report(buf, sizeof(buf), 1, 65536, context));
+  EXPECT_FALSE(packed_sensor_report_encoder_open_report(buf, 3, 1, 1, context));
+
+  // Doesn't fit
+  ASSERT_TRUE(packed_sensor_report_encoder_open_report(buf, 5, 1, 1, context));
+  EXPECT_FALSE(sensor_report_pack_sensor(context, SENSOR_TYPE_SOFT, &sample));
+
+  // More sensors than opened with, or one is missing
+  ASSERT_TRUE(packed_sensor_report_encoder_open_report(buf, sizeof(buf), 1, 1, context));
+  EXPECT_TRUE(sensor_report_pack_sensor(context, SENSOR_TYPE_SOFT, &sample));
+  EXPECT_FALSE(sensor_report_pack_sensor(context, SENSOR_TYPE_SOFT, &sample));
+  ASSERT_TRUE(packed_sensor_report_encoder_open_report(buf, sizeof(buf), 2, 1, context));
+  EXPECT_TRUE(sensor_report_pack_sensor(context, SENSOR_TYPE_SOFT, &sample));
+  EXPECT_FALSE(packed_sensor_report_encoder_close_report(context));
+
+  EXPECT_FALSE(sensor_report_pack_sensor(context, SENSOR_TYPE_UNKNOWN, &sample));
+}
+
+//
+// How many samples per sensor fit into one Iridium message, for the mixes of sensors
+// we deploy, with the CBOR report against the packed one.
+//
+TEST_F(PackedSensorReportEncoderTest, SamplesPerMessage) {
+  struct Mix {
+    const char *name;
+    std::vector<uint8_t> sensors;
+  } mixes[] = {
+      {"aanderaa", {SENSOR_TYPE_AANDERAA}},
+      {"aanderaa + rbr", {SENSOR_TYPE_AANDERAA, SENSOR_TYPE_RBR_CODA}},
+      {"rbr + seapoint", {SENSOR_TYPE_RBR_CODA, SENSOR_TYPE_SEAPOINT_TURBIDITY}},
+      {"aanderaa + rbr + seapoint",
+       {SENSOR_TYPE_AANDERAA, SENSOR_TYPE_RBR_CODA, SENSOR_TYPE_SEAPOINT_TURBIDITY}},
+      {"2 aanderaa + 2 rbr",
+       {SENSOR_TYPE_AANDERAA, SENSOR_TYPE_AANDERAA, SENSOR_TYPE_RBR_CODA,
+        SENSOR_TYPE_RBR_CODA}},
+  };
+  static constexpr size_t MAX_SAMPLES = 128;
+  static uint8_t cbor_buf[65536];
+
+  for (const Mix &mix : mixes) {
+    std::mt19937 rng(1234);
+    std::vector<std::vector<uint8_t>> sensor_data;
+    for (uint8_t sensor_type : mix.sensors) {
+      std::vector<uint8_t> data;
+      if (sensor_type == SENSOR_TYPE_AANDERAA) {
+        auto samples = aanderaaSamples(rng, MAX_SAMPLES);
+        data.assign(reinterpret_cast<uint8_t *>(samples.data()),
+                    reinterpret_cast<uint8_t *>(samples.data() + samples.size()));
+      } else if (sensor_type == SENSOR_TYPE_RBR_CODA) {
+        auto samples = rbrCodaSamples(rng, MAX_SAMPLES);
+        data.assign(reinterpret_cast<uint8_t *>(samples.data()),
+                    reinterpret_cast<uint8_t *>(samples.data() + samples.size()));
+      } else {
+        auto samples = seapointSamples(rng, MAX_SAMPLES);
+        data.assign(reinterpret_cast<uint8_t *>(samples.data()),
+                    reinterpret_cast<uint8_t *>(samples.data() + samples.size()));
+      }
+      sensor_data.push_back(data);
+    }
+
+    size_t cbor_fit = 0;
+    size_t packed_fit = 0;
+    for (uint16_t n = 1; n <= MAX_SAMPLES; n++) {
+      sensor_report_encoder_context_t cbor_ctx;
+      ASSERT_EQ(sensor_report_encoder_open_report(cbor_buf, sizeof(cbor_buf),
+                                                  mix.sensors.size(), cbor_ctx),
+                CborNoError);
+      packed_sensor_report_encoder_context_t packed_ctx;
+      ASSERT_TRUE(packed_sensor_report_encoder_open_report(buf, sizeof(buf), mix.sensors.size(),
+                                                           n, packed_ctx));
+      for (size_t s = 0; s < mix.sensors.size(); s++) {
+        uint8_t sensor_type = mix.sensors[s];
+        void *samples = sensor_data[s].data();
+        ASSERT_EQ(sensor_report_encoder_open_sensor(cbor_ctx, n), CborNoError);
+        for (uint16_t j = 0; j < n; j++) {
+          sensor_report_schema_visit(sensor_type, [&](auto schema) {
+            typedef typename decltype(schema)::sample_t sample_t;
+            const sample_t &sample = static_cast<sample_t *>(samples)[j];
+            ASSERT_EQ(sensor_report_encode_sample(cbor_ctx, sample), CborNoError);
+          });
+        }
+        ASSERT_EQ(sensor_report_encoder_close_sensor(cbor_ctx), CborNoError);
+        ASSERT_TRUE(sensor_report_pack_sensor(packed_ctx, sensor_type, samples));
+      }
+      ASSERT_EQ(sensor_report_encoder_close_report(cbor_ctx), CborNoError);
+      ASSERT_TRUE(packed_sensor_report_encoder_close_report(packed_ctx));
+      if (sensor_report_encoder_get_report_size_bytes(cbor_ctx) <= IRIDIUM_REPORT_BYTES) {
+        cbor_fit = n;
+      }
+      if (packed_sensor_report_encoder_get_report_size_bytes(packed_ctx) <=
+          IRIDIUM_REPORT_BYTES) {
+        packed_fit = n;
+      }
+      if (cbor_fit < n && packed_fit < n) {
+        break;
+      }
+    }
+    printf("%-28s samples/sensor per message: cbor %3zu, packed %3zu\n", mix.name, cbor_fit,
+           packed_fit);
+    EXPECT_GE(packed_fit, 4 * cbor_fit);
+  }
+}
@@ -0,0 +1,303 @@
+#include "gtest/gtest.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+
+#include "rbr_pressure_residual_encoder.h"
+
+static constexpr double RESOLUTION_DBAR = 0.0001;
+static constexpr size_t IRIDIUM_MESSAGE_BYTES = 315;
+// What the CBOR BmRbrPressureDifferenceSignalMsg spends on each residual, a tagged double
+static constexpr size_t CBOR_BYTES_PER_SAMPLE = 9;
+static constexpr size_t CBOR_SAMPLES_PER_MESSAGE = 30;
+
+// Same as tools/scripts/misc/rbr_pressure_decoder.py
+class BitReader {
+public:
+  BitReader(const uint8_t *data, size_t len) : _data(data), _len(len), _pos(0) {}
+  bool get(uint8_t num_bits, uint64_t &value) {
+    value = 0;
+    for (uint8_t i = 0; i < num_bits; i++) {
+      if (_pos >= _len * 8) {
+        return false;
+      }
+      value = (value << 1) | ((_data[_pos / 8] >> (7 - _pos % 8)) & 1);
+      _pos++;
+    }
+    return true;
+  }
+
+private:
+  const uint8_t *_data;
+  size_t _len;
+  size_t _pos;
+};
+
+static bool decode(const uint8_t *buffer, size_t len, rbr_pressure_residual_header_t &header,
+                   std::vector<double> &samples) {
+  if (len < sizeof(header)) {
+    return false;
+  }
+  memcpy(&header, buffer, sizeof(header));
+  BitReader reader(buffer + sizeof(header), len - sizeof(header));
+  int64_t prev_prev_code = header.reference_code;
+  int64_t prev_code = prev_prev_code + header.first_difference;
+  samples.push_back(prev_prev_code * header.resolution_dbar);
+  if (header.num_samples > 1) {
+    samples.push_back(prev_code * header.resolution_dbar);
+  }
+  for (size_t i = 2; i < header.num_samples; i++) {
+    uint64_t quotient = 0;
+    uint64_t bit = 1;
+    while (quotient < RBR_PRESSURE_RESIDUAL_ESCAPE) {
+      if (!reader.get(1, bit)) {
+        return false;
+      }
+      if (!bit) {
+        break;
+      }
+      quotient++;
+    }
+    uint64_t z;
+    if (quotient == RBR_PRESSURE_RESIDUAL_ESCAPE) {
+      uint64_t width;
+      if (!reader.get(RBR_PRESSURE_RESIDUAL_WIDTH_BITS, width) || !reader.get(width, z)) {
+        return false;
+      }
+    } else {
+      uint64_t remainder;
+      if (!reader.get(header.rice_k, remainder)) {
+        return false;
+      }
+      z = (quotient << header.rice_k) | remainder;
+    }
+    int64_t residual = static_cast<int64_t>(z >> 1) ^ -static_cast<int64_t>(z & 1);
+    int64_t code = residual + 2 * prev_code - prev_prev_code;
+    samples.push_back(code * header.resolution_dbar);
+    prev_prev_code = prev_code;
+    prev_code = code;
+  }
+  return true;
+}
+
+// A 275 s window at 2 Hz of swell and wind waves at ~10 m, with sensor noise
+static std::vector<double> waveSignal(size_t num_samples) {
+  std::vector<double> signal;
+  uint32_t seed = 12345;
+  for (size_t i = 0; i < num_samples; i++) {
+    double t = i * 0.5;
+    seed = seed * 1103515245 + 12345;
+    double noise = (static_cast<int32_t>((seed >> 16) & 0x7) - 3) * RESOLUTION_DBAR;
+    double pressure =
+        10.0 + 0.8 * sin(2 * M_PI * t / 12.0) + 0.15 * sin(2 * M_PI * t / 4.5 + 1.0);
+    signal.push_back(round(pressure / RESOLUTION_DBAR) * RESOLUTION_DBAR + noise);
+  }
+  return signal;
+}
+
+// The fixture for testing class Foo.
+class RbrPressureResidualEncoderTest : public ::testing::Test {
+protected:
+  // You can remove any or all of the following functions if its body
+  // is empty.
+
+  RbrPressureResidualEncoderTest() {
+    // You can do set-up work for each test here.
+  }
+
+  ~RbrPressureResidualEncoderTest() override {
+    // You can do clean-up work that doesn't throw exceptions here.
+  }
+
+  // If the constructor and destructor are not enough for setting up
+  // and cleaning up each test, you can define the following methods:
+
+  void SetUp() override {
+    // Code here will be called immediately after the constructor (right
+    // before each test).
+    memset(&header, 0, sizeof(header));
+  }
+
+  void TearDown() override {
+    // Code here will be called immediately after each test (right
+    // before the destructor).
+  }
+
+  // Encode the whole signal the way rbrPressureProcessor does, returning the messages
+  std::vector<std::vector<uint8_t>> encodeWindow(const std::vector<double> &signal,
+                                                 size_t message_len) {
+    std::vector<std::vector<uint8_t>> messages;
+    size_t offset = 0;
+    while (offset < signal.size()) {
+      offset += rbr_pressure_residual_skip(signal.data() + offset, signal.size() - offset,
+                                           RESOLUTION_DBAR);
+      if (offset == signal.size()) {
+        break;
+      }
+      uint8_t buffer[1024];
+      size_t encoded_len = 0;
+      header.sequence_num = messages.size();
+      header.total_samples = signal.size();
+      header.first_sample = offset;
+      EXPECT_TRUE(rbr_pressure_residual_encode(signal.data() + offset, signal.size() - offset,
+                                               RESOLUTION_DBAR, header, buffer, message_len,
+                                               encoded_len));
+      EXPECT_LE(encoded_len, message_len);
+      if (encoded_len == 0) {
+        break;
+      }
+      messages.push_back(std::vector<uint8_t>(buffer, buffer + encoded_len));
+      offset += header.num_samples;
+    }
+    return messages;
+  }
+
+  // Objects declared here can be used by all tests in the test suite for Foo.
+  rbr_pressure_residual_header_t header;
+};
+
+TEST_F(RbrPressureResidualEncoderTest, RoundTrip) {
+  std::vector<double> signal = waveSignal(550);
+  std::vector<std::vector<uint8_t>> messages = encodeWindow(signal, IRIDIUM_MESSAGE_BYTES);
+
+  std::vector<double> decoded;
+  for (size_t i = 0; i < messages.size(); i++) {
+    rbr_pressure_residual_header_t decoded_header;
+    size_t first_sample = decoded.size();
+    ASSERT_TRUE(decode(messages[i].data(), messages[i].size(), decoded_header, decoded));
+    EXPECT_EQ(decoded_header.version, RBR_PRESSURE_RESIDUAL_VERSION);
+    EXPECT_EQ(decoded_header.sequence_num, i);
+    EXPECT_EQ(decoded_header.total_samples, signal.size());
+    EXPECT_EQ(decoded_header.first_sample, first_sample);
+  }
+  ASSERT_EQ(decoded.size(), signal.size());
+  for (size_t i = 0; i < signal.size(); i++) {
+    EXPECT_NEAR(decoded[i], signal[i], RESOLUTION_DBAR / 2 + 1e-9);
+  }
+}
+
+TEST_F(RbrPressureResidualEncoderTest, BytesPerWindow) {
+  for (size_t num_samples : {275, 550, 1100}) {
+    std::vector<double> signal = waveSignal(num_samples);
+    std::vector<std::vector<uint8_t>> messages = encodeWindow(signal, IRIDIUM_MESSAGE_BYTES);
+    size_t residual_bytes = 0;
+    for (const std::vector<uint8_t> &message : messages) {
+      residual_bytes += message.size();
+    }
+    size_t cbor_bytes = num_samples * CBOR_BYTES_PER_SAMPLE;
+    size_t cbor_messages =
+        (num_samples + CBOR_SAMPLES_PER_MESSAGE - 1) / CBOR_SAMPLES_PER_MESSAGE;
+    printf("%zu samples: cbor >= %zu bytes in %zu messages, "
+           "residual %zu bytes in %zu messages\n",
+           num_samples, cbor_bytes, cbor_messages, residual_bytes, messages.size());
+    EXPECT_LE(residual_bytes * 4, cbor_bytes);
+    EXPECT_LE(messages.size() * 4, cbor_messages);
+  }
+}
+
+TEST_F(RbrPressureResidualEncoderTest, FewSamples) {
+  const double signal[] = {10.1234, 10.1240};
+  uint8_t buffer[128];
+  size_t encoded_len = 0;
+  std::vector<double> decoded;
+  rbr_pressure_residual_header_t decoded_header;
+
+  EXPECT_TRUE(rbr_pressure_residual_encode(signal, 1, RESOLUTION_DBAR, header, buffer,
+                                           sizeof(buffer), encoded_len));
+  EXPECT_EQ(encoded_len, sizeof(header));
+  EXPECT_EQ(header.num_samples, 1);
+  EXPECT_EQ(header.reference_code, 101234);
+  EXPECT_EQ(header.first_difference, 0);
+  ASSERT_TRUE(decode(buffer, encoded_len, decoded_header, decoded));
+  ASSERT_EQ(decoded.size(), 1u);
+  EXPECT_NEAR(decoded[0], 10.1234, 1e-9);
+
+  decoded.clear();
+  EXPECT_TRUE(rbr_pressure_residual_encode(signal, 2, RESOLUTION_DBAR, header, buffer,
+                                           sizeof(buffer), encoded_len));
+  EXPECT_EQ(encoded_len, sizeof(header));
+  EXPECT_EQ(header.num_samples, 2);
+  EXPECT_EQ(header.first_difference, 6);
+  ASSERT_TRUE(decode(buffer, encoded_len, decoded_header, decoded));
+  ASSERT_EQ(decoded.size(), 2u);
+  EXPECT_NEAR(decoded[1], 10.1240, 1e-9);
+}
+
+TEST_F(RbrPressureResidualEncoderTest, Escape) {
+  // A quiet signal with a spike, the spike's residuals don't fit the quiet k
+  std::vector<double> signal(100, 12.0);
+  signal[50] = 150.0;
+  std::vector<std::vector<uint8_t>> messages = encodeWindow(signal, IRIDIUM_MESSAGE_BYTES);
+  ASSERT_EQ(messages.size(), 1u);
+  EXPECT_EQ(header.rice_k, 0);
+
+  std::vector<double> decoded;
+  rbr_pressure_residual_header_t decoded_header;
+  ASSERT_TRUE(decode(messages[0].data(), messages[0].size(), decoded_header, decoded));
+  ASSERT_EQ(decoded.size(), signal.size());
+  for (size_t i = 0; i < signal.size(); i++) {
+    EXPECT_NEAR(decoded[i], signal[i], 1e-9);
+  }
+}
+
+TEST_F(RbrPressureResidualEncoderTest, NanInWindow) {
+  std::vector<double> signal = waveSignal(200);
+  signal[0] = NAN;
+  signal[60] = NAN;
+  signal[61] = INFINITY;
+  signal[121] = -NAN;
+  signal[199] = 1e6;
+  std::vector<std::vector<uint8_t>> messages = encodeWindow(signal, IRIDIUM_MESSAGE_BYTES);
+
+  // Every good sample decodes where it was, the bad ones are the gaps between messages
+  std::vector<bool> covered(signal.size(), false);
+  for (size_t i = 0; i < messages.size(); i++) {
+    rbr_pressure_residual_header_t decoded_header;
+    std::vector<double> decoded;
+    ASSERT_TRUE(decode(messages[i].data(), messages[i].size(), decoded_header, decoded));
+    EXPECT_EQ(decoded_header.sequence_num, i);
+    EXPECT_EQ(decoded_header.total_samples, signal.size());
+    ASSERT_EQ(decoded.size(), decoded_header.num_samples);
+    for (size_t j = 0; j < decoded.size(); j++) {
+      size_t sample = decoded_header.first_sample + j;
+      ASSERT_LT(sample, signal.size());
+      EXPECT_FALSE(covered[sample]);
+      covered[sample] = true;
+      EXPECT_NEAR(decoded[j], signal[sample], RESOLUTION_DBAR / 2 + 1e-9);
+    }
+  }
+  for (size_t i = 0; i < signal.size(); i++) {
+    bool bad = (i == 0 || i == 60 || i == 61 || i == 121 || i == 199);
+    EXPECT_EQ(covered[i], !bad) << i;
+  }
+
+  // A message ends ahead of the bad sample, even when it is the second one
+  double short_run[] = {10.0, NAN, 10.2};
+  uint8_t buffer[128];
+  size_t encoded_len = 0;
+  EXPECT_TRUE(rbr_pressure_residual_encode(short_run, 3, RESOLUTION_DBAR, header, buffer,
+                                           sizeof(buffer), encoded_len));
+  EXPECT_EQ(header.num_samples, 1);
+  EXPECT_EQ(rbr_pressure_residual_skip(short_run + 1, 2, RESOLUTION_DBAR), 1u);
+}
+
+TEST_F(RbrPressureResidualEncoderTest, Rejects) {
+  double signal[] = {NAN, 10.1, 10.2, 10.3};
+  uint8_t buffer[128];
+  size_t encoded_len = 1;
+  EXPECT_FALSE(rbr_pressure_residual_encode(signal, 4, RESOLUTION_DBAR, header, buffer,
+                                            sizeof(buffer), encoded_len));
+  EXPECT_EQ(encoded_len, 0u);
+  signal[0] = 10.0;
+  EXPECT_FALSE(rbr_pressure_residual_encode(signal, 3, 0, header, buffer, sizeof(buffer),
+                                            encoded_len));
+  EXPECT_FALSE(rbr_pressure_residual_encode(signal, 0, RESOLUTION_DBAR, header, buffer,
+                                            sizeof(buffer), encoded_len));
+  EXPECT_FALSE(rbr_pressure_residual_encode(signal, 3, RESOLUTION_DBAR, header, buffer,
+                                            sizeof(header), encoded_len));
+  signal[0] = 1e6;
+  EXPECT_FALSE(rbr_pressure_residual_encode(signal, 3, RESOLUTION_DBAR, header, buffer,
+                                            sizeof(buffer), encoded_len));
+}
@@ -0,0 +1,144 @@
+#include "gtest/gtest.h"
+
+#include <math.h>
+#include <string.h>
+
+#include "reportBuilderElementTable.h"
+#include "sensor_report_schema.h"
+
+static constexpr uint32_t SAMPLES_PER_REPORT = 4;
+
+// The fixture for testing class Foo.
+class ReportBuilderElementTableTest : public ::testing::Test {
+protected:
+  // You can remove any or all of the following functions if its body
+  // is empty.
+
+  ReportBuilderElementTableTest() {
+    // You can do set-up work for each test here.
+  }
+
+  ~ReportBuilderElementTableTest() override {
+    // You can do clean-up work that doesn't throw exceptions here.
+  }
+
+  // If the constructor and destructor are not enough for setting up
+  // and cleaning up each test, you can define the following methods:
+
+  void SetUp() override {
+    // Code here will be called immediately after the constructor (right
+    // before each test).
+    table.configure(SAMPLES_PER_REPORT);
+  }
+
+  void TearDown() override {
+    // Code here will be called immediately after each test (right
+    // before the destructor).
+  }
+
+  // Objects declared here can be used by all tests in the test suite for Foo.
+  ReportBuilderElementTable table;
+};
+
+TEST_F(ReportBuilderElementTableTest, AddAndFind) {
+  soft_aggregations_t sample = {.temp_mean_deg_c = 21.5, .reading_count = 10};
+  EXPECT_EQ(table.findElement(0x1234), nullptr);
+  EXPECT_TRUE(table.addSample(0x1234, SENSOR_TYPE_SOFT, &sample, 0));
+  EXPECT_EQ(table.size(), 1u);
+
+  report_builder_element_t *element = table.findElement(0x1234);
+  ASSERT_NE(element, nullptr);
+  EXPECT_EQ(element->node_id, 0x1234u);
+  EXPECT_EQ(element->sensor_type, SENSOR_TYPE_SOFT);
+  EXPECT_EQ(element->sample_counter, 1u);
+  soft_aggregations_t *samples = static_cast<soft_aggregations_t *>(element->sensor_data);
+  EXPECT_EQ(samples[0].temp_mean_deg_c, 21.5);
+  EXPECT_EQ(table.findElement(0x1235), nullptr);
+}
+
+TEST_F(ReportBuilderElementTableTest, BackFillsMissedSamples) {
+  soft_aggregations_t sample = {.temp_mean_deg_c = 21.5, .reading_count = 10};
+  EXPECT_TRUE(table.addSample(1, SENSOR_TYPE_SOFT, &sample, 2));
+  EXPECT_TRUE(table.addSample(1, SENSOR_TYPE_SOFT, NULL, 3));
+
+  report_builder_element_t *element = table.findElement(1);
+  ASSERT_NE(element, nullptr);
+  EXPECT_EQ(element->sample_counter, SAMPLES_PER_REPORT);
+  soft_aggregations_t *samples = static_cast<soft_aggregations_t *>(element->sensor_data);
+  EXPECT_TRUE(isnan(samples[0].temp_mean_deg_c));
+  EXPECT_TRUE(isnan(samples[1].temp_mean_deg_c));
+  EXPECT_EQ(samples[2].temp_mean_deg_c, 21.5);
+  EXPECT_TRUE(isnan(samples[3].temp_mean_deg_c));
+
+  // The report is full
+  EXPECT_FALSE(table.addSample(1, SENSOR_TYPE_SOFT, &sample, 3));
+  EXPECT_FALSE(table.addSample(1, SENSOR_TYPE_SOFT, &sample, SAMPLES_PER_REPORT));
+}
+
+TEST_F(ReportBuilderElementTableTest, Rejects) {
+  soft_aggregations_t sample = {.temp_mean_deg_c = 21.5, .reading_count = 10};
+  EXPECT_FALSE(table.addSample(1, SENSOR_TYPE_UNKNOWN, &sample, 0));
+  EXPECT_FALSE(table.addSample(1, 0xFF, &sample, 0));
+  EXPECT_EQ(table.size(), 0u);
+
+  // A node can't change its sensor type within a report period
+  EXPECT_TRUE(table.addSample(1, SENSOR_TYPE_SOFT, &sample, 0));
+  EXPECT_FALSE(table.addSample(1, SENSOR_TYPE_AANDERAA, NULL, 1));
+  EXPECT_EQ(table.findElement(1)->sample_counter, 1u);
+}
+
+TEST_F(ReportBuilderElementTableTest, FullTopology) {
+  // Node ids that only differ in their high bits, to collide in the index
+  for (uint64_t i = 0; i < TOPOLOGY_SAMPLER_MAX_NODE_LIST_SIZE; i++) {
+    EXPECT_TRUE(table.addSample(i << 60, SENSOR_TYPE_SOFT, NULL, 0));
+  }
+  EXPECT_EQ(table.size(), TOPOLOGY_SAMPLER_MAX_NODE_LIST_SIZE);
+  EXPECT_FALSE(table.addSample(0xDEADBEEF, SENSOR_TYPE_SOFT, NULL, 0));
+  EXPECT_EQ(table.findElement(0xDEADBEEF), nullptr);
+
+  for (uint64_t i = 0; i < TOPOLOGY_SAMPLER_MAX_NODE_LIST_SIZE; i++) {
+    report_builder_element_t *element = table.findElement(i << 60);
+    ASSERT_NE(element, nullptr);
+    EXPECT_EQ(element->node_id, i << 60);
+  }
+}
+
+TEST_F(ReportBuilderElementTableTest, ClearKeepsSampleBuffers) {
+  aanderaa_aggregations_t aanderaa = SensorReportSchema<aanderaa_aggregations_t>::nan_sample;
+  soft_aggregations_t soft = {.temp_mean_deg_c = 21.5, .reading_count = 10};
+  EXPECT_TRUE(table.addSample(1, SENSOR_TYPE_SOFT, &soft, 0));
+  void *soft_buffer = table.findElement(1)->sensor_data;
+
+  table.clear();
+  EXPECT_EQ(table.size(), 0u);
+  EXPECT_EQ(table.findElement(1), nullptr);
+
+  // The slot is reused for the next report period's first node
+  EXPECT_TRUE(table.addSample(2, SENSOR_TYPE_SOFT, &soft, 0));
+  report_builder_element_t *element = table.findElement(2);
+  ASSERT_NE(element, nullptr);
+  EXPECT_EQ(element->sensor_data, soft_buffer);
+  EXPECT_EQ(element->sample_counter, 1u);
+
+  // and grows for a bigger sensor type
+  table.clear();
+  EXPECT_TRUE(table.addSample(3, SENSOR_TYPE_AANDERAA, &aanderaa, 0));
+  element = table.findElement(3);
+  ASSERT_NE(element, nullptr);
+  EXPECT_GE(element->sensor_data_capacity,
+            SAMPLES_PER_REPORT * sizeof(aanderaa_aggregations_t));
+}
+
+TEST_F(ReportBuilderElementTableTest, Configure) {
+  EXPECT_TRUE(table.addSample(1, SENSOR_TYPE_SOFT, NULL, SAMPLES_PER_REPORT - 1));
+  table.configure(SAMPLES_PER_REPORT);
+  EXPECT_NE(table.findElement(1), nullptr);
+
+  table.configure(SAMPLES_PER_REPORT * 2);
+  EXPECT_EQ(table.findElement(1), nullptr);
+  EXPECT_TRUE(table.addSample(1, SENSOR_TYPE_SOFT, NULL, SAMPLES_PER_REPORT * 2 - 1));
+  EXPECT_EQ(table.findElement(1)->sample_counter, SAMPLES_PER_REPORT * 2);
+
+  table.configure(0);
+  EXPECT_FALSE(table.addSample(1, SENSOR_TYPE_SOFT, NULL, 0));
+}
@@ -0,0 +1,237 @@
+#include "gtest/gtest.h"
+
+#include <string.h>
+
+#include "sensor_report_schema.h"
+
+//
+// The per member callbacks reportBuilder used to encode samples with, the schema
+// has to produce the same bytes.
+//
+static CborError encode_double_sample_member(CborEncoder &sample_array, void *sample_member) {
+  return cbor_encode_double(&sample_array, *(double *)sample_member);
+}
+
+static CborError encode_uint_sample_member(CborEncoder &sample_array, void *sample_member) {
+  return cbor_encode_uint(&sample_array, *(uint32_t *)sample_member);
+}
+
+typedef struct {
+  sample_encoder_cb cb;
+  void *member;
+} legacy_member_t;
+
+static CborError legacyEncodeMembers(sensor_report_encoder_context_t &context,
+                                     const char *sample_type, const legacy_member_t *members,
+                                     size_t num_members) {
+  CborError err = sensor_report_encoder_open_sample(context, num_members, sample_type);
+  for (size_t i = 0; i < num_members && err == CborNoError; i++) {
+    err = sensor_report_encoder_add_sample_member(context, members[i].cb, members[i].member);
+  }
+  if (err == CborNoError) {
+    err = sensor_report_encoder_close_sample(context);
+  }
+  return err;
+}
+
+static CborError legacyEncode(sensor_report_encoder_context_t &context,
+                              aanderaa_aggregations_t sample) {
+  legacy_member_t members[] = {
+      {encode_double_sample_member, &sample.abs_speed_mean_cm_s},
+      {encode_double_sample_member, &sample.abs_speed_std_cm_s},
+      {encode_double_sample_member, &sample.direction_circ_mean_rad},
+      {encode_double_sample_member, &sample.direction_circ_std_rad},
+      {encode_double_sample_member, &sample.temp_mean_deg_c},
+      {encode_double_sample_member, &sample.abs_tilt_mean_rad},
+      {encode_double_sample_member, &sample.std_tilt_mean_rad},
+      {encode_uint_sample_member, &sample.reading_count},
+  };
+  return legacyEncodeMembers(context, "aanderaa_current_v0", members,
+                             AANDERAA_NUM_SAMPLE_MEMBERS);
+}
+
+static CborError legacyEncode(sensor_report_encoder_context_t &context,
+                              soft_aggregations_t sample) {
+  legacy_member_t members[] = {{encode_double_sample_member, &sample.temp_mean_deg_c}};
+  return legacyEncodeMembers(context, "bm_soft_temp_v0", members, SOFT_NUM_SAMPLE_MEMBERS);
+}
+
+static CborError legacyEncode(sensor_report_encoder_context_t &context,
+                              rbr_coda_aggregations_t sample) {
+  const char *sample_type = "bm_rbr_unknown";
+  if (sample.sensor_type == BmRbrDataMsg::SensorType::TEMPERATURE) {
+    sample_type = "bm_rbr_t_v0";
+  } else if (sample.sensor_type == BmRbrDataMsg::SensorType::PRESSURE) {
+    sample_type = "bm_rbr_d_v0";
+  } else if (sample.sensor_type == BmRbrDataMsg::SensorType::PRESSURE_AND_TEMPERATURE) {
+    sample_type = "bm_rbr_td_v0";
+  }
+  legacy_member_t members[] = {
+      {encode_double_sample_member, &sample.temp_mean_deg_c},
+      {encode_double_sample_member, &sample.pressure_mean_deci_bar},
+      {encode_double_sample_member, &sample.pressure_stdev_deci_bar},
+  };
+  return legacyEncodeMembers(context, sample_type, members, RBR_CODA_NUM_SAMPLE_MEMBERS);
+}
+
+static CborError legacyEncode(sensor_report_encoder_context_t &context,
+                              seapoint_turbidity_aggregations_t sample) {
+  legacy_member_t members[] = {
+      {encode_double_sample_member, &sample.turbidity_s_mean_ftu},
+      {encode_double_sample_member, &sample.turbidity_r_mean_ftu},
+  };
+  return legacyEncodeMembers(context, "bm_seapoint_turbidity_v0", members,
+                             SEAPOINT_TURBIDITY_NUM_SAMPLE_MEMBERS);
+}
+
+// The fixture for testing class Foo.
+class SensorReportSchemaTest : public ::testing::Test {
+protected:
+  // You can remove any or all of the following functions if its body
+  // is empty.
+
+  SensorReportSchemaTest() {
+    // You can do set-up work for each test here.
+  }
+
+  ~SensorReportSchemaTest() override {
+    // You can do clean-up work that doesn't throw exceptions here.
+  }
+
+  // If the constructor and destructor are not enough for setting up
+  // and cleaning up each test, you can define the following methods:
+
+  void SetUp() override {
+    // Code here will be called immediately after the constructor (right
+    // before each test).
+    memset(schema_buf, 0xAA, sizeof(schema_buf));
+    memset(legacy_buf, 0x55, sizeof(legacy_buf));
+  }
+
+  void TearDown() override {
+    // Code here will be called immediately after each test (right
+    // before the destructor).
+  }
+
+  // Encodes a one sensor report of samples both ways and checks the bytes match
+  template <typename T> void expectSameReport(const T *samples, size_t num_samples) {
+    sensor_report_encoder_context_t schema_ctx, legacy_ctx;
+    ASSERT_EQ(sensor_report_encoder_open_report(schema_buf, sizeof(schema_buf), 1, schema_ctx),
+              CborNoError);
+    ASSERT_EQ(sensor_report_encoder_open_report(legacy_buf, sizeof(legacy_buf), 1, legacy_ctx),
+              CborNoError);
+    ASSERT_EQ(sensor_report_encoder_open_sensor(schema_ctx, num_samples), CborNoError);
+    ASSERT_EQ(sensor_report_encoder_open_sensor(legacy_ctx, num_samples), CborNoError);
+    for (size_t i = 0; i < num_samples; i++) {
+      EXPECT_EQ(sensor_report_encode_sample(schema_ctx, samples[i]), CborNoError);
+      EXPECT_EQ(legacyEncode(legacy_ctx, samples[i]), CborNoError);
+    }
+    ASSERT_EQ(sensor_report_encoder_close_sensor(schema_ctx), CborNoError);
+    ASSERT_EQ(sensor_report_encoder_close_sensor(legacy_ctx), CborNoError);
+    ASSERT_EQ(sensor_report_encoder_close_report(schema_ctx), CborNoError);
+    ASSERT_EQ(sensor_report_encoder_close_report(legacy_ctx), CborNoError);
+
+    size_t len = sensor_report_encoder_get_report_size_bytes(schema_ctx);
+    EXPECT_EQ(len, sensor_report_encoder_get_report_size_bytes(legacy_ctx));
+    EXPECT_EQ(memcmp(schema_buf, legacy_buf, len), 0);
+  }
+
+  // Objects declared here can be used by all tests in the test suite for Foo.
+  uint8_t schema_buf[1024];
+  uint8_t legacy_buf[1024];
+};
+
+TEST_F(SensorReportSchemaTest, Aanderaa) {
+  aanderaa_aggregations_t samples[] = {
+      {.abs_speed_mean_cm_s = 12.5,
+       .abs_speed_std_cm_s = 0.25,
+       .direction_circ_mean_rad = 3.1,
+       .direction_circ_std_rad = 0.01,
+       .temp_mean_deg_c = 18.75,
+       .abs_tilt_mean_rad = 0.1,
+       .std_tilt_mean_rad = 0.002,
+       .reading_count = 59},
+      SensorReportSchema<aanderaa_aggregations_t>::nan_sample,
+      {.abs_speed_mean_cm_s = -1.0,
+       .abs_speed_std_cm_s = 1e-300,
+       .direction_circ_mean_rad = INFINITY,
+       .direction_circ_std_rad = 0,
+       .temp_mean_deg_c = -2.5,
+       .abs_tilt_mean_rad = 6.28,
+       .std_tilt_mean_rad = 0.5,
+       .reading_count = 0x10000},
+  };
+  expectSameReport(samples, sizeof(samples) / sizeof(samples[0]));
+}
+
+TEST_F(SensorReportSchemaTest, Soft) {
+  soft_aggregations_t samples[] = {
+      {.temp_mean_deg_c = 21.125, .reading_count = 240},
+      SensorReportSchema<soft_aggregations_t>::nan_sample,
+  };
+  expectSameReport(samples, sizeof(samples) / sizeof(samples[0]));
+}
+
+TEST_F(SensorReportSchemaTest, RbrCoda) {
+  rbr_coda_aggregations_t samples[] = {
+      {.temp_mean_deg_c = 4.5,
+       .pressure_mean_deci_bar = NAN,
+       .pressure_stdev_deci_bar = NAN,
+       .reading_count = 10,
+       .sensor_type = BmRbrDataMsg::SensorType::TEMPERATURE},
+      {.temp_mean_deg_c = NAN,
+       .pressure_mean_deci_bar = 101.3,
+       .pressure_stdev_deci_bar = 0.2,
+       .reading_count = 11,
+       .sensor_type = BmRbrDataMsg::SensorType::PRESSURE},
+      {.temp_mean_deg_c = 4.75,
+       .pressure_mean_deci_bar = 99.9,
+       .pressure_stdev_deci_bar = 0.4,
+       .reading_count = 12,
+       .sensor_type = BmRbrDataMsg::SensorType::PRESSURE_AND_TEMPERATURE},
+      SensorReportSchema<rbr_coda_aggregations_t>::nan_sample,
+  };
+  expectSameReport(samples, sizeof(samples) / sizeof(samples[0]));
+}
+
+TEST_F(SensorReportSchemaTest, RbrCodaInvalidType) {
+  rbr_coda_aggregations_t sample = SensorReportSchema<rbr_coda_aggregations_t>::nan_sample;
+  sample.sensor_type = static_cast<BmRbrDataMsg::SensorType_t>(0x7F);
+  sensor_report_encoder_context_t context;
+  ASSERT_EQ(sensor_report_encoder_open_report(schema_buf, sizeof(schema_buf), 1, context),
+            CborNoError);
+  ASSERT_EQ(sensor_report_encoder_open_sensor(context, 1), CborNoError);
+  EXPECT_EQ(sensor_report_encode_sample(context, sample), CborErrorImproperValue);
+}
+
+TEST_F(SensorReportSchemaTest, SeapointTurbidity) {
+  seapoint_turbidity_aggregations_t samples[] = {
+      {.turbidity_s_mean_ftu = 1.5, .turbidity_r_mean_ftu = 2.25, .reading_count = 120},
+      SensorReportSchema<seapoint_turbidity_aggregations_t>::nan_sample,
+  };
+  expectSameReport(samples, sizeof(samples) / sizeof(samples[0]));
+}
+
+TEST_F(SensorReportSchemaTest, BufferTooSmall) {
+  aanderaa_aggregations_t sample = SensorReportSchema<aanderaa_aggregations_t>::nan_sample;
+  sensor_report_encoder_context_t context;
+  // Room for the containers and sample type, but not all of the members
+  ASSERT_EQ(sensor_report_encoder_open_report(schema_buf, 40, 1, context), CborNoError);
+  ASSERT_EQ(sensor_report_encoder_open_sensor(context, 1), CborNoError);
+  EXPECT_EQ(sensor_report_encode_sample(context, sample), CborErrorOutOfMemory);
+}
+
+TEST_F(SensorReportSchemaTest, Visit) {
+  EXPECT_EQ(sensor_report_schema_sample_size(SENSOR_TYPE_AANDERAA),
+            sizeof(aanderaa_aggregations_t));
+  EXPECT_EQ(sensor_report_schema_sample_size(SENSOR_TYPE_SOFT), sizeof(soft_aggregations_t));
+  EXPECT_EQ(sensor_report_schema_sample_size(SENSOR_TYPE_RBR_CODA),
+            sizeof(rbr_coda_aggregations_t));
+  EXPECT_EQ(sensor_report_schema_sample_size(SENSOR_TYPE_SEAPOINT_TURBIDITY),
+            sizeof(seapoint_turbidity_aggregations_t));
+  EXPECT_EQ(sensor_report_schema_sample_size(SENSOR_TYPE_UNKNOWN), 0u);
+
+  bool called = false;
+  EXPECT_FALSE(sensor_report_schema_visit(0xFF, [&called](auto) { called = true; }));
+  EXPECT_FALSE(called);
+}
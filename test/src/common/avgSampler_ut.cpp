@@ -1,6 +1,7 @@
 #include "gtest/gtest.h"
 
 #include "avgSampler.h"
+#include <inttypes.h>
 #include "util.h"
 
 // The fixture for testing class Foo.
@@ -229,3 +230,89 @@ TEST_F(AvgSamplerTest, circ_mean_is_positive) {
 
   EXPECT_NEAR(sampler.getCircularMean(), 4.1542, 0.0001);
 }
+
+TEST_F(AvgSamplerTest, streaming) {
+  AveragingSampler sampler;
+  sampler.initStreaming();
+  EXPECT_EQ(sampler.getMaxSamples(), 0);
+  EXPECT_TRUE(isnan(sampler.getMean()));
+  EXPECT_TRUE(isnan(sampler.getVariance()));
+  EXPECT_TRUE(isnan(sampler.getMin()));
+  EXPECT_TRUE(isnan(sampler.getMax()));
+
+  // More samples than a buffer would have held, streaming keeps all of them
+  double samples[] = {0, 0, 0, 0, 2, 2, 4, 4};
+  const uint32_t num_samples = sizeof(samples) / sizeof(double);
+  for (uint32_t sample = 0; sample < num_samples; sample++) {
+    EXPECT_TRUE(sampler.addSampleTimestamped(samples[sample], (sample + 1)));
+  }
+  EXPECT_FALSE(sampler.addSampleTimestamped(1000.0, num_samples));
+  EXPECT_EQ(sampler.getNumSamples(), num_samples);
+  EXPECT_DOUBLE_EQ(sampler.getMean(), 1.5);
+  EXPECT_DOUBLE_EQ(sampler.getVariance(), 2.75);
+  EXPECT_DOUBLE_EQ(sampler.getStd(), sqrt(2.75));
+  // Variance around a mean the caller passes in, like the buffered sampler
+  EXPECT_DOUBLE_EQ(sampler.getVariance(2.0), 3.0);
+  EXPECT_DOUBLE_EQ(sampler.getMax(), 4.0);
+  EXPECT_DOUBLE_EQ(sampler.getMin(), 0.0);
+
+  sampler.clear();
+  EXPECT_EQ(sampler.getNumSamples(), 0);
+  EXPECT_TRUE(isnan(sampler.getMean()));
+  EXPECT_TRUE(sampler.addSampleTimestamped(10.0));
+  EXPECT_TRUE(sampler.addSampleTimestamped(20.0));
+  EXPECT_DOUBLE_EQ(sampler.getMean(), 15.0);
+  EXPECT_DOUBLE_EQ(sampler.getMin(), 10.0);
+}
+
+//
+// The streaming statistics have to agree with the ones computed from a buffer of the same
+// samples, over aggregation periods as long as an hour of 1Hz readings.
+//
+TEST_F(AvgSamplerTest, streaming_matches_buffer) {
+  const uint32_t num_samples = 3600;
+  AveragingSampler buffered, streamed, buffered_dir, streamed_dir;
+  buffered.initBuffer(num_samples);
+  streamed.initStreaming();
+  buffered_dir.initBuffer(num_samples);
+  streamed_dir.initStreaming();
+
+  // Barometer readings around 1019.6 with a slow drift, directions wrapping around north
+  srand(42);
+  for (uint32_t i = 0; i < num_samples; i++) {
+    double noise = (rand() / (double)RAND_MAX) - 0.5;
+    double pressure = 1019.6 + 0.05 * noise + i * 1e-5;
+    double direction = fmod(degToRad(350.0 + 40.0 * noise) + 2 * M_PI, 2 * M_PI);
+    EXPECT_TRUE(buffered.addSample(pressure));
+    EXPECT_TRUE(streamed.addSample(pressure));
+    EXPECT_TRUE(buffered_dir.addSample(direction));
+    EXPECT_TRUE(streamed_dir.addSample(direction));
+  }
+
+  EXPECT_EQ(streamed.getNumSamples(), buffered.getNumSamples());
+  EXPECT_NEAR(streamed.getMean(), buffered.getMean(true), 1e-10);
+  EXPECT_NEAR(streamed.getVariance(), buffered.getVariance(0.0, true), 1e-12);
+  EXPECT_NEAR(streamed.getStd(), buffered.getStd(0.0, 0.0, true), 1e-10);
+  double mean = buffered.getMean(true);
+  EXPECT_NEAR(streamed.getStd(mean, 0.0, true), buffered.getStd(mean, 0.0, true), 1e-10);
+  EXPECT_DOUBLE_EQ(streamed.getMax(), buffered.getMax());
+  EXPECT_DOUBLE_EQ(streamed.getMin(), buffered.getMin());
+  EXPECT_NEAR(streamed_dir.getCircularMean(), buffered_dir.getCircularMean(), 1e-10);
+  EXPECT_NEAR(streamed_dir.getCircularStd(), buffered_dir.getCircularStd(), 1e-10);
+}
+
+TEST_F(AvgSamplerTest, streaming_memory) {
+  // One reading a second, the buffer also has the 10 samples of padding the drivers add
+  const uint32_t windows_min[] = {15, 30, 60};
+  for (uint32_t window_min : windows_min) {
+    uint32_t max_samples = window_min * 60 + 10;
+    AveragingSampler buffered, streamed;
+    buffered.initBuffer(max_samples);
+    streamed.initStreaming();
+    size_t buffered_bytes = sizeof(buffered) + max_samples * sizeof(double);
+    size_t streamed_bytes = sizeof(streamed);
+    printf("%2" PRIu32 " min window: buffered %6zu bytes, streaming %3zu bytes per sampler\n",
+           window_min, buffered_bytes, streamed_bytes);
+    EXPECT_LT(streamed_bytes * 50, buffered_bytes);
+  }
+}
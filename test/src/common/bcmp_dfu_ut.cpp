@@ -1,8 +1,16 @@
 #include "gtest/gtest.h"
 
+#include <algorithm>
+#include <vector>
+
 #include "bm_dfu.h"
+#include "bm_dfu_client.h"
+#include "bm_dfu_delta.h"
+#include "bm_dfu_lz.h"
+#include "crc.h"
 #include "fff.h"
 #include "mock_device_info.h"
+#include "mock_mcu_boot.h"
 #include "nvmPartition.h"
 #include "mock_storage_driver.h"
 #include "flash_map_backend.h"
@@ -1201,3 +1209,1055 @@ TEST_F(BcmpDfuTest, ClientConfirmSkip) {
     testConfig->getConfig("dfu_confirm", sizeof("dfu_confirm"), confirm_val);
     EXPECT_EQ(confirm_val, 1);
 }
+
+// Frames captured from the DFU tx function for the windowed transfer tests.
+static std::vector<std::vector<uint8_t>> captured_frames;
+
+static bool capture_bcmp_tx_func(bcmp_message_type_t type, uint8_t *buf, uint16_t len) {
+    (void) type;
+    captured_frames.push_back(std::vector<uint8_t>(buf, buf + len));
+    return true;
+}
+
+TEST_F(BcmpDfuTest, clientWindowedReorder) {
+    getGitSHA_fake.return_val = 0xbaaddaad;
+    bm_dfu_test_set_client_fa(&fa);
+    fake_bcmp_tx_func_fake.custom_fake = capture_bcmp_tx_func;
+    captured_frames.clear();
+
+    // INIT SUCCESS
+    bm_dfu_init(fake_bcmp_tx_func, testPartition, testConfig);
+    bm_dfu_client_set_max_window_size(4);
+    libSmContext_t* ctx = bm_dfu_test_get_sm_ctx();
+    bm_dfu_event_t evt = {
+        .type = DFU_EVENT_INIT_SUCCESS,
+        .buf = NULL,
+        .len = 0,
+    };
+    bm_dfu_test_set_dfu_event_and_run_sm(evt);
+    EXPECT_EQ(getCurrentStateEnum(*ctx), BM_DFU_STATE_IDLE);
+
+    // DFU REQUEST from a host that supports windowed transfers
+    evt.type = DFU_EVENT_RECEIVED_UPDATE_REQUEST;
+    evt.buf = (uint8_t*)malloc(sizeof(bcmp_dfu_start_ext_t));
+    evt.len = sizeof(bcmp_dfu_start_ext_t);
+    bcmp_dfu_start_ext_t dfu_start_msg;
+    dfu_start_msg.start.header.frame_type = BCMP_DFU_START;
+    dfu_start_msg.start.info.addresses.src_node_id = 0xbeefbeefdaadbaad;
+    dfu_start_msg.start.info.addresses.dst_node_id = 0xdeadbeefbeeffeed;
+    dfu_start_msg.start.info.img_info.image_size = IMAGE_SIZE;
+    dfu_start_msg.start.info.img_info.chunk_size = CHUNK_SIZE;
+    dfu_start_msg.start.info.img_info.crc16 = 0x2fDf;
+    dfu_start_msg.start.info.img_info.major_ver = 1;
+    dfu_start_msg.start.info.img_info.minor_ver = 7;
+    dfu_start_msg.start.info.img_info.gitSHA = 0xdeadd00d;
+    dfu_start_msg.start.info.img_info.filter_key = 0;
+    dfu_start_msg.max_window_size = BM_DFU_MAX_WINDOW_SIZE;
+    dfu_start_msg.flags = 0;
+    memcpy(evt.buf, &dfu_start_msg, sizeof(dfu_start_msg));
+    bm_dfu_test_set_dfu_event_and_run_sm(evt);
+    EXPECT_EQ(getCurrentStateEnum(*ctx), BM_DFU_STATE_CLIENT_RECEIVING);
+    EXPECT_EQ(fake_bcmp_tx_func_fake.arg0_history[0], BCMP_DFU_ACK);
+    EXPECT_EQ(fake_bcmp_tx_func_fake.arg0_val, BCMP_DFU_WINDOW_REQ);
+    bcmp_dfu_window_req_t *window_req = reinterpret_cast<bcmp_dfu_window_req_t *>(captured_frames.back().data());
+    EXPECT_EQ(window_req->window_req.seq_num, 0);
+    EXPECT_EQ(window_req->window_req.window_size, 4);
+    EXPECT_EQ(window_req->window_req.received_mask, 0);
+
+    // Deliver chunks 0, 2, 3, 1
+    const uint16_t order[] = {0, 2, 3, 1};
+    for (uint16_t seq_num : order) {
+        evt.type = DFU_EVENT_WINDOW_CHUNK;
+        evt.len = sizeof(bcmp_dfu_window_payload_t) + CHUNK_SIZE;
+        evt.buf = (uint8_t*)malloc(evt.len);
+        bcmp_dfu_window_payload_t dfu_payload_msg;
+        dfu_payload_msg.header.frame_type = BCMP_DFU_WINDOW_PAYLOAD;
+        dfu_payload_msg.chunk.addresses.src_node_id = 0xbeefbeefdaadbaad;
+        dfu_payload_msg.chunk.addresses.dst_node_id = 0xdeadbeefbeeffeed;
+        dfu_payload_msg.chunk.seq_num = seq_num;
+        dfu_payload_msg.chunk.payload_length = CHUNK_SIZE;
+        memcpy(evt.buf, &dfu_payload_msg, sizeof(dfu_payload_msg));
+        memset(evt.buf + sizeof(dfu_payload_msg), 0xa5, CHUNK_SIZE);
+        size_t frames_before = captured_frames.size();
+        bm_dfu_test_set_dfu_event_and_run_sm(evt);
+
+        if (seq_num == 2) {
+            // Gap detected, chunk 1 should be NACK'd
+            ASSERT_EQ(captured_frames.size(), frames_before + 1);
+            window_req = reinterpret_cast<bcmp_dfu_window_req_t *>(captured_frames.back().data());
+            EXPECT_EQ(window_req->header.frame_type, BCMP_DFU_WINDOW_REQ);
+            EXPECT_EQ(window_req->window_req.seq_num, 1);
+            EXPECT_EQ(window_req->window_req.window_size, 1);
+        } else if (seq_num == 3) {
+            // Same gap, no additional NACK
+            EXPECT_EQ(captured_frames.size(), frames_before);
+        }
+        if (seq_num != 1) {
+            EXPECT_EQ(getCurrentStateEnum(*ctx), BM_DFU_STATE_CLIENT_RECEIVING);
+        }
+    }
+    EXPECT_EQ(getCurrentStateEnum(*ctx), BM_DFU_STATE_CLIENT_VALIDATING);
+
+    // Validating, the image must have been reassembled in order for the CRC to match.
+    evt.type = DFU_EVENT_NONE;
+    evt.buf = NULL;
+    evt.len = 0;
+    bm_dfu_test_set_dfu_event_and_run_sm(evt);
+    EXPECT_EQ(getCurrentStateEnum(*ctx), BM_DFU_STATE_CLIENT_REBOOT_REQ);
+    EXPECT_EQ(fake_bcmp_tx_func_fake.arg0_val, BCMP_DFU_REBOOT_REQ);
+}
+
+TEST_F(BcmpDfuTest, clientWindowedTimeoutNack) {
+    getGitSHA_fake.return_val = 0xbaaddaad;
+    bm_dfu_test_set_client_fa(&fa);
+    fake_bcmp_tx_func_fake.custom_fake = capture_bcmp_tx_func;
+    captured_frames.clear();
+
+    bm_dfu_init(fake_bcmp_tx_func, testPartition, testConfig);
+    libSmContext_t* ctx = bm_dfu_test_get_sm_ctx();
+    bm_dfu_event_t evt = {
+        .type = DFU_EVENT_INIT_SUCCESS,
+        .buf = NULL,
+        .len = 0,
+    };
+    bm_dfu_test_set_dfu_event_and_run_sm(evt);
+
+    evt.type = DFU_EVENT_RECEIVED_UPDATE_REQUEST;
+    evt.buf = (uint8_t*)malloc(sizeof(bcmp_dfu_start_ext_t));
+    evt.len = sizeof(bcmp_dfu_start_ext_t);
+    bcmp_dfu_start_ext_t dfu_start_msg;
+    dfu_start_msg.start.header.frame_type = BCMP_DFU_START;
+    dfu_start_msg.start.info.addresses.src_node_id = 0xbeefbeefdaadbaad;
+    dfu_start_msg.start.info.addresses.dst_node_id = 0xdeadbeefbeeffeed;
+    dfu_start_msg.start.info.img_info.image_size = IMAGE_SIZE;
+    dfu_start_msg.start.info.img_info.chunk_size = CHUNK_SIZE;
+    dfu_start_msg.start.info.img_info.crc16 = 0x2fDf;
+    dfu_start_msg.start.info.img_info.major_ver = 1;
+    dfu_start_msg.start.info.img_info.minor_ver = 7;
+    dfu_start_msg.start.info.img_info.gitSHA = 0xdeadd00d;
+    dfu_start_msg.start.info.img_info.filter_key = 0;
+    dfu_start_msg.max_window_size = 4;
+    dfu_start_msg.flags = 0;
+    memcpy(evt.buf, &dfu_start_msg, sizeof(dfu_start_msg));
+    bm_dfu_test_set_dfu_event_and_run_sm(evt);
+    EXPECT_EQ(getCurrentStateEnum(*ctx), BM_DFU_STATE_CLIENT_RECEIVING);
+
+    // Only chunk 2 makes it through, then the chunk timer expires
+    evt.type = DFU_EVENT_WINDOW_CHUNK;
+    evt.len = sizeof(bcmp_dfu_window_payload_t) + CHUNK_SIZE;
+    evt.buf = (uint8_t*)malloc(evt.len);
+    bcmp_dfu_window_payload_t dfu_payload_msg;
+    dfu_payload_msg.header.frame_type = BCMP_DFU_WINDOW_PAYLOAD;
+    dfu_payload_msg.chunk.addresses.src_node_id = 0xbeefbeefdaadbaad;
+    dfu_payload_msg.chunk.addresses.dst_node_id = 0xdeadbeefbeeffeed;
+    dfu_payload_msg.chunk.seq_num = 2;
+    dfu_payload_msg.chunk.payload_length = CHUNK_SIZE;
+    memcpy(evt.buf, &dfu_payload_msg, sizeof(dfu_payload_msg));
+    memset(evt.buf + sizeof(dfu_payload_msg), 0xa5, CHUNK_SIZE);
+    bm_dfu_test_set_dfu_event_and_run_sm(evt);
+
+    evt.type = DFU_EVENT_CHUNK_TIMEOUT;
+    evt.buf = NULL;
+    evt.len = 0;
+    bm_dfu_test_set_dfu_event_and_run_sm(evt);
+    EXPECT_EQ(getCurrentStateEnum(*ctx), BM_DFU_STATE_CLIENT_RECEIVING);
+
+    // Everything outstanding is re-requested except the chunk we already hold
+    bcmp_dfu_window_req_t *window_req = reinterpret_cast<bcmp_dfu_window_req_t *>(captured_frames.back().data());
+    EXPECT_EQ(window_req->header.frame_type, BCMP_DFU_WINDOW_REQ);
+    EXPECT_EQ(window_req->window_req.seq_num, 0);
+    EXPECT_EQ(window_req->window_req.window_size, 4);
+    EXPECT_EQ(window_req->window_req.received_mask, 0x0004);
+
+    // Give up after max retries
+    for (int i = 1; i < BM_DFU_MAX_CHUNK_RETRIES; i++) {
+        bm_dfu_test_set_dfu_event_and_run_sm(evt);
+    }
+    EXPECT_EQ(getCurrentStateEnum(*ctx), BM_DFU_STATE_ERROR);
+}
+
+TEST_F(BcmpDfuTest, hostWindowedSend) {
+    fake_bcmp_tx_func_fake.custom_fake = capture_bcmp_tx_func;
+    captured_frames.clear();
+
+    // INIT SUCCESS
+    bm_dfu_init(fake_bcmp_tx_func, testPartition, testConfig);
+    libSmContext_t* ctx = bm_dfu_test_get_sm_ctx();
+    bm_dfu_event_t evt = {
+        .type = DFU_EVENT_INIT_SUCCESS,
+        .buf = NULL,
+        .len = 0,
+    };
+    bm_dfu_test_set_dfu_event_and_run_sm(evt);
+    EXPECT_EQ(getCurrentStateEnum(*ctx), BM_DFU_STATE_IDLE);
+
+    // HOST REQUEST
+    evt.type = DFU_EVENT_BEGIN_HOST;
+    evt.buf = (uint8_t*)malloc(sizeof(dfu_host_start_event_t));
+    evt.len = sizeof(dfu_host_start_event_t);
+    dfu_host_start_event_t dfu_start_msg;
+    dfu_start_msg.start.header.frame_type = BCMP_DFU_START;
+    dfu_start_msg.start.info.addresses.src_node_id = 0xdeadbeefbeeffeed;
+    dfu_start_msg.start.info.addresses.dst_node_id = 0xbeefbeefdaadbaad;
+    dfu_start_msg.start.info.img_info.image_size = IMAGE_SIZE;
+    dfu_start_msg.start.info.img_info.chunk_size = CHUNK_SIZE;
+    dfu_start_msg.start.info.img_info.crc16 = 0x2fDf;
+    dfu_start_msg.start.info.img_info.major_ver = 1;
+    dfu_start_msg.start.info.img_info.minor_ver = 7;
+    dfu_start_msg.timeoutMs = 30000;
+    dfu_start_msg.finish_cb = NULL;
+    dfu_start_msg.start.info.img_info.gitSHA = 0xdeadd00d;
+    memcpy(evt.buf, &dfu_start_msg, sizeof(dfu_start_msg));
+    bm_dfu_test_set_dfu_event_and_run_sm(evt);
+    EXPECT_EQ(getCurrentStateEnum(*ctx), BM_DFU_STATE_HOST_REQ_UPDATE);
+
+    // The update request advertises the host's window size
+    ASSERT_EQ(captured_frames.back().size(), sizeof(bcmp_dfu_start_ext_t));
+    bcmp_dfu_start_ext_t *start = reinterpret_cast<bcmp_dfu_start_ext_t *>(captured_frames.back().data());
+    EXPECT_EQ(start->start.header.frame_type, BCMP_DFU_START);
+    EXPECT_EQ(start->max_window_size, BM_DFU_MAX_WINDOW_SIZE);
+
+    // HOST UPDATE
+    evt.type = DFU_EVENT_ACK_RECEIVED;
+    evt.buf = (uint8_t*)malloc(sizeof(bcmp_dfu_ack_t));
+    evt.len = sizeof(bcmp_dfu_ack_t);
+    bcmp_dfu_ack_t dfu_ack_msg;
+    dfu_ack_msg.header.frame_type = BCMP_DFU_ACK;
+    dfu_ack_msg.ack.addresses.dst_node_id = 0xdeadbeefbeeffeed;
+    dfu_ack_msg.ack.addresses.src_node_id = 0xbeefbeefdaadbaad;
+    dfu_ack_msg.ack.err_code = BM_DFU_ERR_NONE;
+    dfu_ack_msg.ack.success = 1;
+    memcpy(evt.buf, &dfu_ack_msg, sizeof(bcmp_dfu_ack_t));
+    bm_dfu_test_set_dfu_event_and_run_sm(evt);
+    EXPECT_EQ(getCurrentStateEnum(*ctx), BM_DFU_STATE_HOST_UPDATE);
+
+    // WINDOW REQUEST, client already holds chunk 1 and the window runs past the end of the image
+    captured_frames.clear();
+    evt.type = DFU_EVENT_WINDOW_REQUEST;
+    evt.buf = (uint8_t*)malloc(sizeof(bcmp_dfu_window_req_t));
+    evt.len = sizeof(bcmp_dfu_window_req_t);
+    bcmp_dfu_window_req_t dfu_window_req_msg;
+    dfu_window_req_msg.header.frame_type = BCMP_DFU_WINDOW_REQ;
+    dfu_window_req_msg.window_req.addresses.dst_node_id = 0xdeadbeefbeeffeed;
+    dfu_window_req_msg.window_req.addresses.src_node_id = 0xbeefbeefdaadbaad;
+    dfu_window_req_msg.window_req.seq_num = 0;
+    dfu_window_req_msg.window_req.window_size = 8;
+    dfu_window_req_msg.window_req.received_mask = 0x0002;
+    memcpy(evt.buf, &dfu_window_req_msg, sizeof(dfu_window_req_msg));
+    bm_dfu_test_set_dfu_event_and_run_sm(evt);
+    EXPECT_EQ(getCurrentStateEnum(*ctx), BM_DFU_STATE_HOST_UPDATE);
+
+    ASSERT_EQ(captured_frames.size(), 3u);
+    const uint16_t expected_seq_nums[] = {0, 2, 3};
+    for (size_t i = 0; i < captured_frames.size(); i++) {
+        bcmp_dfu_window_payload_t *payload = reinterpret_cast<bcmp_dfu_window_payload_t *>(captured_frames[i].data());
+        EXPECT_EQ(payload->header.frame_type, BCMP_DFU_WINDOW_PAYLOAD);
+        EXPECT_EQ(payload->chunk.seq_num, expected_seq_nums[i]);
+        EXPECT_EQ(payload->chunk.payload_length, CHUNK_SIZE);
+        EXPECT_EQ(captured_frames[i].size(), sizeof(bcmp_dfu_window_payload_t) + CHUNK_SIZE);
+    }
+}
+
+/*
+ * Windowed transfer simulation
+ *
+ * The test plays the host at the far end of a string of store-and-forward hops while the real
+ * client state machine runs against it. Time is simulated, so the reported throughput reflects
+ * the protocol (round trips, window, retransmissions) rather than the speed of the test machine.
+ */
+static constexpr uint32_t SIM_HOPS = 10;
+static constexpr double SIM_LINK_BITS_PER_MS = 10e6 / 1000.0; // 10BASE-T1L
+static constexpr double SIM_HOP_PROCESSING_MS = 2.0; // SPI + L2 + lwIP + BCMP task per hop
+static constexpr uint32_t SIM_FRAME_OVERHEAD_BYTES = 26 + 40 + sizeof(bcmp_header_t); // Ethernet + IPv6 + BCMP
+static constexpr uint32_t SIM_CHUNK_SIZE = BM_DFU_MAX_CHUNK_SIZE;
+static constexpr uint32_t SIM_IMAGE_SIZE = 96 * 1024 + 100;
+
+typedef struct {
+    double arrival_ms;
+    bool to_client;
+    std::vector<uint8_t> frame;
+} sim_frame_t;
+
+static std::vector<sim_frame_t> sim_in_flight;
+static std::vector<uint8_t> sim_image;
+static double sim_now_ms;
+static double sim_host_tx_free_ms;
+static double sim_loss_rate;
+static uint32_t sim_rng_state;
+static bool sim_timer_armed;
+static double sim_timer_deadline_ms;
+static uint32_t sim_frames_sent;
+
+static double sim_frame_time_ms(size_t len) {
+    return ((len + SIM_FRAME_OVERHEAD_BYTES) * 8) / SIM_LINK_BITS_PER_MS;
+}
+
+static double sim_one_way_latency_ms(size_t len) {
+    return SIM_HOPS * (sim_frame_time_ms(len) + SIM_HOP_PROCESSING_MS);
+}
+
+static bool sim_frame_lost(void) {
+    sim_rng_state = sim_rng_state * 1103515245 + 12345;
+    return ((sim_rng_state >> 8) & 0xFFFF) < (sim_loss_rate * 0x10000);
+}
+
+static void sim_send(bool to_client, double tx_start_ms, const uint8_t *buf, size_t len) {
+    sim_frames_sent++;
+    if (sim_frame_lost()) {
+        return;
+    }
+    sim_in_flight.push_back({tx_start_ms + sim_one_way_latency_ms(len), to_client, std::vector<uint8_t>(buf, buf + len)});
+}
+
+static bool sim_client_tx(bcmp_message_type_t type, uint8_t *buf, uint16_t len) {
+    (void) type;
+    sim_send(false, sim_now_ms, buf, len);
+    return true;
+}
+
+static BaseType_t sim_timer_command(TimerHandle_t timer, const BaseType_t command, const TickType_t ticks,
+                                    BaseType_t *const woken, const TickType_t wait) {
+    (void) timer;
+    (void) ticks;
+    (void) woken;
+    (void) wait;
+    if (command == tmrCOMMAND_START) {
+        sim_timer_armed = true;
+        sim_timer_deadline_ms = sim_now_ms + BM_DFU_CLIENT_CHUNK_TIMEOUT_MS;
+    } else if (command == tmrCOMMAND_STOP) {
+        sim_timer_armed = false;
+    }
+    return pdPASS;
+}
+
+static void sim_host_send_chunk(uint16_t seq_num, bool windowed) {
+    uint32_t offset = seq_num * SIM_CHUNK_SIZE;
+    if (offset >= SIM_IMAGE_SIZE) {
+        return;
+    }
+    uint16_t payload_len = std::min<uint32_t>(SIM_CHUNK_SIZE, SIM_IMAGE_SIZE - offset);
+    std::vector<uint8_t> frame;
+    if (windowed) {
+        frame.resize(sizeof(bcmp_dfu_window_payload_t) + payload_len);
+        bcmp_dfu_window_payload_t *payload = reinterpret_cast<bcmp_dfu_window_payload_t *>(frame.data());
+        payload->header.frame_type = BCMP_DFU_WINDOW_PAYLOAD;
+        payload->chunk.addresses.src_node_id = 0xbeefbeefdaadbaad;
+        payload->chunk.addresses.dst_node_id = 0xdeadbeefbeeffeed;
+        payload->chunk.seq_num = seq_num;
+        payload->chunk.payload_length = payload_len;
+        memcpy(payload->chunk.payload_buf, &sim_image[offset], payload_len);
+    } else {
+        frame.resize(sizeof(bcmp_dfu_payload_t) + payload_len);
+        bcmp_dfu_payload_t *payload = reinterpret_cast<bcmp_dfu_payload_t *>(frame.data());
+        payload->header.frame_type = BCMP_DFU_PAYLOAD;
+        payload->chunk.addresses.src_node_id = 0xbeefbeefdaadbaad;
+        payload->chunk.addresses.dst_node_id = 0xdeadbeefbeeffeed;
+        payload->chunk.payload_length = payload_len;
+        memcpy(payload->chunk.payload_buf, &sim_image[offset], payload_len);
+    }
+    // The host serializes chunks back to back onto its link
+    double tx_start_ms = std::max(sim_now_ms, sim_host_tx_free_ms);
+    sim_host_tx_free_ms = tx_start_ms + sim_frame_time_ms(frame.size());
+    sim_send(true, tx_start_ms, frame.data(), frame.size());
+}
+
+static void sim_host_rx(const std::vector<uint8_t> &frame) {
+    const bm_dfu_frame_t *dfu_frame = reinterpret_cast<const bm_dfu_frame_t *>(frame.data());
+    if (dfu_frame->header.frame_type == BCMP_DFU_PAYLOAD_REQ) {
+        const bcmp_dfu_payload_req_t *req = reinterpret_cast<const bcmp_dfu_payload_req_t *>(frame.data());
+        sim_host_send_chunk(req->chunk_req.seq_num, false);
+    } else if (dfu_frame->header.frame_type == BCMP_DFU_WINDOW_REQ) {
+        const bcmp_dfu_window_req_t *req = reinterpret_cast<const bcmp_dfu_window_req_t *>(frame.data());
+        for (uint8_t i = 0; i < req->window_req.window_size; i++) {
+            if (!(req->window_req.received_mask & (1U << i))) {
+                sim_host_send_chunk(req->window_req.seq_num + i, true);
+            }
+        }
+    }
+}
+
+TEST_F(BcmpDfuTest, WindowedThroughputSim) {
+    getGitSHA_fake.return_val = 0xbaaddaad;
+    bm_dfu_test_set_client_fa(&fa);
+    fake_bcmp_tx_func_fake.custom_fake = sim_client_tx;
+    xTimerGenericCommand_fake.custom_fake = sim_timer_command;
+
+    sim_image.resize(SIM_IMAGE_SIZE);
+    uint32_t fill = 0x1234567;
+    for (auto &byte : sim_image) {
+        fill = fill * 1664525 + 1013904223;
+        byte = fill >> 24;
+    }
+    uint16_t image_crc = crc16_ccitt(0, sim_image.data(), sim_image.size());
+
+    const double loss_rates[] = {0.0, 0.02};
+    for (double loss_rate : loss_rates) {
+        printf("DFU sim: %u hops, %.1f%% frame loss, %u byte image\n", SIM_HOPS, loss_rate * 100, SIM_IMAGE_SIZE);
+        printf("window | time (ms) | bytes/s | frames\n");
+        double window_1_bytes_per_s = 0;
+        double window_16_bytes_per_s = 0;
+        for (uint8_t window = 1; window <= BM_DFU_MAX_WINDOW_SIZE; window++) {
+            sim_in_flight.clear();
+            sim_now_ms = 0;
+            sim_host_tx_free_ms = 0;
+            sim_loss_rate = loss_rate;
+            sim_rng_state = 42;
+            sim_timer_armed = false;
+            sim_frames_sent = 0;
+
+            bm_dfu_init(fake_bcmp_tx_func, testPartition, testConfig);
+            bm_dfu_client_set_max_window_size(window);
+            libSmContext_t* ctx = bm_dfu_test_get_sm_ctx();
+            bm_dfu_event_t evt = {
+                .type = DFU_EVENT_INIT_SUCCESS,
+                .buf = NULL,
+                .len = 0,
+            };
+            bm_dfu_test_set_dfu_event_and_run_sm(evt);
+            ASSERT_EQ(getCurrentStateEnum(*ctx), BM_DFU_STATE_IDLE);
+
+            bcmp_dfu_start_ext_t dfu_start_msg;
+            dfu_start_msg.start.header.frame_type = BCMP_DFU_START;
+            dfu_start_msg.start.info.addresses.src_node_id = 0xbeefbeefdaadbaad;
+            dfu_start_msg.start.info.addresses.dst_node_id = 0xdeadbeefbeeffeed;
+            dfu_start_msg.start.info.img_info.image_size = SIM_IMAGE_SIZE;
+            dfu_start_msg.start.info.img_info.chunk_size = SIM_CHUNK_SIZE;
+            dfu_start_msg.start.info.img_info.crc16 = image_crc;
+            dfu_start_msg.start.info.img_info.major_ver = 1;
+            dfu_start_msg.start.info.img_info.minor_ver = 7;
+            dfu_start_msg.start.info.img_info.gitSHA = 0xdeadd00d;
+            dfu_start_msg.start.info.img_info.filter_key = 0;
+            dfu_start_msg.max_window_size = BM_DFU_MAX_WINDOW_SIZE;
+            dfu_start_msg.flags = 0;
+            evt.type = DFU_EVENT_RECEIVED_UPDATE_REQUEST;
+            evt.buf = reinterpret_cast<uint8_t *>(&dfu_start_msg);
+            evt.len = sizeof(dfu_start_msg);
+            bm_dfu_test_set_dfu_event_and_run_sm(evt);
+            ASSERT_EQ(getCurrentStateEnum(*ctx), BM_DFU_STATE_CLIENT_RECEIVING);
+
+            while (getCurrentStateEnum(*ctx) == BM_DFU_STATE_CLIENT_RECEIVING) {
+                auto next = std::min_element(sim_in_flight.begin(), sim_in_flight.end(),
+                    [](const sim_frame_t &a, const sim_frame_t &b) { return a.arrival_ms < b.arrival_ms; });
+                if (next == sim_in_flight.end() || (sim_timer_armed && sim_timer_deadline_ms < next->arrival_ms)) {
+                    ASSERT_TRUE(sim_timer_armed);
+                    sim_now_ms = sim_timer_deadline_ms;
+                    sim_timer_armed = false;
+                    evt.type = DFU_EVENT_CHUNK_TIMEOUT;
+                    evt.buf = NULL;
+                    evt.len = 0;
+                    bm_dfu_test_set_dfu_event_and_run_sm(evt);
+                    continue;
+                }
+                sim_frame_t frame = *next;
+                sim_in_flight.erase(next);
+                sim_now_ms = frame.arrival_ms;
+                if (frame.to_client) {
+                    bool windowed = frame.frame[0] == BCMP_DFU_WINDOW_PAYLOAD;
+                    evt.type = windowed ? DFU_EVENT_WINDOW_CHUNK : DFU_EVENT_IMAGE_CHUNK;
+                    evt.buf = frame.frame.data();
+                    evt.len = frame.frame.size();
+                    bm_dfu_test_set_dfu_event_and_run_sm(evt);
+                } else {
+                    sim_host_rx(frame.frame);
+                }
+            }
+            ASSERT_EQ(getCurrentStateEnum(*ctx), BM_DFU_STATE_CLIENT_VALIDATING);
+
+            // The image must have been reassembled intact
+            evt.type = DFU_EVENT_NONE;
+            evt.buf = NULL;
+            evt.len = 0;
+            bm_dfu_test_set_dfu_event_and_run_sm(evt);
+            EXPECT_EQ(getCurrentStateEnum(*ctx), BM_DFU_STATE_CLIENT_REBOOT_REQ);
+
+            double bytes_per_s = SIM_IMAGE_SIZE / (sim_now_ms / 1000.0);
+            printf("%6u | %9.1f | %7.0f | %u\n", window, sim_now_ms, bytes_per_s, sim_frames_sent);
+            if (window == 1) {
+                window_1_bytes_per_s = bytes_per_s;
+            } else if (window == BM_DFU_MAX_WINDOW_SIZE) {
+                window_16_bytes_per_s = bytes_per_s;
+            }
+        }
+        EXPECT_GT(window_16_bytes_per_s, 4 * window_1_bytes_per_s);
+    }
+}
+
+// Secondary slot contents for the multicast tests, chunks land at their own offsets.
+static std::vector<uint8_t> mcast_flash;
+
+static int mcast_flash_area_write(const struct flash_area *fa, uint32_t off, const void *src, uint32_t len) {
+    (void) fa;
+    if (off + len > mcast_flash.size()) {
+        return -1;
+    }
+    memcpy(mcast_flash.data() + off, src, len);
+    return 0;
+}
+
+static int mcast_flash_area_read(const struct flash_area *fa, uint32_t off, void *dst, uint32_t len) {
+    (void) fa;
+    if (off + len > mcast_flash.size()) {
+        return -1;
+    }
+    memcpy(dst, mcast_flash.data() + off, len);
+    return 0;
+}
+
+TEST_F(BcmpDfuTest, clientMulticastGapRepair) {
+    getGitSHA_fake.return_val = 0xbaaddaad;
+    bm_dfu_test_set_client_fa(&fa);
+    fake_bcmp_tx_func_fake.custom_fake = capture_bcmp_tx_func;
+    captured_frames.clear();
+    RESET_FAKE(flash_area_write);
+    RESET_FAKE(flash_area_read);
+    RESET_FAKE(flash_area_open);
+    RESET_FAKE(flash_area_erase);
+    flash_area_write_fake.custom_fake = mcast_flash_area_write;
+    flash_area_read_fake.custom_fake = mcast_flash_area_read;
+    mcast_flash.assign(IMAGE_SIZE, 0xff);
+
+    // Every chunk gets its own fill so the CRC only matches if each chunk landed at its own offset
+    std::vector<uint8_t> image(IMAGE_SIZE);
+    for (size_t i = 0; i < IMAGE_SIZE; i++) {
+        image[i] = static_cast<uint8_t>(0x10 + i / CHUNK_SIZE);
+    }
+    uint16_t image_crc = crc16_ccitt(0, image.data(), IMAGE_SIZE);
+
+    bm_dfu_init(fake_bcmp_tx_func, testPartition, testConfig);
+    libSmContext_t* ctx = bm_dfu_test_get_sm_ctx();
+    bm_dfu_event_t evt = {
+        .type = DFU_EVENT_INIT_SUCCESS,
+        .buf = NULL,
+        .len = 0,
+    };
+    bm_dfu_test_set_dfu_event_and_run_sm(evt);
+    EXPECT_EQ(getCurrentStateEnum(*ctx), BM_DFU_STATE_IDLE);
+
+    auto make_chunk = [&](uint16_t seq_num, size_t &len) {
+        len = sizeof(bcmp_dfu_window_payload_t) + CHUNK_SIZE;
+        uint8_t *buf = (uint8_t*)malloc(len);
+        bcmp_dfu_window_payload_t dfu_payload_msg;
+        dfu_payload_msg.header.frame_type = BCMP_DFU_WINDOW_PAYLOAD;
+        dfu_payload_msg.chunk.addresses.src_node_id = 0xbeefbeefdaadbaad;
+        dfu_payload_msg.chunk.addresses.dst_node_id = BM_DFU_MULTICAST_NODE_ID;
+        dfu_payload_msg.chunk.seq_num = seq_num;
+        dfu_payload_msg.chunk.payload_length = CHUNK_SIZE;
+        memcpy(buf, &dfu_payload_msg, sizeof(dfu_payload_msg));
+        memcpy(buf + sizeof(dfu_payload_msg), image.data() + seq_num * CHUNK_SIZE, CHUNK_SIZE);
+        return buf;
+    };
+
+    // Multicast chunks are dropped unless we're receiving an image
+    size_t len;
+    unsigned int queued = xQueueGenericSend_fake.call_count;
+    uint8_t *buf = make_chunk(0, len);
+    bm_dfu_process_message(buf, len);
+    EXPECT_EQ(xQueueGenericSend_fake.call_count, queued);
+
+    // DFU REQUEST for a multicast session
+    evt.type = DFU_EVENT_RECEIVED_UPDATE_REQUEST;
+    evt.buf = (uint8_t*)malloc(sizeof(bcmp_dfu_start_ext_t));
+    evt.len = sizeof(bcmp_dfu_start_ext_t);
+    bcmp_dfu_start_ext_t dfu_start_msg;
+    dfu_start_msg.start.header.frame_type = BCMP_DFU_START;
+    dfu_start_msg.start.info.addresses.src_node_id = 0xbeefbeefdaadbaad;
+    dfu_start_msg.start.info.addresses.dst_node_id = 0xdeadbeefbeeffeed;
+    dfu_start_msg.start.info.img_info.image_size = IMAGE_SIZE;
+    dfu_start_msg.start.info.img_info.chunk_size = CHUNK_SIZE;
+    dfu_start_msg.start.info.img_info.crc16 = image_crc;
+    dfu_start_msg.start.info.img_info.major_ver = 1;
+    dfu_start_msg.start.info.img_info.minor_ver = 7;
+    dfu_start_msg.start.info.img_info.gitSHA = 0xdeadd00d;
+    dfu_start_msg.start.info.img_info.filter_key = 0;
+    dfu_start_msg.max_window_size = BM_DFU_MAX_WINDOW_SIZE;
+    dfu_start_msg.flags = BM_DFU_START_FLAG_MULTICAST;
+    memcpy(evt.buf, &dfu_start_msg, sizeof(dfu_start_msg));
+    bm_dfu_test_set_dfu_event_and_run_sm(evt);
+    EXPECT_EQ(getCurrentStateEnum(*ctx), BM_DFU_STATE_CLIENT_RECEIVING);
+    // The client waits for the stream instead of requesting chunks
+    EXPECT_EQ(fake_bcmp_tx_func_fake.arg0_val, BCMP_DFU_ACK);
+
+    // Now multicast chunks from our host are accepted
+    queued = xQueueGenericSend_fake.call_count;
+    buf = make_chunk(0, len);
+    bm_dfu_process_message(buf, len);
+    EXPECT_EQ(xQueueGenericSend_fake.call_count, queued + 1);
+    free(buf);
+
+    // The stream delivers chunks 0 and 3, chunks 1 and 2 are lost
+    evt.type = DFU_EVENT_WINDOW_CHUNK;
+    evt.buf = make_chunk(0, evt.len);
+    bm_dfu_test_set_dfu_event_and_run_sm(evt);
+    EXPECT_EQ(fake_bcmp_tx_func_fake.arg0_val, BCMP_DFU_ACK);
+    evt.buf = make_chunk(3, evt.len);
+    bm_dfu_test_set_dfu_event_and_run_sm(evt);
+    EXPECT_EQ(flash_area_write_fake.arg1_history[1], 3 * CHUNK_SIZE);
+
+    // The end of the stream triggers a unicast repair request for the first gap
+    ASSERT_EQ(fake_bcmp_tx_func_fake.arg0_val, BCMP_DFU_WINDOW_REQ);
+    bcmp_dfu_window_req_t *window_req = reinterpret_cast<bcmp_dfu_window_req_t *>(captured_frames.back().data());
+    EXPECT_EQ(window_req->window_req.addresses.dst_node_id, 0xbeefbeefdaadbaadULL);
+    EXPECT_EQ(window_req->window_req.seq_num, 1);
+    EXPECT_EQ(window_req->window_req.window_size, 3);
+    EXPECT_EQ(window_req->window_req.received_mask, 0x0004);
+
+    // Repairs arrive, the image completes once the last gap is filled
+    size_t frames_before = captured_frames.size();
+    evt.buf = make_chunk(1, evt.len);
+    bm_dfu_test_set_dfu_event_and_run_sm(evt);
+    EXPECT_EQ(captured_frames.size(), frames_before);
+    EXPECT_EQ(getCurrentStateEnum(*ctx), BM_DFU_STATE_CLIENT_RECEIVING);
+    evt.buf = make_chunk(2, evt.len);
+    bm_dfu_test_set_dfu_event_and_run_sm(evt);
+    EXPECT_EQ(getCurrentStateEnum(*ctx), BM_DFU_STATE_CLIENT_VALIDATING);
+    EXPECT_EQ(flash_area_write_fake.call_count, 4u);
+    EXPECT_EQ(mcast_flash, image);
+
+    // CRC is computed from the image read back from flash
+    evt.type = DFU_EVENT_NONE;
+    evt.buf = NULL;
+    evt.len = 0;
+    bm_dfu_test_set_dfu_event_and_run_sm(evt);
+    EXPECT_EQ(getCurrentStateEnum(*ctx), BM_DFU_STATE_CLIENT_REBOOT_REQ);
+    EXPECT_EQ(fake_bcmp_tx_func_fake.arg0_val, BCMP_DFU_REBOOT_REQ);
+
+    RESET_FAKE(flash_area_write);
+    RESET_FAKE(flash_area_read);
+}
+
+// Primary slot contents for the delta tests, the image the client is running.
+static std::vector<uint8_t> delta_base;
+
+static int delta_base_flash_area_read(const struct flash_area *fa, uint32_t off, void *dst, uint32_t len) {
+    (void) fa;
+    if (off + len > delta_base.size()) {
+        return -1;
+    }
+    memcpy(dst, delta_base.data() + off, len);
+    return 0;
+}
+
+static void delta_append_op(std::vector<uint8_t> &patch, uint8_t opcode, uint32_t len, uint32_t src_offset) {
+    bm_dfu_delta_op_t op = {opcode, len, src_offset};
+    uint8_t *p = reinterpret_cast<uint8_t *>(&op);
+    patch.insert(patch.end(), p, p + sizeof(op));
+}
+
+TEST_F(BcmpDfuTest, clientDeltaUpdate) {
+    getGitSHA_fake.return_val = 0xbaaddaad;
+    bm_dfu_test_set_client_fa(&fa);
+    fake_bcmp_tx_func_fake.custom_fake = capture_bcmp_tx_func;
+    captured_frames.clear();
+    RESET_FAKE(flash_area_write);
+    RESET_FAKE(flash_area_read);
+    RESET_FAKE(flash_area_open);
+    RESET_FAKE(flash_area_erase);
+    flash_area_write_fake.custom_fake = mcast_flash_area_write;
+    flash_area_read_fake.custom_fake = delta_base_flash_area_read;
+
+    // New image: a few bytes changed in place and some code appended
+    delta_base.resize(IMAGE_SIZE);
+    for (size_t i = 0; i < IMAGE_SIZE; i++) {
+        delta_base[i] = static_cast<uint8_t>(i * 7);
+    }
+    std::vector<uint8_t> target = delta_base;
+    std::fill(target.begin() + 1000, target.begin() + 1024, 0x42);
+    target.insert(target.end(), 500, 0x33);
+    mcast_flash.assign(target.size(), 0xff);
+
+    bm_dfu_delta_header_t header = {};
+    header.magic = BM_DFU_DELTA_MAGIC;
+    header.version = BM_DFU_DELTA_VERSION;
+    header.base_size = IMAGE_SIZE;
+    header.base_crc16 = crc16_ccitt(0, delta_base.data(), delta_base.size());
+    header.base_git_sha = 0xbaaddaad;
+    header.target_size = static_cast<uint32_t>(target.size());
+    header.target_crc16 = crc16_ccitt(0, target.data(), target.size());
+    header.target_major = 1;
+    header.target_minor = 7;
+    header.target_git_sha = 0xdeadd00d;
+    uint8_t *h = reinterpret_cast<uint8_t *>(&header);
+    std::vector<uint8_t> patch(h, h + sizeof(header));
+    delta_append_op(patch, BM_DFU_DELTA_OP_COPY, 1000, 0);
+    delta_append_op(patch, BM_DFU_DELTA_OP_INSERT, 24, 0);
+    patch.insert(patch.end(), target.begin() + 1000, target.begin() + 1024);
+    delta_append_op(patch, BM_DFU_DELTA_OP_COPY, IMAGE_SIZE - 1024, 1024);
+    delta_append_op(patch, BM_DFU_DELTA_OP_INSERT, 500, 0);
+    patch.insert(patch.end(), target.begin() + IMAGE_SIZE, target.end());
+    // Two chunks, the last INSERT spans them
+    ASSERT_GT(patch.size(), CHUNK_SIZE);
+    ASSERT_LT(patch.size(), 2 * CHUNK_SIZE);
+
+    bm_dfu_init(fake_bcmp_tx_func, testPartition, testConfig);
+    libSmContext_t* ctx = bm_dfu_test_get_sm_ctx();
+    bm_dfu_event_t evt = {
+        .type = DFU_EVENT_INIT_SUCCESS,
+        .buf = NULL,
+        .len = 0,
+    };
+    bm_dfu_test_set_dfu_event_and_run_sm(evt);
+    EXPECT_EQ(getCurrentStateEnum(*ctx), BM_DFU_STATE_IDLE);
+
+    // DFU REQUEST, the image CRC is the CRC of the rebuilt image
+    evt.type = DFU_EVENT_RECEIVED_UPDATE_REQUEST;
+    evt.buf = (uint8_t*)malloc(sizeof(bcmp_dfu_start_ext_t));
+    evt.len = sizeof(bcmp_dfu_start_ext_t);
+    bcmp_dfu_start_ext_t dfu_start_msg;
+    dfu_start_msg.start.header.frame_type = BCMP_DFU_START;
+    dfu_start_msg.start.info.addresses.src_node_id = 0xbeefbeefdaadbaad;
+    dfu_start_msg.start.info.addresses.dst_node_id = 0xdeadbeefbeeffeed;
+    dfu_start_msg.start.info.img_info.image_size = static_cast<uint32_t>(patch.size());
+    dfu_start_msg.start.info.img_info.chunk_size = CHUNK_SIZE;
+    dfu_start_msg.start.info.img_info.crc16 = header.target_crc16;
+    dfu_start_msg.start.info.img_info.major_ver = 1;
+    dfu_start_msg.start.info.img_info.minor_ver = 7;
+    dfu_start_msg.start.info.img_info.gitSHA = 0xdeadd00d;
+    dfu_start_msg.start.info.img_info.filter_key = 0;
+    dfu_start_msg.max_window_size = 1;
+    dfu_start_msg.flags = BM_DFU_START_FLAG_DELTA;
+    memcpy(evt.buf, &dfu_start_msg, sizeof(dfu_start_msg));
+    bm_dfu_test_set_dfu_event_and_run_sm(evt);
+    EXPECT_EQ(fake_bcmp_tx_func_fake.arg0_history[0], BCMP_DFU_ACK);
+    EXPECT_EQ(fake_bcmp_tx_func_fake.arg0_val, BCMP_DFU_PAYLOAD_REQ);
+    EXPECT_EQ(getCurrentStateEnum(*ctx), BM_DFU_STATE_CLIENT_RECEIVING);
+
+    auto make_chunk = [&](size_t offset, size_t &len) {
+        uint16_t payload_length = static_cast<uint16_t>(std::min(CHUNK_SIZE, patch.size() - offset));
+        len = sizeof(bcmp_dfu_payload_t) + payload_length;
+        uint8_t *buf = (uint8_t*)malloc(len);
+        bcmp_dfu_payload_t dfu_payload_msg;
+        dfu_payload_msg.header.frame_type = BCMP_DFU_PAYLOAD;
+        dfu_payload_msg.chunk.addresses.src_node_id = 0xbeefbeefdaadbaad;
+        dfu_payload_msg.chunk.addresses.dst_node_id = 0xdeadbeefbeeffeed;
+        dfu_payload_msg.chunk.payload_length = payload_length;
+        memcpy(buf, &dfu_payload_msg, sizeof(dfu_payload_msg));
+        memcpy(buf + sizeof(dfu_payload_msg), patch.data() + offset, payload_length);
+        return buf;
+    };
+
+    evt.type = DFU_EVENT_IMAGE_CHUNK;
+    evt.buf = make_chunk(0, evt.len);
+    bm_dfu_test_set_dfu_event_and_run_sm(evt);
+    EXPECT_EQ(fake_bcmp_tx_func_fake.arg0_val, BCMP_DFU_PAYLOAD_REQ);
+    EXPECT_EQ(getCurrentStateEnum(*ctx), BM_DFU_STATE_CLIENT_RECEIVING);
+    evt.buf = make_chunk(CHUNK_SIZE, evt.len);
+    bm_dfu_test_set_dfu_event_and_run_sm(evt);
+    EXPECT_EQ(getCurrentStateEnum(*ctx), BM_DFU_STATE_CLIENT_VALIDATING);
+    EXPECT_EQ(mcast_flash, target);
+
+    // Validating checks the length and CRC of the rebuilt image
+    evt.type = DFU_EVENT_NONE;
+    evt.buf = NULL;
+    evt.len = 0;
+    bm_dfu_test_set_dfu_event_and_run_sm(evt);
+    EXPECT_EQ(getCurrentStateEnum(*ctx), BM_DFU_STATE_CLIENT_REBOOT_REQ);
+    EXPECT_EQ(fake_bcmp_tx_func_fake.arg0_val, BCMP_DFU_REBOOT_REQ);
+
+    RESET_FAKE(flash_area_write);
+    RESET_FAKE(flash_area_read);
+}
+
+TEST_F(BcmpDfuTest, clientDeltaWrongBase) {
+    getGitSHA_fake.return_val = 0xbaaddaad;
+    bm_dfu_test_set_client_fa(&fa);
+    fake_bcmp_tx_func_fake.custom_fake = capture_bcmp_tx_func;
+    captured_frames.clear();
+    RESET_FAKE(flash_area_write);
+    RESET_FAKE(flash_area_read);
+    RESET_FAKE(flash_area_open);
+    RESET_FAKE(flash_area_erase);
+    flash_area_read_fake.custom_fake = delta_base_flash_area_read;
+    delta_base.assign(IMAGE_SIZE, 0x5a);
+
+    // Patch made against a build this node isn't running
+    bm_dfu_delta_header_t header = {};
+    header.magic = BM_DFU_DELTA_MAGIC;
+    header.version = BM_DFU_DELTA_VERSION;
+    header.base_size = IMAGE_SIZE;
+    header.base_crc16 = crc16_ccitt(0, delta_base.data(), delta_base.size());
+    header.base_git_sha = 0x12345678;
+    header.target_size = IMAGE_SIZE;
+    uint8_t *h = reinterpret_cast<uint8_t *>(&header);
+    std::vector<uint8_t> patch(h, h + sizeof(header));
+    delta_append_op(patch, BM_DFU_DELTA_OP_COPY, IMAGE_SIZE, 0);
+
+    bm_dfu_init(fake_bcmp_tx_func, testPartition, testConfig);
+    libSmContext_t* ctx = bm_dfu_test_get_sm_ctx();
+    bm_dfu_event_t evt = {
+        .type = DFU_EVENT_INIT_SUCCESS,
+        .buf = NULL,
+        .len = 0,
+    };
+    bm_dfu_test_set_dfu_event_and_run_sm(evt);
+    EXPECT_EQ(getCurrentStateEnum(*ctx), BM_DFU_STATE_IDLE);
+
+    evt.type = DFU_EVENT_RECEIVED_UPDATE_REQUEST;
+    evt.buf = (uint8_t*)malloc(sizeof(bcmp_dfu_start_ext_t));
+    evt.len = sizeof(bcmp_dfu_start_ext_t);
+    bcmp_dfu_start_ext_t dfu_start_msg;
+    dfu_start_msg.start.header.frame_type = BCMP_DFU_START;
+    dfu_start_msg.start.info.addresses.src_node_id = 0xbeefbeefdaadbaad;
+    dfu_start_msg.start.info.addresses.dst_node_id = 0xdeadbeefbeeffeed;
+    dfu_start_msg.start.info.img_info.image_size = static_cast<uint32_t>(patch.size());
+    dfu_start_msg.start.info.img_info.chunk_size = CHUNK_SIZE;
+    dfu_start_msg.start.info.img_info.crc16 = 0;
+    dfu_start_msg.start.info.img_info.major_ver = 1;
+    dfu_start_msg.start.info.img_info.minor_ver = 7;
+    dfu_start_msg.start.info.img_info.gitSHA = 0xdeadd00d;
+    dfu_start_msg.start.info.img_info.filter_key = 0;
+    dfu_start_msg.max_window_size = 1;
+    dfu_start_msg.flags = BM_DFU_START_FLAG_DELTA;
+    memcpy(evt.buf, &dfu_start_msg, sizeof(dfu_start_msg));
+    bm_dfu_test_set_dfu_event_and_run_sm(evt);
+    EXPECT_EQ(getCurrentStateEnum(*ctx), BM_DFU_STATE_CLIENT_RECEIVING);
+
+    evt.type = DFU_EVENT_IMAGE_CHUNK;
+    evt.len = sizeof(bcmp_dfu_payload_t) + patch.size();
+    evt.buf = (uint8_t*)malloc(evt.len);
+    bcmp_dfu_payload_t dfu_payload_msg;
+    dfu_payload_msg.header.frame_type = BCMP_DFU_PAYLOAD;
+    dfu_payload_msg.chunk.addresses.src_node_id = 0xbeefbeefdaadbaad;
+    dfu_payload_msg.chunk.addresses.dst_node_id = 0xdeadbeefbeeffeed;
+    dfu_payload_msg.chunk.payload_length = static_cast<uint16_t>(patch.size());
+    memcpy(evt.buf, &dfu_payload_msg, sizeof(dfu_payload_msg));
+    memcpy(evt.buf + sizeof(dfu_payload_msg), patch.data(), patch.size());
+    bm_dfu_test_set_dfu_event_and_run_sm(evt);
+
+    // The host is told right away so it can send a full image instead
+    EXPECT_EQ(fake_bcmp_tx_func_fake.arg0_val, BCMP_DFU_ABORT);
+    bcmp_dfu_abort_t *abort_msg = reinterpret_cast<bcmp_dfu_abort_t *>(captured_frames.back().data());
+    EXPECT_EQ(static_cast<bm_dfu_err_t>(abort_msg->err.err_code), BM_DFU_ERR_DELTA_BASE);
+    EXPECT_EQ(getCurrentStateEnum(*ctx), BM_DFU_STATE_ERROR);
+    EXPECT_EQ(flash_area_write_fake.call_count, 0u);
+
+    RESET_FAKE(flash_area_read);
+}
+
+TEST_F(BcmpDfuTest, clientCompressedUpdate) {
+    getGitSHA_fake.return_val = 0xbaaddaad;
+    bm_dfu_test_set_client_fa(&fa);
+    RESET_FAKE(flash_area_write);
+    RESET_FAKE(flash_area_open);
+    RESET_FAKE(flash_area_erase);
+    flash_area_write_fake.custom_fake = mcast_flash_area_write;
+    mcast_flash.assign(IMAGE_SIZE, 0xff);
+
+    // 16 byte pattern repeated over the image
+    std::vector<uint8_t> image(IMAGE_SIZE);
+    for (size_t i = 0; i < IMAGE_SIZE; i++) {
+        image[i] = static_cast<uint8_t>(i % 16);
+    }
+    bm_dfu_lz_header_t header = {BM_DFU_LZ_MAGIC, BM_DFU_LZ_VERSION, BM_DFU_LZ_MIN_WINDOW_BITS, 0, IMAGE_SIZE};
+    uint8_t *h = reinterpret_cast<uint8_t *>(&header);
+    std::vector<uint8_t> packed(h, h + sizeof(header));
+    for (size_t i = 0; i < 16; i++) {
+        if (i % 8 == 0) {
+            packed.push_back(0xff); // 8 literals
+        }
+        packed.push_back(image[i]);
+    }
+    packed.push_back(0x00); // 8 references to the pattern, the longest is 258 bytes
+    size_t remaining = IMAGE_SIZE - 16;
+    while (remaining) {
+        size_t len = std::min(remaining, static_cast<size_t>(256));
+        uint16_t ref = static_cast<uint16_t>((16 - 1) | ((len - BM_DFU_LZ_MIN_MATCH) << BM_DFU_LZ_MIN_WINDOW_BITS));
+        packed.push_back(static_cast<uint8_t>(ref));
+        packed.push_back(static_cast<uint8_t>(ref >> 8));
+        remaining -= len;
+    }
+
+    bm_dfu_init(fake_bcmp_tx_func, testPartition, testConfig);
+    libSmContext_t* ctx = bm_dfu_test_get_sm_ctx();
+    bm_dfu_event_t evt = {
+        .type = DFU_EVENT_INIT_SUCCESS,
+        .buf = NULL,
+        .len = 0,
+    };
+    bm_dfu_test_set_dfu_event_and_run_sm(evt);
+    EXPECT_EQ(getCurrentStateEnum(*ctx), BM_DFU_STATE_IDLE);
+
+    // DFU REQUEST, the image CRC is the CRC of the decompressed image
+    evt.type = DFU_EVENT_RECEIVED_UPDATE_REQUEST;
+    evt.buf = (uint8_t*)malloc(sizeof(bcmp_dfu_start_ext_t));
+    evt.len = sizeof(bcmp_dfu_start_ext_t);
+    bcmp_dfu_start_ext_t dfu_start_msg;
+    dfu_start_msg.start.header.frame_type = BCMP_DFU_START;
+    dfu_start_msg.start.info.addresses.src_node_id = 0xbeefbeefdaadbaad;
+    dfu_start_msg.start.info.addresses.dst_node_id = 0xdeadbeefbeeffeed;
+    dfu_start_msg.start.info.img_info.image_size = static_cast<uint32_t>(packed.size());
+    dfu_start_msg.start.info.img_info.chunk_size = CHUNK_SIZE;
+    dfu_start_msg.start.info.img_info.crc16 = crc16_ccitt(0, image.data(), image.size());
+    dfu_start_msg.start.info.img_info.major_ver = 1;
+    dfu_start_msg.start.info.img_info.minor_ver = 7;
+    dfu_start_msg.start.info.img_info.gitSHA = 0xdeadd00d;
+    dfu_start_msg.start.info.img_info.filter_key = 0;
+    dfu_start_msg.max_window_size = 1;
+    dfu_start_msg.flags = BM_DFU_START_FLAG_COMPRESSED;
+    memcpy(evt.buf, &dfu_start_msg, sizeof(dfu_start_msg));
+    bm_dfu_test_set_dfu_event_and_run_sm(evt);
+    EXPECT_EQ(fake_bcmp_tx_func_fake.arg0_val, BCMP_DFU_PAYLOAD_REQ);
+    EXPECT_EQ(getCurrentStateEnum(*ctx), BM_DFU_STATE_CLIENT_RECEIVING);
+
+    // The whole image fits in one chunk
+    evt.type = DFU_EVENT_IMAGE_CHUNK;
+    evt.len = sizeof(bcmp_dfu_payload_t) + packed.size();
+    evt.buf = (uint8_t*)malloc(evt.len);
+    bcmp_dfu_payload_t dfu_payload_msg;
+    dfu_payload_msg.header.frame_type = BCMP_DFU_PAYLOAD;
+    dfu_payload_msg.chunk.addresses.src_node_id = 0xbeefbeefdaadbaad;
+    dfu_payload_msg.chunk.addresses.dst_node_id = 0xdeadbeefbeeffeed;
+    dfu_payload_msg.chunk.payload_length = static_cast<uint16_t>(packed.size());
+    memcpy(evt.buf, &dfu_payload_msg, sizeof(dfu_payload_msg));
+    memcpy(evt.buf + sizeof(dfu_payload_msg), packed.data(), packed.size());
+    bm_dfu_test_set_dfu_event_and_run_sm(evt);
+    EXPECT_EQ(getCurrentStateEnum(*ctx), BM_DFU_STATE_CLIENT_VALIDATING);
+    EXPECT_EQ(mcast_flash, image);
+
+    evt.type = DFU_EVENT_NONE;
+    evt.buf = NULL;
+    evt.len = 0;
+    bm_dfu_test_set_dfu_event_and_run_sm(evt);
+    EXPECT_EQ(getCurrentStateEnum(*ctx), BM_DFU_STATE_CLIENT_REBOOT_REQ);
+    EXPECT_EQ(fake_bcmp_tx_func_fake.arg0_val, BCMP_DFU_REBOOT_REQ);
+
+    RESET_FAKE(flash_area_write);
+}
+
+// Results reported by the host for each client in the multicast tests.
+static std::vector<std::pair<uint64_t, bm_dfu_err_t>> mcast_results;
+
+static void mcast_finish_cb(bool success, bm_dfu_err_t error, uint64_t node_id) {
+    (void) success;
+    mcast_results.push_back(std::make_pair(node_id, error));
+}
+
+TEST_F(BcmpDfuTest, hostMulticastUpdate) {
+    static constexpr uint64_t CLIENT_A = 0xbeefbeefdaadbaad;
+    static constexpr uint64_t CLIENT_B = 0xbeefbeefdaadd00d;
+    fake_bcmp_tx_func_fake.custom_fake = capture_bcmp_tx_func;
+    captured_frames.clear();
+    mcast_results.clear();
+
+    // INIT SUCCESS
+    bm_dfu_init(fake_bcmp_tx_func, testPartition, testConfig);
+    libSmContext_t* ctx = bm_dfu_test_get_sm_ctx();
+    bm_dfu_event_t evt = {
+        .type = DFU_EVENT_INIT_SUCCESS,
+        .buf = NULL,
+        .len = 0,
+    };
+    bm_dfu_test_set_dfu_event_and_run_sm(evt);
+    EXPECT_EQ(getCurrentStateEnum(*ctx), BM_DFU_STATE_IDLE);
+
+    // HOST REQUEST for two clients
+    evt.type = DFU_EVENT_BEGIN_HOST_MULTICAST;
+    evt.len = sizeof(dfu_host_mcast_start_event_t) + 2 * sizeof(uint64_t);
+    evt.buf = (uint8_t*)malloc(evt.len);
+    dfu_host_mcast_start_event_t *mcast_start = reinterpret_cast<dfu_host_mcast_start_event_t *>(evt.buf);
+    mcast_start->start_event.start.header.frame_type = BCMP_DFU_START;
+    mcast_start->start_event.start.info.addresses.src_node_id = 0xdeadbeefbeeffeed;
+    mcast_start->start_event.start.info.addresses.dst_node_id = BM_DFU_MULTICAST_NODE_ID;
+    mcast_start->start_event.start.info.img_info.image_size = IMAGE_SIZE;
+    mcast_start->start_event.start.info.img_info.chunk_size = CHUNK_SIZE;
+    mcast_start->start_event.start.info.img_info.crc16 = 0x2fDf;
+    mcast_start->start_event.start.info.img_info.major_ver = 1;
+    mcast_start->start_event.start.info.img_info.minor_ver = 7;
+    mcast_start->start_event.start.info.img_info.gitSHA = 0xdeadd00d;
+    mcast_start->start_event.timeoutMs = 30000;
+    mcast_start->start_event.finish_cb = mcast_finish_cb;
+    mcast_start->num_nodes = 2;
+    mcast_start->node_ids[0] = CLIENT_A;
+    mcast_start->node_ids[1] = CLIENT_B;
+    bm_dfu_test_set_dfu_event_and_run_sm(evt);
+    EXPECT_EQ(getCurrentStateEnum(*ctx), BM_DFU_STATE_HOST_REQ_UPDATE);
+
+    // Each client gets its own update request flagged as multicast
+    ASSERT_EQ(captured_frames.size(), 2u);
+    const uint64_t clients[] = {CLIENT_A, CLIENT_B};
+    for (size_t i = 0; i < captured_frames.size(); i++) {
+        bcmp_dfu_start_ext_t *start = reinterpret_cast<bcmp_dfu_start_ext_t *>(captured_frames[i].data());
+        EXPECT_EQ(start->start.header.frame_type, BCMP_DFU_START);
+        EXPECT_EQ(start->start.info.addresses.dst_node_id, clients[i]);
+        EXPECT_EQ(start->flags, BM_DFU_START_FLAG_MULTICAST);
+    }
+
+    auto send_ack = [&](uint64_t src, uint8_t success, bm_dfu_err_t err) {
+        bm_dfu_event_t ack_evt;
+        ack_evt.type = DFU_EVENT_ACK_RECEIVED;
+        ack_evt.len = sizeof(bcmp_dfu_ack_t);
+        ack_evt.buf = (uint8_t*)malloc(ack_evt.len);
+        bcmp_dfu_ack_t dfu_ack_msg;
+        dfu_ack_msg.header.frame_type = BCMP_DFU_ACK;
+        dfu_ack_msg.ack.addresses.dst_node_id = 0xdeadbeefbeeffeed;
+        dfu_ack_msg.ack.addresses.src_node_id = src;
+        dfu_ack_msg.ack.err_code = err;
+        dfu_ack_msg.ack.success = success;
+        memcpy(ack_evt.buf, &dfu_ack_msg, sizeof(bcmp_dfu_ack_t));
+        bm_dfu_test_set_dfu_event_and_run_sm(ack_evt);
+    };
+
+    // Client A accepts, client B is already up to date
+    send_ack(CLIENT_A, 1, BM_DFU_ERR_NONE);
+    EXPECT_EQ(getCurrentStateEnum(*ctx), BM_DFU_STATE_HOST_REQ_UPDATE);
+    send_ack(CLIENT_B, 0, BM_DFU_ERR_SAME_VER);
+    EXPECT_EQ(getCurrentStateEnum(*ctx), BM_DFU_STATE_HOST_UPDATE);
+    ASSERT_EQ(mcast_results.size(), 1u);
+    EXPECT_EQ(mcast_results[0].first, CLIENT_B);
+    EXPECT_EQ(mcast_results[0].second, BM_DFU_ERR_SAME_VER);
+
+    // The whole image is streamed once to the multicast address
+    captured_frames.clear();
+    evt.type = DFU_EVENT_MCAST_SEND;
+    evt.buf = NULL;
+    evt.len = 0;
+    bm_dfu_test_set_dfu_event_and_run_sm(evt);
+    ASSERT_EQ(captured_frames.size(), IMAGE_SIZE / CHUNK_SIZE);
+    for (size_t i = 0; i < captured_frames.size(); i++) {
+        bcmp_dfu_window_payload_t *payload = reinterpret_cast<bcmp_dfu_window_payload_t *>(captured_frames[i].data());
+        EXPECT_EQ(payload->header.frame_type, BCMP_DFU_WINDOW_PAYLOAD);
+        EXPECT_EQ(payload->chunk.addresses.dst_node_id, (uint64_t)BM_DFU_MULTICAST_NODE_ID);
+        EXPECT_EQ(payload->chunk.seq_num, static_cast<uint16_t>(i));
+    }
+
+    // Repairs are unicast to the client that asked, and only for clients still in the session
+    auto send_window_req = [&](uint64_t src) {
+        bm_dfu_event_t req_evt;
+        req_evt.type = DFU_EVENT_WINDOW_REQUEST;
+        req_evt.len = sizeof(bcmp_dfu_window_req_t);
+        req_evt.buf = (uint8_t*)malloc(req_evt.len);
+        bcmp_dfu_window_req_t dfu_window_req_msg;
+        dfu_window_req_msg.header.frame_type = BCMP_DFU_WINDOW_REQ;
+        dfu_window_req_msg.window_req.addresses.dst_node_id = 0xdeadbeefbeeffeed;
+        dfu_window_req_msg.window_req.addresses.src_node_id = src;
+        dfu_window_req_msg.window_req.seq_num = 2;
+        dfu_window_req_msg.window_req.window_size = 1;
+        dfu_window_req_msg.window_req.received_mask = 0;
+        memcpy(req_evt.buf, &dfu_window_req_msg, sizeof(dfu_window_req_msg));
+        bm_dfu_test_set_dfu_event_and_run_sm(req_evt);
+    };
+    captured_frames.clear();
+    send_window_req(CLIENT_A);
+    ASSERT_EQ(captured_frames.size(), 1u);
+    bcmp_dfu_window_payload_t *payload = reinterpret_cast<bcmp_dfu_window_payload_t *>(captured_frames[0].data());
+    EXPECT_EQ(payload->chunk.addresses.dst_node_id, CLIENT_A);
+    EXPECT_EQ(payload->chunk.seq_num, 2);
+    send_window_req(CLIENT_B);
+    EXPECT_EQ(captured_frames.size(), 1u);
+
+    // Client A finishes, which ends the session
+    evt.type = DFU_EVENT_UPDATE_END;
+    evt.len = sizeof(bcmp_dfu_end_t);
+    evt.buf = (uint8_t*)malloc(evt.len);
+    bcmp_dfu_end_t dfu_end_msg;
+    dfu_end_msg.header.frame_type = BCMP_DFU_END;
+    dfu_end_msg.result.addresses.dst_node_id = 0xdeadbeefbeeffeed;
+    dfu_end_msg.result.addresses.src_node_id = CLIENT_A;
+    dfu_end_msg.result.success = 1;
+    dfu_end_msg.result.err_code = BM_DFU_ERR_NONE;
+    memcpy(evt.buf, &dfu_end_msg, sizeof(dfu_end_msg));
+    bm_dfu_test_set_dfu_event_and_run_sm(evt);
+    EXPECT_EQ(getCurrentStateEnum(*ctx), BM_DFU_STATE_IDLE);
+    ASSERT_EQ(mcast_results.size(), 2u);
+    EXPECT_EQ(mcast_results[1].first, CLIENT_A);
+    EXPECT_EQ(mcast_results[1].second, BM_DFU_ERR_NONE);
+}
@@ -0,0 +1,313 @@
+#include "gtest/gtest.h"
+
+#include <algorithm>
+#include <random>
+#include <vector>
+
+#include "bcmp_frag.h"
+
+// The fixture for testing class Foo.
+class BcmpFragTest : public ::testing::Test {
+protected:
+  // You can remove any or all of the following functions if its body
+  // is empty.
+
+  BcmpFragTest() {
+    // You can do set-up work for each test here.
+  }
+
+  ~BcmpFragTest() override {
+    // You can do clean-up work that doesn't throw exceptions here.
+  }
+
+  // If the constructor and destructor are not enough for setting up
+  // and cleaning up each test, you can define the following methods:
+
+  void SetUp() override {
+    // Code here will be called immediately after the constructor (right
+    // before each test).
+    bcmp_frag_init(&pool);
+  }
+
+  void TearDown() override {
+    // Code here will be called immediately after each test (right
+    // before the destructor).
+  }
+
+  // Objects declared here can be used by all tests in the test suite for Foo.
+  bcmp_frag_pool_t pool;
+
+  struct Frame {
+    std::vector<uint8_t> buf;
+    const bcmp_header_t *header() const { return reinterpret_cast<const bcmp_header_t *>(buf.data()); }
+    uint16_t payloadLen() const { return static_cast<uint16_t>(buf.size() - sizeof(bcmp_header_t)); }
+  };
+
+  static std::vector<uint8_t> makePayload(uint32_t len, uint32_t seed) {
+    std::mt19937 rng(seed);
+    std::vector<uint8_t> payload(len);
+    for (auto &byte : payload) {
+      byte = static_cast<uint8_t>(rng());
+    }
+    return payload;
+  }
+
+  // Splits a payload the same way bcmp_tx() does
+  static std::vector<Frame> fragment(uint16_t type, uint32_t seq_num, const std::vector<uint8_t> &payload) {
+    std::vector<Frame> frames;
+    uint8_t frag_total = bcmp_frag_count(static_cast<uint32_t>(payload.size()));
+    uint32_t offset = 0;
+    for (uint8_t frag_id = 0; frag_id < frag_total; frag_id++) {
+      uint16_t len = bcmp_frag_len(static_cast<uint32_t>(payload.size()), frag_id);
+      Frame frame;
+      frame.buf.resize(sizeof(bcmp_header_t) + len);
+      bcmp_header_t *header = reinterpret_cast<bcmp_header_t *>(frame.buf.data());
+      header->type = type;
+      header->checksum = 0x1234;
+      header->flags = 0;
+      header->rsvd = 0;
+      header->seq_num = seq_num;
+      header->frag_total = frag_total;
+      header->frag_id = frag_id;
+      header->next_header = 0;
+      memcpy(header->payload, &payload[offset], len);
+      offset += len;
+      frames.push_back(frame);
+    }
+    return frames;
+  }
+
+  // Returns the reassembled payload if this frame completed the message
+  bool add(uint64_t src, const Frame &frame, uint32_t now_ms, std::vector<uint8_t> &out) {
+    uint16_t msg_len = 0;
+    bcmp_header_t *msg = bcmp_frag_add(&pool, src, frame.header(), frame.payloadLen(), now_ms, &msg_len);
+    if (!msg) {
+      return false;
+    }
+    EXPECT_EQ(msg->type, frame.header()->type);
+    EXPECT_EQ(msg->seq_num, frame.header()->seq_num);
+    EXPECT_EQ(msg->frag_total, 0);
+    EXPECT_EQ(msg->frag_id, 0);
+    out.assign(msg->payload, msg->payload + msg_len);
+    bcmp_frag_release(&pool, msg);
+    return true;
+  }
+};
+
+TEST_F(BcmpFragTest, Split) {
+  EXPECT_EQ(bcmp_frag_count(0), 0);
+  EXPECT_EQ(bcmp_frag_count(BCMP_FRAG_PAYLOAD_LEN), 0);
+  EXPECT_EQ(bcmp_frag_count(BCMP_FRAG_PAYLOAD_LEN + 1), 2);
+  EXPECT_EQ(bcmp_frag_count(BCMP_FRAG_MAX_MESSAGE_LEN), BCMP_FRAG_MAX_FRAGMENTS);
+  EXPECT_EQ(bcmp_frag_len(BCMP_FRAG_PAYLOAD_LEN + 1, 0), BCMP_FRAG_PAYLOAD_LEN);
+  EXPECT_EQ(bcmp_frag_len(BCMP_FRAG_PAYLOAD_LEN + 1, 1), 1);
+}
+
+TEST_F(BcmpFragTest, InOrder) {
+  std::vector<uint8_t> payload = makePayload(3 * BCMP_FRAG_PAYLOAD_LEN - 100, 1);
+  std::vector<Frame> frames = fragment(0xB1, 7, payload);
+  ASSERT_EQ(frames.size(), 3u);
+
+  std::vector<uint8_t> out;
+  EXPECT_FALSE(add(1, frames[0], 0, out));
+  EXPECT_FALSE(add(1, frames[1], 1, out));
+  EXPECT_TRUE(add(1, frames[2], 2, out));
+  EXPECT_EQ(out, payload);
+  EXPECT_EQ(pool.bytes_in_use, 0u);
+}
+
+TEST_F(BcmpFragTest, ReorderedAndDuplicated) {
+  std::mt19937 rng(2);
+  for (int round = 0; round < 200; round++) {
+    std::vector<uint8_t> payload = makePayload(BCMP_FRAG_PAYLOAD_LEN + 1 + rng() % (BCMP_FRAG_MAX_MESSAGE_LEN - BCMP_FRAG_PAYLOAD_LEN), round);
+    std::vector<Frame> frames = fragment(0xB2, round, payload);
+    // Every fragment shows up twice in random order
+    std::vector<Frame> rx = frames;
+    rx.insert(rx.end(), frames.begin(), frames.end());
+    std::shuffle(rx.begin(), rx.end(), rng);
+
+    std::vector<uint8_t> out;
+    int completed = 0;
+    for (const Frame &frame : rx) {
+      if (add(42, frame, round, out)) {
+        EXPECT_EQ(out, payload);
+        completed++;
+      }
+    }
+    // Late duplicates start a new reassembly that never completes
+    bcmp_frag_evict(&pool, round + BCMP_FRAG_TIMEOUT_MS + 1);
+    EXPECT_GE(completed, 1);
+    EXPECT_EQ(pool.bytes_in_use, 0u);
+  }
+}
+
+TEST_F(BcmpFragTest, Interleaved) {
+  // Same type and sequence number from different nodes, and different sequence numbers from one node
+  std::vector<uint8_t> payload_a = makePayload(2 * BCMP_FRAG_PAYLOAD_LEN, 3);
+  std::vector<uint8_t> payload_b = makePayload(2 * BCMP_FRAG_PAYLOAD_LEN + 5, 4);
+  std::vector<uint8_t> payload_c = makePayload(BCMP_FRAG_PAYLOAD_LEN + 5, 5);
+  std::vector<Frame> a = fragment(0xB3, 1, payload_a);
+  std::vector<Frame> b = fragment(0xB3, 1, payload_b);
+  std::vector<Frame> c = fragment(0xB3, 2, payload_c);
+
+  std::vector<uint8_t> out;
+  EXPECT_FALSE(add(1, a[1], 0, out));
+  EXPECT_FALSE(add(2, b[0], 0, out));
+  EXPECT_FALSE(add(1, c[1], 0, out));
+  EXPECT_FALSE(add(2, b[2], 0, out));
+  EXPECT_TRUE(add(1, c[0], 0, out));
+  EXPECT_EQ(out, payload_c);
+  EXPECT_TRUE(add(1, a[0], 0, out));
+  EXPECT_EQ(out, payload_a);
+  EXPECT_TRUE(add(2, b[1], 0, out));
+  EXPECT_EQ(out, payload_b);
+  EXPECT_EQ(pool.bytes_in_use, 0u);
+}
+
+TEST_F(BcmpFragTest, LostFragmentEvicted) {
+  std::vector<uint8_t> payload = makePayload(3 * BCMP_FRAG_PAYLOAD_LEN, 6);
+  std::vector<Frame> frames = fragment(0xB4, 9, payload);
+  std::vector<uint8_t> out;
+  EXPECT_FALSE(add(1, frames[0], 1000, out));
+  EXPECT_FALSE(add(1, frames[2], 1000, out));
+  EXPECT_GT(pool.bytes_in_use, 0u);
+
+  bcmp_frag_evict(&pool, 1000 + BCMP_FRAG_TIMEOUT_MS);
+  EXPECT_GT(pool.bytes_in_use, 0u);
+  bcmp_frag_evict(&pool, 1000 + BCMP_FRAG_TIMEOUT_MS + 1);
+  EXPECT_EQ(pool.bytes_in_use, 0u);
+  EXPECT_EQ(pool.evicted, 1u);
+
+  // The retransmitted message goes through from scratch
+  for (size_t idx = 0; idx < frames.size(); idx++) {
+    EXPECT_EQ(add(1, frames[idx], 2000, out), idx == frames.size() - 1);
+  }
+  EXPECT_EQ(out, payload);
+}
+
+TEST_F(BcmpFragTest, Malformed) {
+  std::vector<uint8_t> payload = makePayload(2 * BCMP_FRAG_PAYLOAD_LEN, 7);
+  std::vector<Frame> frames = fragment(0xB5, 1, payload);
+  std::vector<uint8_t> out;
+
+  Frame frame = frames[0];
+  bcmp_header_t *header = reinterpret_cast<bcmp_header_t *>(frame.buf.data());
+  header->frag_total = 1;
+  EXPECT_FALSE(add(1, frame, 0, out));
+  header->frag_total = BCMP_FRAG_MAX_FRAGMENTS + 1;
+  EXPECT_FALSE(add(1, frame, 0, out));
+  header->frag_total = 2;
+  header->frag_id = 2;
+  EXPECT_FALSE(add(1, frame, 0, out));
+
+  // Only the last fragment may be short
+  header->frag_id = 0;
+  frame.buf.pop_back();
+  EXPECT_FALSE(add(1, frame, 0, out));
+  Frame last = frames[1];
+  last.buf.push_back(0);
+  EXPECT_FALSE(add(1, last, 0, out));
+
+  EXPECT_EQ(pool.dropped, 5u);
+  EXPECT_EQ(pool.bytes_in_use, 0u);
+
+  // Fragment count changing mid message
+  EXPECT_FALSE(add(1, frames[0], 0, out));
+  Frame other = fragment(0xB5, 1, makePayload(3 * BCMP_FRAG_PAYLOAD_LEN, 8))[1];
+  EXPECT_FALSE(add(1, other, 0, out));
+  EXPECT_EQ(pool.dropped, 6u);
+  EXPECT_TRUE(add(1, frames[1], 0, out));
+  EXPECT_EQ(out, payload);
+}
+
+TEST_F(BcmpFragTest, PoolLimits) {
+  std::vector<uint8_t> out;
+  std::vector<std::vector<Frame>> messages;
+  for (uint32_t msg = 0; msg <= BCMP_FRAG_POOL_LEN; msg++) {
+    messages.push_back(fragment(0xB6, msg, makePayload(2 * BCMP_FRAG_PAYLOAD_LEN, msg)));
+  }
+  for (uint32_t msg = 0; msg < BCMP_FRAG_POOL_LEN; msg++) {
+    EXPECT_FALSE(add(1, messages[msg][0], 0, out));
+  }
+  // No free slot
+  EXPECT_FALSE(add(1, messages[BCMP_FRAG_POOL_LEN][0], 0, out));
+  EXPECT_EQ(pool.dropped, 1u);
+  EXPECT_LE(pool.bytes_high_water, BCMP_FRAG_MAX_BYTES);
+
+  // The memory budget holds even with free slots
+  bcmp_frag_evict(&pool, BCMP_FRAG_TIMEOUT_MS + 1);
+  EXPECT_EQ(pool.bytes_in_use, 0u);
+  uint32_t big_len = sizeof(bcmp_header_t) + BCMP_FRAG_MAX_MESSAGE_LEN;
+  uint32_t fits = BCMP_FRAG_MAX_BYTES / big_len;
+  ASSERT_LT(fits, static_cast<uint32_t>(BCMP_FRAG_POOL_LEN));
+  for (uint32_t msg = 0; msg <= fits; msg++) {
+    std::vector<Frame> big = fragment(0xB6, 100 + msg, makePayload(BCMP_FRAG_MAX_MESSAGE_LEN, msg));
+    EXPECT_FALSE(add(1, big[0], 1000, out));
+  }
+  EXPECT_EQ(pool.bytes_in_use, fits * big_len);
+  EXPECT_EQ(pool.dropped, 2u);
+  bcmp_frag_evict(&pool, 1000 + BCMP_FRAG_TIMEOUT_MS + 1);
+  EXPECT_EQ(pool.bytes_in_use, 0u);
+}
+
+TEST_F(BcmpFragTest, HighWaterMark) {
+  // Four senders streaming large replies at once: fragments interleaved between senders,
+  // neighbours occasionally swapped and 2% lost
+  static constexpr uint32_t NUM_SENDERS = 4;
+  static constexpr uint32_t MSGS_PER_SENDER = 250;
+  std::mt19937 rng(9);
+  uint32_t now_ms = 0;
+  uint32_t sent = 0;
+  uint32_t completed = 0;
+  uint32_t lost_msgs = 0;
+  uint64_t payload_bytes = 0;
+
+  for (uint32_t msg = 0; msg < MSGS_PER_SENDER; msg++) {
+    std::vector<std::vector<std::pair<uint64_t, Frame>>> streams(NUM_SENDERS);
+    for (uint64_t src = 0; src < NUM_SENDERS; src++) {
+      std::vector<uint8_t> payload = makePayload(BCMP_FRAG_PAYLOAD_LEN + 1 + rng() % (3 * BCMP_FRAG_PAYLOAD_LEN), sent);
+      bool lost = false;
+      for (const Frame &frame : fragment(0xB7, msg, payload)) {
+        if (rng() % 50 == 0) {
+          lost = true;
+          continue;
+        }
+        streams[src].push_back({src, frame});
+      }
+      lost_msgs += lost;
+      payload_bytes += payload.size();
+      sent++;
+    }
+    std::vector<std::pair<uint64_t, Frame>> rx;
+    for (size_t idx = 0; idx < BCMP_FRAG_MAX_FRAGMENTS; idx++) {
+      for (auto &stream : streams) {
+        if (idx < stream.size()) {
+          rx.push_back(stream[idx]);
+        }
+      }
+    }
+    for (size_t idx = 1; idx < rx.size(); idx++) {
+      if (rng() % 8 == 0) {
+        std::swap(rx[idx - 1], rx[idx]);
+      }
+    }
+    for (auto &frame : rx) {
+      std::vector<uint8_t> out;
+      now_ms++;
+      if (add(frame.first, frame.second, now_ms, out)) {
+        completed++;
+      }
+    }
+  }
+  bcmp_frag_evict(&pool, now_ms + BCMP_FRAG_TIMEOUT_MS + 1);
+
+  printf("%u messages (%.0f bytes avg) from %u senders, %u with a lost fragment\n", sent,
+         static_cast<double>(payload_bytes) / sent, NUM_SENDERS, lost_msgs);
+  printf("  completed %u, evicted %u, fragments dropped for lack of room %u\n", completed, pool.evicted, pool.dropped);
+  printf("  reassembly high water mark %u bytes (budget %u)\n", pool.bytes_high_water, BCMP_FRAG_MAX_BYTES);
+  EXPECT_LE(completed + lost_msgs, sent);
+  // Almost everything without a lost fragment makes it
+  EXPECT_GE(completed, (sent - lost_msgs) * 95 / 100);
+  EXPECT_LE(pool.bytes_high_water, BCMP_FRAG_MAX_BYTES);
+  EXPECT_EQ(pool.bytes_in_use, 0u);
+}
@@ -0,0 +1,308 @@
+#include "gtest/gtest.h"
+
+#include <deque>
+#include <vector>
+
+#include "bcmp_fwd_table.h"
+
+static constexpr uint64_t BASE_NODE_ID = 0xc0ffee0000000000;
+
+// The fixture for testing class Foo.
+class BcmpFwdTableTest : public ::testing::Test {
+protected:
+  // You can remove any or all of the following functions if its body
+  // is empty.
+
+  BcmpFwdTableTest() {
+    // You can do set-up work for each test here.
+  }
+
+  ~BcmpFwdTableTest() override {
+    // You can do clean-up work that doesn't throw exceptions here.
+  }
+
+  // If the constructor and destructor are not enough for setting up
+  // and cleaning up each test, you can define the following methods:
+
+  void SetUp() override {
+    // Code here will be called immediately after the constructor (right
+    // before each test).
+    bcmp_fwd_table_init(&table);
+  }
+
+  void TearDown() override {
+    // Code here will be called immediately after each test (right
+    // before the destructor).
+  }
+
+  // Objects declared here can be used by all tests in the test suite for Foo.
+  bcmp_fwd_table_t table;
+
+  // Builds an ipv6 packet the way bcmp_tx() sends it: link-local source, ff02::1 destination
+  static std::vector<uint8_t> packet(uint64_t src_node_id, uint16_t type, const std::vector<uint8_t> &payload) {
+    std::vector<uint8_t> buf(40 + sizeof(bcmp_header_t) + payload.size(), 0);
+    buf[0] = 0x60;
+    buf[6] = 0xBC;
+    buf[8] = 0xFE;
+    buf[9] = 0x80;
+    for (int byte = 0; byte < 8; byte++) {
+      buf[16 + byte] = static_cast<uint8_t>(src_node_id >> (56 - 8 * byte));
+    }
+    buf[24] = 0xFF;
+    buf[25] = 0x02;
+    buf[39] = 0x01;
+    bcmp_header_t *header = reinterpret_cast<bcmp_header_t *>(&buf[40]);
+    header->type = type;
+    memcpy(header->payload, payload.data(), payload.size());
+    return buf;
+  }
+
+  static std::vector<uint8_t> configGet(uint64_t src_node_id, uint64_t target_node_id) {
+    // target, source, partition, key length, key
+    std::vector<uint8_t> payload(8 + 8 + 1 + 1 + 4, 'k');
+    memcpy(&payload[0], &target_node_id, sizeof(target_node_id));
+    memcpy(&payload[8], &src_node_id, sizeof(src_node_id));
+    return packet(src_node_id, BCMP_CONFIG_GET, payload);
+  }
+
+  static std::vector<uint8_t> configValue(uint64_t src_node_id, uint64_t target_node_id) {
+    std::vector<uint8_t> payload(8 + 8 + 1 + 4, 'v');
+    memcpy(&payload[0], &target_node_id, sizeof(target_node_id));
+    memcpy(&payload[8], &src_node_id, sizeof(src_node_id));
+    return packet(src_node_id, BCMP_CONFIG_VALUE, payload);
+  }
+
+  static std::vector<uint8_t> heartbeat(uint64_t src_node_id) {
+    return packet(src_node_id, BCMP_HEARTBEAT, std::vector<uint8_t>(sizeof(bcmp_heartbeat_t), 0));
+  }
+
+  /*
+    String of nodes, port 1 of every node goes towards node 0 and port 2
+    towards the end of the string.
+  */
+  struct Chain {
+    Chain(uint8_t num_nodes, bool routing) : tables(num_nodes), deliveries(num_nodes, 0), routing(routing) {
+      for (auto &node_table : tables) {
+        bcmp_fwd_table_init(&node_table);
+      }
+    }
+
+    std::vector<bcmp_fwd_table_t> tables;
+    // Frames handed up to a node's BCMP task
+    std::vector<uint32_t> deliveries;
+    uint32_t frames_on_wire = 0;
+    bool routing;
+    uint32_t now_ms = 0;
+
+    struct InFlight {
+      uint8_t node;
+      uint8_t ingress_port;
+      std::vector<uint8_t> buf;
+    };
+    std::deque<InFlight> wire;
+
+    static uint64_t nodeId(uint8_t idx) { return BASE_NODE_ID + idx; }
+
+    void sendOut(uint8_t node, uint8_t port, const std::vector<uint8_t> &buf) {
+      if (port == 1 && node > 0) {
+        wire.push_back({static_cast<uint8_t>(node - 1), 2, buf});
+        frames_on_wire++;
+      } else if (port == 2 && node < tables.size() - 1) {
+        wire.push_back({static_cast<uint8_t>(node + 1), 1, buf});
+        frames_on_wire++;
+      }
+    }
+
+    // Sends a frame from a node out of both ports and runs the network until it is quiet
+    void send(uint8_t node, const std::vector<uint8_t> &buf) {
+      sendOut(node, 1, buf);
+      sendOut(node, 2, buf);
+      while (!wire.empty()) {
+        InFlight frame = wire.front();
+        wire.pop_front();
+        receive(frame);
+      }
+    }
+
+    void receive(const InFlight &frame) {
+      uint8_t egress_port = 0;
+      bcmp_fwd_action_e action = BCMP_FWD_DELIVER;
+      if (routing) {
+        action = bcmp_fwd_process(&tables[frame.node], nodeId(frame.node), frame.buf.data(),
+                                  static_cast<uint16_t>(frame.buf.size()), frame.ingress_port, now_ms, &egress_port);
+      }
+      if (action == BCMP_FWD_FORWARD) {
+        sendOut(frame.node, egress_port, frame.buf);
+        return;
+      }
+      if (action == BCMP_FWD_DROP) {
+        return;
+      }
+
+      // Like bcmp_process_config_message(), messages for other nodes are flooded on
+      deliveries[frame.node]++;
+      const bcmp_header_t *header = reinterpret_cast<const bcmp_header_t *>(&frame.buf[40]);
+      uint64_t target_node_id;
+      if (bcmp_fwd_target(header, static_cast<uint16_t>(frame.buf.size() - 40 - sizeof(bcmp_header_t)), &target_node_id) &&
+          target_node_id != nodeId(frame.node)) {
+        sendOut(frame.node, frame.ingress_port == 1 ? 2 : 1, frame.buf);
+      }
+    }
+
+    uint32_t totalDeliveries() const {
+      uint32_t total = 0;
+      for (uint32_t count : deliveries) {
+        total += count;
+      }
+      return total;
+    }
+  };
+};
+
+TEST_F(BcmpFwdTableTest, LearnLookup) {
+  EXPECT_EQ(bcmp_fwd_table_lookup(&table, BASE_NODE_ID, 0), 0);
+  bcmp_fwd_table_learn(&table, BASE_NODE_ID, 1, 0);
+  bcmp_fwd_table_learn(&table, BASE_NODE_ID + 1, 2, 0);
+  EXPECT_EQ(bcmp_fwd_table_lookup(&table, BASE_NODE_ID, 0), 1);
+  EXPECT_EQ(bcmp_fwd_table_lookup(&table, BASE_NODE_ID + 1, 0), 2);
+  EXPECT_EQ(bcmp_fwd_table_count(&table), 2);
+
+  // Nodes can move
+  bcmp_fwd_table_learn(&table, BASE_NODE_ID, 2, 10);
+  EXPECT_EQ(bcmp_fwd_table_lookup(&table, BASE_NODE_ID, 10), 2);
+  EXPECT_EQ(bcmp_fwd_table_count(&table), 2);
+
+  // Entries go stale
+  EXPECT_EQ(bcmp_fwd_table_lookup(&table, BASE_NODE_ID, 10 + BCMP_FWD_ENTRY_TIMEOUT_MS), 2);
+  EXPECT_EQ(bcmp_fwd_table_lookup(&table, BASE_NODE_ID, 10 + BCMP_FWD_ENTRY_TIMEOUT_MS + 1), 0);
+
+  // Node 0 and port 0 are not learned
+  bcmp_fwd_table_learn(&table, 0, 1, 0);
+  bcmp_fwd_table_learn(&table, BASE_NODE_ID + 2, 0, 0);
+  EXPECT_EQ(bcmp_fwd_table_count(&table), 2);
+}
+
+TEST_F(BcmpFwdTableTest, FlushPort) {
+  // Colliding ids exercise the backward shift deletion
+  for (uint64_t node = 0; node < 40; node++) {
+    bcmp_fwd_table_learn(&table, BASE_NODE_ID + node * BCMP_FWD_TABLE_LEN / 4, (node % 2) + 1, 0);
+  }
+  EXPECT_EQ(bcmp_fwd_table_count(&table), 40);
+  bcmp_fwd_table_flush_port(&table, 1);
+  EXPECT_EQ(bcmp_fwd_table_count(&table), 20);
+  for (uint64_t node = 0; node < 40; node++) {
+    EXPECT_EQ(bcmp_fwd_table_lookup(&table, BASE_NODE_ID + node * BCMP_FWD_TABLE_LEN / 4, 0), (node % 2) ? 2 : 0);
+  }
+}
+
+TEST_F(BcmpFwdTableTest, Full) {
+  for (uint64_t node = 1; node <= BCMP_FWD_MAX_NODES; node++) {
+    bcmp_fwd_table_learn(&table, node, 1, 0);
+  }
+  EXPECT_EQ(bcmp_fwd_table_count(&table), BCMP_FWD_MAX_NODES);
+  bcmp_fwd_table_learn(&table, BCMP_FWD_MAX_NODES + 1, 1, 0);
+  EXPECT_EQ(bcmp_fwd_table_lookup(&table, BCMP_FWD_MAX_NODES + 1, 0), 0);
+
+  // Stale entries make room, fresh ones stay
+  bcmp_fwd_table_learn(&table, 1, 2, BCMP_FWD_ENTRY_TIMEOUT_MS);
+  bcmp_fwd_table_learn(&table, BCMP_FWD_MAX_NODES + 1, 1, BCMP_FWD_ENTRY_TIMEOUT_MS + 1);
+  EXPECT_EQ(bcmp_fwd_table_count(&table), 2);
+  EXPECT_EQ(bcmp_fwd_table_lookup(&table, 1, BCMP_FWD_ENTRY_TIMEOUT_MS + 1), 2);
+  EXPECT_EQ(bcmp_fwd_table_lookup(&table, BCMP_FWD_MAX_NODES + 1, BCMP_FWD_ENTRY_TIMEOUT_MS + 1), 1);
+}
+
+TEST_F(BcmpFwdTableTest, Process) {
+  static constexpr uint64_t SELF = BASE_NODE_ID + 100;
+  uint8_t egress_port = 0;
+
+  // Anything teaches the table where its sender is
+  std::vector<uint8_t> hb = heartbeat(BASE_NODE_ID + 1);
+  EXPECT_EQ(bcmp_fwd_process(&table, SELF, hb.data(), hb.size(), 2, 0, &egress_port), BCMP_FWD_DELIVER);
+  EXPECT_EQ(bcmp_fwd_table_lookup(&table, BASE_NODE_ID + 1, 0), 2);
+
+  // Unknown target is flooded by the BCMP task
+  std::vector<uint8_t> get = configGet(BASE_NODE_ID + 2, BASE_NODE_ID + 3);
+  EXPECT_EQ(bcmp_fwd_process(&table, SELF, get.data(), get.size(), 1, 0, &egress_port), BCMP_FWD_DELIVER);
+
+  // Known target goes out of its port only
+  get = configGet(BASE_NODE_ID + 2, BASE_NODE_ID + 1);
+  EXPECT_EQ(bcmp_fwd_process(&table, SELF, get.data(), get.size(), 1, 0, &egress_port), BCMP_FWD_FORWARD);
+  EXPECT_EQ(egress_port, 2);
+
+  // Messages for us, and a target behind the ingress port, are delivered
+  get = configGet(BASE_NODE_ID + 2, SELF);
+  EXPECT_EQ(bcmp_fwd_process(&table, SELF, get.data(), get.size(), 1, 0, &egress_port), BCMP_FWD_DELIVER);
+  get = configGet(BASE_NODE_ID + 2, BASE_NODE_ID + 1);
+  EXPECT_EQ(bcmp_fwd_process(&table, SELF, get.data(), get.size(), 2, 0, &egress_port), BCMP_FWD_DELIVER);
+
+  // Time set to every node
+  std::vector<uint8_t> time_payload(sizeof(bcmp_system_time_set_t), 0);
+  std::vector<uint8_t> time_set = packet(BASE_NODE_ID + 2, BCMP_SYSTEM_TIME_SET, time_payload);
+  EXPECT_EQ(bcmp_fwd_process(&table, SELF, time_set.data(), time_set.size(), 1, 0, &egress_port), BCMP_FWD_DELIVER);
+
+  // DFU for another node is not relayed, multicast chunks are delivered
+  std::vector<uint8_t> dfu_payload(sizeof(bcmp_dfu_heartbeat_t), 0);
+  bcmp_dfu_heartbeat_t *dfu_hb = reinterpret_cast<bcmp_dfu_heartbeat_t *>(dfu_payload.data());
+  dfu_hb->addr.dst_node_id = BASE_NODE_ID + 1;
+  std::vector<uint8_t> dfu = packet(BASE_NODE_ID + 2, BCMP_DFU_HEARTBEAT, dfu_payload);
+  EXPECT_EQ(bcmp_fwd_process(&table, SELF, dfu.data(), dfu.size(), 1, 0, &egress_port), BCMP_FWD_DROP);
+  dfu_hb->addr.dst_node_id = 0;
+  dfu = packet(BASE_NODE_ID + 2, BCMP_DFU_PAYLOAD, dfu_payload);
+  EXPECT_EQ(bcmp_fwd_process(&table, SELF, dfu.data(), dfu.size(), 1, 0, &egress_port), BCMP_FWD_DELIVER);
+
+  // Fragments and truncated messages go up untouched
+  get = configGet(BASE_NODE_ID + 2, BASE_NODE_ID + 1);
+  reinterpret_cast<bcmp_header_t *>(&get[40])->frag_total = 2;
+  EXPECT_EQ(bcmp_fwd_process(&table, SELF, get.data(), get.size(), 1, 0, &egress_port), BCMP_FWD_DELIVER);
+  get = configGet(BASE_NODE_ID + 2, BASE_NODE_ID + 1);
+  EXPECT_EQ(bcmp_fwd_process(&table, SELF, get.data(), 40 + sizeof(bcmp_header_t) + 4, 1, 0, &egress_port), BCMP_FWD_DELIVER);
+}
+
+TEST_F(BcmpFwdTableTest, ChainDeliveries) {
+  static constexpr uint8_t NUM_NODES = 16;
+  static constexpr uint8_t HOST = 0;
+  static constexpr uint8_t TARGET = NUM_NODES - 1;
+  static constexpr int NUM_REQUESTS = 20;
+
+  for (bool routing : {false, true}) {
+    Chain chain(NUM_NODES, routing);
+    // Neighbors hear each other's heartbeats
+    for (uint8_t node = 0; node < NUM_NODES; node++) {
+      chain.send(node, heartbeat(Chain::nodeId(node)));
+    }
+    std::fill(chain.deliveries.begin(), chain.deliveries.end(), 0);
+    chain.frames_on_wire = 0;
+
+    // Config get/reply between the ends of the string
+    for (int request = 0; request < NUM_REQUESTS; request++) {
+      chain.now_ms += 100;
+      chain.send(HOST, configGet(Chain::nodeId(HOST), Chain::nodeId(TARGET)));
+      chain.send(TARGET, configValue(Chain::nodeId(TARGET), Chain::nodeId(HOST)));
+    }
+
+    EXPECT_EQ(chain.deliveries[HOST], static_cast<uint32_t>(NUM_REQUESTS));
+    EXPECT_EQ(chain.deliveries[TARGET], static_cast<uint32_t>(NUM_REQUESTS));
+    uint32_t intermediate = chain.totalDeliveries() - chain.deliveries[HOST] - chain.deliveries[TARGET];
+    printf("%2u node string, %d config requests and replies, %s: %4u frames on the wire, %4u BCMP task wakeups on intermediate nodes\n",
+           NUM_NODES, NUM_REQUESTS, routing ? "learned routes" : "flooding      ", chain.frames_on_wire, intermediate);
+    if (routing) {
+      // Only the first request is flooded, and not past the target's neighbor which knows it from
+      // its heartbeats. The reply and everything after it is routed.
+      EXPECT_EQ(intermediate, static_cast<uint32_t>(NUM_NODES - 3));
+      EXPECT_EQ(chain.frames_on_wire, 2u * NUM_REQUESTS * (NUM_NODES - 1));
+    } else {
+      EXPECT_EQ(intermediate, 2u * NUM_REQUESTS * (NUM_NODES - 2));
+    }
+  }
+
+  // A link going down sends traffic back to flooding until routes are learned again
+  Chain chain(4, true);
+  chain.send(0, configGet(Chain::nodeId(0), Chain::nodeId(3)));
+  chain.send(3, configValue(Chain::nodeId(3), Chain::nodeId(0)));
+  bcmp_fwd_table_flush_port(&chain.tables[1], 2);
+  std::fill(chain.deliveries.begin(), chain.deliveries.end(), 0);
+  chain.send(0, configGet(Chain::nodeId(0), Chain::nodeId(3)));
+  EXPECT_EQ(chain.deliveries[1], 1u);
+  EXPECT_EQ(chain.deliveries[2], 0u);
+  EXPECT_EQ(chain.deliveries[3], 1u);
+}
@@ -0,0 +1,163 @@
+#include "gtest/gtest.h"
+
+#include <algorithm>
+#include <map>
+#include <random>
+#include <vector>
+
+#include "bcmp_request_table.h"
+
+static bool reply_cb(uint8_t *payload) {
+  (void)payload;
+  return true;
+}
+
+// The fixture for testing class Foo.
+class BcmpRequestTableTest : public ::testing::Test {
+protected:
+  // You can remove any or all of the following functions if its body
+  // is empty.
+
+  BcmpRequestTableTest() {
+    // You can do set-up work for each test here.
+  }
+
+  ~BcmpRequestTableTest() override {
+    // You can do clean-up work that doesn't throw exceptions here.
+  }
+
+  // If the constructor and destructor are not enough for setting up
+  // and cleaning up each test, you can define the following methods:
+
+  void SetUp() override {
+    // Code here will be called immediately after the constructor (right
+    // before each test).
+    bcmp_request_table_init(&table);
+  }
+
+  void TearDown() override {
+    // Code here will be called immediately after each test (right
+    // before the destructor).
+  }
+
+  // Objects declared here can be used by all tests in the test suite for Foo.
+  bcmp_request_table_t table;
+};
+
+TEST_F(BcmpRequestTableTest, AddRemove) {
+  uint32_t deadline_ms;
+  bcmp_request_t request;
+  EXPECT_FALSE(bcmp_request_table_next_deadline(&table, &deadline_ms));
+  EXPECT_FALSE(bcmp_request_table_remove(&table, 5, &request));
+
+  EXPECT_TRUE(bcmp_request_table_add(&table, 5, 0x1234, 1000, 24, reply_cb));
+  EXPECT_TRUE(bcmp_request_table_add(&table, 6, 0x1235, 1000, 10, NULL));
+  EXPECT_EQ(bcmp_request_table_count(&table), 2);
+  EXPECT_TRUE(bcmp_request_table_next_deadline(&table, &deadline_ms));
+  EXPECT_EQ(deadline_ms, 1010u);
+
+  // Same slot, different sequence number
+  EXPECT_FALSE(bcmp_request_table_slot_free(&table, 5 + BCMP_REQUEST_TABLE_LEN));
+  EXPECT_FALSE(bcmp_request_table_add(&table, 5 + BCMP_REQUEST_TABLE_LEN, 0, 1000, 24, NULL));
+  EXPECT_FALSE(bcmp_request_table_remove(&table, 5 + BCMP_REQUEST_TABLE_LEN, &request));
+
+  EXPECT_TRUE(bcmp_request_table_remove(&table, 5, &request));
+  EXPECT_EQ(request.seq_num, 5);
+  EXPECT_EQ(request.type, 0x1234);
+  EXPECT_EQ(request.callback, reply_cb);
+  EXPECT_FALSE(bcmp_request_table_remove(&table, 5, &request));
+  EXPECT_TRUE(bcmp_request_table_remove(&table, 6, NULL));
+  EXPECT_EQ(bcmp_request_table_count(&table), 0);
+  EXPECT_FALSE(bcmp_request_table_next_deadline(&table, &deadline_ms));
+}
+
+TEST_F(BcmpRequestTableTest, Full) {
+  for (uint16_t seq_num = 0; seq_num < BCMP_REQUEST_TABLE_LEN; seq_num++) {
+    EXPECT_TRUE(bcmp_request_table_add(&table, seq_num, 0, 0, 100, NULL));
+  }
+  for (uint16_t seq_num = BCMP_REQUEST_TABLE_LEN; seq_num < 4 * BCMP_REQUEST_TABLE_LEN; seq_num++) {
+    EXPECT_FALSE(bcmp_request_table_slot_free(&table, seq_num));
+  }
+  EXPECT_EQ(bcmp_request_table_count(&table), BCMP_REQUEST_TABLE_LEN);
+}
+
+TEST_F(BcmpRequestTableTest, Expiry) {
+  bcmp_request_t request;
+  EXPECT_TRUE(bcmp_request_table_add(&table, 1, 0, 0, 30, NULL));
+  EXPECT_TRUE(bcmp_request_table_add(&table, 2, 0, 0, 10, NULL));
+  EXPECT_TRUE(bcmp_request_table_add(&table, 3, 0, 0, 20, NULL));
+
+  // Nothing expires until the deadline has passed
+  EXPECT_FALSE(bcmp_request_table_pop_expired(&table, 10, &request));
+  EXPECT_TRUE(bcmp_request_table_pop_expired(&table, 25, &request));
+  EXPECT_EQ(request.seq_num, 2);
+  EXPECT_TRUE(bcmp_request_table_pop_expired(&table, 25, &request));
+  EXPECT_EQ(request.seq_num, 3);
+  EXPECT_FALSE(bcmp_request_table_pop_expired(&table, 25, &request));
+  EXPECT_EQ(bcmp_request_table_count(&table), 1);
+}
+
+TEST_F(BcmpRequestTableTest, ClockWrap) {
+  bcmp_request_t request;
+  uint32_t deadline_ms;
+  EXPECT_TRUE(bcmp_request_table_add(&table, 1, 0, UINT32_MAX - 5, 20, NULL));
+  EXPECT_TRUE(bcmp_request_table_add(&table, 2, 0, UINT32_MAX - 5, 2, NULL));
+  EXPECT_TRUE(bcmp_request_table_next_deadline(&table, &deadline_ms));
+  EXPECT_EQ(deadline_ms, UINT32_MAX - 3);
+  EXPECT_TRUE(bcmp_request_table_pop_expired(&table, 1, &request));
+  EXPECT_EQ(request.seq_num, 2);
+  EXPECT_FALSE(bcmp_request_table_pop_expired(&table, 1, &request));
+  EXPECT_TRUE(bcmp_request_table_pop_expired(&table, 15, &request));
+  EXPECT_EQ(request.seq_num, 1);
+}
+
+TEST_F(BcmpRequestTableTest, Churn) {
+  // Random adds, replies and expirations checked against a simple model
+  std::mt19937 rng(1234);
+  std::map<uint16_t, uint32_t> outstanding;
+  uint32_t now_ms = UINT32_MAX - 50000;
+  uint16_t next_seq_num = 0;
+
+  for (int i = 0; i < 200000; i++) {
+    switch (rng() % 3) {
+      case 0: {
+        uint16_t seq_num = next_seq_num++;
+        uint32_t timeout_ms = rng() % 100;
+        bool free_slot = bcmp_request_table_slot_free(&table, seq_num);
+        EXPECT_EQ(bcmp_request_table_add(&table, seq_num, 0, now_ms, timeout_ms, NULL), free_slot);
+        if (free_slot) {
+          outstanding[seq_num] = now_ms + timeout_ms;
+        }
+        break;
+      }
+      case 1: {
+        uint16_t seq_num = static_cast<uint16_t>(next_seq_num - 1 - rng() % (2 * BCMP_REQUEST_TABLE_LEN));
+        bcmp_request_t request;
+        bool found = outstanding.erase(seq_num);
+        EXPECT_EQ(bcmp_request_table_remove(&table, seq_num, &request), found);
+        break;
+      }
+      default: {
+        now_ms += rng() % 10;
+        bcmp_request_t request;
+        uint32_t last_deadline_ms = 0;
+        bool first = true;
+        while (bcmp_request_table_pop_expired(&table, now_ms, &request)) {
+          ASSERT_EQ(outstanding.count(request.seq_num), 1u);
+          EXPECT_EQ(outstanding[request.seq_num], request.deadline_ms);
+          EXPECT_LT(static_cast<int32_t>(request.deadline_ms - now_ms), 0);
+          // Expired in deadline order
+          EXPECT_TRUE(first || static_cast<int32_t>(request.deadline_ms - last_deadline_ms) >= 0);
+          first = false;
+          last_deadline_ms = request.deadline_ms;
+          outstanding.erase(request.seq_num);
+        }
+        for (auto &entry : outstanding) {
+          EXPECT_GE(static_cast<int32_t>(entry.second - now_ms), 0);
+        }
+        break;
+      }
+    }
+    ASSERT_EQ(bcmp_request_table_count(&table), outstanding.size());
+  }
+}
@@ -0,0 +1,259 @@
+#include "gtest/gtest.h"
+
+#include <algorithm>
+#include <map>
+#include <set>
+#include <vector>
+
+#include "bcmp_topology_bfs.h"
+
+// Same as BCMP_TOPO_TIMEOUT_S in bcmp_topology.cpp
+static constexpr uint32_t DFS_TIMEOUT_MS = 1000;
+// One way latency of a hop and the time a node takes to answer
+static constexpr uint32_t HOP_MS = 1;
+static constexpr uint32_t REPLY_MS = 2;
+static constexpr uint64_t BASE_NODE_ID = 0xdead000000000000;
+
+/*
+  Simulated string of nodes. Every node has two ports, port 1 goes towards
+  node 0 and port 2 towards the end of the string.
+*/
+class SimChain {
+public:
+  SimChain(uint8_t num_nodes, uint8_t root) : num_nodes(num_nodes), root(root) {}
+
+  uint8_t num_nodes;
+  uint8_t root;
+  std::set<uint8_t> dead;
+  // (node, attempt) pairs whose reply is lost
+  std::set<std::pair<uint8_t, uint8_t>> lost;
+  std::map<uint8_t, uint8_t> attempts;
+
+  static uint64_t nodeId(uint8_t idx) { return BASE_NODE_ID + idx; }
+  static uint8_t nodeIdx(uint64_t node_id) { return static_cast<uint8_t>(node_id - BASE_NODE_ID); }
+
+  uint32_t rttMs(uint8_t idx) const {
+    uint32_t hops = (idx > root) ? idx - root : root - idx;
+    return 2 * hops * HOP_MS + REPLY_MS;
+  }
+
+  // Returns whether the request is answered, counting attempts per node
+  bool answers(uint8_t idx) {
+    uint8_t attempt = ++attempts[idx];
+    return !dead.count(idx) && !lost.count({idx, attempt});
+  }
+
+  bcmp_neighbor_table_reply_t *table(uint8_t idx) const {
+    uint16_t num_neighbors = (idx > 0) + (idx < num_nodes - 1);
+    size_t len = sizeof(bcmp_neighbor_table_reply_t) + 2 * sizeof(bcmp_port_info_t) + num_neighbors * sizeof(bcmp_neighbor_info_t);
+    bcmp_neighbor_table_reply_t *reply = static_cast<bcmp_neighbor_table_reply_t *>(malloc(len));
+    memset(reply, 0, len);
+    reply->node_id = nodeId(idx);
+    reply->port_len = 2;
+    reply->neighbor_len = num_neighbors;
+    reply->port_list[0].state = idx > 0;
+    reply->port_list[1].state = idx < num_nodes - 1;
+    bcmp_neighbor_info_t *neighbor_info = reinterpret_cast<bcmp_neighbor_info_t *>(&reply->port_list[2]);
+    uint16_t neighbor = 0;
+    if (idx > 0) {
+      neighbor_info[neighbor++] = {nodeId(idx - 1), 1, 1};
+    }
+    if (idx < num_nodes - 1) {
+      neighbor_info[neighbor++] = {nodeId(idx + 1), 2, 1};
+    }
+    return reply;
+  }
+};
+
+// The fixture for testing class Foo.
+class BcmpTopologyBfsTest : public ::testing::Test {
+protected:
+  // You can remove any or all of the following functions if its body
+  // is empty.
+
+  BcmpTopologyBfsTest() {
+    // You can do set-up work for each test here.
+  }
+
+  ~BcmpTopologyBfsTest() override {
+    // You can do clean-up work that doesn't throw exceptions here.
+  }
+
+  // If the constructor and destructor are not enough for setting up
+  // and cleaning up each test, you can define the following methods:
+
+  void SetUp() override {
+    // Code here will be called immediately after the constructor (right
+    // before each test).
+  }
+
+  void TearDown() override {
+    // Code here will be called immediately after each test (right
+    // before the destructor).
+  }
+
+  // Objects declared here can be used by all tests in the test suite for Foo.
+  struct BfsSim {
+    SimChain *chain;
+    uint32_t now_ms;
+    // Reply arrival time -> node
+    std::multimap<uint32_t, uint8_t> in_flight;
+  };
+
+  static bool request(uint64_t node_id, void *arg) {
+    BfsSim *sim = static_cast<BfsSim *>(arg);
+    uint8_t idx = SimChain::nodeIdx(node_id);
+    if (sim->chain->answers(idx)) {
+      sim->in_flight.insert({sim->now_ms + sim->chain->rttMs(idx), idx});
+    }
+    return true;
+  }
+
+  // Runs the breadth-first search, returns discovery time and the discovered chain
+  static uint32_t runBfs(SimChain &chain, std::vector<uint64_t> &order) {
+    BfsSim sim = {&chain, 0, {}};
+    bcmp_topo_bfs_t bfs;
+    bcmp_topo_bfs_init(&bfs, request, &sim);
+    bcmp_topo_bfs_start(&bfs, chain.table(chain.root), sim.now_ms);
+
+    while (!bcmp_topo_bfs_done(&bfs)) {
+      uint32_t deadline_ms;
+      EXPECT_TRUE(bcmp_topo_bfs_next_deadline(&bfs, &deadline_ms));
+      if (!sim.in_flight.empty() && sim.in_flight.begin()->first < deadline_ms) {
+        sim.now_ms = sim.in_flight.begin()->first;
+        uint8_t idx = sim.in_flight.begin()->second;
+        sim.in_flight.erase(sim.in_flight.begin());
+        bcmp_neighbor_table_reply_t *reply = chain.table(idx);
+        if (!bcmp_topo_bfs_add_reply(&bfs, reply, sim.now_ms)) {
+          free(reply);
+        }
+      } else {
+        sim.now_ms = deadline_ms;
+        bcmp_topo_bfs_check_timeouts(&bfs, sim.now_ms);
+      }
+    }
+
+    bcmp_neighbor_table_reply_t *tables[BCMP_TOPO_BFS_MAX_NODES];
+    uint8_t len = bcmp_topo_bfs_take_chain(&bfs, tables, BCMP_TOPO_BFS_MAX_NODES);
+    order.clear();
+    for (uint8_t idx = 0; idx < len; idx++) {
+      order.push_back(tables[idx]->node_id);
+      free(tables[idx]);
+    }
+    bcmp_topo_bfs_deinit(&bfs);
+    return sim.now_ms;
+  }
+
+  // Models bcmp_topology_thread(): one request at a time, a lost reply costs
+  // BCMP_TOPO_TIMEOUT_S and ends that branch
+  static uint32_t runDfs(SimChain &chain, size_t &found) {
+    uint32_t now_ms = 0;
+    found = 1;
+    for (int direction : {-1, 1}) {
+      for (int idx = chain.root + direction; idx >= 0 && idx < chain.num_nodes; idx += direction) {
+        if (!chain.answers(static_cast<uint8_t>(idx))) {
+          now_ms += DFS_TIMEOUT_MS;
+          break;
+        }
+        now_ms += chain.rttMs(static_cast<uint8_t>(idx));
+        found++;
+      }
+    }
+    return now_ms;
+  }
+
+  static std::vector<uint64_t> expectedOrder(const SimChain &chain, const std::set<uint8_t> &missing) {
+    // The root's first neighbor (towards node 0 unless the root is node 0) follows the root,
+    // the other side comes first
+    std::vector<uint64_t> order;
+    for (int idx = 0; idx < chain.num_nodes; idx++) {
+      if (!missing.count(static_cast<uint8_t>(idx))) {
+        order.push_back(SimChain::nodeId(static_cast<uint8_t>(idx)));
+      }
+    }
+    if (chain.root) {
+      std::reverse(order.begin(), order.end());
+    }
+    return order;
+  }
+};
+
+TEST_F(BcmpTopologyBfsTest, ChainOrder) {
+  SimChain chain(32, 10);
+  std::vector<uint64_t> order;
+  runBfs(chain, order);
+  EXPECT_EQ(order, expectedOrder(chain, {}));
+  for (uint8_t idx = 0; idx < chain.num_nodes; idx++) {
+    EXPECT_EQ(chain.attempts[idx], idx == chain.root ? 0 : 1);
+  }
+
+  // A lone node is done right away
+  SimChain lone(1, 0);
+  EXPECT_EQ(runBfs(lone, order), 0u);
+  EXPECT_EQ(order, std::vector<uint64_t>{SimChain::nodeId(0)});
+}
+
+TEST_F(BcmpTopologyBfsTest, LostRepliesAreRetried) {
+  SimChain chain(32, 0);
+  chain.lost = {{5, 1}, {20, 1}};
+  chain.dead = {31};
+  std::vector<uint64_t> order;
+  runBfs(chain, order);
+  EXPECT_EQ(order, expectedOrder(chain, {31}));
+  EXPECT_EQ(chain.attempts[5], 2);
+  EXPECT_EQ(chain.attempts[20], 2);
+  EXPECT_EQ(chain.attempts[31], BCMP_TOPO_BFS_MAX_ATTEMPTS);
+}
+
+TEST_F(BcmpTopologyBfsTest, AdaptiveTimeout) {
+  SimChain chain(32, 0);
+  chain.dead = {31};
+  std::vector<uint64_t> order;
+  uint32_t elapsed_ms = runBfs(chain, order);
+  uint32_t healthy_ms = 0;
+  for (uint8_t idx = 1; idx < 31; idx++) {
+    healthy_ms += chain.rttMs(idx);
+  }
+  // Giving up on the dead node takes a few of its round trip times, not the fixed timeout
+  EXPECT_LT(elapsed_ms - healthy_ms, BCMP_TOPO_BFS_MAX_ATTEMPTS * 4 * chain.rttMs(31));
+}
+
+TEST_F(BcmpTopologyBfsTest, DiscoveryTime) {
+  struct Scenario {
+    const char *name;
+    uint8_t root;
+    std::set<uint8_t> dead;
+    std::set<std::pair<uint8_t, uint8_t>> lost;
+  };
+  const std::vector<Scenario> scenarios = {
+    {"root at end", 0, {}, {}},
+    {"root in middle", 16, {}, {}},
+    {"root at end, dead last node", 0, {31}, {}},
+    {"root in middle, dead end nodes", 16, {0, 31}, {}},
+    {"root at end, 3 lost replies", 0, {}, {{4, 1}, {12, 1}, {25, 1}}},
+  };
+
+  printf("32 node chain, %ums per hop, %ums to reply\n", HOP_MS, REPLY_MS);
+  for (const Scenario &scenario : scenarios) {
+    SimChain dfs_chain(32, scenario.root);
+    dfs_chain.dead = scenario.dead;
+    dfs_chain.lost = scenario.lost;
+    size_t dfs_found;
+    uint32_t dfs_ms = runDfs(dfs_chain, dfs_found);
+
+    SimChain bfs_chain(32, scenario.root);
+    bfs_chain.dead = scenario.dead;
+    bfs_chain.lost = scenario.lost;
+    std::vector<uint64_t> order;
+    uint32_t bfs_ms = runBfs(bfs_chain, order);
+
+    printf("  %-32s depth-first %5ums (%2zu nodes)  breadth-first %5ums (%2zu nodes)\n", scenario.name,
+           dfs_ms, dfs_found, bfs_ms, order.size());
+    // A lost reply ends a depth-first branch early, so only compare times when both found everything
+    if (dfs_found == order.size()) {
+      EXPECT_LE(bfs_ms, dfs_ms);
+    }
+    EXPECT_GE(order.size(), dfs_found);
+    EXPECT_EQ(order.size(), 32 - scenario.dead.size());
+  }
+}
@@ -0,0 +1,306 @@
+#include "gtest/gtest.h"
+
+#include <random>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "bm_dfu_delta.h"
+#include "crc.h"
+
+static constexpr size_t CHUNK_SIZE = 512;
+static constexpr size_t MATCH_BLOCK = 16;
+static constexpr uint32_t BASE_SHA = 0xC0FFEE00;
+
+// The fixture for testing class Foo.
+class DeltaTest : public ::testing::Test {
+protected:
+  // You can remove any or all of the following functions if its body
+  // is empty.
+
+  DeltaTest() {
+    // You can do set-up work for each test here.
+  }
+
+  ~DeltaTest() override {
+    // You can do clean-up work that doesn't throw exceptions here.
+  }
+
+  // If the constructor and destructor are not enough for setting up
+  // and cleaning up each test, you can define the following methods:
+
+  void SetUp() override {
+    // Code here will be called immediately after the constructor (right
+    // before each test).
+    base.clear();
+    out.clear();
+    fail_write = false;
+  }
+
+  void TearDown() override {
+    // Code here will be called immediately after each test (right
+    // before the destructor).
+  }
+
+  // Objects declared here can be used by all tests in the test suite for Foo.
+public:
+  static std::vector<uint8_t> base;
+  static std::vector<uint8_t> out;
+  static bool fail_write;
+
+  static int readBase(void *arg, uint32_t offset, uint8_t *buf, uint32_t len) {
+    (void)arg;
+    if (offset + len > base.size()) {
+      return -1;
+    }
+    memcpy(buf, &base[offset], len);
+    return 0;
+  }
+
+  static int writeOut(void *arg, const uint8_t *buf, uint32_t len) {
+    (void)arg;
+    if (fail_write) {
+      return -1;
+    }
+    out.insert(out.end(), buf, buf + len);
+    return 0;
+  }
+
+  // Something that looks roughly like a firmware image: 16 bit instructions, literal pools, padding
+  static std::vector<uint8_t> makeImage(size_t len, uint32_t seed) {
+    std::mt19937 rng(seed);
+    std::vector<uint8_t> img(len);
+    for (size_t i = 0; i + 1 < len; i += 2) {
+      uint16_t insn = static_cast<uint16_t>(0x4000 | (rng() & 0x0FFF));
+      if ((i % 1024) > 1000) {
+        insn = 0xFFFF;
+      }
+      img[i] = static_cast<uint8_t>(insn);
+      img[i + 1] = static_cast<uint8_t>(insn >> 8);
+    }
+    return img;
+  }
+
+  static void appendOp(std::vector<uint8_t> &patch, uint8_t opcode, uint32_t len, uint32_t src_offset) {
+    bm_dfu_delta_op_t op = {opcode, len, src_offset};
+    const uint8_t *p = reinterpret_cast<const uint8_t *>(&op);
+    patch.insert(patch.end(), p, p + sizeof(op));
+  }
+
+  static bm_dfu_delta_header_t makeHeader(const std::vector<uint8_t> &base_img,
+                                          const std::vector<uint8_t> &target) {
+    bm_dfu_delta_header_t header = {};
+    header.magic = BM_DFU_DELTA_MAGIC;
+    header.version = BM_DFU_DELTA_VERSION;
+    header.base_size = static_cast<uint32_t>(base_img.size());
+    header.base_crc16 = crc16_ccitt(0, base_img.data(), base_img.size());
+    header.base_git_sha = BASE_SHA;
+    header.target_size = static_cast<uint32_t>(target.size());
+    header.target_crc16 = crc16_ccitt(0, target.data(), target.size());
+    header.target_major = 1;
+    header.target_minor = 2;
+    header.target_git_sha = 0xBEEF;
+    return header;
+  }
+
+  // Same greedy COPY/INSERT diff as tools/scripts/dfu/bm_dfu_delta.py
+  static std::vector<uint8_t> makePatch(const std::vector<uint8_t> &base_img,
+                                        const std::vector<uint8_t> &target) {
+    std::vector<uint8_t> patch;
+    bm_dfu_delta_header_t header = makeHeader(base_img, target);
+    const uint8_t *h = reinterpret_cast<const uint8_t *>(&header);
+    patch.insert(patch.end(), h, h + sizeof(header));
+
+    std::unordered_map<std::string, uint32_t> index;
+    for (size_t i = 0; i + MATCH_BLOCK <= base_img.size(); i++) {
+      index.emplace(std::string(reinterpret_cast<const char *>(&base_img[i]), MATCH_BLOCK),
+                    static_cast<uint32_t>(i));
+    }
+
+    auto match_len = [&](size_t src, size_t dst) {
+      size_t len = 0;
+      while (src + len < base_img.size() && dst + len < target.size() &&
+             base_img[src + len] == target[dst + len]) {
+        len++;
+      }
+      return len;
+    };
+
+    size_t literal_start = 0;
+    size_t pos = 0;
+    bool have_next = false;
+    size_t next_src = 0;
+    while (pos + MATCH_BLOCK <= target.size()) {
+      size_t best_len = 0;
+      size_t best_src = 0;
+      if (have_next && next_src + (pos - literal_start) < base_img.size()) {
+        best_src = next_src + (pos - literal_start);
+        best_len = match_len(best_src, pos);
+      }
+      auto it = index.find(std::string(reinterpret_cast<const char *>(&target[pos]), MATCH_BLOCK));
+      if (it != index.end()) {
+        size_t len = match_len(it->second, pos);
+        if (len > best_len) {
+          best_len = len;
+          best_src = it->second;
+        }
+      }
+      if (best_len >= MATCH_BLOCK + sizeof(bm_dfu_delta_op_t)) {
+        if (literal_start < pos) {
+          appendOp(patch, BM_DFU_DELTA_OP_INSERT, static_cast<uint32_t>(pos - literal_start), 0);
+          patch.insert(patch.end(), target.begin() + literal_start, target.begin() + pos);
+        }
+        appendOp(patch, BM_DFU_DELTA_OP_COPY, static_cast<uint32_t>(best_len),
+                 static_cast<uint32_t>(best_src));
+        pos += best_len;
+        literal_start = pos;
+        have_next = true;
+        next_src = best_src + best_len;
+      } else {
+        pos++;
+      }
+    }
+    if (literal_start < target.size()) {
+      appendOp(patch, BM_DFU_DELTA_OP_INSERT, static_cast<uint32_t>(target.size() - literal_start), 0);
+      patch.insert(patch.end(), target.begin() + literal_start, target.end());
+    }
+    return patch;
+  }
+
+  static bm_dfu_delta_err_t applyPatch(bm_dfu_delta_ctx_t &ctx, const std::vector<uint8_t> &patch,
+                                       size_t chunk_size) {
+    bm_dfu_delta_init(&ctx, readBase, writeOut, NULL, BASE_SHA);
+    for (size_t offset = 0; offset < patch.size(); offset += chunk_size) {
+      size_t len = std::min(chunk_size, patch.size() - offset);
+      bm_dfu_delta_err_t err = bm_dfu_delta_process(&ctx, &patch[offset], static_cast<uint32_t>(len));
+      if (err != BM_DFU_DELTA_OK) {
+        return err;
+      }
+    }
+    return BM_DFU_DELTA_OK;
+  }
+};
+
+std::vector<uint8_t> DeltaTest::base;
+std::vector<uint8_t> DeltaTest::out;
+bool DeltaTest::fail_write;
+
+TEST_F(DeltaTest, RoundTrip) {
+  base = makeImage(256 * 1024, 1);
+  std::vector<uint8_t> target = base;
+
+  // Scattered in-place changes, like updated constants and branch offsets
+  std::mt19937 rng(2);
+  for (int i = 0; i < 64; i++) {
+    size_t offset = rng() % (target.size() - 4);
+    target[offset] ^= 0x5A;
+    target[offset + 1] ^= 0xA5;
+  }
+  // A new function inserted, and an old one removed, shifting the rest of the image
+  std::vector<uint8_t> new_code = makeImage(2048, 3);
+  target.insert(target.begin() + 40000, new_code.begin(), new_code.end());
+  target.erase(target.begin() + 150000, target.begin() + 151024);
+
+  std::vector<uint8_t> patch = makePatch(base, target);
+  bm_dfu_delta_ctx_t ctx;
+  EXPECT_EQ(applyPatch(ctx, patch, CHUNK_SIZE), BM_DFU_DELTA_OK);
+  EXPECT_TRUE(bm_dfu_delta_done(&ctx));
+  EXPECT_EQ(out, target);
+
+  printf("Delta image: %zu bytes, full image: %zu bytes (%.1f%%)\n", patch.size(), target.size(),
+         100.0 * static_cast<double>(patch.size()) / static_cast<double>(target.size()));
+  EXPECT_LT(patch.size(), target.size() / 10);
+}
+
+TEST_F(DeltaTest, AnyChunkSize) {
+  base = makeImage(8 * 1024, 4);
+  std::vector<uint8_t> target = base;
+  target[100] = 0x12;
+  target.insert(target.begin() + 4000, 300, 0x77);
+
+  std::vector<uint8_t> patch = makePatch(base, target);
+  const size_t chunk_sizes[] = {1, 7, sizeof(bm_dfu_delta_op_t), 100, patch.size()};
+  for (size_t chunk_size : chunk_sizes) {
+    out.clear();
+    bm_dfu_delta_ctx_t ctx;
+    EXPECT_EQ(applyPatch(ctx, patch, chunk_size), BM_DFU_DELTA_OK);
+    EXPECT_TRUE(bm_dfu_delta_done(&ctx));
+    EXPECT_EQ(out, target);
+  }
+}
+
+TEST_F(DeltaTest, BaseMismatch) {
+  base = makeImage(4096, 5);
+  std::vector<uint8_t> target = makeImage(4096, 6);
+  std::vector<uint8_t> patch = makePatch(base, target);
+  bm_dfu_delta_ctx_t ctx;
+
+  // Patch made against a different build
+  bm_dfu_delta_init(&ctx, readBase, writeOut, NULL, BASE_SHA + 1);
+  EXPECT_EQ(bm_dfu_delta_process(&ctx, patch.data(), static_cast<uint32_t>(patch.size())),
+            BM_DFU_DELTA_ERR_BASE);
+  EXPECT_FALSE(bm_dfu_delta_done(&ctx));
+
+  // Same build, but the primary slot doesn't hold the expected bytes
+  base[10] ^= 0xFF;
+  EXPECT_EQ(applyPatch(ctx, patch, CHUNK_SIZE), BM_DFU_DELTA_ERR_BASE);
+  EXPECT_FALSE(bm_dfu_delta_done(&ctx));
+  EXPECT_TRUE(out.empty());
+}
+
+TEST_F(DeltaTest, BadHeader) {
+  base = makeImage(1024, 7);
+  std::vector<uint8_t> patch = makePatch(base, base);
+  bm_dfu_delta_ctx_t ctx;
+
+  std::vector<uint8_t> bad_magic = patch;
+  bad_magic[0] ^= 0xFF;
+  EXPECT_EQ(applyPatch(ctx, bad_magic, CHUNK_SIZE), BM_DFU_DELTA_ERR_FORMAT);
+
+  std::vector<uint8_t> bad_version = patch;
+  bad_version[offsetof(bm_dfu_delta_header_t, version)]++;
+  EXPECT_EQ(applyPatch(ctx, bad_version, CHUNK_SIZE), BM_DFU_DELTA_ERR_FORMAT);
+
+  EXPECT_FALSE(bm_dfu_delta_is_delta_image(bad_magic.data(), static_cast<uint32_t>(bad_magic.size())));
+  EXPECT_TRUE(bm_dfu_delta_is_delta_image(patch.data(), static_cast<uint32_t>(patch.size())));
+  EXPECT_FALSE(bm_dfu_delta_is_delta_image(patch.data(), 2));
+}
+
+TEST_F(DeltaTest, BadOps) {
+  base = makeImage(1024, 8);
+  std::vector<uint8_t> target(512, 0xAB);
+  bm_dfu_delta_header_t header = makeHeader(base, target);
+  const uint8_t *h = reinterpret_cast<const uint8_t *>(&header);
+  std::vector<uint8_t> start(h, h + sizeof(header));
+  bm_dfu_delta_ctx_t ctx;
+
+  // Copy reaching past the end of the base image
+  std::vector<uint8_t> patch = start;
+  appendOp(patch, BM_DFU_DELTA_OP_COPY, 256, 1000);
+  EXPECT_EQ(applyPatch(ctx, patch, CHUNK_SIZE), BM_DFU_DELTA_ERR_FORMAT);
+  // Context stays failed
+  uint8_t byte = 0;
+  EXPECT_EQ(bm_dfu_delta_process(&ctx, &byte, 1), BM_DFU_DELTA_ERR_FORMAT);
+
+  // Op producing more than the target size
+  patch = start;
+  appendOp(patch, BM_DFU_DELTA_OP_COPY, 513, 0);
+  EXPECT_EQ(applyPatch(ctx, patch, CHUNK_SIZE), BM_DFU_DELTA_ERR_FORMAT);
+
+  // Unknown op
+  patch = start;
+  appendOp(patch, 7, 16, 0);
+  EXPECT_EQ(applyPatch(ctx, patch, CHUNK_SIZE), BM_DFU_DELTA_ERR_FORMAT);
+
+  // Bytes after the image is complete
+  patch = start;
+  appendOp(patch, BM_DFU_DELTA_OP_INSERT, 512, 0);
+  patch.insert(patch.end(), target.begin(), target.end());
+  patch.push_back(0);
+  EXPECT_EQ(applyPatch(ctx, patch, CHUNK_SIZE), BM_DFU_DELTA_ERR_FORMAT);
+
+  // Flash write failure
+  patch.pop_back();
+  fail_write = true;
+  EXPECT_EQ(applyPatch(ctx, patch, CHUNK_SIZE), BM_DFU_DELTA_ERR_WRITE);
+}
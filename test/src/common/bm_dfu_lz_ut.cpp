@@ -0,0 +1,263 @@
+#include "gtest/gtest.h"
+
+#include <chrono>
+#include <random>
+#include <vector>
+
+#include "bm_dfu_lz.h"
+
+static constexpr size_t CHUNK_SIZE = 512;
+
+// The fixture for testing class Foo.
+class LzTest : public ::testing::Test {
+protected:
+  // You can remove any or all of the following functions if its body
+  // is empty.
+
+  LzTest() {
+    // You can do set-up work for each test here.
+  }
+
+  ~LzTest() override {
+    // You can do clean-up work that doesn't throw exceptions here.
+  }
+
+  // If the constructor and destructor are not enough for setting up
+  // and cleaning up each test, you can define the following methods:
+
+  void SetUp() override {
+    // Code here will be called immediately after the constructor (right
+    // before each test).
+    out.clear();
+    fail_write = false;
+    max_write = 0;
+  }
+
+  void TearDown() override {
+    // Code here will be called immediately after each test (right
+    // before the destructor).
+  }
+
+  // Objects declared here can be used by all tests in the test suite for Foo.
+public:
+  static std::vector<uint8_t> out;
+  static bool fail_write;
+  static uint32_t max_write;
+  static bm_dfu_lz_ctx_t ctx;
+
+  static int writeOut(void *arg, const uint8_t *buf, uint32_t len) {
+    (void)arg;
+    if (fail_write) {
+      return -1;
+    }
+    max_write = std::max(max_write, len);
+    out.insert(out.end(), buf, buf + len);
+    return 0;
+  }
+
+  // Something that looks roughly like a firmware image: repeated instruction
+  // sequences with varying operands, literal pools, and erased padding
+  static std::vector<uint8_t> makeImage(size_t len, uint32_t seed) {
+    std::mt19937 rng(seed);
+    std::vector<uint8_t> snippets(64 * 16);
+    for (auto &byte : snippets) {
+      byte = static_cast<uint8_t>(rng());
+    }
+    std::vector<uint8_t> img;
+    while (img.size() < len) {
+      uint32_t pick = rng() % 8;
+      if (pick < 5) {
+        size_t start = (rng() % 64) * 16;
+        img.insert(img.end(), snippets.begin() + start, snippets.begin() + start + 16);
+        img[img.size() - 3] = static_cast<uint8_t>(rng());
+      } else if (pick < 7) {
+        for (int i = 0; i < 8; i++) {
+          img.push_back(static_cast<uint8_t>(rng()));
+        }
+      } else {
+        img.insert(img.end(), 32, 0xFF);
+      }
+    }
+    img.resize(len);
+    return img;
+  }
+
+  static std::vector<uint8_t> makeHeader(uint8_t window_bits, uint32_t size) {
+    bm_dfu_lz_header_t header = {BM_DFU_LZ_MAGIC, BM_DFU_LZ_VERSION, window_bits, 0, size};
+    const uint8_t *h = reinterpret_cast<const uint8_t *>(&header);
+    return std::vector<uint8_t>(h, h + sizeof(header));
+  }
+
+  // Same greedy encoder as tools/scripts/dfu/bm_dfu_compress.py
+  static std::vector<uint8_t> compress(const std::vector<uint8_t> &data, uint8_t window_bits) {
+    std::vector<uint8_t> packed = makeHeader(window_bits, static_cast<uint32_t>(data.size()));
+    const size_t window = 1u << window_bits;
+    const size_t max_match = BM_DFU_LZ_MIN_MATCH + (1u << (16 - window_bits)) - 1;
+    size_t control_pos = 0;
+    uint8_t control_bit = 8;
+    size_t pos = 0;
+    while (pos < data.size()) {
+      if (control_bit == 8) {
+        control_pos = packed.size();
+        packed.push_back(0);
+        control_bit = 0;
+      }
+      size_t best_len = 0;
+      size_t best_dist = 0;
+      size_t limit = std::min(max_match, data.size() - pos);
+      for (size_t dist = 1; dist <= std::min(window, pos); dist++) {
+        size_t len = 0;
+        while (len < limit && data[pos - dist + len] == data[pos + len]) {
+          len++;
+        }
+        if (len > best_len) {
+          best_len = len;
+          best_dist = dist;
+          if (len == limit) {
+            break;
+          }
+        }
+      }
+      if (best_len >= BM_DFU_LZ_MIN_MATCH) {
+        uint16_t ref = static_cast<uint16_t>((best_dist - 1) | ((best_len - BM_DFU_LZ_MIN_MATCH) << window_bits));
+        packed.push_back(static_cast<uint8_t>(ref));
+        packed.push_back(static_cast<uint8_t>(ref >> 8));
+        pos += best_len;
+      } else {
+        packed[control_pos] |= static_cast<uint8_t>(1 << control_bit);
+        packed.push_back(data[pos]);
+        pos++;
+      }
+      control_bit++;
+    }
+    return packed;
+  }
+
+  static bm_dfu_lz_err_t decompress(const std::vector<uint8_t> &packed, size_t chunk_size) {
+    bm_dfu_lz_init(&ctx, writeOut, NULL);
+    for (size_t offset = 0; offset < packed.size(); offset += chunk_size) {
+      size_t len = std::min(chunk_size, packed.size() - offset);
+      bm_dfu_lz_err_t err = bm_dfu_lz_process(&ctx, &packed[offset], static_cast<uint32_t>(len));
+      if (err != BM_DFU_LZ_OK) {
+        return err;
+      }
+    }
+    return BM_DFU_LZ_OK;
+  }
+};
+
+std::vector<uint8_t> LzTest::out;
+bool LzTest::fail_write;
+uint32_t LzTest::max_write;
+bm_dfu_lz_ctx_t LzTest::ctx;
+
+TEST_F(LzTest, RoundTrip) {
+  std::vector<uint8_t> image = makeImage(32 * 1024, 1);
+  for (uint8_t window_bits = BM_DFU_LZ_MIN_WINDOW_BITS; window_bits <= BM_DFU_LZ_MAX_WINDOW_BITS; window_bits++) {
+    out.clear();
+    std::vector<uint8_t> packed = compress(image, window_bits);
+    EXPECT_EQ(decompress(packed, CHUNK_SIZE), BM_DFU_LZ_OK);
+    EXPECT_TRUE(bm_dfu_lz_done(&ctx));
+    EXPECT_EQ(out, image);
+    EXPECT_LE(max_write, static_cast<uint32_t>(BM_DFU_LZ_FLUSH_LEN));
+    printf("%u bit window: %zu -> %zu bytes (%.1f%%)\n", window_bits, image.size(), packed.size(),
+           100.0 * static_cast<double>(packed.size()) / static_cast<double>(image.size()));
+  }
+}
+
+TEST_F(LzTest, AnyChunkSize) {
+  std::vector<uint8_t> image = makeImage(4096, 2);
+  std::vector<uint8_t> packed = compress(image, BM_DFU_LZ_MAX_WINDOW_BITS);
+  const size_t chunk_sizes[] = {1, 2, 3, sizeof(bm_dfu_lz_header_t), 100, packed.size()};
+  for (size_t chunk_size : chunk_sizes) {
+    out.clear();
+    EXPECT_EQ(decompress(packed, chunk_size), BM_DFU_LZ_OK);
+    EXPECT_TRUE(bm_dfu_lz_done(&ctx));
+    EXPECT_EQ(out, image);
+  }
+}
+
+TEST_F(LzTest, DecodeThroughput) {
+  // Host-side numbers, compare window sizes relative to each other rather than as target speeds
+  std::vector<uint8_t> image = makeImage(256 * 1024, 3);
+  std::vector<uint8_t> packed = compress(image, BM_DFU_LZ_MAX_WINDOW_BITS);
+  out.reserve(image.size());
+  auto start = std::chrono::steady_clock::now();
+  EXPECT_EQ(decompress(packed, CHUNK_SIZE), BM_DFU_LZ_OK);
+  auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  EXPECT_EQ(out, image);
+  printf("Decoded %zu bytes in %.2f ms (%.1f MB/s), ratio %.3f, window %u bytes\n", image.size(), elapsed * 1000.0,
+         static_cast<double>(image.size()) / elapsed / 1e6,
+         static_cast<double>(packed.size()) / static_cast<double>(image.size()), BM_DFU_LZ_WINDOW_LEN);
+}
+
+TEST_F(LzTest, BadHeader) {
+  std::vector<uint8_t> image = makeImage(1024, 4);
+  std::vector<uint8_t> packed = compress(image, BM_DFU_LZ_MIN_WINDOW_BITS);
+
+  std::vector<uint8_t> bad = packed;
+  bad[0] ^= 0xFF;
+  EXPECT_EQ(decompress(bad, CHUNK_SIZE), BM_DFU_LZ_ERR_FORMAT);
+  EXPECT_FALSE(bm_dfu_lz_is_compressed_image(bad.data(), static_cast<uint32_t>(bad.size()), NULL));
+
+  bad = packed;
+  bad[offsetof(bm_dfu_lz_header_t, version)]++;
+  EXPECT_EQ(decompress(bad, CHUNK_SIZE), BM_DFU_LZ_ERR_FORMAT);
+
+  // Window larger than this client can hold
+  bad = packed;
+  bad[offsetof(bm_dfu_lz_header_t, window_bits)] = BM_DFU_LZ_MAX_WINDOW_BITS + 1;
+  EXPECT_EQ(decompress(bad, CHUNK_SIZE), BM_DFU_LZ_ERR_WINDOW);
+  EXPECT_TRUE(out.empty());
+
+  uint8_t flags = 0xFF;
+  packed[offsetof(bm_dfu_lz_header_t, flags)] = BM_DFU_LZ_FLAG_DELTA;
+  EXPECT_TRUE(bm_dfu_lz_is_compressed_image(packed.data(), static_cast<uint32_t>(packed.size()), &flags));
+  EXPECT_EQ(flags, BM_DFU_LZ_FLAG_DELTA);
+  EXPECT_FALSE(bm_dfu_lz_is_compressed_image(packed.data(), 4, &flags));
+}
+
+TEST_F(LzTest, BadStream) {
+  // Reference before the start of the image
+  std::vector<uint8_t> packed = makeHeader(BM_DFU_LZ_MIN_WINDOW_BITS, 16);
+  packed.push_back(0x01); // literal, then reference
+  packed.push_back(0xAA);
+  packed.push_back(0x01); // distance 2
+  packed.push_back(0x00);
+  EXPECT_EQ(decompress(packed, CHUNK_SIZE), BM_DFU_LZ_ERR_FORMAT);
+  // Context stays failed
+  uint8_t byte = 0;
+  EXPECT_EQ(bm_dfu_lz_process(&ctx, &byte, 1), BM_DFU_LZ_ERR_FORMAT);
+
+  // Reference past the end of the image
+  packed = makeHeader(BM_DFU_LZ_MIN_WINDOW_BITS, 4);
+  packed.push_back(0x01);
+  packed.push_back(0xAA);
+  packed.push_back(0x00); // distance 1
+  packed.push_back(0x01); // length 4
+  EXPECT_EQ(decompress(packed, CHUNK_SIZE), BM_DFU_LZ_ERR_FORMAT);
+
+  // Bytes after the image is complete
+  packed = makeHeader(BM_DFU_LZ_MIN_WINDOW_BITS, 4);
+  packed.push_back(0x01);
+  packed.push_back(0xAA);
+  packed.push_back(0x00); // distance 1
+  packed.push_back(0x00); // length 3
+  out.clear();
+  EXPECT_EQ(decompress(packed, CHUNK_SIZE), BM_DFU_LZ_OK);
+  EXPECT_TRUE(bm_dfu_lz_done(&ctx));
+  EXPECT_EQ(out, std::vector<uint8_t>(4, 0xAA));
+  packed.push_back(0xAA);
+  EXPECT_EQ(decompress(packed, CHUNK_SIZE), BM_DFU_LZ_ERR_FORMAT);
+
+  // Truncated image never completes
+  packed.resize(packed.size() - 2);
+  EXPECT_EQ(decompress(packed, CHUNK_SIZE), BM_DFU_LZ_OK);
+  EXPECT_FALSE(bm_dfu_lz_done(&ctx));
+
+  // Flash write failure
+  packed = compress(makeImage(1024, 5), BM_DFU_LZ_MIN_WINDOW_BITS);
+  fail_write = true;
+  EXPECT_EQ(decompress(packed, CHUNK_SIZE), BM_DFU_LZ_ERR_WRITE);
+  EXPECT_FALSE(bm_dfu_lz_done(&ctx));
+}
@@ -0,0 +1,283 @@
+#include "gtest/gtest.h"
+
+#include <elf.h>
+#include <inttypes.h>
+#include <link.h>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <unistd.h>
+
+#include "bm_dlog.h"
+
+static size_t encode(uint8_t *buf, size_t len, const char *format, ...) {
+  va_list va;
+  va_start(va, format);
+  size_t rval = bm_dlog_encode(buf, len, format, va);
+  va_end(va);
+  return rval;
+}
+
+// Encodes, then formats from the same argument list like the callers fall back to
+static size_t encodeThenFormat(uint8_t *buf, size_t len, char *text, size_t text_len, const char *format, ...) {
+  va_list va;
+  va_start(va, format);
+  size_t rval = bm_dlog_encode(buf, len, format, va);
+  vsnprintf(text, text_len, format, va);
+  va_end(va);
+  return rval;
+}
+
+static uint32_t fmtAddr(const char *format) {
+  return static_cast<uint32_t>(reinterpret_cast<uintptr_t>(format));
+}
+
+// Writes the record as a hex line for dlog_decoder.py and keeps what printf makes of it
+static void addDecoderRecord(FILE *records, std::string &expected, const char *format, ...) {
+  uint8_t buf[BM_DLOG_MAX_LEN];
+  char text[256];
+  va_list va;
+  va_start(va, format);
+  size_t len = bm_dlog_encode(buf, sizeof(buf), format, va);
+  vsnprintf(text, sizeof(text), format, va);
+  va_end(va);
+
+  EXPECT_GT(len, 0u);
+  // The record only has room for a 32 bit address
+  EXPECT_EQ(static_cast<uintptr_t>(fmtAddr(format)), reinterpret_cast<uintptr_t>(format));
+  for (size_t i = 0; i < len; i++) {
+    fprintf(records, "%02x", buf[i]);
+  }
+  fprintf(records, "\n");
+  expected += text;
+}
+
+// First four bytes of this test's own GNU build id, like the firmware reads its note
+static int findBuildId(struct dl_phdr_info *info, size_t size, void *data) {
+  (void)size;
+  for (ElfW(Half) i = 0; i < info->dlpi_phnum; i++) {
+    if (info->dlpi_phdr[i].p_type != PT_NOTE) {
+      continue;
+    }
+    const uint8_t *note = reinterpret_cast<const uint8_t *>(info->dlpi_addr + info->dlpi_phdr[i].p_vaddr);
+    const uint8_t *end = note + info->dlpi_phdr[i].p_memsz;
+    while (note + sizeof(ElfW(Nhdr)) <= end) {
+      const ElfW(Nhdr) *nhdr = reinterpret_cast<const ElfW(Nhdr) *>(note);
+      const uint8_t *desc = note + sizeof(ElfW(Nhdr)) + ((nhdr->n_namesz + 3) & ~3u);
+      if (nhdr->n_type == NT_GNU_BUILD_ID && nhdr->n_descsz >= sizeof(uint32_t)) {
+        memcpy(data, desc, sizeof(uint32_t));
+        return 1;
+      }
+      note = desc + ((nhdr->n_descsz + 3) & ~3u);
+    }
+  }
+  // Only the executable itself, which is reported first
+  return 1;
+}
+
+template <typename T> static T readArg(const uint8_t *buf, size_t offset) {
+  T value;
+  memcpy(&value, &buf[offset], sizeof(value));
+  return value;
+}
+
+// The fixture for testing class Foo.
+class BmDlogTest : public ::testing::Test {
+protected:
+  // You can remove any or all of the following functions if its body
+  // is empty.
+
+  BmDlogTest() {
+    // You can do set-up work for each test here.
+  }
+
+  ~BmDlogTest() override {
+    // You can do clean-up work that doesn't throw exceptions here.
+  }
+
+  // If the constructor and destructor are not enough for setting up
+  // and cleaning up each test, you can define the following methods:
+
+  void SetUp() override {
+    // Code here will be called immediately after the constructor (right
+    // before each test).
+    memset(buf, 0xAA, sizeof(buf));
+    bm_dlog_set_build_id(buildId);
+  }
+
+  void TearDown() override {
+    // Code here will be called immediately after each test (right
+    // before the destructor).
+  }
+
+  // Objects declared here can be used by all tests in the test suite for Foo.
+  uint8_t buf[BM_DLOG_MAX_LEN];
+  static constexpr uint32_t buildId = 0x12345678;
+};
+
+TEST_F(BmDlogTest, NoArgs) {
+  const char *format = "Hello world, 100%% done\n";
+  EXPECT_EQ(encode(buf, sizeof(buf), format), sizeof(bm_dlog_record_t));
+  EXPECT_EQ(readArg<uint32_t>(buf, 0), buildId);
+  EXPECT_EQ(readArg<uint32_t>(buf, 4), fmtAddr(format));
+}
+
+TEST_F(BmDlogTest, Integers) {
+  const char *format = "%d %5u %#x %c %hhu %ld %zu %p\n";
+  int local = 0;
+  EXPECT_EQ(encode(buf, sizeof(buf), format, -5, 7u, 0xABCDu, 'a', 255, 123456L, static_cast<size_t>(42), &local),
+            8u + 8 * 4);
+  EXPECT_EQ(readArg<uint32_t>(buf, 4), fmtAddr(format));
+  EXPECT_EQ(readArg<int32_t>(buf, 8), -5);
+  EXPECT_EQ(readArg<uint32_t>(buf, 12), 7u);
+  EXPECT_EQ(readArg<uint32_t>(buf, 16), 0xABCDu);
+  EXPECT_EQ(readArg<uint32_t>(buf, 20), static_cast<uint32_t>('a'));
+  EXPECT_EQ(readArg<uint32_t>(buf, 24), 255u);
+  EXPECT_EQ(readArg<int32_t>(buf, 28), 123456);
+  EXPECT_EQ(readArg<uint32_t>(buf, 32), 42u);
+  EXPECT_EQ(readArg<uint32_t>(buf, 36), static_cast<uint32_t>(reinterpret_cast<uintptr_t>(&local)));
+}
+
+TEST_F(BmDlogTest, WideArgs) {
+  const char *format = "%llx %-8.3f %e %lld\n";
+  EXPECT_EQ(encode(buf, sizeof(buf), format, 0x1122334455667788ULL, 3.25, 1e-9f, static_cast<long long>(INT64_MIN)), 8u + 4 * 8);
+  EXPECT_EQ(readArg<uint64_t>(buf, 8), 0x1122334455667788ULL);
+  EXPECT_EQ(readArg<double>(buf, 16), 3.25);
+  EXPECT_EQ(readArg<double>(buf, 24), static_cast<double>(1e-9f));
+  EXPECT_EQ(readArg<int64_t>(buf, 32), INT64_MIN);
+}
+
+TEST_F(BmDlogTest, Strings) {
+  const char *format = "[%s] %.*s|%s\n";
+  EXPECT_EQ(encode(buf, sizeof(buf), format, "bridge", 3, "sensor", nullptr), 8u + 7 + 4 + 7 + 7);
+  EXPECT_EQ(buf[8], 6);
+  EXPECT_EQ(memcmp(&buf[9], "bridge", 6), 0);
+  // Precision from the arguments comes first, the whole string is still sent
+  EXPECT_EQ(readArg<int32_t>(buf, 15), 3);
+  EXPECT_EQ(buf[19], 6);
+  EXPECT_EQ(memcmp(&buf[20], "sensor", 6), 0);
+  EXPECT_EQ(buf[26], 6);
+  EXPECT_EQ(memcmp(&buf[27], "(null)", 6), 0);
+}
+
+TEST_F(BmDlogTest, LongStringTruncated) {
+  std::string long_str(1000, 'x');
+  EXPECT_EQ(encode(buf, sizeof(buf), "%s", long_str.c_str()), sizeof(buf));
+  EXPECT_EQ(buf[8], sizeof(buf) - 9);
+
+  // Never longer than the length byte can say
+  uint8_t big_buf[1024];
+  EXPECT_EQ(encode(big_buf, sizeof(big_buf), "%s", long_str.c_str()), 8u + 1 + BM_DLOG_MAX_STR_LEN);
+  EXPECT_EQ(big_buf[8], BM_DLOG_MAX_STR_LEN);
+}
+
+TEST_F(BmDlogTest, DoesNotFit) {
+  EXPECT_EQ(encode(buf, 3, "no args"), 0u);
+  EXPECT_EQ(encode(buf, 7, "no args"), 0u);
+  EXPECT_EQ(encode(buf, 8 + 8 + 3, "%d %d %d", 1, 2, 3), 0u);
+  EXPECT_EQ(encode(buf, 8 + 8 + 4, "%d %d %d", 1, 2, 3), 8u + 12);
+  // No room for the string's length
+  EXPECT_EQ(encode(buf, 8 + 4, "%d %s", 1, "a"), 0u);
+}
+
+TEST_F(BmDlogTest, CantDefer) {
+  int count = 0;
+  EXPECT_EQ(encode(buf, sizeof(buf), "abc%n", &count), 0u);
+  EXPECT_EQ(encode(buf, sizeof(buf), "trailing %"), 0u);
+  EXPECT_EQ(encode(buf, sizeof(buf), "%k", 1), 0u);
+}
+
+TEST_F(BmDlogTest, ArgsLeftForFallback) {
+  char text[64];
+  EXPECT_GT(encodeThenFormat(buf, sizeof(buf), text, sizeof(text), "%s=%d %.2f", "temp", 21, 3.14159), 0u);
+  EXPECT_STREQ(text, "temp=21 3.14");
+
+  EXPECT_EQ(encodeThenFormat(buf, sizeof(buf), text, sizeof(text), "%d%n", 7, &text[60]), 0u);
+  EXPECT_STREQ(text, "7");
+}
+
+TEST_F(BmDlogTest, Enable) {
+  EXPECT_EQ(bm_dlog_enabled(), static_cast<bool>(BM_DLOG_ENABLE_DEFAULT));
+  bm_dlog_set_enabled(true);
+  EXPECT_TRUE(bm_dlog_enabled());
+  bm_dlog_set_enabled(false);
+  EXPECT_FALSE(bm_dlog_enabled());
+}
+
+//
+// Typical bridge log lines, record size against the text that used to be sent.
+// 64 bit values use ll, PRIx64 is only ll on the 32 bit target
+//
+TEST_F(BmDlogTest, BytesPerLine) {
+  char text[256];
+  size_t text_bytes = 0;
+  size_t record_bytes = 0;
+
+  const char *aanderaa = "%llx | Aanderaa | count: %u, temp: %.3f, abs_speed: %.3f, direction: %.3f\n";
+  record_bytes += encodeThenFormat(buf, sizeof(buf), text, sizeof(text), aanderaa, 0xdeadbeefcafeULL, 30u,
+                                   12.3456, 0.2345, 271.5);
+  text_bytes += strlen(text) + 1;
+
+  const char *topology = "Topology sampled, %u nodes, crc32 0x%08" PRIx32 "\n";
+  record_bytes += encodeThenFormat(buf, sizeof(buf), text, sizeof(text), topology, 5u, 0x12345678u);
+  text_bytes += strlen(text) + 1;
+
+  const char *power = "Bus power %s, sampling %" PRIu32 "s every %" PRIu32 "s\n";
+  record_bytes += encodeThenFormat(buf, sizeof(buf), text, sizeof(text), power, "on", 300u, 1200u);
+  text_bytes += strlen(text) + 1;
+
+  printf("Text: %zu bytes, deferred records: %zu bytes\n", text_bytes, record_bytes);
+  EXPECT_LT(record_bytes * 2, text_bytes);
+}
+
+//
+// Records go through tools/scripts/misc/dlog_decoder.py with this test's own ELF, the way
+// the host decodes what the firmware published. Built without PIE so the format string
+// addresses are the ELF's, like on the target.
+//
+TEST_F(BmDlogTest, DecoderRoundTrip) {
+  char exe[512];
+  ssize_t exe_len = readlink("/proc/self/exe", exe, sizeof(exe) - 1);
+  ASSERT_GT(exe_len, 0);
+  exe[exe_len] = 0;
+  uint32_t own_build_id = 0;
+  dl_iterate_phdr(findBuildId, &own_build_id);
+  ASSERT_NE(own_build_id, 0u);
+  bm_dlog_set_build_id(own_build_id);
+
+  std::string records_path = testing::TempDir() + "bm_dlog_records.txt";
+  FILE *records = fopen(records_path.c_str(), "w");
+  ASSERT_NE(records, nullptr);
+  std::string expected;
+  addDecoderRecord(records, expected, "Hello world, 100%% done\n");
+  addDecoderRecord(records, expected, "%llx | Aanderaa | count: %u, temp: %.3f, abs_speed: %.3f\n",
+                   0xdeadbeefcafeULL, 30u, 12.3456, 0.2345);
+  addDecoderRecord(records, expected, "[%-8s] %5.1f%% %*d|%c|%#x|%o|%lld\n", "adin", 99.5, 6, -42, 'z',
+                   0xbeefu, 8u, static_cast<long long>(INT64_MIN));
+  addDecoderRecord(records, expected, "%s Added reading %.4f to Diff signal, %e %g %X\n",
+                   "[RBR-PRESSURE]", 1013.2501, 12345.678, 0.0001, 0xabcdu);
+  addDecoderRecord(records, expected, "[%s] %.*s|%s\n", "bridge", 3, "sensor", nullptr);
+
+  // Records from a build the decoder has no ELF for can't be looked up in this one
+  bm_dlog_set_build_id(~own_build_id);
+  ASSERT_EQ(encode(buf, sizeof(buf), "Hello world, 100%% done\n"), sizeof(bm_dlog_record_t));
+  for (size_t i = 0; i < sizeof(bm_dlog_record_t); i++) {
+    fprintf(records, "%02x", buf[i]);
+  }
+  fprintf(records, "\n");
+  fclose(records);
+
+  std::string cmd = std::string(PYTHON3_EXECUTABLE) + " " + DLOG_DECODER + " -e " + exe + " " +
+                    records_path;
+  FILE *decoder = popen(cmd.c_str(), "r");
+  ASSERT_NE(decoder, nullptr);
+  std::string decoded;
+  char line[256];
+  while (fgets(line, sizeof(line), decoder)) {
+    decoded += line;
+  }
+  EXPECT_EQ(pclose(decoder), 0);
+  ASSERT_EQ(decoded.compare(0, expected.size(), expected), 0) << decoded;
+  EXPECT_NE(decoded.find("no ELF given for build", expected.size()), std::string::npos) << decoded;
+  remove(records_path.c_str());
+}
@@ -0,0 +1,184 @@
+#include "gtest/gtest.h"
+
+#include <chrono>
+#include <random>
+#include <vector>
+
+#include "bm_pub_batch.h"
+
+// Same as BM_MIDDLEWARE_MAX_PAYLOAD_LEN, 1500 byte MTU minus IPv6 and UDP headers
+static constexpr uint16_t MAX_FRAME_LEN = 1500 - 40 - 8;
+
+// The fixture for testing class Foo.
+class PubBatchTest : public ::testing::Test {
+protected:
+  // You can remove any or all of the following functions if its body
+  // is empty.
+
+  PubBatchTest() {
+    // You can do set-up work for each test here.
+  }
+
+  ~PubBatchTest() override {
+    // You can do clean-up work that doesn't throw exceptions here.
+  }
+
+  // If the constructor and destructor are not enough for setting up
+  // and cleaning up each test, you can define the following methods:
+
+  void SetUp() override {
+    // Code here will be called immediately after the constructor (right
+    // before each test).
+    received.clear();
+  }
+
+  void TearDown() override {
+    // Code here will be called immediately after each test (right
+    // before the destructor).
+  }
+
+  // Objects declared here can be used by all tests in the test suite for Foo.
+public:
+  static std::vector<std::vector<uint8_t>> received;
+
+  static void onRecord(const uint8_t *msg, uint16_t msg_len, void *arg) {
+    (void)arg;
+    received.push_back(std::vector<uint8_t>(msg, msg + msg_len));
+  }
+
+  static std::vector<uint8_t> makeMsg(size_t len, uint32_t seed) {
+    std::mt19937 rng(seed);
+    std::vector<uint8_t> msg(len);
+    for (auto &byte : msg) {
+      byte = static_cast<uint8_t>(rng());
+    }
+    // Single pubsub messages start with type 0
+    msg[0] = 0;
+    return msg;
+  }
+
+  static bool add(bm_pub_batch_t &batch, const std::vector<uint8_t> &msg) {
+    uint8_t *dst = bm_pub_batch_add(&batch, static_cast<uint16_t>(msg.size()));
+    if (!dst) {
+      return false;
+    }
+    memcpy(dst, msg.data(), msg.size());
+    return true;
+  }
+};
+
+std::vector<std::vector<uint8_t>> PubBatchTest::received;
+
+TEST_F(PubBatchTest, RoundTrip) {
+  std::vector<uint8_t> frame(MAX_FRAME_LEN);
+  bm_pub_batch_t batch;
+  bm_pub_batch_init(&batch, frame.data(), MAX_FRAME_LEN);
+  EXPECT_EQ(bm_pub_batch_num_records(&batch), 0);
+
+  std::vector<std::vector<uint8_t>> sent;
+  uint32_t seed = 0;
+  while (true) {
+    std::vector<uint8_t> msg = makeMsg(10 + (seed * 37) % 200, seed);
+    seed++;
+    if (!bm_pub_batch_fits(&batch, static_cast<uint16_t>(msg.size()))) {
+      EXPECT_FALSE(add(batch, msg));
+      break;
+    }
+    EXPECT_TRUE(add(batch, msg));
+    sent.push_back(msg);
+  }
+  EXPECT_GT(sent.size(), 1u);
+  EXPECT_EQ(bm_pub_batch_num_records(&batch), sent.size());
+  EXPECT_LE(batch.len, MAX_FRAME_LEN);
+
+  // Single messages aren't batches
+  EXPECT_FALSE(bm_pub_batch_is_batch(sent[0].data(), static_cast<uint16_t>(sent[0].size())));
+  EXPECT_TRUE(bm_pub_batch_is_batch(frame.data(), batch.len));
+  EXPECT_TRUE(bm_pub_batch_unpack(frame.data(), batch.len, onRecord, NULL));
+  EXPECT_EQ(received, sent);
+}
+
+TEST_F(PubBatchTest, RecordLimit) {
+  std::vector<uint8_t> frame(4096);
+  bm_pub_batch_t batch;
+  bm_pub_batch_init(&batch, frame.data(), static_cast<uint16_t>(frame.size()));
+  std::vector<uint8_t> msg = makeMsg(1, 1);
+  for (int i = 0; i < UINT8_MAX; i++) {
+    EXPECT_TRUE(add(batch, msg));
+  }
+  EXPECT_FALSE(add(batch, msg));
+  EXPECT_TRUE(bm_pub_batch_unpack(frame.data(), batch.len, onRecord, NULL));
+  EXPECT_EQ(received.size(), UINT8_MAX);
+}
+
+TEST_F(PubBatchTest, Malformed) {
+  std::vector<uint8_t> frame(256);
+  bm_pub_batch_t batch;
+  bm_pub_batch_init(&batch, frame.data(), static_cast<uint16_t>(frame.size()));
+  EXPECT_TRUE(add(batch, makeMsg(20, 1)));
+  EXPECT_TRUE(add(batch, makeMsg(30, 2)));
+  uint16_t len = batch.len;
+
+  // Truncated, nothing gets delivered
+  for (uint16_t truncated = 0; truncated < len; truncated++) {
+    EXPECT_FALSE(bm_pub_batch_unpack(frame.data(), truncated, onRecord, NULL));
+  }
+  // Trailing bytes
+  EXPECT_FALSE(bm_pub_batch_unpack(frame.data(), len + 1, onRecord, NULL));
+  // Record running past the end
+  frame[sizeof(bm_pub_batch_header_t)] = 200;
+  EXPECT_FALSE(bm_pub_batch_unpack(frame.data(), len, onRecord, NULL));
+  // Empty record
+  frame[sizeof(bm_pub_batch_header_t)] = 0;
+  EXPECT_FALSE(bm_pub_batch_unpack(frame.data(), len, onRecord, NULL));
+  EXPECT_TRUE(received.empty());
+
+  // An empty batch is valid
+  bm_pub_batch_init(&batch, frame.data(), static_cast<uint16_t>(frame.size()));
+  EXPECT_TRUE(bm_pub_batch_unpack(frame.data(), batch.len, onRecord, NULL));
+  EXPECT_TRUE(received.empty());
+}
+
+TEST_F(PubBatchTest, Throughput) {
+  // A sensor reading: pubsub header, "sensor/0123456789abcdef/sofar/bm_rbr_data" and ~24 bytes of CBOR
+  static constexpr uint16_t MSG_LEN = 5 + 41 + 24;
+  static constexpr uint32_t NUM_MSGS = 100000;
+  // Ethernet header + FCS + preamble + inter-frame gap, IPv6 and UDP headers
+  static constexpr uint32_t FRAME_OVERHEAD = 14 + 4 + 8 + 12 + 40 + 8;
+  // 10BASE-T1L
+  static constexpr double LINK_BPS = 10e6;
+
+  std::vector<uint8_t> msg = makeMsg(MSG_LEN, 3);
+  std::vector<uint8_t> frame(MAX_FRAME_LEN);
+  bm_pub_batch_t batch;
+  uint32_t frames = 0;
+  uint64_t wire_bytes = 0;
+  uint32_t delivered = 0;
+
+  auto start = std::chrono::steady_clock::now();
+  bm_pub_batch_init(&batch, frame.data(), MAX_FRAME_LEN);
+  for (uint32_t i = 0; i <= NUM_MSGS; i++) {
+    if (i == NUM_MSGS || !add(batch, msg)) {
+      EXPECT_TRUE(bm_pub_batch_unpack(frame.data(), batch.len, [](const uint8_t *, uint16_t, void *arg) {
+        (*static_cast<uint32_t *>(arg))++;
+      }, &delivered));
+      frames++;
+      wire_bytes += batch.len + FRAME_OVERHEAD;
+      bm_pub_batch_init(&batch, frame.data(), MAX_FRAME_LEN);
+      if (i < NUM_MSGS) {
+        EXPECT_TRUE(add(batch, msg));
+      }
+    }
+  }
+  double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  EXPECT_EQ(delivered, NUM_MSGS);
+
+  uint64_t single_wire_bytes = static_cast<uint64_t>(NUM_MSGS) * (MSG_LEN + FRAME_OVERHEAD);
+  printf("%u messages of %u bytes\n", NUM_MSGS, MSG_LEN);
+  printf("  unbatched: %u frames, %.1f bytes/msg on the wire, %.0f msgs/s at 10 Mbit/s\n", NUM_MSGS,
+         static_cast<double>(single_wire_bytes) / NUM_MSGS, LINK_BPS / 8 / (static_cast<double>(single_wire_bytes) / NUM_MSGS));
+  printf("  batched:   %u frames, %.1f bytes/msg on the wire, %.0f msgs/s at 10 Mbit/s\n", frames,
+         static_cast<double>(wire_bytes) / NUM_MSGS, LINK_BPS / 8 / (static_cast<double>(wire_bytes) / NUM_MSGS));
+  printf("  host pack + unpack: %.1f M msgs/s\n", NUM_MSGS / elapsed / 1e6);
+  EXPECT_LT(wire_bytes, single_wire_bytes);
+}
@@ -0,0 +1,142 @@
+#include "gtest/gtest.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "bm_pubsub.h"
+#include "fff.h"
+#include "mock_bcmp_resource_discovery.h"
+#include "mock_middleware.h"
+extern "C" {
+#include "mock_FreeRTOS.h"
+}
+
+DEFINE_FFF_GLOBALS;
+
+static const char *topic = "sensor/ffff/bm_soft_data";
+
+static void cb(uint64_t, const char *, uint16_t, const uint8_t *, uint16_t, uint8_t, uint8_t) {}
+
+static struct pbuf *pbuf_alloc_custom_fake(pbuf_layer layer, uint16_t length, pbuf_type type) {
+  (void)layer;
+  (void)type;
+  struct pbuf *pbuf = static_cast<struct pbuf *>(calloc(1, sizeof(struct pbuf) + length));
+  pbuf->payload = &pbuf[1];
+  pbuf->len = length;
+  pbuf->tot_len = length;
+  pbuf->ref = 1;
+  return pbuf;
+}
+
+static struct pbuf *pbuf_alloced_custom_custom_fake(pbuf_layer layer, uint16_t length, pbuf_type type,
+                                                    struct pbuf_custom *p, void *payload_mem, uint16_t payload_mem_len) {
+  (void)layer;
+  (void)type;
+  (void)payload_mem_len;
+  memset(&p->pbuf, 0, sizeof(p->pbuf));
+  p->pbuf.payload = payload_mem;
+  p->pbuf.len = length;
+  p->pbuf.tot_len = length;
+  p->pbuf.ref = 1;
+  p->pbuf.flags = 1;
+  return &p->pbuf;
+}
+
+static void pbuf_ref_custom_fake(struct pbuf *pbuf) {
+  pbuf->ref++;
+}
+
+static uint8_t pbuf_free_custom_fake(struct pbuf *pbuf) {
+  if (--pbuf->ref) {
+    return 0;
+  }
+  if (pbuf->flags) {
+    // Custom pbufs go back to their owner
+    reinterpret_cast<struct pbuf_custom *>(pbuf)->custom_free_function(pbuf);
+  } else {
+    free(pbuf);
+  }
+  return 1;
+}
+
+// The fixture for testing class Foo.
+class BmPubsubTest : public ::testing::Test {
+protected:
+  // You can remove any or all of the following functions if its body
+  // is empty.
+
+  BmPubsubTest() {
+    // You can do set-up work for each test here.
+  }
+
+  ~BmPubsubTest() override {
+    // You can do clean-up work that doesn't throw exceptions here.
+  }
+
+  // If the constructor and destructor are not enough for setting up
+  // and cleaning up each test, you can define the following methods:
+
+  void SetUp() override {
+    // Code here will be called immediately after the constructor (right
+    // before each test).
+    RESET_FAKE(pbuf_alloc);
+    RESET_FAKE(pbuf_alloced_custom);
+    RESET_FAKE(pbuf_ref);
+    RESET_FAKE(pbuf_free);
+    RESET_FAKE(middleware_net_tx);
+    RESET_FAKE(bm_middleware_local_pub);
+    pbuf_alloc_fake.custom_fake = pbuf_alloc_custom_fake;
+    pbuf_alloced_custom_fake.custom_fake = pbuf_alloced_custom_custom_fake;
+    pbuf_ref_fake.custom_fake = pbuf_ref_custom_fake;
+    pbuf_free_fake.custom_fake = pbuf_free_custom_fake;
+    memset(&mock_bcmp_resource_discovery, 0, sizeof(mock_bcmp_resource_discovery));
+  }
+
+  void TearDown() override {
+    // Code here will be called immediately after each test (right
+    // before the destructor).
+    bm_unsub(topic, cb);
+  }
+
+  // Objects declared here can be used by all tests in the test suite for Foo.
+};
+
+TEST_F(BmPubsubTest, LocalOnlyPublishSkipsNetwork) {
+  const uint8_t data[] = "hello";
+  EXPECT_TRUE(bm_sub(topic, cb));
+  mock_bcmp_resource_discovery.remote_sub_possible = false;
+
+  EXPECT_TRUE(bm_pub(topic, data, sizeof(data), 0));
+
+  // Straight into a pooled local buffer, no network pbuf
+  EXPECT_EQ(pbuf_alloc_fake.call_count, 0);
+  EXPECT_EQ(middleware_net_tx_fake.call_count, 0);
+  EXPECT_EQ(pbuf_alloced_custom_fake.call_count, 1);
+  EXPECT_EQ(bm_middleware_local_pub_fake.call_count, 1);
+  EXPECT_EQ(mock_bcmp_resource_discovery.remote_sub_possible_call_count, 1);
+}
+
+TEST_F(BmPubsubTest, RemoteSubscriberGetsNetworkMessage) {
+  const uint8_t data[] = "hello";
+  EXPECT_TRUE(bm_sub(topic, cb));
+  mock_bcmp_resource_discovery.remote_sub_possible = true;
+
+  EXPECT_TRUE(bm_pub(topic, data, sizeof(data), 0));
+
+  // Sent once and shared with the local subscriber
+  EXPECT_EQ(pbuf_alloc_fake.call_count, 1);
+  EXPECT_EQ(middleware_net_tx_fake.call_count, 1);
+  EXPECT_EQ(bm_middleware_local_pub_fake.call_count, 1);
+}
+
+TEST_F(BmPubsubTest, NoLocalSubscriberGoesToNetwork) {
+  const uint8_t data[] = "hello";
+
+  EXPECT_TRUE(bm_pub(topic, data, sizeof(data), 0));
+
+  // Remote subscribers aren't looked up without a local one
+  EXPECT_EQ(mock_bcmp_resource_discovery.remote_sub_possible_call_count, 0);
+  EXPECT_EQ(pbuf_alloc_fake.call_count, 1);
+  EXPECT_EQ(middleware_net_tx_fake.call_count, 1);
+  EXPECT_EQ(bm_middleware_local_pub_fake.call_count, 0);
+}
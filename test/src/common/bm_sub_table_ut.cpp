@@ -0,0 +1,395 @@
+#include "gtest/gtest.h"
+
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "bm_sub_table.h"
+
+static void cb_a(uint64_t, const char *, uint16_t, const uint8_t *, uint16_t, uint8_t, uint8_t) {}
+static void cb_b(uint64_t, const char *, uint16_t, const uint8_t *, uint16_t, uint8_t, uint8_t) {}
+static void cb_c(uint64_t, const char *, uint16_t, const uint8_t *, uint16_t, uint8_t, uint8_t) {}
+
+// The fixture for testing class Foo.
+class SubTableTest : public ::testing::Test {
+protected:
+  // You can remove any or all of the following functions if its body
+  // is empty.
+
+  SubTableTest() {
+    // You can do set-up work for each test here.
+  }
+
+  ~SubTableTest() override {
+    // You can do clean-up work that doesn't throw exceptions here.
+  }
+
+  // If the constructor and destructor are not enough for setting up
+  // and cleaning up each test, you can define the following methods:
+
+  void SetUp() override {
+    // Code here will be called immediately after the constructor (right
+    // before each test).
+    EXPECT_EQ(bm_sub_table_count(), 0);
+  }
+
+  void TearDown() override {
+    // Code here will be called immediately after each test (right
+    // before the destructor).
+    // Leave the table empty for the next test
+    for (uint16_t i = 0; i < BM_SUB_TABLE_ENTRIES; i++) {
+      const bm_sub_t *sub = bm_sub_table_entry(i);
+      while (sub) {
+        std::string topic(sub->topic, sub->topic_len);
+        EXPECT_TRUE(bm_sub_table_remove(topic.c_str(), sub->topic_len, sub->callbacks->callback_fn));
+        // Removing may shift another topic into this slot
+        sub = bm_sub_table_entry(i);
+      }
+    }
+  }
+
+  // Objects declared here can be used by all tests in the test suite for Foo.
+  static std::string sensorTopic(uint32_t i) {
+    char topic[64];
+    snprintf(topic, sizeof(topic), "sensor/%016llx/bm_soft_data", static_cast<unsigned long long>(0xc0ffee0000000000ULL + i * 0x1001));
+    return std::string(topic);
+  }
+
+  static bool add(const std::string &topic, bm_cb_t cb) {
+    return bm_sub_table_add(topic.c_str(), static_cast<uint16_t>(topic.size()), cb);
+  }
+
+  static bool remove(const std::string &topic, bm_cb_t cb) {
+    return bm_sub_table_remove(topic.c_str(), static_cast<uint16_t>(topic.size()), cb);
+  }
+
+  static const bm_sub_t *get(const std::string &topic) {
+    return bm_sub_table_get(topic.c_str(), static_cast<uint16_t>(topic.size()));
+  }
+
+  static bool collect(const bm_sub_t *sub, void *arg) {
+    static_cast<std::vector<std::string> *>(arg)->push_back(std::string(sub->topic, sub->topic_len));
+    return true;
+  }
+
+  // Topics of all subscriptions matching a topic, sorted
+  static std::vector<std::string> match(const std::string &topic) {
+    std::vector<std::string> topics;
+    uint16_t count = bm_sub_table_match(topic.c_str(), static_cast<uint16_t>(topic.size()), collect, &topics);
+    EXPECT_EQ(count, topics.size());
+    std::sort(topics.begin(), topics.end());
+    return topics;
+  }
+};
+
+TEST_F(SubTableTest, AddGetRemove) {
+  EXPECT_EQ(get("topic"), nullptr);
+  EXPECT_TRUE(add("topic", cb_a));
+  EXPECT_TRUE(add("topic", cb_b));
+  EXPECT_TRUE(add("topic", cb_c));
+  // Already subscribed, nothing changes
+  EXPECT_TRUE(add("topic", cb_b));
+  EXPECT_EQ(bm_sub_table_count(), 1);
+
+  // Prefixes and extensions of a topic are different topics
+  EXPECT_EQ(get("topi"), nullptr);
+  EXPECT_EQ(get("topic/"), nullptr);
+
+  // Callbacks run in the order they subscribed
+  const bm_sub_t *sub = get("topic");
+  ASSERT_NE(sub, nullptr);
+  EXPECT_EQ(std::string(sub->topic), "topic");
+  EXPECT_EQ(sub->callbacks->callback_fn, cb_a);
+  EXPECT_EQ(sub->callbacks->next->callback_fn, cb_b);
+  EXPECT_EQ(sub->callbacks->next->next->callback_fn, cb_c);
+  EXPECT_EQ(sub->callbacks->next->next->next, nullptr);
+
+  EXPECT_TRUE(remove("topic", cb_b));
+  EXPECT_FALSE(remove("topic", cb_b));
+  EXPECT_FALSE(remove("other", cb_a));
+  sub = get("topic");
+  ASSERT_NE(sub, nullptr);
+  EXPECT_EQ(sub->callbacks->callback_fn, cb_a);
+  EXPECT_EQ(sub->callbacks->next->callback_fn, cb_c);
+
+  // The topic goes away with its last callback
+  EXPECT_TRUE(remove("topic", cb_a));
+  EXPECT_TRUE(remove("topic", cb_c));
+  EXPECT_EQ(get("topic"), nullptr);
+  EXPECT_EQ(bm_sub_table_count(), 0);
+
+  EXPECT_FALSE(bm_sub_table_add("topic", 0, cb_a));
+  EXPECT_FALSE(bm_sub_table_add(NULL, 5, cb_a));
+  EXPECT_FALSE(bm_sub_table_add("topic", 5, NULL));
+}
+
+TEST_F(SubTableTest, FullTableAndChurn) {
+  std::vector<std::string> topics;
+  for (uint32_t i = 0; i < BM_SUB_MAX_TOPICS; i++) {
+    topics.push_back(sensorTopic(i));
+    EXPECT_TRUE(add(topics.back(), cb_a));
+  }
+  EXPECT_EQ(bm_sub_table_count(), BM_SUB_MAX_TOPICS);
+  EXPECT_FALSE(add(sensorTopic(BM_SUB_MAX_TOPICS), cb_a));
+  // Existing topics can still get more callbacks
+  EXPECT_TRUE(add(topics[0], cb_b));
+
+  // Remove topics in random order, the rest must stay reachable as probe sequences get shifted
+  std::mt19937 rng(1);
+  std::vector<std::string> remaining = topics;
+  while (!remaining.empty()) {
+    size_t victim = rng() % remaining.size();
+    const bm_sub_t *sub = get(remaining[victim]);
+    ASSERT_NE(sub, nullptr);
+    while (sub) {
+      EXPECT_TRUE(remove(remaining[victim], sub->callbacks->callback_fn));
+      sub = get(remaining[victim]);
+    }
+    remaining.erase(remaining.begin() + static_cast<long>(victim));
+    for (const auto &topic : remaining) {
+      ASSERT_NE(get(topic), nullptr) << topic;
+    }
+  }
+  EXPECT_EQ(bm_sub_table_count(), 0);
+}
+
+TEST_F(SubTableTest, CallbackPool) {
+  // Every callback node comes from a fixed pool
+  std::vector<std::string> topics;
+  for (uint32_t i = 0; i < BM_SUB_MAX_CALLBACKS / 2; i++) {
+    topics.push_back(sensorTopic(i));
+    EXPECT_TRUE(add(topics.back(), cb_a));
+    EXPECT_TRUE(add(topics.back(), cb_b));
+  }
+  EXPECT_FALSE(add(topics[0], cb_c));
+  EXPECT_FALSE(add("new/topic", cb_c));
+  EXPECT_EQ(get("new/topic"), nullptr);
+
+  // Nodes go back to the pool when unsubscribing
+  EXPECT_TRUE(remove(topics[1], cb_b));
+  EXPECT_TRUE(add(topics[0], cb_c));
+}
+
+TEST_F(SubTableTest, Wildcards) {
+  EXPECT_TRUE(add("sensor/+/sofar/aanderaa", cb_a));
+  EXPECT_TRUE(add("sensor/+/sofar/aanderaa", cb_b));
+  EXPECT_TRUE(add("sensor/#", cb_a));
+  EXPECT_TRUE(add("sensor/+/+/bm_soft_temp", cb_c));
+  EXPECT_TRUE(add("+/0123456789abcdef/#", cb_c));
+  EXPECT_TRUE(add("#", cb_b));
+  EXPECT_TRUE(add("sensor/0123456789abcdef/sofar/aanderaa", cb_c));
+  EXPECT_EQ(bm_sub_table_count(), 6);
+
+  // Exact topic and wildcards are all matched
+  typedef std::vector<std::string> topics_t;
+  EXPECT_EQ(match("sensor/0123456789abcdef/sofar/aanderaa"),
+            (topics_t{"#", "+/0123456789abcdef/#", "sensor/#", "sensor/+/sofar/aanderaa",
+                      "sensor/0123456789abcdef/sofar/aanderaa"}));
+  EXPECT_EQ(match("sensor/fedcba9876543210/sofar/aanderaa"),
+            (topics_t{"#", "sensor/#", "sensor/+/sofar/aanderaa"}));
+  EXPECT_EQ(match("sensor/fedcba9876543210/sofar/bm_soft_temp"),
+            (topics_t{"#", "sensor/#", "sensor/+/+/bm_soft_temp"}));
+  // '+' matches exactly one level
+  EXPECT_EQ(match("sensor/fedcba9876543210/aanderaa"), (topics_t{"#", "sensor/#"}));
+  EXPECT_EQ(match("sensor/a/b/sofar/aanderaa"), (topics_t{"#", "sensor/#"}));
+  // '#' also matches its parent level
+  EXPECT_EQ(match("sensor"), (topics_t{"#", "sensor/#"}));
+  EXPECT_EQ(match("sensors/1"), (topics_t{"#"}));
+
+  // Stop early
+  uint16_t visits = 0;
+  EXPECT_EQ(bm_sub_table_match("sensor/1/sofar/aanderaa", 23, [](const bm_sub_t *, void *arg) {
+    (*static_cast<uint16_t *>(arg))++;
+    return false;
+  }, &visits), 1);
+  EXPECT_EQ(visits, 1);
+  EXPECT_EQ(bm_sub_table_match("sensor/1/sofar/aanderaa", 23, NULL, NULL), 3);
+
+  // Wildcard subscriptions are listed with the rest
+  uint16_t listed = 0;
+  for (uint16_t i = 0; i < BM_SUB_TABLE_ENTRIES; i++) {
+    listed += (bm_sub_table_entry(i) != nullptr);
+  }
+  EXPECT_EQ(listed, 6);
+
+  // Removing a subscription keeps levels shared with other ones
+  EXPECT_FALSE(remove("sensor/+/sofar/aanderaa", cb_c));
+  EXPECT_FALSE(remove("sensor/+/sofar", cb_a));
+  EXPECT_TRUE(remove("sensor/+/sofar/aanderaa", cb_a));
+  EXPECT_EQ(match("sensor/1/sofar/aanderaa"), (topics_t{"#", "sensor/#", "sensor/+/sofar/aanderaa"}));
+  EXPECT_TRUE(remove("sensor/+/sofar/aanderaa", cb_b));
+  EXPECT_EQ(match("sensor/1/sofar/aanderaa"), (topics_t{"#", "sensor/#"}));
+  EXPECT_EQ(match("sensor/1/sofar/bm_soft_temp"), (topics_t{"#", "sensor/#", "sensor/+/+/bm_soft_temp"}));
+  EXPECT_TRUE(remove("#", cb_b));
+  EXPECT_TRUE(remove("sensor/#", cb_a));
+  EXPECT_EQ(match("sensor/1/sofar/bm_soft_temp"), (topics_t{"sensor/+/+/bm_soft_temp"}));
+  EXPECT_EQ(bm_sub_table_count(), 3);
+}
+
+TEST_F(SubTableTest, BadWildcards) {
+  EXPECT_FALSE(add("sensor/#/aanderaa", cb_a));
+  EXPECT_FALSE(add("sensor/a+/aanderaa", cb_a));
+  EXPECT_FALSE(add("sensor/+a/aanderaa", cb_a));
+  EXPECT_FALSE(add("sensor#", cb_a));
+  EXPECT_FALSE(add("##", cb_a));
+  EXPECT_EQ(bm_sub_table_count(), 0);
+  EXPECT_TRUE(add("+", cb_a));
+  EXPECT_TRUE(add("+/+", cb_a));
+  EXPECT_EQ(match("a"), (std::vector<std::string>{"+"}));
+  EXPECT_EQ(match("a/"), (std::vector<std::string>{"+/+"}));
+}
+
+TEST_F(SubTableTest, TopicMatches) {
+  // Single subscriptions match topics the same way the table does
+  const std::vector<std::string> subs = {
+      "sensor/+/sofar/aanderaa", "sensor/#", "sensor/+/+/bm_soft_temp", "+/0123456789abcdef/#",
+      "#", "sensor/0123456789abcdef/sofar/aanderaa", "+", "+/+"};
+  const std::vector<std::string> topics = {
+      "sensor/0123456789abcdef/sofar/aanderaa", "sensor/fedcba9876543210/sofar/bm_soft_temp",
+      "sensor/fedcba9876543210/aanderaa", "sensor/a/b/sofar/aanderaa", "sensor", "sensors/1",
+      "a", "a/", "0123456789abcdef/x"};
+  for (const auto &sub : subs) {
+    EXPECT_TRUE(add(sub, cb_a));
+  }
+  for (const auto &topic : topics) {
+    std::vector<std::string> matched = match(topic);
+    for (const auto &sub : subs) {
+      bool in_table = std::find(matched.begin(), matched.end(), sub) != matched.end();
+      EXPECT_EQ(bm_sub_topic_matches(sub.c_str(), static_cast<uint16_t>(sub.size()), topic.c_str(),
+                                     static_cast<uint16_t>(topic.size())),
+                in_table)
+          << sub << " " << topic;
+    }
+  }
+  EXPECT_FALSE(bm_sub_topic_matches("sensor/a", 8, "sensor", 6));
+  EXPECT_FALSE(bm_sub_topic_matches("sensor", 6, "sensor/a", 8));
+}
+
+TEST_F(SubTableTest, WildcardLevels) {
+  // Each distinct level takes one from the pool
+  std::vector<std::string> topics;
+  for (uint32_t i = 0; i < BM_SUB_MAX_WILDCARD_LEVELS / 2; i++) {
+    topics.push_back("sensor/+/" + std::to_string(i));
+    EXPECT_TRUE(add(topics.back(), cb_a));
+  }
+  // sensor and + are shared
+  for (uint32_t i = BM_SUB_MAX_WILDCARD_LEVELS / 2; i < BM_SUB_MAX_WILDCARD_LEVELS - 2; i++) {
+    topics.push_back("sensor/+/" + std::to_string(i));
+    EXPECT_TRUE(add(topics.back(), cb_a));
+  }
+  EXPECT_FALSE(add("sensor/+/full", cb_a));
+  // A failed subscription doesn't leave levels behind
+  EXPECT_FALSE(add("other/+/full", cb_a));
+  EXPECT_TRUE(remove(topics.back(), cb_a));
+  EXPECT_FALSE(add("other/#", cb_a));
+  EXPECT_TRUE(add("#", cb_a));
+  EXPECT_EQ(match("sensor/1/7"), (std::vector<std::string>{"#", "sensor/+/7"}));
+}
+
+TEST_F(SubTableTest, MayMatch) {
+  auto mayMatch = [](const std::string &topic) {
+    return bm_sub_table_may_match(topic.c_str(), static_cast<uint16_t>(topic.size()));
+  };
+
+  EXPECT_FALSE(mayMatch("sensor/1/sofar/aanderaa"));
+  EXPECT_TRUE(add("sensor/1/sofar/aanderaa", cb_a));
+  EXPECT_TRUE(add("spotter/#", cb_a));
+  EXPECT_TRUE(mayMatch("sensor/1/sofar/aanderaa"));
+  EXPECT_TRUE(mayMatch("spotter/printf"));
+  EXPECT_TRUE(mayMatch("spotter"));
+
+  // Never a false negative, and few false positives with a typical subscription count
+  uint32_t false_positives = 0;
+  static constexpr uint32_t PROBES = 10000;
+  for (uint32_t i = 0; i < 16; i++) {
+    EXPECT_TRUE(add(sensorTopic(i), cb_b));
+  }
+  for (uint32_t i = 0; i < PROBES; i++) {
+    std::string topic = sensorTopic(i);
+    bool subscribed = (i < 16);
+    EXPECT_EQ(!match(topic).empty(), subscribed);
+    if (subscribed) {
+      EXPECT_TRUE(mayMatch(topic));
+    } else {
+      false_positives += mayMatch(topic);
+    }
+  }
+  printf("%u of %u unsubscribed topics pass the filter with 17 topics and 1 wildcard subscribed\n", false_positives, PROBES);
+  EXPECT_LT(false_positives, PROBES / 20);
+
+  // Removing subscriptions narrows the filter again
+  for (uint32_t i = 0; i < 16; i++) {
+    EXPECT_TRUE(remove(sensorTopic(i), cb_b));
+  }
+  EXPECT_TRUE(remove("sensor/1/sofar/aanderaa", cb_a));
+  EXPECT_FALSE(mayMatch("sensor/1/sofar/aanderaa"));
+  EXPECT_TRUE(mayMatch("spotter/printf"));
+  EXPECT_TRUE(remove("spotter/#", cb_a));
+  EXPECT_FALSE(mayMatch("spotter/printf"));
+
+  // A leading wildcard matches everything
+  EXPECT_TRUE(add("+/printf", cb_a));
+  EXPECT_TRUE(mayMatch("anything"));
+  EXPECT_TRUE(remove("+/printf", cb_a));
+  EXPECT_FALSE(mayMatch("anything"));
+}
+
+TEST_F(SubTableTest, DispatchBenchmark) {
+  // Compare the cost of finding a topic's callbacks against the old linear list walk
+  static constexpr uint32_t LOOKUPS = 200000;
+  const uint32_t sub_counts[] = {1, 4, 16, 32, BM_SUB_MAX_TOPICS};
+  std::vector<std::string> topics;
+  for (uint32_t i = 0; i < BM_SUB_MAX_TOPICS * 2; i++) {
+    topics.push_back(sensorTopic(i));
+  }
+
+  printf("%6s %12s %12s\n", "subs", "table ns", "list ns");
+  for (uint32_t count : sub_counts) {
+    for (uint32_t i = 0; i < count; i++) {
+      EXPECT_TRUE(add(topics[i], cb_a));
+    }
+
+    // Half the traffic is for topics we subscribe to, half isn't
+    uint32_t found = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (uint32_t i = 0; i < LOOKUPS; i++) {
+      const std::string &topic = topics[(i % 2) ? (i % count) : (count + i % count)];
+      found += (bm_sub_table_get(topic.data(), static_cast<uint16_t>(topic.size())) != nullptr);
+    }
+    double table_ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / LOOKUPS;
+    EXPECT_EQ(found, LOOKUPS / 2);
+
+    found = 0;
+    start = std::chrono::steady_clock::now();
+    for (uint32_t i = 0; i < LOOKUPS; i++) {
+      const std::string &topic = topics[(i % 2) ? (i % count) : (count + i % count)];
+      for (uint32_t j = 0; j < count; j++) {
+        if (topics[j].size() == topic.size() && memcmp(topics[j].data(), topic.data(), topic.size()) == 0) {
+          found++;
+          break;
+        }
+      }
+    }
+    double list_ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / LOOKUPS;
+    EXPECT_EQ(found, LOOKUPS / 2);
+    printf("%6u %12.1f %12.1f\n", count, table_ns, list_ns);
+
+    for (uint32_t i = 0; i < count; i++) {
+      EXPECT_TRUE(remove(topics[i], cb_a));
+    }
+  }
+
+  // One wildcard subscription instead of one per node
+  EXPECT_TRUE(add("sensor/+/bm_soft_data", cb_a));
+  uint32_t found = 0;
+  auto start = std::chrono::steady_clock::now();
+  for (uint32_t i = 0; i < LOOKUPS; i++) {
+    const std::string &topic = topics[i % topics.size()];
+    found += bm_sub_table_match(topic.data(), static_cast<uint16_t>(topic.size()), NULL, NULL);
+  }
+  double wildcard_ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / LOOKUPS;
+  EXPECT_EQ(found, LOOKUPS);
+  printf("%6s %12.1f\n", "+", wildcard_ns);
+}
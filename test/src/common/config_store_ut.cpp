@@ -0,0 +1,465 @@
+#include "gtest/gtest.h"
+
+#include <string>
+#include <vector>
+
+#include "config_store.h"
+#include "mock_storage_driver.h"
+#include "nvmPartition.h"
+
+using namespace testing;
+using namespace cfg;
+
+//
+// NOR flash behind the storage driver. Erases set whole sectors to 0xFF and
+// programs can only clear bits. Timings are typical W25Q64JV numbers.
+//
+class NorFlashModel {
+public:
+  static constexpr uint32_t SECTOR_SIZE = 4096;
+  static constexpr uint32_t PAGE_SIZE = 256;
+  static constexpr uint32_t SIZE = 16 * SECTOR_SIZE;
+  static constexpr double SECTOR_ERASE_MS = 45.0;
+  static constexpr double PAGE_PROGRAM_MS = 0.4;
+  // 10 MHz SPI
+  static constexpr double SPI_MS_PER_BYTE = 0.0008;
+
+  NorFlashModel(MockStorageDriver &storage) : mem(SIZE, 0xFF) {
+    EXPECT_CALL(storage, getAlignmentBytes()).Times(AtLeast(0)).WillRepeatedly(Return(SECTOR_SIZE));
+    EXPECT_CALL(storage, getStorageSizeBytes()).Times(AtLeast(0)).WillRepeatedly(Return(8000000));
+    EXPECT_CALL(storage, read).Times(AtLeast(0)).WillRepeatedly(Invoke(this, &NorFlashModel::read));
+    EXPECT_CALL(storage, write).Times(AtLeast(0)).WillRepeatedly(Invoke(this, &NorFlashModel::write));
+    EXPECT_CALL(storage, erase).Times(AtLeast(0)).WillRepeatedly(Invoke(this, &NorFlashModel::erase));
+  }
+
+  bool read(uint32_t addr, uint8_t *buffer, size_t len, uint32_t timeoutMs) {
+    (void)timeoutMs;
+    EXPECT_LE(addr + len, SIZE);
+    memcpy(buffer, &mem[addr], len);
+    busy_ms += len * SPI_MS_PER_BYTE;
+    return true;
+  }
+
+  bool write(uint32_t addr, uint8_t *buffer, size_t len, uint32_t timeoutMs) {
+    (void)timeoutMs;
+    EXPECT_LE(addr + len, SIZE);
+    if (read_modify_erase) {
+      // What W25::write() does: read, erase and reprogram every sector touched
+      for (uint32_t sector = addr / SECTOR_SIZE; sector <= (addr + len - 1) / SECTOR_SIZE; sector++) {
+        erases++;
+        page_programs += SECTOR_SIZE / PAGE_SIZE;
+        busy_ms += SECTOR_SIZE * SPI_MS_PER_BYTE * 2 + SECTOR_ERASE_MS + (SECTOR_SIZE / PAGE_SIZE) * PAGE_PROGRAM_MS;
+      }
+      memcpy(&mem[addr], buffer, len);
+      return true;
+    }
+
+    size_t programmed = len;
+    if (tear_after >= 0 && static_cast<size_t>(tear_after) < len) {
+      // Power goes out partway through
+      programmed = tear_after;
+    }
+    tear_after = -1;
+    for (uint32_t page = addr / PAGE_SIZE; page <= (addr + len - 1) / PAGE_SIZE; page++) {
+      page_programs++;
+      busy_ms += PAGE_PROGRAM_MS;
+    }
+    for (size_t i = 0; i < programmed; i++) {
+      if ((mem[addr + i] & buffer[i]) != buffer[i]) {
+        program_violations++;
+      }
+      mem[addr + i] &= buffer[i];
+    }
+    busy_ms += len * SPI_MS_PER_BYTE;
+    return programmed == len;
+  }
+
+  bool erase(uint32_t addr, size_t len, uint32_t timeoutMs) {
+    (void)timeoutMs;
+    EXPECT_EQ(addr % SECTOR_SIZE, 0u);
+    for (uint32_t sector = addr / SECTOR_SIZE; sector <= (addr + len - 1) / SECTOR_SIZE; sector++) {
+      memset(&mem[sector * SECTOR_SIZE], 0xFF, SECTOR_SIZE);
+      erases++;
+      busy_ms += SECTOR_ERASE_MS;
+    }
+    return true;
+  }
+
+  std::vector<uint8_t> mem;
+  bool read_modify_erase = false;
+  int32_t tear_after = -1;
+  uint32_t erases = 0;
+  uint32_t page_programs = 0;
+  uint32_t program_violations = 0;
+  double busy_ms = 0;
+};
+
+struct TestKey {
+  std::string key;
+  uint8_t type;
+  std::vector<uint8_t> value;
+};
+
+static bool keyCb(void *arg, uint16_t idx, ConfigStoreRecord_t &record) {
+  std::vector<TestKey> *keys = static_cast<std::vector<TestKey> *>(arg);
+  if (idx >= keys->size()) {
+    return false;
+  }
+  const TestKey &key = (*keys)[idx];
+  record.key = key.key.c_str();
+  record.keyLen = key.key.size();
+  record.type = key.type;
+  record.value = key.value.data();
+  record.valueLen = key.value.size();
+  return true;
+}
+
+static bool loadCb(void *arg, const ConfigStoreRecord_t &record) {
+  std::vector<TestKey> *keys = static_cast<std::vector<TestKey> *>(arg);
+  keys->push_back({std::string(record.key, record.keyLen), record.type,
+                   std::vector<uint8_t>(record.value, record.value + record.valueLen)});
+  return true;
+}
+
+static std::vector<uint8_t> u32Value(uint32_t value) {
+  // CBOR uint32, like Configuration stores it
+  return {0x1a, static_cast<uint8_t>(value >> 24), static_cast<uint8_t>(value >> 16), static_cast<uint8_t>(value >> 8),
+          static_cast<uint8_t>(value)};
+}
+
+static void expectSameKeys(const std::vector<TestKey> &a, const std::vector<TestKey> &b) {
+  ASSERT_EQ(a.size(), b.size());
+  for (size_t i = 0; i < a.size(); i++) {
+    EXPECT_EQ(a[i].key, b[i].key);
+    EXPECT_EQ(a[i].type, b[i].type);
+    EXPECT_EQ(a[i].value, b[i].value);
+  }
+}
+
+// The fixture for testing class Foo.
+class ConfigStoreTest : public ::testing::Test {
+protected:
+  // You can remove any or all of the following functions if its body
+  // is empty.
+
+  ConfigStoreTest() : partition(_storage, test_configuration) {
+    // You can do set-up work for each test here.
+  }
+
+  ~ConfigStoreTest() override {
+    // You can do clean-up work that doesn't throw exceptions here.
+  }
+
+  // If the constructor and destructor are not enough for setting up
+  // and cleaning up each test, you can define the following methods:
+
+  void SetUp() override {
+    // Code here will be called immediately after the constructor (right
+    // before each test).
+    for (uint32_t i = 0; i < 20; i++) {
+      keys.push_back({"sensorKey" + std::to_string(i), 0, u32Value(i * 1000)});
+    }
+  }
+
+  void TearDown() override {
+    // Code here will be called immediately after each test (right
+    // before the destructor).
+    EXPECT_EQ(flash.program_violations, 0u);
+  }
+
+  // What a reboot would load
+  std::vector<TestKey> reload(void) {
+    std::vector<TestKey> loaded;
+    ConfigStore store(partition);
+    EXPECT_TRUE(store.load(loadCb, &loaded));
+    return loaded;
+  }
+
+  // Objects declared here can be used by all tests in the test suite for Foo.
+  const ext_flash_partition_t test_configuration = {
+      .fa_off = 4096,
+      .fa_size = 10 * 1024,
+  };
+  MockStorageDriver _storage;
+  NorFlashModel flash{_storage};
+  NvmPartition partition;
+  std::vector<TestKey> keys;
+};
+
+TEST_F(ConfigStoreTest, EmptyFlash) {
+  ConfigStore store(partition);
+  std::vector<TestKey> loaded;
+  EXPECT_FALSE(store.load(loadCb, &loaded));
+  EXPECT_TRUE(loaded.empty());
+  EXPECT_EQ(store.freeBytes(), 0u);
+}
+
+TEST_F(ConfigStoreTest, SaveLoad) {
+  ConfigStore store(partition);
+  EXPECT_FALSE(store.load(loadCb, &keys));
+  EXPECT_TRUE(store.save(keyCb, &keys));
+  EXPECT_EQ(store.getStats().compactions, 1u);
+  EXPECT_EQ(flash.erases, 1u);
+  expectSameKeys(reload(), keys);
+}
+
+TEST_F(ConfigStoreTest, UnchangedSaveWritesNothing) {
+  ConfigStore store(partition);
+  EXPECT_TRUE(store.save(keyCb, &keys));
+  uint32_t page_programs = flash.page_programs;
+  EXPECT_TRUE(store.save(keyCb, &keys));
+  EXPECT_EQ(flash.page_programs, page_programs);
+  EXPECT_EQ(store.getStats().unchangedSaves, 1u);
+}
+
+TEST_F(ConfigStoreTest, AppendChangedKeys) {
+  ConfigStore store(partition);
+  EXPECT_TRUE(store.save(keyCb, &keys));
+  uint32_t free_bytes = store.freeBytes();
+
+  keys[3].value = u32Value(123456);
+  keys.push_back({"newKey", 3, {0x63, 'a', 'b', 'c'}});
+  EXPECT_TRUE(store.save(keyCb, &keys));
+  EXPECT_EQ(store.getStats().appendedRecords, 2u);
+  EXPECT_EQ(free_bytes - store.freeBytes(),
+            2 * sizeof(ConfigStoreRecordHeader_t) + keys[3].key.size() + 5 + keys.back().key.size() + 4);
+  EXPECT_EQ(flash.erases, 1u);
+  expectSameKeys(reload(), keys);
+
+  // Loading goes on appending where the log left off
+  ConfigStore other(partition);
+  std::vector<TestKey> loaded;
+  EXPECT_TRUE(other.load(loadCb, &loaded));
+  EXPECT_EQ(other.freeBytes(), store.freeBytes());
+  loaded[0].value = u32Value(7);
+  EXPECT_TRUE(other.save(keyCb, &loaded));
+  EXPECT_EQ(other.getStats().appendedRecords, 1u);
+  expectSameKeys(reload(), loaded);
+}
+
+TEST_F(ConfigStoreTest, RemoveKeys) {
+  ConfigStore store(partition);
+  EXPECT_TRUE(store.save(keyCb, &keys));
+  keys.erase(keys.begin() + 5);
+  keys.erase(keys.begin());
+  EXPECT_TRUE(store.save(keyCb, &keys));
+  EXPECT_EQ(store.getStats().appendedRecords, 2u);
+  expectSameKeys(reload(), keys);
+
+  // Removed and set again, it goes to the back
+  keys.push_back({"sensorKey0", 0, u32Value(1)});
+  EXPECT_TRUE(store.save(keyCb, &keys));
+  expectSameKeys(reload(), keys);
+}
+
+TEST_F(ConfigStoreTest, RejectedKeyIsNotDeleted) {
+  ConfigStore store(partition);
+  keys[4].type = 9;
+  EXPECT_TRUE(store.save(keyCb, &keys));
+  std::vector<TestKey> saved = keys;
+
+  // Like a key of a type this firmware doesn't know
+  ConfigStore other(partition);
+  std::vector<TestKey> loaded;
+  EXPECT_TRUE(other.load(
+      [](void *arg, const ConfigStoreRecord_t &record) {
+        return record.type != 9 && loadCb(arg, record);
+      },
+      &loaded));
+  EXPECT_EQ(loaded.size(), keys.size() - 1);
+  loaded[0].value = u32Value(7);
+  EXPECT_TRUE(other.save(keyCb, &loaded));
+  EXPECT_EQ(other.getStats().appendedRecords, 1u);
+
+  saved[0].value = u32Value(7);
+  expectSameKeys(reload(), saved);
+}
+
+TEST_F(ConfigStoreTest, CompactWhenFull) {
+  ConfigStore store(partition);
+  EXPECT_TRUE(store.save(keyCb, &keys));
+  for (uint32_t i = 0; i < 500; i++) {
+    keys[i % keys.size()].value = u32Value(i);
+    EXPECT_TRUE(store.save(keyCb, &keys));
+    EXPECT_GE(store.freeBytes(), 0u);
+  }
+  EXPECT_GT(store.getStats().compactions, 2u);
+  EXPECT_EQ(flash.erases, store.getStats().compactions);
+  expectSameKeys(reload(), keys);
+}
+
+TEST_F(ConfigStoreTest, ManyKeys) {
+  ConfigStore store(partition);
+  keys.clear();
+  for (uint32_t i = 0; i < 150; i++) {
+    keys.push_back({"k" + std::to_string(i), 0, u32Value(i)});
+  }
+  EXPECT_TRUE(store.save(keyCb, &keys));
+  for (uint32_t i = 150; i < 200; i++) {
+    keys.push_back({"k" + std::to_string(i), 0, u32Value(i)});
+  }
+  EXPECT_TRUE(store.save(keyCb, &keys));
+  expectSameKeys(reload(), keys);
+}
+
+TEST_F(ConfigStoreTest, DoesNotFitBlock) {
+  ConfigStore store(partition);
+  EXPECT_TRUE(store.save(keyCb, &keys));
+  uint32_t used = 0;
+  for (const TestKey &key : keys) {
+    used += ConfigStore::recordSize(key.key.size(), key.value.size());
+  }
+  uint32_t room = store.capacity() - used;
+  EXPECT_EQ(store.freeBytes(), room);
+
+  // Exactly fills the block
+  keys.push_back({"big", 4, std::vector<uint8_t>(room - ConfigStore::recordSize(3, 0), 0x5a)});
+  EXPECT_TRUE(store.save(keyCb, &keys));
+  EXPECT_EQ(store.freeBytes(), 0u);
+
+  keys.back().value.push_back(0x5a);
+  EXPECT_FALSE(store.save(keyCb, &keys));
+
+  // Swapping a key for another fits
+  keys.back().value.pop_back();
+  keys[0].value = u32Value(1);
+  EXPECT_TRUE(store.save(keyCb, &keys));
+  expectSameKeys(reload(), keys);
+}
+
+TEST_F(ConfigStoreTest, TornAppend) {
+  ConfigStore store(partition);
+  EXPECT_TRUE(store.save(keyCb, &keys));
+  std::vector<TestKey> saved = keys;
+
+  keys[1].value = u32Value(1);
+  keys[2].value = u32Value(2);
+  // The first record makes it, the second doesn't
+  flash.tear_after = sizeof(ConfigStoreRecordHeader_t) + keys[1].key.size() + 5 + 3;
+  EXPECT_FALSE(store.save(keyCb, &keys));
+  saved[1].value = u32Value(1);
+  expectSameKeys(reload(), saved);
+
+  // After a reboot, the half written record is compacted away before anything else is appended
+  ConfigStore other(partition);
+  std::vector<TestKey> loaded;
+  EXPECT_TRUE(other.load(loadCb, &loaded));
+  uint32_t erases = flash.erases;
+  EXPECT_TRUE(other.save(keyCb, &keys));
+  EXPECT_EQ(flash.erases, erases + 1);
+  expectSameKeys(reload(), keys);
+}
+
+TEST_F(ConfigStoreTest, TornCompaction) {
+  ConfigStore store(partition);
+  EXPECT_TRUE(store.save(keyCb, &keys));
+  keys[0].value = u32Value(42);
+  EXPECT_TRUE(store.save(keyCb, &keys));
+  std::vector<TestKey> saved = keys;
+
+  // Fits in a block, but not in what is left of this one
+  keys.push_back({"big", 4, std::vector<uint8_t>(3560, 0x5a)});
+  ASSERT_GT(sizeof(ConfigStoreRecordHeader_t) + 3 + 3560, store.freeBytes());
+  flash.tear_after = 100;
+  EXPECT_FALSE(store.save(keyCb, &keys));
+  EXPECT_EQ(store.getStats().compactions, 1u);
+  expectSameKeys(reload(), saved);
+
+  // The next save compacts into the same block again
+  EXPECT_TRUE(store.save(keyCb, &keys));
+  EXPECT_EQ(store.getStats().compactions, 2u);
+  expectSameKeys(reload(), keys);
+}
+
+TEST_F(ConfigStoreTest, TornMigration) {
+  // Layout from older firmware, it runs past the first block
+  const uint32_t legacy_partition_bytes = 9 + 50 * (32 + 4 + 4) + 50 * 50;
+  ASSERT_GT(legacy_partition_bytes, NorFlashModel::SECTOR_SIZE);
+  std::vector<uint8_t> legacy(legacy_partition_bytes);
+  for (uint32_t i = 0; i < legacy.size(); i++) {
+    legacy[i] = i * 7;
+  }
+  memcpy(&flash.mem[test_configuration.fa_off], legacy.data(), legacy.size());
+  auto block0Intact = [&]() {
+    return memcmp(&flash.mem[test_configuration.fa_off], legacy.data(), NorFlashModel::SECTOR_SIZE) == 0;
+  };
+
+  ConfigStore store(partition);
+  std::vector<TestKey> loaded;
+  EXPECT_FALSE(store.load(loadCb, &loaded));
+  flash.tear_after = 100;
+  EXPECT_FALSE(store.save(keyCb, &keys));
+  // The first block is left alone, so the old layout is still there
+  EXPECT_TRUE(block0Intact());
+  ConfigStore torn(partition);
+  EXPECT_FALSE(torn.load(loadCb, &loaded));
+
+  EXPECT_TRUE(store.save(keyCb, &keys));
+  EXPECT_TRUE(block0Intact());
+  expectSameKeys(reload(), keys);
+
+  // Only the next compaction reuses it
+  keys[0].value = u32Value(42);
+  EXPECT_TRUE(store.save(keyCb, &keys));
+  EXPECT_TRUE(block0Intact());
+  keys.push_back({"big", 4, std::vector<uint8_t>(3560, 0x5a)});
+  EXPECT_TRUE(store.save(keyCb, &keys));
+  EXPECT_EQ(store.getStats().compactions, 2u);
+  EXPECT_FALSE(block0Intact());
+  expectSameKeys(reload(), keys);
+}
+
+//
+// rbrPressureProcessor style: one value changes and is saved over and over. The
+// whole partition used to be rewritten each time.
+//
+TEST_F(ConfigStoreTest, EraseCountAndCommitLatency) {
+  const uint32_t saves = 1000;
+  // ConfigPartition_t on the 32 bit target: header, 50 keys, 50 values
+  const uint32_t legacy_partition_bytes = 9 + 50 * (32 + 4 + 4) + 50 * 50;
+  std::vector<uint8_t> legacy(legacy_partition_bytes, 0);
+
+  flash.read_modify_erase = true;
+  for (uint32_t i = 0; i < saves; i++) {
+    EXPECT_TRUE(partition.write(0, legacy.data(), legacy.size(), 100));
+  }
+  uint32_t legacy_erases = flash.erases;
+  double legacy_ms = flash.busy_ms / saves;
+
+  // A driver that erases on every write, appends included
+  flash.erases = 0;
+  flash.busy_ms = 0;
+  {
+    ConfigStore store(partition);
+    store.save(keyCb, &keys);
+    for (uint32_t i = 0; i < saves; i++) {
+      keys[0].value = u32Value(i);
+      EXPECT_TRUE(store.save(keyCb, &keys));
+    }
+  }
+  uint32_t rme_erases = flash.erases;
+  double rme_ms = flash.busy_ms / saves;
+
+  // Page programs into erased flash
+  flash.read_modify_erase = false;
+  std::fill(flash.mem.begin(), flash.mem.end(), 0xFF);
+  flash.erases = 0;
+  flash.busy_ms = 0;
+  ConfigStore store(partition);
+  store.save(keyCb, &keys);
+  for (uint32_t i = 0; i < saves; i++) {
+    keys[0].value = u32Value(i);
+    EXPECT_TRUE(store.save(keyCb, &keys));
+  }
+  uint32_t log_erases = flash.erases;
+  double log_ms = flash.busy_ms / saves;
+
+  printf("Whole partition:              %5u erases, %6.2f ms per commit\n", legacy_erases, legacy_ms);
+  printf("Log, read-modify-erase write: %5u erases, %6.2f ms per commit\n", rme_erases, rme_ms);
+  printf("Log, page program write:      %5u erases, %6.2f ms per commit\n", log_erases, log_ms);
+  expectSameKeys(reload(), keys);
+
+  EXPECT_LT(rme_erases, legacy_erases);
+  EXPECT_LT(log_erases * 100, legacy_erases);
+  EXPECT_LT(log_ms * 20, legacy_ms);
+}
@@ -1,6 +1,12 @@
 #include "gtest/gtest.h"
 
+#include <algorithm>
+#include <chrono>
+#include <inttypes.h>
+#include <vector>
+
 #include "configuration.h"
+#include "crc.h"
 #include "fff.h"
 #include "mock_storage_driver.h"
 #include "nvmPartition.h"
@@ -196,11 +202,214 @@ TEST_F(ConfigurationTest, TooMuchThingy)
   NvmPartition testPartition(_storage, test_configuration);
   Configuration config(testPartition,ram_hardware_configuration,RAM_HARDWARE_CONFIG_SIZE_BYTES);
 
+  // Used to be more than a value could hold
   const char * silly = "The quick brown fox jumps over the lazy dog The quick brown fox jumps over the lazy dog";
-  EXPECT_EQ(config.setConfig("silly",strlen("silly"), silly, strlen(silly)),false);
+  EXPECT_EQ(config.setConfig("silly",strlen("silly"), silly, strlen(silly)),true);
   uint8_t bytes[100];
   memset(bytes, 0xa5, sizeof(bytes));
-  EXPECT_EQ(config.setConfig("bytes", strlen("bytes"), bytes, sizeof(bytes)),false);
+  EXPECT_EQ(config.setConfig("bytes", strlen("bytes"), bytes, sizeof(bytes)),true);
+
+  // Still has to fit in a config store block
+  static uint8_t huge[4096];
+  EXPECT_EQ(config.setConfig("huge", strlen("huge"), huge, sizeof(huge)),false);
+  uint8_t num_keys;
+  config.getStoredKeys(num_keys);
+  EXPECT_EQ(num_keys, 2);
+  const char *too_long_key = "012345678901234567890123456789012";
+  EXPECT_EQ(config.setConfig(too_long_key, strlen(too_long_key), static_cast<uint32_t>(1)),false);
+}
+
+TEST_F(ConfigurationTest, LargeValues)
+{
+  const ext_flash_partition_t test_configuration = {
+      .fa_off = 4096,
+      .fa_size = 10000,
+  };
+  NvmPartition testPartition(_storage, test_configuration);
+  Configuration config(testPartition,ram_hardware_configuration,RAM_HARDWARE_CONFIG_SIZE_BYTES);
+
+  uint8_t first[1000];
+  uint8_t second[300];
+  char third[500];
+  memset(first, 0x11, sizeof(first));
+  memset(second, 0x22, sizeof(second));
+  memset(third, 'c', sizeof(third));
+  EXPECT_EQ(config.setConfig("first", strlen("first"), first, sizeof(first)),true);
+  EXPECT_EQ(config.setConfig("second", strlen("second"), second, sizeof(second)),true);
+  EXPECT_EQ(config.setConfig("third", strlen("third"), third, sizeof(third)),true);
+  EXPECT_EQ(config.setConfig("scalar", strlen("scalar"), static_cast<uint32_t>(7)),true);
+
+  // Growing, shrinking and removing values moves the others around
+  uint8_t bigger_second[600];
+  memset(bigger_second, 0x33, sizeof(bigger_second));
+  EXPECT_EQ(config.setConfig("second", strlen("second"), bigger_second, sizeof(bigger_second)),true);
+  EXPECT_EQ(config.setConfig("first", strlen("first"), first, 10),true);
+  EXPECT_EQ(config.removeKey("third", strlen("third")),true);
+
+  uint8_t result[1000];
+  size_t size = sizeof(result);
+  EXPECT_EQ(config.getConfig("first", strlen("first"), result, size),true);
+  EXPECT_EQ(size, 10);
+  EXPECT_EQ(memcmp(result, first, size),0);
+  size = sizeof(result);
+  EXPECT_EQ(config.getConfig("second", strlen("second"), result, size),true);
+  EXPECT_EQ(size, sizeof(bigger_second));
+  EXPECT_EQ(memcmp(result, bigger_second, size),0);
+  uint32_t scalar = 0;
+  EXPECT_EQ(config.getConfig("scalar", strlen("scalar"), scalar),true);
+  EXPECT_EQ(scalar, 7);
+
+  // The raw CBOR is only as long as the value
+  size = sizeof(result);
+  EXPECT_EQ(config.getConfigCbor("second", strlen("second"), result, size),true);
+  EXPECT_EQ(size, sizeof(bigger_second) + 3);
+  size_t cbor_size = 0;
+  EXPECT_EQ(config.getCborValueSize("second", strlen("second"), cbor_size),true);
+  EXPECT_EQ(cbor_size, size);
+  EXPECT_EQ(config.getCborValueSize("missing", strlen("missing"), cbor_size),false);
+  size = 100;
+  EXPECT_EQ(config.getConfigCbor("second", strlen("second"), result, size),false);
+  size_t value_size = 0;
+  EXPECT_EQ(config.getValueSize("second", strlen("second"), value_size),true);
+  EXPECT_EQ(value_size, sizeof(bigger_second));
+}
+
+//
+// Layout from before variable length values, it gets migrated when loaded
+//
+typedef struct __attribute__((packed)) {
+  uint32_t crc32;
+  uint32_t version;
+  uint8_t numKeys;
+  struct __attribute__((packed)) {
+    char keyBuffer[MAX_KEY_LEN_BYTES];
+    size_t keyLen;
+    ConfigDataTypes_e valueType;
+  } keys[50];
+  uint8_t values[50][50];
+} LegacyLayout_t;
+
+// 60000, with padding after it like every legacy value
+static const uint8_t legacy_sample_ms[] = {0x19, 0xea, 0x60};
+static const uint8_t legacy_name[] = {0x63, 'b', 'o', 'b'};
+
+static LegacyLayout_t legacyLayout(void) {
+  LegacyLayout_t legacy;
+  memset(&legacy, 0, sizeof(legacy));
+  legacy.version = 3;
+  legacy.numKeys = 2;
+  snprintf(legacy.keys[0].keyBuffer, MAX_KEY_LEN_BYTES, "sampleMs");
+  legacy.keys[0].keyLen = strlen("sampleMs");
+  legacy.keys[0].valueType = UINT32;
+  memcpy(legacy.values[0], legacy_sample_ms, sizeof(legacy_sample_ms));
+  snprintf(legacy.keys[1].keyBuffer, MAX_KEY_LEN_BYTES, "name");
+  legacy.keys[1].keyLen = strlen("name");
+  legacy.keys[1].valueType = STR;
+  memcpy(legacy.values[1], legacy_name, sizeof(legacy_name));
+  // The part past the first sector counts too
+  legacy.values[49][0] = 0xa5;
+  legacy.crc32 = crc32_ieee(reinterpret_cast<const uint8_t *>(&legacy.version), sizeof(legacy) - sizeof(legacy.crc32));
+  return legacy;
+}
+
+static void expectLegacyKeys(Configuration &config) {
+  uint8_t num_keys;
+  config.getStoredKeys(num_keys);
+  EXPECT_EQ(num_keys, 2);
+  uint32_t result = 0;
+  EXPECT_EQ(config.getConfig("sampleMs", strlen("sampleMs"), result),true);
+  EXPECT_EQ(result, 60000);
+  // Only the encoded value is kept
+  uint8_t cbor[64];
+  size_t size = sizeof(cbor);
+  EXPECT_EQ(config.getConfigCbor("name", strlen("name"), cbor, size),true);
+  EXPECT_EQ(size, sizeof(legacy_name));
+}
+
+TEST_F(ConfigurationTest, MigratesLegacyLayout)
+{
+  const ext_flash_partition_t test_configuration = {
+      .fa_off = 4096,
+      .fa_size = 10000,
+  };
+  LegacyLayout_t legacy = legacyLayout();
+
+  std::vector<uint8_t> flash(test_configuration.fa_size, 0xFF);
+  memcpy(flash.data(), &legacy, sizeof(legacy));
+  EXPECT_CALL(_storage, read)
+      .Times(AtLeast(1))
+      .WillRepeatedly([&](uint32_t addr, uint8_t *buffer, size_t len, uint32_t) {
+        memcpy(buffer, &flash[addr - test_configuration.fa_off], len);
+        return true;
+      });
+  NvmPartition testPartition(_storage, test_configuration);
+  Configuration config(testPartition,ram_hardware_configuration,RAM_HARDWARE_CONFIG_SIZE_BYTES);
+  expectLegacyKeys(config);
+}
+
+//
+// Power goes out while the first save is converting the legacy layout
+//
+TEST_F(ConfigurationTest, TornMigrationKeepsLegacyLayout)
+{
+  const ext_flash_partition_t test_configuration = {
+      .fa_off = 4096,
+      .fa_size = 10000,
+  };
+  const uint32_t sector_size = 4096;
+  LegacyLayout_t legacy = legacyLayout();
+
+  std::vector<uint8_t> flash(test_configuration.fa_size, 0xFF);
+  memcpy(flash.data(), &legacy, sizeof(legacy));
+  // Writes to go before one is cut short, -1 for none
+  int32_t writes_until_tear = -1;
+  EXPECT_CALL(_storage, read)
+      .Times(AtLeast(1))
+      .WillRepeatedly([&](uint32_t addr, uint8_t *buffer, size_t len, uint32_t) {
+        memcpy(buffer, &flash[addr - test_configuration.fa_off], len);
+        return true;
+      });
+  EXPECT_CALL(_storage, erase)
+      .Times(AtLeast(1))
+      .WillRepeatedly([&](uint32_t addr, size_t, uint32_t) {
+        uint32_t start = addr - test_configuration.fa_off;
+        uint32_t end = std::min<uint32_t>(start + sector_size, flash.size());
+        std::fill(flash.begin() + start, flash.begin() + end, 0xFF);
+        return true;
+      });
+  // Programs erased flash
+  EXPECT_CALL(_storage, write)
+      .Times(AtLeast(1))
+      .WillRepeatedly([&](uint32_t addr, uint8_t *buffer, size_t len, uint32_t) {
+        size_t programmed = (writes_until_tear == 0) ? 50 : len;
+        if (writes_until_tear >= 0) {
+          writes_until_tear--;
+        }
+        for (size_t i = 0; i < programmed; i++) {
+          flash[addr - test_configuration.fa_off + i] &= buffer[i];
+        }
+        return programmed == len;
+      });
+  NvmPartition testPartition(_storage, test_configuration);
+  {
+    Configuration config(testPartition,ram_hardware_configuration,RAM_HARDWARE_CONFIG_SIZE_BYTES);
+    expectLegacyKeys(config);
+    // The legacy backup goes through, the new block doesn't
+    writes_until_tear = 1;
+    EXPECT_FALSE(config.saveConfig(false));
+    EXPECT_EQ(writes_until_tear, -1);
+  }
+  // The legacy layout's second sector is gone, but its backup isn't
+  EXPECT_NE(memcmp(&flash[sector_size], &reinterpret_cast<uint8_t *>(&legacy)[sector_size], sizeof(legacy) - sector_size), 0);
+  memset(ram_hardware_configuration, 0, RAM_HARDWARE_CONFIG_SIZE_BYTES);
+  {
+    Configuration config(testPartition,ram_hardware_configuration,RAM_HARDWARE_CONFIG_SIZE_BYTES);
+    expectLegacyKeys(config);
+    EXPECT_TRUE(config.saveConfig(false));
+  }
+  memset(ram_hardware_configuration, 0, RAM_HARDWARE_CONFIG_SIZE_BYTES);
+  Configuration config(testPartition,ram_hardware_configuration,RAM_HARDWARE_CONFIG_SIZE_BYTES);
+  expectLegacyKeys(config);
 }
 
 TEST_F(ConfigurationTest, TooLittleStorage)
@@ -226,7 +435,7 @@ TEST_F(ConfigurationTest, NoKeyToRemove)
 }
 
 TEST_F(ConfigurationTest, cborGetSet){
-    uint8_t cborBuffer[MAX_STR_LEN_BYTES];
+    uint8_t cborBuffer[64];
     const ext_flash_partition_t test_configuration = {
         .fa_off = 4096,
         .fa_size = 10000,
@@ -275,7 +484,7 @@ TEST_F(ConfigurationTest, cborGetSet){
 }
 
 TEST_F(ConfigurationTest, BadCborGetSet){
-    uint8_t cborBuffer[MAX_STR_LEN_BYTES];
+    uint8_t cborBuffer[64];
     size_t buffer_size = sizeof(cborBuffer);
     memset(cborBuffer, 0xFF, buffer_size);
     const ext_flash_partition_t test_configuration = {
@@ -363,3 +572,133 @@ TEST_F(ConfigurationTest, AsCborMap) {
   EXPECT_EQ(buffer[80], 0x4a);
   vPortFree(buffer);
 }
+
+TEST_F(ConfigurationTest, CachedValueUpdates) {
+  const ext_flash_partition_t test_configuration = {
+      .fa_off = 4096,
+      .fa_size = 10000,
+  };
+  NvmPartition testPartition(_storage, test_configuration);
+  Configuration config(testPartition, ram_hardware_configuration,
+                       RAM_HARDWARE_CONFIG_SIZE_BYTES);
+
+  uint32_t result_u = 0;
+  int32_t result_i = 0;
+  float result_f = 0;
+  EXPECT_EQ(config.setConfig("foo", strlen("foo"), static_cast<uint32_t>(42)), true);
+  EXPECT_EQ(config.getConfig("foo", strlen("foo"), result_u), true);
+  EXPECT_EQ(config.getConfig("foo", strlen("foo"), result_u), true);
+  EXPECT_EQ(result_u, 42);
+  EXPECT_EQ(config.getConfig("foo", strlen("foo"), result_i), true);
+  EXPECT_EQ(result_i, 42);
+  EXPECT_EQ(config.getConfig("foo", strlen("foo"), result_f), false);
+
+  // Overwritten with the same type
+  EXPECT_EQ(config.setConfig("foo", strlen("foo"), static_cast<uint32_t>(43)), true);
+  EXPECT_EQ(config.getConfig("foo", strlen("foo"), result_u), true);
+  EXPECT_EQ(result_u, 43);
+
+  // Overwritten with another type through CBOR
+  uint8_t cborBuffer[64];
+  size_t buffer_size = sizeof(cborBuffer);
+  EXPECT_EQ(config.setConfig("bar", strlen("bar"), 2.5f), true);
+  EXPECT_EQ(config.getConfigCbor("bar", strlen("bar"), cborBuffer, buffer_size), true);
+  EXPECT_EQ(config.setConfigCbor("foo", strlen("foo"), cborBuffer, buffer_size), true);
+  EXPECT_EQ(config.getConfig("foo", strlen("foo"), result_u), false);
+  EXPECT_EQ(config.getConfig("foo", strlen("foo"), result_f), true);
+  EXPECT_EQ(result_f, 2.5f);
+
+  // A failed set leaves the old value alone
+  EXPECT_EQ(config.setConfig("bar", strlen("bar"), static_cast<int32_t>(-7)), true);
+  EXPECT_EQ(config.getConfig("bar", strlen("bar"), result_i), true);
+  static char huge[4096];
+  memset(huge, 'x', sizeof(huge));
+  EXPECT_EQ(config.setConfig("bar", strlen("bar"), huge, sizeof(huge)), false);
+  result_i = 0;
+  EXPECT_EQ(config.getConfig("bar", strlen("bar"), result_i), true);
+  EXPECT_EQ(result_i, -7);
+}
+
+TEST_F(ConfigurationTest, KeyIndexAfterRemove) {
+  const ext_flash_partition_t test_configuration = {
+      .fa_off = 4096,
+      .fa_size = 10000,
+  };
+  NvmPartition testPartition(_storage, test_configuration);
+  Configuration config(testPartition, ram_hardware_configuration,
+                       RAM_HARDWARE_CONFIG_SIZE_BYTES);
+
+  char key[MAX_KEY_LEN_BYTES];
+  for (uint32_t i = 0; i < MAX_NUM_KV; i++) {
+    snprintf(key, sizeof(key), "key%" PRIu32, i);
+    EXPECT_EQ(config.setConfig(key, strlen(key), i), true);
+  }
+  EXPECT_EQ(config.setConfig("oneTooMany", strlen("oneTooMany"), static_cast<uint32_t>(0)), false);
+
+  // Keys only match in full
+  uint32_t result = 0;
+  EXPECT_EQ(config.getConfig("key", strlen("key"), result), false);
+  EXPECT_EQ(config.getConfig("key10", strlen("key1"), result), true);
+  EXPECT_EQ(result, 1);
+
+  for (uint32_t i = 0; i < MAX_NUM_KV; i += 2) {
+    snprintf(key, sizeof(key), "key%" PRIu32, i);
+    EXPECT_EQ(config.removeKey(key, strlen(key)), true);
+  }
+  uint8_t num_keys;
+  config.getStoredKeys(num_keys);
+  EXPECT_EQ(num_keys, MAX_NUM_KV / 2);
+  for (uint32_t i = 0; i < MAX_NUM_KV; i++) {
+    snprintf(key, sizeof(key), "key%" PRIu32, i);
+    EXPECT_EQ(config.getConfig(key, strlen(key), result), (i % 2) != 0);
+    if (i % 2) {
+      EXPECT_EQ(result, i);
+    }
+  }
+}
+
+//
+// Lookup cost with every slot in use, the last key used to take a scan of all the others
+//
+TEST_F(ConfigurationTest, LookupBenchmark) {
+  const ext_flash_partition_t test_configuration = {
+      .fa_off = 4096,
+      .fa_size = 10000,
+  };
+  NvmPartition testPartition(_storage, test_configuration);
+  Configuration config(testPartition, ram_hardware_configuration,
+                       RAM_HARDWARE_CONFIG_SIZE_BYTES);
+
+  // As many as fit in a config store block with keys this long
+  static constexpr uint32_t NUM_KEYS = 64;
+  char key[MAX_KEY_LEN_BYTES];
+  for (uint32_t i = 0; i < NUM_KEYS; i++) {
+    // Long shared prefixes, like the real sensor keys
+    snprintf(key, sizeof(key), "sensorSampleIntervalMs%" PRIu32, i);
+    EXPECT_EQ(config.setConfig(key, strlen(key), i * 1000), true);
+  }
+
+  const char *first = "sensorSampleIntervalMs0";
+  const char *last = "sensorSampleIntervalMs63";
+  static constexpr uint32_t READS = 100000;
+  uint32_t value = 0;
+  uint64_t sum = 0;
+
+  auto start = std::chrono::steady_clock::now();
+  for (uint32_t i = 0; i < READS; i++) {
+    EXPECT_EQ(config.getConfig(first, strlen(first), value), true);
+    sum += value;
+  }
+  auto first_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+
+  start = std::chrono::steady_clock::now();
+  for (uint32_t i = 0; i < READS; i++) {
+    EXPECT_EQ(config.getConfig(last, strlen(last), value), true);
+    sum += value;
+  }
+  auto last_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+
+  EXPECT_EQ(sum, static_cast<uint64_t>(READS) * 63000);
+  printf("getConfig(uint32_t): first key %.1f ns, last key %.1f ns\n",
+         static_cast<double>(first_ns) / READS, static_cast<double>(last_ns) / READS);
+}
@@ -207,3 +207,30 @@ TEST_F(DifferenceSignalTest, orderTwoSignal) {
     EXPECT_NEAR(d_n[i], key2[i], 0.00001);
   }
 }
+
+TEST_F(DifferenceSignalTest, copySignal) {
+  const double samples[] = {1015.6, 1214.3, 1036.6, 1101.1, 1022.7};
+  DifferenceSignal ds(5);
+  double r_n[5];
+  size_t size = 5;
+  EXPECT_FALSE(ds.copySignalToBuffer(r_n, size));
+  EXPECT_EQ(size, 0);
+  for (uint32_t sample = 0; sample < 3; sample++) {
+    EXPECT_TRUE(ds.addSample(samples[sample]));
+  }
+  size = 5;
+  EXPECT_TRUE(ds.copySignalToBuffer(r_n, size));
+  EXPECT_EQ(size, 3);
+  for (uint32_t i = 0; i < size; i++) {
+    EXPECT_EQ(r_n[i], samples[i]);
+  }
+  for (uint32_t sample = 3; sample < 5; sample++) {
+    EXPECT_TRUE(ds.addSample(samples[sample]));
+  }
+  size = 4;
+  EXPECT_TRUE(ds.copySignalToBuffer(r_n, size));
+  EXPECT_EQ(size, 4);
+  for (uint32_t i = 0; i < size; i++) {
+    EXPECT_EQ(r_n[i], samples[i]);
+  }
+}
@@ -0,0 +1,240 @@
+#include "gtest/gtest.h"
+
+#include <chrono>
+#include <set>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+#include "eth_buf_pool.h"
+
+// Same shape as the ADIN driver's frames
+#define FRAME_LEN (1518 + 4 + 2)
+#define POOL_LEN (20)
+
+typedef struct {
+  void *desc[8];
+  uint8_t data[FRAME_LEN] __attribute__((aligned(4)));
+} test_frame_t;
+
+// The fixture for testing class Foo.
+class EthBufPoolTest : public ::testing::Test {
+protected:
+  // You can remove any or all of the following functions if its body
+  // is empty.
+
+  EthBufPoolTest() {
+    // You can do set-up work for each test here.
+  }
+
+  ~EthBufPoolTest() override {
+    // You can do clean-up work that doesn't throw exceptions here.
+  }
+
+  // If the constructor and destructor are not enough for setting up
+  // and cleaning up each test, you can define the following methods:
+
+  void SetUp() override {
+    // Code here will be called immediately after the constructor (right
+    // before each test).
+    eth_buf_pool_init(&pool, frames, sizeof(test_frame_t), POOL_LEN);
+  }
+
+  void TearDown() override {
+    // Code here will be called immediately after each test (right
+    // before the destructor).
+  }
+
+  // Objects declared here can be used by all tests in the test suite for Foo.
+  eth_buf_pool_t pool;
+  test_frame_t frames[POOL_LEN];
+};
+
+TEST_F(EthBufPoolTest, AllocFree) {
+  std::set<void *> blocks;
+  for (uint16_t i = 0; i < POOL_LEN; i++) {
+    void *block = eth_buf_pool_alloc(&pool);
+    ASSERT_NE(block, nullptr);
+    EXPECT_TRUE(eth_buf_pool_owns(&pool, block));
+    EXPECT_EQ(reinterpret_cast<uintptr_t>(static_cast<test_frame_t *>(block)->data) % 4, 0u);
+    blocks.insert(block);
+  }
+  EXPECT_EQ(blocks.size(), static_cast<size_t>(POOL_LEN));
+  EXPECT_EQ(eth_buf_pool_num_free(&pool), 0);
+  EXPECT_EQ(pool.exhausted, 0u);
+
+  EXPECT_EQ(eth_buf_pool_alloc(&pool), nullptr);
+  EXPECT_EQ(pool.exhausted, 1u);
+
+  for (void *block : blocks) {
+    eth_buf_pool_free(&pool, block);
+  }
+  EXPECT_EQ(eth_buf_pool_num_free(&pool), POOL_LEN);
+  EXPECT_EQ(pool.min_free, 0);
+
+  // Everything can be handed out again
+  for (uint16_t i = 0; i < POOL_LEN; i++) {
+    EXPECT_EQ(blocks.count(eth_buf_pool_alloc(&pool)), 1u);
+  }
+}
+
+TEST_F(EthBufPoolTest, Reuse) {
+  void *first = eth_buf_pool_alloc(&pool);
+  EXPECT_EQ(first, &frames[0]);
+  void *second = eth_buf_pool_alloc(&pool);
+  EXPECT_EQ(second, &frames[1]);
+
+  // The block freed last is the next one handed out, while it's still in cache
+  eth_buf_pool_free(&pool, first);
+  EXPECT_EQ(eth_buf_pool_alloc(&pool), first);
+  EXPECT_EQ(pool.min_free, POOL_LEN - 2);
+}
+
+TEST_F(EthBufPoolTest, Owns) {
+  EXPECT_TRUE(eth_buf_pool_owns(&pool, &frames[0]));
+  EXPECT_TRUE(eth_buf_pool_owns(&pool, &frames[POOL_LEN - 1]));
+  EXPECT_FALSE(eth_buf_pool_owns(&pool, nullptr));
+  EXPECT_FALSE(eth_buf_pool_owns(&pool, &frames[POOL_LEN]));
+  EXPECT_FALSE(eth_buf_pool_owns(&pool, frames[0].data));
+
+  test_frame_t other;
+  EXPECT_FALSE(eth_buf_pool_owns(&pool, &other));
+}
+
+//
+// Models the driver's per-frame buffer handling before and after the pool, counting
+// heap calls and bytes copied. RX frames go up to the stack, TX frames come down
+// from it, a third of them multicast on both ports.
+//
+struct BufCounters {
+  uint32_t heap_calls;
+  uint64_t bytes_copied;
+};
+
+static void *counted_malloc(BufCounters &counters, size_t len) {
+  counters.heap_calls++;
+  return malloc(len);
+}
+
+static void counted_free(BufCounters &counters, void *ptr) {
+  counters.heap_calls++;
+  free(ptr);
+}
+
+static void counted_copy(BufCounters &counters, void *dst, const void *src, size_t len) {
+  counters.bytes_copied += len;
+  memcpy(dst, src, len);
+}
+
+struct Traffic {
+  uint16_t len;
+  bool rx;
+  uint8_t ports;
+};
+
+static std::vector<Traffic> makeTraffic(uint32_t frames) {
+  std::vector<Traffic> traffic;
+  for (uint32_t i = 0; i < frames; i++) {
+    uint16_t len = static_cast<uint16_t>(64 + (i * 97) % (1518 - 64));
+    traffic.push_back({len, (i % 2) == 0, static_cast<uint8_t>((i % 3) == 0 ? 2 : 1)});
+  }
+  return traffic;
+}
+
+// RX copied the ADIN buffer into a new pbuf, TX allocated a request and a
+// buffer and copied the pbuf into it for every port
+static BufCounters runCopying(const std::vector<Traffic> &traffic, const uint8_t *wire) {
+  BufCounters counters = {};
+  uint8_t *rx_buf = static_cast<uint8_t *>(malloc(FRAME_LEN));
+  for (const Traffic &frame : traffic) {
+    if (frame.rx) {
+      memcpy(rx_buf, wire, frame.len);
+      uint8_t *pbuf = static_cast<uint8_t *>(counted_malloc(counters, frame.len));
+      counted_copy(counters, pbuf, rx_buf, frame.len);
+      counted_free(counters, pbuf);
+    } else {
+      // The stack's own buffer isn't the driver's doing
+      uint8_t *pbuf = static_cast<uint8_t *>(malloc(frame.len));
+      memcpy(pbuf, wire, frame.len);
+      for (uint8_t port = 0; port < frame.ports; port++) {
+        void *req = counted_malloc(counters, 64);
+        uint8_t *tx_buf = static_cast<uint8_t *>(counted_malloc(counters, frame.len));
+        counted_copy(counters, tx_buf, pbuf, frame.len);
+        tx_buf[12] = port;
+        counted_free(counters, tx_buf);
+        counted_free(counters, req);
+      }
+      free(pbuf);
+    }
+  }
+  free(rx_buf);
+  return counters;
+}
+
+// RX swaps the filled frame for a free one, TX sends the stack's buffer and
+// only copies for the extra port of a multicast
+static BufCounters runPooled(eth_buf_pool_t *frame_pool, eth_buf_pool_t *req_pool,
+                             const std::vector<Traffic> &traffic, const uint8_t *wire) {
+  BufCounters counters = {};
+  test_frame_t *rx_frame = static_cast<test_frame_t *>(eth_buf_pool_alloc(frame_pool));
+  for (const Traffic &frame : traffic) {
+    if (frame.rx) {
+      memcpy(rx_frame->data, wire, frame.len);
+      test_frame_t *spare = static_cast<test_frame_t *>(eth_buf_pool_alloc(frame_pool));
+      EXPECT_NE(spare, nullptr);
+      eth_buf_pool_free(frame_pool, rx_frame);
+      rx_frame = spare;
+    } else {
+      uint8_t *pbuf = static_cast<uint8_t *>(malloc(frame.len));
+      memcpy(pbuf, wire, frame.len);
+      for (uint8_t port = 0; port < frame.ports; port++) {
+        void *req = eth_buf_pool_alloc(req_pool);
+        EXPECT_NE(req, nullptr);
+        if (port + 1 < frame.ports) {
+          test_frame_t *copy = static_cast<test_frame_t *>(eth_buf_pool_alloc(frame_pool));
+          EXPECT_NE(copy, nullptr);
+          counted_copy(counters, copy->data, pbuf, frame.len);
+          copy->data[12] = port;
+          eth_buf_pool_free(frame_pool, copy);
+        } else {
+          pbuf[12] = port;
+        }
+        eth_buf_pool_free(req_pool, req);
+      }
+      free(pbuf);
+    }
+  }
+  eth_buf_pool_free(frame_pool, rx_frame);
+  return counters;
+}
+
+TEST_F(EthBufPoolTest, PerFrameCost) {
+  const uint32_t frames = 20000;
+  const std::vector<Traffic> traffic = makeTraffic(frames);
+  std::vector<uint8_t> wire(FRAME_LEN, 0xA5);
+
+  // Room for as many requests as the driver's event and TX queues hold
+  void *reqs[32 + 4];
+  eth_buf_pool_t req_pool;
+  eth_buf_pool_init(&req_pool, reqs, sizeof(reqs[0]), sizeof(reqs) / sizeof(reqs[0]));
+
+  auto start = std::chrono::steady_clock::now();
+  BufCounters before = runCopying(traffic, wire.data());
+  auto middle = std::chrono::steady_clock::now();
+  BufCounters after = runPooled(&pool, &req_pool, traffic, wire.data());
+  auto end = std::chrono::steady_clock::now();
+
+  double before_ns = std::chrono::duration<double, std::nano>(middle - start).count() / frames;
+  double after_ns = std::chrono::duration<double, std::nano>(end - middle).count() / frames;
+  printf("Per frame before: %.2f heap calls, %.0f bytes copied, %.0f ns\n",
+         static_cast<double>(before.heap_calls) / frames, static_cast<double>(before.bytes_copied) / frames,
+         before_ns);
+  printf("Per frame after:  %.2f heap calls, %.0f bytes copied, %.0f ns\n",
+         static_cast<double>(after.heap_calls) / frames, static_cast<double>(after.bytes_copied) / frames,
+         after_ns);
+
+  EXPECT_EQ(after.heap_calls, 0u);
+  EXPECT_LT(after.bytes_copied * 4, before.bytes_copied);
+  EXPECT_EQ(eth_buf_pool_num_free(&pool), POOL_LEN);
+  EXPECT_EQ(eth_buf_pool_num_free(&req_pool), sizeof(reqs) / sizeof(reqs[0]));
+}
@@ -1,10 +1,153 @@
 #include "gtest/gtest.h"
 
+#include <vector>
+
 #include "nvmPartition.h"
 #include "mock_storage_driver.h"
 
 using namespace testing;
 
+//
+// NOR flash driver model. Erases set whole sectors to 0xFF and page programs
+// can only clear bits. write() does what W25::write() does, with or without
+// the check for an erased target range. Timings are typical W25Q64JV numbers.
+//
+class NorFlash : public AbstractStorageDriver {
+public:
+  static constexpr uint32_t SECTOR_SIZE = 4096;
+  static constexpr uint32_t PAGE_SIZE = 256;
+  static constexpr uint32_t SIZE = 64 * SECTOR_SIZE;
+  static constexpr double SECTOR_ERASE_MS = 45.0;
+  static constexpr double PAGE_PROGRAM_MS = 0.4;
+  // 10 MHz SPI
+  static constexpr double SPI_MS_PER_BYTE = 0.0008;
+
+  NorFlash() : mem(SIZE, 0xFF) {}
+
+  bool read(uint32_t addr, uint8_t *buffer, size_t len, uint32_t timeoutMs) override {
+    (void)timeoutMs;
+    EXPECT_LE(addr + len, SIZE);
+    memcpy(buffer, &mem[addr], len);
+    busy_ms += len * SPI_MS_PER_BYTE;
+    return true;
+  }
+
+  bool write(uint32_t addr, uint8_t *buffer, size_t len, uint32_t timeoutMs) override {
+    (void)timeoutMs;
+    EXPECT_LE(addr + len, SIZE);
+    for (size_t done = 0; done < len;) {
+      uint32_t sector = (addr + done) / SECTOR_SIZE;
+      size_t chunk_len = std::min<size_t>(len - done, (sector + 1) * SECTOR_SIZE - (addr + done));
+      busy_ms += chunk_len * SPI_MS_PER_BYTE;
+      bool erased = true;
+      for (size_t i = 0; i < chunk_len; i++) {
+        erased &= (mem[addr + done + i] == 0xFF);
+      }
+      if (erase_check && erased) {
+        programRange(addr + done, &buffer[done], chunk_len);
+      } else {
+        std::vector<uint8_t> sector_buf(&mem[sector * SECTOR_SIZE], &mem[(sector + 1) * SECTOR_SIZE]);
+        busy_ms += SECTOR_SIZE * SPI_MS_PER_BYTE;
+        memcpy(&sector_buf[addr + done - sector * SECTOR_SIZE], &buffer[done], chunk_len);
+        eraseSector(sector);
+        if (erase_check) {
+          programRange(sector * SECTOR_SIZE, sector_buf.data(), SECTOR_SIZE);
+        } else {
+          // Every page was reprogrammed, erased or not
+          memcpy(&mem[sector * SECTOR_SIZE], sector_buf.data(), SECTOR_SIZE);
+          page_programs += SECTOR_SIZE / PAGE_SIZE;
+          bytes_programmed += SECTOR_SIZE;
+          busy_ms += SECTOR_SIZE * SPI_MS_PER_BYTE + (SECTOR_SIZE / PAGE_SIZE) * PAGE_PROGRAM_MS;
+        }
+      }
+      done += chunk_len;
+    }
+    return true;
+  }
+
+  bool program(uint32_t addr, uint8_t *buffer, size_t len, uint32_t timeoutMs) override {
+    (void)timeoutMs;
+    EXPECT_LE(addr + len, SIZE);
+    if (fail_programs) {
+      return false;
+    }
+    programRange(addr, buffer, len);
+    return true;
+  }
+
+  bool erase(uint32_t addr, size_t len, uint32_t timeoutMs) override {
+    (void)timeoutMs;
+    EXPECT_EQ(addr % SECTOR_SIZE, 0u);
+    for (uint32_t sector = addr / SECTOR_SIZE; sector <= (addr + len - 1) / SECTOR_SIZE; sector++) {
+      eraseSector(sector);
+    }
+    return true;
+  }
+
+  bool crc16(uint32_t addr, size_t len, uint16_t &crc, uint32_t timeoutMs) override {
+    (void)addr;
+    (void)len;
+    (void)timeoutMs;
+    crc = 0;
+    return true;
+  }
+
+  uint32_t getAlignmentBytes(void) override { return SECTOR_SIZE; }
+  uint32_t getStorageSizeBytes(void) override { return 8000000; }
+
+  void programRange(uint32_t addr, const uint8_t *buffer, size_t len) {
+    for (size_t done = 0; done < len;) {
+      size_t page_len = std::min<size_t>(len - done, PAGE_SIZE - ((addr + done) % PAGE_SIZE));
+      bool blank = true;
+      for (size_t i = 0; i < page_len; i++) {
+        uint8_t &cell = mem[addr + done + i];
+        if ((cell & buffer[done + i]) != buffer[done + i]) {
+          program_violations++;
+        }
+        cell &= buffer[done + i];
+        blank &= (buffer[done + i] == 0xFF);
+      }
+      if (!blank) {
+        page_programs++;
+        bytes_programmed += page_len;
+        busy_ms += page_len * SPI_MS_PER_BYTE + PAGE_PROGRAM_MS;
+      }
+      done += page_len;
+    }
+  }
+
+  void eraseSector(uint32_t sector) {
+    memset(&mem[sector * SECTOR_SIZE], 0xFF, SECTOR_SIZE);
+    erases++;
+    busy_ms += SECTOR_ERASE_MS;
+  }
+
+  void resetCounts(void) {
+    erases = 0;
+    page_programs = 0;
+    bytes_programmed = 0;
+    program_violations = 0;
+    busy_ms = 0;
+  }
+
+  std::vector<uint8_t> mem;
+  bool erase_check = true;
+  bool fail_programs = false;
+  uint32_t erases = 0;
+  uint32_t page_programs = 0;
+  uint32_t bytes_programmed = 0;
+  uint32_t program_violations = 0;
+  double busy_ms = 0;
+};
+
+static std::vector<uint8_t> testImage(size_t len, uint8_t seed) {
+  std::vector<uint8_t> image(len);
+  for (size_t i = 0; i < len; i++) {
+    image[i] = static_cast<uint8_t>(i * 31 + seed);
+  }
+  return image;
+}
+
 // The fixture for testing class Foo.
 class NvmPartitionTest : public ::testing::Test {
  protected:
@@ -84,4 +227,163 @@ TEST_F(NvmPartitionTest, BadInit)
     .WillRepeatedly(Return(8000000));
   EXPECT_DEATH(NvmPartition testPartition(_storage, bad_test_configuration_a),"");
   EXPECT_DEATH(NvmPartition testPartition(_storage, bad_test_configuration_b),"");
-}
\ No newline at end of file
+}
+TEST_F(NvmPartitionTest, AppendStream)
+{
+  const ext_flash_partition_t test_configuration = {
+      .fa_off = 4096,
+      .fa_size = 16 * NorFlash::SECTOR_SIZE,
+  };
+  NorFlash flash;
+  NvmPartition testPartition(flash, test_configuration);
+
+  // An old image and a header in front of where the new one goes
+  std::vector<uint8_t> old_image = testImage(test_configuration.fa_size - 1, 0x55);
+  EXPECT_TRUE(testPartition.write(0, old_image.data(), old_image.size(), 100));
+  flash.resetCounts();
+
+  const uint32_t start = 40;
+  const size_t chunk_len = 500;
+  std::vector<uint8_t> image = testImage(10 * NorFlash::SECTOR_SIZE + 123, 0x11);
+  EXPECT_FALSE(testPartition.append(image.data(), chunk_len, 100));
+  EXPECT_TRUE(testPartition.appendStart(start, 100));
+  for (size_t offset = 0; offset < image.size(); offset += chunk_len) {
+    size_t len = std::min(chunk_len, image.size() - offset);
+    EXPECT_EQ(testPartition.appendOffset(), start + offset);
+    EXPECT_TRUE(testPartition.append(&image[offset], len, 100));
+    EXPECT_TRUE(testPartition.appendEraseAhead(100));
+  }
+  EXPECT_EQ(testPartition.appendOffset(), start + image.size());
+
+  std::vector<uint8_t> readback(image.size());
+  EXPECT_TRUE(testPartition.read(start, readback.data(), readback.size(), 100));
+  EXPECT_EQ(readback, image);
+  // The header shares the first sector and survives
+  EXPECT_EQ(memcmp(&flash.mem[test_configuration.fa_off], old_image.data(), start), 0);
+  EXPECT_EQ(flash.program_violations, 0u);
+  // First sector once per chunk it gets, every other sector once, and one erased ahead
+  uint32_t first_sector_chunks = (NorFlash::SECTOR_SIZE - start + chunk_len - 1) / chunk_len;
+  EXPECT_EQ(flash.erases, first_sector_chunks + 10 + 1);
+}
+
+TEST_F(NvmPartitionTest, AppendWithoutEraseAhead)
+{
+  const ext_flash_partition_t test_configuration = {
+      .fa_off = 0,
+      .fa_size = 8 * NorFlash::SECTOR_SIZE,
+  };
+  NorFlash flash;
+  NvmPartition testPartition(flash, test_configuration);
+  std::vector<uint8_t> old_image = testImage(test_configuration.fa_size - 1, 0x55);
+  EXPECT_TRUE(testPartition.write(0, old_image.data(), old_image.size(), 100));
+  flash.resetCounts();
+
+  // The writer erases each sector as it gets to it
+  std::vector<uint8_t> image = testImage(5 * NorFlash::SECTOR_SIZE, 0x22);
+  EXPECT_TRUE(testPartition.appendStart(0, 100));
+  EXPECT_TRUE(testPartition.append(image.data(), 3000, 100));
+  EXPECT_TRUE(testPartition.append(&image[3000], image.size() - 3000, 100));
+  std::vector<uint8_t> readback(image.size());
+  EXPECT_TRUE(testPartition.read(0, readback.data(), readback.size(), 100));
+  EXPECT_EQ(readback, image);
+  EXPECT_EQ(flash.erases, 5u);
+  EXPECT_EQ(flash.program_violations, 0u);
+
+  // A failed append ends the stream, part of it may be programmed
+  flash.fail_programs = true;
+  EXPECT_FALSE(testPartition.append(image.data(), 100, 100));
+  EXPECT_FALSE(testPartition.appending());
+  flash.fail_programs = false;
+  EXPECT_FALSE(testPartition.append(image.data(), 100, 100));
+}
+
+TEST_F(NvmPartitionTest, WriteErasedRange)
+{
+  const ext_flash_partition_t test_configuration = {
+      .fa_off = 0,
+      .fa_size = 4 * NorFlash::SECTOR_SIZE,
+  };
+  NorFlash flash;
+  NvmPartition testPartition(flash, test_configuration);
+  std::vector<uint8_t> data = testImage(300, 0x33);
+
+  // Erased, so only the pages written to are programmed
+  EXPECT_TRUE(testPartition.write(100, data.data(), data.size(), 100));
+  EXPECT_EQ(flash.erases, 0u);
+  EXPECT_EQ(flash.page_programs, 2u);
+  EXPECT_EQ(flash.bytes_programmed, data.size());
+
+  // Overwriting has to erase, and pages that end up blank aren't programmed again
+  flash.resetCounts();
+  EXPECT_TRUE(testPartition.write(200, data.data(), data.size(), 100));
+  EXPECT_EQ(flash.erases, 1u);
+  EXPECT_EQ(flash.page_programs, 2u);
+  std::vector<uint8_t> readback(400);
+  EXPECT_TRUE(testPartition.read(100, readback.data(), readback.size(), 100));
+  EXPECT_EQ(memcmp(readback.data(), data.data(), 100), 0);
+  EXPECT_EQ(memcmp(&readback[100], data.data(), data.size()), 0);
+  EXPECT_EQ(flash.program_violations, 0u);
+}
+
+//
+// DFU image written in chunks over the NCP UART, flash busy time per chunk
+// for each way of writing it.
+//
+TEST_F(NvmPartitionTest, DfuChunkBenchmark)
+{
+  const ext_flash_partition_t test_configuration = {
+      .fa_off = 0,
+      .fa_size = 40 * NorFlash::SECTOR_SIZE,
+  };
+  const uint32_t start = 40;
+  const size_t chunk_len = 2048;
+  std::vector<uint8_t> old_image = testImage(test_configuration.fa_size - 1, 0x55);
+  std::vector<uint8_t> image = testImage(32 * NorFlash::SECTOR_SIZE, 0x44);
+  const size_t chunks = (image.size() + chunk_len - 1) / chunk_len;
+
+  struct Result {
+    uint32_t erases;
+    uint32_t page_programs;
+    uint32_t bytes_programmed;
+    double ms_per_chunk;
+  };
+  auto run = [&](bool erase_check, bool stream) {
+    NorFlash flash;
+    NvmPartition testPartition(flash, test_configuration);
+    EXPECT_TRUE(testPartition.write(0, old_image.data(), old_image.size(), 100));
+    flash.erase_check = erase_check;
+    flash.resetCounts();
+    if (stream) {
+      EXPECT_TRUE(testPartition.appendStart(start, 100));
+    }
+    for (size_t offset = 0; offset < image.size(); offset += chunk_len) {
+      size_t len = std::min(chunk_len, image.size() - offset);
+      if (stream) {
+        EXPECT_TRUE(testPartition.append(&image[offset], len, 100));
+        EXPECT_TRUE(testPartition.appendEraseAhead(100));
+      } else {
+        EXPECT_TRUE(testPartition.write(start + offset, &image[offset], len, 100));
+      }
+    }
+    std::vector<uint8_t> readback(image.size());
+    EXPECT_TRUE(testPartition.read(start, readback.data(), readback.size(), 100));
+    EXPECT_EQ(readback, image);
+    EXPECT_EQ(flash.program_violations, 0u);
+    return Result{flash.erases, flash.page_programs, flash.bytes_programmed, flash.busy_ms / chunks};
+  };
+
+  Result legacy = run(false, false);
+  // The old image is still there, so checking for an erased range alone doesn't save anything
+  Result checked = run(true, false);
+  Result stream = run(true, true);
+  printf("Read-modify-erase write: %4u erases, %5u page programs, %7u bytes, %6.2f ms per chunk\n", legacy.erases,
+         legacy.page_programs, legacy.bytes_programmed, legacy.ms_per_chunk);
+  printf("Erased range check:      %4u erases, %5u page programs, %7u bytes, %6.2f ms per chunk\n", checked.erases,
+         checked.page_programs, checked.bytes_programmed, checked.ms_per_chunk);
+  printf("Append stream:           %4u erases, %5u page programs, %7u bytes, %6.2f ms per chunk\n", stream.erases,
+         stream.page_programs, stream.bytes_programmed, stream.ms_per_chunk);
+
+  EXPECT_LT(stream.ms_per_chunk * 2, legacy.ms_per_chunk);
+  EXPECT_LT(stream.erases * 2, legacy.erases);
+  EXPECT_LE(stream.erases, checked.erases);
+}
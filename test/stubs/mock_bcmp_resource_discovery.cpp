@@ -0,0 +1,20 @@
+#include "mock_bcmp_resource_discovery.h"
+
+mock_bcmp_resource_discovery_t mock_bcmp_resource_discovery;
+
+bool bcmp_resource_discovery::bcmp_resource_discovery_add_resource(const char *res, const uint16_t resource_len,
+                                                                   resource_type_e type, uint32_t timeoutMs) {
+  (void)res;
+  (void)resource_len;
+  (void)type;
+  (void)timeoutMs;
+  mock_bcmp_resource_discovery.add_resource_call_count++;
+  return true;
+}
+
+bool bcmp_resource_discovery::bcmp_resource_discovery_remote_sub_possible(const char *topic, uint16_t topic_len) {
+  (void)topic;
+  (void)topic_len;
+  mock_bcmp_resource_discovery.remote_sub_possible_call_count++;
+  return mock_bcmp_resource_discovery.remote_sub_possible;
+}
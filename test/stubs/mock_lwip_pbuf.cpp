@@ -0,0 +1,7 @@
+#include "lwip/pbuf.h"
+
+DEFINE_FAKE_VALUE_FUNC(struct pbuf *, pbuf_alloc, pbuf_layer, uint16_t, pbuf_type);
+DEFINE_FAKE_VALUE_FUNC(struct pbuf *, pbuf_alloced_custom, pbuf_layer, uint16_t, pbuf_type, struct pbuf_custom *, void *, uint16_t);
+DEFINE_FAKE_VOID_FUNC(pbuf_realloc, struct pbuf *, uint16_t);
+DEFINE_FAKE_VOID_FUNC(pbuf_ref, struct pbuf *);
+DEFINE_FAKE_VALUE_FUNC(uint8_t, pbuf_free, struct pbuf *);
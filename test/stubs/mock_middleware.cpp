@@ -0,0 +1,4 @@
+#include "mock_middleware.h"
+
+DEFINE_FAKE_VALUE_FUNC(int32_t, bm_middleware_local_pub, struct pbuf *);
+DEFINE_FAKE_VALUE_FUNC(int32_t, middleware_net_tx, struct pbuf *);
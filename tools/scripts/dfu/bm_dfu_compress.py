@@ -0,0 +1,205 @@
+"""
+Compressed DFU images
+
+Compresses an image (or a delta image from bm_dfu_delta.py) so fewer chunks have to be sent
+over the bus. Clients decompress while the chunks arrive. The format must be kept in sync
+with src/lib/bcmp/dfu/bm_dfu_lz.h.
+
+Usage:
+    python3 bm_dfu_compress.py compress -i image.bin -o image.lz [--window-bits 11]
+    python3 bm_dfu_compress.py decompress -i image.lz -o image.bin
+    python3 bm_dfu_compress.py bench image.bin [more.bin ...]
+
+bench compresses each image with every window size a client could be built with
+(BM_DFU_LZ_MAX_WINDOW_BITS) and reports the ratio, the decode buffer it needs, and how
+fast the reference decoder runs, to help pick the window size.
+
+The compressed image is loaded onto the host node with bm_load_img_to_flash.py like any image.
+"""
+
+import argparse
+import struct
+import sys
+import time
+from collections import namedtuple
+from pathlib import Path
+
+LZ_MAGIC = 0x5A4C4D42  # "BMLZ"
+LZ_VERSION = 1
+LZ_FLAG_DELTA = 1 << 0
+
+# NOTE: Must be in sync with bm_dfu_lz_header_t
+LZ_HEADER = namedtuple("LZ_HEADER", "magic version window_bits flags size")
+LZ_HEADER_STRUCT_ENCODING = "<LBBBL"
+
+MIN_WINDOW_BITS = 8
+MAX_WINDOW_BITS = 12
+DEFAULT_WINDOW_BITS = 11  # Must not be larger than the clients' BM_DFU_LZ_MAX_WINDOW_BITS
+MIN_MATCH = 3
+# Candidates checked per position, trades compression time for ratio
+MAX_CHAIN = 32
+
+DELTA_MAGIC = 0x50444D42  # bm_dfu_delta.py
+
+
+def parse_header(data: bytes) -> LZ_HEADER:
+    """Returns the compressed image header, or None if the data isn't compressed"""
+    if len(data) < struct.calcsize(LZ_HEADER_STRUCT_ENCODING):
+        return None
+    header = LZ_HEADER._make(struct.unpack_from(LZ_HEADER_STRUCT_ENCODING, data, 0))
+    if header.magic != LZ_MAGIC:
+        return None
+    return header
+
+
+def compress(data: bytes, window_bits: int = DEFAULT_WINDOW_BITS) -> bytes:
+    if not MIN_WINDOW_BITS <= window_bits <= MAX_WINDOW_BITS:
+        raise ValueError(f"Window bits must be {MIN_WINDOW_BITS}-{MAX_WINDOW_BITS}")
+    if not data:
+        raise ValueError("Empty image")
+    window = 1 << window_bits
+    max_match = MIN_MATCH + (1 << (16 - window_bits)) - 1
+    flags = LZ_FLAG_DELTA if len(data) >= 4 and struct.unpack_from("<L", data)[0] == DELTA_MAGIC else 0
+
+    out = bytearray(struct.pack(LZ_HEADER_STRUCT_ENCODING, LZ_MAGIC, LZ_VERSION, window_bits, flags, len(data)))
+    chains = {}  # 3 byte prefix -> recent positions, newest last
+    control_pos = 0
+    control_bit = 8
+    pos = 0
+
+    def add_positions(start, end):
+        for p in range(start, min(end, len(data) - MIN_MATCH + 1)):
+            positions = chains.setdefault(data[p : p + MIN_MATCH], [])
+            positions.append(p)
+            if len(positions) > MAX_CHAIN:
+                del positions[0]
+
+    while pos < len(data):
+        if control_bit == 8:
+            control_pos = len(out)
+            out.append(0)
+            control_bit = 0
+
+        best_len = 0
+        best_dist = 0
+        limit = min(max_match, len(data) - pos)
+        if limit >= MIN_MATCH:
+            for candidate in reversed(chains.get(data[pos : pos + MIN_MATCH], [])):
+                dist = pos - candidate
+                if dist > window:
+                    break
+                length = MIN_MATCH
+                while length < limit and data[candidate + length] == data[pos + length]:
+                    length += 1
+                if length > best_len:
+                    best_len = length
+                    best_dist = dist
+                    if length == limit:
+                        break
+
+        if best_len >= MIN_MATCH:
+            ref = (best_dist - 1) | ((best_len - MIN_MATCH) << window_bits)
+            out += struct.pack("<H", ref)
+            add_positions(pos, pos + best_len)
+            pos += best_len
+        else:
+            out[control_pos] |= 1 << control_bit
+            out.append(data[pos])
+            add_positions(pos, pos + 1)
+            pos += 1
+        control_bit += 1
+    return bytes(out)
+
+
+def decompress(data: bytes) -> bytes:
+    """Reference implementation of the client's decoder"""
+    header = parse_header(data)
+    if header is None or header.version != LZ_VERSION:
+        raise ValueError("Not a compressed image")
+    out = bytearray()
+    distance_mask = (1 << header.window_bits) - 1
+    pos = struct.calcsize(LZ_HEADER_STRUCT_ENCODING)
+    while len(out) < header.size:
+        control = data[pos]
+        pos += 1
+        for _ in range(8):
+            if len(out) == header.size:
+                break
+            if control & 1:
+                out.append(data[pos])
+                pos += 1
+            else:
+                (ref,) = struct.unpack_from("<H", data, pos)
+                pos += 2
+                dist = (ref & distance_mask) + 1
+                length = (ref >> header.window_bits) + MIN_MATCH
+                if dist > len(out):
+                    raise ValueError("Reference before the start of the image")
+                for _ in range(length):
+                    out.append(out[-dist])
+            control >>= 1
+    if pos != len(data) or len(out) != header.size:
+        raise ValueError("Corrupt compressed image")
+    return bytes(out)
+
+
+def bench(paths):
+    print(f"{'image':<32} {'window':>7} {'RAM':>6} {'size':>8} {'ratio':>6} {'enc s':>7} {'dec MB/s':>9}")
+    for path in paths:
+        data = Path(path).read_bytes()
+        for window_bits in range(MIN_WINDOW_BITS, MAX_WINDOW_BITS + 1):
+            start = time.perf_counter()
+            packed = compress(data, window_bits)
+            encode_time = time.perf_counter() - start
+            start = time.perf_counter()
+            if decompress(packed) != data:
+                print(f"{path}: round trip failed with {window_bits} bit window")
+                sys.exit(1)
+            decode_time = time.perf_counter() - start
+            print(
+                f"{Path(path).name:<32} {window_bits:>4} b {1 << window_bits:>6} {len(packed):>8} "
+                f"{len(packed) / len(data):>6.3f} {encode_time:>7.2f} {len(data) / decode_time / 1e6:>9.2f}"
+            )
+        print(f"{Path(path).name:<32} {'raw':>7} {'':>6} {len(data):>8}")
+    print("RAM is the client's decode window (BM_DFU_LZ_MAX_WINDOW_BITS). Decode speed is the")
+    print("Python reference decoder, bm_dfu_lz_tests prints the speed of the C++ decoder.")
+
+
+def main():
+    parser = argparse.ArgumentParser(formatter_class=argparse.ArgumentDefaultsHelpFormatter)
+    subparsers = parser.add_subparsers(dest="command", required=True)
+
+    compress_parser = subparsers.add_parser("compress", help="Compress an image")
+    compress_parser.add_argument("-i", "--input", required=True, help="Image or delta image")
+    compress_parser.add_argument("-o", "--output", required=True, help="Compressed image to write")
+    compress_parser.add_argument(
+        "-w", "--window-bits", type=int, default=DEFAULT_WINDOW_BITS,
+        help="Back reference window, must not be larger than the clients' BM_DFU_LZ_MAX_WINDOW_BITS"
+    )
+
+    decompress_parser = subparsers.add_parser("decompress", help="Decompress an image")
+    decompress_parser.add_argument("-i", "--input", required=True, help="Compressed image")
+    decompress_parser.add_argument("-o", "--output", required=True, help="Image to write")
+
+    bench_parser = subparsers.add_parser("bench", help="Compare window sizes on images")
+    bench_parser.add_argument("images", nargs="+", help="Images to compress")
+
+    args = parser.parse_args()
+
+    if args.command == "compress":
+        data = Path(args.input).read_bytes()
+        packed = compress(data, args.window_bits)
+        if decompress(packed) != data:
+            print("Compressed image doesn't decompress to the input!")
+            sys.exit(1)
+        Path(args.output).write_bytes(packed)
+        print(f"Compressed image: {len(packed)} bytes, image: {len(data)} bytes "
+              f"({100.0 * len(packed) / len(data):.1f}%)")
+    elif args.command == "decompress":
+        Path(args.output).write_bytes(decompress(Path(args.input).read_bytes()))
+    elif args.command == "bench":
+        bench(args.images)
+
+
+if __name__ == "__main__":
+    main()
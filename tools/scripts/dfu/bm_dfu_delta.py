@@ -0,0 +1,222 @@
+"""
+Delta (binary diff) DFU images
+
+Creates patches that rebuild a new image from the image a node is currently running, so only
+the parts of the image that changed have to be sent over the bus. The format must be kept in
+sync with src/lib/bcmp/dfu/bm_dfu_delta.h.
+
+Usage:
+    python3 bm_dfu_delta.py create --base old.bin --target new.bin -o update.patch
+    python3 bm_dfu_delta.py apply --base old.bin --patch update.patch -o new.bin
+    python3 bm_dfu_delta.py info --patch update.patch
+
+The resulting patch is loaded onto the host node with bm_load_img_to_flash.py like any image.
+"""
+
+import argparse
+import struct
+import sys
+from collections import namedtuple
+from pathlib import Path
+
+import crcmod
+
+DELTA_MAGIC = 0x50444D42  # "BMDP"
+DELTA_VERSION = 1
+
+# NOTE: Must be in sync with bm_dfu_delta_header_t
+DELTA_HEADER = namedtuple(
+    "DELTA_HEADER",
+    "magic version base_size base_crc base_sha target_size target_crc target_maj target_min target_sha",
+)
+DELTA_HEADER_STRUCT_ENCODING = "<LBLHLLHBBL"
+
+# NOTE: Must be in sync with bm_dfu_delta_op_t
+DELTA_OP_STRUCT_ENCODING = "<BLL"
+OP_COPY = 0
+OP_INSERT = 1
+OP_SIZE = struct.calcsize(DELTA_OP_STRUCT_ENCODING)
+
+# Matches are found by looking up this many bytes of the target in the base image
+BLOCK_SIZE = 16
+# Longest list of base offsets kept per block, bounds the time spent on repetitive data (padding)
+MAX_CANDIDATES = 8
+# A copy has to save more than the op it replaces
+MIN_COPY_LEN = BLOCK_SIZE + OP_SIZE
+
+VERSION_MAGIC = 0xDF7F9AFDEC06627C
+VERSION_HEADER_STRUCT_ENCODING = "QIBB"
+
+crc16 = crcmod.predefined.mkCrcFun("kermit")
+
+
+def get_version(data: bytes):
+    """Find the version header embedded in a BM image, returns (major, minor, gitSHA)"""
+    header_len = struct.calcsize(VERSION_HEADER_STRUCT_ENCODING)
+    for offset in range(0, len(data) - header_len):
+        magic, sha, major, minor = struct.unpack_from(VERSION_HEADER_STRUCT_ENCODING, data, offset)
+        if magic == VERSION_MAGIC:
+            return major, minor, sha
+    return None
+
+
+def parse_header(patch: bytes) -> DELTA_HEADER:
+    """Returns the delta header, or None if the data isn't a delta image"""
+    if len(patch) < struct.calcsize(DELTA_HEADER_STRUCT_ENCODING):
+        return None
+    header = DELTA_HEADER._make(struct.unpack_from(DELTA_HEADER_STRUCT_ENCODING, patch, 0))
+    if header.magic != DELTA_MAGIC:
+        return None
+    return header
+
+
+def _match_len(base: bytes, src: int, target: bytes, dst: int) -> int:
+    length = 0
+    limit = min(len(base) - src, len(target) - dst)
+    step = 64
+    while length + step <= limit and base[src + length : src + length + step] == target[dst + length : dst + length + step]:
+        length += step
+    while length < limit and base[src + length] == target[dst + length]:
+        length += 1
+    return length
+
+
+def diff(base: bytes, target: bytes):
+    """Greedy COPY/INSERT diff. Returns a list of (opcode, length, src_offset, data)"""
+    index = {}
+    for offset in range(0, len(base) - BLOCK_SIZE + 1):
+        candidates = index.setdefault(base[offset : offset + BLOCK_SIZE], [])
+        if len(candidates) < MAX_CANDIDATES:
+            candidates.append(offset)
+
+    ops = []
+    literal_start = 0
+    pos = 0
+    # Where the last copy would continue in the base image. Code that changed in
+    # place (a constant, a branch offset) resumes matching right there.
+    next_src = None
+    while pos + BLOCK_SIZE <= len(target):
+        candidates = list(index.get(target[pos : pos + BLOCK_SIZE], []))
+        if next_src is not None:
+            candidates.insert(0, next_src + (pos - literal_start))
+        best_len = 0
+        best_src = 0
+        for src in candidates:
+            if src < 0 or src >= len(base):
+                continue
+            length = _match_len(base, src, target, pos)
+            if length > best_len:
+                best_len = length
+                best_src = src
+        if best_len >= MIN_COPY_LEN:
+            if literal_start < pos:
+                ops.append((OP_INSERT, pos - literal_start, 0, target[literal_start:pos]))
+            ops.append((OP_COPY, best_len, best_src, b""))
+            pos += best_len
+            literal_start = pos
+            next_src = best_src + best_len
+        else:
+            pos += 1
+    if literal_start < len(target):
+        ops.append((OP_INSERT, len(target) - literal_start, 0, target[literal_start:]))
+    return ops
+
+
+def create(base: bytes, target: bytes) -> bytes:
+    base_version = get_version(base)
+    target_version = get_version(target)
+    if base_version is None or target_version is None:
+        raise ValueError("Unable to find the version header in the base or target image")
+
+    header = DELTA_HEADER(
+        DELTA_MAGIC,
+        DELTA_VERSION,
+        len(base),
+        crc16(base),
+        base_version[2],
+        len(target),
+        crc16(target),
+        target_version[0],
+        target_version[1],
+        target_version[2],
+    )
+    patch = bytearray(struct.pack(DELTA_HEADER_STRUCT_ENCODING, *header))
+    for opcode, length, src, data in diff(base, target):
+        patch += struct.pack(DELTA_OP_STRUCT_ENCODING, opcode, length, src)
+        patch += data
+    return bytes(patch)
+
+
+def apply(base: bytes, patch: bytes) -> bytes:
+    """Reference implementation of the client's patch applier"""
+    header = parse_header(patch)
+    if header is None or header.version != DELTA_VERSION:
+        raise ValueError("Not a delta image")
+    if header.base_size > len(base) or crc16(base[: header.base_size]) != header.base_crc:
+        raise ValueError("Base image doesn't match the patch")
+
+    out = bytearray()
+    pos = struct.calcsize(DELTA_HEADER_STRUCT_ENCODING)
+    while len(out) < header.target_size:
+        opcode, length, src = struct.unpack_from(DELTA_OP_STRUCT_ENCODING, patch, pos)
+        pos += OP_SIZE
+        if opcode == OP_COPY:
+            if src + length > header.base_size:
+                raise ValueError("Copy past the end of the base image")
+            out += base[src : src + length]
+        elif opcode == OP_INSERT:
+            out += patch[pos : pos + length]
+            pos += length
+        else:
+            raise ValueError(f"Unknown op {opcode}")
+    if len(out) != header.target_size or crc16(bytes(out)) != header.target_crc:
+        raise ValueError("Reconstructed image doesn't match the patch")
+    return bytes(out)
+
+
+def main():
+    parser = argparse.ArgumentParser(formatter_class=argparse.ArgumentDefaultsHelpFormatter)
+    subparsers = parser.add_subparsers(dest="command", required=True)
+
+    create_parser = subparsers.add_parser("create", help="Create a delta image")
+    create_parser.add_argument("--base", required=True, help="Image the client is running")
+    create_parser.add_argument("--target", required=True, help="Image to update the client to")
+    create_parser.add_argument("-o", "--output", required=True, help="Delta image to write")
+
+    apply_parser = subparsers.add_parser("apply", help="Rebuild an image from a delta image")
+    apply_parser.add_argument("--base", required=True, help="Image the patch was made against")
+    apply_parser.add_argument("--patch", required=True, help="Delta image")
+    apply_parser.add_argument("-o", "--output", required=True, help="Image to write")
+
+    info_parser = subparsers.add_parser("info", help="Print the delta image header")
+    info_parser.add_argument("--patch", required=True, help="Delta image")
+
+    args = parser.parse_args()
+
+    if args.command == "create":
+        base = Path(args.base).read_bytes()
+        target = Path(args.target).read_bytes()
+        patch = create(base, target)
+        # Make sure the patch rebuilds the target before anyone sends it to a node
+        if apply(base, patch) != target:
+            print("Patch doesn't reproduce the target image!")
+            sys.exit(1)
+        Path(args.output).write_bytes(patch)
+        print(f"Delta image: {len(patch)} bytes, full image: {len(target)} bytes "
+              f"({100.0 * len(patch) / len(target):.1f}%)")
+    elif args.command == "apply":
+        base = Path(args.base).read_bytes()
+        patch = Path(args.patch).read_bytes()
+        Path(args.output).write_bytes(apply(base, patch))
+    elif args.command == "info":
+        header = parse_header(Path(args.patch).read_bytes())
+        if header is None:
+            print("Not a delta image")
+            sys.exit(1)
+        print(f"Base: size {header.base_size}, crc16 {header.base_crc:04X}, gitSHA {header.base_sha:08X}")
+        print(f"Target: size {header.target_size}, crc16 {header.target_crc:04X}, "
+              f"version {header.target_maj}.{header.target_min}, gitSHA {header.target_sha:08X}")
+
+
+if __name__ == "__main__":
+    main()
@@ -9,6 +9,9 @@ import struct
 from typing import Dict
 from typing import Any
 
+import bm_dfu_compress
+from bm_dfu_delta import get_version, parse_header
+
 CLI_WRITE_SIZE = 128
 CHUNK_SIZE = 512
 
@@ -59,10 +62,34 @@ def main(img_path:str, port:str, baud:int) -> None:
         print("Port does not exist")
         return
 
-    fw_ver = getVersionFromBin(abs_path)
-    major = int(fw_ver["version"].split(".")[0])
-    minor = int(fw_ver["version"].split(".")[1])
-    gitSHA = int(fw_ver["sha"],16)
+    # Get image + crc
+    crc16 = crcmod.predefined.mkCrcFun("kermit")
+    img_data = Path(abs_path).read_bytes()
+    patch_crc = crc16(img_data)
+
+    # A compressed image holds a full or delta image, the header describes what the client ends up with
+    contents = img_data
+    if bm_dfu_compress.parse_header(img_data):
+        contents = bm_dfu_compress.decompress(img_data)
+        print(f"Compressed image, {len(contents)} bytes decompressed")
+
+    delta_header = parse_header(contents)
+    if delta_header:
+        # Delta image, the client checks the CRC of the image it rebuilds from the patch
+        major = delta_header.target_maj
+        minor = delta_header.target_min
+        gitSHA = delta_header.target_sha
+        img_crc = delta_header.target_crc
+        print(f"Delta image for base gitSHA: {delta_header.base_sha:08X}")
+    elif contents is not img_data:
+        major, minor, gitSHA = get_version(contents)
+        img_crc = crc16(contents)
+    else:
+        fw_ver = getVersionFromBin(abs_path)
+        major = int(fw_ver["version"].split(".")[0])
+        minor = int(fw_ver["version"].split(".")[1])
+        gitSHA = int(fw_ver["sha"],16)
+        img_crc = patch_crc
     ser = serial.Serial(
         port=port,
         baudrate=baud,
@@ -72,13 +99,8 @@ def main(img_path:str, port:str, baud:int) -> None:
         timeout=30,
     )
 
-    # Get image + crc
-    crc16 = crcmod.predefined.mkCrcFun("kermit")
-    img_data = Path(abs_path).read_bytes()
-
     # Get image characteristics
     img_size = len(img_data)
-    img_crc = crc16(img_data)
     print(f"Image Info: - size: {img_size}, crc16:{img_crc}, major: {major}, minor: {minor}, gitSHA: {gitSHA}")
 
     # send header
@@ -128,10 +150,10 @@ def main(img_path:str, port:str, baud:int) -> None:
     
     result_str = result_bytes.decode()
     comp_crc16 = int(result_str.split("<crc16>")[1].split('#')[0],16)
-    if comp_crc16 == img_crc:
+    if comp_crc16 == patch_crc:
         print("Validation success! Image loaded in flash!")
     else:
-        print(f"Validation failed crc16: {img_crc} computed crc16: {comp_crc16}")
+        print(f"Validation failed crc16: {patch_crc} computed crc16: {comp_crc16}")
 
 if __name__ == "__main__":
     parser = argparse.ArgumentParser(
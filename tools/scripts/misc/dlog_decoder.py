@@ -0,0 +1,182 @@
+"""
+Decode deferred log records (bm_dlog_record_t) back into text.
+
+Firmware with deferred logging enabled sends the address of each log's format
+string and its raw arguments instead of the formatted text. The format strings
+are looked up in the ELF the firmware was built from. Each record starts with
+the first four bytes of that build's GNU build id, so logs from a network
+running several builds decode as long as every build's ELF is given:
+
+    python dlog_decoder.py -e bridge.elf records.txt
+    python dlog_decoder.py -e bridge.elf -e mote.elf --skip 14 < pubs.txt
+
+Records are read one per line as hex, from a file or stdin.
+
+--skip drops a fixed size header ahead of the record, for example the
+bm_common_log_t or bm_print_publication_t the record was published in.
+"""
+import argparse
+import re
+import struct
+import sys
+
+from elftools.elf.elffile import ELFFile
+
+# Same conversions bm_dlog_encode() accepts
+SPEC_RE = re.compile(r"%([-+ #0']*)(\*|\d+)?(?:\.(\*|\d*))?(hh|h|ll|l|L|q|j|z|t)?([diouxXcpaAeEfFgGs%])")
+
+
+class DlogError(Exception):
+    pass
+
+
+# bm_dlog_record_t header, build id then format string address
+RECORD_HEADER = struct.Struct("<II")
+NT_GNU_BUILD_ID = 3
+
+
+def read_build_id(elffile):
+    """First four bytes of the GNU build id, as the firmware tags its records"""
+    section = elffile.get_section_by_name(".note.gnu.build-id")
+    if section is None:
+        return None
+    data = section.data()
+    namesz, descsz, note_type = struct.unpack_from("<III", data)
+    desc = 12 + (namesz + 3) // 4 * 4
+    if note_type != NT_GNU_BUILD_ID or descsz < 4:
+        return None
+    (build_id,) = struct.unpack_from("<I", data, desc)
+    return build_id
+
+
+def build_id_str(build_id):
+    # Same byte order the build id is printed in everywhere else
+    return struct.pack("<I", build_id).hex()
+
+
+class FormatStrings:
+    """Reads NUL terminated strings out of the ELF's loadable sections"""
+
+    def __init__(self, elf_file_path):
+        self.sections = []
+        with open(elf_file_path, "rb") as f:
+            elffile = ELFFile(f)
+            self.build_id = read_build_id(elffile)
+            for section in elffile.iter_sections():
+                # SHF_ALLOC sections with contents, .rodata and friends
+                if section["sh_flags"] & 0x2 and section["sh_type"] != "SHT_NOBITS":
+                    self.sections.append((section["sh_addr"], section.data()))
+        self.cache = {}
+
+    def get(self, address):
+        if address in self.cache:
+            return self.cache[address]
+        for base, data in self.sections:
+            if base <= address < base + len(data):
+                end = data.find(b"\0", address - base)
+                if end < 0:
+                    break
+                fmt = data[address - base:end].decode("utf-8", errors="replace")
+                self.cache[address] = fmt
+                return fmt
+        raise DlogError(f"no format string at {address:#010x}, is this the right ELF?")
+
+
+class ArgReader:
+    def __init__(self, args):
+        self.args = args
+        self.pos = 0
+
+    def take(self, fmt):
+        size = struct.calcsize(fmt)
+        if self.pos + size > len(self.args):
+            raise DlogError("record is shorter than its format string")
+        (value,) = struct.unpack_from(fmt, self.args, self.pos)
+        self.pos += size
+        return value
+
+    def take_str(self):
+        length = self.take("<B")
+        if self.pos + length > len(self.args):
+            raise DlogError("record is shorter than its format string")
+        value = self.args[self.pos:self.pos + length].decode("utf-8", errors="replace")
+        self.pos += length
+        return value
+
+
+def format_record(fmt, args):
+    """Format the raw arguments the way the firmware's printf would have"""
+    reader = ArgReader(args)
+
+    def convert(match):
+        flags, width, precision, length, conversion = match.groups()
+        if conversion == "%":
+            return "%"
+        flags = flags.replace("'", "")
+        if width == "*":
+            width = str(reader.take("<i"))
+        if precision == "*":
+            precision = str(reader.take("<i"))
+        spec = "%" + flags + (width or "") + ("." + precision if precision is not None else "")
+        wide = length in ("ll", "q", "j")
+
+        if conversion in "di":
+            return (spec + "d") % reader.take("<q" if wide else "<i")
+        if conversion in "ouxX":
+            return (spec + conversion.replace("u", "d")) % reader.take("<Q" if wide else "<I")
+        if conversion == "c":
+            return (spec + "c") % (reader.take("<I") & 0xFF)
+        if conversion == "p":
+            return (spec + "s") % f"{reader.take('<I'):#x}"
+        if conversion in "aA":
+            value = float.hex(reader.take("<d"))
+            return (spec + "s") % (value.upper() if conversion == "A" else value)
+        if conversion in "eEfFgG":
+            return (spec + conversion) % reader.take("<d")
+        return (spec + "s") % reader.take_str()
+
+    text = SPEC_RE.sub(convert, fmt)
+    if reader.pos != len(args):
+        raise DlogError(f"{len(args) - reader.pos} bytes left over after formatting")
+    return text
+
+
+def decode_record(elves, record):
+    """Decode a record with the string table of the build that made it"""
+    if len(record) < RECORD_HEADER.size:
+        raise DlogError("record is too short")
+    build_id, fmt_addr = RECORD_HEADER.unpack_from(record)
+    if build_id not in elves:
+        raise DlogError(f"no ELF given for build {build_id_str(build_id)}")
+    return format_record(elves[build_id].get(fmt_addr), record[RECORD_HEADER.size:])
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Decode deferred log records using the firmware ELF")
+    parser.add_argument("-e", "--elf", required=True, action="append",
+                        help="ELF the logging firmware was built from, repeat for each build on the network")
+    parser.add_argument("--skip", type=int, default=0, help="header bytes ahead of each record")
+    parser.add_argument("input", nargs="?", type=argparse.FileType("r"), default=sys.stdin,
+                        help="hex records, one per line (default: stdin)")
+    args = parser.parse_args()
+
+    elves = {}
+    for elf in args.elf:
+        strings = FormatStrings(elf)
+        if strings.build_id is None:
+            parser.error(f"{elf} has no GNU build id, link it with --build-id")
+        elves[strings.build_id] = strings
+
+    for line in args.input:
+        line = line.strip()
+        if not line:
+            continue
+        try:
+            record = bytes.fromhex(line)[args.skip:]
+            sys.stdout.write(decode_record(elves, record))
+        except (DlogError, ValueError) as e:
+            print(f"\033[91m<undecodable record {line}: {e}>\033[0m")
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,103 @@
+"""
+Decode residual coded raw RBR pressure (APP_PUB_SUB_BM_BRIDGE_RBR_HDR_PRESSURE_RESIDUAL_TYPE).
+
+The layout is described in src/apps/bridge/rbr_pressure_residual_encoder.h.
+
+Messages are read one per line as hex, from a file or stdin:
+
+    python rbr_pressure_decoder.py messages.txt
+    python rbr_pressure_decoder.py --skip 4 < pubs.txt
+
+--skip drops a fixed size header ahead of the message. Each message decodes on
+its own and is printed as JSON, with its header fields and the pressure of
+each of its samples in decibar. first_sample says where the samples go in the
+window of total_samples. Samples of the window that no message covers weren't
+finite or didn't fit a code, the firmware leaves them out.
+"""
+import argparse
+import json
+import struct
+import sys
+
+RBR_PRESSURE_RESIDUAL_VERSION = 1
+RBR_PRESSURE_RESIDUAL_ESCAPE = 16
+RBR_PRESSURE_RESIDUAL_WIDTH_BITS = 6
+
+# rbr_pressure_residual_header_t
+HEADER = struct.Struct("<BBHQQQIIHdii")
+HEADER_FIELDS = ("version", "rice_k", "sequence_num", "reading_time_utc_ms", "reading_uptime_millis",
+                 "sensor_reading_time_ms", "total_samples", "first_sample", "num_samples",
+                 "resolution_dbar", "reference_code", "first_difference")
+
+
+class MessageError(Exception):
+    pass
+
+
+class BitReader:
+    def __init__(self, data):
+        self.data = data
+        self.pos = 0
+
+    def get(self, num_bits):
+        value = 0
+        for _ in range(num_bits):
+            if self.pos >= len(self.data) * 8:
+                raise MessageError("message is truncated")
+            value = (value << 1) | ((self.data[self.pos // 8] >> (7 - self.pos % 8)) & 1)
+            self.pos += 1
+        return value
+
+
+def decode_residual(reader, k):
+    quotient = 0
+    while quotient < RBR_PRESSURE_RESIDUAL_ESCAPE and reader.get(1):
+        quotient += 1
+    if quotient == RBR_PRESSURE_RESIDUAL_ESCAPE:
+        z = reader.get(reader.get(RBR_PRESSURE_RESIDUAL_WIDTH_BITS))
+    else:
+        z = (quotient << k) | reader.get(k)
+    return (z >> 1) ^ -(z & 1)
+
+
+def decode_message(message):
+    if len(message) < HEADER.size:
+        raise MessageError("message is shorter than its header")
+    header = dict(zip(HEADER_FIELDS, HEADER.unpack_from(message)))
+    if header["version"] != RBR_PRESSURE_RESIDUAL_VERSION:
+        raise MessageError(f"unknown message version {header['version']}")
+
+    num_samples = header["num_samples"]
+    codes = [header["reference_code"]]
+    if num_samples > 1:
+        codes.append(codes[0] + header["first_difference"])
+    reader = BitReader(message[HEADER.size:])
+    for _ in range(num_samples - 2):
+        codes.append(decode_residual(reader, header["rice_k"]) + 2 * codes[-1] - codes[-2])
+
+    if (reader.pos + 7) // 8 != len(message) - HEADER.size:
+        raise MessageError(f"{len(message) - HEADER.size - (reader.pos + 7) // 8} bytes left over after the message")
+    header["pressure_deci_bar"] = [round(code * header["resolution_dbar"], 6) for code in codes]
+    return header
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Decode residual coded raw RBR pressure")
+    parser.add_argument("--skip", type=int, default=0, help="header bytes ahead of each message")
+    parser.add_argument("input", nargs="?", type=argparse.FileType("r"), default=sys.stdin,
+                        help="hex messages, one per line (default: stdin)")
+    args = parser.parse_args()
+
+    for line in args.input:
+        line = line.strip()
+        if not line:
+            continue
+        try:
+            message = bytes.fromhex(line)[args.skip:]
+            print(json.dumps(decode_message(message)))
+        except (MessageError, ValueError, struct.error) as e:
+            print(f"\033[91m<undecodable message {line}: {e}>\033[0m")
+
+
+if __name__ == "__main__":
+    main()
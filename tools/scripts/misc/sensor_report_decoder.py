@@ -0,0 +1,178 @@
+"""
+Decode bit-packed sensor reports (APP_PUB_SUB_BM_BRIDGE_SENSOR_REPORT_PACKED_TYPE).
+
+The layout is described in src/apps/bridge/packed_sensor_report_encoder.h, the
+fields of every sensor in src/apps/bridge/sensor_report_schema.h. FIELDS below
+has to be kept in sync with the packed_fields there.
+
+Reports are read one per line as hex, from a file or stdin:
+
+    python sensor_report_decoder.py reports.txt
+    python sensor_report_decoder.py --skip 4 < pubs.txt
+
+--skip drops a fixed size header ahead of the report. Each report is printed
+as JSON, with one list of samples per sensor and the same sample types the
+CBOR report uses.
+"""
+import argparse
+import json
+import math
+import sys
+
+PACKED_SENSOR_REPORT_VERSION = 1
+PACKED_SENSOR_REPORT_ABSOLUTE = 0x1F
+PACKED_SENSOR_REPORT_WIDTH_BITS = 5
+PACKED_SENSOR_REPORT_TYPE_BITS = 4
+PACKED_SENSOR_REPORT_SPECIAL_CODES = 3
+
+
+class ReportError(Exception):
+    pass
+
+
+class Field:
+    """Same code math as packed_sensor_report_double()"""
+
+    def __init__(self, name, min_value, max_value, resolution, integer=False):
+        self.name = name
+        self.min = min_value
+        self.resolution = resolution
+        self.integer = integer
+        self.max_code = int((max_value - min_value) / resolution + 0.5)
+        self.bits = 1
+        while self.bits < 32 and (1 << self.bits) < self.max_code + 1 + PACKED_SENSOR_REPORT_SPECIAL_CODES:
+            self.bits += 1
+
+    def value(self, code):
+        nan_code = (1 << self.bits) - 1
+        if code == nan_code:
+            return math.nan
+        if code == nan_code - 1:
+            return math.inf
+        if code == nan_code - 2:
+            return -math.inf
+        if code > self.max_code:
+            raise ReportError(f"{self.name} code {code} is out of range")
+        if self.integer:
+            return code
+        return round(self.min + code * self.resolution, 6)
+
+
+def uint_field(name, max_value):
+    return Field(name, 0, max_value, 1, integer=True)
+
+
+# abstractSensorType_e -> (sample type, fields in packed order)
+FIELDS = {
+    1: ("aanderaa_current_v0", [
+        Field("abs_speed_mean_cm_s", 0.0, 300.0, 0.01),
+        Field("abs_speed_std_cm_s", 0.0, 300.0, 0.01),
+        Field("direction_circ_mean_rad", 0.0, 2 * math.pi, 0.001),
+        Field("direction_circ_std_rad", 0.0, 2 * math.pi, 0.001),
+        Field("temp_mean_deg_c", -5.0, 40.0, 0.001),
+        Field("abs_tilt_mean_rad", 0.0, math.pi / 2, 0.001),
+        Field("std_tilt_mean_rad", 0.0, math.pi / 2, 0.001),
+        uint_field("reading_count", 0xFFFF),
+    ]),
+    2: ("bm_soft_temp_v0", [
+        Field("temp_mean_deg_c", -20, 61.88, 0.001),
+    ]),
+    3: (None, [
+        uint_field("sensor_type", 3),
+        Field("temp_mean_deg_c", -20, 84.8572, 0.0001),
+        Field("pressure_mean_deci_bar", 5, 200, 0.0001),
+        Field("pressure_stdev_deci_bar", 0, 3.2765, 0.0001),
+    ]),
+    4: ("bm_seapoint_turbidity_v0", [
+        Field("turbidity_s_mean_ftu", 0, 4000, 0.001),
+        Field("turbidity_r_mean_ftu", 0, 4000, 0.001),
+    ]),
+}
+
+# BmRbrDataMsg::SensorType, the RBR sample type depends on what the Coda measures
+RBR_SAMPLE_TYPES = {0: "bm_rbr_unknown", 1: "bm_rbr_t_v0", 2: "bm_rbr_d_v0", 3: "bm_rbr_td_v0"}
+
+
+class BitReader:
+    def __init__(self, data):
+        self.data = data
+        self.pos = 0
+
+    def get(self, num_bits):
+        value = 0
+        for _ in range(num_bits):
+            if self.pos >= len(self.data) * 8:
+                raise ReportError("report is truncated")
+            value = (value << 1) | ((self.data[self.pos // 8] >> (7 - self.pos % 8)) & 1)
+            self.pos += 1
+        return value
+
+
+def decode_field(reader, field, num_samples):
+    code = reader.get(field.bits)
+    codes = [code]
+    if num_samples < 2:
+        return codes
+    width = reader.get(PACKED_SENSOR_REPORT_WIDTH_BITS)
+    for _ in range(num_samples - 1):
+        if width == PACKED_SENSOR_REPORT_ABSOLUTE:
+            code = reader.get(field.bits)
+        else:
+            zig_zag = reader.get(width)
+            code += (zig_zag >> 1) ^ -(zig_zag & 1)
+        codes.append(code)
+    return codes
+
+
+def decode_report(report):
+    reader = BitReader(report)
+    version = reader.get(8)
+    if version != PACKED_SENSOR_REPORT_VERSION:
+        raise ReportError(f"unknown report version {version}")
+    num_sensors = reader.get(8)
+    num_samples = reader.get(16)
+
+    sensors = []
+    for _ in range(num_sensors):
+        sensor_type = reader.get(PACKED_SENSOR_REPORT_TYPE_BITS)
+        if sensor_type not in FIELDS:
+            raise ReportError(f"unknown sensor type {sensor_type}")
+        sample_type, fields = FIELDS[sensor_type]
+        columns = [[field.value(code) for code in decode_field(reader, field, num_samples)]
+                   for field in fields]
+
+        samples = []
+        for i in range(num_samples):
+            values = {field.name: column[i] for field, column in zip(fields, columns)}
+            if sample_type is None:
+                values["sample_type"] = RBR_SAMPLE_TYPES.get(values.pop("sensor_type"), "bm_rbr_unknown")
+            else:
+                values["sample_type"] = sample_type
+            samples.append(values)
+        sensors.append(samples)
+
+    if (reader.pos + 7) // 8 != len(report):
+        raise ReportError(f"{len(report) - (reader.pos + 7) // 8} bytes left over after the report")
+    return sensors
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Decode bit-packed sensor reports")
+    parser.add_argument("--skip", type=int, default=0, help="header bytes ahead of each report")
+    parser.add_argument("input", nargs="?", type=argparse.FileType("r"), default=sys.stdin,
+                        help="hex reports, one per line (default: stdin)")
+    args = parser.parse_args()
+
+    for line in args.input:
+        line = line.strip()
+        if not line:
+            continue
+        try:
+            report = bytes.fromhex(line)[args.skip:]
+            print(json.dumps(decode_report(report)))
+        except (ReportError, ValueError) as e:
+            print(f"\033[91m<undecodable report {line}: {e}>\033[0m")
+
+
+if __name__ == "__main__":
+    main()